@@ -1,9 +1,50 @@
 #include "devices/block.h"
+#include <atomic.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
+#include "threads/vaddr.h"
+
+/* Limits on merging adjacent queued requests into one driver
+   request: at most MERGE_REQS requests and MERGE_SECTORS sectors
+   if their buffers follow one another in memory, or at most
+   BOUNCE_SECTORS through the worker's bounce buffer if not. */
+#define MERGE_REQS 32
+#define MERGE_SECTORS 128
+#define BOUNCE_PAGES 4
+#define BOUNCE_SECTORS (BOUNCE_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Number of batches in a row that the worker may carry out from
+   higher I/O priorities while requests of a lower one wait. */
+#define STARVE_BATCHES 8
+
+/* Priority levels by which a thread's wakeup from a completed
+   request raises its priority, until it next blocks or uses up a
+   time slice.  See thread_boost(). */
+#define IO_BOOST 4
+
+/* Number of I/O groups, and how far ahead of its rate limits, in
+   ns, a group's requests may get, so that a group that has been
+   idle may issue a short burst at full speed.  See struct
+   io_group. */
+#define IO_GROUP_MAX 16
+#define IO_BURST_NS 100000000
+
+/* Number of buckets in the histograms of request latency, by
+   power of 2 microseconds, and of request size, by power of 2
+   sectors. */
+#define LAT_BUCKETS 16
+#define SIZE_BUCKETS 8
 
 /* A block device. */
 struct block
@@ -17,17 +58,118 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    atomic64_t read_cnt;                /* Number of sectors read. */
+    atomic64_t write_cnt;               /* Number of sectors written. */
+
+    /* Queues of requests, one per I/O priority, serviced by a
+       worker thread started on the first call to block_submit().
+       Each is ordered by sector, so that the worker can sweep
+       across the disk. */
+    struct rbtree queue[BLOCK_PRIO_CNT]; /* Pending block_requests. */
+    unsigned skipped[BLOCK_PRIO_CNT];   /* Batches passed over, in a row. */
+    struct lock queue_lock;             /* Protects QUEUE, HEAD and
+                                           THROTTLED. */
+    struct condition queue_nonempty;    /* Signaled on submission. */
+    bool has_worker;                    /* Worker thread started? */
+    struct thread *worker;              /* Worker thread, once running. */
+    block_sector_t head;                /* Sector after the last request. */
+    uint8_t *bounce;                    /* Worker's merge buffer, or null. */
+
+    /* Requests held back by the limits of their I/O groups, which
+       the worker moves to QUEUE once they are due.  See struct
+       io_group. */
+    struct list throttled;              /* Ordered by release time. */
+    bool throttle_waiting;              /* Worker waiting for one? */
+    struct semaphore throttle_wake;     /* Wakes the worker then. */
+    struct timer_callout throttle_timer; /* Ups THROTTLE_WAKE when due. */
+
+    /* Statistics on queued requests, protected by QUEUE_LOCK. */
+    unsigned long long req_cnt;         /* Requests submitted. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+    unsigned long long cmd_cnt;         /* Batches carried out. */
+    unsigned long long lat_hist[LAT_BUCKETS];   /* By latency. */
+    unsigned long long size_hist[SIZE_BUCKETS]; /* By size. */
+    unsigned long long prio_cnt[BLOCK_PRIO_CNT];          /* Submitted. */
+    unsigned long long class_cnt[BLOCK_IO_CLASS_CNT];     /* Requests. */
+    unsigned long long class_sectors[BLOCK_IO_CLASS_CNT]; /* Sectors. */
+    int64_t class_ns[BLOCK_IO_CLASS_CNT];       /* Time in the driver. */
+    unsigned depth;                     /* Requests queued or running. */
+    unsigned max_depth;                 /* Maximum DEPTH. */
+    int64_t depth_ns;                   /* Integral of DEPTH over time. */
+    int64_t depth_since;                /* When DEPTH last changed. */
+    int64_t first_ns;                   /* First submission. */
+  };
+
+/* An I/O group: threads whose block requests share limits on
+   their rate, and counts of those requests.
+
+   A thread belongs to the group of the thread that created it,
+   starting from the default group, group 0, which has no limits,
+   until it calls block_io_group_new().  So a process that makes
+   a new group limits itself and the processes it starts from
+   then on, together.
+
+   A group may limit its requests to IOPS per second and to KBPS
+   kilobytes per second; 0 means no limit.  Each limit keeps a
+   virtual clock.  A request charged at time NOW first advances
+   the clock to NOW, if it is behind, then may start once the
+   clock is no more than IO_BURST_NS ahead of the real one, and
+   moves the clock forward by the request's cost at that rate.
+   block_submit() does not sleep until then: a request that may
+   not start yet goes on its device's throttled list instead of
+   its queue, and the device's worker queues it once it is due,
+   so that other groups' requests go ahead meanwhile. */
+struct io_group
+  {
+    int iops;                           /* Requests per second, or 0. */
+    int kbps;                           /* KB per second, or 0. */
+    int64_t ops_clock;                  /* Virtual clock for IOPS. */
+    int64_t bytes_clock;                /* Virtual clock for KBPS. */
+    size_t thread_cnt;                  /* # of threads; slot free if 0. */
+
+    /* Statistics. */
+    unsigned long long read_cnt;        /* Read requests. */
+    unsigned long long write_cnt;       /* Write requests. */
+    unsigned long long read_sectors;    /* Sectors read. */
+    unsigned long long write_sectors;   /* Sectors written. */
+    unsigned long long throttle_cnt;    /* Requests held back. */
+    int64_t throttle_ns;                /* Time they were held back. */
   };
 
-/* List of all block devices. */
+/* I/O groups, protected by IO_GROUPS_LOCK. */
+static struct io_group io_groups[IO_GROUP_MAX];
+static struct spinlock io_groups_lock;
+
+/* List of all block devices.  Devices are added with
+   rcu_list_push_back(), under ALL_BLOCKS_LOCK, and never removed,
+   so readers need no lock: a device is on the list only once it
+   is fully initialized. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
+static struct spinlock all_blocks_lock;
 
 /* The block block assigned to each Pintos role. */
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static rbtree_less_func request_less;
+static thread_func block_worker NO_RETURN;
+static void transfer (struct block *, block_sector_t, void *,
+                      block_sector_t cnt, bool write);
+static void sync_transfer (struct block *, block_sector_t, void *,
+                           block_sector_t cnt, bool write);
+static void submit (struct block *, struct block_request *,
+                    block_sector_t, void *, block_sector_t cnt, bool write,
+                    enum block_io_class, block_complete_func *, void *aux);
+static void change_depth (struct block *, int delta, int64_t now);
+static void account_thread (block_sector_t cnt, bool write);
+static void charge_request (struct block_request *);
+static list_less_func release_less;
+static bool hold_behind_throttled (struct block *, struct block_request *);
+static timer_callout_func throttle_expired;
+static enum block_io_prio current_io_prio (void);
+static bool queue_empty (struct block *);
+static void print_queue_stats (struct block *);
+static void print_io_groups (void);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -86,17 +228,23 @@ block_next (struct block *block)
 struct block *
 block_get_by_name (const char *name)
 {
+  struct block *found = NULL;
   struct list_elem *e;
 
+  rcu_read_lock ();
   for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
        e = list_next (e))
     {
       struct block *block = list_entry (e, struct block, list_elem);
       if (!strcmp (name, block->name))
-        return block;
+        {
+          found = block;
+          break;
+        }
     }
+  rcu_read_unlock ();
 
-  return NULL;
+  return found;
 }
 
 /* Verifies that SECTOR is a valid offset within BLOCK.
@@ -121,8 +269,7 @@ void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
   check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  sync_transfer (block, sector, buffer, 1, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -135,8 +282,711 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
   check_sector (block, sector);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  sync_transfer (block, sector, (void *) buffer, 1, true);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses a single driver request if the driver supports
+   it.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer, block_sector_t cnt)
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  sync_transfer (block, sector, buffer, cnt, false);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses a single driver request if the driver supports it.
+   Returns after the block device has acknowledged receiving the
+   data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer, block_sector_t cnt)
+{
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  sync_transfer (block, sector, (void *) buffer, cnt, true);
+}
+
+/* Carries out a synchronous transfer for the functions above:
+   through BLOCK's queue, so that it is scheduled along with
+   everyone else's requests, or straight to the driver if waiting
+   is impossible or the caller is BLOCK's own worker. */
+static void
+sync_transfer (struct block *block, block_sector_t sector, void *buffer,
+               block_sector_t cnt, bool write)
+{
+  TRACE (TRACE_BLOCK, write ? TRACE_BLOCK_WRITE : TRACE_BLOCK_READ,
+         sector, cnt);
+  if (!intr_context () && intr_get_level () == INTR_ON
+      && thread_current () != block->worker)
+    {
+      struct block_request r;
+
+      block_submit (block, &r, sector, buffer, cnt, write);
+      block_wait (&r);
+    }
+  else
+    {
+      if (!intr_context ())
+        account_thread (cnt, write);
+      transfer (block, sector, buffer, cnt, write);
+    }
+}
+
+/* Counts a request for CNT sectors, a write if WRITE or a read
+   otherwise, in the resources used by the running thread. */
+static void
+account_thread (block_sector_t cnt, bool write)
+{
+  struct rusage *usage = &thread_current ()->rusage;
+
+  if (write)
+    {
+      usage->oublock += cnt;
+      usage->ouops++;
+    }
+  else
+    {
+      usage->inblock += cnt;
+      usage->inops++;
+    }
+}
+
+/* Transfers CNT consecutive sectors starting at SECTOR between
+   BLOCK and BUFFER in a single driver request, if the driver
+   supports it, or one sector at a time otherwise. */
+static void
+transfer (struct block *block, block_sector_t sector, void *buffer_,
+          block_sector_t cnt, bool write)
+{
+  uint8_t *buffer = buffer_;
+  block_sector_t i;
+
+  if (write)
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, buffer, cnt);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->write (block->aux, sector + i,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+      atomic64_add (&block->write_cnt, cnt);
+    }
+  else
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, buffer, cnt);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->read (block->aux, sector + i,
+                            buffer + i * BLOCK_SECTOR_SIZE);
+      atomic64_add (&block->read_cnt, cnt);
+    }
+}
+
+/* Queues a request to transfer CNT consecutive sectors starting
+   at SECTOR between BLOCK and BUFFER, writing to BLOCK if WRITE
+   is true or reading from it otherwise, and returns without
+   waiting for the transfer.  R describes the request; it and
+   BUFFER must stay valid until block_wait(R) returns.
+
+   Each device's worker thread sweeps its queue in increasing
+   sector order, then starts over from the lowest sector (C-LOOK
+   scheduling), carrying out adjacent requests in the same
+   direction as one driver request.  Requests are queued by the
+   I/O priority of the thread that submits them, from its base
+   priority under priority scheduling, or from its nice value
+   when the scheduling class ignores priorities, and the worker
+   serves the highest priority first, except that a lower one
+   waits for at most STARVE_BATCHES batches in a row.  A thread
+   woken by block_wait() gets a brief priority boost, so that it
+   can issue its next request before CPU-bound threads run.
+   Each request is also charged to the I/O group of the thread
+   that submits it, and waits on the throttled list, rather than
+   in the queue, until the group's limits allow it to start; see
+   struct io_group, as does any later request that starts at the
+   same sector as one there.  So a caller may have several
+   requests in flight, but requests for overlapping sectors are
+   not ordered with respect to each other unless they start at
+   the same sector: wait for one before submitting the other.
+   Requests to devices on different channels proceed
+   concurrently. */
+void
+block_submit (struct block *block, struct block_request *r,
+              block_sector_t sector, void *buffer, block_sector_t cnt,
+              bool write)
+{
+  block_submit_callback (block, r, sector, buffer, cnt, write, NULL, NULL);
+}
+
+/* Queues a request as block_submit() does.  If COMPLETE is
+   non-null, BLOCK's worker thread calls it, passing R and AUX,
+   once the transfer is done, instead of waking up block_wait(),
+   and does not touch R afterward. */
+void
+block_submit_callback (struct block *block, struct block_request *r,
+                       block_sector_t sector, void *buffer,
+                       block_sector_t cnt, bool write,
+                       block_complete_func *complete, void *aux)
+{
+  submit (block, r, sector, buffer, cnt, write,
+          block->type == BLOCK_SWAP ? BLOCK_IO_SWAP : BLOCK_IO_DATA,
+          complete, aux);
+}
+
+/* Queues a request as block_submit() does, counting it in
+   BLOCK's statistics as I/O of the given CLASS instead of the
+   device's default, which is swap for swap devices and data for
+   all others. */
+void
+block_submit_class (struct block *block, struct block_request *r,
+                    block_sector_t sector, void *buffer,
+                    block_sector_t cnt, bool write,
+                    enum block_io_class class)
+{
+  ASSERT (class < BLOCK_IO_CLASS_CNT);
+  submit (block, r, sector, buffer, cnt, write, class, NULL, NULL);
+}
+
+/* Queues request R, described by the other arguments, on BLOCK.
+   For the block_submit*() functions. */
+static void
+submit (struct block *block, struct block_request *r,
+        block_sector_t sector, void *buffer, block_sector_t cnt,
+        bool write, enum block_io_class class,
+        block_complete_func *complete, void *aux)
+{
+  ASSERT (r != NULL);
+  ASSERT (buffer != NULL);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+
+  if (cnt > 0)
+    {
+      check_sector (block, sector);
+      check_sector (block, sector + cnt - 1);
+    }
+
+  r->sector = sector;
+  r->buffer = buffer;
+  r->cnt = cnt;
+  r->write = write;
+  r->io_class = class;
+  r->io_prio = current_io_prio ();
+  r->complete = complete;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+  r->io_group = (intr_context () || thread_current ()->io_group == NULL
+                 ? &io_groups[0] : thread_current ()->io_group);
+  charge_request (r);
+
+  lock_acquire (&block->queue_lock);
+  if (!block->has_worker)
+    {
+      char name[sizeof block->name + 3];
+
+      block->has_worker = true;
+      snprintf (name, sizeof name, "io-%s", block->name);
+      if (thread_create (name, PRI_MAX, block_worker, block) == TID_ERROR)
+        PANIC ("cannot start I/O worker for %s", block->name);
+    }
+  r->submit_ns = clock_ns ();
+  if (hold_behind_throttled (block, r) || r->release_ns > r->submit_ns)
+    list_insert_ordered (&block->throttled, &r->throttle_elem,
+                         release_less, NULL);
+  else
+    rbtree_insert (&block->queue[r->io_prio], &r->elem);
+  block->prio_cnt[r->io_prio]++;
+  if (block->req_cnt++ == 0)
+    block->first_ns = block->depth_since = r->submit_ns;
+  change_depth (block, 1, r->submit_ns);
+  if (block->throttle_waiting)
+    sema_up (&block->throttle_wake);
+  else
+    cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Advances the virtual clock *CLOCK of an I/O group's limit, at
+   time NOW, by COST ns, the time a request takes at the limit's
+   rate, and returns the time at which the request may start. */
+static int64_t
+charge_limit (int64_t *clock, int64_t cost, int64_t now)
+{
+  int64_t release;
+
+  if (*clock < now)
+    *clock = now;
+  release = *clock - IO_BURST_NS > now ? *clock - IO_BURST_NS : now;
+  *clock += cost;
+  return release;
+}
+
+/* Counts request R, about to be queued, in the resources used by
+   the running thread and in the statistics of its I/O group, and
+   charges it against the group's limits, setting R's release
+   time, before which it may not start. */
+static void
+charge_request (struct block_request *r)
+{
+  struct io_group *g = r->io_group;
+  enum intr_level old_level;
+  int64_t now = clock_ns ();
+
+  if (!intr_context ())
+    account_thread (r->cnt, r->write);
+
+  old_level = spinlock_acquire (&io_groups_lock);
+  if (r->write)
+    {
+      g->write_cnt++;
+      g->write_sectors += r->cnt;
+    }
+  else
+    {
+      g->read_cnt++;
+      g->read_sectors += r->cnt;
+    }
+
+  r->release_ns = now;
+  if (g->iops > 0)
+    r->release_ns = charge_limit (&g->ops_clock, 1000000000 / g->iops, now);
+  if (g->kbps > 0)
+    {
+      int64_t cost = ((int64_t) r->cnt * BLOCK_SECTOR_SIZE * 1000000000
+                      / ((int64_t) g->kbps * 1024));
+      int64_t release = charge_limit (&g->bytes_clock, cost, now);
+
+      if (release > r->release_ns)
+        r->release_ns = release;
+    }
+  if (r->release_ns > now)
+    {
+      g->throttle_cnt++;
+      g->throttle_ns += r->release_ns - now;
+    }
+  spinlock_release (&io_groups_lock, old_level);
+}
+
+/* Orders block requests A and B by release time. */
+static bool
+release_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request,
+                                              throttle_elem);
+  const struct block_request *b = list_entry (b_, struct block_request,
+                                              throttle_elem);
+
+  return a->release_ns < b->release_ns;
+}
+
+/* Returns true if a request on BLOCK's throttled list starts at
+   the same sector as R, which then must wait there behind it,
+   and delays R's release time to no earlier than that request's,
+   so that both start in the order submitted.  BLOCK's queue lock
+   must be held. */
+static bool
+hold_behind_throttled (struct block *block, struct block_request *r)
+{
+  struct list_elem *e;
+  bool behind = false;
+
+  for (e = list_begin (&block->throttled); e != list_end (&block->throttled);
+       e = list_next (e))
+    {
+      struct block_request *t = list_entry (e, struct block_request,
+                                            throttle_elem);
+      if (t->sector == r->sector)
+        {
+          behind = true;
+          if (t->release_ns > r->release_ns)
+            r->release_ns = t->release_ns;
+        }
+    }
+  return behind;
+}
+
+/* Waits until request R, submitted by block_submit(), has been
+   carried out. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Returns the I/O priority for a request that the running
+   thread submits.  Its base priority is used, not one donated or
+   boosted, so that it is the same from one request to the
+   next. */
+static enum block_io_prio
+current_io_prio (void)
+{
+  struct thread *t = thread_current ();
+
+  if (sched_class->donation)
+    return (t->base_priority > PRI_DEFAULT ? BLOCK_PRIO_HIGH
+            : t->base_priority < PRI_DEFAULT ? BLOCK_PRIO_LOW
+            : BLOCK_PRIO_NORMAL);
+  else
+    return (t->nice < 0 ? BLOCK_PRIO_HIGH
+            : t->nice > 0 ? BLOCK_PRIO_LOW
+            : BLOCK_PRIO_NORMAL);
+}
+
+/* Returns true if none of BLOCK's queues holds a request.
+   BLOCK's queue lock must be held. */
+static bool
+queue_empty (struct block *block)
+{
+  int prio;
+
+  for (prio = 0; prio < BLOCK_PRIO_CNT; prio++)
+    if (!rbtree_empty (&block->queue[prio]))
+      return false;
+  return true;
+}
+
+/* Adds DELTA to BLOCK's queue depth at time NOW, accumulating
+   the time spent at the old depth.  BLOCK's queue lock must be
+   held. */
+static void
+change_depth (struct block *block, int delta, int64_t now)
+{
+  block->depth_ns += block->depth * (now - block->depth_since);
+  block->depth_since = now;
+  block->depth += delta;
+  if (block->depth > block->max_depth)
+    block->max_depth = block->depth;
+}
+
+/* Returns the base-2 logarithm of X, rounded down, or 0 if X is
+   0, but at most CNT - 1: the index of X's bucket in a histogram
+   of CNT power-of-2 buckets. */
+static int
+log2_bucket (uint64_t x, int cnt)
+{
+  int k = 0;
+
+  while (x > 1 && k < cnt - 1)
+    {
+      x >>= 1;
+      k++;
+    }
+  return k;
+}
+
+/* Counts the CNT requests in BATCH, which were carried out on
+   BLOCK from time START to END, in BLOCK's statistics.  BLOCK's
+   queue lock must be held. */
+static void
+account_batch (struct block *block, struct block_request *batch[],
+               size_t cnt, int64_t start, int64_t end)
+{
+  block_sector_t sector_cnt = 0;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  for (i = 0; i < cnt; i++)
+    sector_cnt += batch[i]->cnt;
+
+  block->cmd_cnt++;
+  for (i = 0; i < cnt; i++)
+    {
+      struct block_request *r = batch[i];
+      enum block_io_class class = r->io_class;
+
+      block->lat_hist[log2_bucket ((end - r->submit_ns) / 1000,
+                                   LAT_BUCKETS)]++;
+      block->size_hist[log2_bucket (r->cnt, SIZE_BUCKETS)]++;
+      block->class_cnt[class]++;
+      block->class_sectors[class] += r->cnt;
+
+      /* Charge each request its share of the batch's time. */
+      if (sector_cnt > 0)
+        block->class_ns[class] += (end - start) * r->cnt / sector_cnt;
+    }
+  change_depth (block, -(int) cnt, end);
+}
+
+/* Orders block requests A and B by first sector. */
+static bool
+request_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = rbtree_entry (a_, struct block_request,
+                                                elem);
+  const struct block_request *b = rbtree_entry (b_, struct block_request,
+                                                elem);
+
+  return a->sector < b->sector;
+}
+
+/* Returns true if B's buffer begins where A's ends. */
+static bool
+follows (const struct block_request *a, const struct block_request *b)
+{
+  return ((uint8_t *) b->buffer
+          == (uint8_t *) a->buffer + a->cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the queue of BLOCK, which must not all be empty, to
+   take the next batch from: the highest priority one that holds
+   a request, unless a lower one has been passed over
+   STARVE_BATCHES times in a row.  BLOCK's queue lock must be
+   held. */
+static struct rbtree *
+pick_queue (struct block *block)
+{
+  int prio, pick = -1;
+
+  for (prio = 0; prio < BLOCK_PRIO_CNT; prio++)
+    if (!rbtree_empty (&block->queue[prio])
+        && (pick < 0 || block->skipped[prio] >= STARVE_BATCHES))
+      pick = prio;
+  ASSERT (pick >= 0);
+
+  for (prio = 0; prio < BLOCK_PRIO_CNT; prio++)
+    if (prio == pick || rbtree_empty (&block->queue[prio]))
+      block->skipped[prio] = 0;
+    else
+      block->skipped[prio]++;
+  return &block->queue[pick];
+}
+
+/* Removes the next requests to carry out from BLOCK's queues,
+   which must not all be empty, and stores them in BATCH.
+   Returns the number of requests, between 1 and MERGE_REQS.
+
+   The first is the lowest-numbered request, in the queue that
+   pick_queue() chooses, at or after the sector where the last
+   batch ended, or the lowest-numbered request in that queue if
+   there is none.  It is followed by as many requests from the
+   same queue as can be merged with it into one transfer.
+   BLOCK's queue lock must be held. */
+static size_t
+pick_batch (struct block *block, struct block_request *batch[])
+{
+  struct block_request key, *first, *last;
+  struct rbtree *queue;
+  struct rbtree_elem *e;
+  block_sector_t sector_cnt;
+  bool contiguous = true;
+  size_t cnt, i;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  queue = pick_queue (block);
+  key.sector = block->head;
+  e = rbtree_lower_bound (queue, &key.elem);
+  if (e == NULL)
+    e = rbtree_min (queue);
+  first = last = rbtree_entry (e, struct block_request, elem);
+  batch[0] = first;
+  sector_cnt = first->cnt;
+
+  for (cnt = 1; cnt < MERGE_REQS; cnt++)
+    {
+      struct block_request *r;
+
+      e = rbtree_next (&last->elem);
+      if (e == NULL)
+        break;
+      r = rbtree_entry (e, struct block_request, elem);
+      if (r->write != first->write || r->sector != first->sector + sector_cnt)
+        break;
+
+      contiguous = contiguous && follows (last, r);
+      if (contiguous
+          ? sector_cnt + r->cnt > MERGE_SECTORS
+          : block->bounce == NULL || sector_cnt + r->cnt > BOUNCE_SECTORS)
+        break;
+
+      batch[cnt] = last = r;
+      sector_cnt += r->cnt;
+    }
+
+  for (i = 0; i < cnt; i++)
+    rbtree_remove (queue, &batch[i]->elem);
+  block->merge_cnt += cnt - 1;
+  block->head = first->sector + sector_cnt;
+  return cnt;
+}
+
+/* Carries out the CNT requests in BATCH, chosen by pick_batch(),
+   on BLOCK as a single transfer, going through BLOCK's bounce
+   buffer if their buffers do not follow one another. */
+static void
+run_batch (struct block *block, struct block_request *batch[], size_t cnt)
+{
+  struct block_request *first = batch[0];
+  block_sector_t sector_cnt = 0;
+  bool contiguous = true;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      if (i > 0 && !follows (batch[i - 1], batch[i]))
+        contiguous = false;
+      sector_cnt += batch[i]->cnt;
+    }
+  if (sector_cnt == 0)
+    return;
+
+  if (contiguous)
+    transfer (block, first->sector, first->buffer, sector_cnt, first->write);
+  else
+    {
+      uint8_t *p;
+
+      if (first->write)
+        for (p = block->bounce, i = 0; i < cnt; i++)
+          {
+            memcpy (p, batch[i]->buffer, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+            p += batch[i]->cnt * BLOCK_SECTOR_SIZE;
+          }
+      transfer (block, first->sector, block->bounce, sector_cnt,
+                first->write);
+      if (!first->write)
+        for (p = block->bounce, i = 0; i < cnt; i++)
+          {
+            memcpy (batch[i]->buffer, p, batch[i]->cnt * BLOCK_SECTOR_SIZE);
+            p += batch[i]->cnt * BLOCK_SECTOR_SIZE;
+          }
+    }
+}
+
+/* Calls the completion callback of block request R_, as
+   deferred work. */
+static void
+run_complete (void *r_)
+{
+  struct block_request *r = r_;
+
+  r->complete (r, r->aux);
+}
+
+/* Moves the requests on BLOCK's throttled list that are due to
+   their queues.  BLOCK's queue lock must be held. */
+static void
+release_throttled (struct block *block)
+{
+  int64_t now = clock_ns ();
+
+  while (!list_empty (&block->throttled))
+    {
+      struct block_request *r = list_entry (list_front (&block->throttled),
+                                            struct block_request,
+                                            throttle_elem);
+      if (r->release_ns > now)
+        break;
+      list_pop_front (&block->throttled);
+      rbtree_insert (&block->queue[r->io_prio], &r->elem);
+    }
+}
+
+/* Waits until the first request on BLOCK's throttled list, which
+   must not be empty, is due, or until another request is
+   submitted.  BLOCK's queue lock must be held; it is released
+   meanwhile. */
+static void
+wait_throttled (struct block *block)
+{
+  struct block_request *r = list_entry (list_front (&block->throttled),
+                                        struct block_request,
+                                        throttle_elem);
+  int64_t delay = r->release_ns - clock_ns ();
+  int64_t ticks = delay > 0 ? DIV_ROUND_UP (delay * TIMER_FREQ,
+                                            1000000000) : 1;
+
+  block->throttle_waiting = true;
+  timer_callout_add (&block->throttle_timer, timer_ticks () + ticks);
+  lock_release (&block->queue_lock);
+
+  sema_down (&block->throttle_wake);
+
+  lock_acquire (&block->queue_lock);
+  block->throttle_waiting = false;
+  timer_callout_cancel (&block->throttle_timer);
+  while (sema_try_down (&block->throttle_wake))
+    continue;
+}
+
+/* Wakes up the worker of block device BLOCK_, waiting in
+   wait_throttled(), from the timer interrupt. */
+static void
+throttle_expired (void *block_)
+{
+  struct block *block = block_;
+
+  sema_up (&block->throttle_wake);
+}
+
+/* Worker thread of block device BLOCK_, which carries out the
+   requests in its queue, a batch at a time. */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+
+  block->worker = thread_current ();
+  block->bounce = palloc_get_multiple (0, BOUNCE_PAGES);
+
+  for (;;)
+    {
+      struct block_request *batch[MERGE_REQS];
+      int64_t start, end;
+      size_t cnt, i;
+
+      lock_acquire (&block->queue_lock);
+      for (;;)
+        {
+          release_throttled (block);
+          if (!queue_empty (block))
+            break;
+          if (list_empty (&block->throttled))
+            cond_wait (&block->queue_nonempty, &block->queue_lock);
+          else
+            wait_throttled (block);
+        }
+      cnt = pick_batch (block, batch);
+      lock_release (&block->queue_lock);
+
+      start = clock_ns ();
+      run_batch (block, batch, cnt);
+      end = clock_ns ();
+
+      lock_acquire (&block->queue_lock);
+      account_batch (block, batch, cnt, start, end);
+      lock_release (&block->queue_lock);
+
+      for (i = 0; i < cnt; i++)
+        {
+          struct block_request *r = batch[i];
+
+          if (r->complete != NULL)
+            {
+              work_init (&r->work, run_complete, r);
+              work_queue (&system_wq, &r->work);
+            }
+          else
+            sema_up_boost (&r->done, IO_BOOST);
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -173,9 +1023,157 @@ block_print_stats (void)
         {
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  atomic64_read (&block->read_cnt),
+                  atomic64_read (&block->write_cnt));
+          if (block->req_cnt > 0)
+            print_queue_stats (block);
         }
     }
+  print_io_groups ();
+}
+
+/* Prints statistics on the requests queued to BLOCK.  Does not
+   take BLOCK's queue lock, so that it works at any time, at the
+   cost of possibly printing counts that disagree slightly. */
+static void
+print_queue_stats (struct block *block)
+{
+  static const char *class_names[BLOCK_IO_CLASS_CNT] =
+    { "data", "metadata", "swap" };
+  int64_t now = clock_ns ();
+  int64_t elapsed, depth_ns;
+  unsigned avg_depth;
+  int i;
+
+  elapsed = now - block->first_ns;
+  depth_ns = block->depth_ns + block->depth * (now - block->depth_since);
+  avg_depth = elapsed > 0 ? depth_ns * 100 / elapsed : 0;
+
+  printf ("%s: %llu requests queued, %llu merged, in %llu commands; "
+          "queue depth %u.%02u average, %u maximum\n",
+          block->name, block->req_cnt, block->merge_cnt, block->cmd_cnt,
+          avg_depth / 100, avg_depth % 100, block->max_depth);
+
+  printf ("%s: requests by I/O priority: high %llu, normal %llu, "
+          "low %llu\n", block->name, block->prio_cnt[BLOCK_PRIO_HIGH],
+          block->prio_cnt[BLOCK_PRIO_NORMAL],
+          block->prio_cnt[BLOCK_PRIO_LOW]);
+
+  for (i = 0; i < BLOCK_IO_CLASS_CNT; i++)
+    if (block->class_cnt[i] > 0)
+      printf ("%s: %s: %llu requests, %llu sectors, %"PRId64" us busy\n",
+              block->name, class_names[i], block->class_cnt[i],
+              block->class_sectors[i], block->class_ns[i] / 1000);
+
+  printf ("%s: requests by size in sectors, rounded down to a power of 2:",
+          block->name);
+  for (i = 0; i < SIZE_BUCKETS; i++)
+    if (block->size_hist[i] > 0)
+      printf (" %s%d: %llu", i == SIZE_BUCKETS - 1 ? ">=" : "",
+              1 << i, block->size_hist[i]);
+  printf ("\n");
+
+  printf ("%s: requests by latency in us:", block->name);
+  for (i = 0; i < LAT_BUCKETS; i++)
+    if (block->lat_hist[i] > 0)
+      printf (" %s%d: %llu", i == LAT_BUCKETS - 1 ? ">=" : "<",
+              i == LAT_BUCKETS - 1 ? 1 << i : 2 << i, block->lat_hist[i]);
+  printf ("\n");
+}
+
+/* Prints the requests of each I/O group, if any group other than
+   group 0 has submitted one, and how long its limits held them
+   back. */
+static void
+print_io_groups (void)
+{
+  int i;
+
+  for (i = 1; i < IO_GROUP_MAX; i++)
+    if (io_groups[i].read_cnt + io_groups[i].write_cnt > 0)
+      break;
+  if (i >= IO_GROUP_MAX)
+    return;
+
+  for (i = 0; i < IO_GROUP_MAX; i++)
+    {
+      struct io_group *g = &io_groups[i];
+
+      if (g->read_cnt + g->write_cnt == 0)
+        continue;
+      printf ("I/O group %d: %llu reads, %llu sectors; "
+              "%llu writes, %llu sectors\n", i, g->read_cnt,
+              g->read_sectors, g->write_cnt, g->write_sectors);
+      if (g->iops > 0 || g->kbps > 0)
+        printf ("I/O group %d: limits %d IOPS, %d KB/s; %llu requests "
+                "held back, %"PRId64" ms in all\n", i, g->iops, g->kbps,
+                g->throttle_cnt, g->throttle_ns / 1000000);
+    }
+}
+
+/* Moves the running thread into a new I/O group, described above
+   struct io_group, that limits its block requests to IOPS per
+   second and KBPS kilobytes per second, where 0 means no limit.
+   The threads it creates from now on join the new group.
+   Returns the group's number, or -1 if a limit is negative or
+   there are too many groups. */
+int
+block_io_group_new (int iops, int kbps)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int i;
+
+  if (iops < 0 || kbps < 0)
+    return -1;
+
+  old_level = spinlock_acquire (&io_groups_lock);
+  for (i = 1; i < IO_GROUP_MAX; i++)
+    if (io_groups[i].thread_cnt == 0)
+      {
+        struct io_group *g = &io_groups[i];
+
+        memset (g, 0, sizeof *g);
+        g->iops = iops;
+        g->kbps = kbps;
+
+        if (cur->io_group != NULL)
+          cur->io_group->thread_cnt--;
+        cur->io_group = g;
+        g->thread_cnt++;
+        break;
+      }
+  spinlock_release (&io_groups_lock, old_level);
+
+  return i < IO_GROUP_MAX ? i : -1;
+}
+
+/* Counts a new thread into I/O group G, or does nothing if G is
+   null, for the default group.  Called by thread_create(). */
+void
+block_io_group_join (struct io_group *g)
+{
+  enum intr_level old_level;
+
+  if (g == NULL)
+    return;
+  old_level = spinlock_acquire (&io_groups_lock);
+  g->thread_cnt++;
+  spinlock_release (&io_groups_lock, old_level);
+}
+
+/* Counts an exiting thread out of I/O group G, or does nothing if
+   G is null, for the default group.  Called by thread_exit(). */
+void
+block_io_group_leave (struct io_group *g)
+{
+  enum intr_level old_level;
+
+  if (g == NULL)
+    return;
+  old_level = spinlock_acquire (&io_groups_lock);
+  g->thread_cnt--;
+  spinlock_release (&io_groups_lock, old_level);
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -188,18 +1186,38 @@ block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
 {
-  struct block *block = malloc (sizeof *block);
+  struct block *block = calloc (1, sizeof *block);
+  enum intr_level old_level;
+  int i;
+
   if (block == NULL)
     PANIC ("Failed to allocate memory for block device descriptor");
 
-  list_push_back (&all_blocks, &block->list_elem);
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  atomic64_set (&block->read_cnt, 0);
+  atomic64_set (&block->write_cnt, 0);
+  for (i = 0; i < BLOCK_PRIO_CNT; i++)
+    rbtree_init (&block->queue[i], request_less, NULL);
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  block->has_worker = false;
+  block->worker = NULL;
+  block->head = 0;
+  block->bounce = NULL;
+  block->req_cnt = 0;
+  block->merge_cnt = 0;
+  list_init (&block->throttled);
+  block->throttle_waiting = false;
+  sema_init (&block->throttle_wake, 0);
+  timer_callout_init (&block->throttle_timer, throttle_expired, block);
+
+  old_level = spinlock_acquire (&all_blocks_lock);
+  rcu_list_push_back (&all_blocks, &block->list_elem);
+  spinlock_release (&all_blocks_lock, old_level);
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -3,6 +3,11 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+#include "threads/workqueue.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,18 +58,96 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *,
+                          block_sector_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           block_sector_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* What a block request is for, for statistics. */
+enum block_io_class
+  {
+    BLOCK_IO_DATA,              /* File data, or anything else. */
+    BLOCK_IO_META,              /* File system metadata. */
+    BLOCK_IO_SWAP,              /* Swap. */
+    BLOCK_IO_CLASS_CNT
+  };
+
+/* I/O priority of a block request, from the priority of the
+   thread that submits it.  See block_submit(). */
+enum block_io_prio
+  {
+    BLOCK_PRIO_HIGH,            /* Above the default priority. */
+    BLOCK_PRIO_NORMAL,          /* At the default priority. */
+    BLOCK_PRIO_LOW,             /* Below the default priority. */
+    BLOCK_PRIO_CNT
+  };
+
+/* An asynchronous block request.  See block_submit(). */
+struct block_request;
+
+/* Called from the system workqueue when request R, submitted by
+   block_submit_callback() with auxiliary data AUX, has been
+   carried out, so that the device's worker thread can go on to
+   its next batch meanwhile.  Should not sleep for long. */
+typedef void block_complete_func (struct block_request *r, void *aux);
+
+struct block_request
+  {
+    block_sector_t sector;              /* First sector. */
+    void *buffer;                       /* Data to transfer. */
+    block_sector_t cnt;                 /* Number of sectors. */
+    bool write;                         /* Write, or read? */
+    enum block_io_class io_class;       /* For statistics. */
+    enum block_io_prio io_prio;         /* Order among queued requests. */
+    block_complete_func *complete;      /* Completion callback, or null. */
+    void *aux;                          /* Passed to COMPLETE. */
+    int64_t submit_ns;                  /* clock_ns() at submission. */
+    struct io_group *io_group;          /* Submitter's I/O group. */
+    int64_t release_ns;                 /* Earliest start allowed. */
+    struct list_elem throttle_elem;     /* Element in throttled list. */
+    struct semaphore done;              /* Upped on completion. */
+    struct work work;                   /* Runs COMPLETE. */
+    struct rbtree_elem elem;            /* Element in device queue. */
+  };
+
+void block_submit (struct block *, struct block_request *,
+                   block_sector_t, void *, block_sector_t cnt,
+                   bool write);
+void block_submit_callback (struct block *, struct block_request *,
+                            block_sector_t, void *, block_sector_t cnt,
+                            bool write, block_complete_func *,
+                            void *aux);
+void block_submit_class (struct block *, struct block_request *,
+                         block_sector_t, void *, block_sector_t cnt,
+                         bool write, enum block_io_class);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+
+/* I/O groups, which share limits on the rate of block requests.
+   See block_io_group_new(). */
+struct io_group;
+int block_io_group_new (int iops, int kbps);
+void block_io_group_join (struct io_group *);
+void block_io_group_leave (struct io_group *);
 
 /* Lower-level interface to block device drivers. */
 
+/* READ_MULTIPLE and WRITE_MULTIPLE transfer CNT consecutive
+   sectors in a single request.  They are optional; if a driver
+   leaves them null, the block layer falls back to one READ or
+   WRITE per sector. */
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, void *buffer,
+                           block_sector_t cnt);
+    void (*write_multiple) (void *aux, block_sector_t, const void *buffer,
+                            block_sector_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
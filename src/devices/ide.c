@@ -5,13 +5,25 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If a PCI IDE controller capable of bus mastering is found, as
+   in Bochs and QEMU, sectors are transferred by DMA, as
+   described in [BMIDE]: the controller copies them between the
+   disk and memory on its own while the CPU does other work, and
+   the disk interrupts once, when the whole transfer is done.
+   Otherwise, or if a DMA transfer fails, the driver falls back
+   to programmed I/O (PIO), in which the CPU copies each sector
+   through the data register. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,12 +42,31 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base port. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
+#define STA_DF 0x20             /* Device Fault. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* Bus master command register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus master status register bits.  Writing 1 clears the last
+   two. */
+#define BM_ACTIVE 0x01          /* Transfer in progress. */
+#define BM_ERROR 0x02           /* Transfer failed. */
+#define BM_INTR 0x04            /* Disk interrupted. */
 
 /* Control Register bits. */
+#define CTL_NIEN 0x02           /* Disable interrupts. */
 #define CTL_SRST 0x04           /* Software Reset. */
 
 /* Device Register bits. */
@@ -49,6 +80,42 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* PCI class and subclass of an IDE controller, and the bit in
+   its programming interface that says it can bus master. */
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+#define PCI_IDE_MASTER 0x80
+
+/* Register in the IDE controller's PCI configuration header
+   holding the bus master base port. */
+#define PCI_REG_BMIDE (PCI_REG_BAR0 + 4 * 4)
+
+/* A physical region descriptor, which describes one physically
+   contiguous piece of the memory of a DMA transfer.  A region
+   may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last descriptor. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_BOUNDARY 0x10000    /* Regions may not cross multiples. */
+
+/* Number of descriptors in a channel's table: enough for
+   MAX_SECTORS_PER_CMD sectors, 128 kB, at any alignment. */
+#define PRD_CNT 4
+
+/* Maximum number of sectors transferred by one READ SECTOR or
+   WRITE SECTOR command in 28-bit LBA mode. */
+#define MAX_SECTORS_PER_CMD 256
+
+/* Number of status register reads, about a microsecond each,
+   after which polled I/O gives up on a busy disk. */
+#define POLL_LIMIT 10000000
 
 /* An ATA device. */
 struct ata_disk
@@ -71,6 +138,13 @@ struct channel
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    struct semaphore probed;    /* Up'd when probe_channel() is done. */
+
+    uint16_t bm_base;           /* Bus master base port, or 0 for PIO. */
+    /* PRD table for DMA transfers.  It must be 4-byte aligned
+       and must not cross a 64 kB boundary; aligning it to its
+       own 32-byte size ensures both. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (32)));
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -79,17 +153,27 @@ struct channel
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+/* Sectors transferred by DMA and by PIO. */
+static unsigned long long dma_sector_cnt;
+static unsigned long long pio_sector_cnt;
+
 static struct block_operations ide_operations;
 
+static uint16_t find_bus_master (void);
+static thread_func probe_channel;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sectors (struct ata_disk *, block_sector_t,
+                            block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static bool dma_transfer (struct ata_disk *, block_sector_t, void *,
+                          block_sector_t cnt, bool read);
 
+static bool poll_while_busy (struct channel *, uint8_t *status);
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
@@ -101,8 +185,12 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
+  if (bm_base != 0)
+    printf ("ide: bus master DMA at port 0x%04"PRIx16"\n", bm_base);
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +214,8 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      sema_init (&c->probed, 0);
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -141,24 +231,95 @@ ide_init (void)
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Reset and probe the channel.  Resetting waits for the
+         drives to spin up, for up to 30 seconds each, so the
+         channels are probed at the same time, each by its own
+         thread. */
+      if (thread_create (c->name, PRI_DEFAULT, probe_channel, c)
+          == TID_ERROR)
+        probe_channel (c);
+    }
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  /* Read hard disk identity information.  This registers the
+     disks, so it is done in order, to give every disk the same
+     name on every boot. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
 
-      /* Read hard disk identity information. */
+      sema_down (&c->probed);
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
           identify_ata_device (&c->devices[dev_no]);
     }
 }
 
+/* Sets up the controller again after a reboot has reset it, on
+   resume from hibernation: turns bus mastering back on and
+   unmasks the disks' interrupts. */
+void
+ide_resume (void)
+{
+  size_t chan_no;
+
+  find_bus_master ();
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    outb (reg_ctl (&channels[chan_no]), 0);
+}
+
+/* Prints disk statistics. */
+void
+ide_print_stats (void) 
+{
+  printf ("IDE: %llu sectors by DMA, %llu by PIO\n",
+          dma_sector_cnt, pio_sector_cnt);
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Resets the channel that C_ points to and finds out which of its
+   devices are ATA disks, then ups its PROBED semaphore. */
+static void
+probe_channel (void *c_)
+{
+  struct channel *c = c_;
+
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  sema_up (&c->probed);
+}
+
+/* Looks for a PCI IDE controller that can bus master, enables
+   bus mastering on it, and returns its bus master base port, or
+   0 if there is none. */
+static uint16_t
+find_bus_master (void) 
+{
+  struct pci_addr addr;
+  uint32_t command, bar;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &addr)
+      || !((pci_read_config (addr, PCI_REG_CLASS) >> 8) & PCI_IDE_MASTER))
+    return 0;
+
+  /* The base must be an assigned I/O port. */
+  bar = pci_read_config (addr, PCI_REG_BMIDE);
+  if (!(bar & 1) || (bar & 0xfff0) == 0)
+    return 0;
+
+  command = pci_read_config (addr, PCI_REG_COMMAND);
+  pci_write_config (addr, PCI_REG_COMMAND,
+                    command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+  return bar & 0xfff0;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -347,12 +508,15 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (!dma_transfer (d, sec_no, buffer, 1, true))
+    {
+      select_sectors (d, sec_no, 1);
+      issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+      sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
+      input_sector (c, buffer);
+    }
   lock_release (&c->lock);
 }
 
@@ -367,33 +531,200 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (!dma_transfer (d, sec_no, (void *) buffer, 1, false))
+    {
+      select_sectors (d, sec_no, 1);
+      issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
+      output_sector (c, buffer);
+      sema_down (&c->completion_wait);
+    }
   lock_release (&c->lock);
 }
 
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Each command transfers up to MAX_SECTORS_PER_CMD sectors.  By
+   DMA, the disk raises one interrupt per command; by PIO, one
+   per sector as its data becomes ready.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, void *buffer_,
+                   block_sector_t cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t chunk = cnt < MAX_SECTORS_PER_CMD
+                             ? cnt : MAX_SECTORS_PER_CMD;
+      block_sector_t i;
+
+      if (dma_transfer (d, sec_no, buffer, chunk, true))
+        buffer += chunk * BLOCK_SECTOR_SIZE;
+      else
+        {
+          select_sectors (d, sec_no, chunk);
+          issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+          for (i = 0; i < chunk; i++)
+            {
+              sema_down (&c->completion_wait);
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              input_sector (c, buffer);
+              buffer += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving all of the data.
+   Each command transfers up to MAX_SECTORS_PER_CMD sectors.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, const void *buffer_,
+                    block_sector_t cnt)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *buffer = buffer_;
+
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      block_sector_t chunk = cnt < MAX_SECTORS_PER_CMD
+                             ? cnt : MAX_SECTORS_PER_CMD;
+      block_sector_t i;
+
+      if (dma_transfer (d, sec_no, (void *) buffer, chunk, false))
+        buffer += chunk * BLOCK_SECTOR_SIZE;
+      else
+        {
+          select_sectors (d, sec_no, chunk);
+          issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+          for (i = 0; i < chunk; i++)
+            {
+              if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+              output_sector (c, buffer);
+              sema_down (&c->completion_wait);
+              buffer += BLOCK_SECTOR_SIZE;
+            }
+        }
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&c->lock);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between IDE disk
+   DISK_NO, numbered from 0 for hda, and BUFFER by polled PIO,
+   with the disk's interrupts masked: into BUFFER if WRITE is
+   false, otherwise out of it.  This is for hibernation, which
+   must do I/O with interrupts off, and even before ide_init()
+   has run; once it has, only disks that it accepted may be used.
+   Returns false if the disk is absent, does not respond, or
+   fails, or if its channel is in the middle of a request. */
+bool
+ide_poll_transfer (int disk_no, block_sector_t sec_no, void *buffer_,
+                   block_sector_t cnt, bool write)
+{
+  struct channel *c = &channels[disk_no / 2];
+  struct ata_disk *d = &c->devices[disk_no % 2];
+  uint8_t *buffer = buffer_;
+  uint8_t status;
+  bool ok = true;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (disk_no >= 0 && disk_no < CHANNEL_CNT * 2);
+  ASSERT (sec_no + cnt <= (1UL << 28));
+
+  if (c->lock.holder != NULL || (d->channel != NULL && !d->is_ata))
+    return false;
+  c->reg_base = disk_no / 2 == 0 ? 0x1f0 : 0x170;
+  d->channel = c;
+  d->dev_no = disk_no % 2;
+
+  outb (reg_ctl (c), CTL_NIEN);
+  while (ok && cnt > 0)
+    {
+      block_sector_t chunk = cnt < MAX_SECTORS_PER_CMD
+                             ? cnt : MAX_SECTORS_PER_CMD;
+      block_sector_t i;
+
+      outb (reg_device (c), DEV_MBS | DEV_LBA
+            | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+      if (!poll_while_busy (c, &status) || !(status & STA_DRDY))
+        {
+          ok = false;
+          break;
+        }
+      outb (reg_nsect (c), chunk == MAX_SECTORS_PER_CMD ? 0 : chunk);
+      outb (reg_lbal (c), sec_no);
+      outb (reg_lbam (c), sec_no >> 8);
+      outb (reg_lbah (c), sec_no >> 16);
+      outb (reg_command (c),
+            write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY);
+
+      for (i = 0; ok && i < chunk; i++)
+        {
+          if (!poll_while_busy (c, &status)
+              || (status & (STA_ERR | STA_DF)) || !(status & STA_DRQ))
+            ok = false;
+          else if (write)
+            output_sector (c, buffer);
+          else
+            input_sector (c, buffer);
+          buffer += BLOCK_SECTOR_SIZE;
+        }
+      if (ok && write
+          && (!poll_while_busy (c, &status)
+              || (status & (STA_ERR | STA_DF))))
+        ok = false;
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  inb (reg_status (c));
+  outb (reg_ctl (c), 0);
+  return ok;
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number CNT of sectors to transfer to the
+   disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sectors (struct ata_disk *d, block_sector_t sec_no,
+                block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  /* A sector count of 0 means 256 sectors. */
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -420,6 +751,7 @@ static void
 input_sector (struct channel *c, void *sector) 
 {
   insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  pio_sector_cnt++;
 }
 
 /* Writes SECTOR to channel C's data register in PIO mode.
@@ -428,10 +760,99 @@ static void
 output_sector (struct channel *c, const void *sector) 
 {
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  pio_sector_cnt++;
+}
+
+/* Transfers CNT sectors, at most MAX_SECTORS_PER_CMD, starting at
+   SEC_NO between disk D and BUFFER by DMA: into BUFFER if READ is
+   true, otherwise out of it.  D's channel lock must be held.
+   Returns true if successful.  Returns false if the channel
+   cannot do DMA, or if the transfer failed, in which case DMA is
+   turned off for the channel and the caller should use PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, void *buffer,
+              block_sector_t cnt, bool read)
+{
+  struct channel *c = d->channel;
+  uint32_t addr, end;
+  uint8_t dir = read ? BM_READ : 0;
+  uint8_t bm_status, status;
+  int i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+
+  /* Kernel virtual memory maps physical memory in order, so the
+     buffer is physically contiguous: it only needs to be split at
+     64 kB boundaries. */
+  if (c->bm_base == 0 || !is_kernel_vaddr (buffer))
+    return false;
+  addr = vtop (buffer);
+  end = addr + cnt * BLOCK_SECTOR_SIZE;
+  for (i = 0; addr < end; i++)
+    {
+      uint32_t next = (addr / PRD_BOUNDARY + 1) * PRD_BOUNDARY;
+      if (next > end)
+        next = end;
+
+      ASSERT (i < PRD_CNT);
+      c->prdt[i].addr = addr;
+      c->prdt[i].size = next - addr;   /* 64 kB is stored as 0. */
+      c->prdt[i].flags = 0;
+      addr = next;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+
+  /* Program the controller, then the disk, then start. */
+  outb (reg_bm_command (c), dir);
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  select_sectors (d, sec_no, cnt);
+  issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+  outb (reg_bm_command (c), dir | BM_START);
+
+  /* Wait for the disk's interrupt, then stop the controller. */
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), dir);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+  status = inb (reg_alt_status (c));
+
+  if ((bm_status & BM_ERROR) || (status & (STA_ERR | STA_DF)))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, read ? "read" : "write", sec_no);
+      c->bm_base = 0;
+      return false;
+    }
+  dma_sector_cnt += cnt;
+  return true;
 }
 
 /* Low-level ATA primitives. */
 
+/* Waits, by polling, for channel C's selected disk to clear BSY,
+   then stores its status in *STATUS.  Reads the status a few
+   times first, to give a newly selected disk the 400 ns it may
+   take to put its status there.  Returns false if there is no
+   disk, or if it stays busy too long.  Usable with interrupts
+   off. */
+static bool
+poll_while_busy (struct channel *c, uint8_t *status)
+{
+  long i;
+
+  for (i = 0; i < POLL_LIMIT; i++)
+    {
+      *status = inb (reg_alt_status (c));
+      if (*status == 0xff)
+        return false;
+      if (i >= 4 && !(*status & STA_BSY))
+        return true;
+    }
+  return false;
+}
+
 /* Wait up to 10 seconds for the controller to become idle, that
    is, for the BSY and DRQ bits to clear in the status register.
 
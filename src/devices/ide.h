@@ -1,6 +1,14 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+#include "devices/block.h"
+
 void ide_init (void);
+void ide_resume (void);
+void ide_print_stats (void);
+
+bool ide_poll_transfer (int disk_no, block_sector_t, void *,
+                        block_sector_t cnt, bool write);
 
 #endif /* devices/ide.h */
@@ -2,15 +2,20 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/poll.h"
 
 /* Stores keys from the keyboard and serial port. */
 static struct intq buffer;
 
+/* Pollers waiting for a key. */
+static struct poll_queue pollers;
+
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
   intq_init (&buffer);
+  poll_queue_init (&pollers);
 }
 
 /* Adds a key to the input buffer.
@@ -22,7 +27,11 @@ input_putc (uint8_t key)
   ASSERT (!intq_full (&buffer));
 
   intq_putc (&buffer, key);
-  serial_notify ();
+  poll_wake (&pollers);
+
+  /* The serial port only cares whether the buffer is full. */
+  if (intq_full (&buffer))
+    serial_notify ();
 }
 
 /* Retrieves a key from the input buffer.
@@ -31,16 +40,65 @@ uint8_t
 input_getc (void) 
 {
   enum intr_level old_level;
+  bool was_full;
   uint8_t key;
 
   old_level = intr_disable ();
+  was_full = intq_full (&buffer);
   key = intq_getc (&buffer);
-  serial_notify ();
+  if (was_full)
+    serial_notify ();
   intr_set_level (old_level);
   
   return key;
 }
 
+/* Reads up to SIZE keys from the input buffer into BUF and
+   returns the number read.  If the buffer is empty, first waits
+   for a key for up to TIMEOUT timer ticks, or indefinitely if
+   TIMEOUT is negative, and returns 0 if none arrives; with a
+   TIMEOUT of 0, never waits.  Takes every key already buffered,
+   up to SIZE, at once. */
+size_t
+input_read (uint8_t *buf, size_t size, int64_t timeout)
+{
+  enum intr_level old_level;
+  bool was_full;
+  size_t cnt = 0;
+
+  old_level = intr_disable ();
+  if (size > 0 && intq_wait (&buffer, timeout))
+    {
+      was_full = intq_full (&buffer);
+      cnt = intq_get_multiple (&buffer, buf, size);
+      if (was_full)
+        serial_notify ();
+    }
+  intr_set_level (old_level);
+
+  return cnt;
+}
+
+/* Returns true if the input buffer holds a key, false
+   otherwise. */
+bool
+input_ready (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool ready = !intq_empty (&buffer);
+
+  intr_set_level (old_level);
+  return ready;
+}
+
+/* Adds W to the input buffer's poll queue, so that POLLER is
+   woken when the next key arrives. */
+void
+input_poll_add (struct poll_waiter *w, struct poller *poller)
+{
+  poll_queue_add (&pollers, w, poller);
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
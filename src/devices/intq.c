@@ -1,10 +1,11 @@
 #include "devices/intq.h"
 #include <debug.h>
+#include "devices/timer.h"
 #include "threads/thread.h"
 
-static int next (int pos);
 static void wait (struct intq *q, struct thread **waiter);
 static void signal (struct intq *q, struct thread **waiter);
+static timer_callout_func wait_expired;
 
 /* Initializes interrupt queue Q. */
 void
@@ -12,7 +13,7 @@ intq_init (struct intq *q)
 {
   lock_init (&q->lock);
   q->not_full = q->not_empty = NULL;
-  q->head = q->tail = 0;
+  spsc_ring_init (&q->ring, q->buf, INTQ_BUFSIZE);
 }
 
 /* Returns true if Q is empty, false otherwise. */
@@ -20,7 +21,7 @@ bool
 intq_empty (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return q->head == q->tail;
+  return spsc_ring_empty (&q->ring);
 }
 
 /* Returns true if Q is full, false otherwise. */
@@ -28,7 +29,7 @@ bool
 intq_full (const struct intq *q) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  return next (q->head) == q->tail;
+  return spsc_ring_full (&q->ring);
 }
 
 /* Removes a byte from Q and returns it.
@@ -48,8 +49,7 @@ intq_getc (struct intq *q)
       lock_release (&q->lock);
     }
   
-  byte = q->buf[q->tail];
-  q->tail = next (q->tail);
+  spsc_ring_get (&q->ring, &byte);
   signal (q, &q->not_full);
   return byte;
 }
@@ -69,16 +69,88 @@ intq_putc (struct intq *q, uint8_t byte)
       lock_release (&q->lock);
     }
 
-  q->buf[q->head] = byte;
-  q->head = next (q->head);
+  spsc_ring_put (&q->ring, byte);
   signal (q, &q->not_empty);
 }
 
-/* Returns the position after POS within an intq. */
-static int
-next (int pos) 
+/* Removes up to SIZE bytes from Q, without waiting, and stores
+   them in BUF.  Returns the number of bytes removed, which is 0
+   if Q is empty. */
+size_t
+intq_get_multiple (struct intq *q, uint8_t *buf, size_t size)
 {
-  return (pos + 1) % INTQ_BUFSIZE;
+  size_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cnt = spsc_ring_get_multiple (&q->ring, buf, size);
+  if (cnt > 0)
+    signal (q, &q->not_full);
+  return cnt;
+}
+
+/* Adds as many of the SIZE bytes in BUF to the end of Q as fit,
+   without waiting.  Returns the number of bytes added, which is
+   0 if Q is full. */
+size_t
+intq_put_multiple (struct intq *q, const uint8_t *buf, size_t size)
+{
+  size_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cnt = spsc_ring_put_multiple (&q->ring, buf, size);
+  if (cnt > 0)
+    signal (q, &q->not_empty);
+  return cnt;
+}
+
+/* Waits until Q is not empty, for at most TIMEOUT timer ticks,
+   or without limit if TIMEOUT is negative.  Returns true if Q is
+   not empty, false if the time ran out.  Must not be called from
+   an interrupt handler. */
+bool
+intq_wait (struct intq *q, int64_t timeout)
+{
+  struct timer_callout callout;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!intq_empty (q) || timeout == 0)
+    return !intq_empty (q);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&q->lock);
+  if (timeout > 0)
+    {
+      timer_callout_init (&callout, wait_expired, q);
+      timer_callout_add (&callout, timer_ticks () + timeout);
+    }
+  while (intq_empty (q))
+    {
+      wait (q, &q->not_empty);
+      if (timeout > 0 && !callout.pending)
+        break;
+    }
+  if (timeout > 0)
+    timer_callout_cancel (&callout);
+  lock_release (&q->lock);
+
+  return !intq_empty (q);
+}
+
+/* Timer callout for intq_wait(): wakes up the thread waiting for
+   intq Q_ to become nonempty, as the time for waiting is up. */
+static void
+wait_expired (void *q_)
+{
+  struct intq *q = q_;
+
+  if (q->not_empty != NULL)
+    {
+      thread_unblock (q->not_empty);
+      q->not_empty = NULL;
+    }
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
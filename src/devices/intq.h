@@ -1,6 +1,7 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <spsc-ring.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -15,10 +16,16 @@
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
+   The bytes themselves are kept in a struct spsc_ring, so that a
+   kernel thread and an interrupt handler, which are naturally
+   one producer and one consumer, never contend for them; only
+   the waiting threads need interrupts off.  See
+   lib/kernel/spsc-ring.h. */
+
+/* Queue buffer size, in bytes.  Must be a power of 2. */
+#define INTQ_BUFSIZE 256
 
 /* A circular queue of bytes. */
 struct intq
@@ -29,9 +36,8 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
+    struct spsc_ring ring;      /* Ring buffer in BUF. */
     uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
-    int head;                   /* New data is written here. */
-    int tail;                   /* Old data is read here. */
   };
 
 void intq_init (struct intq *);
@@ -39,5 +45,8 @@ bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+size_t intq_get_multiple (struct intq *, uint8_t *, size_t size);
+size_t intq_put_multiple (struct intq *, const uint8_t *, size_t size);
+bool intq_wait (struct intq *, int64_t timeout);
 
 #endif /* devices/intq.h */
@@ -0,0 +1,121 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* This code accesses the configuration space of PCI functions
+   with configuration mechanism #1, through two I/O ports, as
+   described in [PCI] section 3.2.2.3.2.  It is only as much of
+   PCI as the drivers need to find their controllers. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Contains the selected register. */
+
+/* Configuration address bits. */
+#define PCI_CONFIG_ENABLE 0x80000000
+
+/* Number of buses scanned, and of devices and functions on each. */
+#define PCI_BUS_CNT 8
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Selects register REG of function ADDR for access through
+   PCI_CONFIG_DATA. */
+static void
+select_register (struct pci_addr addr, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  outl (PCI_CONFIG_ADDR, (PCI_CONFIG_ENABLE
+                          | ((uint32_t) addr.bus << 16)
+                          | ((uint32_t) addr.dev << 11)
+                          | ((uint32_t) addr.func << 8)
+                          | reg));
+}
+
+/* Returns the 32-bit configuration register REG, a multiple of
+   4, of function ADDR. */
+uint32_t
+pci_read_config (struct pci_addr addr, uint8_t reg)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t value;
+
+  select_register (addr, reg);
+  value = inl (PCI_CONFIG_DATA);
+  intr_set_level (old_level);
+  return value;
+}
+
+/* Sets the 32-bit configuration register REG, a multiple of 4,
+   of function ADDR to VALUE. */
+void
+pci_write_config (struct pci_addr addr, uint8_t reg, uint32_t value)
+{
+  enum intr_level old_level = intr_disable ();
+
+  select_register (addr, reg);
+  outl (PCI_CONFIG_DATA, value);
+  intr_set_level (old_level);
+}
+
+/* Searches the first PCI_BUS_CNT buses for the function, after
+   skipping INDEX others, whose configuration register REG, ANDed
+   with MASK, equals VALUE.  If one is found, stores its location
+   in *ADDR and returns true; otherwise, returns false.  Without a
+   PCI bus, every read returns all 1s, which is no valid vendor,
+   so nothing is found. */
+static bool
+find_function (uint8_t reg, uint32_t mask, uint32_t value, int index,
+               struct pci_addr *addr)
+{
+  struct pci_addr a;
+  int bus, dev, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (dev = 0; dev < PCI_DEV_CNT; dev++)
+      for (func = 0; func < PCI_FUNC_CNT; func++)
+        {
+          a.bus = bus;
+          a.dev = dev;
+          a.func = func;
+          if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if ((pci_read_config (a, reg) & mask) == value && index-- == 0)
+            {
+              *addr = a;
+              return true;
+            }
+        }
+  return false;
+}
+
+/* Searches for a function of the given CLASS and SUBCLASS.  If
+   one is found, stores its location in *ADDR and returns true;
+   otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *addr)
+{
+  return find_function (PCI_REG_CLASS, 0xffff0000,
+                        ((uint32_t) class << 24) | ((uint32_t) subclass << 16),
+                        0, addr);
+}
+
+/* Searches for the function with the given VENDOR and DEVICE
+   IDs that comes after INDEX others with the same IDs, so that
+   0, 1, 2, ... enumerate them in bus order.  If one is found,
+   stores its location in *ADDR and returns true; otherwise,
+   returns false. */
+bool
+pci_find_id (uint16_t vendor, uint16_t device, int index,
+             struct pci_addr *addr)
+{
+  return find_function (PCI_REG_ID, 0xffffffff,
+                        ((uint32_t) device << 16) | vendor, index, addr);
+}
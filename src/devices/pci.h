@@ -0,0 +1,34 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function: bus, device, and function
+   numbers. */
+struct pci_addr
+  {
+    uint8_t bus;
+    uint8_t dev;
+    uint8_t func;
+  };
+
+/* Offsets of registers in the PCI configuration header. */
+#define PCI_REG_ID 0x00         /* Device ID 31:16, vendor ID 15:0. */
+#define PCI_REG_COMMAND 0x04    /* Status 31:16, command 15:0. */
+#define PCI_REG_CLASS 0x08      /* Class 31:24, subclass 23:16,
+                                   programming interface 15:8. */
+#define PCI_REG_BAR0 0x10       /* First base address register. */
+#define PCI_REG_INTR 0x3c       /* Interrupt pin 15:8, line 7:0. */
+
+/* Command register bits. */
+#define PCI_COMMAND_IO 0x0001   /* I/O space enable. */
+#define PCI_COMMAND_MASTER 0x0004 /* Bus master enable. */
+
+uint32_t pci_read_config (struct pci_addr, uint8_t reg);
+void pci_write_config (struct pci_addr, uint8_t reg, uint32_t value);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *);
+bool pci_find_id (uint16_t vendor, uint16_t device, int index,
+                  struct pci_addr *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,122 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device kept in memory, set up at boot by the kernel
+   command-line option "-ramdisk=MB" and registered as "rd0".
+   It starts out zeroed, with type BLOCK_RAW, so it is given a
+   role only when named by "-filesys", "-scratch" or "-swap".
+   Its contents are lost at power off.
+
+   The pages come one at a time from the user pool, so that a
+   large disk does not need contiguous memory, and each is
+   reached through the page array PAGES. */
+
+/* Sectors per page. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static uint8_t **pages;                 /* One pointer per page. */
+static block_sector_t ramdisk_cnt;      /* Size in sectors. */
+
+/* Returns the address of sector SEC_NO, which need not be
+   page-aligned. */
+static uint8_t *
+sector_addr (block_sector_t sec_no)
+{
+  ASSERT (sec_no < ramdisk_cnt);
+  return (pages[sec_no / SECTORS_PER_PAGE]
+          + sec_no % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SEC_NO into BUFFER, copying a
+   page's worth of the run at a time. */
+static void
+ramdisk_read_multiple (void *aux UNUSED, block_sector_t sec_no,
+                       void *buffer_, block_sector_t cnt)
+{
+  uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      block_sector_t chunk = SECTORS_PER_PAGE - sec_no % SECTORS_PER_PAGE;
+      if (chunk > cnt)
+        chunk = cnt;
+      memcpy (buffer, sector_addr (sec_no), chunk * BLOCK_SECTOR_SIZE);
+      buffer += chunk * BLOCK_SECTOR_SIZE;
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+}
+
+/* Writes CNT sectors from BUFFER starting at SEC_NO. */
+static void
+ramdisk_write_multiple (void *aux UNUSED, block_sector_t sec_no,
+                        const void *buffer_, block_sector_t cnt)
+{
+  const uint8_t *buffer = buffer_;
+
+  while (cnt > 0)
+    {
+      block_sector_t chunk = SECTORS_PER_PAGE - sec_no % SECTORS_PER_PAGE;
+      if (chunk > cnt)
+        chunk = cnt;
+      memcpy (sector_addr (sec_no), buffer, chunk * BLOCK_SECTOR_SIZE);
+      buffer += chunk * BLOCK_SECTOR_SIZE;
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+}
+
+/* Reads sector SEC_NO into BUFFER. */
+static void
+ramdisk_read (void *aux, block_sector_t sec_no, void *buffer)
+{
+  ramdisk_read_multiple (aux, sec_no, buffer, 1);
+}
+
+/* Writes sector SEC_NO from BUFFER. */
+static void
+ramdisk_write (void *aux, block_sector_t sec_no, const void *buffer)
+{
+  ramdisk_write_multiple (aux, sec_no, buffer, 1);
+}
+
+static const struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple
+  };
+
+/* Allocates a zeroed RAM disk of SIZE_MB megabytes and registers
+   it as block device "rd0".  Does nothing if SIZE_MB is 0.
+   Panics if memory runs out. */
+void
+ramdisk_init (size_t size_mb)
+{
+  size_t page_cnt = size_mb * (1024 * 1024 / PGSIZE);
+  size_t i;
+
+  if (page_cnt == 0)
+    return;
+
+  pages = malloc (page_cnt * sizeof *pages);
+  if (pages == NULL)
+    PANIC ("ramdisk: out of memory for %zu-page table", page_cnt);
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_USER | PAL_ZERO);
+      if (pages[i] == NULL)
+        PANIC ("ramdisk: only %zu of %zu pages available", i, page_cnt);
+    }
+
+  ramdisk_cnt = page_cnt * SECTORS_PER_PAGE;
+  block_register ("rd0", BLOCK_RAW, "RAM disk", ramdisk_cnt,
+                  &ramdisk_operations, NULL);
+}
@@ -1,7 +1,7 @@
 #include "devices/serial.h"
 #include <debug.h>
+#include <string.h>
 #include "devices/input.h"
-#include "devices/intq.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
@@ -33,6 +33,14 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR 0x06          /* Clear receive and transmit FIFOs. */
+#define FCR_TRIGGER_8 0x80      /* Receive interrupt at 8 bytes. */
+
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled. */
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -48,17 +56,55 @@
 #define LSR_DR 0x01             /* Data Ready: received data byte is in RBR. */
 #define LSR_THRE 0x20           /* THR Empty. */
 
+/* Depth of the 16550A's transmit FIFO. */
+#define FIFO_DEPTH 16
+
+/* Transmit queue size, in bytes.  Must be a power of 2.  Much
+   bigger than the UART's FIFO, so that serial_write() can copy a
+   large buffer in at once and return while the interrupt handler
+   drains it, FIFO_DEPTH bytes per interrupt. */
+#define TXQ_SIZE 2048
+
 /* Transmission mode. */
 static enum { UNINIT, POLL, QUEUE } mode;
 
-/* Data to be transmitted. */
-static struct intq txq;
+/* Data to be transmitted, a ring buffer.  TXQ_HEAD and TXQ_TAIL
+   count the bytes ever added and removed, so the queue holds
+   TXQ_HEAD - TXQ_TAIL bytes.  Interrupts must be off to access
+   them. */
+static uint8_t txq[TXQ_SIZE];
+static unsigned txq_head, txq_tail;
+
+/* Number of bytes to write to the UART per transmit interrupt:
+   FIFO_DEPTH, or 1 if the UART turns out to have no FIFO. */
+static int xmit_burst = 1;
+
+/* A thread waiting for room in TXQ, and a lock that lets only
+   one thread at a time wait. */
+static struct lock txq_lock;
+static struct thread *txq_waiter;
 
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
+/* Returns the number of bytes in the transmit queue. */
+static inline unsigned
+txq_cnt (void)
+{
+  return txq_head - txq_tail;
+}
+
+/* Removes and returns the oldest byte in the transmit queue,
+   which must not be empty. */
+static inline uint8_t
+txq_getc (void)
+{
+  ASSERT (txq_cnt () > 0);
+  return txq[txq_tail++ % TXQ_SIZE];
+}
+
 /* Initializes the serial port device for polling mode.
    Polling mode busy-waits for the serial port to become free
    before writing to it.  It's slow, but until interrupts have
@@ -71,7 +117,6 @@ init_poll (void)
   outb (FCR_REG, 0);                    /* Disable FIFO. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
-  intq_init (&txq);
   mode = POLL;
 } 
 
@@ -87,13 +132,54 @@ serial_init_queue (void)
     init_poll ();
   ASSERT (mode == POLL);
 
+  lock_init (&txq_lock);
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
+
+  /* With the FIFOs on, the UART takes FIFO_DEPTH bytes each time
+     its transmitter is empty, and interrupts for received data
+     once 8 bytes are waiting, or when fewer have waited for 4
+     character times, so that a burst of input is drained in one
+     interrupt. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR | FCR_TRIGGER_8);
+  if ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO)
+    xmit_burst = FIFO_DEPTH;
+
   mode = QUEUE;
   old_level = intr_disable ();
   write_ier ();
   intr_set_level (old_level);
 }
 
+/* Waits until the transmit queue is not full.  Interrupts must
+   be off, and the caller must not be an interrupt handler. */
+static void
+wait_for_room (void)
+{
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lock_acquire (&txq_lock);
+  while (txq_cnt () == TXQ_SIZE)
+    {
+      txq_waiter = thread_current ();
+      thread_block ();
+    }
+  lock_release (&txq_lock);
+}
+
+/* Makes room for at least one byte in the transmit queue, which
+   is full: by polling a byte out if interrupts were off, given
+   as OLD_LEVEL, since waiting would need them on, and otherwise
+   by waiting.  Interrupts must be off. */
+static void
+make_room (enum intr_level old_level)
+{
+  if (old_level == INTR_OFF)
+    putc_poll (txq_getc ());
+  else
+    wait_for_room ();
+}
+
 /* Sends BYTE to the serial port. */
 void
 serial_putc (uint8_t byte) 
@@ -112,21 +198,70 @@ serial_putc (uint8_t byte)
     {
       /* Otherwise, queue a byte and update the interrupt enable
          register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      if (txq_cnt () == TXQ_SIZE)
+        make_room (old_level);
+      txq[txq_head++ % TXQ_SIZE] = byte;
+      write_ier ();
+    }
+  
+  intr_set_level (old_level);
+}
+
+/* Sends the N bytes in BUFFER to the serial port.  Copies as
+   much as fits into the transmit queue at once, instead of a
+   byte at a time, and returns once all of it is queued. */
+void
+serial_write (const void *buffer_, size_t n)
+{
+  const uint8_t *buffer = buffer_;
+  enum intr_level old_level;
+
+  if (mode != QUEUE)
+    {
+      while (n-- > 0)
+        serial_putc (*buffer++);
+      return;
+    }
+
+  old_level = intr_disable ();
+  while (n > 0)
+    {
+      unsigned ofs = txq_head % TXQ_SIZE;
+      size_t chunk = TXQ_SIZE - txq_cnt ();
+
+      if (chunk == 0)
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          write_ier ();
+          make_room (old_level);
+          continue;
         }
+      if (chunk > TXQ_SIZE - ofs)
+        chunk = TXQ_SIZE - ofs;
+      if (chunk > n)
+        chunk = n;
+      memcpy (txq + ofs, buffer, chunk);
+      txq_head += chunk;
+      buffer += chunk;
+      n -= chunk;
+    }
+  write_ier ();
+  intr_set_level (old_level);
+}
+
+/* Sets the serial port up again after a reboot has reset it, on
+   resume from hibernation.  Interrupts must be off. */
+void
+serial_resume (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
 
-      intq_putc (&txq, byte); 
+  set_serial (9600);
+  outb (MCR_REG, MCR_OUT2);
+  if (mode == QUEUE)
+    {
+      outb (FCR_REG, FCR_ENABLE | FCR_CLEAR | FCR_TRIGGER_8);
       write_ier ();
     }
-  
-  intr_set_level (old_level);
 }
 
 /* Flushes anything in the serial buffer out the port in polling
@@ -135,8 +270,8 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
-  while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+  while (txq_cnt () > 0)
+    putc_poll (txq_getc ());
   intr_set_level (old_level);
 }
 
@@ -182,7 +317,7 @@ write_ier (void)
 
   /* Enable transmit interrupt if we have any characters to
      transmit. */
-  if (!intq_empty (&txq))
+  if (txq_cnt () > 0)
     ier |= IER_XMIT;
 
   /* Enable receive interrupt if we have room to store any
@@ -218,10 +353,23 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If we have bytes to transmit, and the transmitter is empty,
+     fill its FIFO. */
+  if (txq_cnt () > 0 && (inb (LSR_REG) & LSR_THRE) != 0)
+    {
+      int i;
+
+      for (i = 0; i < xmit_burst && txq_cnt () > 0; i++)
+        outb (THR_REG, txq_getc ());
+    }
+
+  /* Wake up a waiting writer once there is plenty of room, rather
+     than for every burst. */
+  if (txq_waiter != NULL && txq_cnt () <= TXQ_SIZE / 2)
+    {
+      thread_unblock (txq_waiter);
+      txq_waiter = NULL;
+    }
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -4,14 +4,32 @@
 #include "devices/kbd.h"
 #include "devices/serial.h"
 #include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
+#include "userprog/systrace.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#endif
+#ifdef VM
+#include "vm/vmstat.h"
 #endif
 
 /* Keyboard control register port. */
@@ -93,6 +111,11 @@ shutdown_power_off (void)
 #ifdef FILESYS
   filesys_done ();
 #endif
+  profile_done ();
+  trace_done ();
+#ifdef USERPROG
+  systrace_done ();
+#endif
 
   print_stats ();
 
@@ -130,12 +153,27 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  fpu_print_stats ();
+  intr_print_stats ();
+  workqueue_print_stats ();
+  rcu_print_stats ();
+  lock_print_stats ();
+  palloc_print_stats ();
+  malloc_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  syscall_print_stats ();
+#endif
+#ifdef VM
+  vm_print_stats ();
 #endif
 }
@@ -4,9 +4,12 @@
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
+#include "devices/vga.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -24,6 +27,98 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Known loops per tick and TSC rate in kHz, set by kernel
+   command-line options "-lpt" and "-tsc", so that
+   timer_calibrate() need not measure them, or 0 to measure. */
+unsigned timer_preset_loops;
+unsigned timer_preset_tsc_khz;
+
+/* Monotonic clock, in nanoseconds since the OS booted.
+
+   The clock is CLOCK_NS_BASE at time stamp counter value
+   CLOCK_TSC_BASE, and advances by CLOCK_MULT / 2**CLOCK_SHIFT
+   ns per TSC cycle.  timer_calibrate() measures CLOCK_MULT;
+   until then it is 0, and the clock only moves at each tick.
+
+   The timer interrupt moves both bases forward at every tick, so
+   that the product never overflows.  Readers do not disable
+   interrupts: CLOCK_SEQ is odd while the bases are being
+   written, and a reader that sees it change retries. */
+#define NS_PER_SEC 1000000000
+#define CLOCK_SHIFT 20
+#define CLOCK_CALIBRATE_TICKS DIV_ROUND_UP (TIMER_FREQ, 10)
+static volatile unsigned clock_seq;
+static int64_t clock_ns_base;
+static uint64_t clock_tsc_base;
+static uint64_t clock_mult;
+
+static void clock_calibrate (void);
+static void clock_update (void);
+
+/* Timer wheel of pending callouts.
+
+   Slot I of level 0 holds the callouts due at the next tick
+   whose low WHEEL0_BITS bits are I, up to WHEEL0_SIZE ticks
+   away.  Each further level covers WHEEL_BITS more bits of the
+   tick range: a callout due later than level 0 can tell sits in
+   the slot of the first level whose range covers it, and moves
+   down a level ("cascades") whenever the bits below that level
+   of WHEEL_TICKS wrap around to zero.  Adding or cancelling a
+   callout takes constant time, and so does a tick, apart from
+   the cascades every WHEEL0_SIZE ticks and the callouts due.
+
+   Callouts more than WHEEL_RANGE ticks away wait in the last
+   slot of the top level that range reaches, and are sorted out
+   again as it cascades.
+
+   Protected by disabling interrupts. */
+#define WHEEL0_BITS 8
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 3                  /* Levels above level 0. */
+#define WHEEL_RANGE ((int64_t) 1 << (WHEEL0_BITS + WHEEL_LEVELS * WHEEL_BITS))
+static struct list wheel0[WHEEL0_SIZE];
+static struct list wheel[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* The next tick whose callouts are to be called. */
+static int64_t wheel_ticks;
+
+/* Tickless idle.
+
+   While the CPU has nothing to run, the timer need not interrupt
+   it every tick, only at the next tick with work to do.  Then
+   the timer interrupt puts the PIT into one-shot mode for
+   ONESHOT_TICKS ticks, up to the 16-bit counter's limit of
+   ONESHOT_MAX_TICKS, and catches up on all of them at once when
+   the count runs out.  If a thread becomes ready sooner, because
+   of some other interrupt, timer_resume() shortens the count to
+   end at the next tick boundary instead.
+
+   Protected by disabling interrupts. */
+#define TIMER_COUNT ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define ONESHOT_MAX_TICKS (UINT16_MAX / TIMER_COUNT)
+static int oneshot_ticks;       /* Ticks in the one-shot count, or 0. */
+
+/* Timer interrupts per tick.  The profiler may sample faster
+   than the tick rate, by having the timer interrupt more often
+   and counting only every INTR_PER_TICK'th interrupt as a tick.
+   While the profiler is on, the timer never stops, so that it
+   samples the idle CPU too. */
+static int intr_per_tick = 1;
+static int intr_cnt;            /* Interrupts since the last tick. */
+
+/* Copies the VGA shadow screen to the framebuffer, which takes
+   too long to do in the timer interrupt itself. */
+static struct work vga_work;
+static work_func flush_vga;
+
+static void timer_tick (bool idle);
+static void timer_stop (void);
+static void wheel_insert (struct timer_callout *);
+static void wheel_run (void);
+static timer_callout_func wake_thread;
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
@@ -35,17 +130,39 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  pit_configure_channel (0, 2, TIMER_FREQ);
+  size_t i, j;
+
+  for (i = 0; i < WHEEL0_SIZE; i++)
+    list_init (&wheel0[i]);
+  for (i = 0; i < WHEEL_LEVELS; i++)
+    for (j = 0; j < WHEEL_SIZE; j++)
+      list_init (&wheel[i][j]);
+  wheel_ticks = ticks + 1;
+  work_init (&vga_work, flush_vga, NULL);
+
+  if (profile_rate > 1)
+    intr_per_tick = profile_rate;
+  pit_configure_channel (0, 2, TIMER_FREQ * intr_per_tick);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays,
+   and the clock.  Each takes a few timer ticks of busy waiting,
+   unless preset by "-lpt" or "-tsc". */
 void
 timer_calibrate (void) 
 {
   unsigned high_bit, test_bit;
 
   ASSERT (intr_get_level () == INTR_ON);
+  if (timer_preset_loops != 0)
+    {
+      loops_per_tick = timer_preset_loops;
+      printf ("Timer: %'"PRIu64" loops/s, from -lpt.\n",
+              (uint64_t) loops_per_tick * TIMER_FREQ);
+      clock_calibrate ();
+      return;
+    }
   printf ("Calibrating timer...  ");
 
   /* Approximate loops_per_tick as the largest power-of-two
@@ -63,7 +180,133 @@ timer_calibrate (void)
     if (!too_many_loops (loops_per_tick | test_bit))
       loops_per_tick |= test_bit;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s (-lpt=%u).\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, loops_per_tick);
+
+  clock_calibrate ();
+}
+
+/* Measures the TSC's rate against the timer, over
+   CLOCK_CALIBRATE_TICKS ticks, to run clock_ns() from it. */
+static void
+clock_calibrate (void)
+{
+  enum intr_level old_level;
+  uint64_t tsc_hz;
+  uint64_t start;
+  int64_t t;
+
+  /* Wait for a timer tick, then count cycles to a later one. */
+  if (timer_preset_tsc_khz != 0)
+    tsc_hz = timer_preset_tsc_khz * (uint64_t) 1000;
+  else
+    {
+      t = ticks;
+      while (ticks == t)
+        barrier ();
+      t = ticks;
+      start = clock_cycles ();
+      while (ticks < t + CLOCK_CALIBRATE_TICKS)
+        barrier ();
+      tsc_hz = (clock_cycles () - start) * TIMER_FREQ / CLOCK_CALIBRATE_TICKS;
+      if (tsc_hz == 0)
+        return;
+    }
+
+  old_level = intr_disable ();
+  clock_update ();
+  clock_mult = ((uint64_t) NS_PER_SEC << CLOCK_SHIFT) / tsc_hz;
+  intr_set_level (old_level);
+
+  if (timer_preset_tsc_khz != 0)
+    printf ("Clock: %'"PRIu64" cycles/s, from -tsc.\n", tsc_hz);
+  else
+    printf ("Clock: %'"PRIu64" cycles/s (-tsc=%"PRIu64").\n",
+            tsc_hz, tsc_hz / 1000);
+}
+
+/* Sets the timer up again after a reboot has reset it, on resume
+   from hibernation, and restarts the clock at NS, its reading at
+   hibernation, since the reboot also restarted the TSC. */
+void
+timer_reinit (int64_t ns)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  pit_configure_channel (0, 2, TIMER_FREQ * intr_per_tick);
+  clock_seq++;
+  barrier ();
+  clock_ns_base = ns;
+  clock_tsc_base = clock_cycles ();
+  barrier ();
+  clock_seq++;
+}
+
+/* Returns the time since the OS booted, in nanoseconds, from the
+   TSC once it is calibrated.  Never goes backward.  Does not
+   disable interrupts, so it is cheap enough to time short
+   intervals and may be called from an interrupt handler. */
+int64_t
+clock_ns (void)
+{
+  uint64_t cycles;
+  unsigned seq;
+  int64_t ns;
+
+  do
+    {
+      seq = clock_seq;
+      barrier ();
+      cycles = clock_cycles () - clock_tsc_base;
+      ns = clock_ns_base + (int64_t) ((cycles * clock_mult) >> CLOCK_SHIFT);
+      barrier ();
+    }
+  while ((seq & 1) != 0 || seq != clock_seq);
+  return ns;
+}
+
+/* Returns the time since the CPU was reset, in nanoseconds, from
+   the TSC, which counts from 0 at reset, so that it includes the
+   time spent in the BIOS and the loader; or 0 before the TSC is
+   calibrated.  Meant for timing the boot: the product of the TSC
+   and CLOCK_MULT overflows after a few hours. */
+int64_t
+clock_reset_ns (void)
+{
+  return clock_cycles_to_ns (clock_cycles ());
+}
+
+/* Converts CYCLES of the time stamp counter to nanoseconds, or to
+   0 before the TSC is calibrated.  Overflows, like
+   clock_reset_ns(), after a few hours' worth of cycles. */
+int64_t
+clock_cycles_to_ns (uint64_t cycles)
+{
+  return (int64_t) ((cycles * clock_mult) >> CLOCK_SHIFT);
+}
+
+/* Moves the clock's bases forward to now.  Called by the timer
+   interrupt at each tick, and when the clock is calibrated. */
+static void
+clock_update (void)
+{
+  uint64_t tsc = clock_cycles ();
+  int64_t ns;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (clock_mult != 0)
+    ns = clock_ns_base
+         + (int64_t) (((tsc - clock_tsc_base) * clock_mult) >> CLOCK_SHIFT);
+  else
+    ns = ticks * (NS_PER_SEC / TIMER_FREQ);
+
+  clock_seq++;
+  barrier ();
+  clock_ns_base = ns;
+  clock_tsc_base = tsc;
+  barrier ();
+  clock_seq++;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
@@ -84,17 +327,159 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Initializes callout C to call FUNC, passing AUX. */
+void
+timer_callout_init (struct timer_callout *c, timer_callout_func *func,
+                    void *aux)
+{
+  ASSERT (c != NULL);
+  ASSERT (func != NULL);
+
+  c->func = func;
+  c->aux = aux;
+  c->pending = false;
+}
+
+/* Schedules callout C, which must not be pending, to be called
+   once the timer reaches EXPIRES ticks, or at the next tick if
+   it already has.  May be called from an interrupt handler,
+   including a callout. */
+void
+timer_callout_add (struct timer_callout *c, int64_t expires)
+{
+  enum intr_level old_level;
+
+  ASSERT (c != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!c->pending);
+  c->expires = expires;
+  c->pending = true;
+  wheel_insert (c);
+  intr_set_level (old_level);
+}
+
+/* Cancels callout C.  Returns true if C was pending, false if it
+   has already been called or was never added. */
+bool
+timer_callout_cancel (struct timer_callout *c)
+{
+  enum intr_level old_level;
+  bool pending;
+
+  ASSERT (c != NULL);
+
+  old_level = intr_disable ();
+  pending = c->pending;
+  if (pending)
+    {
+      list_remove (&c->elem);
+      c->pending = false;
+    }
+  intr_set_level (old_level);
+  return pending;
+}
+
+/* Adds pending callout C to the wheel slot for its expiry. */
+static void
+wheel_insert (struct timer_callout *c)
+{
+  int64_t expires = c->expires;
+  int64_t delta = expires - wheel_ticks;
+  int level, shift;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < WHEEL0_SIZE)
+    {
+      if (delta < 0)
+        expires = wheel_ticks;
+      list_push_back (&wheel0[expires % WHEEL0_SIZE], &c->elem);
+      return;
+    }
+
+  if (delta >= WHEEL_RANGE)
+    expires = wheel_ticks + WHEEL_RANGE - 1;
+  for (level = 0, shift = WHEEL0_BITS; level < WHEEL_LEVELS - 1;
+       level++, shift += WHEEL_BITS)
+    if (delta < (int64_t) 1 << (shift + WHEEL_BITS))
+      break;
+  list_push_back (&wheel[level][(expires >> shift) % WHEEL_SIZE],
+                  &c->elem);
+}
+
+/* Moves the callouts of LEVEL's slot for the current WHEEL_TICKS
+   down to the slots they belong in now, and returns the slot's
+   index. */
+static int
+wheel_cascade (int level)
+{
+  int shift = WHEEL0_BITS + level * WHEEL_BITS;
+  int idx = (wheel_ticks >> shift) % WHEEL_SIZE;
+  struct list slot;
+
+  list_init (&slot);
+  while (!list_empty (&wheel[level][idx]))
+    list_push_back (&slot, list_pop_front (&wheel[level][idx]));
+  while (!list_empty (&slot))
+    wheel_insert (list_entry (list_pop_front (&slot),
+                              struct timer_callout, elem));
+  return idx;
+}
+
+/* Calls every callout due by the current tick, in the order in
+   which they were added, within each tick. */
+static void
+wheel_run (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_ticks <= ticks)
+    {
+      struct list *slot = &wheel0[wheel_ticks % WHEEL0_SIZE];
+      int level;
+
+      if (wheel_ticks % WHEEL0_SIZE == 0)
+        for (level = 0; level < WHEEL_LEVELS; level++)
+          if (wheel_cascade (level) != 0)
+            break;
+
+      /* A callout added from here on, even for this tick, goes
+         to a later slot. */
+      wheel_ticks++;
+      while (!list_empty (slot))
+        {
+          struct timer_callout *c = list_entry (list_pop_front (slot),
+                                                struct timer_callout, elem);
+          c->pending = false;
+          c->func (c->aux);
+        }
+    }
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
    be turned on. */
 void
 timer_sleep (int64_t ticks) 
 {
+  struct timer_callout wakeup;
+  enum intr_level old_level;
   int64_t start = timer_ticks ();
 
   ASSERT (intr_get_level () == INTR_ON);
 
-  int64_t wakeup_ticks = start + ticks;
-  thread_sleep (wakeup_ticks);
+  timer_callout_init (&wakeup, wake_thread, thread_current ());
+  old_level = intr_disable ();
+  timer_callout_add (&wakeup, start + ticks);
+  thread_block ();
+  intr_set_level (old_level);
+}
+
+/* Wakes up thread T, sleeping in timer_sleep(). */
+static void
+wake_thread (void *t)
+{
+  thread_unblock (t);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -167,33 +552,115 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Returns the timer to interrupting every tick, if it stopped
+   while the CPU was idle, because there is a thread to run
+   again.  The ticks that passed are caught up on at the next
+   tick boundary.  Interrupts must be off. */
+void
+timer_resume (void)
+{
+  uint16_t count;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  /* If the count has run out, its interrupt is pending. */
+  count = pit_read_count (0, &expired);
+  if (expired)
+    return;
+
+  /* Of the ticks left in COUNT, all but the one in progress are
+     dropped. */
+  oneshot_ticks -= DIV_ROUND_UP (count, TIMER_COUNT) - 1;
+  pit_start_count (0, (count - 1) % TIMER_COUNT + 1);
+}
+
+/* Stops the timer from interrupting each tick while the CPU is
+   idle, until the next tick that has a callout due, a wheel
+   cascade or, for the advanced scheduler, a load_avg update.
+   Keeps ticking while RCU callbacks wait for a grace period.
+   Called at a tick boundary, from the timer interrupt. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_stop (void)
 {
-  ticks++;
-  thread_tick ();
-  thread_wakeup (ticks);
+  int span;
 
-  if (thread_mlfqs)
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (profile_rate > 0 || rcu_pending ())
+    return;
+  for (span = 1; span < ONESHOT_MAX_TICKS; span++)
     {
-      /* Increments `recent_cpu' by one at every tick
-         fot not-­idle running thread only. */
-      mlfqs_increment_recent_cpu ();
+      int64_t t = ticks + span;
+      if (!list_empty (&wheel0[t % WHEEL0_SIZE])
+          || t % WHEEL0_SIZE == 0
+          || (sched_class->period != 0 && t % sched_class->period == 0))
+        break;
+    }
+  if (span < 2)
+    return;
 
-      /* Once per second, `recent_cpu' is recalculated for
-         every thread, and `load_avg' is also updated. */
-      if (timer_ticks () % TIMER_FREQ == 0)
-        {
-          mlfqs_update_load_avg ();
-          thread_foreach (mlfqs_recalc_recent_cpu, NULL);
-        }
+  oneshot_ticks = span;
+  pit_start_count (0, span * TIMER_COUNT);
+}
 
-      /* For every thread, priority is recalculated
-         every fourth tick. */
-      if (timer_ticks () % 4 == 0)
-        thread_foreach (mlfqs_recalc_priority, NULL);
+/* Timer interrupt handler. */
+static void
+timer_interrupt (struct intr_frame *args)
+{
+  if (profile_rate > 0)
+    profile_sample (args);
+  if (++intr_cnt < intr_per_tick)
+    return;
+  intr_cnt = 0;
+
+  if (oneshot_ticks != 0)
+    {
+      /* All but the last of the ticks counted passed while
+         idle. */
+      int skipped = oneshot_ticks - 1;
+
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+      while (skipped-- > 0)
+        timer_tick (true);
     }
+  timer_tick (false);
+  clock_update ();
+  if (vga_needs_flush ())
+    work_queue (&system_wq, &vga_work);
+
+  if (thread_idling ())
+    timer_stop ();
+}
+
+/* Flushes the VGA display, as deferred work. */
+static void
+flush_vga (void *aux UNUSED)
+{
+  vga_flush ();
+}
+
+/* Advances the timer by one tick, and does the work due at that
+   tick.  IDLE is true for a tick that passed while the CPU was
+   idle and the timer was stopped. */
+static void
+timer_tick (bool idle)
+{
+  ticks++;
+  if (idle)
+    thread_idle_tick ();
+  else
+    thread_tick ();
+  wheel_run ();
+
+  /* The scheduling class's own accounting, which for the
+     advanced scheduler includes `recent_cpu' and `load_avg'. */
+  if (sched_class->tick != NULL)
+    sched_class->tick (idle);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
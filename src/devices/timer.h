@@ -1,18 +1,62 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* Calls FUNC, passing AUX, from the timer interrupt handler. */
+typedef void timer_callout_func (void *aux);
+
+/* A callout: a call to FUNC (AUX) scheduled by
+   timer_callout_add() for some future timer tick.  The call
+   happens in the timer interrupt handler, with interrupts off,
+   so FUNC must not sleep.  See timer.c. */
+struct timer_callout
+  {
+    int64_t expires;                    /* Tick to call FUNC at. */
+    timer_callout_func *func;           /* Function to call. */
+    void *aux;                          /* Its argument. */
+    bool pending;                       /* Added but not called yet? */
+    struct list_elem elem;              /* Element in a wheel slot. */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_reinit (int64_t ns);
+
+extern unsigned timer_preset_loops;
+extern unsigned timer_preset_tsc_khz;
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
 
+/* High-resolution clock. */
+int64_t clock_ns (void);
+int64_t clock_reset_ns (void);
+int64_t clock_cycles_to_ns (uint64_t);
+
+/* Returns the time stamp counter, in cycles since the CPU was
+   reset.  Usable before timer_calibrate(), so that early events
+   can be timed and converted by clock_cycles_to_ns() later. */
+static inline uint64_t
+clock_cycles (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Callouts. */
+void timer_callout_init (struct timer_callout *, timer_callout_func *,
+                         void *aux);
+void timer_callout_add (struct timer_callout *, int64_t expires);
+bool timer_callout_cancel (struct timer_callout *);
+
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
 void timer_msleep (int64_t milliseconds);
@@ -24,6 +68,9 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Tickless idle. */
+void timer_resume (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -1,4 +1,5 @@
 #include "devices/vga.h"
+#include <debug.h>
 #include <round.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -18,20 +19,49 @@
    the display. */
 static size_t cx, cy;
 
+/* A character and its attribute. */
+typedef uint8_t cell[2];
+
 /* Attribute value for gray text on a black background. */
 #define GRAY_ON_BLACK 0x07
 
 /* Framebuffer.  See [FREEVGA] under "VGA Text Mode Operation".
    The character at (x,y) is fb[y][x][0].
    The attribute at (x,y) is fb[y][x][1]. */
-static uint8_t (*fb)[COL_CNT][2];
+static cell (*fb)[COL_CNT];
+
+/* Shadow copy of the screen in ordinary memory, where characters
+   are written first.  vga_flush() copies the rows that changed to
+   the framebuffer, whose memory is slow to write, and moves the
+   hardware cursor, which takes slow port I/O.
+
+   The rows form a ring: screen row Y is shadow row (top + Y) %
+   ROW_CNT, so that scrolling only advances TOP and clears one
+   row, however many lines are written between flushes. */
+static cell shadow[ROW_CNT][COL_CNT];
+static size_t top;
 
+/* Bit Y is set if screen row Y differs from the framebuffer. */
+static uint32_t dirty;
+#define ALL_DIRTY ((1u << ROW_CNT) - 1)
+
+/* True if the hardware cursor is not at (cx,cy). */
+static bool cursor_dirty;
+
+static void put_char (int c, enum intr_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
 static void move_cursor (void);
 static void find_cursor (size_t *x, size_t *y);
 
+/* Returns screen row Y of the shadow copy. */
+static inline cell *
+row (size_t y)
+{
+  return shadow[(top + y) % ROW_CNT];
+}
+
 /* Initializes the VGA text display. */
 static void
 init (void)
@@ -41,11 +71,57 @@ init (void)
   if (!inited)
     {
       fb = ptov (0xb8000);
+      memcpy (shadow, fb, sizeof shadow);
       find_cursor (&cx, &cy);
       inited = true; 
     }
 }
 
+/* Finishes a write begun with interrupts at OLD_LEVEL.  If they
+   were off, the timer may not be running to call vga_flush(), in
+   early boot or after a kernel panic, so the screen is updated
+   right away. */
+static void
+finish (enum intr_level old_level)
+{
+  if (old_level == INTR_OFF)
+    vga_flush ();
+}
+
+/* Copies the rows of the shadow screen that changed to the
+   framebuffer and moves the hardware cursor, if it moved.
+   Queued as deferred work by the timer interrupt at each tick
+   that finds vga_needs_flush() true, so the display lags the
+   console by about one tick. */
+void
+vga_flush (void)
+{
+  enum intr_level old_level;
+  size_t y;
+
+  if (fb == NULL || (dirty == 0 && !cursor_dirty))
+    return;
+
+  old_level = intr_disable ();
+  for (y = 0; dirty != 0; y++)
+    if (dirty & (1u << y))
+      {
+        memcpy (fb[y], row (y), sizeof fb[y]);
+        dirty &= ~(1u << y);
+      }
+  if (cursor_dirty)
+    move_cursor ();
+  intr_set_level (old_level);
+}
+
+/* Returns true if the framebuffer or the hardware cursor is
+   out of date. */
+bool
+vga_needs_flush (void)
+{
+  return fb != NULL && (dirty != 0 || cursor_dirty);
+}
+
 /* Writes C to the VGA text display, interpreting control
    characters in the conventional ways.  */
 void
@@ -56,7 +132,35 @@ vga_putc (int c)
   enum intr_level old_level = intr_disable ();
 
   init ();
-  
+  put_char (c, old_level);
+  finish (old_level);
+
+  intr_set_level (old_level);
+}
+
+/* Writes the N characters in BUFFER to the VGA text display, as
+   vga_putc() would one by one. */
+void
+vga_write (const char *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  init ();
+  while (n-- > 0)
+    put_char (*buffer++, old_level);
+  finish (old_level);
+
+  intr_set_level (old_level);
+}
+
+/* Puts C on the shadow screen at the cursor and advances the
+   cursor.  Interrupts must be off; OLD_LEVEL is the level to
+   beep at, for '\a'. */
+static void
+put_char (int c, enum intr_level old_level)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
   switch (c) 
     {
     case '\n':
@@ -89,17 +193,14 @@ vga_putc (int c)
       break;
       
     default:
-      fb[cy][cx][0] = c;
-      fb[cy][cx][1] = GRAY_ON_BLACK;
+      row (cy)[cx][0] = c;
+      row (cy)[cx][1] = GRAY_ON_BLACK;
+      dirty |= 1u << cy;
       if (++cx >= COL_CNT)
         newline ();
       break;
     }
-
-  /* Update cursor position. */
-  move_cursor ();
-
-  intr_set_level (old_level);
+  cursor_dirty = true;
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
@@ -112,20 +213,21 @@ cls (void)
     clear_row (y);
 
   cx = cy = 0;
-  move_cursor ();
 }
 
-/* Clears row Y to spaces. */
+/* Clears screen row Y to spaces. */
 static void
 clear_row (size_t y) 
 {
+  cell *r = row (y);
   size_t x;
 
   for (x = 0; x < COL_CNT; x++)
     {
-      fb[y][x][0] = ' ';
-      fb[y][x][1] = GRAY_ON_BLACK;
+      r[x][0] = ' ';
+      r[x][1] = GRAY_ON_BLACK;
     }
+  dirty |= 1u << y;
 }
 
 /* Advances the cursor to the first column in the next line on
@@ -139,8 +241,9 @@ newline (void)
   if (cy >= ROW_CNT)
     {
       cy = ROW_CNT - 1;
-      memmove (&fb[0], &fb[1], sizeof fb[0] * (ROW_CNT - 1));
+      top = (top + 1) % ROW_CNT;
       clear_row (ROW_CNT - 1);
+      dirty = ALL_DIRTY;
     }
 }
 
@@ -152,6 +255,7 @@ move_cursor (void)
   uint16_t cp = cx + COL_CNT * cy;
   outw (0x3d4, 0x0e | (cp & 0xff00));
   outw (0x3d4, 0x0f | (cp << 8));
+  cursor_dirty = false;
 }
 
 /* Reads the current hardware cursor position into (*X,*Y). */
@@ -1,6 +1,12 @@
 #ifndef DEVICES_VGA_H
 #define DEVICES_VGA_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 void vga_putc (int);
+void vga_write (const char *, size_t);
+void vga_flush (void);
+bool vga_needs_flush (void);
 
 #endif /* devices/vga.h */
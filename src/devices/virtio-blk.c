@@ -0,0 +1,429 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives the virtio block devices that
+   QEMU offers with "-drive if=virtio", through the legacy PCI
+   interface described in [VIRTIO] sections 2.3 and 5.2.
+
+   Each disk has a single virtqueue.  A request is a chain of
+   three descriptors, for a header naming the operation and
+   sector, the data, and a status byte that the device writes
+   back, so a transfer of any number of sectors is one request
+   and one notification.  The device interrupts when it has put
+   the request's chain on the used ring.  Requests are carried
+   out while others are in flight: up to REQ_CNT threads may wait
+   on one disk at a time, each for its own request. */
+
+/* PCI IDs of a legacy (transitional) virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio I/O port offsets from BAR0. */
+#define VIRTIO_REG_HOST_FEATURES 0x00   /* Device features (r/o). */
+#define VIRTIO_REG_GUEST_FEATURES 0x04  /* Accepted features. */
+#define VIRTIO_REG_QUEUE_PFN 0x08       /* Page number of queue. */
+#define VIRTIO_REG_QUEUE_SIZE 0x0c      /* Entries in queue (r/o). */
+#define VIRTIO_REG_QUEUE_SEL 0x0e       /* Selects a queue. */
+#define VIRTIO_REG_QUEUE_NOTIFY 0x10    /* Kicks a queue. */
+#define VIRTIO_REG_STATUS 0x12          /* Device status. */
+#define VIRTIO_REG_ISR 0x13             /* Interrupt status (r/o). */
+#define VIRTIO_REG_CAPACITY 0x14        /* Size in sectors, 64 bits. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* Device noticed. */
+#define STATUS_DRIVER 0x02              /* Driver found. */
+#define STATUS_DRIVER_OK 0x04           /* Ready to go. */
+#define STATUS_FAILED 0x80              /* Gave up on the device. */
+
+/* Interrupt status bits. */
+#define ISR_QUEUE 0x01                  /* Used ring updated. */
+
+/* Descriptor flags. */
+#define DESC_NEXT 0x01                  /* Chain goes on at NEXT. */
+#define DESC_WRITE 0x02                 /* Written by the device. */
+
+/* Request header types and status values. */
+#define REQ_IN 0                        /* Read. */
+#define REQ_OUT 1                       /* Write. */
+#define REQ_OK 0                        /* Success. */
+
+/* Requests in flight per disk.  Request I uses descriptors 3*I
+   through 3*I + 2. */
+#define REQ_CNT 16
+
+/* Maximum number of disks. */
+#define DISK_CNT 8
+
+/* Virtqueue, laid out as [VIRTIO] section 2.4.2 requires: the
+   descriptor table, then the available ring, then, on the next
+   page, the used ring. */
+struct vring_desc
+  {
+    uint64_t addr;                      /* Physical address. */
+    uint32_t len;                       /* Length in bytes. */
+    uint16_t flags;                     /* DESC_* flags. */
+    uint16_t next;                      /* Next descriptor in chain. */
+  };
+
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    uint16_t ring[];                    /* Heads of offered chains. */
+  };
+
+struct vring_used_elem
+  {
+    uint32_t id;                        /* Head of finished chain. */
+    uint32_t len;                       /* Bytes written by device. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;                       /* Where the next entry goes. */
+    struct vring_used_elem ring[];
+  };
+
+/* A request, read by the device through its first and last
+   descriptors. */
+struct virtio_req
+  {
+    uint32_t type;                      /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;
+    uint64_t sector;                    /* First sector. */
+    uint8_t status;                     /* REQ_OK on success. */
+    struct semaphore done;              /* Upped on completion. */
+  };
+
+/* A virtio block device. */
+struct virtio_disk
+  {
+    char name[8];                       /* Name, e.g. "vda". */
+    uint16_t base;                      /* I/O port base. */
+    uint8_t irq;                        /* Interrupt vector. */
+    uint16_t qsize;                     /* Entries in the virtqueue. */
+    struct vring_desc *desc;            /* Descriptor table. */
+    struct vring_avail *avail;          /* Available ring. */
+    struct vring_used *used;            /* Used ring. */
+    uint16_t last_used;                 /* Next used entry to look at. */
+
+    struct virtio_req *reqs;            /* REQ_CNT requests. */
+    struct lock lock;                   /* Protects the fields below. */
+    struct condition req_free;          /* Signaled when FREE grows. */
+    uint32_t free;                      /* Bitmap of idle requests. */
+
+    uint8_t *bounce;                    /* Page for non-kernel buffers. */
+    struct lock bounce_lock;            /* Protects BOUNCE. */
+  };
+
+static struct virtio_disk disks[DISK_CNT];
+static size_t disk_cnt;
+
+static const struct block_operations virtio_operations;
+static intr_handler_func interrupt_handler;
+static bool setup_disk (struct virtio_disk *, struct pci_addr);
+
+/* Finds and registers every virtio block device, named "vda",
+   "vdb", and so on in PCI bus order, and scans each for
+   partitions. */
+void
+virtio_blk_init (void)
+{
+  struct pci_addr addr;
+  int index;
+
+  for (index = 0; disk_cnt < DISK_CNT
+         && pci_find_id (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, index, &addr);
+       index++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      uint64_t capacity;
+      struct block *block;
+      size_t i;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (!setup_disk (d, addr))
+        continue;
+
+      /* The interrupt line may be shared with other disks. */
+      for (i = 0; i < disk_cnt; i++)
+        if (disks[i].irq == d->irq)
+          break;
+      if (i == disk_cnt)
+        intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+      disk_cnt++;
+
+      capacity = (inl (d->base + VIRTIO_REG_CAPACITY)
+                  | (uint64_t) inl (d->base + VIRTIO_REG_CAPACITY + 4) << 32);
+      if (capacity > UINT32_MAX)
+        capacity = UINT32_MAX;
+      outb (d->base + VIRTIO_REG_STATUS,
+            STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+      block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                              &virtio_operations, d);
+      partition_scan (block);
+    }
+}
+
+/* Returns the number of virtio block devices found. */
+size_t
+virtio_blk_cnt (void)
+{
+  return disk_cnt;
+}
+
+/* Returns the offset of the used ring in a virtqueue of QSIZE
+   entries: the descriptors and available ring, rounded up to a
+   page. */
+static size_t
+vring_used_ofs (uint16_t qsize)
+{
+  return ROUND_UP (sizeof (struct vring_desc) * qsize
+                   + sizeof (struct vring_avail)
+                   + sizeof (uint16_t) * (qsize + 1), PGSIZE);
+}
+
+/* Returns the number of pages that a virtqueue of QSIZE entries
+   takes up. */
+static size_t
+vring_page_cnt (uint16_t qsize)
+{
+  size_t used_size = (sizeof (struct vring_used)
+                      + sizeof (struct vring_used_elem) * qsize
+                      + sizeof (uint16_t));
+  return DIV_ROUND_UP (vring_used_ofs (qsize) + used_size, PGSIZE);
+}
+
+/* Resets the device at ADDR and sets up disk D to drive it.
+   Returns true if successful, false if the device is unusable or
+   memory runs out, in which case the device is marked failed. */
+static bool
+setup_disk (struct virtio_disk *d, struct pci_addr addr)
+{
+  uint32_t bar = pci_read_config (addr, PCI_REG_BAR0);
+  uint8_t line = pci_read_config (addr, PCI_REG_INTR) & 0xff;
+  uint32_t command;
+  size_t i;
+
+  if (!(bar & 1) || (bar & 0xfffc) == 0 || line > 15)
+    return false;
+  d->base = bar & 0xfffc;
+  d->irq = line + 0x20;
+  command = pci_read_config (addr, PCI_REG_COMMAND);
+  pci_write_config (addr, PCI_REG_COMMAND,
+                    command | PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+  /* Reset, then say hello.  We accept no optional features. */
+  outb (d->base + VIRTIO_REG_STATUS, 0);
+  outb (d->base + VIRTIO_REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->base + VIRTIO_REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (d->base + VIRTIO_REG_GUEST_FEATURES, 0);
+
+  /* Set up queue 0. */
+  outw (d->base + VIRTIO_REG_QUEUE_SEL, 0);
+  d->qsize = inw (d->base + VIRTIO_REG_QUEUE_SIZE);
+  if (d->qsize < 3 * REQ_CNT)
+    goto fail;
+  d->desc = palloc_get_multiple (PAL_ZERO, vring_page_cnt (d->qsize));
+  d->reqs = palloc_get_page (PAL_ZERO);
+  d->bounce = palloc_get_page (0);
+  if (d->desc == NULL || d->reqs == NULL || d->bounce == NULL)
+    {
+      printf ("%s: out of memory for virtqueue\n", d->name);
+      goto fail;
+    }
+  d->avail = (struct vring_avail *) (d->desc + d->qsize);
+  d->used = (struct vring_used *) ((uint8_t *) d->desc
+                                   + vring_used_ofs (d->qsize));
+  d->last_used = 0;
+  outl (d->base + VIRTIO_REG_QUEUE_PFN, vtop (d->desc) / PGSIZE);
+
+  for (i = 0; i < REQ_CNT; i++)
+    sema_init (&d->reqs[i].done, 0);
+  lock_init (&d->lock);
+  cond_init (&d->req_free);
+  d->free = (1u << REQ_CNT) - 1;
+  lock_init (&d->bounce_lock);
+  return true;
+
+ fail:
+  outb (d->base + VIRTIO_REG_STATUS, STATUS_FAILED);
+  if (d->desc != NULL)
+    palloc_free_multiple (d->desc, vring_page_cnt (d->qsize));
+  palloc_free_page (d->reqs);
+  palloc_free_page (d->bounce);
+  d->desc = NULL;
+  d->reqs = NULL;
+  d->bounce = NULL;
+  return false;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, a kernel virtual address, which is therefore
+   physically contiguous: into BUFFER if WRITE is false,
+   otherwise out of it.  Panics if the device reports an
+   error. */
+static void
+transfer (struct virtio_disk *d, block_sector_t sec_no, void *buffer,
+          block_sector_t cnt, bool write)
+{
+  struct vring_desc *desc;
+  struct virtio_req *r;
+  int slot;
+
+  ASSERT (is_kernel_vaddr (buffer));
+
+  /* Claim an idle request. */
+  lock_acquire (&d->lock);
+  while (d->free == 0)
+    cond_wait (&d->req_free, &d->lock);
+  slot = __builtin_ctz (d->free);
+  d->free &= ~(1u << slot);
+
+  r = &d->reqs[slot];
+  r->type = write ? REQ_OUT : REQ_IN;
+  r->reserved = 0;
+  r->sector = sec_no;
+  r->status = 0xff;
+
+  desc = &d->desc[3 * slot];
+  desc[0].addr = vtop (r);
+  desc[0].len = offsetof (struct virtio_req, status);
+  desc[0].flags = DESC_NEXT;
+  desc[0].next = 3 * slot + 1;
+  desc[1].addr = vtop (buffer);
+  desc[1].len = cnt * BLOCK_SECTOR_SIZE;
+  desc[1].flags = DESC_NEXT | (write ? 0 : DESC_WRITE);
+  desc[1].next = 3 * slot + 2;
+  desc[2].addr = vtop (&r->status);
+  desc[2].len = 1;
+  desc[2].flags = DESC_WRITE;
+  desc[2].next = 0;
+
+  /* Offer the chain, making sure the device sees the descriptors
+     before the ring entry and the entry before the index. */
+  d->avail->ring[d->avail->idx % d->qsize] = 3 * slot;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+  lock_release (&d->lock);
+
+  sema_down (&r->done);
+  if (r->status != REQ_OK)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+
+  lock_acquire (&d->lock);
+  d->free |= 1u << slot;
+  cond_signal (&d->req_free, &d->lock);
+  lock_release (&d->lock);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between D and BUFFER,
+   as transfer(), copying through D's bounce page a page's worth
+   at a time if BUFFER is not a kernel address. */
+static void
+bounce_transfer (struct virtio_disk *d, block_sector_t sec_no,
+                 uint8_t *buffer, block_sector_t cnt, bool write)
+{
+  if (is_kernel_vaddr (buffer))
+    {
+      transfer (d, sec_no, buffer, cnt, write);
+      return;
+    }
+
+  lock_acquire (&d->bounce_lock);
+  while (cnt > 0)
+    {
+      block_sector_t chunk = PGSIZE / BLOCK_SECTOR_SIZE;
+      size_t size;
+
+      if (chunk > cnt)
+        chunk = cnt;
+      size = chunk * BLOCK_SECTOR_SIZE;
+      if (write)
+        memcpy (d->bounce, buffer, size);
+      transfer (d, sec_no, d->bounce, chunk, write);
+      if (!write)
+        memcpy (buffer, d->bounce, size);
+      buffer += size;
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+  lock_release (&d->bounce_lock);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER in
+   a single request. */
+static void
+virtio_read_multiple (void *d, block_sector_t sec_no, void *buffer,
+                      block_sector_t cnt)
+{
+  bounce_transfer (d, sec_no, buffer, cnt, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER in
+   a single request. */
+static void
+virtio_write_multiple (void *d, block_sector_t sec_no, const void *buffer,
+                       block_sector_t cnt)
+{
+  bounce_transfer (d, sec_no, (void *) buffer, cnt, true);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER. */
+static void
+virtio_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  virtio_read_multiple (d, sec_no, buffer, 1);
+}
+
+/* Writes sector SEC_NO to disk D from BUFFER. */
+static void
+virtio_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  virtio_write_multiple (d, sec_no, buffer, 1);
+}
+
+static const struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    virtio_read_multiple,
+    virtio_write_multiple
+  };
+
+/* Virtio interrupt handler.  Reading a disk's interrupt status
+   acknowledges the interrupt; then every request the disk has
+   finished since last time gets its waiter woken. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  struct virtio_disk *d;
+
+  for (d = disks; d < disks + disk_cnt; d++)
+    if (d->irq == f->vec_no
+        && (inb (d->base + VIRTIO_REG_ISR) & ISR_QUEUE))
+      while (d->last_used != d->used->idx)
+        {
+          struct vring_used_elem *e
+            = &d->used->ring[d->last_used % d->qsize];
+          sema_up (&d->reqs[e->id / 3].done);
+          d->last_used++;
+        }
+}
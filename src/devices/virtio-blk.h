@@ -0,0 +1,9 @@
+#ifndef DEVICES_VIRTIO_BLK_H
+#define DEVICES_VIRTIO_BLK_H
+
+#include <stddef.h>
+
+void virtio_blk_init (void);
+size_t virtio_blk_cnt (void);
+
+#endif /* devices/virtio-blk.h */
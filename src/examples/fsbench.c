@@ -0,0 +1,229 @@
+/* fsbench.c
+
+   File system throughput benchmark, in the style of fio.
+
+   Creates a file of SIZE kB, then writes and reads it in BLOCK
+   byte blocks, first sequentially and then at random block
+   offsets, calling fsync() after every FSYNC writes (never, if
+   FSYNC is 0).  With -p, that many processes run at once, each
+   on a file of its own.  Prints, for each phase, its throughput
+   in MB/s and percentiles of the time each read() or write()
+   took. */
+
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#define MAX_BLOCK 65536
+#define MAX_OPS 4096
+#define MAX_PROCS 8
+
+/* Settings, from the command line. */
+static int size_kb = 256;
+static int block_size = 4096;
+static int fsync_every = 0;
+static int ops = 0;
+static int proc_cnt = 1;
+static int child_idx = 0;
+
+static char block[MAX_BLOCK];
+static int64_t latencies[MAX_OPS];
+
+static void usage (void);
+static bool parse_args (int argc, char *argv[]);
+static bool run (void);
+static bool phase (int fd, const char *name, bool writing, bool random);
+static int compare_latencies (const void *, const void *);
+static void print_rate (const char *name, long long bytes, int64_t ns);
+
+int
+main (int argc, char *argv[])
+{
+  pid_t pids[MAX_PROCS];
+  int64_t start;
+  bool success = true;
+  int i;
+
+  if (!parse_args (argc, argv))
+    {
+      usage ();
+      return EXIT_FAILURE;
+    }
+  if (proc_cnt == 1 || child_idx > 0)
+    return run () ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  /* Run one child process per file, with the same settings. */
+  start = clock_ns ();
+  for (i = 0; i < proc_cnt; i++)
+    {
+      char cmd[128];
+
+      snprintf (cmd, sizeof cmd, "fsbench -s %d -b %d -f %d -n %d -c %d",
+                size_kb, block_size, fsync_every, ops, i + 1);
+      pids[i] = exec (cmd);
+      if (pids[i] == PID_ERROR)
+        {
+          printf ("fsbench: exec failed\n");
+          return EXIT_FAILURE;
+        }
+    }
+  for (i = 0; i < proc_cnt; i++)
+    if (wait (pids[i]) != EXIT_SUCCESS)
+      success = false;
+  print_rate ("all processes",
+              4LL * proc_cnt * ops * block_size, clock_ns () - start);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void
+usage (void)
+{
+  printf ("usage: fsbench [-s SIZE] [-b BLOCK] [-f FSYNC] [-n OPS] "
+          "[-p PROCS]\n"
+          "  -s SIZE   File size in kB (default: 256)\n"
+          "  -b BLOCK  Bytes per read or write, up to %d (default: 4096)\n"
+          "  -f FSYNC  fsync() after every FSYNC writes "
+          "(default: 0, never)\n"
+          "  -n OPS    Reads or writes in each phase, up to %d "
+          "(default: one pass over the file)\n"
+          "  -p PROCS  Run PROCS processes at once, up to %d (default: 1)\n",
+          MAX_BLOCK, MAX_OPS, MAX_PROCS);
+}
+
+/* Sets the settings from ARGV[].  Returns false if they are not
+   valid. */
+static bool
+parse_args (int argc, char *argv[])
+{
+  int i;
+
+  for (i = 1; i < argc; i += 2)
+    {
+      int value;
+
+      if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0'
+          || i + 1 >= argc)
+        return false;
+      value = atoi (argv[i + 1]);
+      switch (argv[i][1])
+        {
+        case 's': size_kb = value; break;
+        case 'b': block_size = value; break;
+        case 'f': fsync_every = value; break;
+        case 'n': ops = value; break;
+        case 'p': proc_cnt = value; break;
+        case 'c': child_idx = value; break;
+        default: return false;
+        }
+    }
+
+  if (ops == 0 && block_size > 0)
+    ops = size_kb * 1024 / block_size;
+  return (size_kb > 0 && block_size > 0 && block_size <= MAX_BLOCK
+          && block_size <= size_kb * 1024
+          && fsync_every >= 0 && ops > 0 && ops <= MAX_OPS
+          && proc_cnt > 0 && proc_cnt <= MAX_PROCS && child_idx >= 0);
+}
+
+/* Creates this process's file and runs each phase on it. */
+static bool
+run (void)
+{
+  char file_name[32];
+  bool success;
+  int fd;
+
+  random_init (child_idx);
+  snprintf (file_name, sizeof file_name, "fsbench.%d", child_idx);
+  remove (file_name);
+  if (!create (file_name, size_kb * 1024))
+    {
+      printf ("%s: create failed\n", file_name);
+      return false;
+    }
+  fd = open (file_name);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", file_name);
+      return false;
+    }
+
+  success = (phase (fd, "seq write", true, false)
+             && phase (fd, "seq read", false, false)
+             && phase (fd, "rand write", true, true)
+             && phase (fd, "rand read", false, true));
+  close (fd);
+  remove (file_name);
+  return success;
+}
+
+/* Does OPS reads or writes, depending on WRITING, of BLOCK_SIZE
+   bytes each on FD, in order or at random block offsets, and
+   prints how long they took as NAME. */
+static bool
+phase (int fd, const char *name, bool writing, bool random)
+{
+  int block_cnt = size_kb * 1024 / block_size;
+  int64_t start, total;
+  int i;
+
+  start = clock_ns ();
+  for (i = 0; i < ops; i++)
+    {
+      int block_idx = random ? (int) (random_ulong () % block_cnt)
+                             : i % block_cnt;
+      int64_t op_start = clock_ns ();
+      int bytes;
+
+      seek (fd, block_idx * block_size);
+      if (writing)
+        {
+          memset (block, i, block_size);
+          bytes = write (fd, block, block_size);
+        }
+      else
+        bytes = read (fd, block, block_size);
+      if (writing && fsync_every > 0 && (i + 1) % fsync_every == 0)
+        fsync (fd);
+      latencies[i] = clock_ns () - op_start;
+
+      if (bytes != block_size)
+        {
+          printf ("fsbench: %s of block %d failed\n", name, block_idx);
+          return false;
+        }
+    }
+  total = clock_ns () - start;
+
+  qsort (latencies, ops, sizeof *latencies, compare_latencies);
+  print_rate (name, (long long) ops * block_size, total);
+  printf ("  latency us: p50 %lld  p90 %lld  p99 %lld  max %lld\n",
+          latencies[ops / 2] / 1000, latencies[ops * 9 / 10] / 1000,
+          latencies[ops * 99 / 100] / 1000, latencies[ops - 1] / 1000);
+  return true;
+}
+
+/* qsort() comparison function for latencies. */
+static int
+compare_latencies (const void *a_, const void *b_)
+{
+  const int64_t *a = a_;
+  const int64_t *b = b_;
+
+  return *a < *b ? -1 : *a > *b;
+}
+
+/* Prints that NAME moved BYTES bytes in NS nanoseconds. */
+static void
+print_rate (const char *name, long long bytes, int64_t ns)
+{
+  long long rate = ns > 0 ? bytes * 10000 / ns : 0;
+
+  if (child_idx > 0)
+    printf ("[%d] ", child_idx);
+  printf ("%-13s %8lld bytes in %6lld ms: %4lld.%lld MB/s\n",
+          name, bytes, ns / 1000000, rate / 10, rate % 10);
+}
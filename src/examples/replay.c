@@ -0,0 +1,305 @@
+/* replay.c
+
+   Replays a system call log as a benchmark workload.
+
+   Reads FILE (default "systrace"), a log recorded by the kernel's
+   -systrace option and copied in with "pintos -p", and makes its
+   file system calls again, with the same names, sizes and
+   offsets, against the file system as it is now.  Each recorded
+   process's file descriptors are mapped to the ones its calls
+   return here.  With -s SPEED, each call waits until SPEED times
+   sooner than it was made, after the first; with 0, the default,
+   calls are made as fast as possible.  With -x, recorded exec()
+   and wait() calls are made too, and the children's own calls
+   are left to them, rather than made from this process.  Prints
+   how long the replay took next to how long the recording did.
+
+   Console reads and writes are not replayed, file names are
+   truncated as recorded, and the data written is not recorded,
+   so whatever was last read is written in its place. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <syscall-nr.h>
+#include <systrace.h>
+
+#define MAX_PROCS 32            /* Recorded processes. */
+#define MAX_FDS 64              /* File descriptors per process. */
+#define MAX_CHILDREN 32         /* Children run with -x. */
+
+/* A recorded process: its pid, and the descriptor open here for
+   each of the ones it had, or -1. */
+struct proc
+  {
+    int32_t pid;
+    int fds[MAX_FDS];
+  };
+
+/* A child started with -x: its recorded and live pids. */
+struct child
+  {
+    int32_t pid;
+    pid_t live_pid;
+  };
+
+static struct proc procs[MAX_PROCS];
+static int proc_cnt;
+static struct child children[MAX_CHILDREN];
+static int child_cnt;
+
+static int speed = 0;
+static bool run_children = false;
+
+static char buffer[16384];
+
+static void usage (void);
+static struct proc *find_proc (int32_t pid);
+static struct child *find_child (int32_t pid);
+static int *find_fd (struct proc *, uint32_t fd);
+static void pace (int64_t first_ns, int64_t start, int64_t ns);
+static bool replay (const struct systrace_record *);
+static void transfer (int fd, uint32_t size, bool writing);
+
+int
+main (int argc, char *argv[])
+{
+  const char *file_name = "systrace";
+  struct systrace_header h;
+  struct systrace_record r;
+  int64_t first_ns = 0, last_ns = 0, start;
+  uint32_t i, replayed = 0;
+  int fd, arg;
+
+  for (arg = 1; arg < argc; arg++)
+    if (!strcmp (argv[arg], "-s") && arg + 1 < argc)
+      speed = atoi (argv[++arg]);
+    else if (!strcmp (argv[arg], "-x"))
+      run_children = true;
+    else if (argv[arg][0] != '-' && arg + 1 == argc)
+      file_name = argv[arg];
+    else
+      {
+        usage ();
+        return EXIT_FAILURE;
+      }
+  if (speed < 0)
+    {
+      usage ();
+      return EXIT_FAILURE;
+    }
+
+  fd = open (file_name);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", file_name);
+      return EXIT_FAILURE;
+    }
+  if (read (fd, &h, sizeof h) != sizeof h || memcmp (h.magic, "SYSC", 4)
+      || h.record_size != sizeof r)
+    {
+      printf ("%s: not a system call log\n", file_name);
+      return EXIT_FAILURE;
+    }
+  if (h.lost_cnt > 0)
+    printf ("%s: %u calls were not recorded\n", file_name,
+            (unsigned) h.lost_cnt);
+
+  start = clock_ns ();
+  for (i = 0; i < h.record_cnt; i++)
+    {
+      if (read (fd, &r, sizeof r) != sizeof r)
+        {
+          printf ("%s: truncated after %u records\n", file_name,
+                  (unsigned) i);
+          break;
+        }
+      if (i == 0)
+        first_ns = r.ns;
+      last_ns = r.ns;
+      if (find_child (r.pid) != NULL)
+        continue;
+
+      pace (first_ns, start, r.ns);
+      if (replay (&r))
+        replayed++;
+    }
+  close (fd);
+
+  printf ("replay: %u of %u calls in %lld ms, recorded in %lld ms\n",
+          (unsigned) replayed, (unsigned) i,
+          (clock_ns () - start) / 1000000, (last_ns - first_ns) / 1000000);
+  return EXIT_SUCCESS;
+}
+
+static void
+usage (void)
+{
+  printf ("usage: replay [-s SPEED] [-x] [FILE]\n"
+          "  -s SPEED  Replay SPEED times as fast as recorded "
+          "(default: 0, as fast as possible)\n"
+          "  -x        Run recorded exec() and wait() calls\n"
+          "  FILE      System call log (default: systrace)\n");
+}
+
+/* Returns the recorded process PID, adding it if it is new, or a
+   null pointer if there are too many. */
+static struct proc *
+find_proc (int32_t pid)
+{
+  struct proc *p;
+  int i;
+
+  for (i = 0; i < proc_cnt; i++)
+    if (procs[i].pid == pid)
+      return &procs[i];
+  if (proc_cnt >= MAX_PROCS)
+    return NULL;
+
+  p = &procs[proc_cnt++];
+  p->pid = pid;
+  for (i = 0; i < MAX_FDS; i++)
+    p->fds[i] = -1;
+  return p;
+}
+
+/* Returns the child started with -x as recorded process PID, or
+   a null pointer if there is none. */
+static struct child *
+find_child (int32_t pid)
+{
+  int i;
+
+  for (i = 0; i < child_cnt; i++)
+    if (children[i].pid == pid)
+      return &children[i];
+  return NULL;
+}
+
+/* Returns P's entry for recorded descriptor FD, or a null pointer
+   if FD is out of range. */
+static int *
+find_fd (struct proc *p, uint32_t fd)
+{
+  return p != NULL && fd < MAX_FDS ? &p->fds[fd] : NULL;
+}
+
+/* If pacing, waits until the call recorded at NS is due, given
+   that the first was recorded at FIRST_NS and replayed at
+   START. */
+static void
+pace (int64_t first_ns, int64_t start, int64_t ns)
+{
+  int64_t due, now;
+
+  if (speed == 0)
+    return;
+  due = start + (ns - first_ns) / speed;
+  while ((now = clock_ns ()) < due)
+    poll (NULL, 0, (due - now + 999999) / 1000000);
+}
+
+/* Makes the call recorded in R.  Returns false if it is not one
+   that is replayed. */
+static bool
+replay (const struct systrace_record *r)
+{
+  struct proc *p = find_proc (r->pid);
+  int *fd = find_fd (p, r->args[0]);
+
+  switch (r->no)
+    {
+    case SYS_CREATE:
+      create (r->path, r->args[1]);
+      return true;
+    case SYS_REMOVE:
+      remove (r->path);
+      return true;
+    case SYS_MKDIR:
+      mkdir (r->path);
+      return true;
+    case SYS_CHDIR:
+      chdir (r->path);
+      return true;
+    case SYS_SYNC:
+      sync ();
+      return true;
+
+    case SYS_OPEN:
+      fd = find_fd (p, r->ret);
+      if (r->ret < 0 || fd == NULL)
+        return false;
+      if (*fd >= 0)
+        close (*fd);
+      *fd = open (r->path);
+      return true;
+    case SYS_CLOSE:
+      if (fd == NULL || *fd < 0)
+        return false;
+      close (*fd);
+      *fd = -1;
+      return true;
+
+    case SYS_READ:
+    case SYS_WRITE:
+      if (fd == NULL || *fd < 0)
+        return false;
+      transfer (*fd, r->args[2], r->no == SYS_WRITE);
+      return true;
+    case SYS_SEEK:
+      if (fd == NULL || *fd < 0)
+        return false;
+      seek (*fd, r->args[1]);
+      return true;
+    case SYS_TELL:
+    case SYS_FILESIZE:
+    case SYS_FSYNC:
+      if (fd == NULL || *fd < 0)
+        return false;
+      if (r->no == SYS_TELL)
+        tell (*fd);
+      else if (r->no == SYS_FILESIZE)
+        filesize (*fd);
+      else
+        fsync (*fd);
+      return true;
+
+    case SYS_EXEC:
+      if (!run_children || r->ret < 0 || child_cnt >= MAX_CHILDREN)
+        return false;
+      children[child_cnt].pid = r->ret;
+      children[child_cnt].live_pid = exec (r->path);
+      child_cnt++;
+      return true;
+    case SYS_WAIT:
+      {
+        struct child *c = find_child (r->args[0]);
+
+        if (!run_children || c == NULL || c->live_pid == PID_ERROR)
+          return false;
+        wait (c->live_pid);
+        return true;
+      }
+
+    default:
+      return false;
+    }
+}
+
+/* Reads or writes, depending on WRITING, SIZE bytes on FD. */
+static void
+transfer (int fd, uint32_t size, bool writing)
+{
+  while (size > 0)
+    {
+      unsigned chunk = size < sizeof buffer ? size : sizeof buffer;
+      int bytes = writing ? write (fd, buffer, chunk)
+                          : read (fd, buffer, chunk);
+
+      if (bytes <= 0)
+        break;
+      size -= bytes;
+    }
+}
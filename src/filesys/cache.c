@@ -0,0 +1,1002 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Buffer cache of file system sectors.
+
+   All file system I/O goes through a fixed set of CACHE_SIZE
+   sector buffers, replaced by the 2Q policy described below
+   evict().  Writes only
+   mark a buffer dirty; dirty buffers are written back to disk
+   when evicted, by the "flusher" workqueue once they have been
+   dirty for CACHE_DIRTY_AGE ticks, by cache_flush_range() for
+   fsync(), and by cache_flush() for sync() and at shutdown.
+
+   Writes are throttled by the number of dirty buffers.  Past
+   CACHE_DIRTY_BACKGROUND, the flusher starts writing back in
+   the background; past CACHE_DIRTY_LIMIT, a writer stalls to
+   write back buffers itself, so that dirty buffers do not crowd
+   out the rest of the cache.
+
+   CACHE_LOCK protects the mapping from sectors to buffers.  Each
+   buffer's LOCK protects its data and is held during I/O on it,
+   so that reading a sector into one buffer does not stall
+   lookups of the others.  A thread that holds a buffer's lock
+   never acquires CACHE_LOCK.
+
+   cache_flush() submits its writebacks to the disk's request
+   queue in batches of up to FLUSH_BATCH, so that the disk's
+   scheduler can sort and merge them, instead of writing one
+   buffer at a time.
+
+   cache_prefetch() queues sectors to be read into the cache in
+   the background by the "readahead" thread.
+
+   A buffer may also hold a "delayed" block: data written past the
+   end of a file before any disk sector was assigned to it.  Such
+   a buffer is named by an owner, the file's inode, and the index
+   of the block within the file, rather than by a sector.  Delayed
+   buffers are never evicted or written back; the owner assigns
+   them sectors with cache_delayed_assign() or drops them with
+   cache_delayed_discard().  See inode.c.
+
+   A write of part of a sector that is not cached does not read
+   the sector first.  Instead, the buffer remembers the range of
+   bytes written to it, WRITTEN_OFS to WRITTEN_END, and further
+   writes that extend that range continuously are combined into
+   it, so that a sector written in sequential pieces, as by a
+   program writing a file a few hundred bytes at a time, is never
+   read at all once the pieces cover it.  Only if the buffer must
+   be read, written back, or written discontinuously before then
+   is the sector read, into BOUNCE, and the bytes not written
+   merged into the buffer around the ones that were.
+
+   A buffer written with cache_log_at() is "pinned" as part of
+   the running journal transaction: it is not evicted or written
+   back until the transaction commits and the journal calls
+   cache_checkpoint().  See journal.c. */
+
+/* How often the flusher looks for old dirty buffers, and how
+   old they must be to be written back, in timer ticks. */
+#define CACHE_FLUSH_TICKS (5 * TIMER_FREQ)
+#define CACHE_DIRTY_AGE (30 * TIMER_FREQ)
+
+/* Numbers of dirty buffers at which background writeback starts
+   and at which writers stall. */
+#define CACHE_DIRTY_BACKGROUND (CACHE_SIZE / 4)
+#define CACHE_DIRTY_LIMIT (CACHE_SIZE / 2)
+
+/* Maximum number of sectors queued for readahead.  Requests
+   beyond that are dropped. */
+#define RA_QUEUE_SIZE 32
+
+/* Maximum number of writebacks cache_flush() has in flight. */
+#define FLUSH_BATCH 16
+
+/* Replacement queues.  See evict(). */
+enum cache_queue
+  {
+    QUEUE_IN,                           /* Seen once, probation. */
+    QUEUE_MAIN                          /* Seen again, protected. */
+  };
+
+/* Buffers the probation queue may hold before it must give up
+   its oldest, sectors remembered after leaving it, and metadata
+   buffers protected from eviction in favor of data. */
+#define IN_QUOTA (CACHE_SIZE / 4)
+#define GHOST_CNT (CACHE_SIZE / 2)
+#define META_QUOTA (CACHE_SIZE / 4)
+
+/* A cached sector. */
+struct cache_block
+  {
+    const void *owner;                  /* Owner if delayed, or null. */
+    block_sector_t sector;              /* Sector, or index if delayed. */
+    bool valid;                         /* Does SECTOR name a sector? */
+    bool loaded;                        /* DATA read from disk. */
+    int written_ofs, written_end;       /* If !LOADED, bytes written. */
+    bool dirty;                         /* DATA modified since read? */
+    int64_t dirtied;                    /* When DIRTY became true. */
+    enum cache_queue queue;             /* Replacement queue. */
+    unsigned long long stamp;           /* When queued or last used. */
+    bool meta;                          /* Holds file system metadata? */
+    bool pinned;                        /* Logged, not yet committed? */
+    struct lock lock;                   /* Protects DATA. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_block cache[CACHE_SIZE];
+static struct lock cache_lock;
+static unsigned long long use_clock;   /* Source of STAMPs. */
+
+/* Sectors recently evicted from the probation queue, a ring
+   buffer, protected by CACHE_LOCK. */
+static block_sector_t ghosts[GHOST_CNT];
+static size_t ghost_head, ghost_cnt;
+
+/* Number of dirty buffers that name a sector, updated
+   atomically, since buffers change under their own locks. */
+static size_t dirty_cnt;
+
+/* Readahead queue, a ring buffer. */
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;
+static struct lock ra_lock;
+static struct condition ra_nonempty;
+
+/* Writebacks in flight in cache_flush(), protected by
+   CACHE_LOCK. */
+static struct cache_block *flush_blocks[FLUSH_BATCH];
+static struct block_request flush_reqs[FLUSH_BATCH];
+static size_t flush_cnt;
+
+/* Periodic writeback: FLUSH_TIMER queues FLUSH_WORK in
+   FLUSH_WQ every CACHE_FLUSH_TICKS ticks.  BACKGROUND_WORK is
+   queued there by writers past CACHE_DIRTY_BACKGROUND.
+   Writeback may block for a long time, so it has a queue of its
+   own instead of using the system workqueue. */
+static struct workqueue flush_wq;
+static struct work flush_work;
+static struct work background_work;
+static struct timer_callout flush_timer;
+
+/* Sector read to fill in a partly written buffer.  Kept for
+   good rather than allocated each time, and protected by
+   BOUNCE_LOCK, which is acquired only while holding a buffer's
+   lock. */
+static uint8_t bounce[BLOCK_SECTOR_SIZE];
+static struct lock bounce_lock;
+
+/* When delayed blocks were last assigned sectors. */
+static int64_t delayed_flushed;
+
+/* Statistics. */
+static long long hit_cnt[2], miss_cnt[2];     /* Data, metadata. */
+static long long writeback_cnt, prefetch_cnt;
+static long long combined_cnt, merge_cnt;
+
+static struct cache_block *cache_find (const void *owner,
+                                       block_sector_t sector);
+static void read_at (block_sector_t, void *, int ofs, int size, bool meta);
+static void flush (block_sector_t start, size_t cnt, int64_t dirtied_by,
+                   size_t target);
+static work_func periodic_flush;
+static work_func background_flush;
+static timer_callout_func queue_flush;
+static void readahead (void *aux);
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  lock_init (&bounce_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    lock_init (&cache[i].lock);
+  lock_init (&ra_lock);
+  cond_init (&ra_nonempty);
+  workqueue_create (&flush_wq, "flusher", PRI_DEFAULT);
+  work_init (&flush_work, periodic_flush, NULL);
+  work_init (&background_work, background_flush, NULL);
+  timer_callout_init (&flush_timer, queue_flush, NULL);
+  timer_callout_add (&flush_timer, timer_ticks () + CACHE_FLUSH_TICKS);
+  thread_create ("readahead", PRI_DEFAULT, readahead, NULL);
+}
+
+/* Starts reading or writing buffer B's sector, as R, counting it
+   as metadata or data I/O according to B's META. */
+static void
+submit (struct cache_block *b, struct block_request *r, bool write)
+{
+  block_submit_class (fs_device, r, b->sector, b->data, 1, write,
+                      b->meta ? BLOCK_IO_META : BLOCK_IO_DATA);
+}
+
+/* Reads or writes buffer B's sector and waits for it. */
+static void
+transfer (struct cache_block *b, bool write)
+{
+  struct block_request r;
+
+  submit (b, &r, write);
+  block_wait (&r);
+}
+
+/* Reads buffer B's sector into it, unless already done.  If part
+   of B was written meanwhile, only the rest is taken from disk.
+   B's lock must be held. */
+static void
+load_block (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  if (b->loaded)
+    return;
+  if (b->written_ofs == b->written_end)
+    transfer (b, false);
+  else
+    {
+      struct block_request r;
+      int ofs = b->written_ofs;
+
+      lock_acquire (&bounce_lock);
+      block_submit_class (fs_device, &r, b->sector, bounce, 1, false,
+                          b->meta ? BLOCK_IO_META : BLOCK_IO_DATA);
+      block_wait (&r);
+      memcpy (bounce + ofs, b->data + ofs, b->written_end - ofs);
+      memcpy (b->data, bounce, BLOCK_SECTOR_SIZE);
+      lock_release (&bounce_lock);
+      merge_cnt++;
+    }
+  b->loaded = true;
+}
+
+/* Marks buffer B, whose lock must be held, dirty, noting when
+   it became so. */
+static void
+mark_dirty (struct cache_block *b)
+{
+  if (!b->dirty)
+    {
+      b->dirty = true;
+      b->dirtied = timer_ticks ();
+      if (b->owner == NULL)
+        __atomic_add_fetch (&dirty_cnt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Marks buffer B, whose lock must be held, clean. */
+static void
+mark_clean (struct cache_block *b)
+{
+  if (b->dirty)
+    {
+      b->dirty = false;
+      if (b->owner == NULL)
+        __atomic_sub_fetch (&dirty_cnt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Holds back a writer while too many buffers are dirty: starts
+   background writeback past CACHE_DIRTY_BACKGROUND, and past
+   CACHE_DIRTY_LIMIT writes buffers back until no more than
+   CACHE_DIRTY_BACKGROUND are dirty.  The caller must hold no
+   buffer lock. */
+static void
+throttle (void)
+{
+  size_t dirty = __atomic_load_n (&dirty_cnt, __ATOMIC_RELAXED);
+
+  if (dirty > CACHE_DIRTY_LIMIT)
+    flush (0, SIZE_MAX, INT64_MAX, CACHE_DIRTY_BACKGROUND);
+  else if (dirty > CACHE_DIRTY_BACKGROUND)
+    work_queue (&flush_wq, &background_work);
+}
+
+/* Returns true if buffer B holds data that should be written
+   back to disk now. */
+static bool
+needs_writeback (const struct cache_block *b)
+{
+  return b->valid && b->dirty && b->owner == NULL && !b->pinned;
+}
+
+/* Writes buffer B back to disk if it is dirty.  B's lock must be
+   held. */
+static void
+writeback (struct cache_block *b)
+{
+  ASSERT (lock_held_by_current_thread (&b->lock));
+
+  if (needs_writeback (b))
+    {
+      load_block (b);
+      transfer (b, true);
+      mark_clean (b);
+      writeback_cnt++;
+    }
+}
+
+/* Remembers SECTOR as recently evicted from the probation
+   queue, forgetting the oldest such sector if there are
+   GHOST_CNT.  CACHE_LOCK must be held. */
+static void
+ghost_add (block_sector_t sector)
+{
+  ghosts[(ghost_head + ghost_cnt) % GHOST_CNT] = sector;
+  if (ghost_cnt < GHOST_CNT)
+    ghost_cnt++;
+  else
+    ghost_head = (ghost_head + 1) % GHOST_CNT;
+}
+
+/* Returns true if SECTOR was recently evicted from the
+   probation queue, forgetting it.  CACHE_LOCK must be held. */
+static bool
+ghost_take (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < ghost_cnt; i++)
+    {
+      size_t idx = (ghost_head + i) % GHOST_CNT;
+      if (ghosts[idx] == sector)
+        {
+          ghosts[idx] = ghosts[ghost_head];
+          ghost_head = (ghost_head + 1) % GHOST_CNT;
+          ghost_cnt--;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Returns the rank of buffer B as an eviction victim, lower
+   ranks going first, given whether the probation queue is over
+   its quota and whether metadata is within its own.  See
+   evict(). */
+static int
+victim_rank (const struct cache_block *b, bool in_over, bool meta_under)
+{
+  bool preferred = (b->queue == QUEUE_IN) == in_over;
+  bool protected = b->meta && meta_under;
+
+  return (preferred ? 0 : 2) + (protected ? 1 : 0);
+}
+
+/* Picks a buffer to hold a new sector, writing back its old
+   contents if necessary, and returns it locked.  CACHE_LOCK must
+   be held.
+
+   Replacement follows the simplified 2Q policy of Johnson and
+   Shasha.  A sector read for the first time enters the
+   probation queue, QUEUE_IN, which is evicted first-in,
+   first-out once it holds more than IN_QUOTA buffers, so that
+   one long sequential scan only cycles through those buffers.
+   A sector evicted from it is remembered for a while, and if it
+   is needed again meanwhile it enters QUEUE_MAIN, which keeps
+   the rest of the cache and is evicted least recently used
+   first.  Hits in QUEUE_IN do not count, since they are mostly
+   the several accesses of one operation.
+
+   Until META_QUOTA buffers hold metadata, such as inodes and
+   directories, data is evicted before them from either queue,
+   so that scanning file data does not push out the metadata
+   needed to find it. */
+static struct cache_block *
+evict (void)
+{
+  bool tried[CACHE_SIZE];
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  memset (tried, 0, sizeof tried);
+  for (;;)
+    {
+      struct cache_block *victim = NULL;
+      size_t in_cnt = 0, meta_cnt = 0;
+      int victim_r = 0;
+
+      for (i = 0; i < CACHE_SIZE; i++)
+        if (!cache[i].valid)
+          {
+            lock_acquire (&cache[i].lock);
+            return &cache[i];
+          }
+        else if (cache[i].owner == NULL)
+          {
+            in_cnt += cache[i].queue == QUEUE_IN;
+            meta_cnt += cache[i].meta;
+          }
+
+      for (i = 0; i < CACHE_SIZE; i++)
+        {
+          struct cache_block *b = &cache[i];
+          int r;
+
+          if (b->owner != NULL || b->pinned || tried[i])
+            continue;
+          r = victim_rank (b, in_cnt > IN_QUOTA, meta_cnt <= META_QUOTA);
+          if (victim == NULL || r < victim_r
+              || (r == victim_r && b->stamp < victim->stamp))
+            {
+              victim = b;
+              victim_r = r;
+            }
+        }
+
+      if (victim == NULL)
+        {
+          /* Every evictable buffer is busy.  Try them all
+             again. */
+          memset (tried, 0, sizeof tried);
+          continue;
+        }
+      tried[victim - cache] = true;
+      if (lock_try_acquire (&victim->lock))
+        {
+          /* Writing back under CACHE_LOCK keeps anyone from
+             reading the old sector from disk meanwhile. */
+          writeback (victim);
+          if (victim->queue == QUEUE_IN)
+            ghost_add (victim->sector);
+          return victim;
+        }
+    }
+}
+
+/* Returns the index of the buffer holding SECTOR of OWNER, or
+   CACHE_SIZE if there is none.  CACHE_LOCK must be held. */
+static size_t
+cache_index (const void *owner, block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector
+        && cache[i].owner == owner)
+      break;
+  return i;
+}
+
+/* Returns the buffer holding SECTOR of OWNER, locked, creating
+   it if necessary.  The data of a new buffer is read from disk
+   if LOAD is true, or zeroed if it is a delayed block; otherwise
+   it is left for the caller to overwrite, completely or as
+   cache_write_at() describes.  If META is
+   true, the buffer is marked as holding metadata, for I/O
+   statistics. */
+static struct cache_block *
+cache_get (const void *owner, block_sector_t sector, bool load, bool meta)
+{
+  struct cache_block *b;
+
+  for (;;)
+    {
+      size_t i;
+
+      lock_acquire (&cache_lock);
+      i = cache_index (owner, sector);
+      if (i == CACHE_SIZE)
+        {
+          b = evict ();
+          b->owner = owner;
+          b->sector = sector;
+          b->valid = true;
+          b->loaded = false;
+          b->written_ofs = b->written_end = 0;
+          b->dirty = false;
+          b->queue = (owner == NULL && ghost_take (sector)
+                      ? QUEUE_MAIN : QUEUE_IN);
+          b->stamp = ++use_clock;
+          b->pinned = false;
+          b->meta = meta;
+          miss_cnt[meta]++;
+          lock_release (&cache_lock);
+          break;
+        }
+      lock_release (&cache_lock);
+
+      b = cache_find (owner, sector);
+      if (b != NULL)
+        {
+          hit_cnt[meta]++;
+          break;
+        }
+    }
+
+  if (meta)
+    b->meta = true;
+  if (load && !b->loaded)
+    {
+      if (owner == NULL)
+        load_block (b);
+      else
+        memset (b->data, 0, BLOCK_SECTOR_SIZE);
+      b->loaded = true;
+    }
+  return b;
+}
+
+/* Returns the buffer holding SECTOR of OWNER, locked, or a null
+   pointer if it is not cached. */
+static struct cache_block *
+cache_find (const void *owner, block_sector_t sector)
+{
+  for (;;)
+    {
+      struct cache_block *b;
+      size_t i;
+
+      lock_acquire (&cache_lock);
+      i = cache_index (owner, sector);
+      if (i == CACHE_SIZE)
+        {
+          lock_release (&cache_lock);
+          return NULL;
+        }
+      b = &cache[i];
+      if (b->queue == QUEUE_MAIN)
+        b->stamp = ++use_clock;
+      lock_release (&cache_lock);
+
+      /* The buffer may have been reused for another sector while
+         we waited for it. */
+      lock_acquire (&b->lock);
+      if (b->valid && b->sector == sector && b->owner == owner)
+        return b;
+      lock_release (&b->lock);
+    }
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into
+   BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  read_at (sector, buffer, ofs, size, false);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR, which holds
+   file system metadata, into BUFFER. */
+void
+cache_read_meta_at (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  read_at (sector, buffer, ofs, size, true);
+}
+
+/* Reads SIZE bytes starting at byte OFS of SECTOR into BUFFER,
+   marking SECTOR's buffer as metadata if META is true. */
+static void
+read_at (block_sector_t sector, void *buffer, int ofs, int size, bool meta)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (NULL, sector, true, meta);
+  memcpy (buffer, b->data + ofs, size);
+  lock_release (&b->lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   OFS.  If the sector is not cached, it is not read unless the
+   write leaves a gap in what has been written to its buffer so
+   far.  See the comment at the top of the file. */
+void
+cache_write_at (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (NULL, sector, false, false);
+  if (!b->loaded && size < BLOCK_SECTOR_SIZE)
+    {
+      if (b->written_ofs == b->written_end)
+        {
+          b->written_ofs = ofs;
+          b->written_end = ofs + size;
+        }
+      else if (ofs <= b->written_end && ofs + size >= b->written_ofs)
+        {
+          if (ofs < b->written_ofs)
+            b->written_ofs = ofs;
+          if (ofs + size > b->written_end)
+            b->written_end = ofs + size;
+          combined_cnt++;
+        }
+      else
+        load_block (b);
+    }
+  memcpy (b->data + ofs, buffer, size);
+  if (size == BLOCK_SECTOR_SIZE
+      || (b->written_ofs == 0 && b->written_end == BLOCK_SECTOR_SIZE))
+    b->loaded = true;
+  mark_dirty (b);
+  lock_release (&b->lock);
+  throttle ();
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR, starting at byte
+   OFS, as cache_write_at(), and logs SECTOR in the running
+   journal transaction, so that it reaches its place on disk only
+   after the transaction commits.  If the transaction has no room
+   or journaling is off, the write is not logged. */
+void
+cache_log_at (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (NULL, sector, size < BLOCK_SECTOR_SIZE, true);
+  memcpy (b->data + ofs, buffer, size);
+  b->loaded = true;
+  mark_dirty (b);
+  if (!b->pinned)
+    b->pinned = journal_log (sector);
+  lock_release (&b->lock);
+}
+
+/* If SECTOR is pinned in the cache, copies it into BUFFER, which
+   must have room for BLOCK_SECTOR_SIZE bytes, and returns true.
+   Otherwise, returns false: the buffer was dropped because the
+   sector was freed and reused. */
+bool
+cache_copy_pinned (block_sector_t sector, void *buffer)
+{
+  struct cache_block *b = cache_find (NULL, sector);
+  bool pinned = b != NULL && b->pinned;
+
+  if (pinned)
+    memcpy (buffer, b->data, BLOCK_SECTOR_SIZE);
+  if (b != NULL)
+    lock_release (&b->lock);
+  return pinned;
+}
+
+/* Unpins SECTOR, whose journal transaction has committed, and
+   writes it back to its place on disk. */
+void
+cache_checkpoint (block_sector_t sector)
+{
+  struct cache_block *b = cache_find (NULL, sector);
+
+  if (b != NULL)
+    {
+      b->pinned = false;
+      writeback (b);
+      lock_release (&b->lock);
+    }
+}
+
+/* Reads SIZE bytes starting at byte OFS of delayed block IDX of
+   OWNER into BUFFER.  Returns false, without reading anything,
+   if that block is not cached. */
+bool
+cache_delayed_read_at (const void *owner, block_sector_t idx,
+                       void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (owner != NULL);
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_find (owner, idx);
+  if (b == NULL)
+    return false;
+  memcpy (buffer, b->data + ofs, size);
+  lock_release (&b->lock);
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into delayed block IDX of OWNER,
+   starting at byte OFS.  A new delayed block starts out zeroed. */
+void
+cache_delayed_write_at (const void *owner, block_sector_t idx,
+                        const void *buffer, int ofs, int size)
+{
+  struct cache_block *b;
+
+  ASSERT (owner != NULL);
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  b = cache_get (owner, idx, true, false);
+  memcpy (b->data + ofs, buffer, size);
+  mark_dirty (b);
+  lock_release (&b->lock);
+}
+
+/* Invalidates buffer B, if it is not a null pointer, and
+   releases it. */
+static void
+invalidate (struct cache_block *b)
+{
+  if (b != NULL)
+    {
+      mark_clean (b);
+      b->valid = false;
+      b->pinned = false;
+      lock_release (&b->lock);
+    }
+}
+
+/* Turns delayed block IDX of OWNER into a dirty buffer for
+   SECTOR, dropping any stale buffer for SECTOR.  Returns false if
+   that block is not cached. */
+bool
+cache_delayed_assign (const void *owner, block_sector_t idx,
+                      block_sector_t sector)
+{
+  struct cache_block *b;
+  size_t i;
+
+  ASSERT (owner != NULL);
+
+  invalidate (cache_find (NULL, sector));
+
+  /* Renaming under CACHE_LOCK suffices: the data stays the same,
+     and anyone waiting for the buffer rechecks its name. */
+  lock_acquire (&cache_lock);
+  i = cache_index (owner, idx);
+  if (i < CACHE_SIZE)
+    {
+      b = &cache[i];
+      b->owner = NULL;
+      b->sector = sector;
+      ASSERT (b->dirty);
+      __atomic_add_fetch (&dirty_cnt, 1, __ATOMIC_RELAXED);
+    }
+  lock_release (&cache_lock);
+  return i < CACHE_SIZE;
+}
+
+/* Drops all of OWNER's delayed blocks. */
+void
+cache_delayed_discard (const void *owner)
+{
+  size_t i;
+
+  ASSERT (owner != NULL);
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].owner == owner)
+      invalidate (cache_find (owner, cache[i].sector));
+}
+
+/* Returns true if OWNER has delayed block IDX. */
+bool
+cache_delayed_present (const void *owner, block_sector_t idx)
+{
+  bool found;
+
+  ASSERT (owner != NULL);
+
+  lock_acquire (&cache_lock);
+  found = cache_index (owner, idx) != CACHE_SIZE;
+  lock_release (&cache_lock);
+  return found;
+}
+
+/* Stores the indexes of OWNER's delayed blocks into IDX, which
+   has room for MAX of them, in increasing order, and returns
+   their number. */
+size_t
+cache_delayed_list (const void *owner, block_sector_t idx[], size_t max)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  ASSERT (owner != NULL);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].owner == owner)
+      {
+        size_t j;
+
+        ASSERT (cnt < max);
+        for (j = cnt++; j > 0 && idx[j - 1] > cache[i].sector; j--)
+          idx[j] = idx[j - 1];
+        idx[j] = cache[i].sector;
+      }
+  lock_release (&cache_lock);
+  return cnt;
+}
+
+/* Returns true if SECTOR is in the cache. */
+static bool
+cache_contains (block_sector_t sector)
+{
+  bool found;
+
+  lock_acquire (&cache_lock);
+  found = cache_index (NULL, sector) != CACHE_SIZE;
+  lock_release (&cache_lock);
+  return found;
+}
+
+/* Starts reading SECTOR into the cache in the background, unless
+   it is cached already.  Does not wait for the read. */
+void
+cache_prefetch (block_sector_t sector)
+{
+  if (cache_contains (sector))
+    return;
+
+  lock_acquire (&ra_lock);
+  if (ra_cnt < RA_QUEUE_SIZE)
+    {
+      ra_queue[(ra_head + ra_cnt++) % RA_QUEUE_SIZE] = sector;
+      cond_signal (&ra_nonempty, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/* Readahead thread: reads the sectors queued by
+   cache_prefetch(). */
+static void
+readahead (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_nonempty, &ra_lock);
+      sector = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+      ra_cnt--;
+      lock_release (&ra_lock);
+
+      if (!cache_contains (sector))
+        {
+          lock_release (&cache_get (NULL, sector, true, false)->lock);
+          prefetch_cnt++;
+        }
+    }
+}
+
+/* Waits for the writebacks started by cache_flush() and
+   releases their buffers.  CACHE_LOCK must be held. */
+static void
+flush_wait (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < flush_cnt; i++)
+    {
+      block_wait (&flush_reqs[i]);
+      lock_release (&flush_blocks[i]->lock);
+    }
+  flush_cnt = 0;
+}
+
+/* Writes every dirty buffer back to disk. */
+void
+cache_flush (void)
+{
+  flush (0, SIZE_MAX, INT64_MAX, 0);
+}
+
+/* Writes back every dirty buffer for the CNT sectors starting at
+   START. */
+void
+cache_flush_range (block_sector_t start, size_t cnt)
+{
+  flush (start, cnt, INT64_MAX, 0);
+}
+
+/* Writes back the dirty buffers for the CNT sectors starting at
+   START that became dirty no later than DIRTIED_BY, stopping
+   early once no more than TARGET buffers are dirty.
+
+   Buffers being written back stay locked until their writes
+   complete.  To avoid deadlock, this only waits for a buffer's
+   lock while it holds no other buffer locks: if a buffer is
+   busy, the writebacks in flight are finished first. */
+static void
+flush (block_sector_t start, size_t cnt, int64_t dirtied_by, size_t target)
+{
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_block *b = &cache[i];
+
+      if (__atomic_load_n (&dirty_cnt, __ATOMIC_RELAXED) <= target)
+        break;
+      if (!lock_try_acquire (&b->lock))
+        {
+          flush_wait ();
+          lock_acquire (&b->lock);
+        }
+      if (needs_writeback (b)
+          && b->sector >= start && b->sector - start < cnt
+          && b->dirtied <= dirtied_by)
+        {
+          load_block (b);
+          submit (b, &flush_reqs[flush_cnt], true);
+          mark_clean (b);
+          writeback_cnt++;
+          flush_blocks[flush_cnt++] = b;
+          if (flush_cnt == FLUSH_BATCH)
+            flush_wait ();
+        }
+      else
+        lock_release (&b->lock);
+    }
+  flush_wait ();
+  lock_release (&cache_lock);
+}
+
+/* Called by the timer every CACHE_FLUSH_TICKS ticks to start
+   a periodic writeback. */
+static void
+queue_flush (void *aux UNUSED)
+{
+  work_queue (&flush_wq, &flush_work);
+}
+
+/* Writes back the buffers dirty for CACHE_DIRTY_AGE ticks or
+   more, first assigning sectors to delayed blocks if that was
+   last done that long ago, so that a crash loses about
+   CACHE_DIRTY_AGE worth of writes at most, then schedules the
+   next writeback. */
+static void
+periodic_flush (void *aux UNUSED)
+{
+  int64_t now = timer_ticks ();
+
+  if (now - delayed_flushed >= CACHE_DIRTY_AGE)
+    {
+      inode_flush_delayed ();
+      delayed_flushed = now;
+    }
+  flush (0, SIZE_MAX, now - CACHE_DIRTY_AGE, 0);
+  timer_callout_add (&flush_timer, timer_ticks () + CACHE_FLUSH_TICKS);
+}
+
+/* Writes back dirty buffers, oldest or not, until no more than
+   CACHE_DIRTY_BACKGROUND are dirty. */
+static void
+background_flush (void *aux UNUSED)
+{
+  flush (0, SIZE_MAX, INT64_MAX, CACHE_DIRTY_BACKGROUND);
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  int class;
+
+  for (class = 0; class < 2; class++)
+    {
+      long long total = hit_cnt[class] + miss_cnt[class];
+
+      printf ("Cache %s: %lld hits, %lld misses, %lld%% hit ratio\n",
+              class ? "metadata" : "data", hit_cnt[class],
+              miss_cnt[class],
+              total > 0 ? hit_cnt[class] * 100 / total : 0);
+    }
+  printf ("Cache: %lld writebacks, %lld prefetched\n",
+          writeback_cnt, prefetch_cnt);
+  printf ("Cache: %lld partial writes combined, %lld merged with disk\n",
+          combined_cnt, merge_cnt);
+}
@@ -0,0 +1,34 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of sectors in the buffer cache. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, int ofs, int size);
+void cache_read_meta_at (block_sector_t, void *, int ofs, int size);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, int ofs, int size);
+void cache_log_at (block_sector_t, const void *, int ofs, int size);
+bool cache_copy_pinned (block_sector_t, void *);
+void cache_checkpoint (block_sector_t);
+bool cache_delayed_read_at (const void *owner, block_sector_t idx,
+                            void *, int ofs, int size);
+void cache_delayed_write_at (const void *owner, block_sector_t idx,
+                             const void *, int ofs, int size);
+bool cache_delayed_assign (const void *owner, block_sector_t idx,
+                           block_sector_t sector);
+void cache_delayed_discard (const void *owner);
+bool cache_delayed_present (const void *owner, block_sector_t idx);
+size_t cache_delayed_list (const void *owner, block_sector_t idx[],
+                           size_t max);
+void cache_prefetch (block_sector_t);
+void cache_flush (void);
+void cache_flush_range (block_sector_t, size_t);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
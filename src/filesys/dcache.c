@@ -0,0 +1,164 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+
+/* Dentry cache.
+
+   Remembers the results of directory lookups, keyed by the
+   sector of the directory's inode and the name looked up, so
+   that opening the same path again does not rescan the
+   directory.  An entry's target is the sector of the named
+   file's inode, or DCACHE_NONE if the directory has no such
+   name.
+
+   The cache is direct-mapped: each key has exactly one slot,
+   and a new entry simply replaces whatever was there.  The
+   directory code keeps it coherent by inserting the new result
+   whenever it adds or removes a name, and by forgetting all of
+   a directory's entries when its inode is removed, since the
+   sector may be reused for another directory.
+
+   Lookups take no lock: a slot points to its entry, and entries
+   are never changed once published, only replaced, with
+   rcu_assign_pointer(), by a writer holding DCACHE_LOCK.  The
+   entry replaced is freed with call_rcu(), once no lookup can
+   still be reading it. */
+
+/* A cached lookup. */
+struct dentry
+  {
+    block_sector_t parent;              /* Directory inode sector. */
+    block_sector_t sector;              /* Target, or DCACHE_NONE. */
+    struct rcu_head rcu;                /* Frees the entry. */
+    char name[NAME_MAX + 1];            /* Null terminated name. */
+  };
+
+static struct dentry *dcache[DCACHE_SIZE];
+static struct lock dcache_lock;
+
+/* Statistics. */
+static atomic64_t hit_cnt, negative_cnt, miss_cnt;
+
+static void replace (struct dentry **, struct dentry *);
+static rcu_func free_dentry;
+
+/* Initializes the dentry cache. */
+void
+dcache_init (void) 
+{
+  lock_init (&dcache_lock);
+}
+
+/* Returns the slot for NAME in the directory whose inode is in
+   sector PARENT. */
+static struct dentry **
+slot (block_sector_t parent, const char *name) 
+{
+  unsigned h = hash_bytes (&parent, sizeof parent) ^ hash_string (name);
+  return &dcache[h % DCACHE_SIZE];
+}
+
+/* Looks up NAME in the directory whose inode is in sector
+   PARENT.  If the result is cached, stores the target's sector,
+   or DCACHE_NONE if NAME does not exist, into *SECTOR and
+   returns true.  Otherwise, returns false. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sector) 
+{
+  struct dentry **s = slot (parent, name);
+  struct dentry *d;
+  bool found;
+
+  rcu_read_lock ();
+  d = rcu_dereference (*s);
+  found = d != NULL && d->parent == parent && !strcmp (d->name, name);
+  if (found)
+    {
+      *sector = d->sector;
+      atomic64_inc (d->sector != DCACHE_NONE ? &hit_cnt : &negative_cnt);
+    }
+  else
+    atomic64_inc (&miss_cnt);
+  rcu_read_unlock ();
+
+  return found;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   PARENT names the inode in SECTOR, or, if SECTOR is
+   DCACHE_NONE, that it names nothing.  Names too long to be in a
+   directory are not cached.  If memory is short, only forgets
+   whatever the slot held. */
+void
+dcache_insert (block_sector_t parent, const char *name,
+               block_sector_t sector) 
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  d = malloc (sizeof *d);
+  if (d != NULL)
+    {
+      d->parent = parent;
+      d->sector = sector;
+      strlcpy (d->name, name, sizeof d->name);
+    }
+
+  lock_acquire (&dcache_lock);
+  replace (slot (parent, name), d);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every entry for names in the directory whose inode is
+   in sector PARENT. */
+void
+dcache_forget_dir (block_sector_t parent) 
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    if (dcache[i] != NULL && dcache[i]->parent == parent)
+      replace (&dcache[i], NULL);
+  lock_release (&dcache_lock);
+}
+
+/* Makes slot S point to entry D, which may be null, and frees
+   the entry it pointed to once lookups are done with it.  The
+   caller must hold DCACHE_LOCK. */
+static void
+replace (struct dentry **s, struct dentry *d)
+{
+  struct dentry *old = *s;
+
+  ASSERT (lock_held_by_current_thread (&dcache_lock));
+
+  rcu_assign_pointer (*s, d);
+  if (old != NULL)
+    call_rcu (&old->rcu, free_dentry);
+}
+
+/* call_rcu() callback that frees the entry with rcu_head RCU. */
+static void
+free_dentry (struct rcu_head *rcu)
+{
+  free (rcu_entry (rcu, struct dentry, rcu));
+}
+
+/* Prints dentry cache statistics. */
+void
+dcache_print_stats (void) 
+{
+  printf ("Dentry cache: %lld hits, %lld negative hits, %lld misses\n",
+          atomic64_read (&hit_cnt), atomic64_read (&negative_cnt),
+          atomic64_read (&miss_cnt));
+}
@@ -2,6 +2,9 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -19,8 +22,42 @@ struct dir_entry
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    bool removed;                       /* Free, but was in use? */
   };
 
+/* Directory layout.
+
+   A directory is an array of entry slots.  Small directories,
+   with at most DIR_LINEAR_MAX slots, are searched linearly and
+   filled first-fit.  Larger ones are hash tables: an entry lives
+   in the first free slot at or after the slot its name hashes
+   to, wrapping around, and a removed entry leaves a tombstone so
+   that later entries stay reachable.  When an insertion finds no
+   free slot within DIR_PROBE_MAX slots, the directory is rehashed
+   into twice as many slots. */
+#define DIR_LINEAR_MAX 16
+#define DIR_PROBE_MAX 8
+
+/* Number of entry slots dir_read_entries() reads at once. */
+#define DIR_READ_BATCH 16
+
+static bool rehash (struct dir *, size_t slots);
+
+/* Returns the number of entry slots in DIR. */
+static size_t
+slot_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / sizeof (struct dir_entry);
+}
+
+/* Returns the byte offset of the Ith slot probed for NAME in a
+   hashed directory with SLOTS slots. */
+static off_t
+probe_ofs (const char *name, size_t i, size_t slots)
+{
+  return (hash_string (name) + i) % slots * sizeof (struct dir_entry);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
    given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -39,6 +76,7 @@ dir_open (struct inode *inode)
     {
       dir->inode = inode;
       dir->pos = 0;
+      inode_set_journaled (inode);
       return dir;
     }
   else
@@ -93,41 +131,133 @@ lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  size_t slots = slot_cnt (dir);
+  size_t ofs, i;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
+  if (slots <= DIR_LINEAR_MAX)
+    {
+      for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+           ofs += sizeof e) 
+        if (e.in_use && !strcmp (name, e.name)) 
+          goto found;
+      return false;
+    }
+
+  for (i = 0; i < slots; i++)
+    {
+      ofs = probe_ofs (name, i, slots);
+      if (inode_read_at (dir->inode, &e, sizeof e, ofs) != sizeof e
+          || (!e.in_use && !e.removed))
+        return false;
+      if (e.in_use && !strcmp (name, e.name))
+        goto found;
+    }
   return false;
+
+ found:
+  if (ep != NULL)
+    *ep = e;
+  if (ofsp != NULL)
+    *ofsp = ofs;
+  return true;
+}
+
+/* Stores entry E into a free slot of hashed directory DIR,
+   probing at most MAX_PROBES slots.  Returns false if there is no
+   free slot among them or on a disk error. */
+static bool
+insert_hashed (struct dir *dir, const struct dir_entry *e, size_t max_probes)
+{
+  size_t slots = slot_cnt (dir);
+  size_t i;
+
+  for (i = 0; i < max_probes && i < slots; i++)
+    {
+      off_t ofs = probe_ofs (e->name, i, slots);
+      struct dir_entry old;
+
+      if (inode_read_at (dir->inode, &old, sizeof old, ofs) != sizeof old)
+        return false;
+      if (!old.in_use)
+        return inode_write_at (dir->inode, e, sizeof *e, ofs) == sizeof *e;
+    }
+  return false;
+}
+
+/* Rebuilds DIR as a hashed directory with SLOTS slots, which
+   must be more than it has.  Returns false, leaving DIR
+   unchanged, if the directory cannot grow. */
+static bool
+rehash (struct dir *dir, size_t slots)
+{
+  static const struct dir_entry empty;
+  size_t old_slots = slot_cnt (dir);
+  struct dir_entry *entries;
+  size_t cnt, i;
+  bool success = false;
+
+  ASSERT (slots > old_slots);
+
+  entries = malloc (old_slots * sizeof *entries);
+  if (entries == NULL)
+    return false;
+
+  /* Save the entries in use, then grow and clear the slots. */
+  for (cnt = i = 0; i < old_slots; i++)
+    if (inode_read_at (dir->inode, &entries[cnt], sizeof *entries,
+                       i * sizeof *entries) == sizeof *entries
+        && entries[cnt].in_use)
+      cnt++;
+  if (inode_write_at (dir->inode, &empty, sizeof empty,
+                      (slots - 1) * sizeof empty) != sizeof empty)
+    goto done;
+  for (i = 0; i < old_slots; i++)
+    inode_write_at (dir->inode, &empty, sizeof empty, i * sizeof empty);
+
+  /* At most half full, with no tombstones: every entry fits. */
+  success = true;
+  for (i = 0; i < cnt; i++)
+    if (!insert_hashed (dir, &entries[i], slots))
+      success = false;
+
+ done:
+  free (entries);
+  return success;
 }
 
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Consults the dentry cache before scanning DIR. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent, sector;
   struct dir_entry e;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  /* Hold the directory's lock until the inode is open, so that
+     it cannot be removed and freed in between. */
+  inode_lock (dir->inode);
+  parent = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (parent, name, &sector))
+    {
+      sector = lookup (dir, name, &e, NULL) ? e.inode_sector : DCACHE_NONE;
+      dcache_insert (parent, name, sector);
+    }
+
+  if (sector != DCACHE_NONE)
+    *inode = inode_open (sector);
   else
     *inode = NULL;
+  inode_unlock (dir->inode);
 
   return *inode != NULL;
 }
@@ -153,28 +283,53 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
     return false;
 
   /* Check that NAME is not in use. */
+  inode_lock (dir->inode);
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Fill in the new entry. */
+  memset (&e, 0, sizeof e);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+
+  if (slot_cnt (dir) <= DIR_LINEAR_MAX)
+    {
+      struct dir_entry old;
+
+      /* Set OFS to offset of free slot.
+         If there are no free slots, then it will be set to the
+         current end-of-file.
+         
+         inode_read_at() will only return a short read at end of
+         file.  Otherwise, we'd need to verify that we didn't get
+         a short read due to something intermittent such as low
+         memory. */
+      for (ofs = 0;
+           inode_read_at (dir->inode, &old, sizeof old, ofs) == sizeof old;
+           ofs += sizeof old) 
+        if (!old.in_use)
+          break;
+
+      /* Write slot, unless the directory outgrows linear
+         search. */
+      if (ofs / sizeof e < DIR_LINEAR_MAX)
+        {
+          success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+          goto done;
+        }
+      if (!rehash (dir, 2 * DIR_LINEAR_MAX))
+        goto done;
+    }
+
+  while (!(success = insert_hashed (dir, &e, DIR_PROBE_MAX)))
+    if (!rehash (dir, 2 * slot_cnt (dir)))
+      break;
 
  done:
+  if (success)
+    dcache_insert (inode_get_inumber (dir->inode), name, inode_sector);
+  inode_unlock (dir->inode);
   return success;
 }
 
@@ -193,6 +348,7 @@ dir_remove (struct dir *dir, const char *name)
   ASSERT (name != NULL);
 
   /* Find directory entry. */
+  inode_lock (dir->inode);
   if (!lookup (dir, name, &e, &ofs))
     goto done;
 
@@ -203,14 +359,18 @@ dir_remove (struct dir *dir, const char *name)
 
   /* Erase directory entry. */
   e.in_use = false;
+  e.removed = true;
   if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
     goto done;
 
   /* Remove inode. */
   inode_remove (inode);
+  dcache_insert (inode_get_inumber (dir->inode), name, DCACHE_NONE);
+  dcache_forget_dir (e.inode_sector);
   success = true;
 
  done:
+  inode_unlock (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -222,15 +382,72 @@ bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
+  inode_lock (dir->inode);
   while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
       if (e.in_use)
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
+          break;
         } 
     }
-  return false;
+  inode_unlock (dir->inode);
+  return found;
+}
+
+/* Reads up to MAX of the entries in DIR into INFO, starting at
+   byte offset *POS, and advances *POS past them, so that a later
+   call continues where this one stopped.  Entry slots are read
+   DIR_READ_BATCH at a time, instead of one by one as
+   dir_readdir() does.  If ATTRS is true, also stores each file's
+   length, prefetching all of their inodes first so that reading
+   them does not wait for each in turn.  Returns the number of
+   entries read, 0 at the end of DIR. */
+size_t
+dir_read_entries (struct dir *dir, off_t *pos, struct dir_info info[],
+                  size_t max, bool attrs)
+{
+  struct dir_entry e[DIR_READ_BATCH];
+  size_t cnt = 0;
+  size_t i;
+
+  *pos -= *pos % sizeof *e;
+  inode_lock (dir->inode);
+  while (cnt < max)
+    {
+      off_t bytes = inode_read_at (dir->inode, e, sizeof e, *pos);
+      size_t slots = bytes > 0 ? bytes / sizeof *e : 0;
+
+      for (i = 0; i < slots && cnt < max; i++)
+        {
+          *pos += sizeof *e;
+          if (e[i].in_use)
+            {
+              strlcpy (info[cnt].name, e[i].name, sizeof info[cnt].name);
+              info[cnt].inode_sector = e[i].inode_sector;
+              info[cnt++].length = 0;
+            }
+        }
+      if (slots < DIR_READ_BATCH)
+        break;
+    }
+  inode_unlock (dir->inode);
+
+  if (attrs)
+    {
+      for (i = 0; i < cnt; i++)
+        cache_prefetch (info[i].inode_sector);
+      for (i = 0; i < cnt; i++)
+        {
+          struct inode *inode = inode_open (info[i].inode_sector);
+          if (inode != NULL)
+            info[i].length = inode_length (inode);
+          inode_close (inode);
+        }
+    }
+  return cnt;
 }
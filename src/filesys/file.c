@@ -3,12 +3,18 @@
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
+/* Bounds of the readahead window, in bytes.  See file_read(). */
+#define RA_INIT (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX (16 * BLOCK_SECTOR_SIZE)
+
 /* An open file. */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_window;            /* Readahead window, 0 if not sequential. */
+    off_t ra_end;               /* End of data read ahead so far. */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +29,8 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_window = 0;
+      file->ra_end = 0;
       return file;
     }
   else
@@ -64,12 +72,32 @@ file_get_inode (struct file *file)
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+
+   Reads that continue where the previous one left off are
+   sequential: each one doubles the readahead window, up to
+   RA_MAX, and the data in the window past the new position is
+   read into the buffer cache in the background.  A seek resets
+   the window. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t end;
+
   file->pos += bytes_read;
+
+  file->ra_window = (file->ra_window == 0 ? RA_INIT
+                     : file->ra_window * 2 < RA_MAX ? file->ra_window * 2
+                     : RA_MAX);
+  end = file->pos + file->ra_window;
+  if (file->ra_end < file->pos)
+    file->ra_end = file->pos;
+  if (bytes_read > 0 && file->ra_end < end)
+    {
+      inode_readahead (file->inode, file->ra_end, end - file->ra_end);
+      file->ra_end = end;
+    }
   return bytes_read;
 }
 
@@ -87,9 +115,8 @@ file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
    Advances FILE's position by the number of bytes read. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
@@ -102,9 +129,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk is full.
+   Writing past end of file grows the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -113,6 +139,28 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Allocates disk space for the LENGTH bytes of FILE starting at
+   offset FILE_OFS, growing the file if they go past its end, so
+   that writing them later neither fails for lack of space nor
+   fragments the file.  The space reads as zeros; if UNWRITTEN is
+   true, it is not zeroed on disk up front.  Returns true if
+   successful, false if the disk is too full or writes to FILE
+   are denied.  The file's current position is unaffected. */
+bool
+file_allocate (struct file *file, off_t file_ofs, off_t length,
+               bool unwritten)
+{
+  return inode_preallocate (file->inode, file_ofs, length, unwritten);
+}
+
+/* Writes FILE's data and inode to disk and waits until they are
+   there. */
+void
+file_sync (struct file *file)
+{
+  inode_sync (file->inode);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -155,6 +203,12 @@ file_seek (struct file *file, off_t new_pos)
 {
   ASSERT (file != NULL);
   ASSERT (new_pos >= 0);
+  if (new_pos != file->pos)
+    {
+      /* No longer sequential: restart the readahead window. */
+      file->ra_window = 0;
+      file->ra_end = 0;
+    }
   file->pos = new_pos;
 }
 
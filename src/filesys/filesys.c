@@ -2,10 +2,16 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/initrd.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
+#include "filesys/procfs.h"
+#include "filesys/tmpfs.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,12 +27,19 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  dcache_init ();
   inode_init ();
   free_map_init ();
+  journal_init ();
+  tmpfs_init ();
+  initrd_init ();
+  procfs_init ();
 
   if (format) 
     do_format ();
 
+  journal_open ();
   free_map_open ();
 }
 
@@ -35,7 +48,20 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  filesys_sync ();
+  journal_close ();
   free_map_close ();
+  cache_flush ();
+}
+
+/* Writes all file system data and metadata to disk and waits
+   until it is there. */
+void
+filesys_sync (void)
+{
+  inode_flush_delayed ();
+  journal_sync ();
+  cache_flush ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,14 +72,28 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
+  struct dir *dir;
+  bool allocated, success;
+
+  if (tmpfs_name (name) != NULL)
+    return tmpfs_create (tmpfs_name (name), initial_size);
+  if (procfs_name (name) != NULL)
+    return false;
+
+  journal_begin ();
+  dir = dir_open_root ();
+
+  /* Place the new inode near its directory's. */
+  if (dir != NULL)
+    inode_sector = inode_get_inumber (dir_get_inode (dir));
+  allocated = dir != NULL && free_map_allocate (1, &inode_sector);
+  success = (allocated
+             && inode_create (inode_sector, initial_size)
+             && dir_add (dir, name, inode_sector));
+  if (!success && allocated) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
 
   return success;
 }
@@ -66,12 +106,20 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  struct dir *dir;
   struct inode *inode = NULL;
 
+  if (tmpfs_name (name) != NULL)
+    return file_open (tmpfs_open (tmpfs_name (name)));
+  if (procfs_name (name) != NULL)
+    return file_open (procfs_open (procfs_name (name)));
+
+  dir = dir_open_root ();
   if (dir != NULL)
     dir_lookup (dir, name, &inode);
   dir_close (dir);
+  if (inode == NULL)
+    inode = initrd_open (name);
 
   return file_open (inode);
 }
@@ -83,9 +131,19 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  struct dir *dir;
+  bool success;
+
+  if (tmpfs_name (name) != NULL)
+    return tmpfs_remove (tmpfs_name (name));
+  if (procfs_name (name) != NULL)
+    return false;
+
+  journal_begin ();
+  dir = dir_open_root ();
+  success = dir != NULL && dir_remove (dir, name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
@@ -99,5 +157,6 @@ do_format (void)
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_create ();
   printf ("done.\n");
 }
@@ -1,12 +1,54 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Sectors per allocation group.  Allocations search the group
+   of their goal sector first and then the groups nearest it, so
+   that a file's sectors stay together and files placed in
+   different groups do not interleave.  Also the unit of the free
+   map summary. */
+#define GROUP_BITS 256
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static size_t free_cnt;              /* Number of free sectors. */
+static size_t reserved_cnt;          /* Free sectors reserved. */
+
+/* Number of free sectors in each group of GROUP_BITS sectors, so
+   that searches skip full groups without looking at their
+   bits. */
+static uint16_t *group_free;
+static size_t group_cnt;             /* Number of groups. */
+
+/* The free map file holds GROUP_FREE, followed at offset BITS_OFS
+   by the free map itself.  Opening the free map reads only
+   GROUP_FREE, and each group's bits are read from the file the
+   first time a search or release touches them, so that mounting
+   takes time proportional to the number of groups rather than
+   the number of sectors.  Until then, a group's bits are all set
+   in FREE_MAP, so that it looks used.  Changes write back only
+   the bits and counts of the groups they touch. */
+static off_t bits_ofs;
+static struct bitmap *loaded;        /* Groups whose bits are read. */
+
+/* Protects all of the above, except FREE_MAP_FILE, which is set
+   up before and torn down after any concurrent use. */
+static struct lock free_map_lock;
+
+static block_sector_t allocate (size_t cnt, block_sector_t goal);
+static size_t search (size_t cnt, size_t goal);
+static size_t scan_group (size_t g, size_t cnt);
+static size_t scan (size_t start, size_t end, size_t cnt);
+static void load (size_t start, size_t cnt);
+static void summarize (void);
+static void update (size_t start, size_t cnt, bool used);
 
 /* Initializes the free map. */
 void
@@ -15,49 +57,308 @@ free_map_init (void)
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_BITS);
+  group_free = malloc (group_cnt * sizeof *group_free);
+  loaded = bitmap_create (group_cnt);
+  if (group_free == NULL || loaded == NULL)
+    PANIC ("free map summary allocation failed");
+  bitmap_set_all (loaded, true);
+  bits_ofs = ROUND_UP (group_cnt * sizeof *group_free, BLOCK_SECTOR_SIZE);
+  lock_init (&free_map_lock);
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  summarize ();
+}
+
+/* Recomputes FREE_CNT and GROUP_FREE from the free map. */
+static void
+summarize (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t g;
+
+  free_cnt = 0;
+  for (g = 0; g * GROUP_BITS < size; g++)
+    {
+      size_t start = g * GROUP_BITS;
+      size_t cnt = size - start < GROUP_BITS ? size - start : GROUP_BITS;
+      group_free[g] = bitmap_count (free_map, start, cnt, false);
+      free_cnt += group_free[g];
+    }
+}
+
+/* Accounts for CNT sectors starting at START having become used,
+   if USED is true, or free otherwise. */
+static void
+update (size_t start, size_t cnt, bool used)
+{
+  size_t i;
+
+  for (i = start; i < start + cnt; i++)
+    {
+      if (used)
+        group_free[i / GROUP_BITS]--;
+      else
+        group_free[i / GROUP_BITS]++;
+    }
+  if (used)
+    free_cnt -= cnt;
+  else
+    free_cnt += cnt;
+}
+
+/* Reads into the free map the bits of each group that holds any
+   of the CNT sectors starting at START and has not been read
+   yet.  An empty group's bits are known without reading them. */
+static void
+load (size_t start, size_t cnt)
+{
+  size_t size = bitmap_size (free_map);
+  size_t g;
+
+  if (cnt == 0)
+    return;
+  for (g = start / GROUP_BITS; g <= (start + cnt - 1) / GROUP_BITS; g++)
+    if (!bitmap_test (loaded, g))
+      {
+        size_t first = g * GROUP_BITS;
+        size_t bits = size - first < GROUP_BITS ? size - first : GROUP_BITS;
+
+        if (group_free[g] == bits)
+          bitmap_set_multiple (free_map, first, bits, false);
+        else if (!bitmap_read_range (free_map, free_map_file, first, bits,
+                                     bits_ofs))
+          PANIC ("can't read free map");
+        bitmap_mark (loaded, g);
+      }
+}
+
+/* Writes the part of the free map holding the CNT sectors
+   starting at START, and the free counts of their groups, to the
+   free map file.  Only the file sectors covering them are
+   written, through the buffer cache. */
+static bool
+write_range (size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t size;
+
+  if (free_map_file == NULL || cnt == 0)
+    return true;
+  first = start / GROUP_BITS;
+  last = (start + cnt - 1) / GROUP_BITS;
+  size = (last - first + 1) * sizeof *group_free;
+  return (bitmap_write_range (free_map, free_map_file, start, cnt, bits_ofs)
+          && file_write_at (free_map_file, group_free + first, size,
+                            first * sizeof *group_free) == size);
+}
+
+/* Returns the first of CNT consecutive free sectors that starts
+   at or after START and before END, or BITMAP_ERROR if there is
+   none.  The run may extend past END. */
+static size_t
+scan (size_t start, size_t end, size_t cnt)
+{
+  size_t size = bitmap_size (free_map);
+  size_t pos = start;
+
+  if (end > size)
+    end = size;
+  while (pos < end && cnt <= size - pos)
+    {
+      size_t used;
+
+      if (group_free[pos / GROUP_BITS] == 0)
+        {
+          pos = (pos / GROUP_BITS + 1) * GROUP_BITS;
+          continue;
+        }
+
+      /* Find the first used sector in the candidate run, and
+         restart just past it.  A used sector past the run may be
+         in a group not yet read, which does not matter. */
+      load (pos, cnt);
+      used = bitmap_scan (free_map, pos, 1, true);
+      if (used == BITMAP_ERROR || used >= pos + cnt)
+        return pos;
+      pos = used + 1;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns the first of CNT consecutive free sectors that starts
+   in allocation group G, or BITMAP_ERROR if there is none. */
+static size_t
+scan_group (size_t g, size_t cnt)
+{
+  return scan (g * GROUP_BITS, (g + 1) * GROUP_BITS, cnt);
+}
+
+/* Returns the free run of CNT sectors nearest GOAL, or
+   BITMAP_ERROR if there is none: the first one at or after GOAL
+   in GOAL's allocation group, else the first one in that group,
+   else the first one in the nearest other group, trying the
+   groups after and before alternately. */
+static size_t
+search (size_t cnt, size_t goal)
+{
+  size_t g, dist;
+  size_t sector;
+
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  g = goal / GROUP_BITS;
+
+  sector = scan (goal, (g + 1) * GROUP_BITS, cnt);
+  if (sector == BITMAP_ERROR)
+    sector = scan (g * GROUP_BITS, goal, cnt);
+  for (dist = 1; sector == BITMAP_ERROR && dist < group_cnt; dist++)
+    {
+      if (g + dist < group_cnt)
+        sector = scan_group (g + dist, cnt);
+      if (sector == BITMAP_ERROR && dist <= g)
+        sector = scan_group (g - dist, cnt);
+    }
+  return sector;
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+/* Allocates CNT consecutive sectors from the free map, as near
+   as possible to the goal sector passed in *SECTORP, and stores
+   the first into *SECTORP.  Passing a sector near related data,
+   such as the inode of the parent directory for a new inode,
+   keeps the two together on disk.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
-    {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
-    }
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = allocate (cnt, *sectorp);
+  lock_release (&free_map_lock);
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates as many consecutive sectors as possible, up to CNT,
+   halving the request until it fits, and stores the first into
+   *SECTORP.  The run is placed as near as possible to the goal
+   sector passed in *SECTORP, as for free_map_allocate(), so that
+   passing the sector just past a file's last run tends to keep
+   the file contiguous.  Returns the number of sectors allocated,
+   0 if the free map is full or could not be written. */
+size_t
+free_map_allocate_run (size_t cnt, block_sector_t *sectorp)
+{
+  block_sector_t goal = *sectorp;
+
+  lock_acquire (&free_map_lock);
+  for (; cnt > 0; cnt /= 2)
+    {
+      block_sector_t sector = allocate (cnt, goal);
+      if (sector != BITMAP_ERROR)
+        {
+          *sectorp = sector;
+          break;
+        }
+    }
+  lock_release (&free_map_lock);
+  return cnt;
+}
+
+/* Allocates CNT consecutive unreserved sectors as near as
+   possible to GOAL and returns the first one, or BITMAP_ERROR on
+   failure.  FREE_MAP_LOCK must be held. */
+static block_sector_t
+allocate (size_t cnt, block_sector_t goal)
+{
+  block_sector_t sector;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  if (free_cnt - reserved_cnt < cnt)
+    return BITMAP_ERROR;
+
+  sector = search (cnt, goal);
+  if (sector == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  update (sector, cnt, true);
+  if (!write_range (sector, cnt))
+    {
+      bitmap_set_multiple (free_map, sector, cnt, false); 
+      update (sector, cnt, false);
+      return BITMAP_ERROR;
+    }
+  return sector;
+}
+
+/* Reserves CNT free sectors, which other allocations then leave
+   alone, for a later allocation after free_map_unreserve().
+   Returns false if fewer than CNT unreserved sectors are
+   free. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = free_cnt - reserved_cnt >= cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Cancels the reservation of CNT sectors. */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved_cnt >= cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
+  load (sector, cnt);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  update (sector, cnt, false);
+  write_range (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void) 
 {
+  size_t g;
+
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  inode_set_journaled (file_get_inode (free_map_file));
+  if (file_read_at (free_map_file, group_free,
+                    group_cnt * sizeof *group_free, 0)
+      != (off_t) (group_cnt * sizeof *group_free))
     PANIC ("can't read free map");
+
+  /* Read the groups' bits later, on demand. */
+  bitmap_set_all (free_map, true);
+  bitmap_set_all (loaded, false);
+  free_cnt = 0;
+  for (g = 0; g < group_cnt; g++)
+    free_cnt += group_free[g];
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -68,18 +369,40 @@ free_map_close (void)
 }
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it.
+
+   Only the group counts and the bits of groups with used sectors
+   in them are written.  Since load() never reads the bits of an
+   empty group, the rest of the file is left uninitialized, and
+   each group's bits are first written when it stops being empty,
+   so that formatting takes time proportional to the number of
+   groups, not of sectors. */
 void
 free_map_create (void) 
 {
+  size_t size = bitmap_size (free_map);
+  off_t counts_size = group_cnt * sizeof *group_free;
+  size_t g;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create_uninit (FREE_MAP_SECTOR,
+                            bits_ofs + bitmap_file_size (free_map)))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
+  /* Write group counts and the used groups' bits to file. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  inode_set_journaled (file_get_inode (free_map_file));
+  if (file_write_at (free_map_file, group_free, counts_size, 0)
+      != counts_size)
     PANIC ("can't write free map");
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t first = g * GROUP_BITS;
+      size_t bits = size - first < GROUP_BITS ? size - first : GROUP_BITS;
+
+      if (group_free[g] != bits && !write_range (first, bits))
+        PANIC ("can't write free map");
+    }
 }
@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -67,20 +68,65 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Size of the buffer through which fsutil_extract() and
+   fsutil_append() move data between the scratch device and
+   files, so that each reads or writes the device and each file
+   in large pieces rather than a sector at a time. */
+#define STREAM_PAGES 16
+#define STREAM_SECTORS (STREAM_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A window onto STREAM_SECTORS consecutive scratch sectors. */
+struct window
+  {
+    uint8_t *buffer;                    /* Sectors START...START+CNT-1. */
+    block_sector_t start;               /* First sector in BUFFER. */
+    block_sector_t cnt;                 /* Sectors in BUFFER. */
+  };
+
+/* Returns the contents of SECTOR of DEV, read into window W
+   along with the sectors after it if it is not there already,
+   and stores in *CNT the number of consecutive sectors starting
+   there that W holds, at most MAX. */
+static const uint8_t *
+window_get (struct window *w, struct block *dev, block_sector_t sector,
+            block_sector_t max, block_sector_t *cnt)
+{
+  if (sector < w->start || sector >= w->start + w->cnt)
+    {
+      if (sector >= block_size (dev))
+        PANIC ("sector %"PRDSNu" past end of scratch device", sector);
+      w->start = sector;
+      w->cnt = block_size (dev) - sector;
+      if (w->cnt > STREAM_SECTORS)
+        w->cnt = STREAM_SECTORS;
+      block_read_multiple (dev, w->start, w->buffer, w->cnt);
+    }
+
+  *cnt = w->start + w->cnt - sector;
+  if (*cnt > max)
+    *cnt = max;
+  return w->buffer + (sector - w->start) * BLOCK_SECTOR_SIZE;
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  The archive is read
+   STREAM_SECTORS at a time, and each file is created at its full
+   size, so that its data is allocated in one piece, and then
+   written as the archive is read. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  struct window w;
+  void *header;
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
+  w.buffer = palloc_get_multiple (0, STREAM_PAGES);
+  w.cnt = w.start = 0;
+  if (header == NULL || w.buffer == NULL)
     PANIC ("couldn't allocate buffers");
 
   /* Open source block device. */
@@ -96,10 +142,13 @@ fsutil_extract (char **argv UNUSED)
       const char *file_name;
       const char *error;
       enum ustar_type type;
+      block_sector_t cnt;
       int size;
 
-      /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      /* Read and parse ustar header, copying it out of the window
+         because the file name points into it. */
+      memcpy (header, window_get (&w, src, sector++, 1, &cnt),
+              BLOCK_SECTOR_SIZE);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
         PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
@@ -127,13 +176,16 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              const uint8_t *data
+                = window_get (&w, src, sector,
+                              DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE), &cnt);
+              int chunk_size = (size > (int) (cnt * BLOCK_SECTOR_SIZE)
+                                ? (int) (cnt * BLOCK_SECTOR_SIZE)
                                 : size);
-              block_read (src, sector++, data);
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
+              sector += cnt;
               size -= chunk_size;
             }
 
@@ -151,10 +203,14 @@ fsutil_extract (char **argv UNUSED)
   block_write (src, 0, header);
   block_write (src, 1, header);
 
-  free (data);
+  palloc_free_multiple (w.buffer, STREAM_PAGES);
   free (header);
 }
 
+/* Next sector of the scratch device for fsutil_append() and
+   fsutil_save() to write. */
+static block_sector_t append_sector;
+
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
@@ -162,22 +218,24 @@ fsutil_extract (char **argv UNUSED)
    beginning of the scratch device.  Later calls advance across
    the device.  This position is independent of that used for
    fsutil_extract(), so `extract' should precede all
-   `append's. */
+   `append's.  The header and data are gathered into
+   STREAM_SECTORS-sector writes. */
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
+  block_sector_t sector = append_sector;
 
   const char *file_name = argv[1];
-  void *buffer;
+  uint8_t *buffer;
   struct file *src;
   struct block *dst;
   off_t size;
+  size_t fill;
 
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  buffer = palloc_get_multiple (0, STREAM_PAGES);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -192,22 +250,36 @@ fsutil_append (char **argv)
   if (dst == NULL)
     PANIC ("couldn't open scratch device");
   
-  /* Write ustar header to first sector. */
-  if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
+  /* Put ustar header in first sector. */
+  if (!ustar_make_header (file_name, USTAR_REGULAR, size, (char *) buffer))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  fill = BLOCK_SECTOR_SIZE;
 
-  /* Do copy. */
-  while (size > 0) 
+  /* Do copy, writing whenever the buffer fills up and at the
+     end. */
+  for (;;)
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
-        PANIC ("%s: out of space on scratch device", file_name);
-      if (file_read (src, buffer, chunk_size) != chunk_size)
+      off_t chunk_size = STREAM_SECTORS * BLOCK_SECTOR_SIZE - fill;
+      block_sector_t cnt;
+
+      if (chunk_size > size)
+        chunk_size = size;
+      if (file_read (src, buffer + fill, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      fill += chunk_size;
       size -= chunk_size;
+      if (size > 0 && fill < STREAM_SECTORS * BLOCK_SECTOR_SIZE)
+        continue;
+
+      cnt = DIV_ROUND_UP (fill, BLOCK_SECTOR_SIZE);
+      if (sector + cnt > block_size (dst))
+        PANIC ("%s: out of space on scratch device", file_name);
+      memset (buffer + fill, 0, cnt * BLOCK_SECTOR_SIZE - fill);
+      block_write_multiple (dst, sector, buffer, cnt);
+      sector += cnt;
+      if (size == 0)
+        break;
+      fill = 0;
     }
 
   /* Write ustar end-of-archive marker, which is two consecutive
@@ -216,8 +288,54 @@ fsutil_append (char **argv)
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
   block_write (dst, sector, buffer);
   block_write (dst, sector + 1, buffer);
+  append_sector = sector;
 
   /* Finish up. */
   file_close (src);
+  palloc_free_multiple (buffer, STREAM_PAGES);
+}
+
+/* Writes the SIZE bytes of DATA to the scratch device as a file
+   named NAME, in ustar format, after the files written there by
+   fsutil_append().  Returns true if successful, false if there
+   is no scratch device or it is out of space. */
+bool
+fsutil_save (const char *name, const void *data, size_t size)
+{
+  const uint8_t *p = data;
+  block_sector_t sector = append_sector;
+  struct block *dst;
+  void *buffer;
+
+  dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL
+      || sector + DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE) + 3 > block_size (dst))
+    return false;
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+  if (!ustar_make_header (name, USTAR_REGULAR, size, buffer))
+    {
+      free (buffer);
+      return false;
+    }
+  block_write (dst, sector++, buffer);
+
+  for (; size > 0; p += BLOCK_SECTOR_SIZE)
+    {
+      size_t chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
+      memcpy (buffer, p, chunk_size);
+      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
+      block_write (dst, sector++, buffer);
+      size -= chunk_size;
+    }
+
+  /* End-of-archive marker, as in fsutil_append(). */
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (dst, sector, buffer);
+  block_write (dst, sector + 1, buffer);
+  append_sector = sector;
+
   free (buffer);
+  return true;
 }
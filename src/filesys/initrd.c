@@ -0,0 +1,147 @@
+#include "filesys/initrd.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include <ustar.h>
+#include "devices/block.h"
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "filesys/tmpfs.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Read-only file system image.
+
+   With the kernel command-line option "-initrd", the ustar
+   archive that the pintos script puts on the scratch device is
+   loaded into memory at boot, in place of the "extract" action
+   that would copy each file into the file system.  Each file's
+   contents become a struct tmpfs_data, so that inode.c serves
+   reads, and page faults in programs run from the image, out of
+   memory with no disk I/O at all.
+
+   The files are found by filesys_open() when the root directory
+   has no file of the same name, so a file created in the file
+   system hides one in the image.  They cannot be written,
+   removed or listed. */
+
+/* A file in the image. */
+struct initrd_file
+  {
+    struct list_elem elem;              /* In FILES. */
+    char name[NAME_MAX + 1];            /* Name. */
+    struct inode *inode;                /* Kept open, writes denied. */
+  };
+
+/* Files in the image.  Only changed by initrd_load(), before
+   anything else runs, so no lock is needed. */
+static struct list files;
+
+/* Initializes the (empty) image. */
+void
+initrd_init (void)
+{
+  list_init (&files);
+}
+
+/* Reads the SIZE bytes of file data starting at SECTOR of SRC
+   into new memory-backed contents and returns them, using the
+   page at BUFFER to read a page at a time.  Panics if memory
+   runs out. */
+static struct tmpfs_data *
+load_data (struct block *src, block_sector_t sector, off_t size,
+           uint8_t *buffer)
+{
+  struct tmpfs_data *data = tmpfs_data_create (size);
+  off_t ofs;
+
+  if (data == NULL)
+    PANIC ("initrd: out of memory");
+  for (ofs = 0; ofs < size; ofs += PGSIZE)
+    {
+      off_t chunk_size = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+
+      block_read_multiple (src, sector, buffer,
+                           DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE));
+      if (tmpfs_write_at (data, buffer, chunk_size, ofs) != chunk_size)
+        PANIC ("initrd: out of memory");
+      sector += PGSIZE / BLOCK_SECTOR_SIZE;
+    }
+  return data;
+}
+
+/* Loads the ustar archive on the scratch device into memory as
+   the image.  Panics if there is no scratch device, the archive
+   is malformed, or memory runs out. */
+void
+initrd_load (void)
+{
+  struct block *src = block_get_role (BLOCK_SCRATCH);
+  block_sector_t sector = 0;
+  size_t file_cnt = 0;
+  uint8_t *buffer;
+
+  if (src == NULL)
+    PANIC ("initrd: no scratch device");
+  buffer = palloc_get_page (PAL_ASSERT);
+
+  for (;;)
+    {
+      const char *file_name;
+      const char *error;
+      enum ustar_type type;
+      int size;
+
+      if (sector >= block_size (src))
+        PANIC ("initrd: archive runs past end of scratch device");
+      block_read (src, sector++, buffer);
+      error = ustar_parse_header ((const char *) buffer,
+                                  &file_name, &type, &size);
+      if (error != NULL)
+        PANIC ("initrd: bad ustar header in sector %"PRDSNu" (%s)",
+               sector - 1, error);
+
+      if (type == USTAR_EOF)
+        break;
+      else if (type == USTAR_REGULAR && strlen (file_name) > NAME_MAX)
+        printf ("initrd: ignoring %s, name too long\n", file_name);
+      else if (type == USTAR_REGULAR)
+        {
+          struct initrd_file *f = malloc (sizeof *f);
+
+          if (f == NULL)
+            PANIC ("initrd: out of memory");
+          strlcpy (f->name, file_name, sizeof f->name);
+          f->inode = inode_open_memory (load_data (src, sector, size,
+                                                   buffer));
+          if (f->inode == NULL)
+            PANIC ("initrd: out of memory");
+          inode_deny_write (f->inode);
+          list_push_back (&files, &f->elem);
+          file_cnt++;
+        }
+      sector += DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+    }
+
+  palloc_free_page (buffer);
+  printf ("initrd: %zu files loaded from %s\n", file_cnt, block_name (src));
+}
+
+/* Opens the file named NAME in the image and returns its inode,
+   or a null pointer if there is none. */
+struct inode *
+initrd_open (const char *name)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&files); e != list_end (&files); e = list_next (e))
+    {
+      struct initrd_file *f = list_entry (e, struct initrd_file, elem);
+      if (!strcmp (f->name, name))
+        return inode_reopen (f->inode);
+    }
+  return NULL;
+}
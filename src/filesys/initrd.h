@@ -0,0 +1,10 @@
+#ifndef FILESYS_INITRD_H
+#define FILESYS_INITRD_H
+
+struct inode;
+
+void initrd_init (void);
+void initrd_load (void);
+struct inode *initrd_open (const char *name);
+
+#endif /* filesys/initrd.h */
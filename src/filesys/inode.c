@@ -1,23 +1,81 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <hash.h>
 #include <round.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* A sector's worth of zeros. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* A run of consecutive data sectors.  Besides its location on
+   disk, each extent records the index of its first sector within
+   the file, so that byte_to_sector() can binary search the
+   extents.
+
+   An unwritten extent, allocated by inode_preallocate() without
+   zeroing it, reads as zeros like a hole.  Writing one of its
+   sectors zeroes that sector and splits it off into an ordinary
+   extent; see mark_written(). */
+struct extent
+  {
+    uint32_t ofs;                       /* First file sector. */
+    block_sector_t start;               /* First disk sector. */
+    uint32_t length : 31;               /* Number of sectors. */
+    uint32_t unwritten : 1;             /* Not yet written? */
+  };
+
+/* Number of extents stored in the inode itself, and in its
+   indirect extent block. */
+#define INLINE_EXTENTS 41
+#define INDIRECT_EXTENTS (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+#define MAX_EXTENTS (INLINE_EXTENTS + INDIRECT_EXTENTS)
+
+/* Largest file whose data is stored in its inode. */
+#define INLINE_DATA_SIZE (INLINE_EXTENTS * sizeof (struct extent))
+
+/* Disk inode flags. */
+#define INODE_INLINE 0x1                /* Data is in the inode. */
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   The file's data sectors are described by EXTENT_CNT extents in
+   file order.  File sectors that no extent covers, before or
+   after the last extent, are holes, which read as zeros without
+   any I/O and get sectors only once written.  The first
+   INLINE_EXTENTS extents are in EXTENTS; the rest
+   are in the indirect extent block at sector INDIRECT, which is
+   only allocated once EXTENT_CNT exceeds INLINE_EXTENTS.
+
+   A file of at most INLINE_DATA_SIZE bytes instead keeps its
+   data in DATA, in place of the extents: INODE_INLINE is set in
+   FLAGS and EXTENT_CNT is 0, so that reading the file takes no I/O
+   beyond its inode.  The bytes of DATA past LENGTH are zeros.
+   When the file grows past INLINE_DATA_SIZE, the data moves to an
+   ordinary sector; see move_inline_data(). */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    uint32_t extent_cnt;                /* Number of extents. */
+    block_sector_t indirect;            /* Indirect extent block. */
+    union
+      {
+        struct extent extents[INLINE_EXTENTS]; /* Inline extents. */
+        uint8_t data[INLINE_DATA_SIZE]; /* Inline data. */
+      };
+    uint32_t flags;                     /* INODE_* flags. */
   };
 
 /* Returns the number of sectors to allocate for an inode SIZE
@@ -31,46 +89,428 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct rwlock meta_lock;            /* Protects DATA, DENY_WRITE_CNT. */
+    struct lock lock;                   /* See inode_lock(). */
+    bool journaled;                     /* Journal data writes? */
+    unsigned version;                   /* Changed by each write. */
+
+    /* Delayed allocation.  See inode_write_at(). */
+    size_t delayed;                     /* Sectors reserved, not allocated. */
+    struct list_elem delayed_elem;      /* In delayed_inodes if DELAYED > 0. */
+
+    /* Contents of a memory-backed inode, which has no disk inode
+       and is not in open_inodes, or null.  See tmpfs.c. */
+    struct tmpfs_data *tmp;
   };
 
+/* Delayed allocation.
+
+   Writing past the end of a file extends it at once, leaving any
+   gap before the new data a hole, and writing to a hole only
+   reserves a free sector for each block written, whose data
+   waits in a delayed block of the buffer cache.  Real sectors
+   are assigned all at once, in runs following the extent before
+   them, when the file has DELAYED_MAX delayed blocks or all files
+   together have DELAYED_TOTAL_MAX, when the file is closed, and
+   before the buffer cache is flushed.  A stream of small appends
+   thus ends up in consecutive sectors, and seeking far past the
+   end of a file to write costs no sectors for the gap.
+
+   The on-disk inode is rewritten with the new length only once
+   the sectors are assigned, so that a crash does not leave it
+   with a hole where data was written. */
+#define DELAYED_MAX 16
+#define DELAYED_TOTAL_MAX (CACHE_SIZE / 2)
+
+/* Inodes with delayed sectors. */
+static struct list delayed_inodes;
+static size_t delayed_total;
+
+/* Serializes file growth and delayed allocation. */
+static struct lock delayed_lock;
+
+/* Locking.
+
+   OPEN_INODES_LOCK protects the table of open inodes and each
+   inode's OPEN_CNT and REMOVED, and is held while an inode is
+   read in by its first opener or torn down by its last closer.
+   Each inode's META_LOCK, a reader-writer lock, protects its
+   DATA, which I/O only reads briefly to map an offset to a
+   sector, so that I/O on different files, and on the same file,
+   overlaps.
+
+   The locks are acquired in this order, skipping any:
+   OPEN_INODES_LOCK, DELAYED_LOCK, an inode's META_LOCK, the free
+   map's lock, the free map file's META_LOCK.  The buffer cache's
+   locks come last.  An inode's LOCK, see inode_lock(), comes
+   before all of them. */
+static struct lock open_inodes_lock;
+
+/* Stores extent IDX of disk inode D into *E. */
+static void
+extent_get (const struct inode_disk *d, size_t idx, struct extent *e)
+{
+  ASSERT (idx < d->extent_cnt);
+
+  if (idx < INLINE_EXTENTS)
+    *e = d->extents[idx];
+  else
+    cache_read_meta_at (d->indirect, e, (idx - INLINE_EXTENTS) * sizeof *e,
+                        sizeof *e);
+}
+
+/* Stores E as extent IDX of disk inode D. */
+static void
+extent_set (struct inode_disk *d, size_t idx, const struct extent *e)
+{
+  ASSERT (idx < d->extent_cnt);
+
+  if (idx < INLINE_EXTENTS)
+    d->extents[idx] = *e;
+  else
+    cache_log_at (d->indirect, e, (idx - INLINE_EXTENTS) * sizeof *e,
+                  sizeof *e);
+}
+
+/* Returns the disk sector just past the last extent of disk
+   inode D that starts before file sector OFS, or the sector just
+   past HOME, D's own sector, if there is none: the best place
+   for sector OFS, to keep the file contiguous and next to its
+   inode. */
+static block_sector_t
+goal_sector (const struct inode_disk *d, uint32_t ofs, block_sector_t home)
+{
+  size_t i;
+
+  for (i = d->extent_cnt; i > 0; i--)
+    {
+      struct extent e;
+      extent_get (d, i - 1, &e);
+      if (e.ofs < ofs)
+        return e.start + e.length;
+    }
+  return home + 1;
+}
+
+/* Returns true if disk inode D has room for CNT more extents,
+   allocating its indirect extent block if they need it. */
+static bool
+extent_room (struct inode_disk *d, size_t cnt)
+{
+  if (d->extent_cnt + cnt > MAX_EXTENTS)
+    return false;
+  if (d->extent_cnt <= INLINE_EXTENTS
+      && d->extent_cnt + cnt > INLINE_EXTENTS)
+    {
+      /* Put the indirect block next to the data it maps. */
+      d->indirect = goal_sector (d, UINT32_MAX, 0);
+      return free_map_allocate (1, &d->indirect);
+    }
+  return true;
+}
+
+/* Inserts E as extent POS of disk inode D, which must have room
+   for it, moving the extents from POS on up by one. */
+static void
+extent_insert (struct inode_disk *d, size_t pos, const struct extent *e)
+{
+  struct extent x;
+  size_t i;
+
+  ASSERT (pos <= d->extent_cnt && d->extent_cnt < MAX_EXTENTS);
+
+  d->extent_cnt++;
+  for (i = d->extent_cnt - 1; i > pos; i--)
+    {
+      extent_get (d, i - 1, &x);
+      extent_set (d, i, &x);
+    }
+  extent_set (d, pos, e);
+}
+
+/* Removes extent POS from disk inode D, moving the extents after
+   it down by one, and releases the indirect extent block if it
+   is no longer needed. */
+static void
+extent_remove (struct inode_disk *d, size_t pos)
+{
+  struct extent x;
+  size_t i;
+
+  ASSERT (pos < d->extent_cnt);
+
+  for (i = pos; i + 1 < d->extent_cnt; i++)
+    {
+      extent_get (d, i + 1, &x);
+      extent_set (d, i, &x);
+    }
+  if (--d->extent_cnt == INLINE_EXTENTS)
+    free_map_release (d->indirect, 1);
+}
+
+/* Returns the index of the extent of disk inode D that contains
+   file sector IDX and stores it in *E, or returns D's extent
+   count if IDX is in a hole. */
+static size_t
+extent_find (const struct inode_disk *d, uint32_t idx, struct extent *e)
+{
+  size_t lo = 0;
+  size_t hi = d->extent_cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+
+      extent_get (d, mid, e);
+      if (idx < e->ofs)
+        hi = mid;
+      else if (idx >= e->ofs + e->length)
+        lo = mid + 1;
+      else
+        return mid;
+    }
+  return d->extent_cnt;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, because POS is past the end of the file or in a hole or
+   an unwritten extent. */
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
+  const struct inode_disk *d;
+  uint32_t idx;
+  struct extent e;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
-  else
+  if (pos >= inode->data.length)
     return -1;
+
+  d = &inode->data;
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (extent_find (d, idx, &e) == d->extent_cnt || e.unwritten)
+    return -1;
+  return e.start + (idx - e.ofs);
+}
+
+/* Maps the CNT file sectors of disk inode D starting at OFS,
+   which must be a hole, to the CNT disk sectors starting at
+   START, in an unwritten extent if UNWRITTEN is true, by
+   extending the extent before them if they follow it both in the
+   file and on disk and it is of the same kind, or else by
+   inserting a new extent.  Returns false if D has no room for
+   another extent. */
+static bool
+extent_add (struct inode_disk *d, uint32_t ofs, block_sector_t start,
+            size_t cnt, bool unwritten)
+{
+  struct extent e;
+  size_t pos;
+
+  /* Find the extent before OFS, usually the last. */
+  for (pos = d->extent_cnt; pos > 0; pos--)
+    {
+      extent_get (d, pos - 1, &e);
+      if (e.ofs < ofs)
+        break;
+    }
+  if (pos > 0)
+    {
+      ASSERT (e.ofs + e.length <= ofs);
+      if (e.ofs + e.length == ofs && e.start + e.length == start
+          && e.unwritten == unwritten)
+        {
+          e.length += cnt;
+          extent_set (d, pos - 1, &e);
+          return true;
+        }
+    }
+
+  if (!extent_room (d, 1))
+    return false;
+  e.ofs = ofs;
+  e.start = start;
+  e.length = cnt;
+  e.unwritten = unwritten;
+  extent_insert (d, pos, &e);
+  return true;
+}
+
+/* Marks file sector IDX, which is in unwritten extent I of disk
+   inode D, as written, by moving it into the ordinary extent
+   before it if they are contiguous, as when a file preallocated
+   with inode_preallocate() is filled in order, or else by
+   splitting extent I in up to three.  If D has no room for the
+   extents, zeroes all of extent I and marks it written instead.
+   Does not zero sector IDX itself. */
+static void
+mark_written (struct inode_disk *d, size_t i, uint32_t idx)
+{
+  struct extent e, pieces[3];
+  size_t cnt = 0;
+  size_t j;
+
+  extent_get (d, i, &e);
+  ASSERT (e.unwritten && idx >= e.ofs && idx < e.ofs + e.length);
+
+  if (idx == e.ofs && i > 0)
+    {
+      struct extent prev;
+
+      extent_get (d, i - 1, &prev);
+      if (!prev.unwritten && prev.ofs + prev.length == idx
+          && prev.start + prev.length == e.start)
+        {
+          prev.length++;
+          extent_set (d, i - 1, &prev);
+          if (e.length == 1)
+            extent_remove (d, i);
+          else
+            {
+              e.ofs++;
+              e.start++;
+              e.length--;
+              extent_set (d, i, &e);
+            }
+          return;
+        }
+    }
+
+  /* Unwritten sectors before IDX, IDX itself, and unwritten
+     sectors after IDX. */
+  if (idx > e.ofs)
+    pieces[cnt++] = (struct extent) { e.ofs, e.start, idx - e.ofs, true };
+  pieces[cnt++] = (struct extent) { idx, e.start + (idx - e.ofs), 1, false };
+  if (idx + 1 < e.ofs + e.length)
+    pieces[cnt++] = (struct extent) { idx + 1, e.start + (idx - e.ofs) + 1,
+                                      e.ofs + e.length - idx - 1, true };
+
+  if (!extent_room (d, cnt - 1))
+    {
+      for (j = 0; j < e.length; j++)
+        if (e.ofs + j != idx)
+          cache_write (e.start + j, zeros);
+      e.unwritten = false;
+      extent_set (d, i, &e);
+      return;
+    }
+  extent_set (d, i, &pieces[0]);
+  for (j = 1; j < cnt; j++)
+    extent_insert (d, i + j, &pieces[j]);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* What inode_allocate() does with the new sectors. */
+enum alloc_fill
+  {
+    FILL_ZERO,                          /* Zero them. */
+    FILL_UNWRITTEN,                     /* Put them in unwritten extents. */
+    FILL_NONE                           /* Leave their old contents. */
+  };
+
+/* Allocates data sectors to the CNT file sectors of disk inode D
+   starting at OFS, which must be a hole, in runs as long as the
+   free map allows, starting right after the preceding run, or
+   after D's own sector HOME, if possible.  Each new sector takes
+   over OWNER's delayed block for it, if OWNER is nonnull and has
+   one, and is otherwise handled as FILL says.  Returns the
+   number of sectors allocated, fewer than CNT if the disk or D's
+   extents run out, in which case the sectors allocated so far
+   stay in D. */
+static size_t
+inode_allocate (struct inode_disk *d, block_sector_t home, uint32_t ofs,
+                size_t cnt, const struct inode *owner, enum alloc_fill fill)
+{
+  bool unwritten = fill == FILL_UNWRITTEN;
+  size_t have = 0;
+
+  while (have < cnt)
+    {
+      block_sector_t start = goal_sector (d, ofs + have, home);
+      size_t run, i;
+
+      run = free_map_allocate_run (cnt - have, &start);
+      if (run == 0)
+        break;
+      if (!extent_add (d, ofs + have, start, run, unwritten))
+        {
+          free_map_release (start, run);
+          break;
+        }
+      for (i = 0; i < run && !unwritten; i++)
+        if ((owner == NULL
+             || !cache_delayed_assign (owner, ofs + have + i, start + i))
+            && fill == FILL_ZERO)
+          cache_write (start + i, zeros);
+      have += run;
+    }
+  return have;
+}
+
+/* Releases all the data sectors of disk inode D, and its
+   indirect extent block. */
+static void
+inode_release (struct inode_disk *d)
+{
+  size_t i;
+
+  for (i = 0; i < d->extent_cnt; i++)
+    {
+      struct extent e;
+      extent_get (d, i, &e);
+      free_map_release (e.start, e.length);
+    }
+  if (d->extent_cnt > INLINE_EXTENTS)
+    free_map_release (d->indirect, 1);
+  d->extent_cnt = 0;
+}
+
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+
+/* Returns a hash value for inode E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode *inode = hash_entry (e, struct inode, elem);
+  return hash_int (inode->sector);
+}
+
+/* Returns true if inode A precedes inode B. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+  return a->sector < b->sector;
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("inode_init: out of memory");
+  list_init (&delayed_inodes);
+  lock_init (&delayed_lock);
+  lock_init (&open_inodes_lock);
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
-   Returns true if successful.
-   Returns false if memory or disk allocation fails. */
-bool
-inode_create (block_sector_t sector, off_t length)
+/* Initializes an inode with LENGTH bytes of data, handled as
+   FILL says, and writes the new inode to sector SECTOR on the
+   file system device.  Returns true if successful, false if
+   memory or disk allocation fails. */
+static bool
+create (block_sector_t sector, off_t length, enum alloc_fill fill)
 {
   struct inode_disk *disk_inode = NULL;
   bool success = false;
@@ -87,57 +527,420 @@ inode_create (block_sector_t sector, off_t length)
       size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
+      if (length <= (off_t) INLINE_DATA_SIZE)
         {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
+          disk_inode->flags = INODE_INLINE;
+          sectors = 0;
+        }
+      if (inode_allocate (disk_inode, sector, 0, sectors, NULL, fill)
+          == sectors)
+        {
+          cache_log_at (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
           success = true; 
         } 
+      else
+        inode_release (disk_inode);
       free (disk_inode);
     }
   return success;
 }
 
+/* Initializes an inode with LENGTH bytes of data, all zeros, and
+   writes the new inode to sector SECTOR on the file system
+   device.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails. */
+bool
+inode_create (block_sector_t sector, off_t length)
+{
+  return create (sector, length, FILL_ZERO);
+}
+
+/* Like inode_create(), but leaves the data sectors with whatever
+   they held before, so that no data sector is written.  Only
+   for a file whose owner never reads a part of it
+   that it has not written, as the free map does. */
+bool
+inode_create_uninit (block_sector_t sector, off_t length)
+{
+  return create (sector, length, FILL_NONE);
+}
+
+/* Extends INODE to LENGTH bytes.  The new bytes are a hole
+   until written.  DELAYED_LOCK must be held. */
+static void
+inode_grow (struct inode *inode, off_t length)
+{
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+
+  rwlock_acquire_write (&inode->meta_lock);
+  inode->data.length = length;
+  if (inode->delayed == 0)
+    cache_log_at (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->meta_lock);
+}
+
+/* Reserves a free sector for delayed block IDX of INODE, unless
+   INODE has that block already, so that writing the block
+   cannot fail later.  Returns false if the disk is full.
+   DELAYED_LOCK must be held. */
+static bool
+reserve_delayed (struct inode *inode, block_sector_t idx)
+{
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+
+  if (cache_delayed_present (inode, idx))
+    return true;
+  if (!free_map_reserve (1))
+    return false;
+  if (inode->delayed == 0)
+    list_push_back (&delayed_inodes, &inode->delayed_elem);
+  inode->delayed++;
+  delayed_total++;
+  return true;
+}
+
+/* Moves the data of INODE, which must be inline, out of its
+   disk inode into a delayed block, which is assigned a sector
+   like any other, so that INODE can grow past INLINE_DATA_SIZE.
+   Returns false if the disk is full.  DELAYED_LOCK must be
+   held. */
+static bool
+move_inline_data (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+  ASSERT (d->flags & INODE_INLINE);
+
+  if (d->length > 0)
+    {
+      if (!reserve_delayed (inode, 0))
+        return false;
+      cache_delayed_write_at (inode, 0, d->data, 0, d->length);
+    }
+
+  /* The disk inode keeps the inline data until the delayed
+     block is assigned its sector and the inode is rewritten. */
+  rwlock_acquire_write (&inode->meta_lock);
+  memset (d->data, 0, sizeof d->data);
+  d->flags &= ~INODE_INLINE;
+  rwlock_release_write (&inode->meta_lock);
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into the inline data of INODE,
+   starting at OFFSET, extending INODE if necessary.  OFFSET +
+   SIZE must not exceed INLINE_DATA_SIZE.  DELAYED_LOCK must be
+   held. */
+static void
+write_inline (struct inode *inode, const void *buffer, off_t size,
+              off_t offset)
+{
+  struct inode_disk *d = &inode->data;
+
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+  ASSERT (offset + size <= (off_t) INLINE_DATA_SIZE);
+
+  rwlock_acquire_write (&inode->meta_lock);
+  memcpy (d->data + offset, buffer, size);
+  if (offset + size > d->length)
+    d->length = offset + size;
+  cache_log_at (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->meta_lock);
+}
+
+/* If byte POS of INODE lies in an unwritten extent, turns its
+   sector into an ordinary, zeroed sector and returns it, so that
+   it can be written in place.  Otherwise, returns -1.
+   DELAYED_LOCK must be held. */
+static block_sector_t
+claim_unwritten (struct inode *inode, off_t pos)
+{
+  struct inode_disk *d = &inode->data;
+  uint32_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t sector = -1;
+  struct extent e;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+
+  rwlock_acquire_write (&inode->meta_lock);
+  if (pos < d->length)
+    {
+      i = extent_find (d, idx, &e);
+      if (i < d->extent_cnt && e.unwritten)
+        {
+          sector = e.start + (idx - e.ofs);
+          cache_write (sector, zeros);
+          mark_written (d, i, idx);
+          if (inode->delayed == 0)
+            cache_log_at (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+        }
+    }
+  rwlock_release_write (&inode->meta_lock);
+  return sector;
+}
+
+/* Assigns real sectors to INODE's delayed blocks, a run of
+   sectors for each run of consecutive blocks, and writes INODE
+   to disk.  If the file has too many extents to hold all of
+   them, it is cut short after the last sector assigned.
+   DELAYED_LOCK must be held. */
+static void
+assign_delayed (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+  block_sector_t idx[CACHE_SIZE];
+  size_t cnt, i, run;
+
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+
+  if (inode->delayed == 0)
+    return;
+
+  rwlock_acquire_write (&inode->meta_lock);
+  cnt = cache_delayed_list (inode, idx, CACHE_SIZE);
+  ASSERT (cnt == inode->delayed);
+  free_map_unreserve (inode->delayed);
+  for (i = 0; i < cnt; i += run)
+    {
+      size_t have;
+
+      for (run = 1; i + run < cnt && idx[i + run] == idx[i] + run; run++)
+        continue;
+      have = inode_allocate (d, inode->sector, idx[i], run, inode,
+                             FILL_ZERO);
+      if (have < run)
+        {
+          off_t max = (idx[i] + have) * BLOCK_SECTOR_SIZE;
+          if (d->length > max)
+            d->length = max;
+          cache_delayed_discard (inode);
+          break;
+        }
+    }
+  delayed_total -= inode->delayed;
+  inode->delayed = 0;
+  list_remove (&inode->delayed_elem);
+  cache_log_at (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->meta_lock);
+}
+
+/* Drops INODE's delayed sectors and their data.  DELAYED_LOCK
+   must be held. */
+static void
+drop_delayed (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&delayed_lock));
+
+  if (inode->delayed == 0)
+    return;
+
+  free_map_unreserve (inode->delayed);
+  cache_delayed_discard (inode);
+  delayed_total -= inode->delayed;
+  inode->delayed = 0;
+  list_remove (&inode->delayed_elem);
+}
+
+/* Assigns real sectors to the delayed sectors of every inode.
+   DELAYED_LOCK must be held. */
+static void
+assign_all_delayed (void)
+{
+  while (!list_empty (&delayed_inodes))
+    assign_delayed (list_entry (list_front (&delayed_inodes),
+                                struct inode, delayed_elem));
+}
+
+/* Assigns real sectors to the delayed sectors of every inode, so
+   that flushing the buffer cache writes out all data. */
+void
+inode_flush_delayed (void)
+{
+  journal_begin ();
+  lock_acquire (&delayed_lock);
+  assign_all_delayed ();
+  lock_release (&delayed_lock);
+  journal_end ();
+}
+
+/* Writes INODE's data and its disk inode to disk, assigning
+   sectors to its delayed blocks first, and waits until they are
+   there.  Must not be called during a journal operation. */
+void
+inode_sync (struct inode *inode)
+{
+  struct inode_disk *d = &inode->data;
+  size_t i;
+
+  if (inode->tmp != NULL)
+    return;
+
+  journal_begin ();
+  lock_acquire (&delayed_lock);
+  assign_delayed (inode);
+  lock_release (&delayed_lock);
+  journal_end ();
+
+  /* The disk inode and indirect extent block are journaled, but
+     may have been written in place if a transaction was full. */
+  journal_sync ();
+  cache_flush_range (inode->sector, 1);
+
+  rwlock_acquire_read (&inode->meta_lock);
+  if (d->extent_cnt > INLINE_EXTENTS)
+    cache_flush_range (d->indirect, 1);
+  for (i = 0; i < d->extent_cnt; i++)
+    {
+      struct extent e;
+      extent_get (d, i, &e);
+      if (!e.unwritten)
+        cache_flush_range (e.start, e.length);
+    }
+  rwlock_release_read (&inode->meta_lock);
+}
+
+/* Allocates sectors for the holes in the LENGTH bytes of INODE
+   starting at OFFSET, in as few runs of contiguous sectors as
+   the free map allows, and extends INODE to cover them if they
+   go past its end.  The new sectors are zeroed, unless UNWRITTEN
+   is true, in which case they are only marked unwritten, to be
+   zeroed one at a time as they are written; either way, they
+   read as zeros.  Later writes to the range go to the sectors in
+   place, without delayed allocation.  Returns false if the disk
+   or INODE's extents run out, in which case the sectors
+   allocated so far stay allocated, or if writes to INODE are
+   denied. */
+bool
+inode_preallocate (struct inode *inode, off_t offset, off_t length,
+                   bool unwritten)
+{
+  struct inode_disk *d = &inode->data;
+  off_t end = offset + length;
+  bool success = true;
+  uint32_t idx;
+
+  ASSERT (offset >= 0 && length >= 0);
+
+  if (length == 0 || inode->deny_write_cnt > 0)
+    return length == 0;
+  if (inode->tmp != NULL)
+    {
+      /* Memory is not reserved ahead of time. */
+      tmpfs_grow (inode->tmp, end);
+      return true;
+    }
+
+  journal_begin ();
+  lock_acquire (&delayed_lock);
+  if ((d->flags & INODE_INLINE) && !move_inline_data (inode))
+    {
+      lock_release (&delayed_lock);
+      journal_end ();
+      return false;
+    }
+
+  /* Give delayed blocks their sectors first, so that the blocks
+     left in the range are holes. */
+  assign_delayed (inode);
+
+  rwlock_acquire_write (&inode->meta_lock);
+  inode->version++;
+  for (idx = offset / BLOCK_SECTOR_SIZE;
+       success && idx < bytes_to_sectors (end); )
+    {
+      struct extent e;
+      size_t cnt;
+
+      if (extent_find (d, idx, &e) < d->extent_cnt)
+        {
+          idx = e.ofs + e.length;
+          continue;
+        }
+
+      /* Allocate the hole from IDX up to the next extent or the
+         end of the range. */
+      for (cnt = 1; idx + cnt < bytes_to_sectors (end); cnt++)
+        if (extent_find (d, idx + cnt, &e) < d->extent_cnt)
+          break;
+      success = inode_allocate (d, inode->sector, idx, cnt, NULL,
+                                unwritten ? FILL_UNWRITTEN : FILL_ZERO)
+                 == cnt;
+      idx += cnt;
+    }
+  if (success && end > d->length)
+    d->length = end;
+  cache_log_at (inode->sector, d, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->meta_lock);
+
+  lock_release (&delayed_lock);
+  journal_end ();
+  return success;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
-
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Check whether this inode is already open. */
   inode->sector = sector;
+  lock_acquire (&open_inodes_lock);
+  e = hash_insert (&open_inodes, &inode->elem);
+  if (e != NULL)
+    {
+      free (inode);
+      inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+      return inode;
+    }
+
+  /* Initialize. */
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  inode->delayed = 0;
+  inode->journaled = false;
+  inode->version = 0;
+  inode->tmp = NULL;
+  rwlock_init (&inode->meta_lock, RWLOCK_PREFER_WRITERS);
+  lock_init (&inode->lock);
+  cache_read_meta_at (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  lock_release (&open_inodes_lock);
+  return inode;
+}
+
+/* Returns a new inode whose contents are DATA, kept in memory by
+   tmpfs, which it takes over, or a null pointer if memory
+   allocation fails.  Such inodes are numbered down from the top
+   of the sector numbers, where no disk reaches. */
+struct inode *
+inode_open_memory (struct tmpfs_data *data)
+{
+  static block_sector_t next_inumber = (block_sector_t) -2;
+  struct inode *inode = calloc (1, sizeof *inode);
+
+  if (inode == NULL)
+    return NULL;
+  lock_acquire (&open_inodes_lock);
+  inode->sector = next_inumber--;
+  lock_release (&open_inodes_lock);
+  inode->open_cnt = 1;
+  inode->tmp = data;
+  rwlock_init (&inode->meta_lock, RWLOCK_PREFER_WRITERS);
+  lock_init (&inode->lock);
   return inode;
 }
 
@@ -146,7 +949,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -157,6 +964,23 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns INODE's version, which changes whenever INODE is
+   written.  A caller that keeps information derived from INODE's
+   contents, along with INODE open, can tell by the version
+   whether the information is still current. */
+unsigned
+inode_get_version (const struct inode *inode)
+{
+  return inode->version;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -167,22 +991,58 @@ inode_close (struct inode *inode)
   if (inode == NULL)
     return;
 
-  /* Release resources if this was the last opener. */
+  if (inode->tmp != NULL)
+    {
+      bool last;
+
+      lock_acquire (&open_inodes_lock);
+      last = --inode->open_cnt == 0;
+      lock_release (&open_inodes_lock);
+      if (last)
+        {
+          tmpfs_data_destroy (inode->tmp);
+          free (inode);
+        }
+      return;
+    }
+
+  /* Release resources if this was the last opener.  Holding
+     OPEN_INODES_LOCK keeps a new opener from reading the disk
+     inode before it is up to date. */
+  journal_begin ();
+  lock_acquire (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      hash_delete (&open_inodes, &inode->elem);
  
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, otherwise give the delayed
+         blocks their sectors. */
+      lock_acquire (&delayed_lock);
       if (inode->removed) 
         {
+          drop_delayed (inode);
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          inode_release (&inode->data);
         }
+      else
+        assign_delayed (inode);
+      lock_release (&delayed_lock);
+      lock_release (&open_inodes_lock);
 
       free (inode); 
     }
+  else
+    lock_release (&open_inodes_lock);
+  journal_end ();
+}
+
+/* Marks INODE as holding file system metadata, such as a
+   directory, so that writes to its data are journaled. */
+void
+inode_set_journaled (struct inode *inode) 
+{
+  inode->journaled = true;
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -191,7 +1051,82 @@ void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
+}
+
+/* Acquires INODE's lock, which serializes compound operations on
+   its contents, such as directory lookups and updates, among
+   the threads that have it open.  inode_read_at() and
+   inode_write_at() do not take it. */
+void
+inode_lock (struct inode *inode) 
+{
+  lock_acquire (&inode->lock);
+}
+
+/* Releases INODE's lock. */
+void
+inode_unlock (struct inode *inode) 
+{
+  lock_release (&inode->lock);
+}
+
+/* Returns the sector that contains byte offset POS within INODE,
+   as byte_to_sector(), and stores the number of bytes in INODE
+   at and after POS into *LEFT. */
+static block_sector_t
+locate (struct inode *inode, off_t pos, off_t *left)
+{
+  block_sector_t sector;
+
+  rwlock_acquire_read (&inode->meta_lock);
+  sector = byte_to_sector (inode, pos);
+  *left = inode->data.length - pos;
+  rwlock_release_read (&inode->meta_lock);
+  return sector;
+}
+
+/* Returns the disk sector that holds byte offset POS of INODE's
+   data, which must be sector-aligned, and stores into *CNT the
+   number of sectors from there to the end of its extent, which
+   follow it on disk.  Returns -1 if POS is in a hole or past the
+   end of INODE.  Unlike byte_to_sector(), maps unwritten extents
+   too, for the swap file, whose pages are written to its sectors
+   directly and never read back through the file. */
+block_sector_t
+inode_sector_run (struct inode *inode, off_t pos, size_t *cnt)
+{
+  const struct inode_disk *d = &inode->data;
+  block_sector_t sector = -1;
+  uint32_t idx = pos / BLOCK_SECTOR_SIZE;
+  struct extent e;
+
+  ASSERT (pos % BLOCK_SECTOR_SIZE == 0);
+
+  rwlock_acquire_read (&inode->meta_lock);
+  if (inode->tmp == NULL && pos < d->length
+      && extent_find (d, idx, &e) < d->extent_cnt)
+    {
+      sector = e.start + (idx - e.ofs);
+      *cnt = e.ofs + e.length - idx;
+    }
+  rwlock_release_read (&inode->meta_lock);
+  return sector;
+}
+
+/* Reads SIZE bytes from SECTOR of INODE's data into BUFFER,
+   starting at byte OFS, counting it as metadata I/O if INODE is
+   journaled. */
+static void
+read_sector (struct inode *inode, block_sector_t sector,
+             void *buffer, int ofs, int size)
+{
+  if (inode->journaled)
+    cache_read_meta_at (sector, buffer, ofs, size);
+  else
+    cache_read_at (sector, buffer, ofs, size);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -202,16 +1137,33 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (inode->tmp != NULL)
+    return tmpfs_read_at (inode->tmp, buffer, size, offset);
+
+  rwlock_acquire_read (&inode->meta_lock);
+  if (inode->data.flags & INODE_INLINE)
+    {
+      if (offset < inode->data.length)
+        {
+          bytes_read = inode->data.length - offset;
+          if (bytes_read > size)
+            bytes_read = size;
+          memcpy (buffer, inode->data.data + offset, bytes_read);
+        }
+      rwlock_release_read (&inode->meta_lock);
+      return bytes_read;
+    }
+  rwlock_release_read (&inode->meta_lock);
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      off_t inode_left;
+      block_sector_t sector_idx = locate (inode, offset, &inode_left);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -220,23 +1172,24 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Copy the chunk out of the buffer cache.  A sector not
+         assigned yet is either a delayed block or, if none was
+         ever written, zeros. */
+      if (sector_idx != (block_sector_t) -1)
+        read_sector (inode, sector_idx, buffer + bytes_read,
+                     sector_ofs, chunk_size);
+      else
         {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          lock_acquire (&delayed_lock);
+          sector_idx = locate (inode, offset, &inode_left);
+          if (sector_idx != (block_sector_t) -1)
+            read_sector (inode, sector_idx, buffer + bytes_read,
+                         sector_ofs, chunk_size);
+          else if (!cache_delayed_read_at (inode, offset / BLOCK_SECTOR_SIZE,
+                                           buffer + bytes_read,
+                                           sector_ofs, chunk_size))
+            memset (buffer + bytes_read, 0, chunk_size);
+          lock_release (&delayed_lock);
         }
       
       /* Advance. */
@@ -244,35 +1197,83 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
   return bytes_read;
 }
 
+/* Writes SIZE bytes from BUFFER into SECTOR of INODE's data,
+   starting at byte OFS, logging it in the journal if INODE is
+   journaled. */
+static void
+write_sector (struct inode *inode, block_sector_t sector,
+              const void *buffer, int ofs, int size)
+{
+  if (inode->journaled)
+    cache_log_at (sector, buffer, ofs, size);
+  else
+    cache_write_at (sector, buffer, ofs, size);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or an error occurs.
+   A write past end of file extends the inode, leaving any gap a
+   hole that reads as zeros; the new sectors are allocated
+   lazily, as described above DELAYED_MAX. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
+  rwlock_acquire_read (&inode->meta_lock);
   if (inode->deny_write_cnt)
-    return 0;
+    {
+      rwlock_release_read (&inode->meta_lock);
+      return 0;
+    }
+  inode->version++;
+  rwlock_release_read (&inode->meta_lock);
+
+  if (inode->tmp != NULL)
+    return tmpfs_write_at (inode->tmp, buffer, size, offset);
+
+  journal_begin ();
+  if (inode->data.flags & INODE_INLINE)
+    {
+      /* Once INODE is not inline, it never is again, so only an
+         inline INODE needs checking again under the lock. */
+      lock_acquire (&delayed_lock);
+      if (inode->data.flags & INODE_INLINE)
+        {
+          if (offset + size <= (off_t) INLINE_DATA_SIZE)
+            {
+              write_inline (inode, buffer, size, offset);
+              bytes_written = size;
+              size = 0;
+            }
+          else if (!move_inline_data (inode))
+            size = 0;
+        }
+      lock_release (&delayed_lock);
+    }
+  if (size > 0 && offset + size > inode_length (inode))
+    {
+      lock_acquire (&delayed_lock);
+      if (offset + size > inode_length (inode))
+        inode_grow (inode, offset + size);
+      lock_release (&delayed_lock);
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      off_t inode_left;
+      block_sector_t sector_idx = locate (inode, offset, &inode_left);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,30 +1282,39 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
+      /* Copy the chunk into the buffer cache, which reads in the
+         rest of the sector if the chunk does not cover it. */
+      if (sector_idx != (block_sector_t) -1)
+        write_sector (inode, sector_idx, buffer + bytes_written,
+                      sector_ofs, chunk_size);
+      else
         {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
+          lock_acquire (&delayed_lock);
+          sector_idx = locate (inode, offset, &inode_left);
+          if (sector_idx == (block_sector_t) -1)
+            sector_idx = claim_unwritten (inode, offset);
+          if (sector_idx != (block_sector_t) -1)
+            write_sector (inode, sector_idx, buffer + bytes_written,
+                          sector_ofs, chunk_size);
+          else if (reserve_delayed (inode, offset / BLOCK_SECTOR_SIZE))
+            cache_delayed_write_at (inode, offset / BLOCK_SECTOR_SIZE,
+                                    buffer + bytes_written,
+                                    sector_ofs, chunk_size);
+          else
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              /* Disk is full. */
+              lock_release (&delayed_lock);
+              break;
             }
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
+          /* Delayed blocks stay in the cache, so keep their number
+             bounded.  Journaled inodes get their sectors at once,
+             so that the transaction holds their new length. */
+          if (delayed_total >= DELAYED_TOTAL_MAX)
+            assign_all_delayed ();
+          else if (inode->delayed >= DELAYED_MAX || inode->journaled)
+            assign_delayed (inode);
+          lock_release (&delayed_lock);
         }
 
       /* Advance. */
@@ -312,7 +1322,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+  journal_end ();
 
   return bytes_written;
 }
@@ -322,8 +1332,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->meta_lock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->meta_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,14 +1344,68 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->meta_lock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->meta_lock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  The length
+   is read without META_LOCK, so it may be stale by the time the
+   caller uses it. */
 off_t
 inode_length (const struct inode *inode)
 {
+  if (inode->tmp != NULL)
+    return tmpfs_length (inode->tmp);
   return inode->data.length;
 }
+
+/* Returns true if the SIZE bytes of INODE starting at OFFSET,
+   which must be within the file, lie entirely in holes, so that
+   they read as zeros without any I/O. */
+bool
+inode_is_hole (struct inode *inode, off_t offset, off_t size)
+{
+  off_t pos;
+  bool hole;
+
+  if (inode->tmp != NULL)
+    return tmpfs_is_hole (inode->tmp, offset, size);
+
+  lock_acquire (&delayed_lock);
+  rwlock_acquire_read (&inode->meta_lock);
+  hole = (!(inode->data.flags & INODE_INLINE)
+          && offset + size <= inode->data.length);
+  for (pos = offset - offset % BLOCK_SECTOR_SIZE;
+       hole && pos < offset + size; pos += BLOCK_SECTOR_SIZE)
+    if (byte_to_sector (inode, pos) != (block_sector_t) -1
+        || cache_delayed_present (inode, pos / BLOCK_SECTOR_SIZE))
+      hole = false;
+  rwlock_release_read (&inode->meta_lock);
+  lock_release (&delayed_lock);
+  return hole;
+}
+
+/* Starts reading the sectors of INODE holding the SIZE bytes
+   starting at OFFSET into the buffer cache, without waiting for
+   them. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  off_t pos;
+
+  if (inode->tmp != NULL)
+    return;
+  for (pos = offset - offset % BLOCK_SECTOR_SIZE; pos < offset + size;
+       pos += BLOCK_SECTOR_SIZE)
+    {
+      off_t left;
+      block_sector_t sector = locate (inode, pos, &left);
+      if (left <= 0)
+        break;
+      if (sector != (block_sector_t) -1)
+        cache_prefetch (sector);
+    }
+}
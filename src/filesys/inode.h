@@ -5,19 +5,35 @@
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
+struct tmpfs_data;
+
 struct bitmap;
 
 void inode_init (void);
 bool inode_create (block_sector_t, off_t);
+bool inode_create_uninit (block_sector_t, off_t);
 struct inode *inode_open (block_sector_t);
+struct inode *inode_open_memory (struct tmpfs_data *);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
+unsigned inode_get_version (const struct inode *);
+bool inode_is_removed (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_lock (struct inode *);
+void inode_unlock (struct inode *);
+void inode_set_journaled (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+void inode_readahead (struct inode *, off_t offset, off_t size);
+bool inode_is_hole (struct inode *, off_t offset, off_t size);
+bool inode_preallocate (struct inode *, off_t offset, off_t length,
+                        bool unwritten);
+block_sector_t inode_sector_run (struct inode *, off_t pos, size_t *cnt);
+void inode_flush_delayed (void);
+void inode_sync (struct inode *);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,367 @@
+#include "filesys/journal.h"
+#include <crc32c.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Metadata journal.
+
+   Updates to file system metadata -- the free map, inodes and
+   their extent blocks, and directories -- are written with
+   cache_log_at(), which pins the sector in the buffer cache and
+   adds it to the running transaction here.  A pinned sector is
+   not written to its place on disk until its transaction
+   commits: its contents are written to the journal region,
+   after JOURNAL_SECTOR, then the journal header is written
+   listing their home sectors, which is the commit point, and
+   only then are the sectors written in place and the header
+   cleared.  After a crash, journal_open() finds a committed
+   transaction in the header and copies its blocks home again,
+   so that each transaction is on disk entirely or not at all.
+   The header carries a checksum of the blocks and their homes,
+   so that a header that reached the disk before its blocks did,
+   or only in part, is not mistaken for a commit: nothing of
+   that transaction has been written in place yet, so it is
+   simply dropped.
+   File data is not journaled, but new data sectors need no
+   ordering since nothing refers to them until their inode is
+   committed.
+
+   Each file system operation runs between journal_begin() and
+   journal_end(), which nest, and a transaction commits only
+   when no operation is running, so that it holds only whole
+   operations.  Concurrent operations thus share one commit:
+   commits happen when the transaction is nearly full, every
+   JOURNAL_COMMIT_TICKS in the "journal" thread, and at
+   shutdown.  An operation that needs more room than is left in
+   a full transaction, such as rehashing a large directory,
+   writes the excess in place without journaling. */
+
+/* How often the running transaction commits, in timer ticks. */
+#define JOURNAL_COMMIT_TICKS (5 * TIMER_FREQ)
+
+/* Sectors an operation may need.  journal_begin() waits for a
+   commit if fewer are left. */
+#define JOURNAL_OP_BLOCKS 8
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* On-disk journal header, in JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    unsigned magic;                     /* Magic number. */
+    unsigned seq;                       /* Number of commits. */
+    unsigned cnt;                       /* Blocks committed, or 0. */
+    uint32_t cksum;                     /* CRC32C of blocks and homes. */
+    block_sector_t home[JOURNAL_BLOCKS]; /* Home of each block. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 3 * sizeof (unsigned)
+                   - sizeof (uint32_t)
+                   - JOURNAL_BLOCKS * sizeof (block_sector_t)];
+  };
+
+static struct lock journal_lock;
+static struct condition journal_idle;  /* Signaled after a commit. */
+static bool enabled;                    /* Journaling on? */
+static bool committing;                 /* A commit in progress? */
+static bool commit_wanted;              /* Commit at next idle time? */
+static unsigned active;                 /* Operations running. */
+
+/* Running transaction. */
+static block_sector_t tx[JOURNAL_BLOCKS];
+static size_t tx_cnt;
+
+/* Used only by the committing thread. */
+static struct journal_header header;
+static uint8_t commit_buf[BLOCK_SECTOR_SIZE];
+
+/* Statistics. */
+static long long commit_cnt, logged_cnt, op_cnt, overflow_cnt;
+
+static void commit (void);
+static uint32_t header_cksum (uint32_t crc);
+static void journal_thread (void *aux);
+
+/* Initializes the journal module.  Journaling is off until
+   journal_open(). */
+void
+journal_init (void) 
+{
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&journal_idle);
+}
+
+/* Writes an empty journal to a newly formatted disk. */
+void
+journal_create (void) 
+{
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Reads the journal, replays any committed transaction that may
+   not have reached its place on disk, and turns journaling
+   on. */
+void
+journal_open (void) 
+{
+  size_t i;
+
+  block_read (fs_device, JOURNAL_SECTOR, &header);
+  if (header.magic != JOURNAL_MAGIC || header.cnt > JOURNAL_BLOCKS)
+    PANIC ("no file system journal found, reformat with -f");
+
+  if (header.cnt > 0)
+    {
+      uint32_t crc = 0;
+
+      for (i = 0; i < header.cnt; i++)
+        {
+          block_read (fs_device, JOURNAL_SECTOR + 1 + i, commit_buf);
+          crc = crc32c (crc, commit_buf, BLOCK_SECTOR_SIZE);
+        }
+      if (header_cksum (crc) == header.cksum)
+        {
+          printf ("Replaying %u journaled blocks...", header.cnt);
+          for (i = 0; i < header.cnt; i++)
+            {
+              block_read (fs_device, JOURNAL_SECTOR + 1 + i, commit_buf);
+              block_write (fs_device, header.home[i], commit_buf);
+            }
+        }
+      else
+        printf ("Dropping torn journal transaction of %u blocks...",
+                header.cnt);
+      header.cnt = 0;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+      printf ("done.\n");
+    }
+
+  enabled = true;
+  thread_create ("journal", PRI_DEFAULT, journal_thread, NULL);
+}
+
+/* Waits for running operations to finish, commits the running
+   transaction, and turns journaling off. */
+void
+journal_close (void) 
+{
+  lock_acquire (&journal_lock);
+  while (active > 0 || committing)
+    {
+      commit_wanted = true;
+      cond_wait (&journal_idle, &journal_lock);
+    }
+  commit ();
+  enabled = false;
+  lock_release (&journal_lock);
+}
+
+/* Starts a file system operation, which the running transaction
+   will hold in full.  May wait for a commit. */
+void
+journal_begin (void) 
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  for (;;)
+    {
+      if (committing)
+        cond_wait (&journal_idle, &journal_lock);
+      else if (tx_cnt + JOURNAL_OP_BLOCKS <= JOURNAL_BLOCKS)
+        break;
+      else if (active == 0)
+        commit ();
+      else
+        {
+          commit_wanted = true;
+          cond_wait (&journal_idle, &journal_lock);
+        }
+    }
+  active++;
+  op_cnt++;
+  lock_release (&journal_lock);
+}
+
+/* Ends a file system operation started with journal_begin().
+   The last operation to finish commits the transaction if one
+   is wanted. */
+void
+journal_end (void) 
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->journal_depth > 0);
+  if (--cur->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active > 0);
+  if (--active == 0 && commit_wanted)
+    commit ();
+  lock_release (&journal_lock);
+}
+
+/* Adds SECTOR to the running transaction.  Returns false if
+   journaling is off or the transaction is full, in which case
+   SECTOR should be written in place as usual.  Called by the
+   buffer cache for each sector written with cache_log_at() that
+   is not yet in the transaction. */
+bool
+journal_log (block_sector_t sector) 
+{
+  bool success;
+
+  lock_acquire (&journal_lock);
+  success = enabled && tx_cnt < JOURNAL_BLOCKS;
+  if (success)
+    {
+      tx[tx_cnt++] = sector;
+      logged_cnt++;
+    }
+  else if (enabled)
+    overflow_cnt++;
+  lock_release (&journal_lock);
+  return success;
+}
+
+/* Commits the running transaction as soon as no operation is
+   running.  Does not wait for the commit. */
+void
+journal_commit (void) 
+{
+  lock_acquire (&journal_lock);
+  if (active == 0 && !committing)
+    commit ();
+  else
+    commit_wanted = true;
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction and waits until it and its
+   blocks are written in place, so that every operation already
+   ended is on disk.  Must not be called during an operation. */
+void
+journal_sync (void)
+{
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_idle, &journal_lock);
+  if (tx_cnt > 0)
+    {
+      long long seen = commit_cnt;
+
+      if (active == 0)
+        commit ();
+      else
+        {
+          commit_wanted = true;
+          while (commit_cnt == seen)
+            cond_wait (&journal_idle, &journal_lock);
+        }
+    }
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction and writes its blocks in
+   place.  JOURNAL_LOCK must be held and no operation may be
+   running. */
+static void
+commit (void) 
+{
+  uint32_t crc;
+  size_t cnt, i;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (active == 0 && !committing);
+
+  commit_wanted = false;
+  if (tx_cnt == 0)
+    {
+      cond_broadcast (&journal_idle, &journal_lock);
+      return;
+    }
+
+  /* No operation can start until we are done, so TX is ours to
+     use without the lock. */
+  committing = true;
+  lock_release (&journal_lock);
+
+  /* Write the blocks to the journal, then the header that
+     commits them. */
+  for (crc = cnt = i = 0; i < tx_cnt; i++)
+    if (cache_copy_pinned (tx[i], commit_buf))
+      {
+        block_write (fs_device, JOURNAL_SECTOR + 1 + cnt, commit_buf);
+        crc = crc32c (crc, commit_buf, BLOCK_SECTOR_SIZE);
+        header.home[cnt++] = tx[i];
+      }
+  if (cnt > 0)
+    {
+      header.seq++;
+      header.cnt = cnt;
+      header.cksum = header_cksum (crc);
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+
+  /* Write the blocks in place, then empty the journal. */
+  for (i = 0; i < tx_cnt; i++)
+    cache_checkpoint (tx[i]);
+  if (cnt > 0)
+    {
+      header.cnt = 0;
+      block_write (fs_device, JOURNAL_SECTOR, &header);
+    }
+
+  lock_acquire (&journal_lock);
+  tx_cnt = 0;
+  committing = false;
+  commit_cnt++;
+  cond_broadcast (&journal_idle, &journal_lock);
+}
+
+/* Returns the checksum of the transaction in HEADER, given CRC,
+   the CRC32C of its blocks in order. */
+static uint32_t
+header_cksum (uint32_t crc)
+{
+  crc = crc32c (crc, &header.seq, sizeof header.seq);
+  crc = crc32c (crc, &header.cnt, sizeof header.cnt);
+  return crc32c (crc, header.home, header.cnt * sizeof *header.home);
+}
+
+/* Journal thread: commits the running transaction every
+   JOURNAL_COMMIT_TICKS. */
+static void
+journal_thread (void *aux UNUSED) 
+{
+  for (;;)
+    {
+      timer_sleep (JOURNAL_COMMIT_TICKS);
+      journal_commit ();
+    }
+}
+
+/* Prints journal statistics. */
+void
+journal_print_stats (void) 
+{
+  printf ("Journal: %lld operations, %lld commits, %lld blocks logged, "
+          "%lld unlogged\n",
+          op_cnt, commit_cnt, logged_cnt, overflow_cnt);
+}
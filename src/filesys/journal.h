@@ -0,0 +1,25 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Maximum number of sectors in one journal transaction. */
+#define JOURNAL_BLOCKS 24
+
+/* Sectors in the journal region: a header, then the blocks. */
+#define JOURNAL_SECTORS (1 + JOURNAL_BLOCKS)
+
+void journal_init (void);
+void journal_create (void);
+void journal_open (void);
+void journal_close (void);
+
+void journal_begin (void);
+void journal_end (void);
+bool journal_log (block_sector_t);
+void journal_commit (void);
+void journal_sync (void);
+void journal_print_stats (void);
+
+#endif /* filesys/journal.h */
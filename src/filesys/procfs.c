@@ -0,0 +1,279 @@
+#include "filesys/procfs.h"
+#include <console.h>
+#include <ctype.h>
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
+#include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/tmpfs.h"
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#ifdef USERPROG
+#include "userprog/exception.h"
+#include "userprog/syscall.h"
+#endif
+#ifdef VM
+#include "vm/vmstat.h"
+#endif
+
+/* Statistics files.
+
+   A file whose name starts with PROCFS_PREFIX is a snapshot, in
+   text, of the kernel's counters for one subsystem, taken when
+   the file is opened.  A monitoring program samples the counters
+   while a workload runs by opening the file again each time,
+   rather than waiting for the report printed at shutdown.  The
+   files are:
+
+     sched      Timer, threads, FPU, interrupts, work queues, RCU.
+     locks      Lock contention.
+     memory     Page and block allocators.
+     block      Block devices, buffer cache, journal.
+     syscalls   Exceptions and system calls.
+     vm         Frames, pages and swap.
+     TID        Resources used by the thread with tid TID.
+     self       The same, for the thread opening the file.
+
+   Each file but the last two holds just what the subsystem's
+   print function would print at shutdown.  It is captured with
+   console_capture() into memory-backed contents, as for tmpfs,
+   opened with inode_open_memory(), so that struct file and the
+   system calls read it unchanged.  Writes are denied, and the
+   contents are freed when the file is closed. */
+
+/* A statistics file: NAME, without PROCFS_PREFIX, and the
+   function that prints its contents. */
+struct procfs_file
+  {
+    const char *name;
+    void (*print) (void);
+  };
+
+static void print_sched (void);
+static void print_memory (void);
+static void print_block (void);
+#ifdef USERPROG
+static void print_syscalls (void);
+#endif
+
+static const struct procfs_file files[] =
+  {
+    {"sched", print_sched},
+    {"locks", lock_print_stats},
+    {"memory", print_memory},
+    {"block", print_block},
+#ifdef USERPROG
+    {"syscalls", print_syscalls},
+#endif
+#ifdef VM
+    {"vm", vm_print_stats},
+#endif
+  };
+
+/* Serializes the capture of console output. */
+static struct lock capture_lock;
+
+/* Initializes procfs. */
+void
+procfs_init (void)
+{
+  lock_init (&capture_lock);
+}
+
+/* If NAME starts with PROCFS_PREFIX, returns the rest of it, the
+   file's name within procfs, otherwise a null pointer. */
+const char *
+procfs_name (const char *name)
+{
+  size_t len = strlen (PROCFS_PREFIX);
+
+  return (strlen (name) >= len && !memcmp (name, PROCFS_PREFIX, len)
+          ? name + len : NULL);
+}
+
+static void
+print_sched (void)
+{
+  timer_print_stats ();
+  thread_print_stats ();
+  fpu_print_stats ();
+  intr_print_stats ();
+  workqueue_print_stats ();
+  rcu_print_stats ();
+}
+
+static void
+print_memory (void)
+{
+  palloc_print_stats ();
+  malloc_print_stats ();
+}
+
+static void
+print_block (void)
+{
+  block_print_stats ();
+  ide_print_stats ();
+  cache_print_stats ();
+  dcache_print_stats ();
+  journal_print_stats ();
+}
+
+#ifdef USERPROG
+static void
+print_syscalls (void)
+{
+  exception_print_stats ();
+  syscall_print_stats ();
+}
+#endif
+
+/* Returns the name of thread status STATUS. */
+static const char *
+status_name (enum thread_status status)
+{
+  switch (status)
+    {
+    case THREAD_RUNNING:
+      return "running";
+    case THREAD_READY:
+      return "ready";
+    case THREAD_BLOCKED:
+      return "blocked";
+    default:
+      return "dying";
+    }
+}
+
+/* Prints the resources used by the thread with tid TID.  Returns
+   false if there is no such thread. */
+static bool
+print_thread (tid_t tid)
+{
+  struct thread *t = thread_find (tid);
+  enum thread_status status;
+  char name[sizeof t->name];
+  struct rusage r;
+  int priority;
+#ifdef VM
+  struct vmstat vs;
+  size_t rss;
+#endif
+
+  if (t == NULL)
+    return false;
+
+  /* Copy out what is needed, since T may exit as soon as the
+     read-side critical section ends, and printing may sleep. */
+  strlcpy (name, t->name, sizeof name);
+  status = t->status;
+  priority = t->priority;
+  thread_get_rusage (t, &r);
+#ifdef VM
+  vs = t->vmstat;
+  rss = t->rss;
+#endif
+  rcu_read_unlock ();
+
+  printf ("name: %s\n", name);
+  printf ("tid: %d\n", tid);
+  printf ("state: %s\n", status_name (status));
+  printf ("priority: %d\n", priority);
+  printf ("utime: %lld ticks\nstime: %lld ticks\nrun: %lld ns\n",
+          r.utime, r.stime, r.run_ns);
+  printf ("nvcsw: %lld\nnivcsw: %lld\n", r.nvcsw, r.nivcsw);
+  printf ("minflt: %lld\nmajflt: %lld\n", r.minflt, r.majflt);
+  printf ("inblock: %lld\noublock: %lld\n", r.inblock, r.oublock);
+  printf ("inops: %lld\nouops: %lld\n", r.inops, r.ouops);
+#ifdef VM
+  printf ("rss: %zu pages\n", rss);
+  printf ("evictions: %lld\nswap_ins: %lld\nswap_outs: %lld\n",
+          vs.evictions, vs.swap_ins, vs.swap_outs);
+#endif
+  return true;
+}
+
+/* Parses NAME as a thread's file, "self" or a tid in decimal.
+   Returns the tid, or TID_ERROR if NAME is neither. */
+static tid_t
+parse_tid (const char *name)
+{
+  const char *p;
+
+  if (!strcmp (name, "self"))
+    return thread_current ()->tid;
+  if (*name == '\0' || strlen (name) > 9)
+    return TID_ERROR;
+  for (p = name; *p != '\0'; p++)
+    if (!isdigit (*p))
+      return TID_ERROR;
+  return atoi (name);
+}
+
+/* Appends the N captured characters in BUFFER to the contents
+   DATA_. */
+static void
+capture_output (const char *buffer, size_t n, void *data_)
+{
+  struct tmpfs_data *data = data_;
+
+  tmpfs_write_at (data, buffer, n, tmpfs_length (data));
+}
+
+/* Takes a snapshot of the statistics file named NAME and returns
+   it as a new inode, or a null pointer if there is no such file
+   or memory runs out. */
+struct inode *
+procfs_open (const char *name)
+{
+  const struct procfs_file *f = NULL;
+  struct tmpfs_data *data;
+  struct inode *inode;
+  tid_t tid = TID_ERROR;
+  bool found;
+  size_t i;
+
+  for (i = 0; i < sizeof files / sizeof *files; i++)
+    if (!strcmp (name, files[i].name))
+      f = &files[i];
+  if (f == NULL && (tid = parse_tid (name)) == TID_ERROR)
+    return NULL;
+
+  data = tmpfs_data_create (0);
+  if (data == NULL)
+    return NULL;
+
+  lock_acquire (&capture_lock);
+  console_capture (capture_output, data);
+  if (f != NULL)
+    {
+      f->print ();
+      found = true;
+    }
+  else
+    found = print_thread (tid);
+  console_capture_end ();
+  lock_release (&capture_lock);
+
+  inode = found ? inode_open_memory (data) : NULL;
+  if (inode == NULL)
+    {
+      tmpfs_data_destroy (data);
+      return NULL;
+    }
+  inode_deny_write (inode);
+  return inode;
+}
@@ -0,0 +1,14 @@
+#ifndef FILESYS_PROCFS_H
+#define FILESYS_PROCFS_H
+
+/* Files whose names start with this prefix are read-only
+   snapshots of kernel statistics made by procfs. */
+#define PROCFS_PREFIX "/proc/"
+
+struct inode;
+
+void procfs_init (void);
+const char *procfs_name (const char *);
+struct inode *procfs_open (const char *name);
+
+#endif /* filesys/procfs.h */
@@ -0,0 +1,317 @@
+#include "filesys/tmpfs.h"
+#include <debug.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Memory-backed file system.
+
+   A file whose name starts with TMPFS_PREFIX lives only in
+   memory, for scratch data that would otherwise pay for the
+   journal, the free map and disk I/O only to be deleted soon
+   after.  Such a file is a struct inode like any other, opened
+   with inode_open_memory(), so struct file and the system calls
+   use it unchanged; inode.c hands its reads and writes to the
+   file's struct tmpfs_data here.
+
+   The data is kept one page per PGSIZE bytes of the file, each
+   page taken from the user pool when first written, so that the
+   parts never written are holes that read as zeros and cost no
+   memory.  The pages are not evictable: the frame table only
+   manages pages mapped into processes, and a tmpfs page has no
+   backing store to be evicted to.
+
+   The names live in a list of their own, not in the root
+   directory, and are lost at shutdown along with the data. */
+
+/* A file's contents. */
+struct tmpfs_data
+  {
+    struct lock lock;                   /* Protects the members below. */
+    uint8_t **pages;                    /* Pages, or null for holes. */
+    size_t page_cnt;                    /* Number of elements in PAGES. */
+    off_t length;                       /* File size in bytes. */
+  };
+
+/* A named file. */
+struct tmpfs_file
+  {
+    struct list_elem elem;              /* In FILES. */
+    char name[NAME_MAX + 1];            /* Name, without TMPFS_PREFIX. */
+    struct inode *inode;                /* Kept open while named. */
+  };
+
+/* Named files, protected by FILES_LOCK. */
+static struct list files;
+static struct lock files_lock;
+
+/* Initializes tmpfs. */
+void
+tmpfs_init (void)
+{
+  list_init (&files);
+  lock_init (&files_lock);
+}
+
+/* If NAME starts with TMPFS_PREFIX, returns the rest of it, the
+   file's name within tmpfs, otherwise a null pointer. */
+const char *
+tmpfs_name (const char *name)
+{
+  size_t len = strlen (TMPFS_PREFIX);
+
+  return (strlen (name) >= len && !memcmp (name, TMPFS_PREFIX, len)
+          ? name + len : NULL);
+}
+
+/* Returns the file named NAME, or a null pointer if there is
+   none.  FILES_LOCK must be held. */
+static struct tmpfs_file *
+lookup (const char *name)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&files_lock));
+
+  for (e = list_begin (&files); e != list_end (&files); e = list_next (e))
+    {
+      struct tmpfs_file *f = list_entry (e, struct tmpfs_file, elem);
+      if (!strcmp (f->name, name))
+        return f;
+    }
+  return NULL;
+}
+
+/* Creates a file named NAME, INITIAL_SIZE bytes long, all of
+   them holes.  Returns true if successful, false if NAME is
+   empty or too long, a file named NAME already exists, or memory
+   is short. */
+bool
+tmpfs_create (const char *name, off_t initial_size)
+{
+  struct tmpfs_file *f;
+  bool success = false;
+
+  if (*name == '\0' || strlen (name) > NAME_MAX || initial_size < 0)
+    return false;
+
+  lock_acquire (&files_lock);
+  if (lookup (name) == NULL && (f = malloc (sizeof *f)) != NULL)
+    {
+      struct tmpfs_data *data = tmpfs_data_create (initial_size);
+
+      f->inode = data != NULL ? inode_open_memory (data) : NULL;
+      if (f->inode != NULL)
+        {
+          strlcpy (f->name, name, sizeof f->name);
+          list_push_back (&files, &f->elem);
+          success = true;
+        }
+      else
+        {
+          if (data != NULL)
+            tmpfs_data_destroy (data);
+          free (f);
+        }
+    }
+  lock_release (&files_lock);
+  return success;
+}
+
+/* Opens the file named NAME and returns its inode, or a null
+   pointer if there is none. */
+struct inode *
+tmpfs_open (const char *name)
+{
+  struct tmpfs_file *f;
+  struct inode *inode;
+
+  lock_acquire (&files_lock);
+  f = lookup (name);
+  inode = f != NULL ? inode_reopen (f->inode) : NULL;
+  lock_release (&files_lock);
+  return inode;
+}
+
+/* Removes the file named NAME.  Its memory is freed once the
+   last opener closes it.  Returns false if there is no such
+   file. */
+bool
+tmpfs_remove (const char *name)
+{
+  struct tmpfs_file *f;
+
+  lock_acquire (&files_lock);
+  f = lookup (name);
+  if (f != NULL)
+    list_remove (&f->elem);
+  lock_release (&files_lock);
+  if (f == NULL)
+    return false;
+
+  inode_remove (f->inode);
+  inode_close (f->inode);
+  free (f);
+  return true;
+}
+
+/* Returns new contents for a file LENGTH bytes long, all holes,
+   or a null pointer if memory is short. */
+struct tmpfs_data *
+tmpfs_data_create (off_t length)
+{
+  struct tmpfs_data *data = malloc (sizeof *data);
+
+  if (data != NULL)
+    {
+      lock_init (&data->lock);
+      data->pages = NULL;
+      data->page_cnt = 0;
+      data->length = length;
+    }
+  return data;
+}
+
+/* Frees DATA and its pages. */
+void
+tmpfs_data_destroy (struct tmpfs_data *data)
+{
+  size_t i;
+
+  for (i = 0; i < data->page_cnt; i++)
+    if (data->pages[i] != NULL)
+      palloc_free_page (data->pages[i]);
+  free (data->pages);
+  free (data);
+}
+
+/* Reads SIZE bytes of DATA starting at OFFSET into BUFFER, or as
+   many as there are before its end, and returns their number. */
+off_t
+tmpfs_read_at (struct tmpfs_data *data, void *buffer_, off_t size,
+               off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  lock_acquire (&data->lock);
+  if (offset < data->length && size > data->length - offset)
+    size = data->length - offset;
+  while (offset < data->length && bytes_read < size)
+    {
+      size_t idx = offset / PGSIZE;
+      off_t page_ofs = offset % PGSIZE;
+      off_t chunk = PGSIZE - page_ofs;
+
+      if (chunk > size - bytes_read)
+        chunk = size - bytes_read;
+      if (idx < data->page_cnt && data->pages[idx] != NULL)
+        memcpy (buffer + bytes_read, data->pages[idx] + page_ofs, chunk);
+      else
+        memset (buffer + bytes_read, 0, chunk);
+      bytes_read += chunk;
+      offset += chunk;
+    }
+  lock_release (&data->lock);
+  return bytes_read;
+}
+
+/* Makes DATA's page array cover at least PAGE_CNT pages.
+   Returns false if memory is short.  DATA's lock must be
+   held. */
+static bool
+cover (struct tmpfs_data *data, size_t page_cnt)
+{
+  uint8_t **pages;
+  size_t new_cnt;
+
+  if (page_cnt <= data->page_cnt)
+    return true;
+  new_cnt = data->page_cnt;
+  pages = array_grow (data->pages, &new_cnt, page_cnt > 8 ? page_cnt : 8,
+                      sizeof *pages);
+  if (pages == NULL)
+    return false;
+  memset (pages + data->page_cnt, 0,
+          (new_cnt - data->page_cnt) * sizeof *pages);
+  data->pages = pages;
+  data->page_cnt = new_cnt;
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into DATA starting at OFFSET,
+   extending it if they go past its end, and returns the number
+   written, fewer than SIZE if memory runs out. */
+off_t
+tmpfs_write_at (struct tmpfs_data *data, const void *buffer_, off_t size,
+                off_t offset)
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  lock_acquire (&data->lock);
+  while (bytes_written < size)
+    {
+      size_t idx = offset / PGSIZE;
+      off_t page_ofs = offset % PGSIZE;
+      off_t chunk = PGSIZE - page_ofs;
+
+      if (chunk > size - bytes_written)
+        chunk = size - bytes_written;
+      if (!cover (data, idx + 1))
+        break;
+      if (data->pages[idx] == NULL
+          && (data->pages[idx] = palloc_get_page (PAL_USER | PAL_ZERO))
+             == NULL)
+        break;
+      memcpy (data->pages[idx] + page_ofs, buffer + bytes_written, chunk);
+      bytes_written += chunk;
+      offset += chunk;
+    }
+  if (offset > data->length)
+    data->length = offset;
+  lock_release (&data->lock);
+  return bytes_written;
+}
+
+/* Returns the length of DATA in bytes. */
+off_t
+tmpfs_length (const struct tmpfs_data *data)
+{
+  return data->length;
+}
+
+/* Extends DATA to LENGTH bytes, if it is shorter, with holes. */
+void
+tmpfs_grow (struct tmpfs_data *data, off_t length)
+{
+  lock_acquire (&data->lock);
+  if (length > data->length)
+    data->length = length;
+  lock_release (&data->lock);
+}
+
+/* Returns true if the SIZE bytes of DATA starting at OFFSET,
+   which must be within it, have never been written, so that
+   they read as zeros. */
+bool
+tmpfs_is_hole (struct tmpfs_data *data, off_t offset, off_t size)
+{
+  size_t idx;
+  bool hole;
+
+  lock_acquire (&data->lock);
+  hole = offset + size <= data->length;
+  for (idx = offset / PGSIZE;
+       hole && idx < data->page_cnt && (off_t) (idx * PGSIZE) < offset + size;
+       idx++)
+    if (data->pages[idx] != NULL)
+      hole = false;
+  lock_release (&data->lock);
+  return hole;
+}
@@ -0,0 +1,30 @@
+#ifndef FILESYS_TMPFS_H
+#define FILESYS_TMPFS_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+/* Files whose names start with this prefix are kept in memory by
+   tmpfs instead of on the file system device. */
+#define TMPFS_PREFIX "/tmp/"
+
+struct inode;
+struct tmpfs_data;
+
+void tmpfs_init (void);
+const char *tmpfs_name (const char *);
+bool tmpfs_create (const char *name, off_t initial_size);
+struct inode *tmpfs_open (const char *name);
+bool tmpfs_remove (const char *name);
+
+/* File contents, for inode.c. */
+struct tmpfs_data *tmpfs_data_create (off_t length);
+void tmpfs_data_destroy (struct tmpfs_data *);
+off_t tmpfs_read_at (struct tmpfs_data *, void *, off_t size, off_t offset);
+off_t tmpfs_write_at (struct tmpfs_data *, const void *, off_t size,
+                      off_t offset);
+off_t tmpfs_length (const struct tmpfs_data *);
+void tmpfs_grow (struct tmpfs_data *, off_t length);
+bool tmpfs_is_hole (struct tmpfs_data *, off_t offset, off_t size);
+
+#endif /* filesys/tmpfs.h */
@@ -0,0 +1,215 @@
+#ifndef __LIB_KERNEL_ATOMIC_H
+#define __LIB_KERNEL_ATOMIC_H
+
+/* Atomic operations and memory barriers, for x86.
+
+   An atomic_t or atomic64_t is a counter that any number of
+   threads, interrupt handlers and CPUs may update at once without
+   a lock and without disabling interrupts: every operation that
+   writes one is a single "lock"-prefixed instruction, or for
+   atomic64_t a "lock cmpxchg8b" loop, so no update is lost.
+   Reads and writes of an atomic_t through atomic_read() and
+   atomic_set() are plain loads and stores, which x86 performs
+   atomically for aligned 32-bit words; an atomic64_t needs
+   cmpxchg8b even to be read in one piece.
+
+   Every operation that writes is also a full memory barrier, for
+   the compiler and for the CPU, as "lock"-prefixed instructions
+   are on x86.  atomic_read() and atomic_set() are not barriers
+   at all.
+
+   Only the value an operation returns is atomic with it: a
+   atomic_read() followed by atomic_set() is not, so use
+   atomic_cmpxchg() for read-modify-write sequences of your own. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Optimization barrier.
+
+   The compiler will not reorder operations across an
+   optimization barrier.  See "Optimization Barriers" in the
+   reference guide for more information.*/
+#define barrier() asm volatile ("" : : : "memory")
+
+/* CPU memory barriers.
+
+   mb() orders every load and store before it ahead of every one
+   after it, as seen by other CPUs and by devices.  x86 already
+   keeps loads in order with loads and stores in order with
+   stores, so rmb() and wmb() need only keep the compiler from
+   reordering; only a store followed by a load needs mb().  A
+   locked no-op add to the stack serves as a full barrier on every
+   x86, with or without SSE2's "mfence". */
+#define mb() asm volatile ("lock; addl $0, (%%esp)" : : : "memory", "cc")
+#define rmb() barrier ()
+#define wmb() barrier ()
+
+/* A 32-bit atomic counter. */
+typedef struct
+  {
+    volatile int32_t value;
+  }
+atomic_t;
+
+/* A 64-bit atomic counter. */
+typedef struct
+  {
+    volatile int64_t value;
+  }
+atomic64_t;
+
+/* Initializer for an atomic_t or atomic64_t with value V. */
+#define ATOMIC_INIT(V) { (V) }
+
+/* Returns the value of A. */
+static inline int32_t
+atomic_read (const atomic_t *a)
+{
+  return a->value;
+}
+
+/* Sets A to V. */
+static inline void
+atomic_set (atomic_t *a, int32_t v)
+{
+  a->value = v;
+}
+
+/* Adds N to A. */
+static inline void
+atomic_add (atomic_t *a, int32_t n)
+{
+  asm volatile ("lock addl %1, %0" : "+m" (a->value) : "ir" (n)
+                : "memory", "cc");
+}
+
+/* Subtracts N from A. */
+static inline void
+atomic_sub (atomic_t *a, int32_t n)
+{
+  asm volatile ("lock subl %1, %0" : "+m" (a->value) : "ir" (n)
+                : "memory", "cc");
+}
+
+/* Adds 1 to A. */
+static inline void
+atomic_inc (atomic_t *a)
+{
+  asm volatile ("lock incl %0" : "+m" (a->value) : : "memory", "cc");
+}
+
+/* Subtracts 1 from A. */
+static inline void
+atomic_dec (atomic_t *a)
+{
+  asm volatile ("lock decl %0" : "+m" (a->value) : : "memory", "cc");
+}
+
+/* Subtracts 1 from A and returns true if that made it 0, as when
+   the last reference to an object is dropped. */
+static inline bool
+atomic_dec_and_test (atomic_t *a)
+{
+  uint8_t zero;
+
+  asm volatile ("lock decl %0; sete %1" : "+m" (a->value), "=qm" (zero)
+                : : "memory", "cc");
+  return zero;
+}
+
+/* Adds N to A and returns A's previous value. */
+static inline int32_t
+atomic_fetch_add (atomic_t *a, int32_t n)
+{
+  asm volatile ("lock xaddl %0, %1" : "+r" (n), "+m" (a->value)
+                : : "memory", "cc");
+  return n;
+}
+
+/* Sets A to V and returns A's previous value. */
+static inline int32_t
+atomic_xchg (atomic_t *a, int32_t v)
+{
+  /* XCHG with a memory operand is locked even without the
+     prefix. */
+  asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (a->value) : : "memory");
+  return v;
+}
+
+/* Sets A to NEW if it is OLD.  Returns A's previous value, which
+   is OLD if A was set. */
+static inline int32_t
+atomic_cmpxchg (atomic_t *a, int32_t old, int32_t new)
+{
+  int32_t prev;
+
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (a->value)
+                : "r" (new), "0" (old)
+                : "memory", "cc");
+  return prev;
+}
+
+/* Sets A to NEW if it is OLD.  Returns A's previous value, which
+   is OLD if A was set. */
+static inline int64_t
+atomic64_cmpxchg (atomic64_t *a, int64_t old, int64_t new)
+{
+  int64_t prev;
+
+  asm volatile ("lock cmpxchg8b %1"
+                : "=A" (prev), "+m" (a->value)
+                : "b" ((uint32_t) new), "c" ((uint32_t) (new >> 32)),
+                  "0" (old)
+                : "memory", "cc");
+  return prev;
+}
+
+/* Returns the value of A, read in one piece. */
+static inline int64_t
+atomic64_read (const atomic64_t *a)
+{
+  /* Whatever A holds, setting it to itself leaves it unchanged
+     and returns it. */
+  return atomic64_cmpxchg ((atomic64_t *) a, 0, 0);
+}
+
+/* Sets A to V. */
+static inline void
+atomic64_set (atomic64_t *a, int64_t v)
+{
+  int64_t old = a->value;
+  int64_t prev;
+
+  while ((prev = atomic64_cmpxchg (a, old, v)) != old)
+    old = prev;
+}
+
+/* Adds N to A and returns A's previous value. */
+static inline int64_t
+atomic64_fetch_add (atomic64_t *a, int64_t n)
+{
+  int64_t old = a->value;
+  int64_t prev;
+
+  while ((prev = atomic64_cmpxchg (a, old, old + n)) != old)
+    old = prev;
+  return old;
+}
+
+/* Adds N to A. */
+static inline void
+atomic64_add (atomic64_t *a, int64_t n)
+{
+  atomic64_fetch_add (a, n);
+}
+
+/* Adds 1 to A. */
+static inline void
+atomic64_inc (atomic64_t *a)
+{
+  atomic64_fetch_add (a, 1);
+}
+
+#endif /* lib/kernel/atomic.h */
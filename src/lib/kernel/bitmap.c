@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +24,20 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A second, smaller array summarizes the first: bit I of FULL is
+   set if and only if element I of BITS has every bit set.  Scans
+   for unset bits, the common case of allocation, use it to skip
+   ELEM_BITS full elements, or ELEM_BITS * ELEM_BITS bits, at a
+   time.  The summary is kept up to date by every function that
+   changes an element; a bitmap must therefore only be changed
+   through these functions. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* Summary of BITS: full elements. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -60,6 +70,53 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the number of bytes required for BIT_CNT bits and
+   their summary. */
+static inline size_t
+bits_and_summary_size (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + byte_cnt (elem_cnt (bit_cnt));
+}
+
+/* Returns an elem_type with the CNT bits starting at bit OFS set,
+   where OFS + CNT <= ELEM_BITS. */
+static inline elem_type
+range_mask (size_t ofs, size_t cnt)
+{
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type) 1 << cnt) - 1 : (elem_type) -1;
+  return mask << ofs;
+}
+
+/* Returns the index of the least significant set bit in X, which
+   must be nonzero. */
+static inline unsigned
+first_set (elem_type x)
+{
+  unsigned idx;
+  asm ("bsfl %1, %0" : "=r" (idx) : "rm" (x) : "cc");
+  return idx;
+}
+
+/* Returns the number of set bits in X. */
+static inline unsigned
+count_set (elem_type x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
+
+/* Brings the summary bit of element IDX in B up to date. */
+static inline void
+update_full (struct bitmap *b, size_t idx)
+{
+  if (b->bits[idx] == (elem_type) -1)
+    b->full[elem_idx (idx)] |= bit_mask (idx);
+  else
+    b->full[elem_idx (idx)] &= ~bit_mask (idx);
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -82,9 +139,11 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (bits_and_summary_size (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          b->full = b->bits + elem_cnt (bit_cnt);
+          memset (b->full, 0, byte_cnt (elem_cnt (bit_cnt)));
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +164,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->full = b->bits + elem_cnt (bit_cnt);
+  memset (b->full, 0, byte_cnt (elem_cnt (bit_cnt)));
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +175,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + bits_and_summary_size (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -163,6 +224,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_full (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +238,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_full (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +254,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_full (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +277,32 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, an element
+   at a time.  Each element is set atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (i = start; i < end; )
+    {
+      size_t idx = elem_idx (i);
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+      elem_type mask = range_mask (ofs, n);
+
+      if (value)
+        asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+      else
+        asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+      update_full (b, idx);
+      i += n;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,6 +310,7 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t end = start + cnt;
   size_t i, value_cnt;
 
   ASSERT (b != NULL);
@@ -239,10 +318,61 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  for (i = start; i < end; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < end - i ? ELEM_BITS - ofs : end - i;
+      value_cnt += count_set (b->bits[elem_idx (i)] & range_mask (ofs, n));
+      i += n;
+    }
+  return value ? value_cnt : cnt - value_cnt;
+}
+
+/* Returns the index of the first bit in B between START and END,
+   exclusive, that is set to VALUE, or END if there is none.
+   Looks at an element at a time, and when looking for an unset
+   bit, skips over full elements using B's summary. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  size_t idx, last;
+  elem_type e;
+
+  ASSERT (end <= b->bit_cnt);
+  if (start >= end)
+    return end;
+
+  idx = elem_idx (start);
+  last = elem_idx (end - 1);
+  e = (value ? b->bits[idx] : ~b->bits[idx]) & range_mask (start % ELEM_BITS,
+                                                           ELEM_BITS
+                                                           - start % ELEM_BITS);
+  while (e == 0)
+    {
+      if (++idx > last)
+        return end;
+      if (!value)
+        {
+          /* Skip full elements, a summary element at a time. */
+          size_t s = elem_idx (idx);
+          elem_type w = ~b->full[s] & range_mask (idx % ELEM_BITS,
+                                                  ELEM_BITS
+                                                  - idx % ELEM_BITS);
+          while (w == 0)
+            {
+              if (++s > elem_idx (last))
+                return end;
+              w = ~b->full[s];
+            }
+          idx = s * ELEM_BITS + first_set (w);
+          if (idx > last)
+            return end;
+        }
+      e = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  start = idx * ELEM_BITS + first_set (e);
+  return start < end ? start : end;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -250,16 +380,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -301,10 +426,25 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (cnt == 0)
+        return start <= last ? start : BITMAP_ERROR;
+
+      /* Jump from each run of bits set to VALUE to the next,
+         until one is long enough. */
+      while (i <= last)
+        {
+          size_t run_start = find_bit (b, i, b->bit_cnt, value);
+          size_t run_end;
+
+          if (run_start > last)
+            break;
+          run_end = find_bit (b, run_start, run_start + cnt, !value);
+          if (run_end - run_start >= cnt)
+            return run_start;
+          i = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -344,8 +484,12 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t i;
+
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+        update_full (b, i);
     }
   return success;
 }
@@ -358,6 +502,60 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Reads the part of B holding bits START through START + CNT - 1
+   from FILE, in which B is stored starting at offset OFS, as
+   bitmap_write_range() writes it.  The whole elements holding
+   those bits are read, so bits that share an element with them
+   are replaced too.  Returns true if successful, false
+   otherwise. */
+bool
+bitmap_read_range (struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt, off_t ofs)
+{
+  size_t first, last, i;
+  off_t size;
+  bool success;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  size = (last - first + 1) * sizeof (elem_type);
+  success = file_read_at (file, b->bits + first, size,
+                          ofs + first * sizeof (elem_type)) == size;
+  if (last == elem_cnt (b->bit_cnt) - 1)
+    b->bits[last] &= last_mask (b);
+  for (i = first; i <= last; i++)
+    update_full (b, i);
+  return success;
+}
+
+/* Writes the part of B holding bits START through START + CNT - 1
+   to FILE, where bitmap_write() would put it if B started at
+   offset OFS in FILE.  Return true if successful, false
+   otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt, off_t ofs)
+{
+  size_t first, last;
+  off_t size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  size = (last - first + 1) * sizeof (elem_type);
+  return file_write_at (file, b->bits + first, size,
+                        ofs + first * sizeof (elem_type)) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,14 +1,28 @@
 #include <console.h>
+#include <atomic.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 static void vprintf_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+
+/* Output of a vprintf() call, collected so that it reaches the
+   serial port and the display in bulk.  BUF holds a full 80-column
+   line, so that most calls emit their output all at once. */
+struct vprintf_buf
+  {
+    int char_cnt;               /* Characters output so far. */
+    size_t cnt;                 /* Characters in BUF. */
+    char buf[128];              /* Characters not yet output. */
+  };
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -57,7 +71,14 @@ static bool use_console_lock;
 static int console_lock_depth;
 
 /* Number of characters written to console. */
-static int64_t write_cnt;
+static atomic64_t write_cnt;
+
+/* Thread whose console output is passed to CAPTURE_FUNC, along
+   with CAPTURE_AUX, instead of being written out, or a null
+   pointer.  See console_capture(). */
+static struct thread *capture_thread;
+static console_capture_func *capture_func;
+static void *capture_aux;
 
 /* Enable console locking. */
 void
@@ -69,18 +90,54 @@ console_init (void)
 
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
-   now on. */
+   now on, and to stop any capture, so that the panic message
+   is seen. */
 void
 console_panic (void) 
 {
   use_console_lock = false;
+  capture_thread = NULL;
+}
+
+/* Makes the current thread's console output, until
+   console_capture_end(), go to FUNC (BUFFER, N, AUX) for each N
+   characters in BUFFER, instead of the display and serial port.
+   Output from interrupt handlers and other threads is not
+   affected.  Only one thread may capture its output at a time,
+   and the caller must arrange for that. */
+void
+console_capture (console_capture_func *func, void *aux)
+{
+  ASSERT (capture_thread == NULL);
+
+  capture_func = func;
+  capture_aux = aux;
+  capture_thread = thread_current ();
+}
+
+/* Ends console_capture() for the current thread. */
+void
+console_capture_end (void)
+{
+  ASSERT (capture_thread == thread_current ());
+
+  capture_thread = NULL;
+}
+
+/* Returns true if the caller's output is being captured. */
+static bool
+captured (void)
+{
+  return (capture_thread != NULL && !intr_context ()
+          && capture_thread == thread_current ());
 }
 
 /* Prints console statistics. */
 void
 console_print_stats (void) 
 {
-  printf ("Console: %lld characters output\n", write_cnt);
+  printf ("Console: %lld characters output\n",
+          atomic64_read (&write_cnt));
 }
 
 /* Acquires the console lock. */
@@ -125,13 +182,16 @@ console_locked_by_current_thread (void)
 int
 vprintf (const char *format, va_list args) 
 {
-  int char_cnt = 0;
+  struct vprintf_buf b;
 
+  b.char_cnt = 0;
+  b.cnt = 0;
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf (format, args, vprintf_helper, &b);
+  putbuf_have_lock (b.buf, b.cnt);
   release_console ();
 
-  return char_cnt;
+  return b.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -140,8 +200,7 @@ int
 puts (const char *s) 
 {
   acquire_console ();
-  while (*s != '\0')
-    putchar_have_lock (*s++);
+  putbuf_have_lock (s, strlen (s));
   putchar_have_lock ('\n');
   release_console ();
 
@@ -153,8 +212,7 @@ void
 putbuf (const char *buffer, size_t n) 
 {
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -171,11 +229,17 @@ putchar (int c)
 
 /* Helper function for vprintf(). */
 static void
-vprintf_helper (char c, void *char_cnt_) 
+vprintf_helper (char c, void *b_) 
 {
-  int *char_cnt = char_cnt_;
-  (*char_cnt)++;
-  putchar_have_lock (c);
+  struct vprintf_buf *b = b_;
+
+  b->char_cnt++;
+  b->buf[b->cnt++] = c;
+  if (b->cnt == sizeof b->buf)
+    {
+      putbuf_have_lock (b->buf, b->cnt);
+      b->cnt = 0;
+    }
 }
 
 /* Writes C to the vga display and serial port.
@@ -185,7 +249,32 @@ static void
 putchar_have_lock (uint8_t c) 
 {
   ASSERT (console_locked_by_current_thread ());
-  write_cnt++;
+  if (captured ())
+    {
+      char ch = c;
+      capture_func (&ch, 1, capture_aux);
+      return;
+    }
+  atomic64_inc (&write_cnt);
   serial_putc (c);
   vga_putc (c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, in bulk.  The caller has already acquired the
+   console lock if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n)
+{
+  ASSERT (console_locked_by_current_thread ());
+  if (n == 0)
+    return;
+  if (captured ())
+    {
+      capture_func (buffer, n, capture_aux);
+      return;
+    }
+  atomic64_add (&write_cnt, n);
+  serial_write (buffer, n);
+  vga_write (buffer, n);
+}
@@ -1,8 +1,17 @@
 #ifndef __LIB_KERNEL_CONSOLE_H
 #define __LIB_KERNEL_CONSOLE_H
 
+#include <stddef.h>
+
+/* Receives N characters of captured console output in BUFFER.
+   See console_capture(). */
+typedef void console_capture_func (const char *buffer, size_t n,
+                                   void *aux);
+
 void console_init (void);
 void console_panic (void);
+void console_capture (console_capture_func *, void *aux);
+void console_capture_end (void);
 void console_print_stats (void);
 
 #endif /* lib/kernel/console.h */
@@ -0,0 +1,119 @@
+#include "crc32c.h"
+#include "../debug.h"
+
+/* CRC-32C polynomial 0x1edc6f41, bit-reversed, since bits are
+   processed least significant first. */
+#define CRC32C_POLY 0x82f63b78
+
+/* TABLES[0][B] is the CRC of byte B.  TABLES[K][B] is the CRC of
+   byte B followed by K zero bytes, so that each of 8 bytes can be
+   looked up independently of the others. */
+static uint32_t tables[8][256];
+
+/* True once crc32c_init() has run, and if the CPU has the
+   "crc32" instruction. */
+static bool initialized;
+static bool use_hw;
+
+/* Builds the lookup tables and checks whether the CPU has the
+   "crc32" instruction, which it reports in CPUID.01H:ECX bit 20,
+   "SSE4.2".  Must be called before any other function here. */
+void
+crc32c_init (void)
+{
+  uint32_t max_leaf, a, b, c, d;
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    {
+      uint32_t crc = i;
+
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+      tables[0][i] = crc;
+    }
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      {
+        uint32_t crc = tables[k - 1][i];
+        tables[k][i] = (crc >> 8) ^ tables[0][crc & 0xff];
+      }
+
+  asm ("cpuid" : "=a" (max_leaf), "=b" (b), "=c" (c), "=d" (d) : "0" (0));
+  if (max_leaf >= 1)
+    {
+      asm ("cpuid" : "=a" (a), "=b" (b), "=c" (c), "=d" (d) : "0" (1));
+      use_hw = (c & (1u << 20)) != 0;
+    }
+  initialized = true;
+}
+
+/* Returns true if crc32c() uses the "crc32" instruction. */
+bool
+crc32c_hw_enabled (void)
+{
+  return use_hw;
+}
+
+/* Computes the CRC of the SIZE bytes in BUF with the "crc32"
+   instruction, continuing from CRC, which is already
+   inverted. */
+static uint32_t
+crc32c_hw (uint32_t crc, const uint8_t *buf, size_t size)
+{
+  for (; size > 0 && ((uintptr_t) buf & 3) != 0; size--)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*buf++));
+  for (; size >= 4; size -= 4, buf += 4)
+    asm ("crc32l %1, %0" : "+r" (crc) : "rm" (*(const uint32_t *) buf));
+  for (; size > 0; size--)
+    asm ("crc32b %1, %0" : "+r" (crc) : "rm" (*buf++));
+  return crc;
+}
+
+/* Computes the CRC of the SIZE bytes in BUF with the lookup
+   tables, continuing from CRC, which is already inverted. */
+static uint32_t
+crc32c_tables (uint32_t crc, const uint8_t *buf, size_t size)
+{
+  for (; size > 0 && ((uintptr_t) buf & 3) != 0; size--)
+    crc = (crc >> 8) ^ tables[0][(crc ^ *buf++) & 0xff];
+  for (; size >= 8; size -= 8, buf += 8)
+    {
+      uint32_t lo = ((const uint32_t *) buf)[0] ^ crc;
+      uint32_t hi = ((const uint32_t *) buf)[1];
+
+      crc = (tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff]
+             ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+             ^ tables[3][hi & 0xff] ^ tables[2][(hi >> 8) & 0xff]
+             ^ tables[1][(hi >> 16) & 0xff] ^ tables[0][hi >> 24]);
+    }
+  for (; size > 0; size--)
+    crc = (crc >> 8) ^ tables[0][(crc ^ *buf++) & 0xff];
+  return crc;
+}
+
+/* Returns the CRC of the SIZE bytes in BUF, continuing from CRC,
+   the CRC of the data that precedes BUF, or 0 if there is
+   none. */
+uint32_t
+crc32c (uint32_t crc, const void *buf, size_t size)
+{
+  ASSERT (initialized);
+  ASSERT (buf != NULL || size == 0);
+
+  if (use_hw)
+    return ~crc32c_hw (~crc, buf, size);
+  else
+    return ~crc32c_tables (~crc, buf, size);
+}
+
+/* Returns the same as crc32c(), but never uses the "crc32"
+   instruction.  For comparing the two. */
+uint32_t
+crc32c_sw (uint32_t crc, const void *buf, size_t size)
+{
+  ASSERT (initialized);
+  ASSERT (buf != NULL || size == 0);
+
+  return ~crc32c_tables (~crc, buf, size);
+}
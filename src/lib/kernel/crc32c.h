@@ -0,0 +1,30 @@
+#ifndef __LIB_KERNEL_CRC32C_H
+#define __LIB_KERNEL_CRC32C_H
+
+/* CRC-32C (Castagnoli) checksums.
+
+   Used to catch corruption of data that the kernel writes to
+   disk and reads back later, such as journal transactions and,
+   optionally, swapped out pages.  The CRC of a buffer is
+   obtained by passing 0 as CRC; passing the CRC of one buffer
+   when computing that of the next yields the CRC of the two
+   concatenated, so that data need not be contiguous:
+
+     crc = crc32c (0, a, a_size);
+     crc = crc32c (crc, b, b_size);
+
+   crc32c() uses the SSE4.2 "crc32" instruction on CPUs that
+   have it, and otherwise a table-driven loop that handles 8
+   bytes per step ("slicing by 8").  Both give the same
+   results. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void crc32c_init (void);
+bool crc32c_hw_enabled (void);
+uint32_t crc32c (uint32_t crc, const void *, size_t);
+uint32_t crc32c_sw (uint32_t crc, const void *, size_t);
+
+#endif /* lib/kernel/crc32c.h */
@@ -428,3 +428,465 @@ remove_elem (struct hash *h, struct hash_elem *e)
   list_remove (&e->list_elem);
 }
 
+
+/* Open-addressing hash table.  See hash.h for basic information. */
+
+/* Smallest number of slots in an open-addressing table. */
+#define OHASH_MIN_SLOTS 8
+
+/* Number of old slots an incremental table moves per insertion
+   or deletion.  Growth starts with the table 3/8 full, so moving
+   4 slots per insertion empties the old array before the new one
+   is half full. */
+#define OHASH_MOVE_SLOTS 4
+
+static struct ohash_slot *ohash_lookup (struct ohash *, struct ohash_elem *,
+                                        unsigned hash);
+static struct ohash_slot *ohash_search (struct ohash *,
+                                        struct ohash_slot *, size_t slot_cnt,
+                                        struct ohash_elem *, unsigned hash);
+static void ohash_place (struct ohash_slot *, size_t slot_cnt,
+                         unsigned hash, struct ohash_elem *);
+static void ohash_remove (struct ohash_slot *, size_t slot_cnt, size_t idx);
+static void ohash_move (struct ohash *, size_t cnt);
+static bool ohash_resize (struct ohash *, size_t slot_cnt);
+static void ohash_reserve (struct ohash *);
+
+/* Returns true if slot S is in H's old array. */
+static inline bool
+in_old_slots (const struct ohash *h, const struct ohash_slot *s)
+{
+  return (h->old_slots != NULL
+          && s >= h->old_slots && s < h->old_slots + h->old_slot_cnt);
+}
+
+/* Initializes open-addressing hash table H to compute hash
+   values using HASH and compare hash elements using LESS, given
+   auxiliary data AUX.  Returns false if memory is short. */
+bool
+ohash_init (struct ohash *h,
+            ohash_hash_func *hash, ohash_less_func *less, void *aux) 
+{
+  h->elem_cnt = 0;
+  h->slot_cnt = OHASH_MIN_SLOTS;
+  h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+  h->incremental = false;
+  h->old_slots = NULL;
+  h->old_slot_cnt = 0;
+  h->old_elem_cnt = 0;
+  h->old_idx = 0;
+  return h->slots != NULL;
+}
+
+/* Removes all the elements from H, calling DESTRUCTOR, if it is
+   non-null, for each of them.  The same restrictions apply as
+   for hash_clear(). */
+void
+ohash_clear (struct ohash *h, ohash_action_func *destructor) 
+{
+  size_t i;
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      {
+        struct ohash_elem *e = h->slots[i].elem;
+        h->slots[i].elem = NULL;
+        if (destructor != NULL)
+          destructor (e, h->aux);
+      }
+  if (h->old_slots != NULL)
+    {
+      for (i = 0; i < h->old_slot_cnt; i++)
+        if (h->old_slots[i].elem != NULL && destructor != NULL)
+          destructor (h->old_slots[i].elem, h->aux);
+      free (h->old_slots);
+      h->old_slots = NULL;
+      h->old_elem_cnt = 0;
+    }
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H, first calling DESTRUCTOR, if it is
+   non-null, for each element.  The same restrictions apply as
+   for hash_destroy(). */
+void
+ohash_destroy (struct ohash *h, ohash_action_func *destructor) 
+{
+  if (destructor != NULL)
+    ohash_clear (h, destructor);
+  free (h->old_slots);
+  free (h->slots);
+}
+
+/* Makes H grow incrementally if INCREMENTAL is true, or all at
+   once if it is false.  In the latter case, any growth in
+   progress is finished first. */
+void
+ohash_set_incremental (struct ohash *h, bool incremental) 
+{
+  h->incremental = incremental;
+  if (!incremental)
+    ohash_move (h, SIZE_MAX);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW. */   
+struct ohash_elem *
+ohash_insert (struct ohash *h, struct ohash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *s = ohash_lookup (h, new, hash);
+
+  if (s != NULL)
+    return s->elem;
+
+  ohash_reserve (h);
+  ohash_place (h->slots, h->slot_cnt, hash, new);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned. */
+struct ohash_elem *
+ohash_replace (struct ohash *h, struct ohash_elem *new) 
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *s = ohash_lookup (h, new, hash);
+  struct ohash_elem *old;
+
+  if (s != NULL)
+    {
+      old = s->elem;
+      s->elem = new;
+      return old;
+    }
+
+  ohash_reserve (h);
+  ohash_place (h->slots, h->slot_cnt, hash, new);
+  h->elem_cnt++;
+  return NULL;
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct ohash_elem *
+ohash_find (struct ohash *h, struct ohash_elem *e) 
+{
+  struct ohash_slot *s = ohash_lookup (h, e, h->hash (e, h->aux));
+  return s != NULL ? s->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.  As for hash_delete(), deallocating the element
+   is the caller's responsibility. */
+struct ohash_elem *
+ohash_delete (struct ohash *h, struct ohash_elem *e)
+{
+  struct ohash_slot *s = ohash_lookup (h, e, h->hash (e, h->aux));
+  struct ohash_elem *found;
+
+  if (s == NULL)
+    return NULL;
+
+  found = s->elem;
+  if (in_old_slots (h, s))
+    {
+      ohash_remove (h->old_slots, h->old_slot_cnt, s - h->old_slots);
+      h->old_elem_cnt--;
+    }
+  else
+    ohash_remove (h->slots, h->slot_cnt, s - h->slots);
+  h->elem_cnt--;
+
+  /* Don't shrink while still growing; a later deletion will. */
+  if (h->old_slots != NULL)
+    ohash_move (h, OHASH_MOVE_SLOTS);
+  else if (h->slot_cnt > OHASH_MIN_SLOTS && h->elem_cnt * 8 < h->slot_cnt)
+    ohash_resize (h, h->slot_cnt / 2);
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.  The same restrictions apply as for hash_apply(). */
+void
+ohash_apply (struct ohash *h, ohash_action_func *action) 
+{
+  size_t i;
+  
+  ASSERT (action != NULL);
+
+  for (i = 0; i < h->slot_cnt; i++)
+    if (h->slots[i].elem != NULL)
+      action (h->slots[i].elem, h->aux);
+  if (h->old_slots != NULL)
+    for (i = 0; i < h->old_slot_cnt; i++)
+      if (h->old_slots[i].elem != NULL)
+        action (h->old_slots[i].elem, h->aux);
+}
+
+/* Initializes I for iterating hash table H, with the same idiom
+   as hash_first().  Modifying H during iteration invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h) 
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->idx = SIZE_MAX;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order. */
+struct ohash_elem *
+ohash_next (struct ohash_iterator *i)
+{
+  struct ohash *h;
+  size_t end;
+
+  ASSERT (i != NULL);
+
+  h = i->hash;
+  end = h->slot_cnt + (h->old_slots != NULL ? h->old_slot_cnt : 0);
+  for (i->idx++; i->idx < end; i->idx++)
+    {
+      struct ohash_slot *s = (i->idx < h->slot_cnt
+                              ? &h->slots[i->idx]
+                              : &h->old_slots[i->idx - h->slot_cnt]);
+      if (s->elem != NULL)
+        return i->elem = s->elem;
+    }
+
+  i->idx = end;
+  return i->elem = NULL;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct ohash_elem *
+ohash_cur (struct ohash_iterator *i) 
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h) 
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h) 
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns how far slot IDX, holding an element with hash value
+   HASH, is from the element's home slot, in a table of SLOT_CNT
+   slots. */
+static inline size_t
+probe_distance (size_t idx, unsigned hash, size_t slot_cnt)
+{
+  return (idx - (hash & (slot_cnt - 1))) & (slot_cnt - 1);
+}
+
+/* Returns the slot in H holding an element equal to E, whose
+   hash value is HASH, or a null pointer if there is none.  While
+   H is growing, the element may still be in the old array. */
+static struct ohash_slot *
+ohash_lookup (struct ohash *h, struct ohash_elem *e, unsigned hash)
+{
+  struct ohash_slot *s = ohash_search (h, h->slots, h->slot_cnt, e, hash);
+
+  if (s == NULL && h->old_slots != NULL)
+    s = ohash_search (h, h->old_slots, h->old_slot_cnt, e, hash);
+  return s;
+}
+
+/* Returns the slot in SLOTS, one of H's arrays of SLOT_CNT
+   slots, holding an element equal to E, whose hash value is
+   HASH, or a null pointer if there is none.  The search stops at
+   an empty slot or at one whose element is closer to its home
+   than E would be, since Robin Hood insertion would have put E
+   there. */
+static struct ohash_slot *
+ohash_search (struct ohash *h, struct ohash_slot *slots, size_t slot_cnt,
+              struct ohash_elem *e, unsigned hash)
+{
+  size_t mask = slot_cnt - 1;
+  size_t idx = hash & mask;
+  size_t dist;
+
+  for (dist = 0; ; dist++, idx = (idx + 1) & mask)
+    {
+      struct ohash_slot *s = &slots[idx];
+
+      if (s->elem == NULL || probe_distance (idx, s->hash, slot_cnt) < dist)
+        return NULL;
+      if (s->hash == hash
+          && !h->less (s->elem, e, h->aux) && !h->less (e, s->elem, h->aux))
+        return s;
+    }
+}
+
+/* Puts element E, whose hash value is HASH and which must not be
+   present, into SLOTS, an array of SLOT_CNT slots with at least
+   one empty slot.  Each element that E, or an element displaced
+   by it, passes while farther from home takes over the slot of
+   an element closer to home, which moves on in its place. */
+static void
+ohash_place (struct ohash_slot *slots, size_t slot_cnt,
+             unsigned hash, struct ohash_elem *e)
+{
+  size_t mask = slot_cnt - 1;
+  size_t idx = hash & mask;
+  size_t dist = 0;
+
+  for (;;)
+    {
+      struct ohash_slot *s = &slots[idx];
+      size_t s_dist;
+
+      if (s->elem == NULL)
+        {
+          s->hash = hash;
+          s->elem = e;
+          return;
+        }
+
+      s_dist = probe_distance (idx, s->hash, slot_cnt);
+      if (s_dist < dist)
+        {
+          struct ohash_slot displaced = *s;
+          s->hash = hash;
+          s->elem = e;
+          hash = displaced.hash;
+          e = displaced.elem;
+          dist = s_dist;
+        }
+      idx = (idx + 1) & mask;
+      dist++;
+    }
+}
+
+/* Empties slot IDX of SLOTS, an array of SLOT_CNT slots,
+   shifting each element after it that is not in its home slot
+   back by one. */
+static void
+ohash_remove (struct ohash_slot *slots, size_t slot_cnt, size_t idx)
+{
+  size_t mask = slot_cnt - 1;
+
+  for (;;)
+    {
+      size_t next = (idx + 1) & mask;
+      struct ohash_slot *s = &slots[next];
+
+      if (s->elem == NULL || probe_distance (next, s->hash, slot_cnt) == 0)
+        break;
+      slots[idx] = *s;
+      idx = next;
+    }
+  slots[idx].elem = NULL;
+}
+
+/* Moves the elements in up to CNT slots of H's old array, taken
+   in order, into its new array, freeing the old array once it is
+   empty.  Removing each element shifts back those after it that
+   belong earlier, so emptying a slot for good empties all the
+   slots before it too, and an element left in the old array can
+   still be found there by the usual search. */
+static void
+ohash_move (struct ohash *h, size_t cnt) 
+{
+  while (cnt-- > 0 && h->old_slots != NULL)
+    {
+      struct ohash_slot *s;
+
+      if (h->old_elem_cnt > 0)
+        {
+          ASSERT (h->old_idx < h->old_slot_cnt);
+          s = &h->old_slots[h->old_idx++];
+          while (s->elem != NULL)
+            {
+              ohash_place (h->slots, h->slot_cnt, s->hash, s->elem);
+              ohash_remove (h->old_slots, h->old_slot_cnt, s - h->old_slots);
+              h->old_elem_cnt--;
+            }
+        }
+      if (h->old_elem_cnt == 0) 
+        {
+          free (h->old_slots);
+          h->old_slots = NULL;
+        }
+    }
+}
+
+/* Moves the elements of H into a new array of SLOT_CNT slots,
+   which must be a power of 2 with room for all of them.  If H is
+   incremental and growing, the elements are left in the old
+   array for ohash_move() to move later.  Returns false, leaving
+   H unchanged, if memory is short. */
+static bool
+ohash_resize (struct ohash *h, size_t slot_cnt) 
+{
+  struct ohash_slot *slots;
+  size_t i;
+
+  ASSERT (is_power_of_2 (slot_cnt));
+  ASSERT (slot_cnt > h->elem_cnt);
+  ASSERT (h->old_slots == NULL);
+
+  slots = calloc (slot_cnt, sizeof *slots);
+  if (slots == NULL)
+    return false;
+
+  if (h->incremental && slot_cnt > h->slot_cnt)
+    {
+      h->old_slots = h->slots;
+      h->old_slot_cnt = h->slot_cnt;
+      h->old_elem_cnt = h->elem_cnt;
+      h->old_idx = 0;
+    }
+  else
+    {
+      for (i = 0; i < h->slot_cnt; i++)
+        if (h->slots[i].elem != NULL)
+          ohash_place (slots, slot_cnt, h->slots[i].hash, h->slots[i].elem);
+      free (h->slots);
+    }
+  h->slots = slots;
+  h->slot_cnt = slot_cnt;
+  return true;
+}
+
+/* Makes room in H's new array for one more element, growing it
+   if the table would become more than 3/4 full, after first
+   moving a few slots of any growth in progress.  Growing again
+   finishes that growth.  If memory is short, the table just gets
+   fuller, but it must always keep one empty slot. */
+static void
+ohash_reserve (struct ohash *h) 
+{
+  ohash_move (h, OHASH_MOVE_SLOTS);
+  if ((h->elem_cnt + 1) * 4 > h->slot_cnt * 3)
+    {
+      ohash_move (h, SIZE_MAX);
+      if (!ohash_resize (h, h->slot_cnt * 2)
+          && h->elem_cnt + 2 > h->slot_cnt)
+        PANIC ("out of memory growing hash table");
+    }
+}
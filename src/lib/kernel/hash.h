@@ -100,4 +100,111 @@ unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
 
+/* Open-addressing hash table.
+
+   An alternative to the chained table above with the same
+   intrusive interface, for tables searched much more often than
+   they change.  Rather than an array of lists, the table is a
+   single flat array of slots, each holding an element's hash
+   value and a pointer to the element.  Collisions are resolved
+   by Robin Hood linear probing: an element being inserted takes
+   the slot of any element that is closer to its home slot, which
+   keeps probe sequences short and lets a search for an absent
+   element stop early.  Deletion shifts the following elements
+   back, so the table never holds tombstones.
+
+   A search thus reads consecutive slots of one array and
+   touches an element only when its hash value matches, instead
+   of following a list through every element in a bucket.
+
+   Growing the table normally moves every element into the new
+   array at once, so the insertion that triggers it takes time
+   proportional to the table's size.  A table made incremental
+   with ohash_set_incremental() instead keeps the old array
+   beside the new one and moves a few of its slots on each later
+   insertion or deletion, so that no single operation is slow.
+   Until the move is done, searches look in both arrays. */
+
+/* Open-addressing hash element.  The table keeps only pointers
+   to its elements, so an element needs no links; this member
+   lets ohash_entry find the structure an element is embedded in,
+   the same way as hash_entry. */
+struct ohash_elem 
+  {
+    uint8_t unused;
+  };
+
+/* Converts pointer to open-addressing hash element OHASH_ELEM
+   into a pointer to the structure that OHASH_ELEM is embedded
+   inside.  Supply the name of the outer structure STRUCT and
+   the member name MEMBER of the hash element. */
+#define ohash_entry(OHASH_ELEM, STRUCT, MEMBER)                 \
+        ((STRUCT *) ((uint8_t *) (OHASH_ELEM)                   \
+                     - offsetof (STRUCT, MEMBER)))
+
+/* Hash, comparison, and action functions, as for the chained
+   table above. */
+typedef unsigned ohash_hash_func (const struct ohash_elem *e, void *aux);
+typedef bool ohash_less_func (const struct ohash_elem *a,
+                              const struct ohash_elem *b,
+                              void *aux);
+typedef void ohash_action_func (struct ohash_elem *e, void *aux);
+
+/* A slot in an open-addressing hash table. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    struct ohash_elem *elem;    /* Element, or a null pointer. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash 
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+    ohash_hash_func *hash;      /* Hash function. */
+    ohash_less_func *less;      /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+
+    /* Incremental growth. */
+    bool incremental;           /* Grow a few slots at a time? */
+    struct ohash_slot *old_slots; /* Array being emptied, or null. */
+    size_t old_slot_cnt;        /* Number of slots in `old_slots'. */
+    size_t old_elem_cnt;        /* Elements left in `old_slots'. */
+    size_t old_idx;             /* Next slot of `old_slots' to move. */
+  };
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator 
+  {
+    struct ohash *hash;         /* The hash table. */
+    size_t idx;                 /* Index of current slot, counting
+                                   `slots' then `old_slots'. */
+    struct ohash_elem *elem;    /* Current element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, ohash_hash_func *, ohash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, ohash_action_func *);
+void ohash_destroy (struct ohash *, ohash_action_func *);
+void ohash_set_incremental (struct ohash *, bool);
+
+/* Search, insertion, deletion. */
+struct ohash_elem *ohash_insert (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_replace (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_find (struct ohash *, struct ohash_elem *);
+struct ohash_elem *ohash_delete (struct ohash *, struct ohash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, ohash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct ohash_elem *ohash_next (struct ohash_iterator *);
+struct ohash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
 #endif /* lib/kernel/hash.h */
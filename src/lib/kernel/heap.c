@@ -0,0 +1,230 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Binary heap.  See heap.h for basic information.
+
+   Numbering the elements of the complete tree 1 through
+   ELEM_CNT in breadth-first order, as an array heap would store
+   them, element K has children 2K and 2K + 1.  So the bits of K
+   below its most significant 1 bit spell out the path to it from
+   the root, 0 for left and 1 for right, most significant first.
+   The last element, which insertion adds and removal takes
+   away, is found this way in O(log n) steps.
+
+   Moving an element up or down swaps it with its parent or
+   child by relinking the two, since elements cannot be copied. */
+
+static struct heap_elem **find_link (struct heap *, size_t k,
+                                     struct heap_elem **parent);
+static void swap_with_parent (struct heap *, struct heap_elem *);
+static void sift_up (struct heap *, struct heap_elem *);
+static void sift_down (struct heap *, struct heap_elem *);
+
+/* Initializes H as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *h, heap_less_func *less, void *aux)
+{
+  ASSERT (h != NULL);
+  ASSERT (less != NULL);
+
+  h->root = NULL;
+  h->elem_cnt = 0;
+  h->less = less;
+  h->aux = aux;
+}
+
+/* Inserts E into H. */
+void
+heap_push (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *parent;
+  struct heap_elem **link;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  link = find_link (h, ++h->elem_cnt, &parent);
+  e->parent = parent;
+  e->left = e->right = NULL;
+  *link = e;
+  sift_up (h, e);
+}
+
+/* Removes and returns the greatest element of H, which must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *h)
+{
+  struct heap_elem *top = heap_top (h);
+
+  ASSERT (top != NULL);
+  heap_remove (h, top);
+  return top;
+}
+
+/* Returns the greatest element of H, or a null pointer if H is
+   empty. */
+struct heap_elem *
+heap_top (struct heap *h)
+{
+  ASSERT (h != NULL);
+
+  return h->root;
+}
+
+/* Removes E, which must be in H, from H. */
+void
+heap_remove (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *last, *parent;
+  struct heap_elem **link;
+
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+  ASSERT (h->elem_cnt > 0);
+
+  /* Unlink the last element. */
+  link = find_link (h, h->elem_cnt--, &parent);
+  last = *link;
+  *link = NULL;
+  if (last == e)
+    return;
+
+  /* Put it in E's place, then move it to where it belongs. */
+  last->parent = e->parent;
+  last->left = e->left;
+  last->right = e->right;
+  if (e->parent == NULL)
+    h->root = last;
+  else if (e->parent->left == e)
+    e->parent->left = last;
+  else
+    e->parent->right = last;
+  if (last->left != NULL)
+    last->left->parent = last;
+  if (last->right != NULL)
+    last->right->parent = last;
+  heap_update (h, last);
+}
+
+/* Moves E, which must be in H, to its proper place in H after
+   its key has changed in either direction. */
+void
+heap_update (struct heap *h, struct heap_elem *e)
+{
+  ASSERT (h != NULL);
+  ASSERT (e != NULL);
+
+  if (e->parent != NULL && h->less (e->parent, e, h->aux))
+    sift_up (h, e);
+  else
+    sift_down (h, e);
+}
+
+/* Returns the number of elements in H. */
+size_t
+heap_size (struct heap *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H is empty, false otherwise. */
+bool
+heap_empty (struct heap *h)
+{
+  return h->root == NULL;
+}
+
+/* Returns the link in H that points, or would point, to element
+   number K, which must be between 1 and H's element count, and
+   stores its parent, or a null pointer for the root, in
+   *PARENT. */
+static struct heap_elem **
+find_link (struct heap *h, size_t k, struct heap_elem **parent)
+{
+  struct heap_elem **link = &h->root;
+  int bit;
+
+  ASSERT (k >= 1);
+
+  for (bit = 0; (k >> bit) > 1; bit++)
+    continue;
+
+  *parent = NULL;
+  while (bit-- > 0)
+    {
+      *parent = *link;
+      link = (k >> bit) & 1 ? &(*parent)->right : &(*parent)->left;
+    }
+  return link;
+}
+
+/* Exchanges E, which must have a parent, with its parent in H. */
+static void
+swap_with_parent (struct heap *h, struct heap_elem *e)
+{
+  struct heap_elem *p = e->parent;
+  struct heap_elem *g = p->parent;
+  struct heap_elem *left = e->left, *right = e->right;
+
+  /* E takes P's place under G. */
+  if (g == NULL)
+    h->root = e;
+  else if (g->left == p)
+    g->left = e;
+  else
+    g->right = e;
+  e->parent = g;
+
+  /* P becomes E's child, on the side E was on. */
+  if (p->left == e)
+    {
+      e->left = p;
+      e->right = p->right;
+      if (e->right != NULL)
+        e->right->parent = e;
+    }
+  else
+    {
+      e->right = p;
+      e->left = p->left;
+      if (e->left != NULL)
+        e->left->parent = e;
+    }
+  p->parent = e;
+
+  /* P takes over E's old children. */
+  p->left = left;
+  if (left != NULL)
+    left->parent = p;
+  p->right = right;
+  if (right != NULL)
+    right->parent = p;
+}
+
+/* Moves E up H while it is greater than its parent. */
+static void
+sift_up (struct heap *h, struct heap_elem *e)
+{
+  while (e->parent != NULL && h->less (e->parent, e, h->aux))
+    swap_with_parent (h, e);
+}
+
+/* Moves E down H while one of its children is greater than it. */
+static void
+sift_down (struct heap *h, struct heap_elem *e)
+{
+  for (;;)
+    {
+      struct heap_elem *c = e->left;
+
+      if (c == NULL)
+        break;
+      if (e->right != NULL && h->less (c, e->right, h->aux))
+        c = e->right;
+      if (!h->less (e, c, h->aux))
+        break;
+      swap_with_parent (h, c);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Binary heap.
+
+   A priority queue whose greatest element, by the LESS function
+   given to heap_init(), is found in O(1) time and is removed, or
+   any element inserted, removed, or moved after its key changes,
+   in O(log n) time, where a list needs a linear scan such as
+   list_max() for each.
+
+   Like a list, the heap does not use dynamic allocation: its
+   elements are linked together as a complete binary tree, not
+   kept in an array, so that pushing an element cannot fail, even
+   with interrupts off.  Each structure that can be in a heap
+   must embed a struct heap_elem member, and the heap_entry macro
+   converts a struct heap_elem back to the structure that
+   contains it, in the same way as list_entry.  Refer to
+   lib/kernel/list.h for a detailed explanation.
+
+   A heap does not keep equal elements in any particular order.
+   Callers that need first-in, first-out order among equal
+   elements should break ties in LESS, for example with a
+   sequence number. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *parent;           /* Parent, or null at the top. */
+    struct heap_elem *left;             /* Left child, or null. */
+    struct heap_elem *right;            /* Right child, or null. */
+  };
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Binary heap. */
+struct heap
+  {
+    struct heap_elem *root;             /* Greatest element, or null. */
+    size_t elem_cnt;                    /* Number of elements. */
+    heap_less_func *less;               /* Comparison function. */
+    void *aux;                          /* Auxiliary data for `less'. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->parent           \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+struct heap_elem *heap_top (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+size_t heap_size (struct heap *);
+bool heap_empty (struct heap *);
+
+#endif /* lib/kernel/heap.h */
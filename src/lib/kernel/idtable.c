@@ -0,0 +1,126 @@
+#include "idtable.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Number of slots in a table on its first insertion. */
+#define IDTABLE_MIN 16
+
+/* Initializes T as an empty table whose ids start at BASE. */
+void
+idtable_init (struct idtable *t, int base)
+{
+  ASSERT (t != NULL);
+  ASSERT (base >= 0);
+
+  t->slots = NULL;
+  t->base = base;
+  t->cnt = 0;
+  t->low = 0;
+}
+
+/* Destroys T, first calling DESTRUCTOR, if non-null, for each
+   pointer in T in order of id, in a single walk.  DESTRUCTOR may
+   remove its own id from T, but no other.  T is left empty and
+   may be reused. */
+void
+idtable_destroy (struct idtable *t, idtable_action_func *destructor)
+{
+  int idx;
+
+  if (destructor != NULL)
+    for (idx = 0; idx < t->cnt; idx++)
+      if (t->slots[idx] != NULL)
+        destructor (t->slots[idx], t->base + idx);
+  free (t->slots);
+  idtable_init (t, t->base);
+}
+
+/* Fills DST, which must be empty, with the copies that COPY
+   makes of the pointers in SRC, each under the same id as in
+   SRC.  Returns false if memory cannot be allocated or COPY
+   fails, in which case DST holds the copies made so far. */
+bool
+idtable_copy (struct idtable *dst, const struct idtable *src,
+              idtable_copy_func *copy)
+{
+  int idx;
+
+  ASSERT (dst->slots == NULL);
+
+  if (src->cnt == 0)
+    return true;
+  dst->slots = calloc (src->cnt, sizeof *dst->slots);
+  if (dst->slots == NULL)
+    return false;
+  dst->base = src->base;
+  dst->cnt = src->cnt;
+
+  for (idx = 0; idx < src->cnt; idx++)
+    if (src->slots[idx] != NULL)
+      {
+        dst->slots[idx] = copy (src->slots[idx], src->base + idx);
+        if (dst->slots[idx] == NULL)
+          return false;
+      }
+  dst->low = src->low;
+  return true;
+}
+
+/* Inserts non-null pointer P into T under the lowest free id,
+   which is returned.  Returns -1 if T must grow and memory
+   cannot be allocated. */
+int
+idtable_insert (struct idtable *t, void *p)
+{
+  int idx;
+
+  ASSERT (p != NULL);
+
+  for (idx = t->low; idx < t->cnt; idx++)
+    if (t->slots[idx] == NULL)
+      break;
+
+  if (idx == t->cnt)
+    {
+      size_t cnt = t->cnt;
+      void **slots = array_grow (t->slots, &cnt,
+                                 t->cnt > 0 ? t->cnt + 1 : IDTABLE_MIN,
+                                 sizeof *slots);
+      if (slots == NULL)
+        return -1;
+      memset (slots + t->cnt, 0, (cnt - t->cnt) * sizeof *slots);
+      t->slots = slots;
+      t->cnt = cnt;
+    }
+
+  t->slots[idx] = p;
+  t->low = idx + 1;
+  return t->base + idx;
+}
+
+/* Returns the pointer stored under ID in T, or a null pointer if
+   ID is not in use. */
+void *
+idtable_lookup (const struct idtable *t, int id)
+{
+  int idx = id - t->base;
+  return idx >= 0 && idx < t->cnt ? t->slots[idx] : NULL;
+}
+
+/* Removes ID from T and returns the pointer stored under it, or
+   returns a null pointer if ID is not in use. */
+void *
+idtable_remove (struct idtable *t, int id)
+{
+  void *p = idtable_lookup (t, id);
+
+  if (p != NULL)
+    {
+      int idx = id - t->base;
+      t->slots[idx] = NULL;
+      if (idx < t->low)
+        t->low = idx;
+    }
+  return p;
+}
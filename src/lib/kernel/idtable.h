@@ -0,0 +1,40 @@
+#ifndef __LIB_KERNEL_IDTABLE_H
+#define __LIB_KERNEL_IDTABLE_H
+
+/* Id table.
+
+   Maps small integer ids, such as file descriptors, to pointers.
+   The pointers are kept in a growable array indexed by id, so
+   that looking an id up takes constant time, and a new pointer
+   always receives the lowest id not in use.
+
+   An id table allocates nothing until the first insertion, so an
+   unused table costs only the struct itself. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct idtable
+  {
+    void **slots;               /* Pointers, indexed by id - BASE. */
+    int base;                   /* Lowest id. */
+    int cnt;                    /* Number of slots. */
+    int low;                    /* No free slot below this index. */
+  };
+
+/* Performs some operation on pointer P with id ID. */
+typedef void idtable_action_func (void *p, int id);
+
+/* Returns a copy of pointer P with id ID, or a null pointer on
+   failure. */
+typedef void *idtable_copy_func (void *p, int id);
+
+void idtable_init (struct idtable *, int base);
+void idtable_destroy (struct idtable *, idtable_action_func *);
+bool idtable_copy (struct idtable *, const struct idtable *,
+                   idtable_copy_func *);
+int idtable_insert (struct idtable *, void *);
+void *idtable_lookup (const struct idtable *, int id);
+void *idtable_remove (struct idtable *, int id);
+
+#endif /* lib/kernel/idtable.h */
@@ -0,0 +1,424 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.  See rbtree.h for basic information.
+
+   The tree keeps these invariants, which bound its height to
+   2 * log2 (n + 1):
+
+     1. The root is black.
+
+     2. A red element has no red child.
+
+     3. Every path from an element down to a null child passes
+        through the same number of black elements.
+
+   Null children count as black.  The algorithms are those of
+   Cormen et al., _Introduction to Algorithms_, chapter 13, with
+   null pointers instead of a sentinel leaf. */
+
+static void rotate_left (struct rbtree *, struct rbtree_elem *);
+static void rotate_right (struct rbtree *, struct rbtree_elem *);
+static void insert_fixup (struct rbtree *, struct rbtree_elem *);
+static void remove_fixup (struct rbtree *, struct rbtree_elem *,
+                          struct rbtree_elem *parent);
+
+/* Returns true if E is a non-null red element. */
+static inline bool
+is_red (const struct rbtree_elem *e)
+{
+  return e != NULL && e->red;
+}
+
+/* Makes NEW take the place of OLD as the child of PARENT in T,
+   or as T's root if PARENT is null. */
+static inline void
+replace_child (struct rbtree *t, struct rbtree_elem *parent,
+               struct rbtree_elem *old, struct rbtree_elem *new)
+{
+  if (parent == NULL)
+    t->root = new;
+  else if (parent->left == old)
+    parent->left = new;
+  else
+    parent->right = new;
+}
+
+/* Initializes T as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rbtree_init (struct rbtree *t, rbtree_less_func *less, void *aux)
+{
+  ASSERT (t != NULL);
+  ASSERT (less != NULL);
+
+  t->root = NULL;
+  t->elem_cnt = 0;
+  t->less = less;
+  t->aux = aux;
+}
+
+/* Inserts E into T, after any elements equal to it. */
+void
+rbtree_insert (struct rbtree *t, struct rbtree_elem *e)
+{
+  struct rbtree_elem *parent = NULL;
+  struct rbtree_elem **link = &t->root;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      link = t->less (e, parent, t->aux) ? &parent->left : &parent->right;
+    }
+
+  e->parent = parent;
+  e->left = e->right = NULL;
+  e->red = true;
+  *link = e;
+  t->elem_cnt++;
+  insert_fixup (t, e);
+}
+
+/* Removes E, which must be in T, from T. */
+void
+rbtree_remove (struct rbtree *t, struct rbtree_elem *e)
+{
+  struct rbtree_elem *child, *parent;
+  bool removed_red;
+
+  ASSERT (t != NULL);
+  ASSERT (e != NULL);
+  ASSERT (t->elem_cnt > 0);
+
+  if (e->left != NULL && e->right != NULL)
+    {
+      /* Replace E by its successor Y, which has no left child,
+         moving Y's right child up into Y's old place. */
+      struct rbtree_elem *y = e->right;
+      while (y->left != NULL)
+        y = y->left;
+
+      child = y->right;
+      parent = y->parent;
+      removed_red = y->red;
+      if (parent == e)
+        parent = y;
+      else
+        {
+          if (child != NULL)
+            child->parent = parent;
+          parent->left = child;
+          y->right = e->right;
+          e->right->parent = y;
+        }
+      y->left = e->left;
+      e->left->parent = y;
+      y->parent = e->parent;
+      y->red = e->red;
+      replace_child (t, e->parent, e, y);
+    }
+  else
+    {
+      child = e->left != NULL ? e->left : e->right;
+      parent = e->parent;
+      removed_red = e->red;
+      if (child != NULL)
+        child->parent = parent;
+      replace_child (t, parent, e, child);
+    }
+
+  t->elem_cnt--;
+  if (!removed_red)
+    remove_fixup (t, child, parent);
+}
+
+/* Removes and returns the smallest element of T, which must not
+   be empty.  Among equal elements, the one inserted first is
+   removed. */
+struct rbtree_elem *
+rbtree_pop_min (struct rbtree *t)
+{
+  struct rbtree_elem *e = rbtree_min (t);
+
+  ASSERT (e != NULL);
+  rbtree_remove (t, e);
+  return e;
+}
+
+/* Returns an element of T equal to KEY, or a null pointer if
+   there is none.  If several are equal to KEY, returns the one
+   inserted first. */
+struct rbtree_elem *
+rbtree_find (struct rbtree *t, const struct rbtree_elem *key)
+{
+  struct rbtree_elem *e = rbtree_lower_bound (t, key);
+
+  return e != NULL && !t->less (key, e, t->aux) ? e : NULL;
+}
+
+/* Returns the first element of T, in order, that is not less
+   than KEY, or a null pointer if there is none. */
+struct rbtree_elem *
+rbtree_lower_bound (struct rbtree *t, const struct rbtree_elem *key)
+{
+  struct rbtree_elem *e = t->root;
+  struct rbtree_elem *bound = NULL;
+
+  ASSERT (t != NULL);
+  ASSERT (key != NULL);
+
+  while (e != NULL)
+    if (t->less (e, key, t->aux))
+      e = e->right;
+    else
+      {
+        bound = e;
+        e = e->left;
+      }
+  return bound;
+}
+
+/* Returns the smallest element in T, or a null pointer if T is
+   empty. */
+struct rbtree_elem *
+rbtree_min (struct rbtree *t)
+{
+  struct rbtree_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->left != NULL)
+      e = e->left;
+  return e;
+}
+
+/* Returns the largest element in T, or a null pointer if T is
+   empty. */
+struct rbtree_elem *
+rbtree_max (struct rbtree *t)
+{
+  struct rbtree_elem *e = t->root;
+
+  if (e != NULL)
+    while (e->right != NULL)
+      e = e->right;
+  return e;
+}
+
+/* Returns the element after E in its tree, or a null pointer if
+   E is the last. */
+struct rbtree_elem *
+rbtree_next (struct rbtree_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->right != NULL)
+    {
+      e = e->right;
+      while (e->left != NULL)
+        e = e->left;
+      return e;
+    }
+  while (e->parent != NULL && e->parent->right == e)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the element before E in its tree, or a null pointer
+   if E is the first. */
+struct rbtree_elem *
+rbtree_prev (struct rbtree_elem *e)
+{
+  ASSERT (e != NULL);
+
+  if (e->left != NULL)
+    {
+      e = e->left;
+      while (e->right != NULL)
+        e = e->right;
+      return e;
+    }
+  while (e->parent != NULL && e->parent->left == e)
+    e = e->parent;
+  return e->parent;
+}
+
+/* Returns the number of elements in T. */
+size_t
+rbtree_size (struct rbtree *t)
+{
+  return t->elem_cnt;
+}
+
+/* Returns true if T is empty, false otherwise. */
+bool
+rbtree_empty (struct rbtree *t)
+{
+  return t->root == NULL;
+}
+
+/* Rotates the subtree rooted at X in T to the left, making X's
+   right child its root. */
+static void
+rotate_left (struct rbtree *t, struct rbtree_elem *x)
+{
+  struct rbtree_elem *y = x->right;
+
+  x->right = y->left;
+  if (y->left != NULL)
+    y->left->parent = x;
+  y->parent = x->parent;
+  replace_child (t, x->parent, x, y);
+  y->left = x;
+  x->parent = y;
+}
+
+/* Rotates the subtree rooted at X in T to the right, making X's
+   left child its root. */
+static void
+rotate_right (struct rbtree *t, struct rbtree_elem *x)
+{
+  struct rbtree_elem *y = x->left;
+
+  x->left = y->right;
+  if (y->right != NULL)
+    y->right->parent = x;
+  y->parent = x->parent;
+  replace_child (t, x->parent, x, y);
+  y->right = x;
+  x->parent = y;
+}
+
+/* Restores invariant 2 after red element E was inserted into T,
+   by recoloring up the tree and then rotating at most twice. */
+static void
+insert_fixup (struct rbtree *t, struct rbtree_elem *e)
+{
+  while (is_red (e->parent))
+    {
+      struct rbtree_elem *parent = e->parent;
+      struct rbtree_elem *grandparent = parent->parent;
+
+      if (parent == grandparent->left)
+        {
+          struct rbtree_elem *uncle = grandparent->right;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->right)
+            {
+              rotate_left (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_right (t, grandparent);
+        }
+      else
+        {
+          struct rbtree_elem *uncle = grandparent->left;
+          if (is_red (uncle))
+            {
+              parent->red = uncle->red = false;
+              grandparent->red = true;
+              e = grandparent;
+              continue;
+            }
+          if (e == parent->left)
+            {
+              rotate_right (t, parent);
+              e = parent;
+              parent = e->parent;
+            }
+          parent->red = false;
+          grandparent->red = true;
+          rotate_left (t, grandparent);
+        }
+    }
+  t->root->red = false;
+}
+
+/* Restores invariant 3 after a black element was removed from
+   T.  X, possibly null, is the child of PARENT that took its
+   place and is short one black element on every path. */
+static void
+remove_fixup (struct rbtree *t, struct rbtree_elem *x,
+              struct rbtree_elem *parent)
+{
+  while (x != t->root && !is_red (x))
+    {
+      if (x == parent->left)
+        {
+          struct rbtree_elem *w = parent->right;
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_left (t, parent);
+              w = parent->right;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->right))
+                {
+                  w->left->red = false;
+                  w->red = true;
+                  rotate_right (t, w);
+                  w = parent->right;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->right->red = false;
+              rotate_left (t, parent);
+              x = t->root;
+            }
+        }
+      else
+        {
+          struct rbtree_elem *w = parent->left;
+          if (w->red)
+            {
+              w->red = false;
+              parent->red = true;
+              rotate_right (t, parent);
+              w = parent->left;
+            }
+          if (!is_red (w->left) && !is_red (w->right))
+            {
+              w->red = true;
+              x = parent;
+              parent = x->parent;
+            }
+          else
+            {
+              if (!is_red (w->left))
+                {
+                  w->right->red = false;
+                  w->red = true;
+                  rotate_left (t, w);
+                  w = parent->left;
+                }
+              w->red = parent->red;
+              parent->red = false;
+              w->left->red = false;
+              rotate_right (t, parent);
+              x = t->root;
+            }
+        }
+    }
+  if (x != NULL)
+    x->red = false;
+}
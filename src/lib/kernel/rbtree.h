@@ -0,0 +1,94 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+
+   A balanced binary search tree that keeps its elements in
+   order, so that insertion, removal, and search take O(log n)
+   time and the smallest element is found in O(log n) time,
+   where a list would need a linear scan for each.
+
+   Like a list, the tree does not use dynamic allocation.  Each
+   structure that can be in a tree must embed a struct
+   rbtree_elem member, and the rbtree_entry macro converts a
+   struct rbtree_elem back to the structure that contains it, in
+   the same way as list_entry.  Refer to lib/kernel/list.h for a
+   detailed explanation.
+
+   Elements are ordered by the LESS function given to
+   rbtree_init().  Equal elements are allowed; they are kept in
+   the order they were inserted.  An element's key must not
+   change while it is in a tree: remove it, change it, and insert
+   it again.
+
+   In-order iteration idiom:
+
+      struct rbtree_elem *e;
+
+      for (e = rbtree_min (&foo_tree); e != NULL; e = rbtree_next (e))
+        {
+          struct foo *f = rbtree_entry (e, struct foo, elem);
+          ...do something with f...
+        }
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rbtree_elem
+  {
+    struct rbtree_elem *parent;         /* Parent, or null at the root. */
+    struct rbtree_elem *left;           /* Left child, or null. */
+    struct rbtree_elem *right;          /* Right child, or null. */
+    bool red;                           /* Red or black? */
+  };
+
+/* Compares the value of two tree elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool rbtree_less_func (const struct rbtree_elem *a,
+                               const struct rbtree_elem *b,
+                               void *aux);
+
+/* Red-black tree. */
+struct rbtree
+  {
+    struct rbtree_elem *root;           /* Root, or null if empty. */
+    size_t elem_cnt;                    /* Number of elements. */
+    rbtree_less_func *less;             /* Comparison function. */
+    void *aux;                          /* Auxiliary data for `less'. */
+  };
+
+/* Converts pointer to tree element RBTREE_ELEM into a pointer to
+   the structure that RBTREE_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the tree element. */
+#define rbtree_entry(RBTREE_ELEM, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) &(RBTREE_ELEM)->parent         \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+void rbtree_init (struct rbtree *, rbtree_less_func *, void *aux);
+
+/* Insertion and removal. */
+void rbtree_insert (struct rbtree *, struct rbtree_elem *);
+void rbtree_remove (struct rbtree *, struct rbtree_elem *);
+struct rbtree_elem *rbtree_pop_min (struct rbtree *);
+
+/* Search. */
+struct rbtree_elem *rbtree_find (struct rbtree *, const struct rbtree_elem *);
+struct rbtree_elem *rbtree_lower_bound (struct rbtree *,
+                                        const struct rbtree_elem *);
+
+/* Traversal. */
+struct rbtree_elem *rbtree_min (struct rbtree *);
+struct rbtree_elem *rbtree_max (struct rbtree *);
+struct rbtree_elem *rbtree_next (struct rbtree_elem *);
+struct rbtree_elem *rbtree_prev (struct rbtree_elem *);
+
+/* Properties. */
+size_t rbtree_size (struct rbtree *);
+bool rbtree_empty (struct rbtree *);
+
+#endif /* lib/kernel/rbtree.h */
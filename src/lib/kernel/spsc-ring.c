@@ -0,0 +1,136 @@
+#include "spsc-ring.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Ring buffer.  See spsc-ring.h for basic information.
+
+   On x86 an acquire load or release store is an ordinary load
+   or store, because the processor neither reorders loads with
+   other loads nor stores with other stores, so these cost no
+   more than the plain accesses they replace; they mostly keep
+   the compiler from moving the buffer accesses across them. */
+
+/* Returns the value of *P, ordered before any later memory
+   access. */
+static inline unsigned
+load_acquire (const unsigned *p)
+{
+  return __atomic_load_n (p, __ATOMIC_ACQUIRE);
+}
+
+/* Stores X into *P, ordered after any earlier memory access. */
+static inline void
+store_release (unsigned *p, unsigned x)
+{
+  __atomic_store_n (p, x, __ATOMIC_RELEASE);
+}
+
+/* Initializes R as an empty ring buffer that stores its data in
+   the SIZE bytes at BUF.  SIZE must be a power of 2. */
+void
+spsc_ring_init (struct spsc_ring *r, void *buf, size_t size)
+{
+  ASSERT (r != NULL);
+  ASSERT (buf != NULL);
+  ASSERT (size > 0 && (size & (size - 1)) == 0);
+
+  r->buf = buf;
+  r->size = size;
+  r->head = r->tail = 0;
+}
+
+/* Returns the number of bytes in R.  Should be called only by
+   the producer or the consumer.  The other side may change the
+   count at any time, so to the consumer it is a lower bound and
+   to the producer an upper bound. */
+size_t
+spsc_ring_cnt (const struct spsc_ring *r)
+{
+  unsigned tail = load_acquire (&r->tail);
+  return load_acquire (&r->head) - tail;
+}
+
+/* Returns the number of bytes that may be added to R.  Subject
+   to the same caveats as spsc_ring_cnt(). */
+size_t
+spsc_ring_space (const struct spsc_ring *r)
+{
+  return r->size - spsc_ring_cnt (r);
+}
+
+/* Returns true if R is empty, false otherwise. */
+bool
+spsc_ring_empty (const struct spsc_ring *r)
+{
+  return spsc_ring_cnt (r) == 0;
+}
+
+/* Returns true if R is full, false otherwise. */
+bool
+spsc_ring_full (const struct spsc_ring *r)
+{
+  return spsc_ring_cnt (r) == r->size;
+}
+
+/* Adds BYTE to R.  Returns true if successful, false if R is
+   full.  Only the producer may call this function. */
+bool
+spsc_ring_put (struct spsc_ring *r, uint8_t byte)
+{
+  return spsc_ring_put_multiple (r, &byte, 1) == 1;
+}
+
+/* Adds as many of the SIZE bytes in BUF to R as fit, without
+   waiting, and returns the number added.  Only the producer may
+   call this function. */
+size_t
+spsc_ring_put_multiple (struct spsc_ring *r, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+  unsigned head = r->head;
+  unsigned ofs = head & (r->size - 1);
+  size_t cnt, chunk;
+
+  cnt = r->size - (head - load_acquire (&r->tail));
+  if (cnt > size)
+    cnt = size;
+
+  chunk = r->size - ofs < cnt ? r->size - ofs : cnt;
+  memcpy (r->buf + ofs, buf, chunk);
+  memcpy (r->buf, buf + chunk, cnt - chunk);
+
+  store_release (&r->head, head + cnt);
+  return cnt;
+}
+
+/* Removes the oldest byte from R and stores it in *BYTE.
+   Returns true if successful, false if R is empty.  Only the
+   consumer may call this function. */
+bool
+spsc_ring_get (struct spsc_ring *r, uint8_t *byte)
+{
+  return spsc_ring_get_multiple (r, byte, 1) == 1;
+}
+
+/* Removes up to SIZE bytes from R, without waiting, and stores
+   them in BUF.  Returns the number of bytes removed, which is 0
+   if R is empty.  Only the consumer may call this function. */
+size_t
+spsc_ring_get_multiple (struct spsc_ring *r, void *buf_, size_t size)
+{
+  uint8_t *buf = buf_;
+  unsigned tail = r->tail;
+  unsigned ofs = tail & (r->size - 1);
+  size_t cnt, chunk;
+
+  cnt = load_acquire (&r->head) - tail;
+  if (cnt > size)
+    cnt = size;
+
+  chunk = r->size - ofs < cnt ? r->size - ofs : cnt;
+  memcpy (buf, r->buf + ofs, chunk);
+  memcpy (buf + chunk, r->buf, cnt - chunk);
+
+  store_release (&r->tail, tail + cnt);
+  return cnt;
+}
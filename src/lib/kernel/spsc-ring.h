@@ -0,0 +1,54 @@
+#ifndef __LIB_KERNEL_SPSC_RING_H
+#define __LIB_KERNEL_SPSC_RING_H
+
+/* Single-producer, single-consumer ring buffer of bytes.
+
+   One thread or interrupt handler, the producer, adds bytes to
+   the ring, and one other, the consumer, removes them.  Neither
+   needs a lock or disabled interrupts to do so, even if they run
+   on different CPUs at once, because each of the ring's two
+   indexes is written by only one of them: HEAD by the producer,
+   TAIL by the consumer.  The producer publishes bytes by storing
+   HEAD after the bytes themselves, and the consumer frees space
+   by storing TAIL after it has copied the bytes out, each a
+   release store that the other side reads with an acquire load.
+
+   With more than one producer, or more than one consumer, the
+   callers on that side must exclude one another by some other
+   means, for example a lock.
+
+   HEAD and TAIL count the bytes ever added and removed, so that
+   the ring holds HEAD - TAIL bytes and all SIZE bytes of the
+   buffer are usable.  SIZE must be a power of 2, so that the
+   counts stay correct when they wrap around. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A ring buffer. */
+struct spsc_ring
+  {
+    uint8_t *buf;               /* Storage, SIZE bytes. */
+    unsigned size;              /* Capacity, a power of 2. */
+    unsigned head;              /* Bytes ever added. */
+    unsigned tail;              /* Bytes ever removed. */
+  };
+
+void spsc_ring_init (struct spsc_ring *, void *buf, size_t size);
+
+size_t spsc_ring_cnt (const struct spsc_ring *);
+size_t spsc_ring_space (const struct spsc_ring *);
+bool spsc_ring_empty (const struct spsc_ring *);
+bool spsc_ring_full (const struct spsc_ring *);
+
+/* Producer side. */
+bool spsc_ring_put (struct spsc_ring *, uint8_t);
+size_t spsc_ring_put_multiple (struct spsc_ring *, const void *,
+                               size_t size);
+
+/* Consumer side. */
+bool spsc_ring_get (struct spsc_ring *, uint8_t *);
+size_t spsc_ring_get_multiple (struct spsc_ring *, void *, size_t size);
+
+#endif /* lib/kernel/spsc-ring.h */
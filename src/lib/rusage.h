@@ -0,0 +1,39 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+/* Resource usage, kept for each thread, and copied to user
+   programs by the getrusage system call, for the calling process
+   or for the children it has waited for. */
+
+#define RUSAGE_SELF 0                   /* The calling process. */
+#define RUSAGE_CHILDREN (-1)            /* Its waited-for children. */
+
+struct rusage
+  {
+    /* CPU time. */
+    long long utime;                    /* Ticks in user programs. */
+    long long stime;                    /* Ticks in the kernel. */
+    long long run_ns;                   /* Time run, from the TSC. */
+
+    /* Context switches. */
+    long long nvcsw;                    /* By blocking. */
+    long long nivcsw;                   /* By preemption or yield. */
+
+    /* Page faults. */
+    long long minflt;                   /* Resolved without I/O. */
+    long long majflt;                   /* Required reading a page. */
+
+    /* Block I/O. */
+    long long inblock;                  /* Sectors read. */
+    long long oublock;                  /* Sectors written. */
+    long long inops;                    /* Read requests. */
+    long long ouops;                    /* Write requests. */
+
+    /* Hardware events, if counted (kernel option -pmc). */
+    long long cycles;                   /* Unhalted core cycles. */
+    long long instructions;             /* Instructions retired. */
+    long long llc_misses;               /* Last-level cache misses. */
+    long long dtlb_misses;              /* Data TLB load misses. */
+  };
+
+#endif /* lib/rusage.h */
@@ -1,8 +1,17 @@
 #include <string.h>
 #include <debug.h>
+#include <stdint.h>
+
+/* Blocks shorter than this are copied or set a byte at a time:
+   aligning them first would not pay off. */
+#define WORD_MIN 16
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
-   Returns DST. */
+   Returns DST.
+
+   Longer blocks are copied a byte at a time until DST is
+   word-aligned, then a 32-bit word at a time with "rep movsl",
+   then the last few bytes. */
 void *
 memcpy (void *dst_, const void *src_, size_t size) 
 {
@@ -12,14 +21,34 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  if (size >= WORD_MIN)
+    {
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words;
+
+      size -= head;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep movsb; movl %3, %%ecx; rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (head)
+                    : "g" (words)
+                    : "memory");
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size)
+                :
+                : "memory");
 
   return dst_;
 }
 
 /* Copies SIZE bytes from SRC to DST, which are allowed to
-   overlap.  Returns DST. */
+   overlap.  Returns DST.
+
+   Unless DST lies within the source block, copying forward, as
+   memcpy() does, is safe.  Otherwise the block is copied
+   backward, with the direction flag set, in the same three
+   steps. */
 void *
 memmove (void *dst_, const void *src_, size_t size) 
 {
@@ -29,20 +58,36 @@ memmove (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  if (dst < src) 
-    {
-      while (size-- > 0)
-        *dst++ = *src++;
-    }
-  else 
+  if (dst <= src || dst >= src + size)
+    return memcpy (dst_, src_, size);
+
+  /* Point to the last byte of each block. */
+  dst += size - 1;
+  src += size - 1;
+  if (size >= WORD_MIN)
     {
-      dst += size;
-      src += size;
-      while (size-- > 0)
-        *--dst = *--src;
+      size_t tail = (uintptr_t) (dst + 1) & 3;
+      size_t words;
+
+      size -= tail;
+      words = size / 4;
+      size %= 4;
+
+      /* After the bytes, step back to the start of the last
+         word for "rep movsl", then forward again to its end. */
+      asm volatile ("std; rep movsb; subl $3, %%edi; subl $3, %%esi; "
+                    "movl %3, %%ecx; rep movsl; "
+                    "addl $3, %%edi; addl $3, %%esi; cld"
+                    : "+D" (dst), "+S" (src), "+c" (tail)
+                    : "g" (words)
+                    : "memory", "cc");
     }
+  asm volatile ("std; rep movsb; cld"
+                : "+D" (dst), "+S" (src), "+c" (size)
+                :
+                : "memory", "cc");
 
-  return dst;
+  return dst_;
 }
 
 /* Find the first differing byte in the two blocks of SIZE bytes
@@ -281,13 +326,46 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  /* As in memcpy(), longer blocks are set by 32-bit words with
+     "rep stosl" once DST is word-aligned. */
+  if (size >= WORD_MIN)
+    {
+      uint32_t word = (unsigned char) value * 0x01010101u;
+      size_t head = -(uintptr_t) dst & 3;
+      size_t words;
+
+      size -= head;
+      words = size / 4;
+      size %= 4;
+      asm volatile ("rep stosb; movl %2, %%ecx; rep stosl"
+                    : "+D" (dst), "+c" (head)
+                    : "g" (words), "a" (word)
+                    : "memory");
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size)
+                : "a" (value)
+                : "memory");
 
   return dst_;
 }
 
+/* Sets the 4,096 bytes of PAGE, which must be page-aligned, to
+   zero, with a single "rep stosl". */
+void
+memzero_page (void *page)
+{
+  size_t words = 4096 / 4;
+
+  ASSERT (((uintptr_t) page & 4095) == 0);
+
+  asm volatile ("rep stosl"
+                : "+D" (page), "+c" (words)
+                : "a" (0)
+                : "memory");
+}
+
 /* Returns the length of STRING. */
 size_t
 strlen (const char *string) 
@@ -28,7 +28,45 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_VMSTAT,                 /* Reads virtual memory statistics. */
+    SYS_READV,                  /* Reads a file into several buffers. */
+    SYS_WRITEV,                 /* Writes several buffers to a file. */
+    SYS_RING_SETUP,             /* Registers a system call ring. */
+    SYS_RING_ENTER,             /* Processes a system call ring. */
+    SYS_FORK,                   /* Duplicate the current process. */
+    SYS_CLOCK_NS,               /* Reads the monotonic clock. */
+    SYS_LOCKSTAT,               /* Prints lock statistics. */
+    SYS_MEMSTAT,                /* Prints memory statistics. */
+    SYS_IOSTAT,                 /* Prints block I/O statistics. */
+    SYS_READ_INPUT,             /* Reads console input with a timeout. */
+    SYS_PIPE,                   /* Creates a pipe. */
+    SYS_SHM_MAP,                /* Maps a shared memory segment. */
+    SYS_SHM_UNLINK,             /* Removes a shared memory segment. */
+    SYS_MSYNC,                  /* Writes back a memory mapping. */
+    SYS_MMAP_RANGE,             /* Maps part of a file into memory. */
+    SYS_MADVISE,                /* Gives memory access hints. */
+    SYS_THREAD_CREATE,          /* Start a thread in this process. */
+    SYS_FUTEX,                  /* Waits on or wakes a futex. */
+    SYS_SBRK,                   /* Moves the end of the heap. */
+    SYS_SPAWN,                  /* Starts a process without waiting. */
+    SYS_SPAWN_MANY,             /* Starts several processes at once. */
+    SYS_SCHED_GROUP,            /* Moves into a new CPU share group. */
+    SYS_GETRUSAGE,              /* Reports resources used. */
+    SYS_SYSCALLSTAT,            /* Prints system call statistics. */
+    SYS_FALLOCATE,              /* Allocates disk space for a file. */
+    SYS_COPY_FILE_RANGE,        /* Copies between files in the kernel. */
+    SYS_FSYNC,                  /* Writes a file to disk. */
+    SYS_SYNC,                   /* Writes all files to disk. */
+    SYS_GETDENTS,               /* Reads many directory entries. */
+    SYS_POLL,                   /* Waits on several fds. */
+    SYS_RING_WAIT,              /* Waits for ring completions. */
+    SYS_MEMPRESSURE,            /* Waits for memory pressure. */
+    SYS_UFFD_REGISTER,          /* Registers a user fault region. */
+    SYS_UFFD_COPY,              /* Fills in user fault pages. */
+    SYS_IO_GROUP                /* Moves into a new I/O limit group. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,33 @@
+#ifndef __LIB_SYSENTER_H
+#define __LIB_SYSENTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Returns true if the CPU implements "sysenter" and "sysexit".
+   The kernel sets up "sysenter" exactly when this returns true,
+   so user programs may use it as the condition for issuing
+   system calls that way.
+
+   CPUID reports the SEP feature bit on early Pentium Pro models
+   that do not really implement the instructions; see [IA32-v2b]
+   "SYSENTER". */
+static inline bool
+sysenter_supported (void)
+{
+  uint32_t eax, ebx, ecx, edx;
+  unsigned family, model, stepping;
+
+  asm ("cpuid"
+       : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+       : "a" (1));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+
+  if ((edx & (1u << 11)) == 0)
+    return false;
+  return !(family == 6 && model < 3 && stepping < 3);
+}
+
+#endif /* lib/sysenter.h */
@@ -0,0 +1,36 @@
+#ifndef __LIB_SYSTRACE_H
+#define __LIB_SYSTRACE_H
+
+#include <stdint.h>
+
+/* System call log, recorded by the kernel with the "-systrace"
+   command-line option, saved to the scratch device as file
+   "systrace", and replayed by examples/replay.  The file is a
+   struct systrace_header followed by RECORD_CNT records, in the
+   order the calls returned. */
+
+/* Longest string argument recorded, including its null
+   terminator.  Longer ones are truncated. */
+#define SYSTRACE_PATH_MAX 28
+
+/* One system call. */
+struct systrace_record
+  {
+    int64_t ns;                 /* clock_ns() when the call was made. */
+    int32_t pid;                /* Calling process. */
+    int32_t tid;                /* Calling thread. */
+    int32_t no;                 /* A SYS_* number. */
+    int32_t ret;                /* Return value, or exit status. */
+    uint32_t args[3];           /* First arguments, 0 if absent. */
+    char path[SYSTRACE_PATH_MAX]; /* File name or command line, if any. */
+  };
+
+struct systrace_header
+  {
+    char magic[4];              /* "SYSC". */
+    uint32_t record_size;       /* sizeof (struct systrace_record). */
+    uint32_t record_cnt;        /* Records that follow. */
+    uint32_t lost_cnt;          /* Calls not recorded, log full. */
+  };
+
+#endif /* lib/systrace.h */
@@ -1,19 +1,68 @@
 #include <stdio.h>
+#include <malloc.h>
 #include <string.h>
+#include <synch.h>
 #include <syscall.h>
 #include <syscall-nr.h>
 
+/* A buffered stream on a file descriptor, open for reading or
+   for writing.  BUF holds LEN bytes, of which those before POS
+   have been consumed by a reading stream; a writing stream keeps
+   LEN at 0 and has POS bytes waiting to be written. */
+struct FILE
+  {
+    int fd;                     /* File descriptor. */
+    bool writing;               /* Open for writing? */
+    int mode;                   /* _IOFBF, _IOLBF, or _IONBF. */
+    char *buf;                  /* Buffer. */
+    size_t size;                /* Size of BUF. */
+    size_t pos;                 /* Position in BUF. */
+    size_t len;                 /* Bytes read into BUF. */
+    bool eof;                   /* Read reached end of file? */
+    bool own_buf;               /* BUF allocated by fdopen()? */
+    bool allocated;             /* Stream allocated by fdopen()? */
+    struct mutex mutex;         /* Protects all members. */
+    struct FILE *next;          /* Next in streams. */
+  };
+
+static char stdin_buf[BUFSIZ];
+static char stdout_buf[BUFSIZ];
+
+static FILE stdin_file =
+  {
+    .fd = STDIN_FILENO, .writing = false, .mode = _IOLBF,
+    .buf = stdin_buf, .size = sizeof stdin_buf,
+    .mutex = MUTEX_INITIALIZER, .next = NULL,
+  };
+static FILE stdout_file =
+  {
+    .fd = STDOUT_FILENO, .writing = true, .mode = _IOLBF,
+    .buf = stdout_buf, .size = sizeof stdout_buf,
+    .mutex = MUTEX_INITIALIZER, .next = &stdin_file,
+  };
+
+FILE *stdin = &stdin_file;
+FILE *stdout = &stdout_file;
+
+/* All open streams, and a mutex protecting the list. */
+static FILE *streams = &stdout_file;
+static struct mutex streams_mutex = MUTEX_INITIALIZER;
+
+static void put_locked (char, void *);
+static bool flush_locked (FILE *);
+static void end_call (FILE *);
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list. */
 int
-vprintf (const char *format, va_list args) 
+vprintf (const char *format, va_list args)
 {
-  return vhprintf (STDOUT_FILENO, format, args);
+  return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
 int
-hprintf (int handle, const char *format, ...) 
+hprintf (int handle, const char *format, ...)
 {
   va_list args;
   int retval;
@@ -25,28 +74,30 @@ hprintf (int handle, const char *format, ...)
   return retval;
 }
 
-/* Writes string S to the console, followed by a new-line
+/* Writes string S to stdout, followed by a new-line
    character. */
 int
-puts (const char *s) 
+puts (const char *s)
 {
-  write (STDOUT_FILENO, s, strlen (s));
-  putchar ('\n');
+  mutex_lock (&stdout->mutex);
+  while (*s != '\0')
+    put_locked (*s++, stdout);
+  put_locked ('\n', stdout);
+  end_call (stdout);
+  mutex_unlock (&stdout->mutex);
 
   return 0;
 }
 
-/* Writes C to the console. */
+/* Writes C to stdout. */
 int
-putchar (int c) 
+putchar (int c)
 {
-  char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
-  return c;
+  return fputc (c, stdout);
 }
-
+
 /* Auxiliary data for vhprintf_helper(). */
-struct vhprintf_aux 
+struct vhprintf_aux
   {
     char buf[64];       /* Character buffer. */
     char *p;            /* Current position in buffer. */
@@ -59,11 +110,16 @@ static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to STDOUT_FILENO goes through stdout, so that
+   it stays in order with printf(). */
 int
-vhprintf (int handle, const char *format, va_list args) 
+vhprintf (int handle, const char *format, va_list args)
 {
   struct vhprintf_aux aux;
+
+  if (handle == STDOUT_FILENO)
+    return vfprintf (stdout, format, args);
+
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
@@ -75,7 +131,7 @@ vhprintf (int handle, const char *format, va_list args)
 /* Adds C to the buffer in AUX, flushing it if the buffer fills
    up. */
 static void
-add_char (char c, void *aux_) 
+add_char (char c, void *aux_)
 {
   struct vhprintf_aux *aux = aux_;
   *aux->p++ = c;
@@ -92,3 +148,346 @@ flush (struct vhprintf_aux *aux)
     write (aux->handle, aux->buf, aux->p - aux->buf);
   aux->p = aux->buf;
 }
+
+/* Opens a stream on file descriptor FD, for reading if MODE
+   starts with "r", or for writing if it starts with "w" or "a".
+   The stream is fully buffered.  Returns the new stream, or a
+   null pointer if MODE is invalid or memory is short. */
+FILE *
+fdopen (int fd, const char *mode)
+{
+  FILE *f;
+
+  if (mode[0] != 'r' && mode[0] != 'w' && mode[0] != 'a')
+    return NULL;
+
+  f = malloc (sizeof *f);
+  if (f == NULL)
+    return NULL;
+  f->buf = malloc (BUFSIZ);
+  if (f->buf == NULL)
+    {
+      free (f);
+      return NULL;
+    }
+  f->fd = fd;
+  f->writing = mode[0] != 'r';
+  f->mode = _IOFBF;
+  f->size = BUFSIZ;
+  f->pos = f->len = 0;
+  f->eof = false;
+  f->own_buf = f->allocated = true;
+  mutex_init (&f->mutex);
+
+  mutex_lock (&streams_mutex);
+  f->next = streams;
+  streams = f;
+  mutex_unlock (&streams_mutex);
+  return f;
+}
+
+/* Flushes F, closes its file descriptor, and frees F.  Returns 0
+   if successful, or EOF if buffered output could not be
+   written. */
+int
+fclose (FILE *f)
+{
+  FILE **fp;
+  bool ok;
+
+  mutex_lock (&streams_mutex);
+  for (fp = &streams; *fp != NULL; fp = &(*fp)->next)
+    if (*fp == f)
+      {
+        *fp = f->next;
+        break;
+      }
+  mutex_unlock (&streams_mutex);
+
+  mutex_lock (&f->mutex);
+  ok = flush_locked (f);
+  close (f->fd);
+  mutex_unlock (&f->mutex);
+
+  if (f->own_buf)
+    free (f->buf);
+  if (f->allocated)
+    free (f);
+  return ok ? 0 : EOF;
+}
+
+/* Writes out the output buffered in F, or in every open stream
+   if F is a null pointer.  Returns 0 if successful, EOF if some
+   output could not be written. */
+int
+fflush (FILE *f)
+{
+  bool ok = true;
+
+  if (f == NULL)
+    {
+      mutex_lock (&streams_mutex);
+      for (f = streams; f != NULL; f = f->next)
+        ok = fflush (f) == 0 && ok;
+      mutex_unlock (&streams_mutex);
+    }
+  else
+    {
+      mutex_lock (&f->mutex);
+      ok = flush_locked (f);
+      mutex_unlock (&f->mutex);
+    }
+  return ok ? 0 : EOF;
+}
+
+/* Sets F's buffering MODE, one of _IOFBF, _IOLBF, or _IONBF,
+   and, if BUF is not a null pointer, makes it F's buffer of SIZE
+   bytes, which F uses until it is closed.  Must be called before
+   any other operation on F.  Returns 0 if successful, nonzero if
+   MODE is invalid. */
+int
+setvbuf (FILE *f, char *buf, int mode, size_t size)
+{
+  if ((mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+      || (buf != NULL && size == 0))
+    return EOF;
+
+  mutex_lock (&f->mutex);
+  f->mode = mode;
+  if (buf != NULL)
+    {
+      if (f->own_buf)
+        free (f->buf);
+      f->buf = buf;
+      f->size = size;
+      f->own_buf = false;
+    }
+  mutex_unlock (&f->mutex);
+  return 0;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from F into BUF,
+   and returns the number of whole elements read. */
+size_t
+fread (void *buf_, size_t size, size_t cnt, FILE *f)
+{
+  char *buf = buf_;
+  size_t total = size * cnt;
+  size_t done = 0;
+
+  if (size == 0 || f->writing)
+    return 0;
+
+  mutex_lock (&f->mutex);
+  while (done < total)
+    {
+      size_t chunk;
+
+      if (f->pos == f->len)
+        {
+          int n;
+
+          if (f->eof)
+            break;
+
+          /* Read a large request straight into BUF. */
+          if (total - done >= f->size)
+            {
+              n = read (f->fd, buf + done, total - done);
+              if (n <= 0)
+                f->eof = true;
+              else
+                done += n;
+              continue;
+            }
+
+          n = read (f->fd, f->buf, f->size);
+          if (n <= 0)
+            {
+              f->eof = true;
+              break;
+            }
+          f->pos = 0;
+          f->len = n;
+        }
+
+      chunk = f->len - f->pos;
+      if (chunk > total - done)
+        chunk = total - done;
+      memcpy (buf + done, f->buf + f->pos, chunk);
+      f->pos += chunk;
+      done += chunk;
+    }
+  mutex_unlock (&f->mutex);
+  return done / size;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUF to F, and
+   returns the number of whole elements written or buffered. */
+size_t
+fwrite (const void *buf_, size_t size, size_t cnt, FILE *f)
+{
+  const char *buf = buf_;
+  size_t total = size * cnt;
+  size_t done = 0;
+
+  if (size == 0 || !f->writing)
+    return 0;
+
+  mutex_lock (&f->mutex);
+  while (done < total)
+    {
+      size_t chunk = f->size - f->pos;
+
+      /* Write a large request straight from BUF. */
+      if (f->pos == 0 && total - done >= f->size)
+        {
+          int n = write (f->fd, buf + done, total - done);
+          if (n <= 0)
+            break;
+          done += n;
+          continue;
+        }
+
+      if (chunk > total - done)
+        chunk = total - done;
+      memcpy (f->buf + f->pos, buf + done, chunk);
+      f->pos += chunk;
+      done += chunk;
+      if (f->pos == f->size && !flush_locked (f))
+        break;
+    }
+  if (f->mode == _IOLBF && memchr (buf, '\n', done) != NULL)
+    flush_locked (f);
+  end_call (f);
+  mutex_unlock (&f->mutex);
+  return done / size;
+}
+
+/* Reads and returns the next byte of F, or EOF at end of file. */
+int
+fgetc (FILE *f)
+{
+  unsigned char c;
+
+  return fread (&c, 1, 1, f) == 1 ? c : EOF;
+}
+
+/* Writes C to F and returns C, or EOF if F is not open for
+   writing. */
+int
+fputc (int c, FILE *f)
+{
+  if (!f->writing)
+    return EOF;
+
+  mutex_lock (&f->mutex);
+  put_locked (c, f);
+  end_call (f);
+  mutex_unlock (&f->mutex);
+  return (unsigned char) c;
+}
+
+/* Writes string S to F, without a new-line.  Returns 0, or EOF
+   if F is not open for writing. */
+int
+fputs (const char *s, FILE *f)
+{
+  size_t len = strlen (s);
+
+  return len == 0 || fwrite (s, len, 1, f) == 1 ? 0 : EOF;
+}
+
+/* Like printf(), but writes output to stream F. */
+int
+fprintf (FILE *f, const char *format, ...)
+{
+  va_list args;
+  int retval;
+
+  va_start (args, format);
+  retval = vfprintf (f, format, args);
+  va_end (args);
+
+  return retval;
+}
+
+/* Auxiliary data for vfprintf(). */
+struct vfprintf_aux
+  {
+    FILE *f;            /* Stream written. */
+    int char_cnt;       /* Total characters written so far. */
+  };
+
+static void add_stream_char (char, void *);
+
+/* Like vprintf(), but writes output to stream F. */
+int
+vfprintf (FILE *f, const char *format, va_list args)
+{
+  struct vfprintf_aux aux;
+
+  if (!f->writing)
+    return EOF;
+
+  aux.f = f;
+  aux.char_cnt = 0;
+  mutex_lock (&f->mutex);
+  __vprintf (format, args, add_stream_char, &aux);
+  end_call (f);
+  mutex_unlock (&f->mutex);
+  return aux.char_cnt;
+}
+
+/* Adds C to the stream in AUX, for vfprintf(). */
+static void
+add_stream_char (char c, void *aux_)
+{
+  struct vfprintf_aux *aux = aux_;
+
+  put_locked (c, aux->f);
+  aux->char_cnt++;
+}
+
+/* Adds C to the buffer of stream F_, which must be locked,
+   writing the buffer out if it fills up, or at a new-line if F_
+   is line-buffered. */
+static void
+put_locked (char c, void *f_)
+{
+  FILE *f = f_;
+
+  f->buf[f->pos++] = c;
+  if (f->pos == f->size || (c == '\n' && f->mode == _IOLBF))
+    flush_locked (f);
+}
+
+/* Writes out the output buffered in F, which must be locked.
+   Returns false if some of it could not be written, which is
+   then dropped. */
+static bool
+flush_locked (FILE *f)
+{
+  size_t ofs = 0, len = f->pos;
+
+  if (!f->writing)
+    return true;
+  while (ofs < len)
+    {
+      int n = write (f->fd, f->buf + ofs, len - ofs);
+      if (n <= 0)
+        break;
+      ofs += n;
+    }
+  f->pos = 0;
+  return ofs == len;
+}
+
+/* Completes an output call on F, which must be locked, by
+   writing out its buffer if F is unbuffered. */
+static void
+end_call (FILE *f)
+{
+  if (f->mode == _IONBF)
+    flush_locked (f);
+}
@@ -0,0 +1,277 @@
+#include <malloc.h>
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include <synch.h>
+#include <syscall.h>
+
+/* A simple malloc() for user programs, built on sbrk().
+
+   As in the kernel's malloc() in threads/malloc.c, a request of
+   up to 1 kB is rounded up to a power of 2, at least MIN_SIZE
+   bytes, and served from that size class's free list.  A class
+   whose list is empty gets a new page from the heap, an "arena"
+   whose header names the class, carved into blocks from the top
+   down, so that each block is aligned to its size.  free()
+   finds a block's class in the header of the page the block is
+   in.  Arenas are not given back to the heap.
+
+   A larger request is given a run of whole pages that starts
+   with the same header, holding the run's length in pages.
+   Freed runs are kept on a list, and a request takes the first
+   one that is big enough, splitting it if it is bigger, before
+   growing the heap; a freed run that ends at the break shrinks
+   the heap instead.
+
+   The heap only grows a page at a time, or by a run, so that
+   its pages are touched, and given frames by the kernel, only as
+   they are used.  A mutex protects the allocator; it costs no
+   system call unless threads contend for it. */
+
+#define PAGE_SIZE 4096                  /* Bytes in a page. */
+#define MIN_SIZE 16                     /* Smallest block. */
+#define CLASS_CNT 7                     /* 16, 32, ..., 1024 bytes. */
+#define ARENA_MAGIC 0x5f3a7c19          /* Detects bad pointers. */
+
+/* Header at the start of each arena or run. */
+struct arena
+  {
+    unsigned magic;                     /* ARENA_MAGIC. */
+    int class;                          /* Size class, or -1 for a run. */
+    size_t page_cnt;                    /* Pages in a run. */
+    struct arena *next_run;             /* Next free run. */
+  };
+
+/* A free block. */
+struct block
+  {
+    struct block *next;                 /* Next free block. */
+  };
+
+static struct block *free_lists[CLASS_CNT]; /* Free blocks, by class. */
+static struct arena *free_runs;         /* Free runs. */
+static struct mutex heap_mutex = MUTEX_INITIALIZER;
+
+static void *get_pages (size_t page_cnt);
+static struct arena *block_to_arena (void *);
+
+/* Returns the size class for SIZE bytes, or -1 if SIZE calls for
+   a run of pages. */
+static int
+size_class (size_t size)
+{
+  int class;
+  size_t block_size = MIN_SIZE;
+
+  for (class = 0; class < CLASS_CNT; class++, block_size *= 2)
+    if (size <= block_size)
+      return class;
+  return -1;
+}
+
+/* Returns the size of the blocks of CLASS. */
+static size_t
+class_size (int class)
+{
+  return (size_t) MIN_SIZE << class;
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size)
+{
+  int class = size_class (size);
+  void *result = NULL;
+
+  if (size == 0)
+    return NULL;
+
+  mutex_lock (&heap_mutex);
+  if (class >= 0)
+    {
+      /* Refill the free list from a new arena if it is empty. */
+      if (free_lists[class] == NULL)
+        {
+          struct arena *a = get_pages (1);
+          size_t block_size = class_size (class);
+          uint8_t *b;
+
+          if (a != NULL)
+            {
+              a->magic = ARENA_MAGIC;
+              a->class = class;
+              for (b = (uint8_t *) a + PAGE_SIZE - block_size;
+                   b >= (uint8_t *) (a + 1); b -= block_size)
+                {
+                  struct block *blk = (struct block *) b;
+                  blk->next = free_lists[class];
+                  free_lists[class] = blk;
+                }
+            }
+        }
+      if (free_lists[class] != NULL)
+        {
+          result = free_lists[class];
+          free_lists[class] = free_lists[class]->next;
+        }
+    }
+  else if (size <= SIZE_MAX - sizeof (struct arena) - PAGE_SIZE)
+    {
+      size_t page_cnt = ((size + sizeof (struct arena) + PAGE_SIZE - 1)
+                         / PAGE_SIZE);
+      struct arena **ap, *a;
+
+      /* First fit among the free runs, splitting off the front of
+         a bigger run. */
+      for (ap = &free_runs; (a = *ap) != NULL; ap = &a->next_run)
+        if (a->page_cnt >= page_cnt)
+          break;
+      if (a != NULL)
+        {
+          struct arena *next = a->next_run;
+          if (a->page_cnt > page_cnt)
+            {
+              struct arena *rest = (struct arena *) ((uint8_t *) a
+                                                     + page_cnt * PAGE_SIZE);
+              rest->magic = ARENA_MAGIC;
+              rest->class = -1;
+              rest->page_cnt = a->page_cnt - page_cnt;
+              rest->next_run = next;
+              next = rest;
+            }
+          *ap = next;
+        }
+      else
+        a = get_pages (page_cnt);
+
+      if (a != NULL)
+        {
+          a->magic = ARENA_MAGIC;
+          a->class = -1;
+          a->page_cnt = page_cnt;
+          result = a + 1;
+        }
+    }
+  mutex_unlock (&heap_mutex);
+  return result;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b)
+{
+  void *p;
+  size_t size;
+
+  size = a * b;
+  if (size < a || size < b)
+    return NULL;
+
+  p = malloc (size);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t
+block_size (void *block)
+{
+  struct arena *a = block_to_arena (block);
+
+  return (a->class >= 0
+          ? class_size (a->class)
+          : a->page_cnt * PAGE_SIZE - sizeof *a);
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size)
+{
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  else if (old_block == NULL)
+    return malloc (new_size);
+  else
+    {
+      size_t old_size = block_size (old_block);
+      void *new_block;
+
+      if (new_size <= old_size)
+        return old_block;
+      new_block = malloc (new_size);
+      if (new_block != NULL)
+        {
+          memcpy (new_block, old_block, old_size);
+          free (old_block);
+        }
+      return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p)
+{
+  struct arena *a;
+
+  if (p == NULL)
+    return;
+
+  a = block_to_arena (p);
+  mutex_lock (&heap_mutex);
+  if (a->class >= 0)
+    {
+      struct block *b = p;
+      b->next = free_lists[a->class];
+      free_lists[a->class] = b;
+    }
+  else if ((uint8_t *) a + a->page_cnt * PAGE_SIZE == sbrk (0))
+    sbrk (-(intptr_t) (a->page_cnt * PAGE_SIZE));
+  else
+    {
+      a->next_run = free_runs;
+      free_runs = a;
+    }
+  mutex_unlock (&heap_mutex);
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *
+block_to_arena (void *b)
+{
+  struct arena *a = (struct arena *) ((uintptr_t) b & ~(PAGE_SIZE - 1));
+
+  ASSERT (a->magic == ARENA_MAGIC);
+  ASSERT (a->class >= 0
+          ? ((uintptr_t) b & (PAGE_SIZE - 1)) % class_size (a->class) == 0
+          : b == a + 1);
+  return a;
+}
+
+/* Extends the heap by PAGE_CNT pages and returns the first, or
+   returns a null pointer if the heap cannot grow.  The first call
+   aligns the break to a page boundary. */
+static void *
+get_pages (size_t page_cnt)
+{
+  uint8_t *brk = sbrk (0);
+  size_t pad = -(uintptr_t) brk & (PAGE_SIZE - 1);
+  uint8_t *p;
+
+  if (page_cnt > (SIZE_MAX - pad) / PAGE_SIZE)
+    return NULL;
+  p = sbrk (pad + page_cnt * PAGE_SIZE);
+  return p != (uint8_t *) -1 ? p + pad : NULL;
+}
@@ -4,4 +4,41 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered streams.
+
+   Output to stdout, including printf(), putchar() and puts(),
+   collects in a BUFSIZ-byte buffer that is written out when it
+   fills up, when a new-line is written, and by fflush().  A
+   stream opened on a file with fdopen() is fully buffered
+   instead, unless setvbuf() says otherwise.  exit(), fork()
+   and exec() flush every stream first, and reading from
+   STDIN_FILENO flushes stdout, so that a prompt shows before
+   the program waits for input.  Output still buffered when the
+   kernel kills the process is lost. */
+typedef struct FILE FILE;
+
+#define BUFSIZ 4096             /* Size of a stream's buffer. */
+#define EOF (-1)                /* End of file, or error. */
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0                /* Write when the buffer is full. */
+#define _IOLBF 1                /* Also write at each new-line. */
+#define _IONBF 2                /* Write at the end of each call. */
+
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fgetc (FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
 #endif /* lib/user/stdio.h */
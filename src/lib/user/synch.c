@@ -0,0 +1,127 @@
+#include <synch.h>
+#include <syscall.h>
+
+/* The mutex is the second one of Ulrich Drepper's "Futexes Are
+   Tricky": a thread that finds the mutex locked sets its value
+   to 2 before waiting, so that the thread that unlocks it knows
+   to call FUTEX_WAKE. */
+
+/* Atomically sets *P to NEW if it equals OLD, and returns the
+   value *P had. */
+static inline int
+compare_exchange (int *p, int old, int new)
+{
+  int prev;
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "=a" (prev), "+m" (*p) : "r" (new), "0" (old)
+                : "memory");
+  return prev;
+}
+
+/* Atomically sets *P to NEW and returns the value *P had. */
+static inline int
+exchange (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically adds N to *P and returns the value *P had. */
+static inline int
+fetch_add (int *p, int n)
+{
+  asm volatile ("lock xaddl %0, %1" : "+r" (n), "+m" (*p) : : "memory");
+  return n;
+}
+
+/* Initializes M as an unlocked mutex. */
+void
+mutex_init (struct mutex *m)
+{
+  m->value = 0;
+}
+
+/* Locks M, waiting until it is unlocked if need be.  M must not
+   already be locked by the running thread. */
+void
+mutex_lock (struct mutex *m)
+{
+  int c = compare_exchange (&m->value, 0, 1);
+
+  if (c != 0)
+    {
+      if (c != 2)
+        c = exchange (&m->value, 2);
+      while (c != 0)
+        {
+          futex (&m->value, FUTEX_WAIT, 2);
+          c = exchange (&m->value, 2);
+        }
+    }
+}
+
+/* Locks M if it is unlocked and returns true, or returns false
+   without waiting. */
+bool
+mutex_trylock (struct mutex *m)
+{
+  return compare_exchange (&m->value, 0, 1) == 0;
+}
+
+/* Unlocks M, which the running thread must have locked, and
+   wakes up one thread waiting for it, if any. */
+void
+mutex_unlock (struct mutex *m)
+{
+  if (fetch_add (&m->value, -1) != 1)
+    {
+      m->value = 0;
+      futex (&m->value, FUTEX_WAKE, 1);
+    }
+}
+
+/* Initializes CV as a condition variable. */
+void
+condvar_init (struct condvar *cv)
+{
+  cv->seq = 0;
+  cv->mutex = NULL;
+}
+
+/* Atomically unlocks M and waits for CV to be signaled, then
+   locks M again.  As with any condition variable, the caller
+   must check its condition again after waking up. */
+void
+condvar_wait (struct condvar *cv, struct mutex *m)
+{
+  int seq = cv->seq;
+
+  cv->mutex = m;
+  mutex_unlock (m);
+  futex (&cv->seq, FUTEX_WAIT, seq);
+
+  /* A broadcast may have moved us to wait on M, so lock it as a
+     waiter would, leaving it marked as contended: whoever
+     unlocks it next then wakes the next of those moved. */
+  while (exchange (&m->value, 2) != 0)
+    futex (&m->value, FUTEX_WAIT, 2);
+}
+
+/* Wakes up one thread waiting on CV, if any. */
+void
+condvar_signal (struct condvar *cv)
+{
+  fetch_add (&cv->seq, 1);
+  futex (&cv->seq, FUTEX_WAKE, 1);
+}
+
+/* Wakes up all the threads waiting on CV.  Rather than waking
+   them all at once to fight over their mutex, wakes one and
+   moves the others to wait for the mutex. */
+void
+condvar_broadcast (struct condvar *cv)
+{
+  fetch_add (&cv->seq, 1);
+  if (cv->mutex != NULL)
+    futex (&cv->seq, FUTEX_REQUEUE, (int) &cv->mutex->value);
+}
@@ -0,0 +1,43 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+/* Synchronization between the threads of a process, built on
+   futex().  Locking an unlocked mutex, unlocking a mutex that no
+   thread waits for, and signaling a condition variable that no
+   thread waits on are done entirely in user space, without a
+   system call. */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A mutex.  Its value is 0 if it is unlocked, 1 if it is locked,
+   or 2 if it is locked and threads may be waiting for it. */
+struct mutex
+  {
+    int value;
+  };
+
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_lock (struct mutex *);
+bool mutex_trylock (struct mutex *);
+void mutex_unlock (struct mutex *);
+
+/* A condition variable.  SEQ counts the signals sent, so that a
+   signal sent between a waiter's unlocking its mutex and its
+   going to sleep is not lost. */
+struct condvar
+  {
+    int seq;                    /* Signals sent so far. */
+    struct mutex *mutex;        /* Mutex of the latest waiter. */
+  };
+
+#define CONDVAR_INITIALIZER { 0, NULL }
+
+void condvar_init (struct condvar *);
+void condvar_wait (struct condvar *, struct mutex *);
+void condvar_signal (struct condvar *);
+void condvar_broadcast (struct condvar *);
+
+#endif /* lib/user/synch.h */
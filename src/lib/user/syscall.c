@@ -1,31 +1,70 @@
 #include <syscall.h>
+#include <stdio.h>
+#include <sysenter.h>
 #include "../syscall-nr.h"
 
+/* Whether system calls enter the kernel with "sysenter", rather
+   than "int $0x30": 1 if so, 0 if not, -1 if not yet known. */
+static int fast_syscalls = -1;
+
+/* Decides, on the first system call, whether to use "sysenter".
+   See lib/sysenter.h. */
+static inline void
+check_fast_syscalls (void)
+{
+  if (fast_syscalls < 0)
+    fast_syscalls = sysenter_supported ();
+}
+
+/* Loads the address of label 2 into %edx.  Position-independent
+   code, as in the shared C library, cannot name it directly, but
+   finds it relative to the address a call pushes. */
+#ifdef __PIC__
+#define SYSCALL_RESUME "call 3f; 3: popl %%edx; addl $2f-3b, %%edx; "
+#else
+#define SYSCALL_RESUME "movl $2f, %%edx; "
+#endif
+
+/* Enters the kernel, with the system call number and then its
+   arguments at the top of the stack, and pops NARGS arguments
+   and the number on return.  "sysenter" expects the stack
+   pointer and the address to resume at in %ecx and %edx. */
+#define SYSCALL_ENTER(NARGS)                                    \
+        "cmpl $0, %[fast]; je 1f; "                             \
+        SYSCALL_RESUME "movl %%esp, %%ecx; sysenter; "          \
+        "1: int $0x30; "                                        \
+        "2: addl $" #NARGS "*4+4, %%esp"
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
+          check_fast_syscalls ();                               \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            ("pushl %[number]; " SYSCALL_ENTER (0)              \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : [number] "i" (NUMBER),                         \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          check_fast_syscalls ();                               \
+          asm volatile                                          \
+            ("pushl %[arg0]; pushl %[number]; "                 \
+             SYSCALL_ENTER (1)                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "g" (ARG0),                             \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -33,14 +72,16 @@
 #define syscall2(NUMBER, ARG0, ARG1)                            \
         ({                                                      \
           int retval;                                           \
+          check_fast_syscalls ();                               \
           asm volatile                                          \
             ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER (2)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
-                 [arg1] "r" (ARG1)                              \
-               : "memory");                                     \
+                 [arg1] "r" (ARG1),                             \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -49,15 +90,17 @@
 #define syscall3(NUMBER, ARG0, ARG1, ARG2)                      \
         ({                                                      \
           int retval;                                           \
+          check_fast_syscalls ();                               \
           asm volatile                                          \
             ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+             "pushl %[number]; " SYSCALL_ENTER (3)              \
                : "=a" (retval)                                  \
                : [number] "i" (NUMBER),                         \
                  [arg0] "r" (ARG0),                             \
                  [arg1] "r" (ARG1),                             \
-                 [arg2] "r" (ARG2)                              \
-               : "memory");                                     \
+                 [arg2] "r" (ARG2),                             \
+                 [fast] "m" (fast_syscalls)                     \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -71,6 +114,7 @@ halt (void)
 void
 exit (int status)
 {
+  fflush (NULL);
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,9 +122,86 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  fflush (NULL);
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+spawn (const char *file)
+{
+  fflush (NULL);
+  return (pid_t) syscall1 (SYS_SPAWN, file);
+}
+
+int
+spawn_many (const char **files, int cnt, pid_t *pids)
+{
+  fflush (NULL);
+  return syscall3 (SYS_SPAWN_MANY, files, cnt, pids);
+}
+
+int
+sched_group (int tickets)
+{
+  return syscall1 (SYS_SCHED_GROUP, tickets);
+}
+
+int
+io_group (int iops, int kbps)
+{
+  return syscall2 (SYS_IO_GROUP, iops, kbps);
+}
+
+bool
+getrusage (int who, struct rusage *usage)
+{
+  return syscall2 (SYS_GETRUSAGE, who, usage);
+}
+
+void
+syscallstat (void)
+{
+  syscall0 (SYS_SYSCALLSTAT);
+}
+
+bool
+fallocate (int fd, unsigned offset, unsigned length, int flags)
+{
+  struct fallocate_args args = { offset, length, flags };
+  return syscall2 (SYS_FALLOCATE, fd, &args);
+}
+
+int
+copy_file_range (int in_fd, int out_fd, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
+int
+getdents (unsigned *cookie, struct dirent *ents, int cnt, int flags)
+{
+  struct getdents_args args = { cookie, ents, cnt, flags };
+  return syscall1 (SYS_GETDENTS, &args);
+}
+
+int
+poll (struct pollfd *fds, int cnt, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, cnt, timeout);
+}
+
 int
 wait (pid_t pid)
 {
@@ -114,6 +235,8 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  if (fd == STDIN_FILENO)
+    fflush (stdout);
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -182,3 +305,160 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+vmstat (struct vmstat *stats, bool system)
+{
+  return syscall2 (SYS_VMSTAT, stats, (int) system);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+bool
+ring_setup (struct ring *ring)
+{
+  return syscall1 (SYS_RING_SETUP, ring);
+}
+
+int
+ring_enter (void)
+{
+  return syscall0 (SYS_RING_ENTER);
+}
+
+int
+ring_wait (void)
+{
+  return syscall0 (SYS_RING_WAIT);
+}
+
+pid_t
+fork (void)
+{
+  fflush (NULL);
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+int64_t
+clock_ns (void)
+{
+  int64_t ns;
+  syscall1 (SYS_CLOCK_NS, &ns);
+  return ns;
+}
+
+void
+lockstat (void)
+{
+  syscall0 (SYS_LOCKSTAT);
+}
+
+void
+memstat (void)
+{
+  syscall0 (SYS_MEMSTAT);
+}
+
+void
+iostat (void)
+{
+  syscall0 (SYS_IOSTAT);
+}
+
+int
+read_input (void *buffer, unsigned size, int timeout)
+{
+  return syscall3 (SYS_READ_INPUT, buffer, size, timeout);
+}
+
+bool
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+mapid_t
+shm_map (const char *name, void *addr, unsigned size)
+{
+  return syscall3 (SYS_SHM_MAP, name, addr, size);
+}
+
+bool
+shm_unlink (const char *name)
+{
+  return syscall1 (SYS_SHM_UNLINK, name);
+}
+
+bool
+msync (mapid_t mapid, int flags)
+{
+  return syscall2 (SYS_MSYNC, mapid, flags);
+}
+
+mapid_t
+mmap_range (int fd, void *addr, unsigned offset, size_t length, int flags)
+{
+  struct mmap_args args = { offset, length, flags };
+  return syscall3 (SYS_MMAP_RANGE, fd, addr, &args);
+}
+
+bool
+madvise (void *addr, size_t length, int advice)
+{
+  return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+/* Runs FUNC (AUX) in a thread started by thread_spawn(), then
+   ends the thread. */
+static void NO_RETURN
+thread_start (void (*func) (void *), void *aux)
+{
+  func (aux);
+  exit (EXIT_SUCCESS);
+}
+
+pid_t
+thread_spawn (void (*func) (void *), void *aux)
+{
+  return (pid_t) syscall3 (SYS_THREAD_CREATE, thread_start, func, aux);
+}
+
+int
+futex (int *addr, int op, int val)
+{
+  return syscall3 (SYS_FUTEX, addr, op, val);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+mempressure (int level, int timeout)
+{
+  return syscall2 (SYS_MEMPRESSURE, level, timeout);
+}
+
+int
+uffd_register (void *addr, size_t length)
+{
+  return syscall2 (SYS_UFFD_REGISTER, addr, length);
+}
+
+int
+uffd_copy (void *dst, const void *src, size_t length)
+{
+  return syscall3 (SYS_UFFD_COPY, dst, src, length);
+}
@@ -2,7 +2,11 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
+#include <rusage.h>
+#include <vmstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -12,9 +16,206 @@ typedef int pid_t;
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
+/* Flags for mmap_range().  Exactly one of MAP_SHARED and
+   MAP_PRIVATE must be given. */
+#define MAP_SHARED 0x01         /* Write changes back to the file. */
+#define MAP_PRIVATE 0x02        /* Keep changes to this process. */
+#define MAP_POPULATE 0x8000     /* Read the pages in right away. */
+
+/* Arguments of mmap_range() beyond the first two, as passed to
+   the kernel. */
+struct mmap_args
+  {
+    unsigned offset;            /* Page-aligned file offset. */
+    size_t length;              /* Bytes to map. */
+    int flags;                  /* MAP_* flags. */
+  };
+
+/* Advice for madvise(). */
+#define MADV_NORMAL 0           /* No particular access pattern. */
+#define MADV_RANDOM 1           /* Random accesses. */
+#define MADV_SEQUENTIAL 2       /* Sequential accesses, once. */
+#define MADV_WILLNEED 3         /* Will be needed soon. */
+#define MADV_DONTNEED 4         /* Not needed any more. */
+
+/* Levels of memory pressure for mempressure(), from none to
+   close to thrashing.  A program that caches data it could
+   compute or read again should give the memory back, with
+   madvise(MADV_DONTNEED), at MEMPRESSURE_MEDIUM or earlier,
+   before the kernel writes it to swap. */
+#define MEMPRESSURE_NONE 0      /* Enough free memory. */
+#define MEMPRESSURE_LOW 1       /* Free memory running low. */
+#define MEMPRESSURE_MEDIUM 2    /* Pages being evicted. */
+#define MEMPRESSURE_CRITICAL 3  /* Close to thrashing. */
+
+/* A fault on a missing page of a region registered with
+   uffd_register(), as read from the region's file descriptor.
+   The faulting thread waits until uffd_copy() fills the page in
+   or the descriptor is closed, after which missing pages read as
+   zeros.  Threads faulting on the same page report it once each,
+   so uffd_copy() finds all but the first already filled in. */
+struct uffd_msg
+  {
+    void *addr;                 /* Page that faulted. */
+    int write;                  /* Nonzero for a write access. */
+    pid_t tid;                  /* Faulting thread. */
+    int reserved;               /* Pads to 16 bytes. */
+  };
+
+/* Operations for futex().  A futex is an int in memory on which
+   the threads of a process wait for one another; only contended
+   lock operations need to enter the kernel.  See lib/user/synch.h
+   for a mutex and a condition variable built on futexes.
+
+   FUTEX_WAIT blocks until woken if the futex still holds VAL, and
+   returns 0 once woken, or -1 at once if the value differs.
+   FUTEX_WAKE wakes up to VAL waiters and returns the number woken.
+   FUTEX_REQUEUE wakes one waiter and moves the rest to wait on the
+   futex at address VAL, and returns the number woken or moved. */
+#define FUTEX_WAIT 0            /* Wait if *ADDR == VAL. */
+#define FUTEX_WAKE 1            /* Wake up to VAL waiters. */
+#define FUTEX_REQUEUE 2         /* Wake one, move the rest to VAL. */
+
+/* Flags for msync(). */
+#define MS_ASYNC 1              /* Leave writing to disk for later. */
+#define MS_SYNC 4               /* Wait until written to disk. */
+
+/* fallocate() allocates disk space for LENGTH bytes of a file
+   starting at OFFSET, in as few contiguous runs as possible,
+   growing the file if they go past its end.  Writing the range
+   later then fills the space in place.  The space reads as
+   zeros; with FALLOC_UNWRITTEN, the kernel does not zero it on
+   disk up front, but zeroes each sector as it is first written.
+
+   Arguments of fallocate(), as passed to the kernel. */
+struct fallocate_args
+  {
+    unsigned offset;            /* First byte to allocate. */
+    unsigned length;            /* Bytes to allocate. */
+    int flags;                  /* FALLOC_* flags. */
+  };
+
+/* Flags for fallocate(). */
+#define FALLOC_UNWRITTEN 0x01   /* Do not zero the space on disk. */
+
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* getdents() writes up to CNT entries of the root directory,
+   which is the only directory, to ENTS and returns their number,
+   0 at the end of the directory.  *COOKIE is where to start,
+   initially 0, and is advanced for the next call.  With
+   GETDENTS_PLUS, each entry's inode number and size are also
+   filled in, with the inodes read in one batch, saving a
+   separate open() and filesize() for each.
+
+   Arguments of getdents(), as passed to the kernel. */
+struct getdents_args
+  {
+    unsigned *cookie;           /* Position in the directory. */
+    struct dirent *ents;        /* Entries to fill in. */
+    int cnt;                    /* Number of entries in ENTS. */
+    int flags;                  /* GETDENTS_* flags. */
+  };
+
+/* A directory entry written by getdents(). */
+struct dirent
+  {
+    char name[READDIR_MAX_LEN + 1];     /* Null terminated file name. */
+    unsigned inumber;                   /* Inode number, with PLUS. */
+    unsigned size;                      /* Size in bytes, with PLUS. */
+  };
+
+/* Flags for getdents(). */
+#define GETDENTS_PLUS 0x01      /* Fill in INUMBER and SIZE too. */
+
+/* A buffer for readv() and writev(). */
+struct iovec
+  {
+    void *iov_base;             /* Start of buffer. */
+    size_t iov_len;             /* Length of buffer in bytes. */
+  };
+
+/* System call ring.
+
+   A program that issues many small reads and writes may queue
+   them in a ring in its own memory and have the kernel process
+   the whole batch with one ring_enter() call.  The program adds
+   entries to SQES at SQ_TAIL and the kernel consumes them at
+   SQ_HEAD; the kernel posts a completion for each to CQES at
+   CQ_TAIL and the program consumes them at CQ_HEAD.  The indexes
+   run freely and are reduced modulo ENTRIES, a power of 2 no
+   greater than RING_MAX.
+
+   RING_READ_ASYNC and RING_WRITE_ASYNC are not finished by the
+   ring_enter() that submits them: they transfer in the
+   background, up to RING_ASYNC_MAX bytes each, while the program
+   goes on running, so that it may keep several in flight.  Each
+   holds a completion slot until it finishes, which a later
+   ring_enter() or ring_wait() posts.  Their buffer must stay
+   valid until then.  They work only on files, not on pipes or
+   the console, and do not see or update pages of the file mapped
+   with mmap() and not yet written back. */
+#define RING_MAX 256
+#define RING_ASYNC_MAX 65536
+
+/* Operations that a ring can submit. */
+enum ring_op
+  {
+    RING_READ,                  /* read (FD, BUF, SIZE). */
+    RING_WRITE,                 /* write (FD, BUF, SIZE). */
+    RING_SEEK,                  /* seek (FD, SIZE). */
+    RING_CLOSE,                 /* close (FD). */
+    RING_READ_ASYNC,            /* Read SIZE bytes at OFFSET into BUF. */
+    RING_WRITE_ASYNC            /* Write SIZE bytes at OFFSET from BUF. */
+  };
+
+/* A submission queue entry. */
+struct ring_sqe
+  {
+    int op;                     /* One of enum ring_op. */
+    int fd;                     /* File descriptor. */
+    void *buf;                  /* Buffer for RING_READ, RING_WRITE. */
+    unsigned size;              /* Byte count, or RING_SEEK position. */
+    unsigned user_data;         /* Copied to the completion. */
+    unsigned offset;            /* File offset for RING_*_ASYNC. */
+  };
+
+/* A completion queue entry. */
+struct ring_cqe
+  {
+    unsigned user_data;         /* From the submission. */
+    int res;                    /* Result of read() or write(), else 0,
+                                   or -1 for an unknown operation. */
+  };
+
+/* A submission and completion ring pair. */
+struct ring
+  {
+    unsigned entries;           /* Entries in each of SQES, CQES. */
+    unsigned sq_head, sq_tail;  /* Submissions. */
+    unsigned cq_head, cq_tail;  /* Completions. */
+    struct ring_sqe *sqes;
+    struct ring_cqe *cqes;
+  };
+
+/* A file descriptor for poll() to check, with the events to wait
+   for in EVENTS.  poll() sets REVENTS to those that occurred, plus
+   POLLHUP and POLLNVAL, which need not be asked for.  Regular
+   files, and the console for output, are always ready. */
+struct pollfd
+  {
+    int fd;                     /* File descriptor, or negative to skip. */
+    short events;               /* POLL* events of interest. */
+    short revents;              /* POLL* events that occurred. */
+  };
+
+/* Events for poll(). */
+#define POLLIN 0x01             /* read() would not wait. */
+#define POLLOUT 0x04            /* write() would not wait. */
+#define POLLHUP 0x10            /* Other end of pipe closed. */
+#define POLLNVAL 0x20           /* FD is not open. */
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
 #define EXIT_FAILURE 1          /* Unsuccessful execution. */
@@ -45,4 +246,43 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool vmstat (struct vmstat *, bool system);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+bool ring_setup (struct ring *);
+int ring_enter (void);
+int ring_wait (void);
+pid_t fork (void);
+int64_t clock_ns (void);
+void lockstat (void);
+void memstat (void);
+void iostat (void);
+int read_input (void *, unsigned size, int timeout);
+bool pipe (int fds[2]);
+mapid_t shm_map (const char *name, void *addr, unsigned size);
+bool shm_unlink (const char *name);
+bool msync (mapid_t, int flags);
+mapid_t mmap_range (int fd, void *addr, unsigned offset, size_t length,
+                    int flags);
+bool madvise (void *addr, size_t length, int advice);
+pid_t thread_spawn (void (*func) (void *), void *aux);
+int futex (int *addr, int op, int val);
+void *sbrk (intptr_t increment);
+pid_t spawn (const char *file);
+int spawn_many (const char **files, int cnt, pid_t *pids);
+int sched_group (int tickets);
+int io_group (int iops, int kbps);
+bool getrusage (int who, struct rusage *);
+void syscallstat (void);
+bool fallocate (int fd, unsigned offset, unsigned length, int flags);
+int copy_file_range (int in_fd, int out_fd, unsigned length);
+bool fsync (int fd);
+void sync (void);
+int getdents (unsigned *cookie, struct dirent *ents, int cnt, int flags);
+int poll (struct pollfd *, int cnt, int timeout);
+int mempressure (int level, int timeout);
+int uffd_register (void *addr, size_t length);
+int uffd_copy (void *dst, const void *src, size_t length);
+
 #endif /* lib/user/syscall.h */
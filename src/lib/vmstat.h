@@ -0,0 +1,38 @@
+#ifndef __LIB_VMSTAT_H
+#define __LIB_VMSTAT_H
+
+/* Virtual memory statistics, kept for each process and for the
+   whole system, and copied to user programs by the vmstat system
+   call. */
+
+/* Number of buckets in the fault latency histogram.  Bucket I
+   counts faults serviced in [2**(I + 10), 2**(I + 11)) TSC
+   cycles; the first bucket also counts faster faults and the
+   last one slower faults. */
+#define VMSTAT_LATENCY_BUCKETS 16
+
+struct vmstat
+  {
+    /* Page faults. */
+    long long minor_faults;             /* Resolved without I/O. */
+    long long major_faults;             /* Required reading a page. */
+    long long file_faults;              /* Faults on file pages. */
+    long long swap_faults;              /* Faults on swapped pages. */
+    long long zero_faults;              /* Faults on zero pages. */
+    long long cow_faults;               /* Copy-on-write faults. */
+
+    /* Page replacement. */
+    long long evictions;                /* Frames evicted. */
+    long long scan_steps;               /* Frames examined for victims. */
+    long long lock_contention;          /* Frame lock attempts failed. */
+
+    /* Swap. */
+    long long swap_ins;                 /* Pages read from swap. */
+    long long swap_outs;                /* Pages written to swap. */
+    long long file_writes;              /* Pages written back to files. */
+
+    /* Fault service latency histogram. */
+    long long latency[VMSTAT_LATENCY_BUCKETS];
+  };
+
+#endif /* lib/vmstat.h */
@@ -0,0 +1,290 @@
+/* Benchmarks for the data structures in lib/kernel and for
+   malloc() and the string functions.
+
+   Times hash_insert() and hash_find() at growing table sizes,
+   list_sort() and list_max(), bitmap_scan_and_flip() on a
+   fragmented bitmap, malloc() and free() churning through the
+   size classes, memcpy() and memset() at several sizes and
+   alignments, and crc32c() with and without the "crc32"
+   instruction.  Prints the time each operation takes, from the
+   time-stamp counter, as a baseline for changes to them.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <crc32c.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/test.h"
+#include "devices/timer.h"
+
+/* Largest number of elements in a hash table or list. */
+#define MAX_ELEMS 16384
+
+/* Largest block copied or set. */
+#define MAX_BLOCK 65536
+
+/* A hash table or list element. */
+struct elem
+  {
+    struct hash_elem hash_elem;
+    struct list_elem list_elem;
+    int key;
+  };
+
+static struct elem elems[MAX_ELEMS];
+static uint8_t src_buf[MAX_BLOCK + 8];
+static uint8_t dst_buf[MAX_BLOCK + 8];
+
+static void bench_hash (void);
+static void bench_list (void);
+static void bench_bitmap (void);
+static void bench_malloc (void);
+static void bench_string (void);
+static void bench_crc (void);
+static void report (const char *name, int size, uint64_t cycles, int ops);
+static unsigned elem_hash (const struct hash_elem *, void *);
+static bool elem_hash_less (const struct hash_elem *,
+                            const struct hash_elem *, void *);
+static bool elem_list_less (const struct list_elem *,
+                            const struct list_elem *, void *);
+
+/* Runs the benchmarks. */
+void
+test (void)
+{
+  random_init (0);
+  bench_hash ();
+  bench_list ();
+  bench_bitmap ();
+  bench_malloc ();
+  bench_string ();
+  bench_crc ();
+  printf ("done\n");
+}
+
+/* Fills a hash table with 64 up to MAX_ELEMS elements, timing
+   each insertion, then looks every element up. */
+static void
+bench_hash (void)
+{
+  int size;
+
+  for (size = 64; size <= MAX_ELEMS; size *= 4)
+    {
+      struct hash hash;
+      struct elem key;
+      uint64_t start;
+      int i;
+
+      ASSERT (hash_init (&hash, elem_hash, elem_hash_less, NULL));
+      for (i = 0; i < size; i++)
+        elems[i].key = random_ulong ();
+
+      start = clock_cycles ();
+      for (i = 0; i < size; i++)
+        hash_insert (&hash, &elems[i].hash_elem);
+      report ("hash_insert", size, clock_cycles () - start, size);
+
+      start = clock_cycles ();
+      for (i = 0; i < size; i++)
+        {
+          key.key = elems[i].key;
+          ASSERT (hash_find (&hash, &key.hash_elem) != NULL);
+        }
+      report ("hash_find", size, clock_cycles () - start, size);
+
+      hash_destroy (&hash, NULL);
+    }
+}
+
+/* Sorts, and finds the maximum of, lists of random values. */
+static void
+bench_list (void)
+{
+  int size;
+
+  for (size = 64; size <= MAX_ELEMS; size *= 4)
+    {
+      struct list list;
+      uint64_t start;
+      int i;
+
+      list_init (&list);
+      for (i = 0; i < size; i++)
+        {
+          elems[i].key = random_ulong ();
+          list_push_back (&list, &elems[i].list_elem);
+        }
+
+      start = clock_cycles ();
+      list_max (&list, elem_list_less, NULL);
+      report ("list_max", size, clock_cycles () - start, size);
+
+      start = clock_cycles ();
+      list_sort (&list, elem_list_less, NULL);
+      report ("list_sort", size, clock_cycles () - start, size);
+    }
+}
+
+/* Allocates runs of 1 and 8 bits from a bitmap in which a random
+   half of the bits are already set, and frees each run again. */
+static void
+bench_bitmap (void)
+{
+  enum { BITS = 16384, RUNS = 1000 };
+  struct bitmap *b = bitmap_create (BITS);
+  size_t cnt;
+  int i;
+
+  ASSERT (b != NULL);
+  for (i = 0; i < BITS; i++)
+    bitmap_set (b, i, random_ulong () & 1);
+
+  for (cnt = 1; cnt <= 8; cnt *= 8)
+    {
+      uint64_t start = clock_cycles ();
+      for (i = 0; i < RUNS; i++)
+        {
+          size_t idx = bitmap_scan_and_flip (b, 0, cnt, false);
+          ASSERT (idx != BITMAP_ERROR);
+          bitmap_set_multiple (b, idx, cnt, false);
+        }
+      report ("bitmap_scan_and_flip", cnt, clock_cycles () - start, RUNS);
+    }
+  bitmap_destroy (b);
+}
+
+/* Keeps 256 blocks of random sizes from 1 to 2,048 bytes
+   allocated, freeing one and allocating another in its place,
+   so that every size class sees blocks come and go. */
+static void
+bench_malloc (void)
+{
+  enum { SLOTS = 256, OPS = 10000 };
+  void *slots[SLOTS];
+  uint64_t start;
+  int i;
+
+  for (i = 0; i < SLOTS; i++)
+    ASSERT ((slots[i] = malloc (random_ulong () % 2048 + 1)) != NULL);
+
+  start = clock_cycles ();
+  for (i = 0; i < OPS; i++)
+    {
+      size_t slot = random_ulong () % SLOTS;
+      free (slots[slot]);
+      ASSERT ((slots[slot] = malloc (random_ulong () % 2048 + 1)) != NULL);
+    }
+  report ("malloc+free", 2048, clock_cycles () - start, OPS);
+
+  for (i = 0; i < SLOTS; i++)
+    free (slots[i]);
+}
+
+/* Times memcpy() and memset() of 16 bytes up to MAX_BLOCK bytes,
+   with the destination aligned and not. */
+static void
+bench_string (void)
+{
+  static const int aligns[] = {0, 1, 3};
+  size_t a;
+  int size;
+
+  for (size = 16; size <= MAX_BLOCK; size *= 16)
+    for (a = 0; a < sizeof aligns / sizeof *aligns; a++)
+      {
+        int runs = MAX_BLOCK / size < 64 ? 64 : MAX_BLOCK / size;
+        uint8_t *dst = dst_buf + aligns[a];
+        char name[32];
+        uint64_t start;
+        int i;
+
+        start = clock_cycles ();
+        for (i = 0; i < runs; i++)
+          memcpy (dst, src_buf, size);
+        snprintf (name, sizeof name, "memcpy+%d", aligns[a]);
+        report (name, size, clock_cycles () - start, runs);
+
+        start = clock_cycles ();
+        for (i = 0; i < runs; i++)
+          memset (dst, i, size);
+        snprintf (name, sizeof name, "memset+%d", aligns[a]);
+        report (name, size, clock_cycles () - start, runs);
+      }
+}
+
+/* Checks crc32c() against a known value, then times it, and the
+   table-driven loop behind it, over 64 bytes up to MAX_BLOCK
+   bytes. */
+static void
+bench_crc (void)
+{
+  int size;
+  int i;
+
+  ASSERT (crc32c (0, "123456789", 9) == 0xe3069283);
+  ASSERT (crc32c_sw (0, "123456789", 9) == 0xe3069283);
+  for (i = 0; i < MAX_BLOCK; i++)
+    src_buf[i] = random_ulong ();
+  ASSERT (crc32c (0, src_buf + 1, MAX_BLOCK - 1)
+          == crc32c_sw (0, src_buf + 1, MAX_BLOCK - 1));
+
+  printf ("crc32c: %s\n", crc32c_hw_enabled () ? "using crc32" : "tables");
+  for (size = 64; size <= MAX_BLOCK; size *= 16)
+    {
+      int runs = MAX_BLOCK / size < 64 ? 64 : MAX_BLOCK / size;
+      uint64_t start;
+
+      start = clock_cycles ();
+      for (i = 0; i < runs; i++)
+        crc32c (0, src_buf, size);
+      report ("crc32c", size, clock_cycles () - start, runs);
+
+      start = clock_cycles ();
+      for (i = 0; i < runs; i++)
+        crc32c_sw (0, src_buf, size);
+      report ("crc32c_sw", size, clock_cycles () - start, runs);
+    }
+}
+
+/* Prints that OPS operations NAME of the given SIZE took CYCLES
+   cycles in all. */
+static void
+report (const char *name, int size, uint64_t cycles, int ops)
+{
+  printf ("%-22s %6d: %8"PRIu64" cycles, %8"PRId64" ns per op\n",
+          name, size, cycles / ops, clock_cycles_to_ns (cycles) / ops);
+}
+
+static unsigned
+elem_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct elem, hash_elem)->key);
+}
+
+static bool
+elem_hash_less (const struct hash_elem *a, const struct hash_elem *b,
+                void *aux UNUSED)
+{
+  return (hash_entry (a, struct elem, hash_elem)->key
+          < hash_entry (b, struct elem, hash_elem)->key);
+}
+
+static bool
+elem_list_less (const struct list_elem *a, const struct list_elem *b,
+                void *aux UNUSED)
+{
+  return (list_entry (a, struct elem, list_elem)->key
+          < list_entry (b, struct elem, list_elem)->key);
+}
@@ -0,0 +1,154 @@
+/* Test program for bitmap_count(), bitmap_contains(),
+   bitmap_set_multiple() and bitmap_scan() in
+   lib/kernel/bitmap.c.
+
+   Checks the word-at-a-time implementations against simple bit
+   loops, the way lib/kernel/bitmap.c used to implement them, on
+   random bitmaps of many sizes and densities, then compares how
+   many cycles a scan for a free run takes in a large, nearly
+   full bitmap.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest bitmap checked for correctness, and how many random
+   operations are checked on each. */
+#define MAX_BITS 1100
+#define CHECK_OPS 64
+
+/* Size of the bitmap timed, and how many times each scan is run. */
+#define BENCH_BITS (1024 * 1024)
+#define BENCH_RUNS 4
+
+static size_t bit_count (const struct bitmap *, size_t, size_t, bool);
+static size_t bit_scan (const struct bitmap *, size_t, size_t, bool);
+static void check (void);
+static void bench (void);
+
+/* Test bitmap scanning functions. */
+void
+test (void)
+{
+  check ();
+  bench ();
+  printf ("bitmap: PASS\n");
+}
+
+/* Checks each function on random bitmaps of every size up to
+   MAX_BITS, in steps, filled to random densities. */
+static void
+check (void)
+{
+  size_t bit_cnt;
+
+  printf ("testing bitmaps...");
+  for (bit_cnt = 0; bit_cnt <= MAX_BITS; bit_cnt += 7)
+    {
+      struct bitmap *b = bitmap_create (bit_cnt);
+      unsigned density = random_ulong () % 101;
+      size_t i;
+
+      ASSERT (b != NULL);
+      for (i = 0; i < bit_cnt; i++)
+        bitmap_set (b, i, random_ulong () % 100 < density);
+
+      for (i = 0; i < CHECK_OPS; i++)
+        {
+          size_t start = random_ulong () % (bit_cnt + 1);
+          size_t cnt = random_ulong () % (bit_cnt - start + 1);
+          size_t run = random_ulong () % 70;
+          bool value = random_ulong () % 2;
+
+          if (i % 4 == 0)
+            bitmap_set_multiple (b, start, cnt, value);
+          ASSERT (bitmap_count (b, start, cnt, value)
+                  == bit_count (b, start, cnt, value));
+          ASSERT (bitmap_contains (b, start, cnt, value)
+                  == (bit_count (b, start, cnt, value) > 0));
+          ASSERT (bitmap_scan (b, start, run, value)
+                  == bit_scan (b, start, run, value));
+        }
+      bitmap_destroy (b);
+    }
+  printf (" done\n");
+}
+
+/* Prints the average number of cycles taken by the old and the
+   new bitmap_scan() to find a free run near the end of a
+   BENCH_BITS bitmap with scattered free bits. */
+static void
+bench (void)
+{
+  struct bitmap *b = bitmap_create (BENCH_BITS);
+  uint64_t start, old, new;
+  size_t i;
+  int j;
+
+  ASSERT (b != NULL);
+  bitmap_set_all (b, true);
+  for (i = 0; i < BENCH_BITS / 2; i += 4099)
+    bitmap_reset (b, i);
+  bitmap_set_multiple (b, BENCH_BITS - 64, 8, false);
+
+#define BENCH(NAME, OLD, NEW)                                   \
+  start = clock_cycles ();                                      \
+  for (j = 0; j < BENCH_RUNS; j++)                              \
+    ASSERT (OLD == BENCH_BITS - 64);                            \
+  old = (clock_cycles () - start) / BENCH_RUNS;                 \
+  start = clock_cycles ();                                      \
+  for (j = 0; j < BENCH_RUNS; j++)                              \
+    ASSERT (NEW == BENCH_BITS - 64);                            \
+  new = (clock_cycles () - start) / BENCH_RUNS;                 \
+  printf ("%-12s %10"PRIu64" cycles before, %10"PRIu64" after\n",\
+          NAME, old, new);
+
+  BENCH ("scan 1", bit_scan (b, BENCH_BITS / 2, 1, false),
+         bitmap_scan (b, BENCH_BITS / 2, 1, false));
+  BENCH ("scan 8", bit_scan (b, 0, 8, false),
+         bitmap_scan (b, 0, 8, false));
+#undef BENCH
+
+  bitmap_destroy (b);
+}
+
+/* The old bitmap_count(), a bit at a time. */
+static size_t
+bit_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = 0; i < cnt; i++)
+    if (bitmap_test (b, start + i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* The old bitmap_scan(), checking every starting bit a bit at a
+   time. */
+static size_t
+bit_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t bit_cnt = bitmap_size (b);
+
+  if (cnt <= bit_cnt)
+    {
+      size_t last = bit_cnt - cnt;
+      size_t i;
+
+      for (i = start; i <= last; i++)
+        if (bit_count (b, i, cnt, value) == cnt)
+          return i;
+    }
+  return BITMAP_ERROR;
+}
@@ -0,0 +1,179 @@
+/* Test program for lib/kernel/heap.c.
+
+   Pushes, pops, removes, and updates random values, checking the
+   heap's shape and order after each step, then compares how many
+   cycles it takes to repeatedly take the greatest element of a
+   heap and of a list scanned with list_max().
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <heap.h>
+#include <inttypes.h>
+#include <list.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Maximum number of elements in a heap that we will test. */
+#define MAX_SIZE 256
+
+/* Number of elements timed. */
+#define BENCH_SIZE 1024
+
+/* A heap element. */
+struct value 
+  {
+    struct heap_elem heap_elem;         /* Heap element. */
+    struct list_elem list_elem;         /* List element, for timing. */
+    int value;                          /* Item value. */
+    bool in_heap;                       /* In the heap? */
+  };
+
+static struct value values[BENCH_SIZE];
+
+static bool value_less (const struct heap_elem *,
+                        const struct heap_elem *, void *);
+static bool value_list_less (const struct list_elem *,
+                             const struct list_elem *, void *);
+static size_t verify (struct heap_elem *, struct heap_elem *parent);
+static void bench (void);
+
+/* Test the binary heap implementation. */
+void
+test (void) 
+{
+  struct heap heap;
+  size_t size = 0;
+  int i;
+
+  printf ("testing binary heap...");
+  heap_init (&heap, value_less, NULL);
+  for (i = 0; i < 20000; i++)
+    {
+      struct value *v = &values[random_ulong () % MAX_SIZE];
+
+      switch (random_ulong () % 4)
+        {
+        case 0:
+          if (!heap_empty (&heap))
+            {
+              struct value *top = heap_entry (heap_pop (&heap),
+                                              struct value, heap_elem);
+              size_t j;
+
+              for (j = 0; j < MAX_SIZE; j++)
+                ASSERT (!values[j].in_heap || values[j].value <= top->value);
+              top->in_heap = false;
+              size--;
+            }
+          break;
+
+        case 1:
+          if (v->in_heap)
+            {
+              v->value = random_ulong () % MAX_SIZE;
+              heap_update (&heap, &v->heap_elem);
+            }
+          break;
+
+        default:
+          if (!v->in_heap)
+            {
+              v->value = random_ulong () % MAX_SIZE;
+              heap_push (&heap, &v->heap_elem);
+              size++;
+            }
+          else
+            {
+              heap_remove (&heap, &v->heap_elem);
+              size--;
+            }
+          v->in_heap = !v->in_heap;
+          break;
+        }
+
+      ASSERT (heap_size (&heap) == size);
+      ASSERT (verify (heap.root, NULL) == size);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("heap: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct heap_elem *a_, const struct heap_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct value *a = heap_entry (a_, struct value, heap_elem);
+  const struct value *b = heap_entry (b_, struct value, heap_elem);
+  
+  return a->value < b->value;
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_list_less (const struct list_elem *a_, const struct list_elem *b_,
+                 void *aux UNUSED) 
+{
+  const struct value *a = list_entry (a_, struct value, list_elem);
+  const struct value *b = list_entry (b_, struct value, list_elem);
+  
+  return a->value < b->value;
+}
+
+/* Verifies the links and order of the subtree rooted at E, whose
+   parent is PARENT, and returns its number of elements. */
+static size_t
+verify (struct heap_elem *e, struct heap_elem *parent) 
+{
+  if (e == NULL)
+    return 0;
+  ASSERT (e->parent == parent);
+  ASSERT (parent == NULL || !value_less (parent, e, NULL));
+  ASSERT (e->right == NULL || e->left != NULL);
+  return 1 + verify (e->left, e) + verify (e->right, e);
+}
+
+/* Prints the average number of cycles taken to fill a list and a
+   heap with BENCH_SIZE random values and take them back out
+   greatest first. */
+static void
+bench (void) 
+{
+  struct heap heap;
+  struct list list;
+  uint64_t start, list_cycles, heap_cycles;
+  int i;
+
+  for (i = 0; i < BENCH_SIZE; i++)
+    values[i].value = random_ulong ();
+
+  start = clock_cycles ();
+  list_init (&list);
+  for (i = 0; i < BENCH_SIZE; i++)
+    list_push_back (&list, &values[i].list_elem);
+  while (!list_empty (&list))
+    list_remove (list_max (&list, value_list_less, NULL));
+  list_cycles = (clock_cycles () - start) / BENCH_SIZE;
+
+  start = clock_cycles ();
+  heap_init (&heap, value_less, NULL);
+  for (i = 0; i < BENCH_SIZE; i++)
+    heap_push (&heap, &values[i].heap_elem);
+  while (!heap_empty (&heap))
+    heap_pop (&heap);
+  heap_cycles = (clock_cycles () - start) / BENCH_SIZE;
+
+  printf ("%d elements: %"PRIu64" cycles each in a list, "
+          "%"PRIu64" in a heap\n", BENCH_SIZE, list_cycles, heap_cycles);
+}
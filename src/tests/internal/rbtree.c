@@ -0,0 +1,181 @@
+/* Test program for lib/kernel/rbtree.c.
+
+   Inserts and removes random values, checking the red-black
+   invariants and the order of the tree after each step, then
+   compares how many cycles it takes to keep a sorted set of
+   elements in a tree and in an ordered list.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <random.h>
+#include <rbtree.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Maximum number of elements in a tree that we will test. */
+#define MAX_SIZE 256
+
+/* Number of elements timed. */
+#define BENCH_SIZE 1024
+
+/* A tree element. */
+struct value 
+  {
+    struct rbtree_elem tree_elem;       /* Tree element. */
+    struct list_elem list_elem;         /* List element, for timing. */
+    int value;                          /* Item value. */
+    bool in_tree;                       /* In the tree? */
+  };
+
+static struct value values[BENCH_SIZE];
+
+static bool value_less (const struct rbtree_elem *,
+                        const struct rbtree_elem *, void *);
+static bool value_list_less (const struct list_elem *,
+                             const struct list_elem *, void *);
+static int verify (struct rbtree_elem *, struct rbtree_elem *parent);
+static void verify_order (struct rbtree *, size_t size);
+static void bench (void);
+
+/* Test the red-black tree implementation. */
+void
+test (void) 
+{
+  struct rbtree tree;
+  size_t size = 0;
+  int i;
+
+  printf ("testing red-black tree...");
+  rbtree_init (&tree, value_less, NULL);
+  for (i = 0; i < 20000; i++)
+    {
+      struct value *v = &values[random_ulong () % MAX_SIZE];
+
+      if (!v->in_tree)
+        {
+          v->value = random_ulong () % (MAX_SIZE / 2);
+          rbtree_insert (&tree, &v->tree_elem);
+          size++;
+        }
+      else
+        {
+          rbtree_remove (&tree, &v->tree_elem);
+          size--;
+        }
+      v->in_tree = !v->in_tree;
+
+      ASSERT (rbtree_size (&tree) == size);
+      ASSERT (tree.root == NULL || !tree.root->red);
+      verify (tree.root, NULL);
+      if (i % 64 == 0)
+        verify_order (&tree, size);
+    }
+  printf (" done\n");
+
+  bench ();
+  printf ("rbtree: PASS\n");
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+            void *aux UNUSED) 
+{
+  const struct value *a = rbtree_entry (a_, struct value, tree_elem);
+  const struct value *b = rbtree_entry (b_, struct value, tree_elem);
+  
+  return a->value < b->value;
+}
+
+/* Returns true if value A is less than value B, false
+   otherwise. */
+static bool
+value_list_less (const struct list_elem *a_, const struct list_elem *b_,
+                 void *aux UNUSED) 
+{
+  const struct value *a = list_entry (a_, struct value, list_elem);
+  const struct value *b = list_entry (b_, struct value, list_elem);
+  
+  return a->value < b->value;
+}
+
+/* Verifies the links and colors of the subtree rooted at E,
+   whose parent is PARENT, and returns its black height. */
+static int
+verify (struct rbtree_elem *e, struct rbtree_elem *parent) 
+{
+  int left, right;
+
+  if (e == NULL)
+    return 1;
+  ASSERT (e->parent == parent);
+  ASSERT (!e->red || e->left == NULL || !e->left->red);
+  ASSERT (!e->red || e->right == NULL || !e->right->red);
+  left = verify (e->left, e);
+  right = verify (e->right, e);
+  ASSERT (left == right);
+  return left + !e->red;
+}
+
+/* Verifies that TREE holds SIZE elements in order, forward,
+   backward, and by search. */
+static void
+verify_order (struct rbtree *tree, size_t size) 
+{
+  struct rbtree_elem *e, *prev = NULL;
+  size_t cnt = 0;
+
+  for (e = rbtree_min (tree); e != NULL; prev = e, e = rbtree_next (e))
+    {
+      ASSERT (prev == NULL || !value_less (e, prev, NULL));
+      ASSERT (rbtree_prev (e) == prev);
+      ASSERT (rbtree_find (tree, e) != NULL);
+      ASSERT (rbtree_lower_bound (tree, e) == rbtree_find (tree, e));
+      cnt++;
+    }
+  ASSERT (prev == rbtree_max (tree));
+  ASSERT (cnt == size);
+}
+
+/* Prints the average number of cycles taken to insert BENCH_SIZE
+   random values into an ordered list and into a tree, and to
+   take them back out smallest first. */
+static void
+bench (void) 
+{
+  struct rbtree tree;
+  struct list list;
+  uint64_t start, list_cycles, tree_cycles;
+  int i;
+
+  for (i = 0; i < BENCH_SIZE; i++)
+    values[i].value = random_ulong ();
+
+  start = clock_cycles ();
+  list_init (&list);
+  for (i = 0; i < BENCH_SIZE; i++)
+    list_insert_ordered (&list, &values[i].list_elem, value_list_less, NULL);
+  while (!list_empty (&list))
+    list_pop_front (&list);
+  list_cycles = (clock_cycles () - start) / BENCH_SIZE;
+
+  start = clock_cycles ();
+  rbtree_init (&tree, value_less, NULL);
+  for (i = 0; i < BENCH_SIZE; i++)
+    rbtree_insert (&tree, &values[i].tree_elem);
+  while (!rbtree_empty (&tree))
+    rbtree_pop_min (&tree);
+  tree_cycles = (clock_cycles () - start) / BENCH_SIZE;
+
+  printf ("%d elements: %"PRIu64" cycles each in a list, "
+          "%"PRIu64" in a tree\n", BENCH_SIZE, list_cycles, tree_cycles);
+}
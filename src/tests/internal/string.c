@@ -0,0 +1,206 @@
+/* Test program for memcpy(), memmove(), memset() and
+   memzero_page() in lib/string.c.
+
+   Checks the word-at-a-time implementations against simple byte
+   loops, the way lib/string.c used to implement them, for every
+   combination of small sizes and alignments, then compares how
+   many cycles each takes on large blocks.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest block checked for correctness. */
+#define MAX_SIZE 80
+
+/* Size of the blocks timed, and how many times each is run. */
+#define BENCH_SIZE 4096
+#define BENCH_RUNS 256
+
+static uint8_t src_buf[BENCH_SIZE + 8];
+static uint8_t dst_buf[BENCH_SIZE + 8];
+static uint8_t ref_buf[BENCH_SIZE + 8];
+static uint8_t page[4096] __attribute__ ((aligned (4096)));
+
+static void byte_memcpy (void *, const void *, size_t);
+static void byte_memmove (void *, const void *, size_t);
+static void byte_memset (void *, int, size_t);
+static void check_copies (void);
+static void check_moves (void);
+static void check_sets (void);
+static void bench (void);
+
+/* Test memory block functions. */
+void
+test (void)
+{
+  check_copies ();
+  check_moves ();
+  check_sets ();
+  bench ();
+  printf ("string: PASS\n");
+}
+
+/* Fills the source buffer with random bytes and the destination
+   and reference buffers with the same different ones. */
+static void
+fill (void)
+{
+  size_t i;
+
+  random_bytes (src_buf, sizeof src_buf);
+  for (i = 0; i < sizeof dst_buf; i++)
+    dst_buf[i] = ref_buf[i] = ~src_buf[i];
+}
+
+/* Checks memcpy() for every size up to MAX_SIZE and every
+   alignment of source and destination. */
+static void
+check_copies (void)
+{
+  size_t size, s, d;
+
+  printf ("testing memcpy...");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (s = 0; s < 4; s++)
+      for (d = 0; d < 4; d++)
+        {
+          fill ();
+          ASSERT (memcpy (dst_buf + d, src_buf + s, size) == dst_buf + d);
+          byte_memcpy (ref_buf + d, src_buf + s, size);
+          ASSERT (!memcmp (dst_buf, ref_buf, MAX_SIZE + 8));
+        }
+  printf (" done\n");
+}
+
+/* Checks memmove() within one buffer, for every size up to
+   MAX_SIZE and every distance between blocks up to 8 bytes in
+   either direction. */
+static void
+check_moves (void)
+{
+  size_t size, s, d;
+
+  printf ("testing memmove...");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (s = 0; s <= 8; s++)
+      for (d = 0; d <= 8; d++)
+        {
+          fill ();
+          memcpy (dst_buf, src_buf, sizeof dst_buf);
+          memcpy (ref_buf, src_buf, sizeof ref_buf);
+          ASSERT (memmove (dst_buf + d, dst_buf + s, size) == dst_buf + d);
+          byte_memmove (ref_buf + d, ref_buf + s, size);
+          ASSERT (!memcmp (dst_buf, ref_buf, MAX_SIZE + 8));
+        }
+  printf (" done\n");
+}
+
+/* Checks memset() for every size up to MAX_SIZE and alignment,
+   and memzero_page(). */
+static void
+check_sets (void)
+{
+  size_t size, d;
+
+  printf ("testing memset...");
+  for (size = 0; size <= MAX_SIZE; size++)
+    for (d = 0; d < 4; d++)
+      {
+        fill ();
+        ASSERT (memset (dst_buf + d, 0xa5, size) == dst_buf + d);
+        byte_memset (ref_buf + d, 0xa5, size);
+        ASSERT (!memcmp (dst_buf, ref_buf, MAX_SIZE + 8));
+      }
+
+  random_bytes (page, sizeof page);
+  memzero_page (page);
+  for (d = 0; d < sizeof page; d++)
+    ASSERT (page[d] == 0);
+  printf (" done\n");
+}
+
+/* Prints the average number of cycles taken by the old and the
+   new implementation of each function on BENCH_SIZE bytes. */
+static void
+bench (void)
+{
+  uint64_t start, old, new;
+  int i;
+
+#define BENCH(NAME, OLD, NEW)                                   \
+  start = clock_cycles ();                                      \
+  for (i = 0; i < BENCH_RUNS; i++)                              \
+    OLD;                                                        \
+  old = (clock_cycles () - start) / BENCH_RUNS;                 \
+  start = clock_cycles ();                                      \
+  for (i = 0; i < BENCH_RUNS; i++)                              \
+    NEW;                                                        \
+  new = (clock_cycles () - start) / BENCH_RUNS;                 \
+  printf ("%-12s %8"PRIu64" cycles before, %8"PRIu64" after\n",  \
+          NAME, old, new);
+
+  BENCH ("memcpy", byte_memcpy (dst_buf, src_buf, BENCH_SIZE),
+         memcpy (dst_buf, src_buf, BENCH_SIZE));
+  BENCH ("memcpy+1", byte_memcpy (dst_buf + 1, src_buf, BENCH_SIZE),
+         memcpy (dst_buf + 1, src_buf, BENCH_SIZE));
+  BENCH ("memmove", byte_memmove (dst_buf + 4, dst_buf, BENCH_SIZE),
+         memmove (dst_buf + 4, dst_buf, BENCH_SIZE));
+  BENCH ("memset", byte_memset (dst_buf, 0, BENCH_SIZE),
+         memset (dst_buf, 0, BENCH_SIZE));
+  BENCH ("memzero_page", byte_memset (page, 0, sizeof page),
+         memzero_page (page));
+#undef BENCH
+}
+
+/* The old memcpy(), a byte at a time. */
+static void
+byte_memcpy (void *dst_, const void *src_, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  while (size-- > 0)
+    *dst++ = *src++;
+}
+
+/* The old memmove(), a byte at a time. */
+static void
+byte_memmove (void *dst_, const void *src_, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+  const unsigned char *src = src_;
+
+  if (dst < src)
+    {
+      while (size-- > 0)
+        *dst++ = *src++;
+    }
+  else
+    {
+      dst += size;
+      src += size;
+      while (size-- > 0)
+        *--dst = *--src;
+    }
+}
+
+/* The old memset(), a byte at a time. */
+static void
+byte_memset (void *dst_, int value, size_t size)
+{
+  volatile unsigned char *dst = dst_;
+
+  while (size-- > 0)
+    *dst++ = value;
+}
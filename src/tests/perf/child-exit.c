@@ -0,0 +1,7 @@
+/* Child process of perf-exec, which exits right away. */
+
+int
+main (void)
+{
+  return 0;
+}
@@ -0,0 +1,27 @@
+/* Measures exec/wait latency: runs child-exit, which does
+   nothing, and waits for it, 16 times. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define CHILD_CNT 16
+
+void
+test_main (void)
+{
+  struct perf perf;
+  int i;
+
+  perf_start (&perf, "exec-wait");
+  for (i = 0; i < CHILD_CNT; i++)
+    {
+      pid_t pid = exec ("child-exit");
+      if (pid == PID_ERROR)
+        fail ("exec of child %d failed", i);
+      if (wait (pid) != 0)
+        fail ("child %d exited abnormally", i);
+    }
+  perf_stop (&perf, CHILD_CNT, 0);
+}
@@ -0,0 +1,34 @@
+/* Measures page fault throughput: touches each page of a 512 kB
+   buffer, then frees them all with madvise(), so that every
+   round takes a fresh zero-fill fault on every page. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 128
+#define ROUNDS 8
+
+static char buf[PAGE_CNT * PAGE_SIZE]
+  __attribute__ ((aligned (PAGE_SIZE)));
+
+void
+test_main (void)
+{
+  struct perf perf;
+  int round;
+  size_t i;
+
+  perf_start (&perf, "fault");
+  for (round = 0; round < ROUNDS; round++)
+    {
+      for (i = 0; i < PAGE_CNT; i++)
+        buf[i * PAGE_SIZE] = round + 1;
+      if (!madvise (buf, sizeof buf, MADV_DONTNEED))
+        fail ("madvise failed");
+    }
+  perf_stop (&perf, (long long) ROUNDS * PAGE_CNT,
+             (long long) ROUNDS * sizeof buf);
+}
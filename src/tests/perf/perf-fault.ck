@@ -0,0 +1,4 @@
+# -*- perl -*-
+use tests::tests;
+use tests::perf::perf;
+check_perf (qw(fault));
@@ -0,0 +1,48 @@
+/* Measures file bandwidth: writes a 256 kB file in 4 kB blocks,
+   then reads it back 4 times. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define BLOCK_SIZE 4096
+#define BLOCK_CNT 64
+#define READ_ROUNDS 4
+
+static char buf[BLOCK_SIZE];
+
+void
+test_main (void)
+{
+  const char *file_name = "perf-file.dat";
+  struct perf perf;
+  int fd, round;
+  size_t i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  perf_start (&perf, "file-write");
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      buf[0] = i;
+      if (write (fd, buf, BLOCK_SIZE) != BLOCK_SIZE)
+        fail ("write of block %zu failed", i);
+    }
+  perf_stop (&perf, BLOCK_CNT, (long long) BLOCK_CNT * BLOCK_SIZE);
+
+  perf_start (&perf, "file-read");
+  for (round = 0; round < READ_ROUNDS; round++)
+    {
+      seek (fd, 0);
+      for (i = 0; i < BLOCK_CNT; i++)
+        if (read (fd, buf, BLOCK_SIZE) != BLOCK_SIZE
+            || buf[0] != (char) i)
+          fail ("read of block %zu failed", i);
+    }
+  perf_stop (&perf, (long long) READ_ROUNDS * BLOCK_CNT,
+             (long long) READ_ROUNDS * BLOCK_CNT * BLOCK_SIZE);
+
+  close (fd);
+}
@@ -0,0 +1,63 @@
+/* Measures the cost of read() and write() calls of 1 byte,
+   256 bytes, 4 kB and 64 kB on a 64 kB file, so that the cost of
+   entering the kernel can be told apart from the cost of copying
+   between user and kernel memory. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define FILE_SIZE 65536
+#define MAX_CALLS 1024
+
+static char buf[FILE_SIZE];
+
+/* Calls write() or read(), depending on WRITING, on FD with SIZE
+   bytes at a time, covering the file in order and starting over
+   at its beginning when it runs out, and reports it as NAME. */
+static void
+measure (int fd, const char *name, size_t size, bool writing)
+{
+  size_t per_file = FILE_SIZE / size;
+  size_t cnt = per_file < MAX_CALLS ? per_file : MAX_CALLS;
+  struct perf perf;
+  size_t i;
+
+  if (cnt < 16)
+    cnt = 16;
+  perf_start (&perf, name);
+  for (i = 0; i < cnt; i++)
+    {
+      int bytes;
+
+      if (i % per_file == 0)
+        seek (fd, 0);
+      bytes = (writing ? write (fd, buf, size) : read (fd, buf, size));
+      if (bytes != (int) size)
+        fail ("%s of %zu bytes returned %d", writing ? "write" : "read",
+              size, bytes);
+    }
+  perf_stop (&perf, cnt, (long long) cnt * size);
+}
+
+void
+test_main (void)
+{
+  const char *file_name = "perf-rw.dat";
+  int fd;
+
+  CHECK (create (file_name, FILE_SIZE), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  measure (fd, "write-1", 1, true);
+  measure (fd, "read-1", 1, false);
+  measure (fd, "write-256", 256, true);
+  measure (fd, "read-256", 256, false);
+  measure (fd, "write-4096", 4096, true);
+  measure (fd, "read-4096", 4096, false);
+  measure (fd, "write-65536", 65536, true);
+  measure (fd, "read-65536", 65536, false);
+
+  close (fd);
+}
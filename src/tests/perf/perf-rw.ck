@@ -0,0 +1,5 @@
+# -*- perl -*-
+use tests::tests;
+use tests::perf::perf;
+check_perf (qw(write-1 read-1 write-256 read-256 write-4096 read-4096
+	       write-65536 read-65536));
@@ -0,0 +1,32 @@
+/* Measures swap throughput: writes a 2 MB buffer, more than the
+   user pool holds, so that its pages are evicted to swap, then
+   reads it back and checks it. */
+
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 512
+
+static char buf[PAGE_CNT * PAGE_SIZE];
+
+void
+test_main (void)
+{
+  struct perf perf;
+  size_t i;
+
+  perf_start (&perf, "swap-write");
+  for (i = 0; i < PAGE_CNT; i++)
+    memset (buf + i * PAGE_SIZE, i & 0xff, PAGE_SIZE);
+  perf_stop (&perf, PAGE_CNT, sizeof buf);
+
+  perf_start (&perf, "swap-read");
+  for (i = 0; i < PAGE_CNT; i++)
+    if (buf[i * PAGE_SIZE] != (char) (i & 0xff)
+        || buf[i * PAGE_SIZE + PAGE_SIZE - 1] != (char) (i & 0xff))
+      fail ("page %zu has the wrong contents", i);
+  perf_stop (&perf, PAGE_CNT, sizeof buf);
+}
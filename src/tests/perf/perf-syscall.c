@@ -0,0 +1,28 @@
+/* Measures the system call rate with tell(), which does almost
+   no work in the kernel. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/perf/perf.h"
+
+#define CALL_CNT 10000
+
+void
+test_main (void)
+{
+  const char *file_name = "perf-syscall.dat";
+  struct perf perf;
+  int fd, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  perf_start (&perf, "syscall");
+  for (i = 0; i < CALL_CNT; i++)
+    if (tell (fd) != 0)
+      fail ("tell returned nonzero");
+  perf_stop (&perf, CALL_CNT, 0);
+
+  close (fd);
+}
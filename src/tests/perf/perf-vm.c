@@ -0,0 +1,239 @@
+/* VM stress benchmark, for sweeping working-set size against
+   memory, e.g. with the kernel's -ul option ("make perf-vm-sweep").
+
+   Usage: perf-vm PAGES PATTERN WRITE-PCT PROCS SOURCE [ACCESSES]
+   where PAGES is the working-set size in pages for each process,
+         PATTERN is "seq", "random", "zipf" or "stride",
+         WRITE-PCT is the percentage of accesses that write,
+         PROCS is the number of processes that run at once,
+         SOURCE is "anon" for heap memory from sbrk() or "mmap"
+           for a mapped file (which needs a big enough file system),
+     and ACCESSES is the number of pages each process touches
+         (default: 4 * PAGES).
+
+   Reports one "perf vm" line for the whole run, then a
+   "perf vm-faults" line with the system-wide page faults and
+   evictions during the run and the faults per second. */
+
+#include <random.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <vmstat.h>
+#include "tests/lib.h"
+#include "tests/perf/perf.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PAGES 16384         /* 64 MB. */
+#define MAX_PROCS 16
+#define STRIDE 17               /* Pages between stride accesses. */
+#define MMAP_BASE ((char *) 0x10000000)
+
+enum pattern
+  {
+    SEQUENTIAL,
+    RANDOM,
+    ZIPF,
+    STRIDED,
+    PATTERN_CNT
+  };
+
+/* Access pattern names, in the order of enum pattern. */
+static const char *pattern_names[] = {"seq", "random", "zipf", "stride"};
+
+/* For ZIPF, zipf_sums[I] is the sum of the weights of pages 0
+   through I, page I having weight ZIPF_SCALE / (I + 1). */
+#define ZIPF_SCALE 1000000
+static uint32_t zipf_sums[MAX_PAGES];
+
+static void usage (void) NO_RETURN;
+static void run (size_t pages, enum pattern, int write_pct,
+                 int source_mmap, long accesses, int child_idx);
+static size_t pick_page (size_t pages, enum pattern, long i);
+
+int
+main (int argc, char *argv[])
+{
+  struct vmstat before, after;
+  struct perf perf;
+  size_t pages;
+  enum pattern pattern;
+  int write_pct, procs, mmap_source, i;
+  long accesses;
+  int64_t ns;
+
+  test_name = "perf-vm";
+  if (argc != 6 && argc != 7)
+    usage ();
+  pages = atoi (argv[1]);
+  for (pattern = 0; pattern < PATTERN_CNT; pattern++)
+    if (!strcmp (argv[2], pattern_names[pattern]))
+      break;
+  write_pct = atoi (argv[3]);
+  procs = atoi (argv[4]);
+  mmap_source = !strcmp (argv[5], "mmap");
+  accesses = argc > 6 ? atoi (argv[6]) : 4 * (long) pages;
+  if (pages < 1 || pages > MAX_PAGES || pattern == PATTERN_CNT
+      || write_pct < 0 || write_pct > 100
+      || procs < -MAX_PROCS || procs == 0 || procs > MAX_PROCS
+      || (!mmap_source && strcmp (argv[5], "anon")) || accesses < 1)
+    usage ();
+
+  /* A negative PROCS marks one of the child processes that a
+     run with more than one process execs. */
+  if (procs < 0)
+    {
+      run (pages, pattern, write_pct, mmap_source, accesses, -procs);
+      return 0;
+    }
+
+  msg ("begin");
+  if (!vmstat (&before, true))
+    fail ("vmstat failed");
+  perf_start (&perf, "vm");
+  if (procs == 1)
+    run (pages, pattern, write_pct, mmap_source, accesses, 0);
+  else
+    {
+      pid_t pids[MAX_PROCS];
+
+      for (i = 0; i < procs; i++)
+        {
+          char cmd[128];
+
+          snprintf (cmd, sizeof cmd, "perf-vm %zu %s %d %d %s %ld",
+                    pages, argv[2], write_pct, -(i + 1), argv[5],
+                    accesses);
+          pids[i] = exec (cmd);
+          if (pids[i] == PID_ERROR)
+            fail ("exec \"%s\" failed", cmd);
+        }
+      for (i = 0; i < procs; i++)
+        if (wait (pids[i]) != 0)
+          fail ("child %d failed", i + 1);
+    }
+  ns = clock_ns () - perf.ns;
+  perf_stop (&perf, (long long) procs * accesses,
+             (long long) procs * accesses * PAGE_SIZE);
+  if (!vmstat (&after, true))
+    fail ("vmstat failed");
+
+  {
+    long long faults = ((after.minor_faults + after.major_faults)
+                        - (before.minor_faults + before.major_faults));
+    msg ("perf vm-faults faults %lld evictions %lld faults/s %lld",
+         faults, after.evictions - before.evictions,
+         ns > 0 ? faults * 1000000000LL / ns : 0);
+  }
+  msg ("end");
+  return 0;
+}
+
+/* Prints a usage message and exits. */
+static void
+usage (void)
+{
+  printf ("usage: perf-vm PAGES seq|random|zipf|stride WRITE-PCT PROCS "
+          "anon|mmap [ACCESSES]\n");
+  exit (1);
+}
+
+/* Makes PAGES pages of memory, from the heap or, if SOURCE_MMAP,
+   from a mapped file, and makes ACCESSES accesses to them in the
+   given PATTERN, WRITE_PCT percent of them writes.  CHILD_IDX
+   numbers the process, for its random seed and file name. */
+static void
+run (size_t pages, enum pattern pattern, int write_pct, int source_mmap,
+     long accesses, int child_idx)
+{
+  volatile char *mem;
+  char file_name[32];
+  mapid_t map = MAP_FAILED;
+  int fd = -1;
+  long i;
+
+  random_init (child_idx);
+  if (pattern == ZIPF)
+    {
+      uint32_t sum = 0;
+      size_t p;
+
+      for (p = 0; p < pages; p++)
+        zipf_sums[p] = sum += ZIPF_SCALE / (p + 1);
+    }
+
+  if (source_mmap)
+    {
+      snprintf (file_name, sizeof file_name, "perf-vm-%d.dat", child_idx);
+      if (!create (file_name, pages * PAGE_SIZE))
+        fail ("create \"%s\" failed", file_name);
+      fd = open (file_name);
+      if (fd < 0)
+        fail ("open \"%s\" failed", file_name);
+      map = mmap (fd, MMAP_BASE);
+      if (map == MAP_FAILED)
+        fail ("mmap \"%s\" failed", file_name);
+      mem = MMAP_BASE;
+    }
+  else
+    {
+      mem = sbrk (pages * PAGE_SIZE);
+      if (mem == (void *) -1)
+        fail ("sbrk of %zu pages failed", pages);
+    }
+
+  for (i = 0; i < accesses; i++)
+    {
+      volatile char *p = mem + pick_page (pages, pattern, i) * PAGE_SIZE;
+
+      if ((int) (random_ulong () % 100) < write_pct)
+        *p = i;
+      else
+        (void) *p;
+    }
+
+  if (source_mmap)
+    {
+      munmap (map);
+      close (fd);
+      remove (file_name);
+    }
+}
+
+/* Returns the page, out of PAGES, for access I in PATTERN. */
+static size_t
+pick_page (size_t pages, enum pattern pattern, long i)
+{
+  switch (pattern)
+    {
+    case SEQUENTIAL:
+      return i % pages;
+    case RANDOM:
+      return random_ulong () % pages;
+    case ZIPF:
+      {
+        uint32_t target = random_ulong () % zipf_sums[pages - 1];
+        size_t lo = 0, hi = pages - 1;
+
+        /* Find the first page whose sum exceeds TARGET. */
+        while (lo < hi)
+          {
+            size_t mid = (lo + hi) / 2;
+            if (zipf_sums[mid] > target)
+              hi = mid;
+            else
+              lo = mid + 1;
+          }
+        return lo;
+      }
+    case STRIDED:
+      /* Shift by one page on each pass, so that every page is
+         touched even when STRIDE divides PAGES. */
+      return (i * STRIDE + i * STRIDE / pages) % pages;
+    default:
+      NOT_REACHED ();
+    }
+}
@@ -0,0 +1,55 @@
+#include "tests/perf/perf.h"
+#include <rusage.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Returns the timer ticks used by this process and the children
+   it has waited for, in user mode and in the kernel. */
+static long long
+used_ticks (void)
+{
+  struct rusage self, children;
+
+  if (!getrusage (RUSAGE_SELF, &self)
+      || !getrusage (RUSAGE_CHILDREN, &children))
+    fail ("getrusage failed");
+  return (self.utime + self.stime) + (children.utime + children.stime);
+}
+
+/* Reads the time-stamp counter, as the kernel's clock_cycles()
+   does.  User programs cannot include devices/timer.h. */
+static inline uint64_t
+read_tsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Starts measuring NAME in P. */
+void
+perf_start (struct perf *p, const char *name)
+{
+  p->name = name;
+  p->ticks = used_ticks ();
+  p->ns = clock_ns ();
+  p->tsc = read_tsc ();
+}
+
+/* Stops measuring P, which did OPS operations that moved BYTES
+   bytes, and prints the result as one line of the form
+     perf NAME ops OPS bytes BYTES ticks TICKS ns NS tsc TSC per-op CYCLES
+   which "make perf" gathers into a summary.  CYCLES is TSC / OPS,
+   the cost of one operation in time-stamp counter cycles. */
+void
+perf_stop (struct perf *p, long long ops, long long bytes)
+{
+  uint64_t tsc = read_tsc () - p->tsc;
+  int64_t ns = clock_ns () - p->ns;
+  long long ticks = used_ticks () - p->ticks;
+
+  msg ("perf %s ops %lld bytes %lld ticks %lld ns %lld tsc %llu per-op %llu",
+       p->name, ops, bytes, ticks, (long long) ns,
+       (unsigned long long) tsc,
+       (unsigned long long) (ops > 0 ? tsc / ops : 0));
+}
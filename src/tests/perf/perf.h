@@ -0,0 +1,19 @@
+#ifndef TESTS_PERF_PERF_H
+#define TESTS_PERF_PERF_H
+
+#include <stdint.h>
+
+/* A measurement in progress, started by perf_start() and
+   reported by perf_stop(). */
+struct perf
+  {
+    const char *name;           /* What is being measured. */
+    long long ticks;            /* Timer ticks used so far. */
+    int64_t ns;                 /* clock_ns() at start. */
+    uint64_t tsc;               /* Time-stamp counter at start. */
+  };
+
+void perf_start (struct perf *, const char *name);
+void perf_stop (struct perf *, long long ops, long long bytes);
+
+#endif /* tests/perf/perf.h */
@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# Checks that the run of a perf test finished and reported each
+# of the measurements in @names.  The numbers are not checked:
+# "make perf" only gathers them into a summary.
+sub check_perf {
+    my (@names) = @_;
+    our ($test);
+    my ($prog) = $test =~ m%([^/]+)$%;
+    my (@output) = read_text_file ("$test.output");
+
+    common_checks ("run", @output);
+    @output = get_core_output ("run", @output);
+    fail "First line of output is not `($prog) begin' message.\n"
+      if $output[0] ne "($prog) begin";
+    fail "Output missing `($prog) end' message.\n"
+      if !grep ($_ eq "($prog) end", @output);
+    for my $name (@names) {
+	my ($re) = qr/^\($prog\) perf \Q$name\E ops \d+ bytes \d+ /
+	  . qr/ticks \d+ ns \d+ tsc \d+ per-op \d+$/;
+	fail "Output missing measurement of $name.\n"
+	  if !grep (/$re/, @output);
+    }
+    pass;
+}
+
+1;
@@ -0,0 +1,72 @@
+/* Schedules timer callouts at several delays, including one long
+   enough to cascade through the timer wheel, cancels one of
+   them, and checks that the others are called in order of
+   expiry, in the order they were added within the same tick,
+   and no earlier than they were due. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CALLOUT_CNT 5
+
+/* Delays, in ticks, of each callout. */
+static const int delays[CALLOUT_CNT] = {3, 1, 300, 2, 1};
+
+static struct timer_callout callouts[CALLOUT_CNT];
+static int64_t fired[CALLOUT_CNT];      /* Tick each one was called. */
+static int order[CALLOUT_CNT];          /* Callouts in call order. */
+static int order_cnt;
+static struct semaphore done;
+
+static timer_callout_func record_callout;
+
+void
+test_alarm_callout (void) 
+{
+  int64_t start;
+  int i;
+
+  sema_init (&done, 0);
+
+  /* Add them all in the same tick. */
+  intr_disable ();
+  start = timer_ticks ();
+  for (i = 0; i < CALLOUT_CNT; i++)
+    {
+      timer_callout_init (&callouts[i], record_callout, (void *) i);
+      timer_callout_add (&callouts[i], start + delays[i]);
+    }
+  intr_enable ();
+
+  ASSERT (timer_callout_cancel (&callouts[3]));
+  ASSERT (!timer_callout_cancel (&callouts[3]));
+
+  /* The last one to expire wakes us up. */
+  sema_down (&done);
+  ASSERT (!timer_callout_cancel (&callouts[2]));
+
+  for (i = 0; i < order_cnt; i++)
+    {
+      int c = order[i];
+      msg ("callout %d, delay %d", c, delays[c]);
+      if (fired[c] < start + delays[c])
+        fail ("callout %d called %lld ticks early",
+              c, start + delays[c] - fired[c]);
+    }
+}
+
+/* Records that the callout with index AUX was called. */
+static void
+record_callout (void *aux) 
+{
+  int c = (int) aux;
+
+  fired[c] = timer_ticks ();
+  order[order_cnt++] = c;
+  if (c == 2)
+    sema_up (&done);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-callout) begin
+(alarm-callout) callout 1, delay 1
+(alarm-callout) callout 4, delay 1
+(alarm-callout) callout 0, delay 3
+(alarm-callout) callout 2, delay 300
+(alarm-callout) end
+EOF
+pass;
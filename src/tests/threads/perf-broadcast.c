@@ -0,0 +1,68 @@
+/* Measures cond_broadcast(): 16 threads wait on a condition
+   variable, and the main thread wakes them all 200 times. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define WAITER_CNT 16
+#define ROUNDS 200
+
+static thread_func waiter_thread;
+static struct lock lock;
+static struct condition cond;
+static struct semaphore woken;
+static int generation;
+
+void
+test_perf_broadcast (void)
+{
+  struct perf perf;
+  int i, round;
+
+  lock_init (&lock);
+  cond_init (&cond);
+  sema_init (&woken, 0);
+  generation = 0;
+  for (i = 0; i < WAITER_CNT; i++)
+    thread_create ("waiter", PRI_DEFAULT, waiter_thread, NULL);
+
+  /* Each waiter ups WOKEN once it is waiting, and again each
+     time it wakes up and goes back to wait. */
+  for (i = 0; i < WAITER_CNT; i++)
+    sema_down (&woken);
+
+  perf_start (&perf, "broadcast");
+  for (round = 0; round < ROUNDS; round++)
+    {
+      lock_acquire (&lock);
+      generation++;
+      cond_broadcast (&cond, &lock);
+      lock_release (&lock);
+      for (i = 0; i < WAITER_CNT; i++)
+        sema_down (&woken);
+    }
+  perf_stop (&perf, ROUNDS * WAITER_CNT);
+}
+
+static void
+waiter_thread (void *aux UNUSED)
+{
+  int seen = 0;
+
+  lock_acquire (&lock);
+  sema_up (&woken);
+  while (seen < ROUNDS)
+    {
+      while (generation == seen)
+        cond_wait (&cond, &lock);
+      seen = generation;
+
+      /* The last round's WOKEN is upped below, on the way out. */
+      if (seen < ROUNDS)
+        sema_up (&woken);
+    }
+  lock_release (&lock);
+  sema_up (&woken);
+}
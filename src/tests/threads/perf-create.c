@@ -0,0 +1,36 @@
+/* Measures thread creation and exit: creates 500 threads, one
+   at a time, each of which exits right away. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 500
+
+static thread_func exit_thread;
+static struct semaphore done;
+
+void
+test_perf_create (void)
+{
+  struct perf perf;
+  int i;
+
+  sema_init (&done, 0);
+  perf_start (&perf, "create");
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      if (thread_create ("short", PRI_DEFAULT, exit_thread, NULL)
+          == TID_ERROR)
+        fail ("thread_create failed");
+      sema_down (&done);
+    }
+  perf_stop (&perf, THREAD_CNT);
+}
+
+static void
+exit_thread (void *aux UNUSED)
+{
+  sema_up (&done);
+}
@@ -0,0 +1,46 @@
+/* Measures contended lock_acquire(): 8 threads take the same
+   lock 2,000 times each, yielding while they hold it, so that
+   nearly every acquire has to wait. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define THREAD_CNT 8
+#define ITERATIONS 2000
+
+static thread_func lock_thread;
+static struct lock lock;
+static struct semaphore done;
+
+void
+test_perf_lock (void)
+{
+  struct perf perf;
+  int i;
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+
+  perf_start (&perf, "lock");
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("locker", PRI_DEFAULT, lock_thread, NULL);
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  perf_stop (&perf, THREAD_CNT * ITERATIONS);
+}
+
+static void
+lock_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      lock_acquire (&lock);
+      thread_yield ();
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
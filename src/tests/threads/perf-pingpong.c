@@ -0,0 +1,47 @@
+/* Measures the cost of a context switch: two threads take turns
+   through a pair of semaphores, so that every sema_up() switches
+   to the other thread through schedule(). */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define ROUNDS 10000
+
+static thread_func pong_thread;
+static struct semaphore ping, pong, done;
+
+void
+test_perf_pingpong (void)
+{
+  struct perf perf;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  sema_init (&done, 0);
+  thread_create ("pong", PRI_DEFAULT, pong_thread, NULL);
+
+  perf_start (&perf, "pingpong");
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  perf_stop (&perf, 2 * ROUNDS);
+  sema_down (&done);
+}
+
+static void
+pong_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < ROUNDS; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,62 @@
+/* Measures timer_sleep() wakeup accuracy with many sleepers:
+   32 threads each sleep 5 times for 1 to 5 ticks, and record how
+   many ticks late each wakeup was. */
+
+#include "tests/threads/tests.h"
+#include "tests/threads/perf.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 32
+#define SLEEPS 5
+
+static thread_func sleeper_thread;
+static struct lock lock;
+static struct semaphore done;
+static int64_t late_total, late_max;
+
+void
+test_perf_sleep (void)
+{
+  struct perf perf;
+  int i;
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+  late_total = late_max = 0;
+
+  perf_start (&perf, "sleep");
+  for (i = 0; i < THREAD_CNT; i++)
+    thread_create ("sleeper", PRI_DEFAULT, sleeper_thread,
+                   (void *) (intptr_t) (i % 5 + 1));
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+  perf_stop (&perf, THREAD_CNT * SLEEPS);
+
+  msg ("perf sleep-late total %lld max %lld ticks",
+       (long long) late_total, (long long) late_max);
+}
+
+static void
+sleeper_thread (void *duration_)
+{
+  int64_t duration = (intptr_t) duration_;
+  int i;
+
+  for (i = 0; i < SLEEPS; i++)
+    {
+      int64_t start = timer_ticks ();
+      int64_t late;
+
+      timer_sleep (duration);
+      late = timer_elapsed (start) - duration;
+
+      lock_acquire (&lock);
+      late_total += late;
+      if (late > late_max)
+        late_max = late;
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
@@ -0,0 +1,30 @@
+#include "tests/threads/perf.h"
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+/* Starts measuring NAME in P. */
+void
+perf_start (struct perf *p, const char *name)
+{
+  p->name = name;
+  p->ticks = timer_ticks ();
+  p->ns = clock_ns ();
+  p->cycles = clock_cycles ();
+}
+
+/* Stops measuring P, which did OPS operations, and prints the
+   result as one line of the form
+     perf NAME ops OPS bytes 0 ticks TICKS ns NS tsc TSC per-op CYCLES
+   which "make perf" gathers into a summary. */
+void
+perf_stop (struct perf *p, long long ops)
+{
+  uint64_t cycles = clock_cycles () - p->cycles;
+  int64_t ns = clock_ns () - p->ns;
+  int64_t ticks = timer_elapsed (p->ticks);
+
+  msg ("perf %s ops %lld bytes 0 ticks %lld ns %lld tsc %llu per-op %llu",
+       p->name, ops, (long long) ticks, (long long) ns,
+       (unsigned long long) cycles,
+       (unsigned long long) (ops > 0 ? cycles / ops : 0));
+}
@@ -0,0 +1,20 @@
+#ifndef TESTS_THREADS_PERF_H
+#define TESTS_THREADS_PERF_H
+
+#include <stdint.h>
+
+/* A measurement in progress, started by perf_start() and
+   reported by perf_stop(), in the same form as the user
+   programs in tests/perf. */
+struct perf
+  {
+    const char *name;           /* What is being measured. */
+    int64_t ticks;              /* timer_ticks() at start. */
+    int64_t ns;                 /* clock_ns() at start. */
+    uint64_t cycles;            /* clock_cycles() at start. */
+  };
+
+void perf_start (struct perf *, const char *name);
+void perf_stop (struct perf *, long long ops);
+
+#endif /* tests/threads/perf.h */
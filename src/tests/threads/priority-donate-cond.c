@@ -0,0 +1,72 @@
+/* The main thread declares itself the signaller of a condition
+   variable.  Then it creates a higher-priority thread that
+   waits on the condition, donating its priority to the main
+   thread, and a thread of medium priority that must not run
+   while the donation holds.  When the main thread signals the
+   condition, holding the monitor's lock, the waiter donates its
+   priority again through the lock, until the main thread
+   releases it, after which the waiter runs, then the medium
+   thread. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct lock_and_cond
+  {
+    struct lock lock;
+    struct condition cond;
+  };
+
+static thread_func waiter_thread_func;
+static thread_func medium_thread_func;
+
+void
+test_priority_donate_cond (void)
+{
+  struct lock_and_cond lc;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&lc.lock);
+  cond_init (&lc.cond);
+  cond_set_signaller (&lc.cond, thread_current ());
+  thread_create ("waiter", PRI_DEFAULT + 5, waiter_thread_func, &lc);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  thread_create ("medium", PRI_DEFAULT + 2, medium_thread_func, NULL);
+
+  lock_acquire (&lc.lock);
+  cond_signal (&lc.cond, &lc.lock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 5, thread_get_priority ());
+  lock_release (&lc.lock);
+  msg ("waiter, medium must already have finished, in that order.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  cond_set_signaller (&lc.cond, NULL);
+}
+
+static void
+waiter_thread_func (void *lc_)
+{
+  struct lock_and_cond *lc = lc_;
+
+  lock_acquire (&lc->lock);
+  msg ("waiter: waiting");
+  cond_wait (&lc->cond, &lc->lock);
+  msg ("waiter: signalled");
+  lock_release (&lc->lock);
+}
+
+static void
+medium_thread_func (void *aux UNUSED)
+{
+  msg ("medium: ran");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-cond) begin
+(priority-donate-cond) waiter: waiting
+(priority-donate-cond) This thread should have priority 36.  Actual priority: 36.
+(priority-donate-cond) This thread should have priority 36.  Actual priority: 36.
+(priority-donate-cond) waiter: signalled
+(priority-donate-cond) medium: ran
+(priority-donate-cond) waiter, medium must already have finished, in that order.
+(priority-donate-cond) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-cond) end
+EOF
+pass;
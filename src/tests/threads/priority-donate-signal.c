@@ -0,0 +1,64 @@
+/* The main thread declares itself the signaller of a semaphore.
+   Then it creates two higher-priority threads that block
+   downing the semaphore, donating their priorities to the main
+   thread, and a thread of medium priority that must not run
+   while the donation holds.  Each time the main thread ups the
+   semaphore, the highest waiter wakes and runs, and the main
+   thread's priority falls to that of the waiter left, and
+   finally back to its own, letting the medium thread run. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func waiter_thread_func;
+static thread_func medium_thread_func;
+
+void
+test_priority_donate_signal (void)
+{
+  struct semaphore sema;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  sema_init (&sema, 0);
+  sema_set_signaller (&sema, thread_current ());
+  thread_create ("waiter-1", PRI_DEFAULT + 3, waiter_thread_func, &sema);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+  thread_create ("waiter-2", PRI_DEFAULT + 6, waiter_thread_func, &sema);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 6, thread_get_priority ());
+  thread_create ("medium", PRI_DEFAULT + 1, medium_thread_func, NULL);
+
+  sema_up (&sema);
+  msg ("waiter-2 must already have finished.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+  sema_up (&sema);
+  msg ("waiter-1, medium must already have finished, in that order.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  sema_set_signaller (&sema, NULL);
+}
+
+static void
+waiter_thread_func (void *sema_)
+{
+  struct semaphore *sema = sema_;
+
+  sema_down (sema);
+  msg ("%s: downed the semaphore", thread_name ());
+}
+
+static void
+medium_thread_func (void *aux UNUSED)
+{
+  msg ("medium: ran");
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-donate-signal) begin
+(priority-donate-signal) This thread should have priority 34.  Actual priority: 34.
+(priority-donate-signal) This thread should have priority 37.  Actual priority: 37.
+(priority-donate-signal) waiter-2: downed the semaphore
+(priority-donate-signal) waiter-2 must already have finished.
+(priority-donate-signal) This thread should have priority 34.  Actual priority: 34.
+(priority-donate-signal) waiter-1: downed the semaphore
+(priority-donate-signal) medium: ran
+(priority-donate-signal) waiter-1, medium must already have finished, in that order.
+(priority-donate-signal) This thread should have priority 31.  Actual priority: 31.
+(priority-donate-signal) end
+EOF
+pass;
@@ -0,0 +1,136 @@
+/* Measures how long a workload of 95% reads and 5% writes, in
+   which every operation sleeps for a tick while holding the lock,
+   takes under a plain lock and under a reader-writer lock
+   preferring readers and preferring writers.  The plain lock
+   runs one operation at a time, so it takes at least a tick per
+   operation however slow the machine is.  Readers share the
+   reader-writer lock, so it should finish in fewer ticks.  Along
+   the way, checks that no reader overlaps a writer and no two
+   writers overlap. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 10
+#define THREAD_OPS 20           /* Operations per thread. */
+#define WRITE_EVERY 20          /* One write per 20 operations. */
+
+/* Shared state of one run. */
+struct mix 
+  {
+    struct lock lock;           /* Used if !USE_RWLOCK. */
+    struct rwlock rw;           /* Used if USE_RWLOCK. */
+    bool use_rwlock;
+    int readers, writers;       /* Threads inside. */
+    struct semaphore done;      /* Upped by each thread at the end. */
+  };
+
+/* Per-thread argument. */
+struct mix_thread 
+  {
+    struct mix *mix;
+    int id;
+  };
+
+static thread_func mix_thread_func;
+static int64_t run (const char *name, bool use_rwlock,
+                    enum rwlock_pref);
+
+void
+test_rwlock_mix (void) 
+{
+  int64_t plain, readers, writers;
+
+  plain = run ("lock", false, RWLOCK_PREFER_READERS);
+  readers = run ("rwlock, prefer readers", true, RWLOCK_PREFER_READERS);
+  writers = run ("rwlock, prefer writers", true, RWLOCK_PREFER_WRITERS);
+
+  if (readers >= plain || writers >= plain)
+    fail ("reader-writer lock no faster than a plain lock");
+}
+
+/* Runs THREAD_OPS operations of the mix on each of THREAD_CNT
+   threads, under a plain lock or, if USE_RWLOCK, under a
+   reader-writer lock with preference PREF.  Prints and returns
+   the number of ticks taken. */
+static int64_t
+run (const char *name, bool use_rwlock, enum rwlock_pref pref) 
+{
+  struct mix mix;
+  struct mix_thread threads[THREAD_CNT];
+  int64_t start, ticks;
+  int i;
+
+  lock_init (&mix.lock);
+  rwlock_init (&mix.rw, pref);
+  mix.use_rwlock = use_rwlock;
+  mix.readers = mix.writers = 0;
+  sema_init (&mix.done, 0);
+
+  start = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char tname[16];
+
+      threads[i].mix = &mix;
+      threads[i].id = i;
+      snprintf (tname, sizeof tname, "mix %d", i);
+      thread_create (tname, PRI_DEFAULT, mix_thread_func, &threads[i]);
+    }
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&mix.done);
+  ticks = timer_elapsed (start);
+
+  msg ("%s: %d operations in %lld ticks",
+       name, THREAD_CNT * THREAD_OPS, (long long) ticks);
+  return ticks;
+}
+
+/* Reads or writes THREAD_OPS times under MIX's lock, writing
+   once every WRITE_EVERY operations.  Readers may share the
+   lock, so they count themselves in MIX atomically. */
+static void
+mix_thread_func (void *t_) 
+{
+  struct mix_thread *t = t_;
+  struct mix *mix = t->mix;
+  int op;
+
+  for (op = t->id; op < t->id + THREAD_OPS; op++) 
+    {
+      bool write = op % WRITE_EVERY == 0;
+
+      if (!mix->use_rwlock)
+        lock_acquire (&mix->lock);
+      else if (write)
+        rwlock_acquire_write (&mix->rw);
+      else
+        rwlock_acquire_read (&mix->rw);
+
+      if (mix->writers > 0 || (write && mix->readers > 0))
+        fail ("%s overlapped a writer", write ? "writer" : "reader");
+      if (write)
+        mix->writers++;
+      else
+        __atomic_add_fetch (&mix->readers, 1, __ATOMIC_SEQ_CST);
+
+      timer_sleep (1);
+
+      if (write)
+        mix->writers--;
+      else
+        __atomic_sub_fetch (&mix->readers, 1, __ATOMIC_SEQ_CST);
+
+      if (!mix->use_rwlock)
+        lock_release (&mix->lock);
+      else if (write)
+        rwlock_release_write (&mix->rw);
+      else
+        rwlock_release_read (&mix->rw);
+    }
+  sema_up (&mix->done);
+}
@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (%ticks);
+foreach (@output) {
+    fail $_ if /overlapped|no faster/;
+    $ticks{$1} = $2 if /\(rwlock-mix\) (.*): \d+ operations in (\d+) ticks/;
+}
+
+foreach my $name ("lock", "rwlock, prefer readers", "rwlock, prefer writers") {
+    fail "No result for $name.\n" if !defined $ticks{$name};
+}
+# A plain lock takes at least a tick per operation, however slow
+# the machine, so the reader-writer lock must always beat it.
+foreach my $name ("rwlock, prefer readers", "rwlock, prefer writers") {
+    fail "$name took $ticks{$name} ticks, "
+      . "no fewer than a plain lock's $ticks{lock}.\n"
+      if $ticks{$name} >= $ticks{lock};
+}
+pass;
@@ -0,0 +1,20 @@
+/* Child process run by fpu-switch.  Loads its own values into
+   the x87 and SSE registers, and returns 0 if they are still
+   there after a few system calls. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/userprog/fpu.h"
+
+int
+main (void) 
+{
+  int i;
+
+  test_name = "child-fpu";
+
+  fpu_load (-5678);
+  for (i = 0; i < 10; i++)
+    msg ("run %d", i);
+  return fpu_check (-5678) ? 0 : 1;
+}
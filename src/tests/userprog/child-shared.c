@@ -0,0 +1,19 @@
+/* Child process run by exec-shared test.
+   Linked against the shared C library instead of the static
+   one, so the kernel must load and link libc.so before it
+   runs.  Prints a message through the library and terminates. */
+
+#include <stdio.h>
+#include <string.h>
+#include "tests/lib.h"
+
+int
+main (int argc, char *argv[])
+{
+  test_name = "child-shared";
+
+  CHECK (argc == 2 && strcmp (argv[1], "arg") == 0,
+         "argv[1] is \"arg\"");
+  msg ("run");
+  return 82;
+}
@@ -0,0 +1,14 @@
+/* Executes a child process linked against the shared C library,
+   twice, and waits for it each time.  The second load finds the
+   program and the library in the kernel's exec cache. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  msg ("wait(exec()) = %d", wait (exec ("child-shared arg")));
+  msg ("wait(exec()) = %d", wait (exec ("child-shared arg")));
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(exec-shared) begin
+(child-shared) argv[1] is "arg"
+(child-shared) run
+child-shared: exit(82)
+(exec-shared) wait(exec()) = 82
+(child-shared) argv[1] is "arg"
+(child-shared) run
+child-shared: exit(82)
+(exec-shared) wait(exec()) = 82
+(exec-shared) end
+exec-shared: exit(0)
+EOF
+pass;
@@ -0,0 +1,17 @@
+/* Leaves values in the x87 and SSE registers, then runs a child
+   process that loads others into the same registers, and checks
+   that the kernel kept each process's values apart. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/fpu.h"
+
+void
+test_main (void) 
+{
+  fpu_load (1234);
+  CHECK (wait (exec ("child-fpu")) == 0, "wait for child-fpu");
+  if (!fpu_check (1234))
+    fail ("FPU registers changed across child-fpu");
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu-switch) begin
+(child-fpu) run 0
+(child-fpu) run 1
+(child-fpu) run 2
+(child-fpu) run 3
+(child-fpu) run 4
+(child-fpu) run 5
+(child-fpu) run 6
+(child-fpu) run 7
+(child-fpu) run 8
+(child-fpu) run 9
+child-fpu: exit(0)
+(fpu-switch) wait for child-fpu
+(fpu-switch) end
+fpu-switch: exit(0)
+EOF
+pass;
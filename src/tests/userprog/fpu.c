@@ -0,0 +1,31 @@
+/* Helpers for tests of x87 FPU and SSE context switching.  The
+   tests are compiled with -msoft-float and without SSE, so only
+   these functions touch the registers. */
+
+#include "tests/userprog/fpu.h"
+#include <stdint.h>
+
+/* Pushes VALUE onto the x87 register stack and loads it into
+   each lane of %xmm0. */
+void
+fpu_load (int value)
+{
+  int32_t lanes[4] = {value, value, value, value};
+
+  asm volatile ("fildl %0; movups %1, %%xmm0"
+                : : "m" (value), "m" (lanes));
+}
+
+/* Pops the top of the x87 register stack and reads %xmm0, and
+   returns true if each holds VALUE, as fpu_load() left them. */
+bool
+fpu_check (int value)
+{
+  int32_t lanes[4];
+  int32_t top;
+
+  asm volatile ("fistpl %0; movups %%xmm0, %1"
+                : "=m" (top), "=m" (lanes));
+  return (top == value && lanes[0] == value && lanes[1] == value
+          && lanes[2] == value && lanes[3] == value);
+}
@@ -0,0 +1,9 @@
+#ifndef TESTS_USERPROG_FPU_H
+#define TESTS_USERPROG_FPU_H
+
+#include <stdbool.h>
+
+void fpu_load (int value);
+bool fpu_check (int value);
+
+#endif /* tests/userprog/fpu.h */
@@ -0,0 +1,45 @@
+/* Opens statistics files under /proc/ and checks their contents,
+   and that they cannot be written, created or removed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[4096];
+
+/* Reads the file named NAME into BUF, null-terminated, and
+   returns its length. */
+static int
+read_file (const char *name)
+{
+  int handle, size;
+
+  CHECK ((handle = open (name)) > 1, "open \"%s\"", name);
+  size = read (handle, buf, sizeof buf - 1);
+  if (size <= 0)
+    fail ("read() returned %d", size);
+  buf[size] = '\0';
+  if (write (handle, "x", 1) != 0)
+    fail ("write() to \"%s\" succeeded", name);
+  close (handle);
+  return size;
+}
+
+void
+test_main (void)
+{
+  read_file ("/proc/self");
+  if (strstr (buf, "name: open-proc\n") != buf)
+    fail ("/proc/self does not start with our name");
+  if (strstr (buf, "state: running\n") == NULL)
+    fail ("/proc/self does not say we are running");
+
+  read_file ("/proc/syscalls");
+  if (strstr (buf, "open") == NULL)
+    fail ("/proc/syscalls does not mention open");
+
+  CHECK (open ("/proc/no-such-file") == -1, "open \"/proc/no-such-file\"");
+  CHECK (!create ("/proc/new", 0), "create \"/proc/new\"");
+  CHECK (!remove ("/proc/self"), "remove \"/proc/self\"");
+}
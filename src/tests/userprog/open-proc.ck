@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-proc) begin
+(open-proc) open "/proc/self"
+(open-proc) open "/proc/syscalls"
+(open-proc) open "/proc/no-such-file"
+(open-proc) create "/proc/new"
+(open-proc) remove "/proc/self"
+(open-proc) end
+open-proc: exit(0)
+EOF
+pass;
@@ -0,0 +1,88 @@
+/* Writes four blocks of a file, then reads them back, each as an
+   asynchronous ring operation with all four in flight at once,
+   and checks each completion once ring_wait() posts it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCKS 4
+#define BLOCK_SIZE 1024
+
+static struct ring_sqe sqes[BLOCKS];
+static struct ring_cqe cqes[BLOCKS];
+static struct ring ring = {BLOCKS, 0, 0, 0, 0, sqes, cqes};
+static char wbuf[BLOCKS][BLOCK_SIZE];
+static char rbuf[BLOCKS][BLOCK_SIZE];
+
+/* Queues asynchronous operation OP of block I, of FD, in RING. */
+static void
+submit (enum ring_op op, int fd, int i, void *buf)
+{
+  struct ring_sqe *sqe = &sqes[ring.sq_tail++ % ring.entries];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->size = BLOCK_SIZE;
+  sqe->offset = i * BLOCK_SIZE;
+  sqe->user_data = i;
+}
+
+/* Collects BLOCKS completions, each the full block.  The
+   ring_enter() that submitted them may have posted some. */
+static void
+reap (const char *what)
+{
+  bool seen[BLOCKS] = {false};
+
+  while (ring.cq_tail - ring.cq_head < BLOCKS)
+    {
+      int posted = ring_wait ();
+      if (posted <= 0)
+        fail ("ring_wait() returned %d during %s", posted, what);
+    }
+  while (ring.cq_head != ring.cq_tail)
+    {
+      struct ring_cqe *cqe = &cqes[ring.cq_head++ % ring.entries];
+      if (cqe->user_data >= BLOCKS || seen[cqe->user_data]
+          || cqe->res != BLOCK_SIZE)
+        fail ("%s completion: user_data %u, result %d",
+              what, cqe->user_data, cqe->res);
+      seen[cqe->user_data] = true;
+    }
+  msg ("%s completed", what);
+}
+
+void
+test_main (void)
+{
+  int handle, cnt, i;
+
+  for (i = 0; i < BLOCKS; i++)
+    memset (wbuf[i], 'a' + i, BLOCK_SIZE);
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (ring_setup (&ring), "ring_setup");
+
+  for (i = 0; i < BLOCKS; i++)
+    submit (RING_WRITE_ASYNC, handle, i, wbuf[i]);
+  cnt = ring_enter ();
+  if (cnt != BLOCKS)
+    fail ("ring_enter() returned %d instead of %d", cnt, BLOCKS);
+  reap ("writes");
+
+  for (i = 0; i < BLOCKS; i++)
+    submit (RING_READ_ASYNC, handle, i, rbuf[i]);
+  cnt = ring_enter ();
+  if (cnt != BLOCKS)
+    fail ("ring_enter() returned %d instead of %d", cnt, BLOCKS);
+  reap ("reads");
+
+  if (memcmp (rbuf, wbuf, sizeof wbuf))
+    fail ("data read back differs from data written");
+  if (ring_wait () != 0)
+    fail ("ring_wait() with nothing in flight did not return 0");
+  msg ("ring processed");
+  close (handle);
+}
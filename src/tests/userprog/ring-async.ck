@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-async) begin
+(ring-async) create "test.txt"
+(ring-async) open "test.txt"
+(ring-async) ring_setup
+(ring-async) writes completed
+(ring-async) reads completed
+(ring-async) ring processed
+(ring-async) end
+ring-async: exit(0)
+EOF
+pass;
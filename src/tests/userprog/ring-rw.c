@@ -0,0 +1,58 @@
+/* Writes a file, seeks back, reads it and closes it, all through
+   one batch submitted to a system call ring, and checks each
+   completion. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct ring_sqe sqes[4];
+static struct ring_cqe cqes[4];
+static struct ring ring = {4, 0, 0, 0, 0, sqes, cqes};
+static char buf[sizeof sample];
+
+/* Queues operation OP on FD in RING. */
+static void
+submit (enum ring_op op, int fd, void *buf, unsigned size)
+{
+  struct ring_sqe *sqe = &sqes[ring.sq_tail % ring.entries];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buf;
+  sqe->size = size;
+  sqe->user_data = ring.sq_tail++;
+}
+
+void
+test_main (void) 
+{
+  int handle, cnt;
+  static const int expected[4] = {sizeof sample - 1, 0, sizeof sample - 1, 0};
+  unsigned i;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (ring_setup (&ring), "ring_setup");
+
+  submit (RING_WRITE, handle, sample, sizeof sample - 1);
+  submit (RING_SEEK, handle, NULL, 0);
+  submit (RING_READ, handle, buf, sizeof sample - 1);
+  submit (RING_CLOSE, handle, NULL, 0);
+
+  cnt = ring_enter ();
+  if (cnt != 4)
+    fail ("ring_enter() returned %d instead of 4", cnt);
+  if (ring.sq_head != 4 || ring.cq_tail != 4)
+    fail ("ring indexes not advanced");
+  for (i = 0; i < 4; i++)
+    if (cqes[i].user_data != i || cqes[i].res != expected[i])
+      fail ("completion %u: user_data %u, result %d",
+            i, cqes[i].user_data, cqes[i].res);
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("data read back differs from data written");
+  msg ("ring processed");
+
+  check_file ("test.txt", sample, sizeof sample - 1);
+}
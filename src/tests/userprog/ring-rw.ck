@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-rw) begin
+(ring-rw) create "test.txt"
+(ring-rw) open "test.txt"
+(ring-rw) ring_setup
+(ring-rw) ring processed
+(ring-rw) open "test.txt" for verification
+(ring-rw) verified contents of "test.txt"
+(ring-rw) close "test.txt"
+(ring-rw) end
+ring-rw: exit(0)
+EOF
+pass;
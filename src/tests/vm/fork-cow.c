@@ -0,0 +1,53 @@
+/* Forks a child that shares a 256 kB buffer with its parent
+   copy-on-write, then has both processes overwrite the buffer
+   while the other one still checks its own copy. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (256 * 1024)
+
+static char buf[SIZE];
+
+/* Fails unless every byte of BUF is VALUE. */
+static void
+check (char value)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("byte %zu != %#x", i, value & 0xff);
+}
+
+void
+test_main (void)
+{
+  pid_t pid;
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  msg ("fork");
+  pid = fork ();
+  if (pid == 0)
+    {
+      msg ("child: read pass");
+      check (0x5a);
+      msg ("child: write pass");
+      memset (buf, 0xa5, sizeof buf);
+      check (0xa5);
+      exit (81);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork");
+
+  /* Runs while the child may still be reading the old contents,
+     silently, because the child's messages may come first. */
+  memset (buf, 0x33, sizeof buf);
+  CHECK (wait (pid) == 81, "wait for child");
+  msg ("parent: read pass");
+  check (0x33);
+}
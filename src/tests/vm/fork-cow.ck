@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) initialize
+(fork-cow) fork
+(fork-cow) child: read pass
+(fork-cow) child: write pass
+(fork-cow) wait for child
+(fork-cow) parent: read pass
+(fork-cow) end
+EOF
+pass;
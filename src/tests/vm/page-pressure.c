@@ -0,0 +1,31 @@
+/* Touches 2 MB of memory, more than fits in the user pool, and
+   checks that the kernel then reports memory pressure, before
+   giving the memory back with madvise(). */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  int level;
+
+  CHECK (mempressure (MEMPRESSURE_CRITICAL + 1, 0) == -1,
+         "mempressure() rejects a bad level");
+
+  msg ("initialize");
+  memset (buf, 0x5a, sizeof buf);
+
+  level = mempressure (MEMPRESSURE_MEDIUM, 0);
+  if (level < MEMPRESSURE_MEDIUM)
+    fail ("pressure level %d after touching 2 MB", level);
+  msg ("pressure is at least medium");
+
+  CHECK (madvise (buf, sizeof buf, MADV_DONTNEED), "madvise(DONTNEED)");
+}
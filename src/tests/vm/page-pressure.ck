@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-pressure) begin
+(page-pressure) mempressure() rejects a bad level
+(page-pressure) initialize
+(page-pressure) pressure is at least medium
+(page-pressure) madvise(DONTNEED)
+(page-pressure) end
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Swaps to a swap file in the file system as well as the swap
+   disk, by touching 2 MB of memory twice, and checks that user
+   programs cannot write the swap file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  size_t i;
+  int fd;
+
+  CHECK ((fd = open ("swapfile")) > 1, "open \"swapfile\"");
+  CHECK (write (fd, buf, 1) == 0, "write \"swapfile\" (must return 0)");
+  close (fd);
+
+  msg ("initialize");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i % 251;
+
+  msg ("read pass");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i % 251))
+      fail ("byte %zu != %d", i, (int) (i % 251));
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-swapfile) begin
+(page-swapfile) open "swapfile"
+(page-swapfile) write "swapfile" (must return 0)
+(page-swapfile) initialize
+(page-swapfile) read pass
+(page-swapfile) end
+EOF
+pass;
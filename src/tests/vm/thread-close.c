@@ -0,0 +1,42 @@
+/* Has a second thread read a file over and over while the main
+   thread closes the descriptor it reads from, then checks that
+   the file is intact.  The reads that overlap the close must
+   neither crash the kernel nor hang it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define READ_CNT 1000
+
+static int handle;
+
+/* Reads the file until its descriptor is closed. */
+static void
+reader (void *aux UNUSED)
+{
+  char buf[sizeof sample];
+  int i;
+
+  for (i = 0; i < READ_CNT; i++)
+    {
+      if (read (handle, buf, sizeof buf) < 0)
+        return;
+      seek (handle, 0);
+    }
+}
+
+void
+test_main (void)
+{
+  pid_t tid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((tid = thread_spawn (reader, NULL)) != PID_ERROR, "thread_spawn");
+  msg ("close \"sample.txt\"");
+  close (handle);
+  CHECK (wait (tid) == 0, "wait for reader");
+  check_file ("sample.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(thread-close) begin
+(thread-close) open "sample.txt"
+(thread-close) thread_spawn
+(thread-close) close "sample.txt"
+(thread-close) wait for reader
+(thread-close) verified contents of "sample.txt"
+(thread-close) end
+EOF
+pass;
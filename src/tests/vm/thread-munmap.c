@@ -0,0 +1,54 @@
+/* Has a second thread write a memory-mapped file to another file
+   over and over while the main thread unmaps it.  The writes that
+   overlap the unmap either succeed or kill the writer, but must
+   neither crash the kernel nor hang it. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((void *) 0x10000000)
+#define WRITE_CNT 1000
+
+static int handle;
+
+/* Copies the mapping into "copy.txt" until it is unmapped, at
+   which point the kernel kills this thread. */
+static void
+writer (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      if (write (handle, ACTUAL, sizeof sample - 1) < 0)
+        return;
+      seek (handle, 0);
+    }
+}
+
+void
+test_main (void)
+{
+  mapid_t map;
+  pid_t tid;
+  int status;
+  int fd;
+
+  CHECK ((fd = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (fd, ACTUAL)) != MAP_FAILED, "mmap \"sample.txt\"");
+  close (fd);
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((handle = open ("copy.txt")) > 1, "open \"copy.txt\"");
+  CHECK ((tid = thread_spawn (writer, NULL)) != PID_ERROR, "thread_spawn");
+  msg ("munmap \"sample.txt\"");
+  munmap (map);
+  status = wait (tid);
+  if (status != 0 && status != -1)
+    fail ("writer exited with status %d", status);
+  msg ("wait for writer");
+  close (handle);
+  check_file ("sample.txt", sample, sizeof sample - 1);
+}
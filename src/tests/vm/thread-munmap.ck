@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(thread-munmap) begin
+(thread-munmap) open "sample.txt"
+(thread-munmap) mmap "sample.txt"
+(thread-munmap) create "copy.txt"
+(thread-munmap) open "copy.txt"
+(thread-munmap) thread_spawn
+(thread-munmap) munmap "sample.txt"
+(thread-munmap) wait for writer
+(thread-munmap) verified contents of "sample.txt"
+(thread-munmap) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Registers a region for user fault handling and has a handler
+   thread fill its pages in as the main thread touches them, then
+   checks that once the handler's descriptor is closed, the
+   remaining missing page reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define REGION ((char *) 0x10000000)
+#define PAGE_SIZE 4096
+#define PAGE_CNT 4
+
+static int uffd;
+static char page[PAGE_SIZE];
+
+/* Fills in each page that faults with the page's letter. */
+static void
+handler (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      struct uffd_msg m;
+      size_t idx;
+
+      if (read (uffd, &m, sizeof m) != sizeof m)
+        return;
+      idx = ((char *) m.addr - REGION) / PAGE_SIZE;
+      memset (page, 'a' + idx, sizeof page);
+      if (uffd_copy (m.addr, page, PAGE_SIZE) != 1)
+        return;
+    }
+}
+
+void
+test_main (void)
+{
+  int i;
+
+  CHECK ((uffd = uffd_register (REGION, (PAGE_CNT + 1) * PAGE_SIZE)) > 1,
+         "uffd_register");
+  CHECK (thread_spawn (handler, NULL) != PID_ERROR, "thread_spawn");
+
+  for (i = 0; i < PAGE_CNT; i++)
+    {
+      char *p = REGION + i * PAGE_SIZE;
+
+      if (p[0] != 'a' + i || p[PAGE_SIZE - 1] != 'a' + i)
+        fail ("page %d not filled in", i);
+      msg ("page %d filled in with '%c'", i, p[0]);
+    }
+
+  close (uffd);
+  if (REGION[PAGE_CNT * PAGE_SIZE] != 0)
+    fail ("page %d not zero", PAGE_CNT);
+  msg ("page %d zero without a handler", PAGE_CNT);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(uffd-fill) begin
+(uffd-fill) uffd_register
+(uffd-fill) thread_spawn
+(uffd-fill) page 0 filled in with 'a'
+(uffd-fill) page 1 filled in with 'b'
+(uffd-fill) page 2 filled in with 'c'
+(uffd-fill) page 3 filled in with 'd'
+(uffd-fill) page 4 zero without a handler
+(uffd-fill) end
+EOF
+pass;
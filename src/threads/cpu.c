@@ -0,0 +1,196 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <packed.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/loader.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Processors.
+
+   Only the bootstrap processor (BSP), cpus[0], runs threads.
+   cpu_probe() finds the others, the application processors, in
+   the BIOS's MultiProcessor Specification tables [MPS], so that
+   the scheduler's per-CPU state has a slot for each, but does not
+   start them yet. */
+struct cpu cpus[CPU_MAX];
+int cpu_cnt;
+
+/* MP floating pointer structure. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* In 16-byte units, normally 1. */
+    uint8_t spec_rev;
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t feature[5];         /* feature[0] nonzero: default config. */
+  } PACKED;
+
+/* MP configuration table header, followed by its entries. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Of header and entries, in bytes. */
+    uint8_t spec_rev;
+    uint8_t checksum;           /* All bytes sum to 0. */
+    char oem[8];
+    char product[12];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t entry_cnt;         /* # of entries after the header. */
+    uint32_t lapic;             /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  } PACKED;
+
+/* MP configuration table processor entry.  Every other type of
+   entry is 8 bytes long. */
+#define MP_PROCESSOR 0
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;
+    uint8_t flags;              /* MP_CPU_* bits. */
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+  } PACKED;
+#define MP_CPU_ENABLED 0x01     /* Usable. */
+#define MP_CPU_BSP 0x02         /* The bootstrap processor. */
+
+static struct mp_float *mp_search (uintptr_t, size_t);
+static bool checksum_ok (const void *, size_t);
+static void *phys_to_kernel (uintptr_t, size_t);
+
+/* Sets up cpus[0] as the bootstrap processor, the only one known
+   until cpu_probe().  Called by thread_init(). */
+void
+cpu_init (void)
+{
+  cpus[0].id = 0;
+  cpus[0].started = true;
+  cpu_cnt = 1;
+}
+
+/* Looks for application processors in the MP tables, and adds
+   each one found to cpus[]. */
+void
+cpu_probe (void)
+{
+  uint16_t ebda = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_float *mpf;
+  struct mp_config *conf;
+  uint8_t *entry, *end;
+  int found = 0;
+
+  /* [MPS] 4: the floating pointer is in the first kB of the
+     EBDA, the last kB of base memory, or the BIOS ROM. */
+  mpf = mp_search ((uintptr_t) ebda << 4, 1024);
+  if (mpf == NULL)
+    mpf = mp_search ((uintptr_t) base_kb * 1024 - 1024, 1024);
+  if (mpf == NULL)
+    mpf = mp_search (0xf0000, 0x10000);
+  if (mpf == NULL || mpf->config == 0)
+    return;
+
+  conf = phys_to_kernel (mpf->config, sizeof *conf);
+  if (conf == NULL || memcmp (conf->signature, "PCMP", 4)
+      || phys_to_kernel (mpf->config, conf->length) == NULL
+      || !checksum_ok (conf, conf->length))
+    return;
+
+  entry = (uint8_t *) (conf + 1);
+  end = (uint8_t *) conf + conf->length;
+  while (entry < end)
+    {
+      struct mp_processor *p = (struct mp_processor *) entry;
+      if (p->type != MP_PROCESSOR)
+        {
+          entry += 8;
+          continue;
+        }
+      entry += sizeof *p;
+      if (!(p->flags & MP_CPU_ENABLED))
+        continue;
+
+      found++;
+      if (p->flags & MP_CPU_BSP)
+        cpus[0].apic_id = p->apic_id;
+      else if (cpu_cnt < CPU_MAX)
+        {
+          struct cpu *c = &cpus[cpu_cnt];
+          c->id = cpu_cnt++;
+          c->apic_id = p->apic_id;
+          c->started = false;
+        }
+    }
+
+  if (found > 1)
+    printf ("%d CPUs found, using 1.\n", found);
+}
+
+/* Returns the processor running the caller, which is the CPU of
+   the running thread: a thread only changes CPUs while it is not
+   running.  Interrupt handlers run on the stack of the thread
+   they interrupted, and so find its CPU.  The initial thread has
+   no CPU until thread_init() gives it this one, the bootstrap
+   processor. */
+struct cpu *
+cpu_current (void)
+{
+  uint32_t *esp;
+  struct thread *t;
+
+  /* As running_thread() in thread.c. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  t = pg_round_down (esp);
+  return t->cpu != NULL ? t->cpu : &cpus[0];
+}
+
+/* Searches SIZE bytes of physical memory at START for an MP
+   floating pointer structure, and returns it if found, otherwise
+   a null pointer. */
+static struct mp_float *
+mp_search (uintptr_t start, size_t size)
+{
+  uint8_t *p = phys_to_kernel (start, size);
+  uint8_t *end;
+
+  if (p == NULL)
+    return NULL;
+  for (end = p + size; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_float)))
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to zero. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
+
+/* Returns the kernel virtual address of SIZE bytes of physical
+   memory at PADDR, or a null pointer if they are not all mapped
+   in the kernel's view of physical memory. */
+static void *
+phys_to_kernel (uintptr_t paddr, size_t size)
+{
+  uintptr_t limit = init_ram_pages * PGSIZE;
+
+  if (paddr == 0 || paddr > limit || size > limit - paddr)
+    return NULL;
+  return ptov (paddr);
+}
@@ -0,0 +1,52 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Maximum number of processors. */
+#define CPU_MAX 8
+
+/* A processor, and its per-CPU data.
+
+   Each field below ID is state of this CPU alone, which only
+   code running on it changes, with interrupts off, so that it
+   needs no lock.  Statistics kept here are summed over all CPUs
+   when they are read.  The run queue and the malloc() magazines
+   of a CPU are kept by thread.c and malloc.c, indexed by ID.
+
+   cpu_current() finds the running CPU through the running
+   thread, which records the CPU it runs on. */
+struct cpu
+  {
+    int id;                     /* Index in cpus[]. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool started;               /* Running threads? */
+    struct thread *idle_thread; /* Runs when nothing else can. */
+
+    /* Scheduling. */
+    unsigned thread_ticks;      /* # of timer ticks since last yield. */
+    unsigned rcu_qs_cnt;        /* # of RCU quiescent states passed. */
+
+    /* FPU. */
+    struct thread *fpu_owner;   /* Thread whose state is in the FPU. */
+    bool fpu_live;              /* Running thread owns the FPU? */
+    bool fpu_kernel;            /* In kernel_fpu_begin()? */
+
+    /* Statistics. */
+    long long idle_ticks;       /* # of timer ticks spent idle. */
+    long long kernel_ticks;     /* # of timer ticks in kernel threads. */
+    long long user_ticks;       /* # of timer ticks in user programs. */
+  };
+
+/* Processors found, with the bootstrap processor first. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+void cpu_init (void);
+void cpu_probe (void);
+struct cpu *cpu_current (void);
+
+#endif /* threads/cpu.h */
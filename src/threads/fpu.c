@@ -0,0 +1,386 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Lazy x87 FPU and SSE context switching.
+
+   Neither switch_threads() nor the interrupt stubs touch the FPU
+   or SSE registers, which only user programs and code between
+   kernel_fpu_begin() and kernel_fpu_end() may use.  Instead,
+   CR0.TS is set whenever the current thread's state is not in
+   the registers, so that its first FPU or SSE instruction traps
+   with a #NM (device not available) exception, and
+   fpu_restore() loads its state with FXRSTOR then.  A thread
+   that never uses the FPU costs nothing: it has no save area,
+   only allocated at its first #NM.
+
+   A thread that trapped is "live" on its CPU until it is
+   switched out, when fpu_switch() saves its registers with
+   FXSAVE and sets CR0.TS again.  The CPU remembers the thread
+   whose state its registers still hold, as FPU_OWNER, so that if
+   no other thread used them meanwhile the next #NM of that
+   thread on that CPU need not reload them.  As a thread's save
+   area is always current once the thread is switched out, it may
+   resume on any CPU.
+
+   Kernel code that uses SSE, such as fpu_zero_page(), brackets
+   it with kernel_fpu_begin() and kernel_fpu_end(), which save a
+   live thread's registers first and keep interrupts off
+   meanwhile, since no one would save the kernel's.  The kernel
+   is compiled with -msoft-float and without SSE, so the compiler
+   itself never emits such instructions.
+
+   Without FXSR and SSE, as on a CPU older than the Pentium III,
+   FPU emulation stays on, the FPU is disabled and #NM kills the
+   process as before. */
+
+/* CR0 and CR4 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor: WAIT traps if TS. */
+#define CR0_EM 0x00000004       /* Emulation: FPU instructions trap. */
+#define CR0_TS 0x00000008       /* Task switched: FPU instructions trap. */
+#define CR0_NE 0x00000020       /* Numeric error: report as #MF. */
+#define CR4_OSFXSR 0x00000200   /* FXSAVE, FXRSTOR and SSE enabled. */
+#define CR4_OSXMMEXCPT 0x00000400 /* SSE exceptions reported as #XM. */
+
+/* CPUID.01H:EDX feature bits. */
+#define CPUID_FXSR (1u << 24)   /* FXSAVE and FXRSTOR. */
+#define CPUID_SSE (1u << 25)    /* SSE. */
+
+/* Size of an FXSAVE area, which must be 16-byte aligned. */
+#define FXSAVE_SIZE 512
+
+/* Initial MXCSR: round to nearest, all SSE exceptions masked. */
+#define MXCSR_INIT 0x1f80
+
+/* True if the FPU may be used. */
+static bool fpu_on;
+
+/* State a thread starts with, after FNINIT. */
+static uint8_t init_state[FXSAVE_SIZE + 15];
+
+/* Statistics. */
+static long long trap_cnt;      /* # of #NM exceptions handled. */
+static long long restore_cnt;   /* # of FXRSTORs. */
+static long long save_cnt;      /* # of FXSAVEs. */
+
+/* Returns the 16-byte aligned FXSAVE area within BUF. */
+static void *
+fx_area (void *buf)
+{
+  return (void *) ROUND_UP ((uintptr_t) buf, 16);
+}
+
+static inline void
+fxsave (void *area)
+{
+  asm volatile ("fxsave (%0)" : : "r" (area) : "memory");
+}
+
+static inline void
+fxrstor (const void *area)
+{
+  asm volatile ("fxrstor (%0)" : : "r" (area) : "memory");
+}
+
+/* Clears CR0.TS, letting FPU and SSE instructions run. */
+static inline void
+clts (void)
+{
+  asm volatile ("clts" : : : "memory");
+}
+
+/* Sets CR0.TS, making the next FPU or SSE instruction trap. */
+static inline void
+stts (void)
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0 | CR0_TS) : "memory");
+}
+
+/* Enables the FPU and SSE, if the CPU has FXSAVE and SSE, and
+   records the state threads start with. */
+void
+fpu_init (void)
+{
+  uint32_t max_leaf, b, c, d;
+  uint32_t cr0, cr4, mxcsr = MXCSR_INIT;
+
+  asm ("cpuid" : "=a" (max_leaf), "=b" (b), "=c" (c), "=d" (d) : "0" (0));
+  if (max_leaf < 1)
+    return;
+  asm ("cpuid" : "=a" (max_leaf), "=b" (b), "=c" (c), "=d" (d) : "0" (1));
+  if ((d & (CPUID_FXSR | CPUID_SSE)) != (CPUID_FXSR | CPUID_SSE))
+    {
+      printf ("fpu: no FXSR or SSE, FPU disabled\n");
+      return;
+    }
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4));
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0));
+
+  asm volatile ("fninit; ldmxcsr %0" : : "m" (mxcsr));
+  fxsave (fx_area (init_state));
+  stts ();
+  fpu_on = true;
+}
+
+/* Returns true if the FPU and SSE may be used. */
+bool
+fpu_enabled (void)
+{
+  return fpu_on;
+}
+
+/* Saves the FPU state of PREV, the running thread, if it has
+   used the FPU since it was switched in, and sets CR0.TS.  Called
+   by schedule() before switching away from PREV, with interrupts
+   off. */
+void
+fpu_switch (struct thread *prev)
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->fpu_live)
+    {
+      ASSERT (c->fpu_owner == prev);
+      fxsave (fx_area (c->fpu_owner->fpu));
+      save_cnt++;
+      stts ();
+      c->fpu_live = false;
+    }
+}
+
+/* Handles a #NM exception from user code, giving the running
+   thread the FPU: allocates its save area at its first use, and
+   loads its state unless the registers still hold it.  Returns
+   false if the FPU is disabled or memory is short, in which case
+   the process should be killed. */
+bool
+fpu_restore (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct cpu *c;
+
+  if (!fpu_on)
+    return false;
+  if (cur->fpu == NULL)
+    {
+      cur->fpu = malloc (FXSAVE_SIZE + 15);
+      if (cur->fpu == NULL)
+        return false;
+      memcpy (fx_area (cur->fpu), fx_area (init_state), FXSAVE_SIZE);
+      cur->fpu_cpu = NULL;
+    }
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  clts ();
+  if (c->fpu_owner != cur || cur->fpu_cpu != c)
+    {
+      fxrstor (fx_area (cur->fpu));
+      restore_cnt++;
+      c->fpu_owner = cur;
+      cur->fpu_cpu = c;
+    }
+  c->fpu_live = true;
+  trap_cnt++;
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Gives the running thread, a new process forked from PARENT, a
+   copy of PARENT's FPU state.  PARENT must be blocked, so that
+   its save area is current.  Returns false if memory is short. */
+bool
+fpu_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (parent->status == THREAD_BLOCKED);
+
+  if (parent->fpu == NULL)
+    return true;
+  cur->fpu = malloc (FXSAVE_SIZE + 15);
+  if (cur->fpu == NULL)
+    return false;
+  memcpy (fx_area (cur->fpu), fx_area (parent->fpu), FXSAVE_SIZE);
+  cur->fpu_cpu = NULL;
+  return true;
+}
+
+/* Discards the running thread's FPU state, as it exits. */
+void
+fpu_exit (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  struct cpu *c;
+
+  old_level = intr_disable ();
+  c = cpu_current ();
+  if (c->fpu_live)
+    {
+      stts ();
+      c->fpu_live = false;
+    }
+  if (c->fpu_owner == cur)
+    c->fpu_owner = NULL;
+  intr_set_level (old_level);
+
+  free (cur->fpu);
+  cur->fpu = NULL;
+}
+
+/* Saves the running thread's FPU state, if it is live, and
+   forgets which thread's state the registers hold, so that each
+   thread's next use reloads it.  For hibernation, across which
+   the registers are lost.  Interrupts must be off. */
+void
+fpu_flush (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (fpu_on)
+    kernel_fpu_end (kernel_fpu_begin ());
+}
+
+/* Lets the kernel use SSE registers until kernel_fpu_end(),
+   saving the state of the thread whose registers they are first.
+   Turns interrupts off, and returns the previous interrupt level
+   to pass to kernel_fpu_end().  The FPU must be enabled, and
+   kernel_fpu_begin() may not nest. */
+enum intr_level
+kernel_fpu_begin (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct cpu *c = cpu_current ();
+
+  ASSERT (fpu_on);
+  ASSERT (!c->fpu_kernel);
+
+  if (c->fpu_live)
+    {
+      fxsave (fx_area (c->fpu_owner->fpu));
+      save_cnt++;
+      c->fpu_live = false;
+    }
+  else
+    clts ();
+  c->fpu_owner = NULL;
+  c->fpu_kernel = true;
+  return old_level;
+}
+
+/* Ends the use of SSE registers begun by kernel_fpu_begin(), and
+   restores interrupts to OLD_LEVEL. */
+void
+kernel_fpu_end (enum intr_level old_level)
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (c->fpu_kernel);
+
+  c->fpu_kernel = false;
+  stts ();
+  intr_set_level (old_level);
+}
+
+/* Sets the PGSIZE bytes of page-aligned PAGE to zero, 128 bytes
+   at a time through the SSE registers if the FPU is enabled.
+   The xmm registers are not named as clobbered: the compiler
+   does not use them in the kernel. */
+void
+fpu_zero_page (void *page)
+{
+  enum intr_level old_level;
+  uint8_t *p;
+
+  ASSERT (pg_ofs (page) == 0);
+
+  if (!fpu_on)
+    {
+      memzero_page (page);
+      return;
+    }
+
+  old_level = kernel_fpu_begin ();
+  asm volatile ("xorps %xmm0, %xmm0");
+  for (p = page; p < (uint8_t *) page + PGSIZE; p += 128)
+    asm volatile ("movaps %%xmm0, 0(%0)\n\t"
+                  "movaps %%xmm0, 16(%0)\n\t"
+                  "movaps %%xmm0, 32(%0)\n\t"
+                  "movaps %%xmm0, 48(%0)\n\t"
+                  "movaps %%xmm0, 64(%0)\n\t"
+                  "movaps %%xmm0, 80(%0)\n\t"
+                  "movaps %%xmm0, 96(%0)\n\t"
+                  "movaps %%xmm0, 112(%0)"
+                  : : "r" (p) : "memory");
+  kernel_fpu_end (old_level);
+}
+
+/* Copies the PGSIZE bytes of page-aligned SRC to page-aligned
+   DST, 128 bytes at a time through the SSE registers if the FPU
+   is enabled. */
+void
+fpu_copy_page (void *dst, const void *src)
+{
+  enum intr_level old_level;
+  const uint8_t *s;
+  uint8_t *d;
+
+  ASSERT (pg_ofs (dst) == 0);
+  ASSERT (pg_ofs (src) == 0);
+
+  if (!fpu_on)
+    {
+      memcpy (dst, src, PGSIZE);
+      return;
+    }
+
+  old_level = kernel_fpu_begin ();
+  for (d = dst, s = src; s < (const uint8_t *) src + PGSIZE;
+       d += 128, s += 128)
+    asm volatile ("movaps 0(%1), %%xmm0\n\t"
+                  "movaps 16(%1), %%xmm1\n\t"
+                  "movaps 32(%1), %%xmm2\n\t"
+                  "movaps 48(%1), %%xmm3\n\t"
+                  "movaps 64(%1), %%xmm4\n\t"
+                  "movaps 80(%1), %%xmm5\n\t"
+                  "movaps 96(%1), %%xmm6\n\t"
+                  "movaps 112(%1), %%xmm7\n\t"
+                  "movaps %%xmm0, 0(%0)\n\t"
+                  "movaps %%xmm1, 16(%0)\n\t"
+                  "movaps %%xmm2, 32(%0)\n\t"
+                  "movaps %%xmm3, 48(%0)\n\t"
+                  "movaps %%xmm4, 64(%0)\n\t"
+                  "movaps %%xmm5, 80(%0)\n\t"
+                  "movaps %%xmm6, 96(%0)\n\t"
+                  "movaps %%xmm7, 112(%0)"
+                  : : "r" (d), "r" (s) : "memory");
+  kernel_fpu_end (old_level);
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void)
+{
+  if (fpu_on)
+    printf ("FPU: %lld traps, %lld restores, %lld saves\n",
+            trap_cnt, restore_cnt, save_cnt);
+}
@@ -0,0 +1,26 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+#include "threads/interrupt.h"
+
+/* x87 FPU and SSE state.  See fpu.c. */
+
+struct thread;
+
+void fpu_init (void);
+bool fpu_enabled (void);
+void fpu_switch (struct thread *prev);
+bool fpu_restore (void);
+bool fpu_copy (struct thread *parent);
+void fpu_exit (void);
+void fpu_flush (void);
+void fpu_print_stats (void);
+
+enum intr_level kernel_fpu_begin (void);
+void kernel_fpu_end (enum intr_level);
+
+void fpu_zero_page (void *);
+void fpu_copy_page (void *dst, const void *src);
+
+#endif /* threads/fpu.h */
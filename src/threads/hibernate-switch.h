@@ -0,0 +1,68 @@
+#ifndef THREADS_HIBERNATE_SWITCH_H
+#define THREADS_HIBERNATE_SWITCH_H
+
+#ifndef __ASSEMBLER__
+#include <debug.h>
+#include <stdint.h>
+
+/* CPU state saved by hibernate_save_context(). */
+struct hibernate_context
+  {
+    uint32_t ebx;               /*  0: Saved %ebx. */
+    uint32_t esi;               /*  4: Saved %esi. */
+    uint32_t edi;               /*  8: Saved %edi. */
+    uint32_t ebp;               /* 12: Saved %ebp. */
+    uint32_t esp;               /* 16: Stack pointer after return. */
+    uint32_t eip;               /* 20: Return address. */
+    uint32_t eflags;            /* 24: Flags. */
+    uint32_t cr0;               /* 28: Control registers. */
+    uint32_t cr3;               /* 32 */
+    uint32_t cr4;               /* 36 */
+  };
+
+/* One page for hibernate_restore() to copy. */
+struct hibernate_copy
+  {
+    void *dst;                  /* Where the page goes. */
+    const void *src;            /* Where it is held until then. */
+  };
+
+/* A page-sized table of pages for hibernate_restore() to copy. */
+#define HIBERNATE_COPY_CNT 511
+struct hibernate_table
+  {
+    struct hibernate_table *next;       /* 0: Next table, or null. */
+    uint32_t cnt;                       /* 4: Number of copies. */
+    struct hibernate_copy copies[HIBERNATE_COPY_CNT]; /* 8: Copies. */
+  };
+
+/* Saves the CPU state in CTX and returns a null pointer, and
+   later, if hibernate_restore() resumes CTX, returns again with
+   its RET. */
+void *hibernate_save_context (struct hibernate_context *ctx)
+  __attribute__ ((returns_twice));
+
+/* Copies the pages in TABLE and resumes CTX, returning RET from
+   hibernate_save_context(). */
+void hibernate_restore (struct hibernate_table *table,
+                        struct hibernate_context *ctx, void *ret)
+  NO_RETURN;
+#endif
+
+/* Offsets used by hibernate-switch.S. */
+#define HIB_EBX 0
+#define HIB_ESI 4
+#define HIB_EDI 8
+#define HIB_EBP 12
+#define HIB_ESP 16
+#define HIB_EIP 20
+#define HIB_EFLAGS 24
+#define HIB_CR0 28
+#define HIB_CR3 32
+#define HIB_CR4 36
+
+#define HIB_TABLE_NEXT 0
+#define HIB_TABLE_CNT 4
+#define HIB_TABLE_COPIES 8
+
+#endif /* threads/hibernate-switch.h */
@@ -0,0 +1,435 @@
+#include "threads/hibernate.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/serial.h"
+#include "devices/timer.h"
+#include "devices/virtio-blk.h"
+#include "threads/fpu.h"
+#include "threads/hibernate-switch.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pmc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+#ifdef FILESYS
+#include "filesys/filesys.h"
+#endif
+
+/* Hibernation: saving the booted kernel to disk and resuming it.
+
+   The "hibernate" action writes each page that the kernel is
+   using, with the CPU state needed to go on from there, to a
+   Pintos hibernation partition (type 0x25), such as the one that
+   "pintos-mkdisk --hibernate-size" makes.  A later boot with
+   -resume reads them back where it would otherwise run
+   palloc_init() through filesys_init() and the actions before
+   "hibernate", and so starts from the same warm state, going on
+   with its own command line's actions instead of the rest of the
+   first boot's.
+
+   The image works only with the same kernel binary and amount of
+   RAM, which are checked, and the same disk contents, which are
+   not: in particular, the file system in memory expects the file
+   system disk to be as it was at hibernation, so it must be a
+   copy kept from that run.
+
+   Pages are written with interrupts off, by polled IDE transfers,
+   so that nothing changes while they are saved.  Resuming cannot
+   use the block layer, which is not set up yet, so it finds the
+   image by reading the IDE disks' primary partition tables
+   itself, and reads each saved page into a page that no saved
+   page goes to.  Then hibernate_restore() copies the pages into
+   place and returns into the saved kernel, which sets up again
+   the devices that the reboot reset.
+
+   The image is laid out as:
+
+     - Sector 0: struct image_header.
+
+     - MAP_SECTORS sectors: saved_map[].
+
+     - Each saved page, in order of physical address. */
+
+/* Partition type of a hibernation image. */
+#define PART_TYPE 0x25
+
+/* "PHIB", identifies a valid image. */
+#define IMAGE_MAGIC 0x42494850
+
+/* start.S caps RAM at 64 MB. */
+#define MAX_PAGES (64 * 1024 * 1024 / PGSIZE)
+
+/* Sectors in the image's map of saved pages, and per page. */
+#define MAP_SECTORS (MAX_PAGES / 8 / BLOCK_SECTOR_SIZE)
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The first page above the 1 MB of low memory. */
+#define HIGH_PAGE (1024 * 1024 / PGSIZE)
+
+/* Number of IDE disks, hda through hdd. */
+#define IDE_DISK_CNT 4
+
+/* First sector of an image. */
+struct image_header
+  {
+    uint32_t magic;             /* IMAGE_MAGIC. */
+    uint32_t kernel_hash;       /* hash_bytes() of the kernel code. */
+    uint32_t ram_pages;         /* init_ram_pages at hibernation. */
+    uint32_t page_cnt;          /* Number of pages saved. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16];
+  };
+
+/* Location of an image. */
+struct image
+  {
+    int disk_no;                /* IDE disk, 0 for hda. */
+    block_sector_t start;       /* First sector. */
+    block_sector_t size;        /* Number of sectors. */
+  };
+
+/* Kernel code, from kernel.lds.S. */
+extern char _start, _end_kernel_text, _end;
+
+/* Which pages are in the image, one bit per physical page. */
+static uint32_t saved_map[MAX_PAGES / 32];
+
+/* CPU state at hibernation. */
+static struct hibernate_context context;
+
+/* clock_ns() at hibernation. */
+static int64_t hibernate_ns;
+
+/* Buffer for a header or partition table. */
+static struct image_header header;
+
+static bool find_image (struct image *);
+static size_t mark_pages (void) NO_INLINE;
+static bool write_image (const struct image *, size_t page_cnt) NO_INLINE;
+static char **resume_devices (const char *args);
+static uint32_t kernel_hash (void);
+static void *staging_page (size_t *pfn);
+
+/* Returns true if page number PFN is in the image. */
+static inline bool
+is_saved (size_t pfn)
+{
+  return (saved_map[pfn / 32] & (1u << (pfn % 32))) != 0;
+}
+
+/* Marks page number PFN as in the image. */
+static inline void
+mark_saved (size_t pfn)
+{
+  saved_map[pfn / 32] |= 1u << (pfn % 32);
+}
+
+/* Saves the running kernel to the hibernation partition.
+   Returns a null pointer once it is saved, or if it could not
+   be.  Otherwise, once a later boot with -resume has brought the
+   saved kernel back, returns that boot's actions, as an
+   argv-like array.  Must be called from main()'s thread, with
+   the system otherwise idle. */
+char **
+hibernate (void)
+{
+  struct image image;
+  enum intr_level old_level;
+  size_t page_cnt;
+  const char *args;
+
+  ASSERT (vtop (thread_current ()) < HIGH_PAGE * PGSIZE);
+
+  if (virtio_blk_cnt () > 0 || pmc_enabled)
+    {
+      printf ("hibernate: cannot resume virtio disks or -pmc\n");
+      return NULL;
+    }
+#ifdef FILESYS
+  filesys_sync ();
+#endif
+
+  old_level = intr_disable ();
+  serial_flush ();
+  if (!find_image (&image))
+    {
+      intr_set_level (old_level);
+      printf ("hibernate: no hibernation partition, or disk busy\n");
+      return NULL;
+    }
+  palloc_flush_cache ();
+  fpu_flush ();
+  page_cnt = mark_pages ();
+  if (page_cnt * PAGE_SECTORS > image.size - 1 - MAP_SECTORS)
+    {
+      intr_set_level (old_level);
+      printf ("hibernate: %zu pages do not fit in hd%c\n",
+              page_cnt, 'a' + image.disk_no);
+      return NULL;
+    }
+
+  /* Everything written to memory from here on, until the image
+     is written, may or may not be in the image, so it must not
+     matter to the resumed kernel. */
+  hibernate_ns = clock_ns ();
+  args = hibernate_save_context (&context);
+  if (args != NULL)
+    return resume_devices (args);
+  if (!write_image (&image, page_cnt))
+    {
+      intr_set_level (old_level);
+      printf ("hibernate: write to hd%c failed\n", 'a' + image.disk_no);
+      return NULL;
+    }
+  intr_set_level (old_level);
+
+  printf ("hibernate: saved %zu pages to hd%c\n",
+          page_cnt, 'a' + image.disk_no);
+  return NULL;
+}
+
+/* Resumes the kernel that hibernate() saved, which goes on to
+   run the actions in ARGV[] instead of its own.  Panics if there
+   is no image, or it does not fit this kernel or machine.
+   Called by main() with interrupts off, before the page allocator
+   is set up, so that all of physical memory but the kernel and
+   its stack page is unused. */
+void
+hibernate_resume (char **argv)
+{
+  struct hibernate_table *table = NULL, *t = NULL;
+  struct image image;
+  block_sector_t sector;
+  size_t pfn, next_pfn = HIGH_PAGE;
+  char *args, *p;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!find_image (&image))
+    PANIC ("resume: no hibernation partition");
+  if (!ide_poll_transfer (image.disk_no, image.start, &header, 1, false)
+      || header.magic != IMAGE_MAGIC)
+    PANIC ("resume: no saved kernel in hd%c", 'a' + image.disk_no);
+  if (header.kernel_hash != kernel_hash ())
+    PANIC ("resume: kernel was saved by a different kernel binary");
+  if (header.ram_pages != init_ram_pages)
+    PANIC ("resume: kernel was saved with %"PRIu32" pages of RAM, "
+           "not %"PRIu32, header.ram_pages, init_ram_pages);
+  if (!ide_poll_transfer (image.disk_no, image.start + 1, saved_map,
+                          MAP_SECTORS, false))
+    PANIC ("resume: read of hd%c failed", 'a' + image.disk_no);
+
+  /* Pack our actions into a page that the saved kernel will find
+     free, to be copied out at once. */
+  args = p = staging_page (&next_pfn);
+  for (; *argv != NULL; argv++)
+    {
+      size_t size = strlen (*argv) + 1;
+      memcpy (p, *argv, size);
+      p += size;
+    }
+  *p = '\0';
+
+  /* Read each saved page into a staging page, noting the copy to
+     make in a table. */
+  printf ("resume: reading %"PRIu32" pages from hd%c\n",
+          header.page_cnt, 'a' + image.disk_no);
+  sector = image.start + 1 + MAP_SECTORS;
+  for (pfn = 0; pfn < init_ram_pages; pfn++)
+    if (is_saved (pfn))
+      {
+        void *copy;
+
+        if (t == NULL || t->cnt == HIBERNATE_COPY_CNT)
+          {
+            struct hibernate_table *n = staging_page (&next_pfn);
+            n->next = NULL;
+            n->cnt = 0;
+            if (t != NULL)
+              t->next = n;
+            else
+              table = n;
+            t = n;
+          }
+
+        copy = staging_page (&next_pfn);
+        if (!ide_poll_transfer (image.disk_no, sector, copy,
+                                PAGE_SECTORS, false))
+          PANIC ("resume: read of hd%c failed, sector=%"PRDSNu,
+                 'a' + image.disk_no, sector);
+        t->copies[t->cnt].dst = ptov (pfn * PGSIZE);
+        t->copies[t->cnt].src = copy;
+        t->cnt++;
+        sector += PAGE_SECTORS;
+      }
+
+  hibernate_restore (table, &context, args);
+}
+
+/* Looks for a hibernation partition in the primary partition
+   table of each IDE disk, and stores the first found in *IMAGE.
+   Returns true if successful.  Interrupts must be off. */
+static bool
+find_image (struct image *image)
+{
+  uint8_t *mbr = (uint8_t *) &header;
+  int disk_no, i;
+
+  for (disk_no = 0; disk_no < IDE_DISK_CNT; disk_no++)
+    {
+      if (!ide_poll_transfer (disk_no, 0, mbr, 1, false)
+          || mbr[510] != 0x55 || mbr[511] != 0xaa)
+        continue;
+      for (i = 0; i < 4; i++)
+        {
+          const uint8_t *e = mbr + 446 + 16 * i;
+          uint32_t start, size;
+
+          if (e[4] != PART_TYPE)
+            continue;
+          memcpy (&start, e + 8, sizeof start);
+          memcpy (&size, e + 12, sizeof size);
+          if (size < 1 + MAP_SECTORS)
+            continue;
+          image->disk_no = disk_no;
+          image->start = start;
+          image->size = size;
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Marks in saved_map[] the pages to save, and returns how many
+   there are: the page of main()'s thread, the only one not
+   from the page allocator, the kernel image, and every page
+   above low memory that the page allocator does not have free,
+   which includes its own bookkeeping.  Low memory outside the
+   kernel is left out, since it holds the new boot's command
+   line and page tables from start.S, which the saved kernel no
+   longer uses. */
+static size_t
+mark_pages (void)
+{
+  size_t pfn, cnt = 0;
+
+  memset (saved_map, 0, sizeof saved_map);
+  mark_saved (vtop (thread_current ()) / PGSIZE);
+  for (pfn = vtop (&_start) / PGSIZE; pfn <= vtop (&_end - 1) / PGSIZE;
+       pfn++)
+    mark_saved (pfn);
+  for (pfn = HIGH_PAGE; pfn < init_ram_pages; pfn++)
+    if (!palloc_page_free (ptov (pfn * PGSIZE)))
+      mark_saved (pfn);
+
+  for (pfn = 0; pfn < init_ram_pages; pfn++)
+    if (is_saved (pfn))
+      cnt++;
+  return cnt;
+}
+
+/* Writes the PAGE_CNT pages marked in saved_map[] to IMAGE, then
+   the map, then the header, which makes the image valid.  The
+   header is invalidated first, so that a failed write leaves no
+   image that seems valid.  Returns true if successful. */
+static bool
+write_image (const struct image *image, size_t page_cnt)
+{
+  block_sector_t sector = image->start + 1 + MAP_SECTORS;
+  size_t pfn, cnt;
+
+  memset (&header, 0, sizeof header);
+  if (!ide_poll_transfer (image->disk_no, image->start, &header, 1, true))
+    return false;
+
+  /* Write each run of consecutive pages in one transfer. */
+  for (pfn = 0; pfn < init_ram_pages; pfn += cnt)
+    {
+      for (cnt = 0; pfn + cnt < init_ram_pages && is_saved (pfn + cnt);
+           cnt++)
+        continue;
+      if (cnt == 0)
+        cnt = 1;
+      else
+        {
+          if (!ide_poll_transfer (image->disk_no, sector,
+                                  ptov (pfn * PGSIZE),
+                                  cnt * PAGE_SECTORS, true))
+            return false;
+          sector += cnt * PAGE_SECTORS;
+        }
+    }
+
+  header.magic = IMAGE_MAGIC;
+  header.kernel_hash = kernel_hash ();
+  header.ram_pages = init_ram_pages;
+  header.page_cnt = page_cnt;
+  return (ide_poll_transfer (image->disk_no, image->start + 1, saved_map,
+                             MAP_SECTORS, true)
+          && ide_poll_transfer (image->disk_no, image->start, &header, 1,
+                                true));
+}
+
+/* Called in the resumed kernel, with interrupts off, as
+   hibernate() returns the second time, with ARGS, the resuming
+   boot's actions packed one after another and ended by an empty
+   string.  Copies them out of the free page they are in, sets
+   up the devices that the reboot reset, turns interrupts on, and
+   returns the actions as an argv-like array. */
+static char **
+resume_devices (const char *args)
+{
+  static char buf[LOADER_ARGS_LEN];
+  static char *argv[LOADER_ARGS_LEN / 2 + 1];
+  char *p = buf;
+  int argc = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (; *args != '\0'; args += strlen (args) + 1)
+    {
+      argv[argc++] = p;
+      strlcpy (p, args, buf + sizeof buf - p);
+      p += strlen (p) + 1;
+    }
+  argv[argc] = NULL;
+
+#ifdef USERPROG
+  gdt_init ();
+#endif
+  intr_resume ();
+  timer_reinit (hibernate_ns);
+  serial_resume ();
+  ide_resume ();
+  intr_enable ();
+
+  return argv;
+}
+
+/* Returns a hash of the kernel's code and read-only data. */
+static uint32_t
+kernel_hash (void)
+{
+  return hash_bytes (&_start, &_end_kernel_text - &_start);
+}
+
+/* Returns the page numbered *PFN or the first after it that is
+   not in the image, to hold data until hibernate_restore(), and
+   advances *PFN past it.  Panics if there is none. */
+static void *
+staging_page (size_t *pfn)
+{
+  while (*pfn < init_ram_pages && is_saved (*pfn))
+    ++*pfn;
+  if (*pfn >= init_ram_pages)
+    PANIC ("resume: not enough free memory to resume");
+  return ptov ((*pfn)++ * PGSIZE);
+}
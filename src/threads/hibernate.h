@@ -0,0 +1,9 @@
+#ifndef THREADS_HIBERNATE_H
+#define THREADS_HIBERNATE_H
+
+#include <debug.h>
+
+char **hibernate (void);
+void hibernate_resume (char **argv) NO_RETURN;
+
+#endif /* threads/hibernate.h */
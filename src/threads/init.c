@@ -1,5 +1,6 @@
 #include "threads/init.h"
 #include <console.h>
+#include <crc32c.h>
 #include <debug.h>
 #include <inttypes.h>
 #include <limits.h>
@@ -15,18 +16,27 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
+#include "threads/hibernate.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pmc.h"
+#include "threads/profile.h"
+#include "threads/trace.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
+#include "userprog/systrace.h"
 #include "userprog/tss.h"
 #else
 #include "tests/threads/tests.h"
@@ -34,11 +44,19 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
+#include "filesys/initrd.h"
 #include "filesys/fsutil.h"
 #endif
 #ifdef VM
 #include "vm/frame.h"
+#include "vm/futex.h"
+#include "vm/page.h"
+#include "vm/pff.h"
+#include "vm/prepage.h"
+#include "vm/shm.h"
 #include "vm/swap.h"
 #endif
 
@@ -49,10 +67,19 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -initrd: Load the scratch device's archive as a file image? */
+static bool load_initrd;
+
+/* -resume: Resume the kernel saved by the "hibernate" action? */
+static bool resume_kernel;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: Size in MB of RAM disk "rd0", or 0 for none. */
+static size_t ramdisk_mb;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -61,6 +88,20 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -bt: Print how long each step of the boot took? */
+static bool print_boot_times;
+
+/* Steps of the boot, each with the time stamp counter at its
+   end, recorded by boot_step(). */
+#define BOOT_STEP_CNT 16
+static struct
+  {
+    const char *name;
+    uint64_t cycles;
+  }
+boot_steps[BOOT_STEP_CNT];
+static size_t boot_step_cnt;
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -68,6 +109,8 @@ static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+static void boot_step (const char *name);
+static void print_boot_steps (void);
 
 #ifdef FILESYS
 static void locate_block_devices (void);
@@ -84,6 +127,7 @@ main (void)
 
   /* Clear BSS. */  
   bss_init ();
+  boot_step ("firmware and loader");
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
@@ -97,11 +141,24 @@ main (void)
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
+  cpu_probe ();
+
+#ifdef FILESYS
+  /* Resume a hibernated kernel instead of booting this one. */
+  if (resume_kernel)
+    hibernate_resume (argv);
+#endif
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+  fpu_init ();
+  crc32c_init ();
+  pmc_init ();
+  profile_init ();
+  trace_init ();
+  boot_step ("memory");
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -117,27 +174,48 @@ main (void)
 #ifdef USERPROG
   exception_init ();
   syscall_init ();
+  systrace_init ();
+  process_init ();
 #endif
+  boot_step ("interrupts");
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  workqueue_init ();
+#ifdef USERPROG
+  aio_init ();
+#endif
   serial_init_queue ();
+  boot_step ("threads");
   timer_calibrate ();
+  boot_step ("timer calibration");
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init (ramdisk_mb);
+  boot_step ("disks");
   locate_block_devices ();
   filesys_init (format_filesys);
+  if (load_initrd)
+    initrd_load ();
+  boot_step ("file system");
 #endif
 
 #ifdef VM
   /* Initialize virtual memory system. */
   frame_init ();
   swap_init ();
+  page_init ();
+  shm_init ();
+  futex_init ();
+  boot_step ("virtual memory");
 #endif
 
-  printf ("Boot complete.\n");
+  if (print_boot_times)
+    print_boot_steps ();
+  printf ("Boot complete in %"PRId64" ms.\n", clock_reset_ns () / 1000000);
   
   /* Run actions specified on kernel command line. */
   run_actions (argv);
@@ -160,6 +238,10 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CR4 bits. */
+#define CR4_PSE 0x00000010      /* Page size extensions (4 MB pages). */
+#define CR4_PGE 0x00000080      /* Global pages. */
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
@@ -187,7 +269,9 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      /* Kernel mappings are the same in every page directory,
+         so they are global and survive context switches. */
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -196,6 +280,12 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
+
+  /* Allow 4 MB pages in page directories and honor the global
+     bit in PTEs.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte and
+     4-MByte Pages" and 3.12 "Translation Lookaside Buffers". */
+  asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                : : "i" (CR4_PSE | CR4_PGE) : "eax");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -253,22 +343,109 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-initrd"))
+        load_initrd = true;
+      else if (!strcmp (name, "-resume"))
+        resume_kernel = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_mb = atoi (value);
 #ifdef VM
       else if (!strcmp (name, "-swap"))
-        swap_bdev_name = value;
+        {
+          swap_bdev_name = value;
+          swap_all_devices = false;
+        }
 #endif
 #endif
+      else if (!strcmp (name, "-lpt"))
+        timer_preset_loops = atoi (value);
+      else if (!strcmp (name, "-tsc"))
+        timer_preset_tsc_khz = atoi (value);
+      else if (!strcmp (name, "-bt"))
+        print_boot_times = true;
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
-        thread_mlfqs = true;
+        thread_set_sched_class ("mlfqs");
+      else if (!strcmp (name, "-slt"))
+        thread_trace_sched = true;
+      else if (!strcmp (name, "-it"))
+        intr_trace = true;
+      else if (!strcmp (name, "-prof"))
+        profile_rate = value != NULL ? atoi (value) : 1;
+      else if (!strcmp (name, "-pmc"))
+        pmc_enabled = true;
+      else if (!strcmp (name, "-profev"))
+        {
+          profile_event = value != NULL ? pmc_lookup (value) : -1;
+          if (profile_event < 0)
+            PANIC ("unknown performance counter event `%s'", value);
+          pmc_enabled = true;
+        }
+      else if (!strcmp (name, "-trace"))
+        {
+          if (value == NULL || !trace_enable (value))
+            PANIC ("unknown trace category in `%s'", value);
+        }
+      else if (!strcmp (name, "-sched"))
+        {
+          if (value == NULL || !thread_set_sched_class (value))
+            PANIC ("unknown scheduling class `%s'", value);
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-systrace"))
+        systrace_pages = value != NULL ? atoi (value) : SYSTRACE_PAGES;
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-fl"))
+        frame_free_low = atoi (value);
+      else if (!strcmp (name, "-cl"))
+        frame_clean_low = atoi (value);
+      else if (!strcmp (name, "-ch"))
+        frame_clean_high = atoi (value);
+      else if (!strcmp (name, "-mf"))
+        frame_flush_secs = atoi (value);
+      else if (!strcmp (name, "-rp"))
+        {
+          if (!frame_set_policy (value))
+            PANIC ("unknown replacement policy `%s'", value);
+        }
+      else if (!strcmp (name, "-hs"))
+        frame_hand_spread = atoi (value);
+      else if (!strcmp (name, "-rl"))
+        frame_rss_limit = atoi (value);
+      else if (!strcmp (name, "-ksm"))
+        frame_merge_pages = atoi (value);
+      else if (!strcmp (name, "-kc"))
+        frame_compact_order = atoi (value);
+      else if (!strcmp (name, "-pc"))
+        frame_retain_max = atoi (value);
+      else if (!strcmp (name, "-pff"))
+        pff_enabled = true;
+      else if (!strcmp (name, "-ph"))
+        pff_high = atoi (value);
+      else if (!strcmp (name, "-pl"))
+        pff_low = atoi (value);
+      else if (!strcmp (name, "-fa"))
+        page_fault_around_pages = atoi (value);
+      else if (!strcmp (name, "-pp"))
+        prepage_enabled = true;
+      else if (!strcmp (name, "-sb"))
+        page_stack_batch = atoi (value);
+      else if (!strcmp (name, "-zp"))
+        zswap_pool_percent = atoi (value);
+      else if (!strcmp (name, "-swapck"))
+        swap_checksums = true;
+      else if (!strcmp (name, "-swapfile"))
+        swap_file_name = value;
+      else if (!strcmp (name, "-swapfile-max"))
+        swap_file_max_mb = atoi (value);
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -302,6 +479,27 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+#ifdef FILESYS
+/* Saves the booted kernel to the hibernation partition.  When a
+   later boot with -resume brings it back, runs that boot's
+   actions instead of the rest of ours, then finishes up as
+   main() does. */
+static void
+run_hibernate (char **argv UNUSED)
+{
+  char **actions = hibernate ();
+
+  if (actions != NULL)
+    {
+      printf ("Resume complete in %"PRId64" ms.\n",
+              clock_reset_ns () / 1000000);
+      run_actions (actions);
+      shutdown ();
+      thread_exit ();
+    }
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -325,6 +523,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"hibernate", 1, run_hibernate},
 #endif
       {NULL, 0, NULL},
     };
@@ -374,6 +573,8 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  hibernate          Save the booted kernel to the hibernation\n"
+          "                     partition, for a later boot's -resume.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -381,21 +582,100 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -initrd            Open files from the scratch device's ustar\n"
+          "                     archive, read into memory, not extracted.\n"
+          "  -resume            Resume the kernel saved by `hibernate', with\n"
+          "                     its options and disks, to run these actions.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=MB        Create an MB-megabyte RAM disk named rd0.\n"
 #ifdef VM
-          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -swap=BDEV         Use only BDEV for swap instead of all swap\n"
+          "                     partitions.\n"
 #endif
 #endif
+          "  -lpt=LOOPS         Skip timer calibration, assuming LOOPS\n"
+          "                     loops per tick, as printed by a former boot.\n"
+          "  -tsc=KHZ           Skip clock calibration, assuming the TSC\n"
+          "                     runs at KHZ, as printed by a former boot.\n"
+          "  -bt                Print how long each step of the boot took.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -sched=CLASS       Schedule threads by CLASS: priority, mlfqs,\n"
+          "                     fair or stride.\n"
+          "  -slt               Trace scheduler latency, print at shutdown.\n"
+          "  -it                Trace longest interrupts-off sections.\n"
+          "  -prof[=RATE]       Profile RATE times per timer tick (max 100)\n"
+          "                     and save samples to scratch device.\n"
+          "  -pmc               Count cycles, instructions, cache and TLB\n"
+          "                     misses per thread, for getrusage().\n"
+          "  -profev=EVENT      Weight profile samples by EVENT: cycles,\n"
+          "                     instructions, llc-misses or dtlb-misses.\n"
+          "  -trace=CAT[,...]   Trace events in each CAT: sched, lock, vm,\n"
+          "                     block, syscall or all.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -systrace[=PAGES]  Record system calls in a log of PAGES pages\n"
+          "                     and save it to scratch device.\n"
+#endif
+#ifdef VM
+          "  -fl=COUNT          Run page cleaner below COUNT free frames.\n"
+          "  -cl=COUNT          Start cleaning below COUNT clean frames.\n"
+          "  -ch=COUNT          Stop cleaning at COUNT clean frames (0=off).\n"
+          "  -mf=SECS           Write back mmap'ed pages every SECS s (0=off).\n"
+          "  -rp=POLICY         Replace pages by clock, 2clock or clockpro.\n"
+          "  -hs=COUNT          Set the two-handed clock's spread to COUNT.\n"
+          "  -rl=COUNT          Limit each process to COUNT resident pages.\n"
+          "  -ksm=COUNT         Merge same pages, scanning COUNT per period.\n"
+          "  -kc=ORDER          Compact memory to keep 2**ORDER pages free.\n"
+          "  -pc=COUNT          Keep up to COUNT pages of exited programs.\n"
+          "  -pff               Control page fault frequency of processes.\n"
+          "  -ph=COUNT          Give frames above COUNT faults per period.\n"
+          "  -pl=COUNT          Take frames below COUNT faults per period.\n"
+          "  -fa=COUNT          Map up to COUNT file pages around faults.\n"
+          "  -pp                Record fault traces and prepage from them.\n"
+          "  -sb=COUNT          Grow the stack by COUNT pages at a time.\n"
+          "  -zp=PCT            Keep compressed swap in PCT%% of kernel memory.\n"
+          "  -swapck            Verify swapped in pages against checksums.\n"
+          "  -swapfile=FILE     Also swap to FILE in the file system.\n"
+          "  -swapfile-max=MB   Let the swap file grow to MB (default 16).\n"
 #endif
           );
   shutdown_power_off ();
 }
 
+/* Records that the step of the boot called NAME ends now.  The
+   time stamp counter is recorded raw, since the clock is not yet
+   calibrated for the first steps. */
+static void
+boot_step (const char *name)
+{
+  if (boot_step_cnt < BOOT_STEP_CNT)
+    {
+      boot_steps[boot_step_cnt].name = name;
+      boot_steps[boot_step_cnt].cycles = clock_cycles ();
+      boot_step_cnt++;
+    }
+}
+
+/* Prints how long each step recorded by boot_step() took, the
+   first measured from CPU reset. */
+static void
+print_boot_steps (void)
+{
+  uint64_t start = 0;
+  size_t i;
+
+  for (i = 0; i < boot_step_cnt; i++)
+    {
+      int64_t us = clock_cycles_to_ns (boot_steps[i].cycles - start) / 1000;
+
+      printf ("Boot: %-20s %6"PRId64".%03"PRId64" ms\n",
+              boot_steps[i].name, us / 1000, us % 1000);
+      start = boot_steps[i].cycles;
+    }
+}
+
 #ifdef FILESYS
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
@@ -9,6 +9,11 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "userprog/syscall.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -47,6 +52,34 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Interrupts-off tracing, enabled by the "-it" kernel
+   command-line option.  Each section of code that runs with
+   interrupts off, from the intr_disable() that turned them off
+   to the intr_enable() that turned them back on, is timed in TSC
+   cycles, as is each external interrupt handler.  The longest
+   sections are kept, at most one for each address that disabled
+   interrupts, along with the address that enabled them again,
+   for intr_print_stats() to report.
+
+   Interrupts that a section ends by returning from an interrupt,
+   rather than by calling intr_enable(), are not timed. */
+bool intr_trace;
+#define INTR_TRACE_CNT 8
+struct intr_section
+  {
+    void *disabler;             /* Caller of intr_disable(), or handler. */
+    void *enabler;              /* Caller of intr_enable(). */
+    uint64_t cycles;            /* Longest time with interrupts off. */
+    unsigned cnt;               /* Number of sections traced. */
+  };
+static struct intr_section intr_sections[INTR_TRACE_CNT];
+static uint64_t intr_off_tsc;   /* When interrupts went off, or 0. */
+static void *intr_off_caller;   /* Who turned them off. */
+
+static enum intr_level enable (void *caller);
+static enum intr_level disable (void *caller);
+static void trace_section (void *disabler, void *enabler, uint64_t start);
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -80,16 +113,39 @@ intr_get_level (void)
 enum intr_level
 intr_set_level (enum intr_level level) 
 {
-  return level == INTR_ON ? intr_enable () : intr_disable ();
+  void *caller = __builtin_return_address (0);
+
+  return level == INTR_ON ? enable (caller) : disable (caller);
 }
 
 /* Enables interrupts and returns the previous interrupt status. */
 enum intr_level
 intr_enable (void) 
+{
+  return enable (__builtin_return_address (0));
+}
+
+/* Disables interrupts and returns the previous interrupt status. */
+enum intr_level
+intr_disable (void) 
+{
+  return disable (__builtin_return_address (0));
+}
+
+/* Enables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+enable (void *caller)
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  if (intr_trace && old_level == INTR_OFF && intr_off_tsc != 0)
+    {
+      trace_section (intr_off_caller, caller, intr_off_tsc);
+      intr_off_tsc = 0;
+    }
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -99,9 +155,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
-enum intr_level
-intr_disable (void) 
+/* Disables interrupts on behalf of CALLER and returns the
+   previous interrupt status. */
+static enum intr_level
+disable (void *caller)
 {
   enum intr_level old_level = intr_get_level ();
 
@@ -110,8 +167,79 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (intr_trace && old_level == INTR_ON)
+    {
+      intr_off_tsc = clock_cycles ();
+      intr_off_caller = caller;
+    }
+
   return old_level;
 }
+
+/* Records a section with interrupts off from START, in TSC
+   cycles, until now, begun by DISABLER and ended by ENABLER. */
+static void
+trace_section (void *disabler, void *enabler, uint64_t start)
+{
+  uint64_t cycles = clock_cycles () - start;
+  struct intr_section *s, *shortest = intr_sections;
+
+  for (s = intr_sections; s < intr_sections + INTR_TRACE_CNT; s++)
+    {
+      if (s->disabler == disabler)
+        {
+          s->cnt++;
+          if (cycles > s->cycles)
+            {
+              s->cycles = cycles;
+              s->enabler = enabler;
+            }
+          return;
+        }
+      if (s->cycles < shortest->cycles)
+        shortest = s;
+    }
+
+  /* Displace the shortest section kept, if this one is longer. */
+  if (cycles > shortest->cycles)
+    {
+      shortest->disabler = disabler;
+      shortest->enabler = enabler;
+      shortest->cycles = cycles;
+      shortest->cnt = 1;
+    }
+}
+
+/* Prints the longest sections traced with interrupts off. */
+void
+intr_print_stats (void)
+{
+  struct intr_section *s;
+  bool printed[INTR_TRACE_CNT] = { false };
+  size_t i;
+
+  if (!intr_trace)
+    return;
+
+  printf ("Interrupts off: longest sections, in cycles, with the"
+          " addresses that\n"
+          "disabled and enabled interrupts (use `backtrace' on them):\n");
+  for (;;)
+    {
+      /* Print the sections from longest to shortest. */
+      s = NULL;
+      for (i = 0; i < INTR_TRACE_CNT; i++)
+        if (!printed[i] && intr_sections[i].cnt > 0
+            && (s == NULL || intr_sections[i].cycles > s->cycles))
+          s = &intr_sections[i];
+      if (s == NULL)
+        break;
+      printed[s - intr_sections] = true;
+
+      printf ("%12llu cycles (%u times): %p %p\n",
+              s->cycles, s->cnt, s->disabler, s->enabler);
+    }
+}
 
 /* Initializes the interrupt system. */
 void
@@ -157,6 +285,21 @@ intr_init (void)
   intr_names[19] = "#XF SIMD Floating-Point Exception";
 }
 
+/* Sets up the interrupt controller and the IDT register again
+   after a reboot has reset them, on resume from hibernation.
+   The IDT itself is in memory, and so was restored. */
+void
+intr_resume (void)
+{
+  uint64_t idtr_operand;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  pic_init ();
+  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
    privilege level DPL.  Names the interrupt NAME for debugging
    purposes.  The interrupt handler will be invoked with
@@ -346,12 +489,21 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  uint64_t start = 0;
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+
+  /* If the interrupted code had interrupts on, any section it last
+     ran with them off ended without intr_enable(). */
+  if ((frame->eflags & FLAG_IF) != 0)
+    intr_off_tsc = 0;
+  if (external && intr_trace)
+    start = clock_cycles ();
+
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
@@ -383,8 +535,22 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
+      if (intr_trace && handler != NULL)
+        trace_section (handler, intr_handler, start);
+
       if (yield_on_return) 
-        thread_yield (); 
+        thread_preempt (); 
+
+#ifdef USERPROG
+      /* A peer of an exiting process that keeps running user
+         code without entering the kernel exits at its next
+         timer tick instead.  See end_group(). */
+      if (frame->cs == SEL_UCSEG && process_must_exit ())
+        {
+          intr_enable ();
+          sys_exit (-1);
+        }
+#endif
     }
 }
 
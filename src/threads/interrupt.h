@@ -15,6 +15,11 @@ enum intr_level intr_get_level (void);
 enum intr_level intr_set_level (enum intr_level);
 enum intr_level intr_enable (void);
 enum intr_level intr_disable (void);
+
+/* Trace sections run with interrupts off?  Controlled by kernel
+   command-line option "-it". */
+extern bool intr_trace;
+void intr_print_stats (void);
 
 /* Interrupt stack frame. */
 struct intr_frame
@@ -58,6 +63,7 @@ struct intr_frame
 typedef void intr_handler_func (struct intr_frame *);
 
 void intr_init (void);
+void intr_resume (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
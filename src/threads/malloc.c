@@ -5,10 +5,21 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/memtrace.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
+/* malloc.c defines the functions that the tagging macros in
+   malloc.h stand in for. */
+#undef malloc
+#undef calloc
+#undef realloc
+#undef free
+
 /* A simple implementation of malloc().
 
    The size of each request, in bytes, is rounded up to a power
@@ -26,13 +37,67 @@
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
-
-   We can't handle blocks bigger than 2 kB using this scheme,
+   and give the arena back to the page allocator.  Each
+   descriptor keeps one such empty arena back as a spare, so that
+   a program that allocates and frees a block over and over does
+   not get and free a page each time.
+
+   In front of each descriptor's free list, each CPU has a
+   "magazine", a small stack of free blocks that malloc() pops
+   and free() pushes without taking the descriptor's lock.  An
+   empty magazine is refilled, and a full one drained, MAG_BATCH
+   blocks at a time.  A magazine is protected by disabling
+   interrupts, since only its own CPU uses it.  Blocks in a
+   magazine count as in use by their arenas.
+
+   We can't handle blocks of 2 kB or more using this scheme,
    because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   descriptor.  Blocks from 2 kB up to BIG_MAX bytes are kept in
+   "big" size classes, also powers of 2, which keep no header in
+   the block's pages: a 4 kB block takes one page, not two.  A
+   block of half a page is carved with its buddy out of a single
+   page; a larger block is its own run of pages.  Instead of an
+   arena header, PAGE_TAGS records for each physical page the big
+   class of the blocks in it, if any, and for a half-page page how
+   many of them are in use.  Big blocks are always aligned to half
+   a page, which other blocks never are, since they follow an
+   arena header.  Each big class keeps up to BIG_CACHE free
+   blocks' worth of memory back from the page allocator.
+
+   We handle blocks bigger than BIG_MAX by allocating contiguous
+   pages with the page allocator and sticking the allocation size
+   at the beginning of the allocated block's arena header.
+
+   realloc() keeps a block where it is if its size class, or for
+   one of these, its pages, already hold the new size, unless a
+   smaller class would.  It grows a big block of whole pages, or
+   one of these, in place if the page allocator can give it the
+   pages that follow, and gives back the pages that one of these
+   no longer needs.  Only otherwise does it copy the block. */
+
+/* Magazine sizes: the number of blocks a magazine holds, and
+   the number moved between it and its descriptor at a time. */
+#define MAG_SIZE 16
+#define MAG_BATCH 8
+
+/* Number of arena occupancy buckets counted per descriptor:
+   arenas with no blocks in use, with up to 1/4, 2/4, 3/4 or all
+   but one in use, and with all in use.  Blocks in a magazine
+   count as in use. */
+#define OCC_BUCKETS 6
+
+/* Free block. */
+struct block 
+  {
+    struct list_elem free_elem; /* Free list element. */
+  };
+
+/* A CPU's cache of free blocks of one size. */
+struct magazine
+  {
+    size_t cnt;                         /* Number of blocks. */
+    struct block *blocks[MAG_SIZE];     /* Blocks, most recent last. */
+  };
 
 /* Descriptor. */
 struct desc
@@ -40,7 +105,10 @@ struct desc
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
+    struct arena *spare;        /* Empty arena kept back, or null. */
     struct lock lock;           /* Lock. */
+    struct magazine mags[CPU_MAX];      /* Per-CPU magazines. */
+    size_t occupancy[OCC_BUCKETS];      /* Arenas, by blocks in use. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -54,18 +122,45 @@ struct arena
     size_t free_cnt;            /* Free blocks; pages in big block. */
   };
 
-/* Free block. */
-struct block 
+/* Big size classes. */
+#define BIG_MAX (64 * 1024)     /* Size of the largest big class. */
+#define BIG_CACHE 2             /* Free blocks of a class kept back. */
+
+/* A big size class. */
+struct big_class
   {
-    struct list_elem free_elem; /* Free list element. */
+    size_t block_size;          /* Size of each block in bytes. */
+    struct list free_list;      /* List of free blocks. */
+    size_t free_cnt;            /* Number of free blocks. */
   };
 
+/* A page tag, one per physical page: the index in big_classes[]
+   plus 1 of the class of the big blocks in the page, 0 if none,
+   and for a half-page class, the number of its blocks in use. */
+#define TAG_CLASS_MASK 0x0f
+#define TAG_USED_SHIFT 4
+
+static struct big_class big_classes[6]; /* Big size classes. */
+static size_t big_cnt;                  /* Number of big classes. */
+static struct lock big_lock;            /* Protects big classes. */
+static uint8_t *page_tags;              /* Tags, by physical page. */
+
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static void *desc_refill (struct desc *);
+static void desc_drain (struct desc *, struct block *);
+static size_t desc_get (struct desc *, struct block **, size_t cnt);
+static void desc_put (struct desc *, struct block **, size_t cnt);
+static void arena_recount (struct desc *, size_t old_free, size_t new_free);
+static void *big_alloc (size_t size);
+static void big_free (struct block *);
+static bool is_big_block (const void *);
+static struct big_class *big_block_class (const void *);
+static bool resize_in_place (void *, size_t old_size, size_t new_size);
 
 /* Initializes the malloc() descriptors. */
 void
@@ -80,8 +175,22 @@ malloc_init (void)
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
       list_init (&d->free_list);
+      d->spare = NULL;
       lock_init (&d->lock);
     }
+
+  for (; block_size <= BIG_MAX; block_size *= 2)
+    {
+      struct big_class *c = &big_classes[big_cnt++];
+      ASSERT (big_cnt < TAG_CLASS_MASK);
+      ASSERT (big_cnt <= sizeof big_classes / sizeof *big_classes);
+      c->block_size = block_size;
+      list_init (&c->free_list);
+      c->free_cnt = 0;
+    }
+  lock_init (&big_lock);
+  page_tags = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                   DIV_ROUND_UP (init_ram_pages, PGSIZE));
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -90,8 +199,9 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
-  struct block *b;
+  struct magazine *m;
   struct arena *a;
+  enum intr_level old_level;
 
   /* A null pointer satisfies a request for 0 bytes. */
   if (size == 0)
@@ -102,9 +212,11 @@ malloc (size_t size)
   for (d = descs; d < descs + desc_cnt; d++)
     if (d->block_size >= size)
       break;
+  if (d == descs + desc_cnt && size <= BIG_MAX)
+    return big_alloc (size);
   if (d == descs + desc_cnt) 
     {
-      /* SIZE is too big for any descriptor.
+      /* SIZE is too big for any descriptor or big class.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
       a = palloc_get_multiple (0, page_cnt);
@@ -119,38 +231,51 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Take a block from this CPU's magazine, if it has one. */
+  old_level = intr_disable ();
+  m = &d->mags[cpu_current ()->id];
+  if (m->cnt > 0)
     {
-      size_t i;
+      struct block *b = m->blocks[--m->cnt];
+      intr_set_level (old_level);
+      return b;
+    }
+  intr_set_level (old_level);
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+  return desc_refill (d);
+}
 
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
+/* Takes a batch of blocks from D's free list, returns one of
+   them and puts the rest in this CPU's magazine.  Returns a null
+   pointer if memory is not available. */
+static void *
+desc_refill (struct desc *d)
+{
+  struct block *batch[MAG_BATCH];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt, i;
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
+  lock_acquire (&d->lock);
+  cnt = desc_get (d, batch, MAG_BATCH);
   lock_release (&d->lock);
-  return b;
+  if (cnt == 0)
+    return NULL;
+
+  /* Another thread may have filled the magazine while we did not
+     have the CPU.  Give back what does not fit. */
+  old_level = intr_disable ();
+  m = &d->mags[cpu_current ()->id];
+  for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+    m->blocks[m->cnt++] = batch[i];
+  intr_set_level (old_level);
+  if (i < cnt)
+    {
+      lock_acquire (&d->lock);
+      desc_put (d, batch + i, cnt - i);
+      lock_release (&d->lock);
+    }
+  return batch[0];
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -179,12 +304,38 @@ static size_t
 block_size (void *block) 
 {
   struct block *b = block;
-  struct arena *a = block_to_arena (b);
-  struct desc *d = a->desc;
+  struct arena *a;
+  struct desc *d;
+
+  if (is_big_block (block))
+    return big_block_class (block)->block_size;
+  a = block_to_arena (b);
+  d = a->desc;
 
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Returns the number of bytes that malloc() allocates for a
+   request of SIZE bytes, at least SIZE, so that a caller that
+   can use more may as well ask for them all. */
+size_t
+malloc_good_size (size_t size)
+{
+  struct desc *d;
+  struct big_class *c;
+
+  if (size == 0)
+    return 0;
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d->block_size;
+  for (c = big_classes; c < big_classes + big_cnt; c++)
+    if (c->block_size >= size)
+      return c->block_size;
+  return (DIV_ROUND_UP (size + sizeof (struct arena), PGSIZE) * PGSIZE
+          - sizeof (struct arena));
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -194,22 +345,81 @@ block_size (void *block)
 void *
 realloc (void *old_block, size_t new_size) 
 {
+  size_t old_size;
+  void *new_block;
+
   if (new_size == 0) 
     {
       free (old_block);
       return NULL;
     }
-  else 
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  old_size = block_size (old_block);
+  if (resize_in_place (old_block, old_size, new_size))
+    return old_block;
+
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block,
+              new_size < old_size ? new_size : old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Tries to resize BLOCK, of OLD_SIZE bytes, to NEW_SIZE bytes
+   without moving it, as described at the top of this file.
+   Returns true if successful. */
+static bool
+resize_in_place (void *block, size_t old_size, size_t new_size)
+{
+  struct arena *a;
+
+  if (is_big_block (block))
+    {
+      struct big_class *c = big_block_class (block), *new_c;
+      size_t page_cnt = DIV_ROUND_UP (c->block_size, PGSIZE);
+
+      if (new_size <= old_size)
+        return new_size > old_size / 2;
+      if (c->block_size < PGSIZE || new_size > BIG_MAX)
+        return false;
+
+      for (new_c = c; new_c->block_size < new_size; new_c++)
+        continue;
+      if (!palloc_extend (block, page_cnt, new_c->block_size / PGSIZE))
+        return false;
+      lock_acquire (&big_lock);
+      page_tags[vtop (block) >> PGBITS] = new_c - big_classes + 1;
+      lock_release (&big_lock);
+      return true;
+    }
+
+  a = block_to_arena (block);
+  if (a->desc != NULL)
+    return (new_size <= old_size
+            && (new_size > old_size / 2 || a->desc == descs));
+  else
     {
-      void *new_block = malloc (new_size);
-      if (old_block != NULL && new_block != NULL)
+      /* A block of whole pages, with the arena in its first. */
+      size_t new_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+
+      if (new_cnt < a->free_cnt)
+        {
+          palloc_free_multiple ((uint8_t *) a + new_cnt * PGSIZE,
+                                a->free_cnt - new_cnt);
+          a->free_cnt = new_cnt;
+        }
+      else if (new_cnt > a->free_cnt)
         {
-          size_t old_size = block_size (old_block);
-          size_t min_size = new_size < old_size ? new_size : old_size;
-          memcpy (new_block, old_block, min_size);
-          free (old_block);
+          if (!palloc_extend (a, a->free_cnt, new_cnt))
+            return false;
+          a->free_cnt = new_cnt;
         }
-      return new_block;
+      return true;
     }
 }
 
@@ -218,7 +428,9 @@ realloc (void *old_block, size_t new_size)
 void
 free (void *p) 
 {
-  if (p != NULL)
+  if (p != NULL && is_big_block (p))
+    big_free (p);
+  else if (p != NULL)
     {
       struct block *b = p;
       struct arena *a = block_to_arena (b);
@@ -228,31 +440,26 @@ free (void *p)
         {
           /* It's a normal block.  We handle it here. */
 
+          struct magazine *m;
+          enum intr_level old_level;
+
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Put the block in this CPU's magazine, if it has room. */
+          old_level = intr_disable ();
+          m = &d->mags[cpu_current ()->id];
+          if (m->cnt < MAG_SIZE)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              m->blocks[m->cnt++] = b;
+              intr_set_level (old_level);
+              return;
             }
+          intr_set_level (old_level);
 
-          lock_release (&d->lock);
+          desc_drain (d, b);
         }
       else
         {
@@ -263,6 +470,281 @@ free (void *p)
     }
 }
 
+/* Frees block B, whose CPU's magazine was found full, by
+   returning it and the magazine's MAG_BATCH - 1 least recently
+   freed blocks to D's free list. */
+static void
+desc_drain (struct desc *d, struct block *b)
+{
+  struct block *batch[MAG_BATCH];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt;
+
+  /* Another thread may have emptied the magazine meanwhile, so
+     take only as many as it has. */
+  batch[0] = b;
+  old_level = intr_disable ();
+  m = &d->mags[cpu_current ()->id];
+  cnt = m->cnt < MAG_BATCH - 1 ? m->cnt : MAG_BATCH - 1;
+  memcpy (batch + 1, m->blocks, cnt * sizeof *m->blocks);
+  m->cnt -= cnt;
+  memmove (m->blocks, m->blocks + cnt, m->cnt * sizeof *m->blocks);
+  intr_set_level (old_level);
+
+  lock_acquire (&d->lock);
+  desc_put (d, batch, cnt + 1);
+  lock_release (&d->lock);
+}
+
+/* Takes up to CNT blocks from D's free list and stores them in
+   BLOCKS, creating a new arena first if the free list is empty.
+   Returns the number of blocks taken, which is 0 only if memory
+   is not available.  D's lock must be held. */
+static size_t
+desc_get (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      /* Allocate a page. */
+      struct arena *a = palloc_get_page (0);
+      if (a == NULL)
+        return 0;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++)
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+      d->occupancy[0]++;
+    }
+
+  /* Get blocks from the free list. */
+  for (i = 0; i < cnt && !list_empty (&d->free_list); i++)
+    {
+      struct block *b = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      struct arena *a = block_to_arena (b);
+      if (a == d->spare)
+        d->spare = NULL;
+      arena_recount (d, a->free_cnt, a->free_cnt - 1);
+      a->free_cnt--;
+      blocks[i] = b;
+    }
+  return i;
+}
+
+/* Adds the CNT blocks in BLOCKS to D's free list.  D's lock must
+   be held. */
+static void
+desc_put (struct desc *d, struct block **blocks, size_t cnt)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+      arena_recount (d, a->free_cnt, a->free_cnt + 1);
+
+      /* If the arena is now entirely unused, keep it as the spare
+         or, if there is one already, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena)
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          if (d->spare == NULL)
+            {
+              d->spare = a;
+              continue;
+            }
+          for (j = 0; j < d->blocks_per_arena; j++)
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          d->occupancy[0]--;
+          palloc_free_page (a);
+        }
+    }
+}
+
+/* Returns the occupancy bucket of an arena of D that has
+   FREE_CNT free blocks. */
+static int
+occupancy_bucket (const struct desc *d, size_t free_cnt)
+{
+  size_t used_cnt = d->blocks_per_arena - free_cnt;
+
+  if (used_cnt == 0)
+    return 0;
+  else if (free_cnt == 0)
+    return OCC_BUCKETS - 1;
+  else
+    return 1 + (used_cnt - 1) * 4 / d->blocks_per_arena;
+}
+
+/* Moves an arena of D that had OLD_FREE free blocks and now has
+   NEW_FREE to its new occupancy bucket.  D's lock must be
+   held. */
+static void
+arena_recount (struct desc *d, size_t old_free, size_t new_free)
+{
+  d->occupancy[occupancy_bucket (d, old_free)]--;
+  d->occupancy[occupancy_bucket (d, new_free)]++;
+}
+
+/* Prints the number of arenas of each descriptor by occupancy,
+   the free blocks of each big class, and, with MEM_TRACE, the
+   memory used by each caller. */
+void
+malloc_print_stats (void)
+{
+  struct desc *d;
+  struct big_class *c;
+
+  printf ("Arenas by blocks in use: %6s %6s %6s %6s %6s %6s\n",
+          "none", "<=25%", "<=50%", "<=75%", "<100%", "all");
+  for (d = descs; d < descs + desc_cnt; d++)
+    {
+      int i;
+
+      printf ("  %4zu-byte blocks:      ", d->block_size);
+      for (i = 0; i < OCC_BUCKETS; i++)
+        printf (" %6zu", d->occupancy[i]);
+      printf ("\n");
+    }
+  printf ("Free big blocks:");
+  for (c = big_classes; c < big_classes + big_cnt; c++)
+    printf (" %zu of %zu kB", c->free_cnt, c->block_size / 1024);
+  printf ("\n");
+#ifdef MEM_TRACE
+  memtrace_print ();
+#endif
+}
+
+/* Returns a new block from the smallest big class that holds
+   SIZE bytes, or a null pointer if memory is not available. */
+static void *
+big_alloc (size_t size)
+{
+  struct big_class *c;
+  struct block *b;
+
+  for (c = big_classes; c < big_classes + big_cnt; c++)
+    if (c->block_size >= size)
+      break;
+  ASSERT (c < big_classes + big_cnt);
+
+  lock_acquire (&big_lock);
+
+  /* If the free list is empty, get pages for more blocks. */
+  if (list_empty (&c->free_list))
+    {
+      size_t page_cnt = DIV_ROUND_UP (c->block_size, PGSIZE);
+      uint8_t *pages = palloc_get_multiple (0, page_cnt);
+      size_t ofs;
+
+      if (pages == NULL)
+        {
+          lock_release (&big_lock);
+          return NULL;
+        }
+      page_tags[vtop (pages) >> PGBITS] = c - big_classes + 1;
+      for (ofs = 0; ofs < page_cnt * PGSIZE; ofs += c->block_size)
+        {
+          b = (struct block *) (pages + ofs);
+          list_push_back (&c->free_list, &b->free_elem);
+          c->free_cnt++;
+        }
+    }
+
+  b = list_entry (list_pop_front (&c->free_list), struct block, free_elem);
+  c->free_cnt--;
+  if (c->block_size < PGSIZE)
+    page_tags[vtop (b) >> PGBITS] += 1 << TAG_USED_SHIFT;
+  lock_release (&big_lock);
+  return b;
+}
+
+/* Frees big block B.  Gives its pages back to the page allocator
+   if none of them are in use and the class has BIG_CACHE free
+   blocks besides. */
+static void
+big_free (struct block *b)
+{
+  struct big_class *c = big_block_class (b);
+  size_t page_cnt = DIV_ROUND_UP (c->block_size, PGSIZE);
+  uint8_t *tag = &page_tags[vtop (b) >> PGBITS];
+  uint8_t *page = pg_round_down (b);
+
+#ifndef NDEBUG
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (b, 0xcc, c->block_size);
+#endif
+
+  lock_acquire (&big_lock);
+  list_push_front (&c->free_list, &b->free_elem);
+  c->free_cnt++;
+  if (c->block_size < PGSIZE)
+    {
+      size_t per_page = PGSIZE / c->block_size;
+      size_t ofs;
+
+      *tag -= 1 << TAG_USED_SHIFT;
+      if ((*tag >> TAG_USED_SHIFT) == 0
+          && c->free_cnt >= per_page + BIG_CACHE)
+        {
+          for (ofs = 0; ofs < PGSIZE; ofs += c->block_size)
+            list_remove (&((struct block *) (page + ofs))->free_elem);
+          c->free_cnt -= per_page;
+          *tag = 0;
+          palloc_free_page (page);
+        }
+    }
+  else if (c->free_cnt > BIG_CACHE)
+    {
+      list_remove (&b->free_elem);
+      c->free_cnt--;
+      *tag = 0;
+      palloc_free_multiple (b, page_cnt);
+    }
+  lock_release (&big_lock);
+}
+
+/* Returns true if P, a block returned by malloc(), is a big
+   block. */
+static bool
+is_big_block (const void *p)
+{
+  return pg_ofs (p) % (PGSIZE / 2) == 0;
+}
+
+/* Returns the big class of big block P. */
+static struct big_class *
+big_block_class (const void *p)
+{
+  unsigned idx = page_tags[vtop (p) >> PGBITS] & TAG_CLASS_MASK;
+
+  ASSERT (idx > 0 && idx <= big_cnt);
+  return &big_classes[idx - 1];
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -292,3 +774,93 @@ arena_to_block (struct arena *a, size_t idx)
                            + sizeof *a
                            + idx * a->desc->block_size);
 }
+
+#ifdef MEM_TRACE
+/* Header in front of each block allocated through the tagging
+   macros. */
+struct trace_header
+  {
+    int tag;                    /* Memtrace tag. */
+    size_t size;                /* Size requested. */
+  };
+
+/* Obtains a block of SIZE bytes, as malloc(), on behalf of source
+   file NAME. */
+void *
+malloc_tagged (size_t size, const char *name)
+{
+  struct trace_header *h;
+
+  if (size == 0 || size + sizeof *h < size)
+    return NULL;
+  h = malloc (size + sizeof *h);
+  if (h == NULL)
+    return NULL;
+  h->tag = memtrace_tag (MEMTRACE_MALLOC, name);
+  h->size = size;
+  memtrace_alloc (h->tag, size);
+  return h + 1;
+}
+
+/* Allocates A times B zeroed bytes, as calloc(), on behalf of
+   source file NAME. */
+void *
+calloc_tagged (size_t a, size_t b, const char *name)
+{
+  size_t size = a * b;
+  void *p;
+
+  if (size < a || size < b)
+    return NULL;
+  p = malloc_tagged (size, name);
+  if (p != NULL)
+    memset (p, 0, size);
+  return p;
+}
+
+/* Resizes OLD_BLOCK to NEW_SIZE bytes, as realloc(), on behalf of
+   source file NAME. */
+void *
+realloc_tagged (void *old_block, size_t new_size, const char *name)
+{
+  struct trace_header *old_h, *h;
+
+  if (new_size == 0)
+    {
+      free_tagged (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc_tagged (new_size, name);
+  if (new_size + sizeof *h < new_size)
+    return NULL;
+
+  /* Resize the block with its header, so that it may stay in
+     place, and account for it afresh only once that works. */
+  old_h = (struct trace_header *) old_block - 1;
+  memtrace_free (old_h->tag, old_h->size);
+  h = realloc (old_h, new_size + sizeof *h);
+  if (h == NULL)
+    {
+      memtrace_alloc (old_h->tag, old_h->size);
+      return NULL;
+    }
+  h->tag = memtrace_tag (MEMTRACE_MALLOC, name);
+  h->size = new_size;
+  memtrace_alloc (h->tag, new_size);
+  return h + 1;
+}
+
+/* Frees block P, which must have been allocated through the
+   tagging macros. */
+void
+free_tagged (void *p)
+{
+  if (p != NULL)
+    {
+      struct trace_header *h = (struct trace_header *) p - 1;
+      memtrace_free (h->tag, h->size);
+      free (h);
+    }
+}
+#endif /* MEM_TRACE */
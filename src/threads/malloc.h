@@ -3,11 +3,53 @@
 
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
 
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+size_t malloc_good_size (size_t);
+void malloc_print_stats (void);
+
+#ifdef MEM_TRACE
+/* Tag each allocation with its caller's source file. */
+void *malloc_tagged (size_t, const char *) __attribute__ ((malloc));
+void *calloc_tagged (size_t, size_t, const char *) __attribute__ ((malloc));
+void *realloc_tagged (void *, size_t, const char *);
+void free_tagged (void *);
+#define malloc(SIZE) malloc_tagged (SIZE, __FILE__)
+#define calloc(A, B) calloc_tagged (A, B, __FILE__)
+#define realloc(BLOCK, SIZE) realloc_tagged (BLOCK, SIZE, __FILE__)
+#define free(BLOCK) free_tagged (BLOCK)
+#endif
+
+/* Makes sure that ARRAY, which holds *CAPACITY elements of
+   ELEM_SIZE bytes each, has room for NEEDED, which must be
+   positive.  If not, grows it with realloc() to at least twice
+   its capacity, rounded up to fill the block that malloc() would
+   give it, and updates *CAPACITY.  Returns the array, which may
+   have moved, or a null pointer if memory is not available, in
+   which case ARRAY and *CAPACITY are left unchanged. */
+static inline void *
+array_grow (void *array, size_t *capacity, size_t needed, size_t elem_size)
+{
+  size_t cnt, size;
+  void *p;
+
+  ASSERT (needed > 0 && elem_size > 0);
+
+  if (needed <= *capacity)
+    return array;
+  cnt = *capacity * 2 > needed ? *capacity * 2 : needed;
+  if (cnt > SIZE_MAX / elem_size)
+    return NULL;
+  size = malloc_good_size (cnt * elem_size);
+  p = realloc (array, size);
+  if (p != NULL)
+    *capacity = size / elem_size;
+  return p;
+}
 
 #endif /* threads/malloc.h */
@@ -0,0 +1,111 @@
+#include "threads/memtrace.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+
+/* Kernel memory tracing.
+
+   With MEM_TRACE defined, malloc(), calloc(), realloc() and the
+   palloc_get_*() functions are macros that pass their caller's
+   source file name along as a "tag", and each tag's live bytes,
+   peak live bytes and number of allocations are recorded here.
+   malloc() keeps the tag in a header in front of each block and
+   palloc in each page's buddy entry, so that freeing the memory
+   later is charged to the same tag.  The pages malloc() takes for
+   its own arenas are charged to threads/malloc.c.
+
+   Tags live in a fixed table, protected by disabling interrupts,
+   since pages are freed with interrupts off by the scheduler. */
+
+#ifdef MEM_TRACE
+/* A tag. */
+struct memtrace_entry
+  {
+    enum memtrace_kind kind;    /* What is counted. */
+    const char *name;           /* Source file name. */
+    size_t live;                /* Bytes allocated now. */
+    size_t peak;                /* Maximum of LIVE. */
+    unsigned long long cnt;     /* Number of allocations. */
+  };
+
+/* Tags, by number.  Tag MEMTRACE_NONE collects the memory whose
+   caller is unknown. */
+#define MEMTRACE_TAGS 64
+static struct memtrace_entry tags[MEMTRACE_TAGS] = { { .name = "(none)" } };
+static int tag_cnt = 1;
+
+/* Returns the number of the tag for memory of KIND allocated by
+   source file NAME, creating it if necessary.  Returns
+   MEMTRACE_NONE if the table is full. */
+int
+memtrace_tag (enum memtrace_kind kind, const char *name)
+{
+  enum intr_level old_level;
+  int i;
+
+  /* Drop leading "../" components. */
+  while (name[0] == '.' && name[1] == '.' && name[2] == '/')
+    name += 3;
+
+  old_level = intr_disable ();
+  for (i = 1; i < tag_cnt; i++)
+    if (tags[i].kind == kind && !strcmp (tags[i].name, name))
+      break;
+  if (i == tag_cnt)
+    {
+      if (tag_cnt < MEMTRACE_TAGS)
+        {
+          tags[i].kind = kind;
+          tags[i].name = name;
+          tag_cnt++;
+        }
+      else
+        i = MEMTRACE_NONE;
+    }
+  intr_set_level (old_level);
+  return i;
+}
+
+/* Charges BYTES newly allocated to TAG. */
+void
+memtrace_alloc (int tag, size_t bytes)
+{
+  enum intr_level old_level = intr_disable ();
+  struct memtrace_entry *e = &tags[tag];
+
+  e->live += bytes;
+  if (e->live > e->peak)
+    e->peak = e->live;
+  e->cnt++;
+  intr_set_level (old_level);
+}
+
+/* Credits BYTES freed to TAG. */
+void
+memtrace_free (int tag, size_t bytes)
+{
+  enum intr_level old_level = intr_disable ();
+  struct memtrace_entry *e = &tags[tag];
+
+  ASSERT (e->live >= bytes);
+  e->live -= bytes;
+  intr_set_level (old_level);
+}
+
+/* Prints each tag's statistics. */
+void
+memtrace_print (void)
+{
+  int i;
+
+  printf ("Memory by caller: %-24s %10s %10s %10s\n",
+          "", "live", "peak", "allocs");
+  for (i = 0; i < tag_cnt; i++)
+    if (tags[i].cnt > 0)
+      printf ("  %-6s %-34s %10zu %10zu %10llu\n",
+              tags[i].kind == MEMTRACE_MALLOC ? "malloc" : "palloc",
+              tags[i].name, tags[i].live, tags[i].peak, tags[i].cnt);
+}
+#endif /* MEM_TRACE */
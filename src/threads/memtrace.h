@@ -0,0 +1,24 @@
+#ifndef THREADS_MEMTRACE_H
+#define THREADS_MEMTRACE_H
+
+#include <stddef.h>
+
+/* Kernel memory tracing, enabled by building with MEM_TRACE.
+   See memtrace.c. */
+
+/* Kinds of memory traced. */
+enum memtrace_kind
+  {
+    MEMTRACE_MALLOC,            /* Bytes from malloc(). */
+    MEMTRACE_PALLOC             /* Pages from palloc. */
+  };
+
+/* Tag for memory not attributed to any caller. */
+#define MEMTRACE_NONE 0
+
+int memtrace_tag (enum memtrace_kind, const char *name);
+void memtrace_alloc (int tag, size_t bytes);
+void memtrace_free (int tag, size_t bytes);
+void memtrace_print (void);
+
+#endif /* threads/memtrace.h */
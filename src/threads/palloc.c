@@ -2,43 +2,136 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/fpu.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/memtrace.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
+#ifdef VM
+#include "vm/frame.h"
+#endif
+
+/* palloc.c defines the functions that the tagging macros in
+   palloc.h stand in for. */
+#undef palloc_get_page
+#undef palloc_get_multiple
+#undef palloc_get_aligned
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
    hands out smaller chunks.
 
-   System memory is divided into two "pools" called the kernel
-   and user pools.  The user pool is for user (virtual) memory
-   pages, the kernel pool for everything else.  The idea here is
-   that the kernel needs to have memory for its own operations
-   even if user processes are swapping like mad.
+   All free memory is in one "pool", shared by user (virtual)
+   memory pages, allocated with PAL_USER, and the kernel's own
+   pages, which we call the user and kernel pools.  The kernel
+   needs to have memory for its own operations even if user
+   processes are swapping like mad, so the user pool may not take
+   the last KERNEL_RESERVE pages, one eighth of memory, and at most
+   USER_LIMIT pages altogether.  Otherwise either may use what the
+   other does not: the user pool grows into memory the kernel does
+   not need, and as the kernel's demand rises, the user pool finds
+   fewer free pages and frame_alloc() evicts frames to reuse them
+   instead of taking more.
+
+   The pool is a binary buddy allocator.  Its free pages are
+   kept as blocks of 2**ORDER pages, each aligned to its size in
+   physical memory, on one free list per order.  A request for N
+   pages takes a block of the smallest order that holds N,
+   splitting a larger block in halves ("buddies") if there is
+   none, and gives back the pages past N.  Freed pages are given
+   back as the largest aligned blocks that they make up, and a
+   block whose buddy is free is merged with it into a block of
+   the next order.  Both take time proportional to the number of
+   orders, not to the size of the pool.
+
+   Since blocks keep no record of how they were allocated, any
+   range of allocated pages may be freed, not only a whole
+   allocation: a large page split into ordinary pages is freed a
+   page at a time.  Likewise, palloc_extend() grows an allocation
+   in place by taking the free pages that follow it out of
+   whatever blocks hold them.
+
+   In front of the buddy allocator, the pool keeps up to
+   CACHE_PAGES single free pages on two lists: pages just freed,
+   still "dirty", and pages the idle thread has zeroed.  A PAL_ZERO
+   request for a page takes a zeroed page, so it need not clear
+   one itself, and other requests for a page take a dirty one
+   first.  A freed page put on the dirty list is not filled with
+   0xcc, since it will be zeroed or reused shortly.  A request the
+   buddy allocator cannot satisfy gives the cached pages back to
+   it and tries again.
+
+   With VM, a request for more than one page that still fails
+   asks frame_compact() to move user frames out of the way, so as
+   to free a block large enough, and then tries once more. */
+
+/* Maximum number of pages cached in the pool, dirty or zeroed. */
+#define CACHE_PAGES 32
+
+/* Number of block orders.  The largest block is 2**(BUDDY_ORDERS
+   - 1) pages, or 2 GB. */
+#define BUDDY_ORDERS 20
 
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+/* A page's entry in its pool's buddy allocator. */
+struct buddy
+  {
+    struct list_elem elem;              /* Element in free list. */
+    int8_t order;                       /* Order if first page of a
+                                           free block, otherwise -1. */
+    bool user;                          /* Allocated with PAL_USER? */
+#ifdef MEM_TRACE
+    uint16_t tag;                       /* Memtrace tag if allocated. */
+#endif
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t base_pfn;                    /* Physical page number of base. */
+    size_t free_cnt;                    /* Number of free pages. */
+    struct buddy *buddies;              /* One per page. */
+    struct list free_lists[BUDDY_ORDERS]; /* Free blocks, by order. */
+    struct list dirty_list;             /* Cached pages not zeroed. */
+    struct list zero_list;              /* Cached pages zeroed. */
+    size_t dirty_cnt;                   /* Pages in dirty_list. */
+    size_t zero_cnt;                    /* Pages in zero_list. */
+    size_t user_cnt;                    /* Pages allocated with PAL_USER. */
+    size_t user_limit;                  /* Maximum user_cnt. */
+    size_t kernel_reserve;              /* Free pages PAL_USER leaves. */
   };
 
-/* Two pools: one for kernel data, one for user pages. */
-static struct pool kernel_pool, user_pool;
+/* The pool of all free memory. */
+static struct pool phys_pool;
 
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static bool pfn_in_pool (const struct pool *, size_t pfn);
+static void zero_pages (void *pages, size_t page_cnt);
+static void *alloc_pages (struct pool *, enum palloc_flags,
+                          size_t page_cnt, int order, bool *zeroed);
+static void *get_pages (struct pool *, size_t page_cnt, int order);
+static void *get_block (enum palloc_flags, size_t page_cnt, int order);
+static void cache_push (struct pool *, struct list *, void *page);
+static void *cache_pop (struct pool *, struct list *);
+static void cache_flush (struct pool *);
+static bool zero_cached_page (struct pool *);
+static size_t user_free_cnt (const struct pool *);
+static void unmark_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static size_t buddy_alloc (struct pool *, int order);
+static void buddy_free (struct pool *, size_t pfn, int order);
+static void buddy_free_range (struct pool *, size_t pfn, size_t page_cnt);
+static void buddy_claim (struct pool *, size_t pfn);
+static int page_cnt_order (size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -49,49 +142,81 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  init_pool (&phys_pool, free_start, free_pages, "memory pool");
+  phys_pool.kernel_reserve = free_pages / 8;
+  phys_pool.user_limit = user_page_limit;
+  printf ("%zu pages reserved for the kernel.\n", phys_pool.kernel_reserve);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
-   If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   If PAL_USER is set, the pages are obtained for the user pool,
+   otherwise for the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
-  struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
-  size_t page_idx;
+  if (page_cnt == 0)
+    return NULL;
+
+  return get_block (flags, page_cnt, page_cnt_order (page_cnt));
+}
+
+/* Obtains PAGE_CNT contiguous free pages, like
+   palloc_get_multiple(), whose first page is aligned to a
+   multiple of ALIGN_CNT pages in physical memory.  ALIGN_CNT must
+   be a power of 2.  This is meant for large pages; see pte.h. */
+void *
+palloc_get_aligned (enum palloc_flags flags, size_t page_cnt,
+                    size_t align_cnt)
+{
+  int order;
+
+  ASSERT (align_cnt > 0 && (align_cnt & (align_cnt - 1)) == 0);
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  /* A block is aligned to its own size. */
+  order = page_cnt_order (page_cnt);
+  if (order < page_cnt_order (align_cnt))
+    order = page_cnt_order (align_cnt);
 
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  return get_block (flags, page_cnt, order);
+}
 
-  if (pages != NULL) 
+/* Obtains PAGE_CNT pages starting at a block of 2**ORDER pages,
+   compacting memory if that helps, for palloc_get_multiple() and
+   palloc_get_aligned(). */
+static void *
+get_block (enum palloc_flags flags, size_t page_cnt, int order)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+  bool zeroed;
+  void *pages;
+
+  old_level = spinlock_acquire (&pool->lock);
+  pages = alloc_pages (pool, flags, page_cnt, order, &zeroed);
+  spinlock_release (&pool->lock, old_level);
+
+#ifdef VM
+  if (pages == NULL && order > 0 && frame_compact (order))
     {
-      if (flags & PAL_ZERO)
-        memset (pages, 0, PGSIZE * page_cnt);
+      old_level = spinlock_acquire (&pool->lock);
+      pages = alloc_pages (pool, flags, page_cnt, order, &zeroed);
+      spinlock_release (&pool->lock, old_level);
     }
-  else 
+#endif
+
+  if (pages != NULL)
+    {
+      if ((flags & PAL_ZERO) && !zeroed)
+        zero_pages (pages, page_cnt);
+    }
+  else
     {
       if (flags & PAL_ASSERT)
         PANIC ("palloc_get: out of pages");
@@ -117,28 +242,101 @@ palloc_get_page (enum palloc_flags flags)
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
-  struct pool *pool;
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
   size_t page_idx;
+  size_t pfn;
 
   ASSERT (pg_ofs (pages) == 0);
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
-    pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
-    pool = &user_pool;
-  else
+  if (!page_from_pool (pool, pages))
     NOT_REACHED ();
 
   page_idx = pg_no (pages) - pg_no (pool->base);
+  pfn = pool->base_pfn + page_idx;
+
+  /* Cache a single page, if there is room, to be zeroed. */
+  if (page_cnt == 1)
+    {
+      old_level = spinlock_acquire (&pool->lock);
+      if (pool->dirty_cnt + pool->zero_cnt < CACHE_PAGES)
+        {
+          ASSERT (bitmap_test (pool->used_map, page_idx));
+          unmark_pages (pool, page_idx, 1);
+          cache_push (pool, &pool->dirty_list, pages);
+          spinlock_release (&pool->lock, old_level);
+          return;
+        }
+      spinlock_release (&pool->lock, old_level);
+    }
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = spinlock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  unmark_pages (pool, page_idx, page_cnt);
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  buddy_free_range (pool, pfn, page_cnt);
+  pool->free_cnt += page_cnt;
+  spinlock_release (&pool->lock, old_level);
+}
+
+/* Tries to grow the PAGE_CNT pages starting at PAGES, allocated
+   without PAL_USER, to NEW_CNT pages in place, by allocating the
+   pages that follow them.  Returns true if successful, false if
+   any of those pages is in use or past the end of memory, in
+   which case nothing changes.  The new pages are not zeroed. */
+bool
+palloc_extend (void *pages, size_t page_cnt, size_t new_cnt)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+  size_t page_idx, extra, i;
+  bool ok;
+#ifdef MEM_TRACE
+  int tag = MEMTRACE_NONE;
+#endif
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_from_pool (pool, pages));
+  ASSERT (new_cnt >= page_cnt);
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  extra = new_cnt - page_cnt;
+  if (extra == 0)
+    return true;
+  if (page_idx + new_cnt > bitmap_size (pool->used_map))
+    return false;
+
+  old_level = spinlock_acquire (&pool->lock);
+  ok = bitmap_none (pool->used_map, page_idx + page_cnt, extra);
+  if (ok)
+    {
+      /* Cached pages are not in any block, so give them back
+         first, in case some of them are ours. */
+      if (pool->dirty_cnt + pool->zero_cnt > 0)
+        cache_flush (pool);
+      for (i = page_cnt; i < new_cnt; i++)
+        buddy_claim (pool, pool->base_pfn + page_idx + i);
+      bitmap_set_multiple (pool->used_map, page_idx + page_cnt, extra, true);
+      pool->free_cnt -= extra;
+#ifdef MEM_TRACE
+      tag = pool->buddies[page_idx].tag;
+      for (i = page_cnt; i < new_cnt; i++)
+        pool->buddies[page_idx + i].tag = tag;
+#endif
+    }
+  spinlock_release (&pool->lock, old_level);
+
+#ifdef MEM_TRACE
+  if (tag != MEMTRACE_NONE)
+    memtrace_alloc (tag, extra * PGSIZE);
+#endif
+  return ok;
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +346,614 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page for a later PAL_ZERO request, if the pool
+   has room for one more.  Returns true if a page was zeroed,
+   false if there was nothing to do.  Called by the idle thread,
+   with interrupts on, while no other thread is ready to run. */
+bool
+palloc_zero_idle (void)
+{
+  return zero_cached_page (&phys_pool);
+}
+
+/* Returns the number of pages in the memory pool, which
+   palloc_page_no() numbers from 0 in address order. */
+size_t
+palloc_page_cnt (void)
+{
+  return bitmap_size (phys_pool.used_map);
+}
+
+/* Returns the number of PAGE, which must belong to the memory
+   pool, counting from the pool's first page.  A table with one
+   entry per page of the pool may be indexed by it. */
+size_t
+palloc_page_no (const void *page)
+{
+  ASSERT (page_from_pool (&phys_pool, (void *) page));
+
+  return pg_no (page) - pg_no (phys_pool.base);
+}
+
+/* Returns the kernel virtual address of the page of the memory
+   pool numbered PAGE_NO, the inverse of palloc_page_no(). */
+void *
+palloc_page_addr (size_t page_no)
+{
+  ASSERT (page_no < bitmap_size (phys_pool.used_map));
+
+  return phys_pool.base + PGSIZE * page_no;
+}
+
+/* Returns the order of the largest free block of the memory
+   pool, a run of 2**ORDER free pages, or -1 if no page is free.
+   Cached free pages are not counted. */
+int
+palloc_free_order (void)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+  int order;
+
+  old_level = spinlock_acquire (&pool->lock);
+  for (order = BUDDY_ORDERS - 1; order >= 0; order--)
+    if (!list_empty (&pool->free_lists[order]))
+      break;
+  spinlock_release (&pool->lock, old_level);
+
+  return order;
+}
+
+/* Returns true if PAGE is a free page of the memory pool, whose
+   contents therefore do not matter.  Free pages cached as zeroed
+   count as free, though their contents matter to the allocator,
+   unless palloc_flush_cache() has given them back first. */
+bool
+palloc_page_free (const void *page)
+{
+  struct pool *pool = &phys_pool;
+  size_t pfn = vtop (page) >> PGBITS;
+
+  return (pfn_in_pool (pool, pfn)
+          && !bitmap_test (pool->used_map, pfn - pool->base_pfn));
+}
+
+/* Gives the free pages that the memory pool keeps cached, dirty
+   or zeroed, back to its buddy allocator. */
+void
+palloc_flush_cache (void)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+
+  old_level = spinlock_acquire (&pool->lock);
+  cache_flush (pool);
+  spinlock_release (&pool->lock, old_level);
+}
+
+/* Returns the number of free pages available to the user pool if
+   PAL_USER is set in FLAGS, otherwise to the kernel pool. */
+size_t
+palloc_free_cnt (enum palloc_flags flags)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+  size_t cnt;
+
+  old_level = spinlock_acquire (&pool->lock);
+  cnt = flags & PAL_USER ? user_free_cnt (pool) : pool->free_cnt;
+  spinlock_release (&pool->lock, old_level);
+
+  return cnt;
+}
+
+/* Returns the number of POOL's free pages that may be allocated
+   with PAL_USER.  POOL's spinlock must be held. */
+static size_t
+user_free_cnt (const struct pool *pool)
+{
+  size_t cnt;
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  if (pool->free_cnt <= pool->kernel_reserve
+      || pool->user_cnt >= pool->user_limit)
+    return 0;
+  cnt = pool->free_cnt - pool->kernel_reserve;
+  if (cnt > pool->user_limit - pool->user_cnt)
+    cnt = pool->user_limit - pool->user_cnt;
+  return cnt;
+}
+
+/* Clears the user flag, and the memtrace tag, of the PAGE_CNT
+   pages starting at PAGE_IDX in POOL, which are being freed.
+   POOL's spinlock must be held. */
+static void
+unmark_pages (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  size_t i;
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      struct buddy *b = &pool->buddies[page_idx + i];
+
+      if (b->user)
+        {
+          b->user = false;
+          pool->user_cnt--;
+        }
+#ifdef MEM_TRACE
+      if (b->tag != MEMTRACE_NONE)
+        {
+          memtrace_free (b->tag, PGSIZE);
+          b->tag = MEMTRACE_NONE;
+        }
+#endif
+    }
+}
+
+/* Prints statistics about the page pool: how many pages are
+   free and in use, and how fragmented the free pages are. */
+void
+palloc_print_stats (void)
+{
+  struct pool *pool = &phys_pool;
+  size_t page_cnt = bitmap_size (pool->used_map);
+  size_t free_cnt, user_cnt, cached_cnt;
+  size_t run = 0, max_run = 0;
+  size_t order_cnt[BUDDY_ORDERS];
+  enum intr_level old_level;
+  size_t i;
+  int order, max_order = -1;
+
+  old_level = spinlock_acquire (&pool->lock);
+  for (i = 0; i < page_cnt; i++)
+    if (!bitmap_test (pool->used_map, i))
+      {
+        if (++run > max_run)
+          max_run = run;
+      }
+    else
+      run = 0;
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    {
+      order_cnt[order] = list_size (&pool->free_lists[order]);
+      if (order_cnt[order] > 0)
+        max_order = order;
+    }
+  free_cnt = pool->free_cnt;
+  user_cnt = pool->user_cnt;
+  cached_cnt = pool->dirty_cnt + pool->zero_cnt;
+  spinlock_release (&pool->lock, old_level);
+
+  printf ("Pages: %zu free of %zu, %zu user, %zu cached, "
+          "largest free run %zu\n",
+          free_cnt, page_cnt, user_cnt, cached_cnt, max_run);
+  printf ("Free blocks by order:");
+  for (order = 0; order <= max_order; order++)
+    printf (" %zu", order_cnt[order]);
+  printf ("\n");
+}
+
+#ifdef MEM_TRACE
+/* Tags the PAGE_CNT pages starting at PAGES, if nonnull, as
+   allocated by source file NAME, and returns PAGES. */
+static void *
+tag_pages (void *pages, size_t page_cnt, const char *name)
+{
+  struct pool *pool = &phys_pool;
+  enum intr_level old_level;
+  size_t page_idx, i;
+  int tag;
+
+  if (pages == NULL)
+    return NULL;
+
+  tag = memtrace_tag (MEMTRACE_PALLOC, name);
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  old_level = spinlock_acquire (&pool->lock);
+  for (i = 0; i < page_cnt; i++)
+    pool->buddies[page_idx + i].tag = tag;
+  spinlock_release (&pool->lock, old_level);
+  memtrace_alloc (tag, page_cnt * PGSIZE);
+  return pages;
+}
+
+/* Obtains a single page, as palloc_get_page(), on behalf of
+   source file NAME. */
+void *
+palloc_get_page_tagged (enum palloc_flags flags, const char *name)
+{
+  return tag_pages (palloc_get_multiple (flags, 1), 1, name);
+}
+
+/* Obtains PAGE_CNT pages, as palloc_get_multiple(), on behalf of
+   source file NAME. */
+void *
+palloc_get_multiple_tagged (enum palloc_flags flags, size_t page_cnt,
+                            const char *name)
+{
+  return tag_pages (palloc_get_multiple (flags, page_cnt), page_cnt, name);
+}
+
+/* Obtains PAGE_CNT aligned pages, as palloc_get_aligned(), on
+   behalf of source file NAME. */
+void *
+palloc_get_aligned_tagged (enum palloc_flags flags, size_t page_cnt,
+                           size_t align_cnt, const char *name)
+{
+  return tag_pages (palloc_get_aligned (flags, page_cnt, align_cnt),
+                    page_cnt, name);
+}
+#endif /* MEM_TRACE */
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's buddy entries and used_map at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t buddies_size = page_cnt * sizeof *p->buddies;
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (buddies_size + bm_size, PGSIZE);
+  size_t i;
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool with every page in use, then free them
+     all, to build the free lists. */
+  spinlock_init (&p->lock);
+  p->buddies = base;
+  p->used_map = bitmap_create_in_buf (page_cnt, (uint8_t *) base
+                                      + buddies_size, bm_size);
   p->base = base + bm_pages * PGSIZE;
+  p->base_pfn = vtop (p->base) >> PGBITS;
+  p->free_cnt = page_cnt;
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    list_init (&p->free_lists[order]);
+  list_init (&p->dirty_list);
+  list_init (&p->zero_list);
+  p->dirty_cnt = p->zero_cnt = 0;
+  p->user_cnt = 0;
+  p->user_limit = SIZE_MAX;
+  p->kernel_reserve = 0;
+  for (i = 0; i < page_cnt; i++)
+    {
+      p->buddies[i].order = -1;
+      p->buddies[i].user = false;
+#ifdef MEM_TRACE
+      p->buddies[i].tag = MEMTRACE_NONE;
+#endif
+    }
+  buddy_free_range (p, p->base_pfn, page_cnt);
+}
+
+/* Allocates PAGE_CNT pages from POOL for a request with FLAGS,
+   starting at a block of 2**ORDER pages as get_pages() if they
+   do not come from the cache, and returns the first one.  Sets
+   *ZEROED to true if the pages are known to be zeroed already.
+   Returns a null pointer if there are not so many free pages.
+   POOL's spinlock must be held. */
+static void *
+alloc_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt,
+             int order, bool *zeroed)
+{
+  void *pages = NULL;
+
+  *zeroed = false;
+  if ((flags & PAL_USER) && user_free_cnt (pool) < page_cnt)
+    return NULL;
+
+  if (page_cnt == 1 && order == 0)
+    {
+      if ((flags & PAL_ZERO) && pool->zero_cnt > 0)
+        {
+          *zeroed = true;
+          pages = cache_pop (pool, &pool->zero_list);
+        }
+      else if (!(flags & PAL_ZERO) && pool->dirty_cnt > 0)
+        pages = cache_pop (pool, &pool->dirty_list);
+    }
+
+  if (pages == NULL)
+    pages = get_pages (pool, page_cnt, order);
+  if (pages == NULL && pool->dirty_cnt + pool->zero_cnt > 0)
+    {
+      cache_flush (pool);
+      pages = get_pages (pool, page_cnt, order);
+    }
+
+  if (pages != NULL && (flags & PAL_USER))
+    {
+      size_t page_idx = pg_no (pages) - pg_no (pool->base);
+      size_t i;
+
+      for (i = 0; i < page_cnt; i++)
+        pool->buddies[page_idx + i].user = true;
+      pool->user_cnt += page_cnt;
+    }
+  return pages;
+}
+
+/* Allocates PAGE_CNT pages from POOL, starting at a block of
+   2**ORDER pages, which must hold PAGE_CNT pages, and returns
+   the first one.  Returns a null pointer if there is no free
+   block so large.  POOL's spinlock must be held. */
+static void *
+get_pages (struct pool *pool, size_t page_cnt, int order)
+{
+  size_t pfn, page_idx;
+
+  ASSERT (spinlock_held (&pool->lock));
+  ASSERT (page_cnt <= (size_t) 1 << order);
+
+  if (order >= BUDDY_ORDERS)
+    return NULL;
+  pfn = buddy_alloc (pool, order);
+  if (pfn == SIZE_MAX)
+    return NULL;
+
+  /* Give back the rest of the block. */
+  buddy_free_range (pool, pfn + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  page_idx = pfn - pool->base_pfn;
+  ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  pool->free_cnt -= page_cnt;
+  return pool->base + PGSIZE * page_idx;
+}
+
+/* Adds free PAGE, whose used_map bit is still set, to cached page
+   list LIST in POOL.  POOL's spinlock must be held. */
+static void
+cache_push (struct pool *pool, struct list *list, void *page)
+{
+  size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  bitmap_reset (pool->used_map, page_idx);
+  list_push_front (list, &pool->buddies[page_idx].elem);
+  if (list == &pool->zero_list)
+    pool->zero_cnt++;
+  else
+    pool->dirty_cnt++;
+  pool->free_cnt++;
+}
+
+/* Removes a page from cached page list LIST in POOL, which must
+   not be empty, and returns it.  POOL's spinlock must be held. */
+static void *
+cache_pop (struct pool *pool, struct list *list)
+{
+  struct buddy *b = list_entry (list_pop_front (list), struct buddy, elem);
+  size_t page_idx = b - pool->buddies;
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  bitmap_mark (pool->used_map, page_idx);
+  if (list == &pool->zero_list)
+    pool->zero_cnt--;
+  else
+    pool->dirty_cnt--;
+  pool->free_cnt--;
+  return pool->base + PGSIZE * page_idx;
+}
+
+/* Gives all of POOL's cached pages back to its buddy allocator.
+   POOL's spinlock must be held. */
+static void
+cache_flush (struct pool *pool)
+{
+  ASSERT (spinlock_held (&pool->lock));
+
+  while (pool->dirty_cnt + pool->zero_cnt > 0)
+    {
+      bool dirty = pool->dirty_cnt > 0;
+      void *page = cache_pop (pool, dirty ? &pool->dirty_list
+                                          : &pool->zero_list);
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+#ifndef NDEBUG
+      if (dirty)
+        memset (page, 0xcc, PGSIZE);
+#endif
+      bitmap_reset (pool->used_map, page_idx);
+      buddy_free (pool, pool->base_pfn + page_idx, 0);
+      pool->free_cnt++;
+    }
+}
+
+/* Zeroes a page for POOL's zero_list, taking a dirty page if
+   there is one or else a page from the buddy allocator, unless
+   the list is full.  Returns true if a page was zeroed. */
+static bool
+zero_cached_page (struct pool *pool)
+{
+  enum intr_level old_level;
+  void *page = NULL;
+
+  old_level = spinlock_acquire (&pool->lock);
+  if (pool->zero_cnt < CACHE_PAGES)
+    {
+      if (pool->dirty_cnt > 0)
+        page = cache_pop (pool, &pool->dirty_list);
+      else if (pool->zero_cnt + pool->dirty_cnt < CACHE_PAGES)
+        page = get_pages (pool, 1, 0);
+    }
+  spinlock_release (&pool->lock, old_level);
+  if (page == NULL)
+    return false;
+
+  fpu_zero_page (page);
+
+  old_level = spinlock_acquire (&pool->lock);
+  cache_push (pool, &pool->zero_list, page);
+  spinlock_release (&pool->lock, old_level);
+  return true;
+}
+
+/* Returns POOL's buddy entry for physical page number PFN. */
+static struct buddy *
+pfn_to_buddy (struct pool *pool, size_t pfn)
+{
+  return &pool->buddies[pfn - pool->base_pfn];
+}
+
+/* Returns true if physical page number PFN is in POOL. */
+static bool
+pfn_in_pool (const struct pool *pool, size_t pfn)
+{
+  return pfn >= pool->base_pfn
+         && pfn - pool->base_pfn < bitmap_size (pool->used_map);
+}
+
+/* Removes a free block of 2**ORDER pages from POOL, splitting a
+   larger block if there is none, and returns its first physical
+   page number.  Returns SIZE_MAX if there is no free block of
+   ORDER or larger. */
+static size_t
+buddy_alloc (struct pool *pool, int order)
+{
+  struct buddy *b;
+  size_t pfn;
+  int o;
+
+  for (o = order; o < BUDDY_ORDERS; o++)
+    if (!list_empty (&pool->free_lists[o]))
+      break;
+  if (o >= BUDDY_ORDERS)
+    return SIZE_MAX;
+
+  b = list_entry (list_pop_front (&pool->free_lists[o]), struct buddy, elem);
+  b->order = -1;
+  pfn = pool->base_pfn + (b - pool->buddies);
+
+  /* Split the block, keeping its first half each time. */
+  while (o > order)
+    {
+      struct buddy *half;
+
+      o--;
+      half = pfn_to_buddy (pool, pfn + ((size_t) 1 << o));
+      half->order = o;
+      list_push_front (&pool->free_lists[o], &half->elem);
+    }
+  return pfn;
+}
+
+/* Adds the block of 2**ORDER pages at physical page number PFN
+   to POOL's free lists, merging it with its buddy as long as the
+   buddy is free too. */
+static void
+buddy_free (struct pool *pool, size_t pfn, int order)
+{
+  struct buddy *b;
+
+  while (order < BUDDY_ORDERS - 1)
+    {
+      size_t buddy_pfn = pfn ^ ((size_t) 1 << order);
+
+      if (!pfn_in_pool (pool, buddy_pfn))
+        break;
+      b = pfn_to_buddy (pool, buddy_pfn);
+      if (b->order != order)
+        break;
+
+      list_remove (&b->elem);
+      b->order = -1;
+      pfn &= ~((size_t) 1 << order);
+      order++;
+    }
+
+  b = pfn_to_buddy (pool, pfn);
+  b->order = order;
+  list_push_front (&pool->free_lists[order], &b->elem);
+}
+
+/* Adds the PAGE_CNT pages starting at physical page number PFN
+   to POOL's free lists, as the largest aligned blocks they make
+   up. */
+static void
+buddy_free_range (struct pool *pool, size_t pfn, size_t page_cnt)
+{
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < BUDDY_ORDERS
+             && pfn % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      buddy_free (pool, pfn, order);
+      pfn += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Removes physical page number PFN, which must be free and not
+   cached, from the free block of POOL that holds it, and gives
+   the rest of the block back as smaller blocks.  POOL's spinlock
+   must be held. */
+static void
+buddy_claim (struct pool *pool, size_t pfn)
+{
+  struct buddy *b;
+  size_t head = pfn;
+  int order;
+
+  ASSERT (spinlock_held (&pool->lock));
+
+  for (order = 0; order < BUDDY_ORDERS; order++)
+    {
+      head = pfn & ~(((size_t) 1 << order) - 1);
+      if (pfn_in_pool (pool, head)
+          && pfn_to_buddy (pool, head)->order == order)
+        break;
+    }
+  ASSERT (order < BUDDY_ORDERS);
+
+  b = pfn_to_buddy (pool, head);
+  list_remove (&b->elem);
+  b->order = -1;
+
+  /* Split the block, keeping the half that holds PFN each time. */
+  while (order > 0)
+    {
+      size_t half;
+
+      order--;
+      half = head + ((size_t) 1 << order);
+      if (pfn >= half)
+        {
+          half = head;
+          head += (size_t) 1 << order;
+        }
+      b = pfn_to_buddy (pool, half);
+      b->order = order;
+      list_push_front (&pool->free_lists[order], &b->elem);
+    }
+}
+
+/* Returns the order of the smallest block that holds PAGE_CNT
+   pages. */
+static int
+page_cnt_order (size_t page_cnt)
+{
+  int order = 0;
+
+  while (order < BUDDY_ORDERS && ((size_t) 1 << order) < page_cnt)
+    order++;
+  return order;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -180,3 +967,13 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Sets PAGE_CNT pages starting at PAGES to zero. */
+static void
+zero_pages (void *pages, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    fpu_zero_page (pages + i * PGSIZE);
+}
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -14,7 +15,33 @@ enum palloc_flags
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
+void *palloc_get_aligned (enum palloc_flags, size_t page_cnt,
+                          size_t align_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend (void *, size_t page_cnt, size_t new_cnt);
+size_t palloc_page_cnt (void);
+size_t palloc_page_no (const void *);
+void *palloc_page_addr (size_t page_no);
+int palloc_free_order (void);
+size_t palloc_free_cnt (enum palloc_flags);
+bool palloc_page_free (const void *);
+void palloc_flush_cache (void);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
+
+#ifdef MEM_TRACE
+/* Tag each allocation with its caller's source file. */
+void *palloc_get_page_tagged (enum palloc_flags, const char *);
+void *palloc_get_multiple_tagged (enum palloc_flags, size_t page_cnt,
+                                  const char *);
+void *palloc_get_aligned_tagged (enum palloc_flags, size_t page_cnt,
+                                 size_t align_cnt, const char *);
+#define palloc_get_page(FLAGS) palloc_get_page_tagged (FLAGS, __FILE__)
+#define palloc_get_multiple(FLAGS, PAGE_CNT) \
+        palloc_get_multiple_tagged (FLAGS, PAGE_CNT, __FILE__)
+#define palloc_get_aligned(FLAGS, PAGE_CNT, ALIGN_CNT) \
+        palloc_get_aligned_tagged (FLAGS, PAGE_CNT, ALIGN_CNT, __FILE__)
+#endif
 
 #endif /* threads/palloc.h */
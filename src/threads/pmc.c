@@ -0,0 +1,207 @@
+#include "threads/pmc.h"
+#include <debug.h>
+#include <rusage.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+
+/* Hardware performance counters, enabled by the "-pmc" kernel
+   command-line option.
+
+   pmc_init() programs one general-purpose counter of the
+   processor's architectural performance monitoring unit, as
+   described by CPUID leaf 0xa (see [IA32-v3b] chapter 18), for
+   each event in enum pmc_event that the processor counts, in both
+   kernel and user mode.  The counters then run freely.  At each
+   thread switch, schedule() calls pmc_account() to add to the
+   outgoing thread's resource usage the counts since the previous
+   switch, so that each thread's counts, as getrusage() reports
+   them, include only the events while it ran.
+
+   Data TLB misses have no architectural event.  They are counted
+   with event 0x08, unit mask 0x01, which is DTLB_LOAD_MISSES on
+   Intel processors of family 6 since the Core 2, and only on
+   those.
+
+   Without a local APIC driver, counter overflow cannot raise an
+   interrupt, so the sampling profiler instead weights each timer
+   sample by the increase in one counter since the sample before
+   (see profile.c). */
+bool pmc_enabled;
+
+/* Model-specific registers. */
+#define MSR_PERFEVTSEL0 0x186   /* Event select for counter 0. */
+#define MSR_PERF_GLOBAL_CTRL 0x38f
+#define EVTSEL_USR (1u << 16)   /* Count in user mode. */
+#define EVTSEL_OS (1u << 17)    /* Count in kernel mode. */
+#define EVTSEL_EN (1u << 22)    /* Enable. */
+
+/* An event. */
+struct pmc_event_info
+  {
+    const char *name;           /* Name for the command line. */
+    uint8_t event;              /* Event select. */
+    uint8_t umask;              /* Unit mask. */
+    int cpuid_bit;              /* Bit in CPUID.0AH:EBX set if absent,
+                                   or -1 if not architectural. */
+  };
+
+static const struct pmc_event_info events[PMC_EVENT_CNT] =
+  {
+    {"cycles", 0x3c, 0x00, 0},
+    {"instructions", 0xc0, 0x00, 1},
+    {"llc-misses", 0x2e, 0x41, 4},
+    {"dtlb-misses", 0x08, 0x01, -1},
+  };
+
+static int counter_of[PMC_EVENT_CNT];   /* Counter for each event, or -1. */
+static uint64_t counter_mask;           /* Bits in a counter. */
+static uint64_t last[CPU_MAX][PMC_EVENT_CNT];  /* At last accounting. */
+
+/* Executes CPUID for LEAF. */
+static inline void
+cpuid (uint32_t leaf, uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+  asm volatile ("cpuid" : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+                : "a" (leaf), "c" (0));
+}
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "A" (value));
+}
+
+/* Reads performance counter COUNTER. */
+static inline uint64_t
+rdpmc (int counter)
+{
+  uint64_t value;
+  asm volatile ("rdpmc" : "=A" (value) : "c" (counter));
+  return value;
+}
+
+/* Programs a counter for each event the processor can count, if
+   the counters are enabled. */
+void
+pmc_init (void)
+{
+  uint32_t a, b, c, d, vendor[3], max_leaf;
+  int version, counter_cnt, family, i, n, cpu;
+  bool intel_core;
+
+  for (i = 0; i < PMC_EVENT_CNT; i++)
+    counter_of[i] = -1;
+  if (!pmc_enabled)
+    return;
+
+  cpuid (0, &max_leaf, &vendor[0], &vendor[2], &vendor[1]);
+  if (max_leaf < 0xa || memcmp (vendor, "GenuineIntel", 12))
+    {
+      printf ("pmc: no architectural performance monitoring\n");
+      pmc_enabled = false;
+      return;
+    }
+  cpuid (1, &a, &b, &c, &d);
+  family = (a >> 8) & 0xf;
+  cpuid (0xa, &a, &b, &c, &d);
+  version = a & 0xff;
+  counter_cnt = (a >> 8) & 0xff;
+  counter_mask = ((uint64_t) 1 << ((a >> 16) & 0xff)) - 1;
+  if (version == 0 || counter_cnt == 0)
+    {
+      printf ("pmc: no performance counters\n");
+      pmc_enabled = false;
+      return;
+    }
+  intel_core = family == 6 && version >= 2;
+
+  /* Assign counters in order of the events. */
+  counter_cnt = counter_cnt < PMC_EVENT_CNT ? counter_cnt : PMC_EVENT_CNT;
+  n = 0;
+  for (i = 0; i < PMC_EVENT_CNT && n < counter_cnt; i++)
+    {
+      const struct pmc_event_info *e = &events[i];
+
+      if (e->cpuid_bit >= 0 ? (b & (1u << e->cpuid_bit)) != 0 : !intel_core)
+        continue;
+      wrmsr (MSR_PERFEVTSEL0 + n, e->event | (e->umask << 8)
+             | EVTSEL_USR | EVTSEL_OS | EVTSEL_EN);
+      counter_of[i] = n++;
+    }
+  if (version >= 2)
+    wrmsr (MSR_PERF_GLOBAL_CTRL, ((uint64_t) 1 << n) - 1);
+
+  for (cpu = 0; cpu < CPU_MAX; cpu++)
+    for (i = 0; i < PMC_EVENT_CNT; i++)
+      if (counter_of[i] >= 0)
+        last[cpu][i] = rdpmc (counter_of[i]);
+
+  printf ("pmc: counting");
+  for (i = 0; i < PMC_EVENT_CNT; i++)
+    if (counter_of[i] >= 0)
+      printf (" %s", events[i].name);
+  printf ("\n");
+}
+
+/* Returns true if EVENT is being counted. */
+bool
+pmc_counting (enum pmc_event event)
+{
+  return counter_of[event] >= 0;
+}
+
+/* Returns the event named NAME, or -1 if there is none. */
+int
+pmc_lookup (const char *name)
+{
+  int i;
+
+  for (i = 0; i < PMC_EVENT_CNT; i++)
+    if (!strcmp (name, events[i].name))
+      return i;
+  return -1;
+}
+
+/* Returns the current count of EVENT, which must be counted.
+   The count wraps around at the counter's width. */
+uint64_t
+pmc_read (enum pmc_event event)
+{
+  ASSERT (pmc_counting (event));
+
+  return rdpmc (counter_of[event]);
+}
+
+/* Adds the events counted since the last call to USAGE.
+   Interrupts must be off. */
+void
+pmc_account (struct rusage *usage)
+{
+  long long delta[PMC_EVENT_CNT];
+  uint64_t *prev;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!pmc_enabled)
+    return;
+
+  prev = last[cpu_current ()->id];
+  for (i = 0; i < PMC_EVENT_CNT; i++)
+    if (counter_of[i] >= 0)
+      {
+        uint64_t now = rdpmc (counter_of[i]);
+        delta[i] = (now - prev[i]) & counter_mask;
+        prev[i] = now;
+      }
+    else
+      delta[i] = 0;
+
+  usage->cycles += delta[PMC_CYCLES];
+  usage->instructions += delta[PMC_INSTRUCTIONS];
+  usage->llc_misses += delta[PMC_LLC_MISSES];
+  usage->dtlb_misses += delta[PMC_DTLB_MISSES];
+}
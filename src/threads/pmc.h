@@ -0,0 +1,29 @@
+#ifndef THREADS_PMC_H
+#define THREADS_PMC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hardware performance counters.  See pmc.c. */
+
+/* Events counted. */
+enum pmc_event
+  {
+    PMC_CYCLES,                 /* Unhalted core cycles. */
+    PMC_INSTRUCTIONS,           /* Instructions retired. */
+    PMC_LLC_MISSES,             /* Last-level cache misses. */
+    PMC_DTLB_MISSES,            /* Data TLB load misses. */
+    PMC_EVENT_CNT
+  };
+
+struct rusage;
+
+extern bool pmc_enabled;
+
+void pmc_init (void);
+bool pmc_counting (enum pmc_event);
+int pmc_lookup (const char *name);
+uint64_t pmc_read (enum pmc_event);
+void pmc_account (struct rusage *);
+
+#endif /* threads/pmc.h */
@@ -0,0 +1,126 @@
+#include "threads/poll.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+
+/* Waiting on several objects at once, for the poll system call.
+
+   An object that threads may wait on, such as a pipe or the
+   console's input buffer, keeps a poll_queue and calls
+   poll_wake() on it whenever it may have become ready.  A thread
+   that wants to wait on several such objects initializes a
+   poller, adds a poll_waiter for it to each object's queue, then
+   checks the objects and calls poller_wait() until one of them is
+   ready or the timeout expires.  Since the waiters are added
+   before the first check, no wakeup can be missed in between.
+
+   poll_wake() takes every waiter off the queue and ups its
+   poller's semaphore, so it may be called from an interrupt
+   handler, and a queue's list is only changed with interrupts
+   off.  Since a waiter is woken once, a poller that finds
+   nothing ready after a wakeup adds its waiters again before
+   checking again.  Taking the waiters off the queue before
+   waking them also means that poll_wake() is not disturbed if
+   sema_up() switches to a poller that then removes its other
+   waiters. */
+
+static timer_callout_func expire;
+
+/* Initializes poller P to wait for up to TIMEOUT timer ticks, or
+   indefinitely if TIMEOUT is negative.  With a TIMEOUT of 0,
+   poller_wait() never waits. */
+void
+poller_init (struct poller *p, int64_t timeout)
+{
+  sema_init (&p->wakeups, 0);
+  timer_callout_init (&p->timeout, expire, p);
+  p->expired = timeout == 0;
+  if (timeout > 0)
+    timer_callout_add (&p->timeout, timer_ticks () + timeout);
+}
+
+/* Waits for a wakeup of P.  Returns false, without waiting, if
+   P's timeout has expired, true otherwise. */
+bool
+poller_wait (struct poller *p)
+{
+  if (p->expired)
+    return false;
+  sema_down (&p->wakeups);
+  return !p->expired;
+}
+
+/* Cancels P's timeout, if it has not expired.  P's waiters must
+   already be removed from their queues. */
+void
+poller_done (struct poller *p)
+{
+  timer_callout_cancel (&p->timeout);
+}
+
+/* Timer callout for poller P_'s timeout. */
+static void
+expire (void *p_)
+{
+  struct poller *p = p_;
+
+  p->expired = true;
+  sema_up (&p->wakeups);
+}
+
+/* Initializes Q as an empty poll queue. */
+void
+poll_queue_init (struct poll_queue *q)
+{
+  list_init (&q->waiters);
+}
+
+/* Adds W to Q, so that the next poll_wake (Q) wakes POLLER.  W
+   must not be in a queue already. */
+void
+poll_queue_add (struct poll_queue *q, struct poll_waiter *w,
+                struct poller *poller)
+{
+  enum intr_level old_level = intr_disable ();
+
+  ASSERT (w->queue == NULL);
+  w->queue = q;
+  w->poller = poller;
+  list_push_back (&q->waiters, &w->elem);
+  intr_set_level (old_level);
+}
+
+/* Removes W from its queue, if it is still in one. */
+void
+poll_queue_remove (struct poll_waiter *w)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (w->queue != NULL)
+    {
+      list_remove (&w->elem);
+      w->queue = NULL;
+    }
+  intr_set_level (old_level);
+}
+
+/* Removes every waiter from Q and wakes its poller.  May be
+   called from an interrupt handler. */
+void
+poll_wake (struct poll_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list woken;
+
+  list_init (&woken);
+  if (!list_empty (&q->waiters))
+    list_splice (list_end (&woken), list_begin (&q->waiters),
+                 list_end (&q->waiters));
+  while (!list_empty (&woken))
+    {
+      struct poll_waiter *w = list_entry (list_pop_front (&woken),
+                                          struct poll_waiter, elem);
+      w->queue = NULL;
+      sema_up (&w->poller->wakeups);
+    }
+  intr_set_level (old_level);
+}
@@ -0,0 +1,46 @@
+#ifndef THREADS_POLL_H
+#define THREADS_POLL_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "devices/timer.h"
+
+/* Waiting on several objects at once.  See poll.c. */
+
+/* A thread waiting for any of several objects to become ready,
+   or for a timeout. */
+struct poller
+  {
+    struct semaphore wakeups;           /* Upped by each wakeup. */
+    struct timer_callout timeout;       /* Ends the wait. */
+    bool expired;                       /* Timeout reached? */
+  };
+
+/* An object's queue of pollers, woken whenever the object may
+   have become ready. */
+struct poll_queue
+  {
+    struct list waiters;                /* List of struct poll_waiter. */
+  };
+
+/* A poller's place in one object's poll_queue. */
+struct poll_waiter
+  {
+    struct list_elem elem;              /* Element in QUEUE. */
+    struct poll_queue *queue;           /* Queue, or null if none. */
+    struct poller *poller;              /* Poller to wake. */
+  };
+
+void poller_init (struct poller *, int64_t timeout);
+bool poller_wait (struct poller *);
+void poller_done (struct poller *);
+
+void poll_queue_init (struct poll_queue *);
+void poll_queue_add (struct poll_queue *, struct poll_waiter *,
+                     struct poller *);
+void poll_queue_remove (struct poll_waiter *);
+void poll_wake (struct poll_queue *);
+
+#endif /* threads/poll.h */
@@ -0,0 +1,207 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pmc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* Sampling profiler, enabled by the "-prof" kernel command-line
+   option.
+
+   profile_rate times each timer tick, the timer interrupt calls
+   profile_sample() to record what it interrupted: its eip and,
+   following the chain of saved frame pointers, up to
+   PROFILE_DEPTH - 1 return addresses, along with the name of the
+   running thread and whether it was idle, in the kernel, or in a
+   user program.  Samples go into a ring buffer of PROFILE_PAGES
+   pages allocated at boot, so that once it fills the newest
+   samples overwrite the oldest.
+
+   Samples are weighted equally by default, for a profile of
+   time.  With "-profev=EVENT", each is weighted instead by the
+   number of hardware events of that kind since the sample before
+   it, from the performance counters (see pmc.c), for a profile
+   of, say, cache misses.
+
+   At shutdown, profile_done() saves the buffer to the scratch
+   device as file "profile", where "pintos --profile" retrieves
+   it.  utils/pintos-profile turns it into folded stacks for a
+   flame graph. */
+int profile_rate;
+int profile_event = -1;
+
+#define PROFILE_PAGES 64
+#define PROFILE_CNT ((PROFILE_PAGES * PGSIZE - sizeof (struct profile_header)) \
+                     / sizeof (struct profile_sample))
+
+static struct profile_header *header;   /* Start of the buffer. */
+static struct profile_sample *samples;  /* PROFILE_CNT samples. */
+static uint64_t sample_cnt;             /* Samples taken. */
+static uint64_t kind_cnt[3];            /* Samples by kind. */
+static uint64_t last_event_cnt;         /* PROFILE_EVENT count. */
+
+static int kernel_frames (const struct intr_frame *, uint32_t *pc, int max);
+static int user_frames (const struct intr_frame *, uint32_t *pc, int max);
+
+/* Allocates the sample buffer, if the profiler is on. */
+void
+profile_init (void)
+{
+  if (profile_rate <= 0)
+    return;
+  if (profile_rate > PROFILE_RATE_MAX)
+    profile_rate = PROFILE_RATE_MAX;
+
+  header = palloc_get_multiple (PAL_ZERO, PROFILE_PAGES);
+  if (header == NULL)
+    {
+      printf ("profile: out of memory, profiler off\n");
+      profile_rate = 0;
+      return;
+    }
+  samples = (struct profile_sample *) (header + 1);
+
+  if (profile_event >= 0 && !pmc_counting (profile_event))
+    {
+      printf ("profile: event not counted, weighting samples equally\n");
+      profile_event = -1;
+    }
+  if (profile_event >= 0)
+    last_event_cnt = pmc_read (profile_event);
+}
+
+/* Records a sample of the code that timer interrupt FRAME
+   interrupted. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  struct profile_sample *s;
+
+  ASSERT (intr_context ());
+
+  if (header == NULL)
+    return;
+
+  s = &samples[sample_cnt++ % PROFILE_CNT];
+  s->weight = 1;
+  if (profile_event >= 0)
+    {
+      uint64_t cnt = pmc_read (profile_event);
+      s->weight = cnt - last_event_cnt;
+      last_event_cnt = cnt;
+    }
+  s->pc[0] = (uint32_t) f->eip;
+  if ((f->cs & 3) != 0)
+    {
+      /* Interrupted at user privilege. */
+      s->kind = PROFILE_USER;
+      s->depth = 1 + user_frames (f, s->pc + 1, PROFILE_DEPTH - 1);
+    }
+  else
+    {
+      s->kind = thread_idling () ? PROFILE_IDLE : PROFILE_KERNEL;
+      s->depth = 1 + kernel_frames (f, s->pc + 1, PROFILE_DEPTH - 1);
+    }
+  strlcpy (s->name, thread_name (), sizeof s->name);
+  kind_cnt[s->kind]++;
+}
+
+/* Stops the profiler and saves its samples to the scratch
+   device. */
+void
+profile_done (void)
+{
+  size_t cnt;
+  enum intr_level old_level;
+
+  if (header == NULL)
+    return;
+
+  old_level = intr_disable ();
+  cnt = sample_cnt < PROFILE_CNT ? sample_cnt : PROFILE_CNT;
+  memcpy (header->magic, "PROF", 4);
+  header->sample_size = sizeof (struct profile_sample);
+  header->sample_cnt = cnt;
+  header->first = sample_cnt < PROFILE_CNT ? 0 : sample_cnt % PROFILE_CNT;
+  header->lost_cnt = sample_cnt - cnt;
+  header->hz = TIMER_FREQ * profile_rate;
+  header->event = profile_event;
+  intr_set_level (old_level);
+
+  printf ("Profile: %llu samples (%llu kernel, %llu user, %llu idle), ",
+          sample_cnt, kind_cnt[PROFILE_KERNEL], kind_cnt[PROFILE_USER],
+          kind_cnt[PROFILE_IDLE]);
+#ifdef FILESYS
+  if (old_level == INTR_ON
+      && fsutil_save ("profile", header,
+                      sizeof *header + cnt * sizeof *samples))
+    printf ("saved to scratch device\n");
+  else
+#endif
+    printf ("not saved\n");
+
+  palloc_free_multiple (header, PROFILE_PAGES);
+  header = NULL;
+}
+
+/* Stores in PC up to MAX return addresses from the kernel stack
+   that F interrupted, and returns the number stored.  The frames
+   followed must lie within the interrupted thread's stack page,
+   which also holds F. */
+static int
+kernel_frames (const struct intr_frame *f, uint32_t *pc, int max)
+{
+  const uint32_t *fp = (const uint32_t *) f->ebp;
+  int n = 0;
+
+  while (n < max
+         && pg_round_down (fp) == pg_round_down (f)
+         && pg_ofs (fp) <= PGSIZE - 8
+         && fp[1] != 0)
+    {
+      pc[n++] = fp[1];
+      if ((const uint32_t *) fp[0] <= fp)
+        break;
+      fp = (const uint32_t *) fp[0];
+    }
+  return n;
+}
+
+/* Stores in PC up to MAX return addresses from the user stack
+   that F interrupted, and returns the number stored.  The stack
+   is read through the process's page directory, stopping at the
+   first frame that is not mapped, so that this cannot fault. */
+static int
+user_frames (const struct intr_frame *f UNUSED, uint32_t *pc UNUSED,
+             int max UNUSED)
+{
+  int n = 0;
+#ifdef USERPROG
+  uint32_t *pd = thread_current ()->pagedir;
+  const uint32_t *fp = (const uint32_t *) f->ebp;
+
+  while (n < max && pd != NULL
+         && fp != NULL && is_user_vaddr (fp)
+         && (uintptr_t) fp % 4 == 0 && pg_ofs (fp) <= PGSIZE - 8)
+    {
+      const uint32_t *kfp = pagedir_get_page (pd, fp);
+      if (kfp == NULL || kfp[1] == 0)
+        break;
+      pc[n++] = kfp[1];
+      if ((const uint32_t *) kfp[0] <= fp)
+        break;
+      fp = (const uint32_t *) kfp[0];
+    }
+#endif
+  return n;
+}
@@ -0,0 +1,56 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+#include <stdint.h>
+
+/* Sampling profiler.  See profile.c. */
+
+/* What a sample interrupted. */
+enum profile_kind
+  {
+    PROFILE_IDLE,               /* The idle thread. */
+    PROFILE_KERNEL,             /* Other kernel code. */
+    PROFILE_USER                /* A user program. */
+  };
+
+/* Addresses kept in a sample. */
+#define PROFILE_DEPTH 8
+
+/* Header of the profile saved to the scratch device, followed by
+   SAMPLE_CNT samples in a ring that starts at the oldest, sample
+   FIRST. */
+struct profile_header
+  {
+    char magic[4];              /* "PROF". */
+    uint32_t sample_size;       /* sizeof (struct profile_sample). */
+    uint32_t sample_cnt;        /* Number of samples saved. */
+    uint32_t first;             /* Index of the oldest sample. */
+    uint32_t lost_cnt;          /* Older samples overwritten. */
+    uint32_t hz;                /* Samples per second. */
+    int32_t event;              /* PMC_* event weighting samples, or -1. */
+  };
+
+/* A sample. */
+struct profile_sample
+  {
+    uint8_t kind;               /* A PROFILE_* kind. */
+    uint8_t depth;              /* Number of addresses in pc[]. */
+    uint16_t unused;
+    char name[16];              /* Name of the thread interrupted. */
+    uint32_t weight;            /* Events since last sample, or 1. */
+    uint32_t pc[PROFILE_DEPTH]; /* Interrupted eip, then callers. */
+  };
+
+/* Samples per timer tick, or 0 if the profiler is off. */
+extern int profile_rate;
+#define PROFILE_RATE_MAX 100
+
+/* Event to weight samples by, or -1 to weight them equally. */
+extern int profile_event;
+
+struct intr_frame;
+void profile_init (void);
+void profile_sample (const struct intr_frame *);
+void profile_done (void);
+
+#endif /* threads/profile.h */
@@ -1,6 +1,7 @@
 #ifndef THREADS_PTE_H
 #define THREADS_PTE_H
 
+#include <debug.h>
 #include "threads/vaddr.h"
 
 /* Functions and macros for working with x86 hardware page
@@ -66,6 +67,14 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page (PDEs only, needs CR4.PSE). */
+#define PTE_G 0x100             /* 1=global, kept in TLB across CR3 loads. */
+
+/* A large page maps a whole page table's span with a single PDE
+   whose PTE_PS bit is set.  Its A, D, W, U and P bits have the
+   same meaning as in a PTE. */
+#define LPSIZE  PTSPAN                      /* Bytes in a large page. */
+#define LPPAGES (LPSIZE / PGSIZE)           /* Pages in a large page. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -97,6 +106,15 @@ static inline uint32_t pte_create_user (void *page, bool writable) {
   return pte_create_kernel (page, writable) | PTE_U;
 }
 
+/* Returns a PDE that maps the large page starting at PAGE,
+   which must be LPSIZE-aligned in physical memory, for user
+   access.  If WRITABLE is true, the large page is read/write;
+   otherwise it is read-only. */
+static inline uint32_t pde_create_large_user (void *page, bool writable) {
+  ASSERT (vtop (page) % LPSIZE == 0);
+  return vtop (page) | PTE_PS | PTE_U | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a pointer to the page that page table entry PTE points
    to. */
 static inline void *pte_get_page (uint32_t pte) {
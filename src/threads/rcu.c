@@ -0,0 +1,316 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Read-copy update.
+
+   For data that is read far more often than it is written, such
+   as the list of all threads, RCU lets readers go without any
+   lock, atomic instruction or disabling of interrupts.  A reader
+   brackets its accesses with rcu_read_lock() and
+   rcu_read_unlock(), which only count nesting in the running
+   thread.  A writer, still excluding other writers with a lock
+   of its own, changes the data so that a concurrent reader sees
+   either the old version or the new one: it publishes new
+   objects with rcu_assign_pointer() or rcu_list_push_back(), and
+   unlinks old ones, which it may free only once every reader
+   that could have found them is done.  It waits for that with
+   synchronize_rcu(), or has call_rcu() free them later.
+
+   A read-side critical section may not sleep or yield, and the
+   running thread is not preempted in one: a preemption that
+   falls due is put off until rcu_read_unlock(), or for a reader
+   that ends with interrupts off, until the next timer tick.  So
+   a CPU that switches threads, or whose timer interrupts a
+   thread outside any critical section, has no reader left from
+   before.  Such a point is a quiescent state, counted in the
+   CPU's RCU_QS_CNT by schedule() and rcu_tick().  A grace period
+   ends once every CPU has passed one since it began, at which
+   point no reader from before it remains.  Code that runs with
+   interrupts off, and interrupt handlers, cannot be interrupted
+   by either, so they are implicitly readers too.
+
+   Callbacks queued by call_rcu() wait in WAIT_CBS for the next
+   grace period to begin, then in CUR_CBS for it to end, then in
+   DONE_CBS for the system workqueue to run them, so that they
+   may sleep, as free() may.  The timer tick advances them from
+   one list to the next, and keeps ticking while any are left. */
+
+/* Callback lists, and the current grace period.  Protected by
+   RCU_LOCK. */
+static struct spinlock rcu_lock;
+static struct list wait_cbs;    /* For the next grace period. */
+static struct list cur_cbs;     /* For the current grace period. */
+static struct list done_cbs;    /* Ready to run. */
+static bool gp_active;          /* Grace period in progress? */
+static bool gp_cpus[CPU_MAX];   /* CPUs running when it began. */
+static unsigned gp_qs[CPU_MAX]; /* Their RCU_QS_CNT when it began. */
+
+/* Runs the callbacks in DONE_CBS. */
+static struct work rcu_work;
+
+/* Statistics. */
+static long long gp_cnt;        /* # of grace periods ended. */
+static long long cb_cnt;        /* # of callbacks run. */
+
+static void advance (void);
+static bool gp_done (void);
+static work_func run_callbacks;
+
+/* Initializes RCU.  Must be called before any thread starts or
+   exits. */
+void
+rcu_init (void)
+{
+  spinlock_init (&rcu_lock);
+  list_init (&wait_cbs);
+  list_init (&cur_cbs);
+  list_init (&done_cbs);
+  gp_active = false;
+  work_init (&rcu_work, run_callbacks, NULL);
+}
+
+/* Begins a read-side critical section, which may nest.  Until
+   the matching rcu_read_unlock(), no object that an RCU writer
+   unlinks meanwhile is freed, and the running thread must not
+   sleep or yield. */
+void
+rcu_read_lock (void)
+{
+  thread_current ()->rcu_nesting++;
+  barrier ();
+}
+
+/* Ends a read-side critical section begun by rcu_read_lock().
+   At the end of the outermost one, yields the CPU if a
+   preemption was put off during it. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (t->rcu_nesting > 0);
+
+  barrier ();
+  if (--t->rcu_nesting == 0 && t->rcu_resched
+      && intr_get_level () == INTR_ON)
+    {
+      t->rcu_resched = false;
+      thread_preempt ();
+    }
+}
+
+/* Returns true if the caller is in a read-side critical section,
+   explicitly or by having interrupts off.  For assertions. */
+bool
+rcu_read_held (void)
+{
+  return (intr_get_level () == INTR_OFF
+          || thread_current ()->rcu_nesting > 0);
+}
+
+/* Arranges for FUNC to be called with HEAD, from the system
+   workqueue, once every read-side critical section in progress
+   has ended.  HEAD is usually embedded in an object that the
+   caller has unlinked and FUNC frees.  May be called from an
+   interrupt handler, or with interrupts off. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  ASSERT (head != NULL);
+  ASSERT (func != NULL);
+
+  head->func = func;
+  old_level = spinlock_acquire (&rcu_lock);
+  list_push_back (&wait_cbs, &head->elem);
+  spinlock_release (&rcu_lock, old_level);
+}
+
+/* Waiter in synchronize_rcu(). */
+struct rcu_sync
+  {
+    struct rcu_head head;               /* Queued by call_rcu(). */
+    struct semaphore done;              /* Upped by the callback. */
+  };
+
+/* call_rcu() callback for synchronize_rcu(). */
+static void
+sync_done (struct rcu_head *head)
+{
+  sema_up (&rcu_entry (head, struct rcu_sync, head)->done);
+}
+
+/* Waits until every read-side critical section in progress has
+   ended.  The caller may not be in one itself. */
+void
+synchronize_rcu (void)
+{
+  struct rcu_sync s;
+
+  ASSERT (!intr_context ());
+  ASSERT (!rcu_read_held ());
+
+  if (rcu_one_cpu ())
+    return;
+
+  sema_init (&s.done, 0);
+  call_rcu (&s.head, sync_done);
+  sema_down (&s.done);
+}
+
+/* Returns true if only one CPU runs threads.  Readers are never
+   preempted, so then none can be in progress while a thread runs
+   outside of one, with no interrupt handler active, and that
+   thread need not wait for a grace period. */
+bool
+rcu_one_cpu (void)
+{
+  int running = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].started)
+      running++;
+  return running <= 1;
+}
+
+/* Notes a quiescent state for the running CPU: it has no reader
+   left from before.  Called by schedule() on each thread switch,
+   with interrupts off. */
+void
+rcu_note_qs (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cpu_current ()->rcu_qs_cnt++;
+}
+
+/* Called by the timer interrupt handler at each timer tick.
+   Notes a quiescent state if the interrupted thread is not a
+   reader, and moves callbacks along toward running. */
+void
+rcu_tick (void)
+{
+  struct thread *t = thread_current ();
+
+  ASSERT (intr_context ());
+
+  if (t->rcu_nesting == 0)
+    {
+      rcu_note_qs ();
+
+      /* A reader that ended with interrupts off could not yield
+         then. */
+      if (t->rcu_resched)
+        {
+          t->rcu_resched = false;
+          intr_yield_on_return ();
+        }
+    }
+  if (rcu_pending ())
+    advance ();
+}
+
+/* Returns true if callbacks are waiting to be run.  Reads the
+   lists without RCU_LOCK, so the answer may be stale on another
+   CPU, but not on the one that queued them. */
+bool
+rcu_pending (void)
+{
+  return gp_active || !list_empty (&wait_cbs) || !list_empty (&done_cbs);
+}
+
+/* Ends the current grace period if it is over, begins the next
+   one if callbacks are waiting for it, and has the system
+   workqueue run the callbacks that are due.  Called from the
+   timer interrupt. */
+static void
+advance (void)
+{
+  enum intr_level old_level = spinlock_acquire (&rcu_lock);
+  bool run;
+
+  if (gp_active && gp_done ())
+    {
+      list_splice (list_end (&done_cbs),
+                   list_begin (&cur_cbs), list_end (&cur_cbs));
+      gp_active = false;
+      gp_cnt++;
+    }
+  if (!gp_active && !list_empty (&wait_cbs))
+    {
+      int i;
+
+      list_splice (list_end (&cur_cbs),
+                   list_begin (&wait_cbs), list_end (&wait_cbs));
+      for (i = 0; i < cpu_cnt; i++)
+        {
+          gp_cpus[i] = cpus[i].started;
+          gp_qs[i] = cpus[i].rcu_qs_cnt;
+        }
+      gp_active = true;
+    }
+  run = !list_empty (&done_cbs);
+  spinlock_release (&rcu_lock, old_level);
+
+  /* Does nothing if RCU_WORK is already queued, or the system
+     workqueue is not yet running, in which case a later tick
+     tries again. */
+  if (run)
+    work_queue (&system_wq, &rcu_work);
+}
+
+/* Returns true if every CPU that was running when the current
+   grace period began has passed a quiescent state since.  A CPU
+   started later had no readers then. */
+static bool
+gp_done (void)
+{
+  int i;
+
+  ASSERT (spinlock_held (&rcu_lock));
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (gp_cpus[i] && cpus[i].rcu_qs_cnt == gp_qs[i])
+      return false;
+  return true;
+}
+
+/* Runs the callbacks whose grace period has ended, as a work
+   item. */
+static void
+run_callbacks (void *aux UNUSED)
+{
+  enum intr_level old_level;
+  struct list cbs;
+
+  list_init (&cbs);
+  old_level = spinlock_acquire (&rcu_lock);
+  list_splice (list_end (&cbs),
+               list_begin (&done_cbs), list_end (&done_cbs));
+  spinlock_release (&rcu_lock, old_level);
+
+  while (!list_empty (&cbs))
+    {
+      struct rcu_head *head = list_entry (list_pop_front (&cbs),
+                                          struct rcu_head, elem);
+      head->func (head);
+      cb_cnt++;
+    }
+}
+
+/* Prints RCU statistics. */
+void
+rcu_print_stats (void)
+{
+  printf ("RCU: %lld grace periods, %lld callbacks run\n",
+          gp_cnt, cb_cnt);
+}
@@ -0,0 +1,82 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <atomic.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read-copy update.  See rcu.c. */
+
+struct rcu_head;
+
+/* Function called with the rcu_head of an object once no reader
+   can still see it, usually to free it. */
+typedef void rcu_func (struct rcu_head *);
+
+/* Embedded in an object to free it with call_rcu(). */
+struct rcu_head
+  {
+    struct list_elem elem;              /* Element in callback list. */
+    rcu_func *func;                     /* Function to call. */
+  };
+
+/* Converts pointer to rcu_head RCU_HEAD into a pointer to the
+   structure that RCU_HEAD is embedded inside, as MEMBER. */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER)                     \
+        ((STRUCT *) ((uint8_t *) (RCU_HEAD)                     \
+                     - offsetof (STRUCT, MEMBER)))
+
+void rcu_init (void);
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_held (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+void synchronize_rcu (void);
+bool rcu_one_cpu (void);
+void rcu_note_qs (void);
+void rcu_tick (void);
+bool rcu_pending (void);
+void rcu_print_stats (void);
+
+/* Returns pointer P, read once inside a read-side critical
+   section, as a void *.  The object it points to is seen as it
+   was when rcu_assign_pointer() published it: x86 does not
+   reorder dependent loads, so only the compiler needs to be kept
+   from reading P more than once. */
+#define rcu_dereference(P) (*(void *volatile *) &(P))
+
+/* Sets pointer P to V, after every store that initialized the
+   object V points to, so that readers never see it half-made. */
+#define rcu_assign_pointer(P, V)                        \
+        do { wmb (); (P) = (V); } while (0)
+
+/* Adds ELEM, fully initialized, to the end of LIST, such that a
+   reader walking LIST forward with list_next() inside a
+   read-side critical section either sees it whole or not at
+   all.  Writers must still exclude each other. */
+static inline void
+rcu_list_push_back (struct list *list, struct list_elem *elem)
+{
+  struct list_elem *tail = list_end (list);
+
+  elem->prev = tail->prev;
+  elem->next = tail;
+  wmb ();
+  tail->prev->next = elem;
+  tail->prev = elem;
+}
+
+/* Removes ELEM from its list.  ELEM keeps pointing to the
+   elements that followed it, so a reader standing on ELEM can
+   still walk on; ELEM may not be freed or reused until a grace
+   period has passed, as by call_rcu().  Writers must still
+   exclude each other. */
+static inline void
+rcu_list_remove (struct list_elem *elem)
+{
+  list_remove (elem);
+}
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,186 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A typed object cache.
+
+   Each cache hands out objects of a single size, carved out of
+   pages called "slabs" obtained from the page allocator.  Unlike
+   malloc(), there is no rounding to a power of 2, so a slab packs
+   as many objects as fit.
+
+   An object is initialized by the cache's constructor only once,
+   when its slab is created; it must be returned to slab_free() in
+   its constructed state, e.g. with any embedded lock released,
+   and keeps that state until it is allocated again.  For this
+   reason the free list link of each object is kept right after
+   the object instead of inside it.
+
+   The free lists are manipulated with interrupts turned off,
+   which is cheaper than a lock on a uniprocessor and lets at most
+   one allocation sleep, in the page allocator, when a cache runs
+   dry.  An empty slab is given back to the page allocator as long
+   as the cache keeps at least another slab's worth of free
+   objects. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Header at the beginning of each slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    size_t used_cnt;            /* Number of allocated objects. */
+  };
+
+static bool slab_grow (struct slab_cache *);
+static struct slab *obj_to_slab (void *);
+static void *slab_obj (struct slab_cache *, struct slab *, size_t idx);
+
+/* Returns the free list link of OBJ in cache C. */
+static inline struct list_elem *
+obj_to_elem (struct slab_cache *c, void *obj)
+{
+  return (struct list_elem *) ((uint8_t *) obj + c->obj_size);
+}
+
+/* Returns the object whose free list link is E in cache C. */
+static inline void *
+elem_to_obj (struct slab_cache *c, struct list_elem *e)
+{
+  return (uint8_t *) e - c->obj_size;
+}
+
+/* Initializes C as a cache of OBJ_SIZE-byte objects named NAME.
+   If CTOR is nonnull, it is called on each new object. */
+void
+slab_cache_init (struct slab_cache *c, const char *name,
+                 size_t obj_size, slab_ctor_func *ctor)
+{
+  ASSERT (c != NULL);
+  ASSERT (obj_size > 0);
+
+  c->name = name;
+  c->obj_size = ROUND_UP (obj_size, sizeof (void *));
+  c->slot_size = c->obj_size + sizeof (struct list_elem);
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / c->slot_size;
+  c->ctor = ctor;
+  list_init (&c->free_list);
+  c->free_cnt = 0;
+
+  ASSERT (c->objs_per_slab > 0);
+}
+
+/* Obtains and returns an object from cache C.
+   Returns a null pointer if memory is not available. */
+void *
+slab_alloc (struct slab_cache *c)
+{
+  enum intr_level old_level;
+  void *obj;
+
+  old_level = intr_disable ();
+  while (list_empty (&c->free_list))
+    {
+      intr_set_level (old_level);
+      if (!slab_grow (c))
+        return NULL;
+      old_level = intr_disable ();
+    }
+
+  obj = elem_to_obj (c, list_pop_front (&c->free_list));
+  c->free_cnt--;
+  obj_to_slab (obj)->used_cnt++;
+  intr_set_level (old_level);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C and
+   be in its constructed state, to C.  A null pointer is
+   ignored. */
+void
+slab_free (struct slab_cache *c, void *obj)
+{
+  enum intr_level old_level;
+  struct slab *s;
+  size_t i;
+
+  if (obj == NULL)
+    return;
+
+  s = obj_to_slab (obj);
+  ASSERT (s->cache == c);
+
+  old_level = intr_disable ();
+  list_push_front (&c->free_list, obj_to_elem (c, obj));
+  c->free_cnt++;
+  if (--s->used_cnt > 0 || c->free_cnt < 2 * c->objs_per_slab)
+    {
+      intr_set_level (old_level);
+      return;
+    }
+
+  /* Every object of S is free: give S back. */
+  for (i = 0; i < c->objs_per_slab; i++)
+    list_remove (obj_to_elem (c, slab_obj (c, s, i)));
+  c->free_cnt -= c->objs_per_slab;
+  intr_set_level (old_level);
+
+  s->magic = 0;
+  palloc_free_page (s);
+}
+
+/* Adds a new slab of constructed objects to C.  Returns false
+   if memory is not available. */
+static bool
+slab_grow (struct slab_cache *c)
+{
+  enum intr_level old_level;
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return false;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->used_cnt = 0;
+  if (c->ctor != NULL)
+    for (i = 0; i < c->objs_per_slab; i++)
+      c->ctor (slab_obj (c, s, i));
+
+  old_level = intr_disable ();
+  for (i = 0; i < c->objs_per_slab; i++)
+    list_push_back (&c->free_list, obj_to_elem (c, slab_obj (c, s, i)));
+  c->free_cnt += c->objs_per_slab;
+  intr_set_level (old_level);
+
+  return true;
+}
+
+/* Returns the slab that OBJ is in. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s != NULL);
+  ASSERT (s->magic == SLAB_MAGIC);
+
+  return s;
+}
+
+/* Returns the IDX'th object of slab S in cache C. */
+static void *
+slab_obj (struct slab_cache *c, struct slab *s, size_t idx)
+{
+  ASSERT (idx < c->objs_per_slab);
+  return (uint8_t *) (s + 1) + idx * c->slot_size;
+}
@@ -0,0 +1,27 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+
+/* Initializes a newly created object of a slab cache. */
+typedef void slab_ctor_func (void *obj);
+
+/* An object cache.  See slab.c. */
+struct slab_cache
+  {
+    const char *name;           /* Name, for debugging. */
+    size_t obj_size;            /* Size of an object, rounded up. */
+    size_t slot_size;           /* Size of an object and its link. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    slab_ctor_func *ctor;       /* Constructor, or null. */
+    struct list free_list;      /* Free objects. */
+    size_t free_cnt;            /* Number of free objects. */
+  };
+
+void slab_cache_init (struct slab_cache *, const char *name,
+                      size_t obj_size, slab_ctor_func *);
+void *slab_alloc (struct slab_cache *);
+void slab_free (struct slab_cache *, void *);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,65 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* A spinlock, for mutual exclusion in code that cannot sleep,
+   such as interrupt handlers and the scheduler, between CPUs as
+   well as against interrupts on the same CPU.  Holding one keeps
+   interrupts off, so it must be held only briefly, and never
+   while acquiring a lock or semaphore.  On a uniprocessor it
+   costs one atomic exchange more than intr_disable(). */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if not. */
+  };
+
+/* Initializes spinlock L, unheld. */
+static inline void
+spinlock_init (struct spinlock *l)
+{
+  l->locked = 0;
+}
+
+/* Disables interrupts and acquires spinlock L, waiting for
+   another CPU to release it if necessary.  Returns the previous
+   interrupt level, to pass to spinlock_release(). */
+static inline enum intr_level
+spinlock_acquire (struct spinlock *l)
+{
+  enum intr_level old_level = intr_disable ();
+  uint32_t v;
+
+  do
+    {
+      v = 1;
+      asm volatile ("xchgl %0, %1" : "+r" (v), "+m" (l->locked)
+                    : : "memory");
+    }
+  while (v != 0);
+  return old_level;
+}
+
+/* Releases spinlock L, which the current CPU must hold, and
+   restores interrupts to OLD_LEVEL. */
+static inline void
+spinlock_release (struct spinlock *l, enum intr_level old_level)
+{
+  ASSERT (l->locked);
+
+  asm volatile ("" : : : "memory");
+  l->locked = 0;
+  intr_set_level (old_level);
+}
+
+/* Returns true if some CPU holds spinlock L. */
+static inline bool
+spinlock_held (const struct spinlock *l)
+{
+  return l->locked != 0;
+}
+
+#endif /* threads/spinlock.h */
@@ -31,6 +31,111 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
+
+/* The semaphores and locks that synch.c itself initializes are
+   parts of other primitives, and are not profiled on their own. */
+#undef sema_init
+#undef lock_init
+
+#ifdef LOCK_PROFILE
+/* Lock profile.
+
+   Statistics for a class of semaphores and locks: those
+   initialized with the same name.  For a semaphore, an
+   acquisition is a "down", and it is contended if it has to
+   wait.  A lock also counts the time it is held and how deep a
+   chain of priority donations acquiring it has caused.  Classes
+   outlive their members, so a lock may be freed without any
+   clean-up.  Times are in nanoseconds, from clock_ns(). */
+struct lock_class
+  {
+    const char *name;           /* Name at initialization. */
+    unsigned long long acquired; /* # of acquisitions. */
+    unsigned long long contended; /* # that had to wait. */
+    unsigned long long spun;    /* # that spun on a lock, not slept. */
+    unsigned long long yielded; /* # that yielded for a lock. */
+    int64_t wait_ns;            /* Total time waited. */
+    int64_t max_wait_ns;        /* Longest wait. */
+    int64_t hold_ns;            /* Total time locks were held. */
+    int max_depth;              /* Longest donation chain. */
+  };
+
+/* Classes, in order of first initialization.  Members of
+   classes beyond LOCK_CLASS_MAX go unprofiled.  Protected by
+   disabling interrupts. */
+#define LOCK_CLASS_MAX 128
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static int lock_class_cnt;
+
+static struct lock_class *lock_class_find (const char *);
+static void profile_acquire (struct lock_class *, int64_t start,
+                             bool contended, int depth);
+static void profile_lock (struct lock *, int64_t start,
+                          bool contended, int depth);
+static void profile_release (struct lock *);
+static void profile_print (void);
+#define profile_now() clock_ns ()
+#else
+#define profile_now() 0
+#define profile_acquire(CLASS, START, CONTENDED, DEPTH) \
+        ((void) (START), (void) (CONTENDED), (void) (DEPTH))
+#define profile_lock(LOCK, START, CONTENDED, DEPTH) \
+        ((void) (START), (void) (CONTENDED), (void) (DEPTH))
+#define profile_release(LOCK) ((void) 0)
+#define profile_print() ((void) 0)
+#endif
+
+/* Waiters.  Each semaphore and condition variable keeps its
+   waiters in a heap, highest priority first and, among equal
+   priorities, in order of arrival, so that waking one takes
+   O(log n) time rather than a scan of every waiter.  A waiting
+   thread whose priority changes, as by donation, is moved to its
+   new place by synch_requeue().  The heaps are protected by
+   disabling interrupts. */
+static unsigned wait_seq;       /* Next arrival number. */
+
+/* One waiter on a condition variable. */
+struct semaphore_elem 
+  {
+    struct heap_elem elem;              /* Element in COND's waiters. */
+    struct semaphore semaphore;         /* This semaphore. */
+    struct condition *cond;             /* Condition waited on. */
+    struct thread *thread;              /* Waiting thread. */
+    unsigned seq;                       /* Arrival order. */
+  };
+
+static heap_less_func waiter_less;
+static heap_less_func cond_waiter_less;
+static void sema_push (struct semaphore *, struct thread *);
+static void sema_catch_up (struct semaphore *);
+static int sema_top_priority (struct semaphore *);
+static int cond_top_priority (struct condition *);
+
+/* Declared signallers.  A thread that waits on a lock donates
+   its priority to the lock's holder, but a semaphore or
+   condition variable has no holder, so that a high-priority
+   thread waiting for a low-priority one to up a semaphore or
+   signal a condition would wait behind every thread of middle
+   priority.  When the thread that will do so is known, as for a
+   daemon that serves requests, sema_set_signaller() or
+   cond_set_signaller() declares it, and then waiters donate
+   their priority to it just as they would to the holder of a
+   lock: the struct signaller caches the priority of the highest
+   waiter and sits in the signaller's SIGNALLED list, which
+   thread_effective_priority() scans along with its held locks,
+   and donation follows on through the lock or declared
+   signaller that the signaller itself waits on.  A semaphore or
+   condition variable whose signaller is declared must have it
+   cleared before it is freed, unless the signaller has
+   exited. */
+static void signaller_init (struct signaller *);
+static void signaller_set (struct signaller *, struct thread *,
+                           int priority);
+static int signaller_donate (struct signaller *, int priority);
+static void signaller_update (struct signaller *, int priority);
+static int lock_donate (struct lock *, int priority);
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -47,8 +152,23 @@ sema_init (struct semaphore *sema, unsigned value)
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
+  signaller_init (&sema->signaller);
+#ifdef LOCK_PROFILE
+  sema->class = NULL;
+#endif
+}
+
+#ifdef LOCK_PROFILE
+/* Initializes semaphore SEMA to VALUE, and profiles it under
+   NAME. */
+void
+sema_init_named (struct semaphore *sema, unsigned value, const char *name)
+{
+  sema_init (sema, value);
+  sema->class = lock_class_find (name);
 }
+#endif
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
    to become positive and then atomically decrements it.
@@ -61,17 +181,27 @@ void
 sema_down (struct semaphore *sema) 
 {
   enum intr_level old_level;
+  int64_t start = profile_now ();
+  bool contended;
+  int depth = 0;
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  contended = sema->value == 0;
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
+      struct thread *cur = thread_current ();
+      int boosted = signaller_donate (&sema->signaller, cur->priority);
+
+      if (boosted > depth)
+        depth = boosted;
+      sema_push (sema, cur);
       thread_block ();
     }
   sema->value--;
+  profile_acquire (sema->class, start, contended, depth);
   intr_set_level (old_level);
 }
 
@@ -107,6 +237,15 @@ sema_try_down (struct semaphore *sema)
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
+{
+  sema_up_boost (sema, 0);
+}
+
+/* Ups SEMA as sema_up() does, raising the priority of the thread
+   woken, if any, by BOOST levels with thread_boost().  For
+   waking a thread whose I/O has completed. */
+void
+sema_up_boost (struct semaphore *sema, int boost)
 {
   enum intr_level old_level;
 
@@ -120,20 +259,217 @@ sema_up (struct semaphore *sema)
      before the yield. */
   sema->value++;
 
-  if (!list_empty (&sema->waiters))
+  if (!heap_empty (&sema->waiters))
     {
+      struct thread *t;
+
+      /* A scheduling class such as the advanced scheduler may
+         bring a blocked thread's priority up to date only when
+         it is needed. */
+      if (sched_class->wake != NULL)
+        sema_catch_up (sema);
+
       /* When there are threads waiting for a lock, semaphore,
          or condition variables, the highest priority thread
          should be awakened first.*/
-      struct thread *t
-        = list_entry (list_max(&sema->waiters, thread_priority_less, NULL),
-                      struct thread, elem);
-      list_remove (&t->elem);
+      t = heap_entry (heap_pop (&sema->waiters), struct thread, wait_elem);
+      t->wait_sema = NULL;
+      signaller_update (&sema->signaller, sema_top_priority (sema));
+      if (boost > 0)
+        thread_boost (t, boost);
       thread_unblock (t);
     }
   intr_set_level (old_level);
 }
 
+/* Declares T, which may be null, as the thread that will up
+   SEMA, in place of any declared before.  Threads waiting on
+   SEMA then donate their priority to T.  Does nothing else under
+   a scheduling class that disables priority donation. */
+void
+sema_set_signaller (struct semaphore *sema, struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (sema != NULL);
+
+  old_level = intr_disable ();
+  signaller_set (&sema->signaller, t, sema_top_priority (sema));
+  intr_set_level (old_level);
+}
+
+/* Adds T, which is about to block, to the waiters of SEMA. */
+static void
+sema_push (struct semaphore *sema, struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->wait_sema = sema;
+  t->wait_seq = wait_seq++;
+  heap_push (&sema->waiters, &t->wait_elem);
+}
+
+/* Brings the priority of each thread waiting on SEMA up to date,
+   for a scheduling class with a `wake' hook.  The waiters are moved to a
+   scratch heap while their priorities change, so that
+   synch_requeue() leaves them alone, and then back. */
+static void
+sema_catch_up (struct semaphore *sema)
+{
+  struct heap caught;
+
+  heap_init (&caught, waiter_less, NULL);
+  while (!heap_empty (&sema->waiters))
+    {
+      struct thread *t = heap_entry (heap_pop (&sema->waiters),
+                                     struct thread, wait_elem);
+      t->wait_sema = NULL;
+      heap_push (&caught, &t->wait_elem);
+    }
+  while (!heap_empty (&caught))
+    {
+      struct thread *t = heap_entry (heap_pop (&caught),
+                                     struct thread, wait_elem);
+      sched_class->wake (t);
+      t->wait_sema = sema;
+      heap_push (&sema->waiters, &t->wait_elem);
+    }
+}
+
+/* Moves T, whose priority has just changed, to its new place
+   among the waiters of the semaphore and the condition variable
+   it waits on, if any.  Called by thread_change_priority() with
+   interrupts off. */
+void
+synch_requeue (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->wait_sema != NULL)
+    {
+      heap_update (&t->wait_sema->waiters, &t->wait_elem);
+      signaller_donate (&t->wait_sema->signaller, t->priority);
+    }
+  if (t->wait_cond != NULL)
+    {
+      struct condition *cond = t->wait_cond->cond;
+
+      heap_update (&cond->waiters, &t->wait_cond->elem);
+      signaller_donate (&cond->signaller, t->priority);
+    }
+}
+
+/* Forgets T as the declared signaller of every semaphore and
+   condition variable, as T exits.  Called by thread_exit() with
+   interrupts off. */
+void
+synch_exit (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&t->signalled))
+    signaller_init (list_entry (list_pop_front (&t->signalled),
+                                struct signaller, elem));
+}
+
+/* Initializes S with no signaller declared. */
+static void
+signaller_init (struct signaller *s)
+{
+  s->thread = NULL;
+  s->priority = PRI_MIN;
+}
+
+/* Makes T, which may be null, the signaller of S, in place of
+   the one before, which gives up what was donated to it through
+   S.  PRIORITY is that of the highest thread now waiting, or
+   PRI_MIN, which is donated to T. */
+static void
+signaller_set (struct signaller *s, struct thread *t, int priority)
+{
+  struct thread *old = s->thread;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (old != NULL)
+    {
+      list_remove (&s->elem);
+      signaller_init (s);
+      if (sched_class->donation)
+        thread_change_priority (old, thread_effective_priority (old));
+    }
+  if (t != NULL)
+    {
+      s->thread = t;
+      list_push_back (&t->signalled, &s->elem);
+      signaller_donate (s, priority);
+    }
+}
+
+/* Donates PRIORITY, that of a thread about to wait or already
+   waiting, to the signaller of S, if one is declared, and on
+   from there as lock_donate() does.  Returns the number of
+   threads whose priority was raised. */
+static int
+signaller_donate (struct signaller *s, int priority)
+{
+  struct thread *t = s->thread;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!sched_class->donation || t == NULL || s->priority >= priority)
+    return 0;
+  s->priority = priority;
+  if (t->priority >= priority)
+    return 0;
+  thread_change_priority (t, priority);
+  return 1 + lock_donate (t->wait_on, priority);
+}
+
+/* Sets the priority that S donates to PRIORITY, that of the
+   highest thread still waiting, or PRI_MIN, after a waiter was
+   woken, and brings its signaller's priority up to date. */
+static void
+signaller_update (struct signaller *s, int priority)
+{
+  struct thread *t = s->thread;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t == NULL)
+    return;
+  s->priority = priority;
+  if (sched_class->donation)
+    thread_change_priority (t, thread_effective_priority (t));
+}
+
+/* Returns the priority of the highest thread waiting on SEMA, or
+   PRI_MIN if there is none. */
+static int
+sema_top_priority (struct semaphore *sema)
+{
+  struct heap_elem *top = heap_top (&sema->waiters);
+
+  return (top != NULL
+          ? heap_entry (top, struct thread, wait_elem)->priority
+          : PRI_MIN);
+}
+
+/* Returns true if thread A, waiting on a semaphore, has lower
+   priority than thread B, or arrived after it at equal
+   priority. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, wait_elem);
+  const struct thread *b = heap_entry (b_, struct thread, wait_elem);
+
+  if (a->priority != b->priority)
+    return a->priority < b->priority;
+  return (int) (a->wait_seq - b->wait_seq) > 0;
+}
+
 static void sema_test_helper (void *sema_);
 
 /* Self-test for semaphores that makes control "ping-pong"
@@ -193,7 +529,42 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->priority = PRI_MIN;
+#ifdef LOCK_PROFILE
+  lock->class = NULL;
+#endif
+}
+
+#ifdef LOCK_PROFILE
+/* Initializes LOCK, and profiles it under NAME. */
+void
+lock_init_named (struct lock *lock, const char *name)
+{
+  lock_init (lock);
+  lock->class = lock_class_find (name);
 }
+#endif
+
+/* Adaptive locking.  Before sleeping on a lock that is held,
+   lock_acquire() waits up to LOCK_ADAPT_ROUNDS times for the
+   holder to release it: by spinning for LOCK_SPIN_LOOPS loops if
+   the holder is running on another CPU, or by yielding to the
+   holder if it is ready to run on this one.  Either is cheaper
+   than blocking, for a lock held only briefly.  LOCK_STATS counts
+   how each acquisition went. */
+#define LOCK_ADAPT_ROUNDS 4
+#define LOCK_SPIN_LOOPS 1000
+static struct
+  {
+    unsigned long long free;    /* Lock was free. */
+    unsigned long long spun;    /* Acquired after spinning. */
+    unsigned long long yielded; /* Acquired after yielding. */
+    unsigned long long blocked; /* Slept. */
+  }
+lock_stats;
+
+static bool lock_adapt (struct lock *);
+static void lock_take (struct lock *);
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
@@ -210,47 +581,277 @@ lock_acquire (struct lock *lock)
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  static size_t nested_depth = 8;
-
   struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int64_t start = profile_now ();
+  int depth = 0;
+
+  if (sema_try_down (&lock->semaphore))
+    {
+      lock_take (lock);
+      lock_stats.free++;
+      profile_lock (lock, start, false, 0);
+      return;
+    }
+  TRACE (TRACE_LOCK, TRACE_LOCK_CONTEND, lock,
+         lock->holder != NULL ? lock->holder->tid : TID_ERROR);
+  if (lock_adapt (lock))
+    {
+      lock_take (lock);
+      profile_lock (lock, start, true, 0);
+      TRACE (TRACE_LOCK, TRACE_LOCK_ACQUIRE, lock,
+             (profile_now () - start) / 1000);
+      return;
+    }
+  lock_stats.blocked++;
+
+  /* Sleeps on the lock's semaphore as sema_down() would, but
+     donates our priority each time before sleeping: a thread
+     woken by lock_release() may find the lock taken by another
+     thread, which knows nothing of it, before it gets to run. */
+  old_level = intr_disable ();
   cur->wait_on = lock;
+  while (lock->semaphore.value == 0)
+    {
+      /* Some scheduling classes disable priority donation. */
+      if (sched_class->donation)
+        {
+          int boosted = lock_donate (lock, cur->priority);
+          if (boosted > depth)
+            depth = boosted;
+        }
+      sema_push (&lock->semaphore, cur);
+      thread_block ();
+    }
+  lock->semaphore.value--;
+  cur->wait_on = NULL;
+  lock_take (lock);
+  intr_set_level (old_level);
+
+  profile_lock (lock, start, true, depth);
+  TRACE (TRACE_LOCK, TRACE_LOCK_ACQUIRE, lock,
+         (profile_now () - start) / 1000);
+}
+
+/* Donates PRIORITY to the holder of LOCK, which the current
+   thread is about to wait on, and on down the chain of locks
+   that holder and the holders after it wait on.  Returns the
+   number of threads whose priority was raised.
+
+   A lock's priority is the highest priority of a thread waiting
+   on it, and a holder's priority is at least that of each lock
+   it holds, so the walk stops at the first lock that already has
+   PRIORITY: everything past it has been raised already.  This
+   bounds the walk without limiting the depth of nesting. */
+static int
+lock_donate (struct lock *lock, int priority)
+{
+  int depth = 0;
 
-  /* When `lock' has a holder who has a lower priority
-     than current thread, this thread will surely be blocked.
-     Thus, it must donate its priority before blocked. */
-  /* The advanced scheduler disables priority donation. */
-  struct thread *t = lock->holder;
-  if (!thread_mlfqs &&
-      t != NULL &&
-      t->priority < thread_get_priority ())
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (lock != NULL && lock->priority < priority)
     {
-      if (list_empty (&t->donor_list))
+      struct thread *holder = lock->holder;
+
+      lock->priority = priority;
+      if (holder == NULL || holder->priority >= priority)
+        break;
+      thread_change_priority (holder, priority);
+      depth++;
+      lock = holder->wait_on;
+    }
+  return depth;
+}
+
+/* Makes the current thread the holder of LOCK, whose semaphore
+   it has just downed.  Recomputes the lock's priority from the
+   threads still waiting on it, which donate it to the new
+   holder. */
+static void
+lock_take (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+
+  lock->priority = sema_top_priority (&lock->semaphore);
+  if (sched_class->donation && lock->priority > cur->priority)
+    cur->priority = lock->priority;
+  intr_set_level (old_level);
+}
+
+/* Waits for the holder of LOCK, which was found held, to release
+   it, without sleeping, as described above lock_acquire().
+   Returns true if LOCK was acquired, false if the caller should
+   sleep on it. */
+static bool
+lock_adapt (struct lock *lock)
+{
+  int round;
+
+  for (round = 0; round < LOCK_ADAPT_ROUNDS; round++)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct thread *holder = lock->holder;
+      bool spin = holder != NULL && holder->status == THREAD_RUNNING;
+      bool yielded = !spin && holder != NULL && thread_yield_to (holder);
+      intr_set_level (old_level);
+
+      if (spin)
         {
-          /* If donor list is empty, the thread has never
-             received a donation, or all donations were withdrawn.
-             Therefore, it is needed to backup its own priority. */
-          t->original_priority = t->priority;
+          /* Only compares HOLDER, which may exit meanwhile. */
+          int i;
+          for (i = 0; i < LOCK_SPIN_LOOPS && lock->holder == holder; i++)
+            asm volatile ("pause" : : : "memory");
         }
-      t->priority = cur->priority;
-      /* Remember the current thread as a donor */      
-      list_push_back (&t->donor_list, &cur->donor_list_elem);
+      else if (!yielded)
+        return false;
 
-      /* Nested donation */
-      size_t i = 0;
-      while (t->wait_on != NULL && i < nested_depth)
+      if (sema_try_down (&lock->semaphore))
         {
-          t = t->wait_on->holder;
-          t->priority = cur->priority;
-          i++;
+          if (spin)
+            lock_stats.spun++;
+          else
+            lock_stats.yielded++;
+#ifdef LOCK_PROFILE
+          if (lock->class != NULL)
+            {
+              if (spin)
+                lock->class->spun++;
+              else
+                lock->class->yielded++;
+            }
+#endif
+          return true;
         }
     }
+  return false;
+}
 
-  sema_down (&lock->semaphore);
-  cur->wait_on = NULL;
+/* Prints lock statistics. */
+void
+lock_print_stats (void)
+{
+  printf ("Locks: %llu free, %llu after spinning, %llu after yielding, "
+          "%llu blocked\n",
+          lock_stats.free, lock_stats.spun, lock_stats.yielded,
+          lock_stats.blocked);
+  profile_print ();
+}
+
+#ifdef LOCK_PROFILE
+/* Returns the class named NAME, creating it if necessary, or a
+   null pointer if there are too many classes. */
+static struct lock_class *
+lock_class_find (const char *name)
+{
+  struct lock_class *class = NULL;
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  for (i = 0; i < lock_class_cnt; i++)
+    if (!strcmp (lock_classes[i].name, name))
+      {
+        class = &lock_classes[i];
+        break;
+      }
+  if (class == NULL && lock_class_cnt < LOCK_CLASS_MAX)
+    {
+      class = &lock_classes[lock_class_cnt++];
+      class->name = name;
+    }
+  intr_set_level (old_level);
+  return class;
+}
+
+/* Counts an acquisition in CLASS, if it is not null, that began
+   at START and had to wait if CONTENDED is true, and that
+   donated through DEPTH threads. */
+static void
+profile_acquire (struct lock_class *class, int64_t start, bool contended,
+                 int depth)
+{
+  enum intr_level old_level;
+  int64_t now;
 
-  lock->holder = thread_current ();
+  if (class == NULL)
+    return;
+
+  now = clock_ns ();
+  old_level = intr_disable ();
+  class->acquired++;
+  if (contended)
+    {
+      int64_t wait = now - start;
+      class->contended++;
+      class->wait_ns += wait;
+      if (wait > class->max_wait_ns)
+        class->max_wait_ns = wait;
+    }
+  if (depth > class->max_depth)
+    class->max_depth = depth;
+  intr_set_level (old_level);
+}
+
+/* Counts the acquisition of LOCK as by profile_acquire(), and
+   starts timing how long it is held. */
+static void
+profile_lock (struct lock *lock, int64_t start, bool contended, int depth)
+{
+  if (lock->class != NULL)
+    {
+      profile_acquire (lock->class, start, contended, depth);
+      lock->acquired = clock_ns ();
+    }
+}
+
+/* Adds the time LOCK has been held to its class.  Called just
+   before it is released. */
+static void
+profile_release (struct lock *lock)
+{
+  if (lock->class != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      lock->class->hold_ns += clock_ns () - lock->acquired;
+      intr_set_level (old_level);
+    }
 }
 
+/* Prints the statistics of each class that was ever acquired,
+   most contended first. */
+static void
+profile_print (void)
+{
+  struct lock_class *sorted[LOCK_CLASS_MAX];
+  int cnt = 0;
+  int i, j;
+
+  for (i = 0; i < lock_class_cnt; i++)
+    if (lock_classes[i].acquired > 0)
+      {
+        struct lock_class *c = &lock_classes[i];
+        for (j = cnt++; j > 0 && sorted[j - 1]->contended < c->contended; j--)
+          sorted[j] = sorted[j - 1];
+        sorted[j] = c;
+      }
+
+  printf ("Lock profile: acquired, contended, spun, yielded, "
+          "wait ns (max), held ns, donation depth\n");
+  for (i = 0; i < cnt; i++)
+    {
+      struct lock_class *c = sorted[i];
+      printf ("  %s: %llu, %llu, %llu, %llu, %lld (%lld), %lld, %d\n",
+              c->name, c->acquired, c->contended, c->spun, c->yielded,
+              c->wait_ns, c->max_wait_ns, c->hold_ns, c->max_depth);
+    }
+}
+#endif
+
 /* Tries to acquires LOCK and returns true if successful or false
    on failure.  The lock must not already be held by the current
    thread.
@@ -267,7 +868,10 @@ lock_try_acquire (struct lock *lock)
 
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock_take (lock);
+      profile_lock (lock, 0, false, 0);
+    }
   return success;
 }
 
@@ -283,48 +887,20 @@ lock_release (struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
 
   struct thread *cur = thread_current ();
-  struct list *list = &cur->donor_list;
+  enum intr_level old_level;
 
-  /* If there are donors */
-  /* The advanced scheduler disables priority donation. */
-  if (!thread_mlfqs && !list_empty (list))
-    {
-      struct list_elem *max = list_begin (list);
-      struct list_elem *e;
-      for (e = max; e != list_end (list);
-           /**/)
-        {
-          struct thread *donor
-            = list_entry (e, struct thread, donor_list_elem);
-          /* Finds all donor threads wating for this lock
-             and removes all of them. */
-          if (donor->wait_on == lock)
-            e = list_remove (e);
-          else
-            {
-              /* Finds max prioirty donor thread except for those
-                 who were wating for this lock. */
-              struct thread *max_t
-                = list_entry (max, struct thread, donor_list_elem);
-              if (donor->priority > max_t->priority)
-                max = e;
-              e = list_next (e);
-            }
-        }
-      /* If there are no more donors related to this lock,
-         reset priority. */
-      if (list_empty (list))
-        cur->priority = cur->original_priority;
-      else
-        {
-          struct thread *t
-            = list_entry (max, struct thread,
-                          donor_list_elem);
-          cur->priority = t->priority;
-        }
-    }
+  profile_release (lock);
 
+  /* Gives up what was donated through LOCK.  What was donated
+     through the other locks we hold is cached in each of them. */
+  /* Some scheduling classes disable priority donation. */
+  old_level = intr_disable ();
+  list_remove (&lock->elem);
+  if (sched_class->donation)
+    thread_change_priority (cur, thread_effective_priority (cur));
   lock->holder = NULL;
+  intr_set_level (old_level);
+
   sema_up (&lock->semaphore);
 }
 
@@ -339,12 +915,7 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem 
-  {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
-  };
+static void cond_catch_up (struct condition *);
 
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
@@ -354,7 +925,34 @@ cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
+  signaller_init (&cond->signaller);
+}
+
+/* Declares T, which may be null, as the thread that will signal
+   COND, as sema_set_signaller() does for a semaphore. */
+void
+cond_set_signaller (struct condition *cond, struct thread *t)
+{
+  enum intr_level old_level;
+
+  ASSERT (cond != NULL);
+
+  old_level = intr_disable ();
+  signaller_set (&cond->signaller, t, cond_top_priority (cond));
+  intr_set_level (old_level);
+}
+
+/* Returns the priority of the highest thread waiting on COND, or
+   PRI_MIN if there is none. */
+static int
+cond_top_priority (struct condition *cond)
+{
+  struct heap_elem *top = heap_top (&cond->waiters);
+
+  return (top != NULL
+          ? heap_entry (top, struct semaphore_elem, elem)->thread->priority
+          : PRI_MIN);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -381,6 +979,7 @@ void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
   struct semaphore_elem waiter;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
@@ -388,7 +987,14 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
+  waiter.cond = cond;
+  waiter.thread = thread_current ();
+  old_level = intr_disable ();
+  waiter.seq = wait_seq++;
+  waiter.thread->wait_cond = &waiter;
+  heap_push (&cond->waiters, &waiter.elem);
+  signaller_donate (&cond->signaller, waiter.thread->priority);
+  intr_set_level (old_level);
   lock_release (lock);
   sema_down (&waiter.semaphore);
   lock_acquire (lock);
@@ -409,19 +1015,56 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters))
+  if (!heap_empty (&cond->waiters))
     {
+      struct semaphore_elem *sema_elem;
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+
+      /* A scheduling class may bring a blocked thread's
+         priority up to date only when it is needed. */
+      if (sched_class->wake != NULL)
+        cond_catch_up (cond);
+
       /* When there are threads waiting for a lock, semaphore,
          or condition variables, the highest priority thread
          should be awakened first.*/
-      struct semaphore_elem *sema_elem
-        = list_entry (list_max(&cond->waiters, semaphore_elem_less, NULL),
-                      struct semaphore_elem, elem);
-      list_remove (&sema_elem->elem);
+      sema_elem = heap_entry (heap_pop (&cond->waiters),
+                              struct semaphore_elem, elem);
+      sema_elem->thread->wait_cond = NULL;
+      signaller_update (&cond->signaller, cond_top_priority (cond));
+      intr_set_level (old_level);
       sema_up (&sema_elem->semaphore);
     }
 }
 
+/* Brings the priority of each thread waiting on COND up to date,
+   for the scheduling class, as sema_catch_up() does for a
+   semaphore. */
+static void
+cond_catch_up (struct condition *cond)
+{
+  struct heap caught;
+
+  heap_init (&caught, cond_waiter_less, NULL);
+  while (!heap_empty (&cond->waiters))
+    {
+      struct semaphore_elem *w = heap_entry (heap_pop (&cond->waiters),
+                                             struct semaphore_elem, elem);
+      w->thread->wait_cond = NULL;
+      heap_push (&caught, &w->elem);
+    }
+  while (!heap_empty (&caught))
+    {
+      struct semaphore_elem *w = heap_entry (heap_pop (&caught),
+                                             struct semaphore_elem, elem);
+      sched_class->wake (w->thread);
+      w->thread->wait_cond = w;
+      heap_push (&cond->waiters, &w->elem);
+    }
+}
+
 /* Wakes up all threads, if any, waiting on COND (protected by
    LOCK).  LOCK must be held before calling this function.
 
@@ -434,29 +1077,235 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
 
-  while (!list_empty (&cond->waiters))
+  while (!heap_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
 
+/* Moves all the threads waiting on FROM (protected by LOCK) to
+   wait on TO, also protected by LOCK, without waking them.  LOCK
+   must be held before calling this function. */
+void
+cond_requeue (struct condition *from, struct condition *to,
+              struct lock *lock UNUSED)
+{
+  enum intr_level old_level;
+
+  ASSERT (from != NULL);
+  ASSERT (to != NULL);
+  ASSERT (lock != NULL);
+  ASSERT (lock_held_by_current_thread (lock));
+
+  old_level = intr_disable ();
+  while (!heap_empty (&from->waiters))
+    {
+      struct semaphore_elem *w = heap_entry (heap_pop (&from->waiters),
+                                             struct semaphore_elem, elem);
+      w->cond = to;
+      heap_push (&to->waiters, &w->elem);
+    }
+  signaller_update (&from->signaller, PRI_MIN);
+  signaller_donate (&to->signaller, cond_top_priority (to));
+  intr_set_level (old_level);
+}
+
+/* Initializes RW as a reader-writer lock, which any number of
+   readers may hold at once, or else a single writer.  With PREF
+   RWLOCK_PREFER_READERS, a reader may join other readers even
+   while writers wait, which maximizes read throughput but can
+   starve writers.  With RWLOCK_PREFER_WRITERS, a new reader waits
+   for the writers already waiting.
+
+   A thread that waits while a writer holds RW donates its
+   priority to the writer, as for a lock.  Readers receive no
+   donations. */
+void
+rwlock_init (struct rwlock *rw, enum rwlock_pref pref)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->guard);
+  lock_init (&rw->write_lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writer_ok);
+  rw->writer = NULL;
+  rw->readers = 0;
+  rw->waiting_writers = 0;
+  rw->pref = pref;
+}
+
+/* Returns true if a reader may enter RW now.  RW's guard must be
+   held. */
+static bool
+read_ok (const struct rwlock *rw)
+{
+  return (rw->writer == NULL
+          && (rw->pref == RWLOCK_PREFER_READERS || rw->waiting_writers == 0));
+}
+
+/* Returns true if a writer may enter RW now.  RW's guard must be
+   held. */
+static bool
+write_ok (const struct rwlock *rw)
+{
+  return rw->writer == NULL && rw->readers == 0;
+}
+
+/* Waits, with RW's guard held, until RW changes.  If a writer
+   holds RW, waits on its write lock, which donates our priority
+   to it; otherwise, waits on COND. */
+static void
+rwlock_wait (struct rwlock *rw, struct condition *cond)
+{
+  if (rw->writer != NULL)
+    {
+      lock_release (&rw->guard);
+      lock_acquire (&rw->write_lock);
+      lock_release (&rw->write_lock);
+      lock_acquire (&rw->guard);
+    }
+  else
+    cond_wait (cond, &rw->guard);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it if
+   necessary.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  while (!read_ok (rw))
+    rwlock_wait (rw, &rw->readers_ok);
+  rw->readers++;
+  lock_release (&rw->guard);
+}
+
+/* Tries to acquire RW for reading and returns true if
+   successful, false if it would have to wait for a writer. */
 bool
-semaphore_elem_less (const struct list_elem *a,
-                     const struct list_elem *b,
-                     void *aux UNUSED)
+rwlock_try_acquire_read (struct rwlock *rw)
 {
-  struct semaphore_elem
-    *sema_elem_a, *sema_elem_b;
-  struct thread
-    *thread_a, *thread_b;
+  bool success;
 
-  sema_elem_a = list_entry (a, struct semaphore_elem, elem);
-  sema_elem_b = list_entry (b, struct semaphore_elem, elem);
-  
-  thread_a
-    = list_entry (list_front (&sema_elem_a->semaphore.waiters),
-                  struct thread, elem);
-  thread_b
-    = list_entry (list_front (&sema_elem_b->semaphore.waiters),
-                  struct thread, elem);
-
-  return thread_a->priority < thread_b->priority;
+  ASSERT (rw != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  success = read_ok (rw);
+  if (success)
+    rw->readers++;
+  lock_release (&rw->guard);
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for
+   reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->guard);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->writer_ok, &rw->guard);
+  lock_release (&rw->guard);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it if necessary.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->waiting_writers++;
+  while (!write_ok (rw))
+    rwlock_wait (rw, &rw->writer_ok);
+  rw->waiting_writers--;
+  rw->writer = thread_current ();
+  lock_acquire (&rw->write_lock);
+  lock_release (&rw->guard);
+}
+
+/* Tries to acquire RW for writing and returns true if
+   successful, false if it would have to wait. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  success = write_ok (rw) && lock_try_acquire (&rw->write_lock);
+  if (success)
+    rw->writer = thread_current ();
+  lock_release (&rw->guard);
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for
+   writing.  Waiting writers go first if RW prefers writers, and
+   waiting readers otherwise. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_by_current_thread (rw));
+
+  lock_acquire (&rw->guard);
+  rw->writer = NULL;
+  if (rw->pref == RWLOCK_PREFER_WRITERS && rw->waiting_writers > 0)
+    cond_signal (&rw->writer_ok, &rw->guard);
+  else
+    {
+      cond_broadcast (&rw->readers_ok, &rw->guard);
+      cond_signal (&rw->writer_ok, &rw->guard);
+    }
+  lock_release (&rw->guard);
+
+  /* Wakes the threads that waited on us, and withdraws their
+     donations. */
+  lock_release (&rw->write_lock);
+}
+
+/* Returns true if the current thread holds RW for writing,
+   false otherwise.  Readers are not tracked. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+/* Returns true if condition variable waiter A has lower
+   priority than waiter B, or arrived after it at equal
+   priority. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct semaphore_elem *a
+    = heap_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = heap_entry (b_, struct semaphore_elem, elem);
+
+  if (a->thread->priority != b->thread->priority)
+    return a->thread->priority < b->thread->priority;
+  return (int) (a->seq - b->seq) > 0;
 }
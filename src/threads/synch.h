@@ -1,27 +1,60 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <atomic.h>
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+/* Lock profiling statistics.  See synch.c. */
+struct lock_class;
+
+/* Defined in threads/thread.h. */
+struct thread;
+
+/* The thread declared to wake the waiters of a semaphore or
+   condition variable, which receives their priority as the
+   holder of a lock does.  See synch.c. */
+struct signaller
+  {
+    struct thread *thread;      /* Declared signaller, or null. */
+    struct list_elem elem;      /* Element in thread's signalled list. */
+    int priority;               /* Highest priority of a waiter. */
+  };
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, highest priority first. */
+    struct signaller signaller; /* Thread expected to up it. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Statistics, or null. */
+#endif
   };
 
 void sema_init (struct semaphore *, unsigned value);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
+void sema_up_boost (struct semaphore *, int boost);
+void sema_set_signaller (struct semaphore *, struct thread *);
 void sema_self_test (void);
+void synch_requeue (struct thread *);
+void synch_exit (struct thread *);
 
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's held_locks. */
+    int priority;               /* Highest priority of a waiter. */
+#ifdef LOCK_PROFILE
+    struct lock_class *class;   /* Statistics, or null. */
+    int64_t acquired;           /* clock_ns() when last acquired. */
+#endif
   };
 
 void lock_init (struct lock *);
@@ -29,28 +62,63 @@ void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiters, highest priority first. */
+    struct signaller signaller; /* Thread expected to signal it. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
+void cond_requeue (struct condition *, struct condition *, struct lock *);
+void cond_set_signaller (struct condition *, struct thread *);
+
+/* Which waiters a reader-writer lock admits first. */
+enum rwlock_pref
+  {
+    RWLOCK_PREFER_READERS,      /* Readers enter while writers wait. */
+    RWLOCK_PREFER_WRITERS       /* Waiting writers hold off new readers. */
+  };
+
+/* Reader-writer lock. */
+struct rwlock
+  {
+    struct lock guard;          /* Protects the members below. */
+    struct lock write_lock;     /* Held by the writer, for donation. */
+    struct condition readers_ok; /* Signaled when readers may enter. */
+    struct condition writer_ok; /* Signaled when a writer may enter. */
+    struct thread *writer;      /* Writer holding the lock, or null. */
+    unsigned readers;           /* Number of readers holding it. */
+    unsigned waiting_writers;   /* Number of writers waiting. */
+    enum rwlock_pref pref;      /* Readers or writers first? */
+  };
 
-bool
-semaphore_elem_less (const struct list_elem *,
-                     const struct list_elem *,
-                     void *);
+void rwlock_init (struct rwlock *, enum rwlock_pref);
+void rwlock_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
 
-/* Optimization barrier.
+#ifdef LOCK_PROFILE
+/* With LOCK_PROFILE defined ("make OPTIONS=-DLOCK_PROFILE"),
+   each semaphore and lock initialized outside synch.c is
+   profiled, under the text of the argument it was initialized
+   with, such as "&cache->lock".  All those initialized with the
+   same text share statistics. */
+void sema_init_named (struct semaphore *, unsigned value, const char *);
+void lock_init_named (struct lock *, const char *);
+#define sema_init(SEMA, VALUE) sema_init_named (SEMA, VALUE, #SEMA)
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+#endif
 
-   The compiler will not reorder operations across an
-   optimization barrier.  See "Optimization Barriers" in the
-   reference guide for more information.*/
-#define barrier() asm volatile ("" : : : "memory")
+/* barrier() is defined in <atomic.h>, with the CPU barriers. */
 
 #endif /* threads/synch.h */
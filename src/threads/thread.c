@@ -2,53 +2,149 @@
 #include <debug.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/pmc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/fixed-point.h"
+#include "threads/spinlock.h"
+#include "devices/block.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef VM
+#include <bitmap.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue: processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   Each CPU has its own, which holds the ready threads whose
+   `cpu' is that CPU.  How the threads are kept is up to the
+   scheduling class.
+
+   The priority and MLFQS classes keep one FIFO list per
+   priority, and bit P of MASK is set if the list for priority P
+   is not empty, so that the highest priority ready process is
+   found in constant time. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+struct run_queue
+  {
+    struct spinlock lock;       /* Protects the members below. */
+    size_t cnt;                 /* # of processes in the queue. */
+    int load;                   /* Load average, fixed-point. */
 
-/* List of all processes.  Processes are added to this list
-   when they are first scheduled and removed when they exit. */
-static struct list all_list;
+    /* Multi-level queue, for the priority and MLFQS classes. */
+    struct list lists[PRI_CNT]; /* Ready threads, by priority. */
+    uint32_t mask[DIV_ROUND_UP (PRI_CNT, 32)];
 
-/* List of sleeping processes, that is, processes
-   who previously called timer_sleep() and became blocked. */
-static struct list sleep_list;
+    /* For the fair class. */
+    struct rbtree fair_tree;    /* Ready threads, by vruntime. */
+    int64_t min_vruntime;       /* Never decreases. */
 
-/* Wake-up time of the thread who should wake up "first"
-   among sleeping thread. */
-static int64_t earliest_wakeup_ticks;
+    /* Earliest deadline first, above any class. */
+    struct rbtree edf_tree;     /* Ready EDF threads, by deadline. */
+
+    /* For the stride class. */
+    int64_t stride_pass;        /* Pass of group last picked. */
+  };
+static struct run_queue run_queues[CPU_MAX];
+
+/* Scheduling groups: sets of threads, such as a tenant's
+   processes, that share CPU time by tickets under the stride
+   class.  A thread starts in the group of the thread that
+   created it, so the processes that a process executes, forks
+   or spawns, and their threads, stay in its group.  Group 0,
+   which holds the initial thread and so every thread that has
+   not moved, has SCHED_GROUP_TICKETS tickets.
+
+   Each group has a `pass' that advances by its `stride',
+   STRIDE_ONE divided by its tickets, for each tick its threads
+   run.  The stride class runs the ready group with the lowest
+   pass, so that groups get CPU time in proportion to their
+   tickets however many threads each has.  Within a group,
+   threads run by priority, round robin among equals, as under
+   the priority class. */
+#define SCHED_GROUP_MAX 16
+#define STRIDE_ONE (1 << 20)
+struct sched_group
+  {
+    int tickets;                /* Share of the CPU. */
+    int64_t stride;             /* STRIDE_ONE / tickets. */
+    int64_t pass;               /* Virtual time of the group. */
+    size_t thread_cnt;          /* # of threads; slot free if 0. */
+    long long ticks;            /* # of timer ticks its threads ran. */
+    struct list queues[CPU_MAX];/* Ready threads per CPU, for the
+                                   stride class, by priority. */
+  };
+static struct sched_group sched_groups[SCHED_GROUP_MAX];
 
-#define EARLIER(TICKS) \
-        (((earliest_wakeup_ticks) > (TICKS)) ? (TICKS) : (earliest_wakeup_ticks))
+/* Load balancing.  A CPU with nothing left to run steals a
+   thread from the busiest other run queue.  Also, once every
+   BALANCE_TICKS, each CPU updates the load average of its own
+   queue, the way load_avg is kept for the advanced scheduler,
+   and steals a thread if another queue's load is BALANCE_MARGIN
+   or more above its own. */
+#define BALANCE_TICKS TIMER_FREQ
+#define BALANCE_MARGIN 1
 
-/* Idle thread. */
-static struct thread *idle_thread;
+/* List of all processes.  Processes are added to this list
+   when they are first scheduled and removed when they exit. */
+static struct list all_list;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
-/* Lock used by allocate_tid(). */
+/* Every thread that has not yet exited, by tid.  Lets
+   thread_find() look a thread up without a walk over ALL_LIST.
+   Created by thread_start(), since it needs malloc(). */
+static struct ohash tid_table;
+
+/* Lock used by allocate_tid(), which also protects TID_TABLE
+   and TID_KEY. */
 static struct lock tid_lock;
 
+/* Search key for TID_TABLE.  A struct thread is too large to
+   make one on the stack. */
+static struct thread tid_key;
+
+/* Cache of the pages of dead threads, for thread_create() to
+   reuse without going through the page allocator or zeroing the
+   page, since init_thread() clears the struct thread and the
+   stack needs no clearing.
+
+   The cache holds up to PAGE_CACHE_LIMIT pages.  The limit
+   doubles, up to PAGE_CACHE_MAX, each time thread_create() finds
+   the cache empty, and halves, down to PAGE_CACHE_MIN, after
+   PAGE_CACHE_DECAY thread creations in a row that find a page,
+   so that the cache grows to fit bursts of thread churn and
+   gives pages back once they pass.  Pages beyond the limit are
+   freed as threads die. */
+#define PAGE_CACHE_MIN 2
+#define PAGE_CACHE_MAX 32
+#define PAGE_CACHE_DECAY 64
+static void *page_cache[PAGE_CACHE_MAX];
+static size_t page_cache_cnt;           /* # of pages cached. */
+static size_t page_cache_limit = PAGE_CACHE_MIN;
+static size_t page_cache_hits;          /* # of hits since last miss. */
+static struct spinlock page_cache_lock; /* Protects the cache. */
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -57,39 +153,220 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
-/* Scheduling. */
+/* Scheduling.  Each CPU counts the ticks of its running
+   thread's time slice in its THREAD_TICKS. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+/* Earliest deadline first scheduling.
+
+   A thread that calls thread_set_edf() becomes periodic: a job
+   of it is released every `edf_period' ticks, by a timer
+   callout, and must run for up to `edf_runtime' ticks before its
+   deadline, `edf_rel_deadline' ticks after its release.  While
+   its job has budget left and has not finished, the thread is
+   kept in its run queue's EDF tree, ordered by deadline, and
+   runs ahead of every thread of the scheduling class.  Once the
+   job uses up its budget, the thread is scheduled by the class
+   like any other until its next release; a job that finishes
+   early waits for the next release in thread_edf_wait().
+
+   A job that has not finished by its deadline counts as a
+   deadline miss.  So that jobs do not miss their deadlines for
+   want of CPU time, thread_set_edf() admits a thread only while
+   the EDF threads together need at most EDF_UTIL_MAX thousandths
+   of the CPU. */
+#define EDF_UTIL_MAX 950
+static int edf_util;            /* Thousandths of the CPU reserved. */
+static long long edf_jobs;      /* # of EDF jobs released. */
+static long long edf_misses;    /* # of EDF deadlines missed. */
+
+static bool edf_eligible (const struct thread *);
+static bool edf_less (const struct rbtree_elem *,
+                      const struct rbtree_elem *, void *aux);
+static timer_callout_func edf_release;
+static bool preempts (const struct thread *, const struct thread *);
+
+/* Scheduling classes. */
+static void mlq_enqueue (struct run_queue *, struct thread *, bool front);
+static void mlq_dequeue (struct run_queue *, struct thread *);
+static struct thread *mlq_peek (struct run_queue *);
+static struct thread *mlq_pick_next (struct run_queue *);
+static struct thread *mlq_steal (struct run_queue *);
+static bool priority_preempts (const struct thread *,
+                               const struct thread *);
+static void mlfqs_tick (bool idle);
+static void mlfqs_wake (struct thread *);
+static void mlfqs_nice_changed (struct thread *);
+static void fair_enqueue (struct run_queue *, struct thread *, bool front);
+static void fair_dequeue (struct run_queue *, struct thread *);
+static struct thread *fair_peek (struct run_queue *);
+static struct thread *fair_pick_next (struct run_queue *);
+static struct thread *fair_steal (struct run_queue *);
+static bool fair_preempts (const struct thread *, const struct thread *);
+static void fair_tick (bool idle);
+static void fair_dispatch (struct thread *prev, struct thread *next);
+static bool fair_less (const struct rbtree_elem *,
+                       const struct rbtree_elem *, void *aux);
+static void stride_enqueue (struct run_queue *, struct thread *, bool front);
+static void stride_dequeue (struct run_queue *, struct thread *);
+static struct thread *stride_peek (struct run_queue *);
+static struct thread *stride_pick_next (struct run_queue *);
+static struct thread *stride_steal (struct run_queue *);
+static bool stride_preempts (const struct thread *, const struct thread *);
+static void stride_tick (bool idle);
+
+/* Priority scheduling with priority donation.  Among threads of
+   equal priority, round robin. */
+static const struct sched_class priority_class =
+  {
+    .name = "priority", .donation = true, .period = 0,
+    .enqueue = mlq_enqueue, .dequeue = mlq_dequeue,
+    .peek = mlq_peek, .pick_next = mlq_pick_next, .steal = mlq_steal,
+    .preempts = priority_preempts,
+    .tick = NULL, .wake = NULL, .nice_changed = NULL, .dispatch = NULL,
+  };
+
+/* Multi-level feedback queue scheduling, which sets priorities
+   from `nice' and `recent_cpu'.  Round robin, like the priority
+   class, among threads of equal priority. */
+static const struct sched_class mlfqs_class =
+  {
+    .name = "mlfqs", .donation = false, .period = TIMER_FREQ,
+    .enqueue = mlq_enqueue, .dequeue = mlq_dequeue,
+    .peek = mlq_peek, .pick_next = mlq_pick_next, .steal = mlq_steal,
+    .preempts = priority_preempts,
+    .tick = mlfqs_tick, .wake = mlfqs_wake,
+    .nice_changed = mlfqs_nice_changed, .dispatch = NULL,
+  };
+
+/* Fair-share scheduling, like Linux's CFS.  Each thread runs in
+   turn for CPU time in proportion to a weight set by its nice
+   value, regardless of priority, and without priority donation.
+
+   Time is charged to a thread, from the TSC by clock_ns(), as
+   virtual runtime: nanoseconds run, scaled by the weight of nice
+   0 divided by the thread's weight.  The ready thread with the
+   least virtual runtime runs next, from a red-black tree.  A
+   thread that wakes is placed no further than FAIR_SLEEPER_NS
+   behind the least virtual runtime of the threads that kept
+   running, which the run queue tracks in `min_vruntime', so that
+   sleeping earns it only a little credit.  A thread preempts the
+   running one if it is more than FAIR_GRAN_NS behind it. */
+static const struct sched_class fair_class =
+  {
+    .name = "fair", .donation = false, .period = 0,
+    .enqueue = fair_enqueue, .dequeue = fair_dequeue,
+    .peek = fair_peek, .pick_next = fair_pick_next, .steal = fair_steal,
+    .preempts = fair_preempts,
+    .tick = fair_tick, .wake = NULL, .nice_changed = NULL,
+    .dispatch = fair_dispatch,
+  };
+#define FAIR_SLEEPER_NS 20000000        /* Wakeup credit, in ns. */
+#define FAIR_GRAN_NS 4000000            /* Preemption granularity. */
+
+/* Stride scheduling between scheduling groups, described above
+   struct sched_group, with priority scheduling and donation
+   within each group. */
+static const struct sched_class stride_class =
+  {
+    .name = "stride", .donation = true, .period = 0,
+    .enqueue = stride_enqueue, .dequeue = stride_dequeue,
+    .peek = stride_peek, .pick_next = stride_pick_next,
+    .steal = stride_steal,
+    .preempts = stride_preempts,
+    .tick = stride_tick, .wake = NULL, .nice_changed = NULL,
+    .dispatch = NULL,
+  };
+
+/* Classes that thread_set_sched_class() may choose from. */
+static const struct sched_class *const sched_classes[] =
+  {
+    &priority_class,
+    &mlfqs_class,
+    &fair_class,
+    &stride_class,
+  };
+
+/* Scheduling class in use. */
+const struct sched_class *sched_class = &priority_class;
+
+/* True if the MLFQS class is in use. */
 bool thread_mlfqs;
+
+/* Scheduler latency tracing, enabled by the "-slt" kernel
+   command-line option.  For the priority each thread ran at,
+   counts how long threads waited in the ready queue before they
+   ran, both overall and just after being woken, in buckets of
+   powers of 2 nanoseconds from 2**10 up; how many timer ticks of
+   their time slice they used before giving up the CPU; and how
+   often interrupts preempted them. */
+bool thread_trace_sched;
+#define LATENCY_BUCKETS 16
+static unsigned wait_hist[PRI_CNT][LATENCY_BUCKETS];
+static unsigned wake_hist[PRI_CNT][LATENCY_BUCKETS];
+static unsigned slice_hist[PRI_CNT][TIME_SLICE + 1];
+static unsigned preempt_cnt[PRI_CNT];
 static int load_avg;            /* mlfqs, fixed-point. */
 
+/* Once a second every thread's recent_cpu decays by the factor
+   2*load_avg / (2*load_avg + 1) for the load_avg of that second.
+   Only the running and ready threads are decayed on time; a
+   blocked thread catches up on the decays it missed, from this
+   history of recent factors, when it is next needed.  All
+   threads are caught up every DECAY_HISTORY_CNT seconds, before
+   the history they need is overwritten. */
+#define DECAY_HISTORY_CNT 64
+static int decay_history[DECAY_HISTORY_CNT];    /* Fixed-point. */
+static unsigned decay_cnt;      /* # of decays so far. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void print_group_stats (void);
+static void print_sched_trace (void);
+static void trace_ready (struct thread *, bool woken);
+static void trace_switch (struct thread *cur, struct thread *next);
 static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
+static struct run_queue *ready_queue (struct cpu *);
+static void ready_push (struct thread *);
+static void ready_insert (struct thread *, bool front);
+static void ready_remove (struct thread *);
+static struct thread *ready_max (struct run_queue *);
+static struct thread *ready_pop (struct run_queue *);
+static struct thread *ready_steal (struct cpu *);
+static void ready_balance (void);
+static int load_avg_formula (int avg, int ready);
+static int mlfqs_ready_threads (void);
+static int mlfqs_priority_formula (struct thread *);
+static int mlfqs_load_avg_formula (void);
+static void mlfqs_increment_recent_cpu (void);
+static void mlfqs_update_load_avg (void);
+static void mlfqs_recalc_priority (struct thread *, void *);
+static void mlfqs_catch_up (struct thread *, void *);
+static void mlfqs_decay_recent_cpu (void);
+static bool is_idle (struct thread *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void tid_table_insert (struct thread *);
+static ohash_hash_func tid_hash;
+static ohash_less_func tid_less;
+static struct thread *get_thread_page (void);
+static void free_thread_page (struct thread *);
+static rcu_func free_thread_rcu;
+static void mlfqs_apply_decay (struct thread *);
+static void end_boost (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -100,16 +377,33 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i, j;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
+  cpu_init ();
+  rcu_init ();
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  spinlock_init (&page_cache_lock);
+  for (i = 0; i < CPU_MAX; i++)
+    {
+      spinlock_init (&run_queues[i].lock);
+      for (j = 0; j < PRI_CNT; j++)
+        list_init (&run_queues[i].lists[j]);
+      rbtree_init (&run_queues[i].fair_tree, fair_less, NULL);
+      rbtree_init (&run_queues[i].edf_tree, edf_less, NULL);
+      run_queues[i].stride_pass = 0;
+      run_queues[i].min_vruntime = 0;
+    }
   list_init (&all_list);
-
-  list_init (&sleep_list);
-  earliest_wakeup_ticks = INT64_MAX;
+  for (i = 0; i < SCHED_GROUP_MAX; i++)
+    for (j = 0; j < CPU_MAX; j++)
+      list_init (&sched_groups[i].queues[j]);
+  sched_groups[0].tickets = SCHED_GROUP_TICKETS;
+  sched_groups[0].stride = STRIDE_ONE / SCHED_GROUP_TICKETS;
 
   load_avg = 0;
+  decay_cnt = 0;
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
@@ -118,6 +412,25 @@ thread_init (void)
   initial_thread->tid = allocate_tid ();
 }
 
+/* Makes the scheduling class called NAME, "priority", "mlfqs",
+   "fair", or "stride", schedule every thread.  Returns false, changing
+   nothing, if there is no class of that name.  Must be called
+   before thread_start(), while no thread is ready to run. */
+bool
+thread_set_sched_class (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof sched_classes / sizeof *sched_classes; i++)
+    if (!strcmp (sched_classes[i]->name, name))
+      {
+        sched_class = sched_classes[i];
+        thread_mlfqs = sched_class == &mlfqs_class;
+        return true;
+      }
+  return false;
+}
+
 /* Starts preemptive thread scheduling by enabling interrupts.
    Also creates the idle thread. */
 void
@@ -125,13 +438,19 @@ thread_start (void)
 {
   /* Create the idle thread. */
   struct semaphore idle_started;
+
+  if (!ohash_init (&tid_table, tid_hash, tid_less, NULL))
+    PANIC ("cannot allocate thread table");
+  tid_table_insert (initial_thread);
+
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize the CPU's
+     idle_thread. */
   sema_down (&idle_started);
 }
 
@@ -141,28 +460,184 @@ void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *cpu = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (is_idle (t))
+    cpu->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    {
+      cpu->user_ticks++;
+      t->rusage.utime++;
+    }
 #endif
   else
-    kernel_ticks++;
+    {
+      cpu->kernel_ticks++;
+      t->rusage.stime++;
+    }
+  if (!is_idle (t))
+    t->sched_group->ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* Enforce preemption.  An EDF job that has used up its budget
+     goes back to its scheduling class. */
+  if (++cpu->thread_ticks >= TIME_SLICE)
+    {
+      end_boost (t);
+      intr_yield_on_return ();
+    }
+  if (edf_eligible (t) && --t->edf_budget == 0)
     intr_yield_on_return ();
+
+  if (timer_ticks () % BALANCE_TICKS == 0)
+    ready_balance ();
+
+  rcu_tick ();
+}
+
+/* Called by the timer interrupt handler, in place of
+   thread_tick(), for a timer tick that passed while the CPU was
+   idle and the timer was not interrupting. */
+void
+thread_idle_tick (void)
+{
+  cpu_current ()->idle_ticks++;
+}
+
+/* Returns true if the CPU has nothing to do: the idle thread is
+   running and no thread is ready to run.  Interrupts must be
+   off. */
+bool
+thread_idling (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return is_idle (running_thread ())
+         && ready_queue (cpu_current ())->cnt == 0;
 }
 
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      idle_ticks += cpus[i].idle_ticks;
+      kernel_ticks += cpus[i].kernel_ticks;
+      user_ticks += cpus[i].user_ticks;
+    }
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (edf_jobs > 0)
+    printf ("EDF: %lld jobs, %lld deadline misses\n", edf_jobs, edf_misses);
+  print_group_stats ();
+  if (thread_trace_sched)
+    print_sched_trace ();
+}
+
+/* Prints the CPU time used by each scheduling group, if any
+   group other than group 0 has run. */
+static void
+print_group_stats (void)
+{
+  int i;
+
+  for (i = 1; i < SCHED_GROUP_MAX; i++)
+    if (sched_groups[i].ticks > 0)
+      break;
+  if (i >= SCHED_GROUP_MAX)
+    return;
+
+  for (i = 0; i < SCHED_GROUP_MAX; i++)
+    if (sched_groups[i].ticks > 0)
+      printf ("Group %d: %d tickets, %lld ticks\n",
+              i, sched_groups[i].tickets, sched_groups[i].ticks);
+}
+
+/* Prints the histograms of scheduler latency tracing for each
+   priority that threads ran at. */
+static void
+print_sched_trace (void)
+{
+  int pri, i;
+
+  printf ("Sched: ready wait and wakeup latency (log2 ns), "
+          "ticks of slice used, preemptions\n");
+  for (pri = PRI_MAX; pri >= PRI_MIN; pri--)
+    {
+      unsigned slices = 0;
+
+      for (i = 0; i <= TIME_SLICE; i++)
+        slices += slice_hist[pri][i];
+      if (slices == 0 && preempt_cnt[pri] == 0)
+        continue;
+
+      printf ("Pri %d: wait", pri);
+      for (i = 0; i < LATENCY_BUCKETS; i++)
+        if (wait_hist[pri][i] > 0)
+          printf (" %d:%u", i + 10, wait_hist[pri][i]);
+      printf (", wake");
+      for (i = 0; i < LATENCY_BUCKETS; i++)
+        if (wake_hist[pri][i] > 0)
+          printf (" %d:%u", i + 10, wake_hist[pri][i]);
+      printf (", slice");
+      for (i = 0; i <= TIME_SLICE; i++)
+        printf (" %u", slice_hist[pri][i]);
+      printf (", %u preempted\n", preempt_cnt[pri]);
+    }
+}
+
+/* Notes, if scheduler tracing is on, that T has just been made
+   ready to run, because it was WOKEN or because it gave up the
+   CPU while still ready. */
+static void
+trace_ready (struct thread *t, bool woken)
+{
+  if (thread_trace_sched)
+    {
+      t->ready_ns = clock_ns ();
+      t->woken = woken;
+    }
+}
+
+/* Returns the latency histogram bucket for a wait of NS
+   nanoseconds. */
+static int
+latency_bucket (int64_t ns)
+{
+  int bucket = 0;
+
+  for (ns >>= 11; ns > 0 && bucket < LATENCY_BUCKETS - 1; ns >>= 1)
+    bucket++;
+  return bucket;
+}
+
+/* Records, if scheduler tracing is on, the part of its time
+   slice CUR used and how long NEXT waited to run. */
+static void
+trace_switch (struct thread *cur, struct thread *next)
+{
+  if (!thread_trace_sched)
+    return;
+
+  if (!is_idle (cur))
+    {
+      unsigned ticks = cur->cpu->thread_ticks;
+      slice_hist[cur->priority][ticks < TIME_SLICE ? ticks : TIME_SLICE]++;
+    }
+  if (!is_idle (next) && next->ready_ns != 0)
+    {
+      int bucket = latency_bucket (clock_ns () - next->ready_ns);
+
+      wait_hist[next->priority][bucket]++;
+      if (next->woken)
+        wake_hist[next->priority][bucket]++;
+      next->ready_ns = 0;
+    }
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -193,13 +668,14 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = get_thread_page ();
   if (t == NULL)
     return TID_ERROR;
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  tid_table_insert (t);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -242,6 +718,7 @@ thread_block (void)
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
 
+  end_boost (thread_current ());
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
 }
@@ -263,17 +740,26 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (sched_class->wake != NULL)
+    sched_class->wake (t);
+  ready_push (t);
   t->status = THREAD_READY;
+  trace_ready (t, true);
+  TRACE (TRACE_SCHED, TRACE_WAKEUP, t->tid, t->priority);
 
-  /* When a thread is added to the ready list that has a higher
-     priority than the currently running thread, the current thread
+  /* When a thread is added to the ready list that should run
+     before the currently running thread, the current thread
      should immediately yield the processor to the new thread. */
-  if (thread_current () != idle_thread &&
-      t->priority > thread_get_priority ())
+  if (!is_idle (thread_current ())
+      && preempts (t, thread_current ()))
     {
       if (!intr_context ())
-        thread_yield ();
+        {
+          if (thread_current ()->rcu_nesting == 0)
+            thread_yield ();
+          else
+            thread_current ()->rcu_resched = true;
+        }
       else
         {
           /* In the external interrupt context,
@@ -331,12 +817,22 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  fpu_exit ();
+
+  lock_acquire (&tid_lock);
+  ohash_delete (&tid_table, &thread_current ()->tid_elem);
+  lock_release (&tid_lock);
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
-  list_remove (&thread_current()->allelem);
+  synch_exit (thread_current ());
+  if (thread_current ()->edf_runtime != 0)
+    thread_set_edf (0, 0, 0);
+  thread_current ()->sched_group->thread_cnt--;
+  block_io_group_leave (thread_current ()->io_group);
+  rcu_list_remove (&thread_current ()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -353,110 +849,440 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  if (!is_idle (cur)) 
+    ready_push (cur);
   cur->status = THREAD_READY;
+  trace_ready (cur, false);
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Suspends execution of the calling thread until until
-   timer `ticks' reaches `wakeup_ticks'. */
+/* Yields the CPU on return from an external interrupt that asked
+   for it with intr_yield_on_return(), counting the preemption of
+   the running thread if scheduler tracing is on. */
 void
-thread_sleep (int64_t wakeup_ticks)
+thread_preempt (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->rcu_nesting > 0)
+    {
+      /* Put off until the RCU reader is done.  See rcu.c. */
+      cur->rcu_resched = true;
+      return;
+    }
+  if (thread_trace_sched && !is_idle (cur))
+    preempt_cnt[cur->priority]++;
+  thread_yield ();
+}
+
+/* Returns true if the running thread should give up the CPU:
+   if it has used up its time slice and another thread is ready,
+   or if a ready thread should preempt it.  These are the cases
+   in which the timer or a wakeup calls intr_yield_on_return(). */
+bool
+thread_need_resched (void)
 {
   struct thread *cur = thread_current ();
+  struct thread *next;
   enum intr_level old_level;
+  bool resched;
 
-  old_level = intr_disable ();  
-  if (cur != idle_thread) 
-    list_push_back (&sleep_list, &cur->elem);
-  cur->wakeup_ticks = wakeup_ticks;
-  earliest_wakeup_ticks = EARLIER (wakeup_ticks);
-  thread_block ();
+  old_level = intr_disable ();
+  next = ready_max (ready_queue (cur->cpu));
+  resched = (next != NULL && !is_idle (cur)
+             && (cur->cpu->thread_ticks >= TIME_SLICE
+                 || preempts (next, cur)));
   intr_set_level (old_level);
+  return resched;
 }
 
-/* When there is a thread to wake up, find and unblock
-   the thread. There can be more than one thread who should
-   wake up. */
+/* A voluntary preemption point: yields the CPU if
+   thread_need_resched() says so.  For long kernel loops, such as
+   tearing down an address space, to call at points where they
+   hold no lock that others may want, so that a thread that becomes ready meanwhile
+   does not wait for the loop to finish whenever the interrupt
+   that should preempt it cannot, as while interrupts are off.
+   Costs one look at the run queue when there is nothing to do. */
 void
-thread_wakeup (int64_t ticks)
+cond_resched (void)
 {
-  /* There is no thread to wake up. */
-  if (ticks < earliest_wakeup_ticks)
-    return;
-  
-  /* At least one thread should wake up. */
-  struct list_elem *min = list_begin (&sleep_list);
-  struct list_elem *e;
-  for (e = min; e != list_end (&sleep_list);
-       /**/)
+  ASSERT (!intr_context ());
+
+  if (thread_need_resched ())
+    thread_yield ();
+}
+
+/* Yields the CPU to T, if T is ready to run on this CPU and its
+   priority is at least the current thread's.  The current thread
+   stays ready, behind T.  Returns true if T ran, false if no
+   yield took place.  Used to let the holder of a lock finish
+   with it, rather than block waiting. */
+bool
+thread_yield_to (struct thread *t)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool yielded = false;
+
+  ASSERT (!intr_context ());
+  ASSERT (is_thread (t));
+
+  old_level = intr_disable ();
+  if (t != cur && t->status == THREAD_READY && t->cpu == cur->cpu
+      && !preempts (cur, t))
     {
-      struct thread *t = list_entry (e, struct thread, elem);
-      /* Wake up this thread. */
-      if (ticks >= t->wakeup_ticks)
-        {
-          e = list_remove (e);
-          thread_unblock (t);
-        }
-      else
+      /* No ready thread runs before T, so putting it first
+         makes it the next to run. */
+      ready_remove (t);
+      ready_insert (t, true);
+      ready_push (cur);
+      cur->status = THREAD_READY;
+      trace_ready (cur, false);
+      schedule ();
+      yielded = true;
+    }
+  intr_set_level (old_level);
+  return yielded;
+}
+
+/* Makes the running thread periodic under earliest deadline
+   first scheduling, as described at the top of this file, with
+   each job needing RUNTIME ticks of CPU time within DEADLINE
+   ticks of its release, and a job released every PERIOD ticks,
+   the first one now.  0 < RUNTIME <= DEADLINE <= PERIOD is
+   required.  Returns false, changing nothing, if admitting the
+   thread would reserve more of the CPU than EDF_UTIL_MAX allows.
+
+   If RUNTIME is 0, the thread stops being periodic and returns
+   to its scheduling class, and true is returned. */
+bool
+thread_set_edf (int64_t runtime, int64_t deadline, int64_t period)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int util = 0, old_util = 0;
+
+  ASSERT (runtime == 0 || (0 < runtime && runtime <= deadline
+                           && deadline <= period));
+
+  if (runtime != 0)
+    util = DIV_ROUND_UP (runtime * 1000, period);
+
+  old_level = intr_disable ();
+  if (cur->edf_runtime != 0)
+    old_util = DIV_ROUND_UP (cur->edf_runtime * 1000, cur->edf_period);
+  if (edf_util - old_util + util > EDF_UTIL_MAX)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  edf_util += util - old_util;
+  if (cur->edf_runtime != 0)
+    timer_callout_cancel (&cur->edf_timer);
+
+  cur->edf_runtime = runtime;
+  cur->edf_rel_deadline = deadline;
+  cur->edf_period = period;
+  cur->edf_done = true;
+  if (runtime != 0)
+    {
+      /* Releases the first job now. */
+      cur->edf_timer.expires = timer_ticks ();
+      edf_release (cur);
+    }
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Finishes the running EDF thread's current job, and waits for
+   its next job to be released.  Does nothing if the thread is
+   not periodic. */
+void
+thread_edf_wait (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (cur->edf_runtime != 0)
+    {
+      if (!cur->edf_done && timer_ticks () > cur->edf_deadline)
         {
-          /* Finds a thread with smallest wakeup_ticks
-             except the threads to wake up. */
-          struct thread *min_t = list_entry (min, struct thread, elem);
-          if (t->wakeup_ticks < min_t->wakeup_ticks)
-            min = e;
-          e = list_next (e);
+          cur->edf_misses++;
+          edf_misses++;
         }
+      cur->edf_done = true;
+      cur->edf_waiting = true;
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Releases the next job of EDF thread T, given as AUX, with a
+   fresh budget and deadline, and wakes T if it waits for the
+   release.  If T's previous job has not finished, it has missed
+   its deadline, which came no later than this release.  Called
+   from the timer interrupt, and by thread_set_edf() for the
+   first job. */
+static void
+edf_release (void *t_)
+{
+  struct thread *t = t_;
+  int64_t now = t->edf_timer.expires;
+  bool queued = t->status == THREAD_READY;
+
+  if (queued)
+    ready_remove (t);
+
+  if (!t->edf_done)
+    {
+      t->edf_misses++;
+      edf_misses++;
+    }
+  edf_jobs++;
+  t->edf_deadline = now + t->edf_rel_deadline;
+  t->edf_budget = t->edf_runtime;
+  t->edf_done = false;
+  timer_callout_add (&t->edf_timer, now + t->edf_period);
+
+  if (queued)
+    {
+      ready_push (t);
+      if (preempts (t, running_thread ()))
+        intr_yield_on_return ();
+    }
+  else if (t->edf_waiting)
+    {
+      t->edf_waiting = false;
+      thread_unblock (t);
     }
+}
+
+/* Moves the running thread into a new scheduling group with
+   TICKETS tickets, described above struct sched_group.  The
+   threads it creates from now on join the new group.  Returns
+   the group's number, or -1 if TICKETS is not between 1 and
+   SCHED_GROUP_TICKETS_MAX or there are too many groups. */
+int
+thread_new_sched_group (int tickets)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int i;
+
+  if (tickets < 1 || tickets > SCHED_GROUP_TICKETS_MAX)
+    return -1;
+
+  old_level = intr_disable ();
+  for (i = 1; i < SCHED_GROUP_MAX; i++)
+    if (sched_groups[i].thread_cnt == 0)
+      {
+        struct sched_group *g = &sched_groups[i];
+
+        /* Starts the group level with the groups running now. */
+        g->tickets = tickets;
+        g->stride = STRIDE_ONE / tickets;
+        g->pass = ready_queue (cur->cpu)->stride_pass;
+        g->ticks = 0;
+
+        cur->sched_group->thread_cnt--;
+        cur->sched_group = g;
+        g->thread_cnt++;
+        break;
+      }
+  intr_set_level (old_level);
+
+  return i < SCHED_GROUP_MAX ? i : -1;
+}
+
+/* Copies the resources that T has used to USAGE, including, if
+   T is running, the time it has run since it was last
+   scheduled. */
+void
+thread_get_rusage (struct thread *t, struct rusage *usage)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (t == thread_current ())
+    pmc_account (&t->rusage);
+  *usage = t->rusage;
+  if (t == thread_current ())
+    usage->run_ns += clock_ns () - t->run_start;
+#ifdef VM
+  usage->minflt = t->vmstat.minor_faults;
+  usage->majflt = t->vmstat.major_faults;
+#endif
+  intr_set_level (old_level);
+}
 
-  /* There are no sleeping threads left. */
-  if (list_empty (&sleep_list))
-    earliest_wakeup_ticks = INT64_MAX;
+/* Adds each count in SRC to the same count in DST. */
+void
+thread_add_rusage (struct rusage *dst, const struct rusage *src)
+{
+  dst->utime += src->utime;
+  dst->stime += src->stime;
+  dst->run_ns += src->run_ns;
+  dst->nvcsw += src->nvcsw;
+  dst->nivcsw += src->nivcsw;
+  dst->minflt += src->minflt;
+  dst->majflt += src->majflt;
+  dst->inblock += src->inblock;
+  dst->oublock += src->oublock;
+  dst->inops += src->inops;
+  dst->ouops += src->ouops;
+  dst->cycles += src->cycles;
+  dst->instructions += src->instructions;
+  dst->llc_misses += src->llc_misses;
+  dst->dtlb_misses += src->dtlb_misses;
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   The walk is an RCU read-side critical section, so 'func' must
+   not sleep, and threads may be created or exit meanwhile; a
+   caller that needs them to hold still turns interrupts off. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
-
+  rcu_read_lock ();
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
     {
       struct thread *t = list_entry (e, struct thread, allelem);
       func (t, aux);
     }
+  rcu_read_unlock ();
 }
 
 /* Sets the current thread's priority to NEW_PRIORITY. */
 void
 thread_set_priority (int new_priority) 
 {
-  if (thread_mlfqs)
-    return;   /* Disabled by advanced scheduler. */
+  if (!sched_class->donation)
+    return;   /* The class sets priorities itself. */
 
   struct thread *cur = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  int old_priority = cur->priority;
+
+  /* A donation still in effect keeps the thread above
+     NEW_PRIORITY until the lock concerned is released. */
+  cur->base_priority = new_priority;
+  cur->priority = thread_effective_priority (cur);
+  intr_set_level (old_level);
+
+  /* Lowering the priority of currently running thread
+     such that it no longer has the highest priority must cause
+     it to immediately yield the CPU. */
+  if (cur->priority < old_priority)
+    thread_yield ();
+}
+
+/* Returns the priority T should run at: its base priority, plus
+   any boost from thread_boost(), or the highest priority donated
+   to it through any lock it holds or any semaphore or condition
+   variable it is the declared signaller of, whichever is higher.
+   Each caches the priority of its highest waiter, so this takes
+   time proportional to their number, not to the number of T's
+   donors. */
+int
+thread_effective_priority (struct thread *t)
+{
+  int priority = t->base_priority + t->io_boost;
+  struct list_elem *e;
+
+  if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      if (lock->priority > priority)
+        priority = lock->priority;
+    }
+  for (e = list_begin (&t->signalled); e != list_end (&t->signalled);
+       e = list_next (e))
+    {
+      struct signaller *s = list_entry (e, struct signaller, elem);
+      if (s->priority > priority)
+        priority = s->priority;
+    }
+  return priority;
+}
+
+/* Raises the priority of T, which must be blocked, by BOOST
+   levels, up to PRI_MAX, until T next blocks or uses up a time
+   slice.  A thread woken by the completion of its I/O gets such
+   a boost, so that it may issue its next request without first
+   waiting behind CPU-bound threads of its own priority.  Does
+   nothing under a scheduling class that ignores priorities. */
+void
+thread_boost (struct thread *t, int boost)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (boost > 0);
+
+  if (!sched_class->donation && !thread_mlfqs)
+    return;
 
-  /* There is no donation, thus it is normal case. */
-  if (list_empty (&cur->donor_list))
+  old_level = intr_disable ();
+  ASSERT (t->status == THREAD_BLOCKED);
+  if (boost > t->io_boost)
+    {
+      t->io_boost = boost;
+      thread_change_priority (t, thread_mlfqs
+                                 ? mlfqs_priority_formula (t)
+                                 : thread_effective_priority (t));
+    }
+  intr_set_level (old_level);
+}
+
+/* Ends the boost that thread_boost() gave T, if any. */
+static void
+end_boost (struct thread *t)
+{
+  if (t->io_boost == 0)
+    return;
+  t->io_boost = 0;
+  thread_change_priority (t, thread_mlfqs
+                             ? mlfqs_priority_formula (t)
+                             : thread_effective_priority (t));
+}
+
+/* Sets the priority of T, which may be ready to run, to
+   PRIORITY, without yielding.  Used to donate priority and to
+   recalculate it, so that a thread in the run queue is kept in
+   the list for its current priority, and a waiting thread in its
+   place among the waiters. */
+void
+thread_change_priority (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY && t->priority != priority)
     {
-      /* Apparently, this currently runnnig thread
-         has the highest priority. */
-      bool is_priority_lowered = cur->priority > new_priority;
-      cur->priority = new_priority;
-      /* Lowering the priority of currently running thread
-         such that it no longer has the highest priority must cause
-         it to immediately yield the CPU. */
-      if (is_priority_lowered)
-        thread_yield ();
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else if (t->priority != priority
+           && (t->wait_sema != NULL || t->wait_cond != NULL))
+    {
+      t->priority = priority;
+      synch_requeue (t);
     }
   else
-    cur->original_priority = new_priority;
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -466,29 +1292,26 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE and
-   recalculates the thread's priority based on the new
-   value. If the running thread no longer has the
-   highest priority, yields. */
+/* Sets the current thread's nice value to NICE and lets the
+   scheduling class recalculate the thread's priority based on
+   the new value.  If the running thread should no longer run
+   first, yields. */
 void
 thread_set_nice (int nice) 
 {
   struct thread *cur = thread_current ();
+  struct thread *max;
   enum intr_level old_level;
 
   old_level = intr_disable ();
 
   cur->nice = nice;
-  cur->priority = mlfqs_priority_formula (cur);
+  if (sched_class->nice_changed != NULL)
+    sched_class->nice_changed (cur);
 
-  if (!list_empty (&ready_list))
-    {
-      struct thread *max
-        = list_entry (list_max (&ready_list, thread_priority_less, NULL),
-                      struct thread, elem);
-      if (cur->priority < max->priority)
-        thread_yield ();
-    }
+  max = ready_max (ready_queue (cur->cpu));
+  if (max != NULL && preempts (max, cur))
+    thread_yield ();
   
   intr_set_level (old_level);
 }
@@ -541,27 +1364,82 @@ thread_get_recent_cpu (void)
   return recent_cpu;
 }
 
-/* The number of threads that are either running
-   or ready to run at time of update (not including
-   the idle thread). */
-int
-mlfqs_ready_threads ()
+/* Returns true if ready thread T has a higher priority than
+   running thread CUR, for the priority and MLFQS classes. */
+static bool
+priority_preempts (const struct thread *t, const struct thread *cur)
 {
-  int addend
-    = (thread_current () != idle_thread)
-       ? 1
+  return t->priority > cur->priority;
+}
+
+/* Does the advanced scheduler's work for a timer tick.  IDLE is
+   true for a tick that passed while the CPU was idle. */
+static void
+mlfqs_tick (bool idle)
+{
+  /* Increments `recent_cpu' by one at every tick for a
+     non-idle running thread only. */
+  if (!idle)
+    mlfqs_increment_recent_cpu ();
+
+  /* Once per second, `load_avg' is updated and `recent_cpu'
+     decays.  Blocked threads catch up on their decay later, when
+     they are woken up. */
+  if (timer_ticks () % TIMER_FREQ == 0)
+    {
+      mlfqs_update_load_avg ();
+      mlfqs_decay_recent_cpu ();
+    }
+
+  /* Priority is recalculated every fourth tick.  Only the
+     running thread's `recent_cpu' has changed since the last
+     time. */
+  if (timer_ticks () % 4 == 0)
+    mlfqs_recalc_priority (thread_current (), NULL);
+}
+
+/* Brings the priority of blocked thread T up to date before it
+   is woken or compared with other threads. */
+static void
+mlfqs_wake (struct thread *t)
+{
+  mlfqs_catch_up (t, NULL);
+}
+
+/* Recalculates the priority of T, the running thread, after its
+   nice value changed. */
+static void
+mlfqs_nice_changed (struct thread *t)
+{
+  t->priority = mlfqs_priority_formula (t);
+}
+
+/* The number of threads that are either running
+   or ready to run at time of update (not including
+   the idle thread). */
+static int
+mlfqs_ready_threads (void)
+{
+  int addend
+    = !is_idle (thread_current ())
+       ? 1
        : 0;
-  return list_size (&ready_list) + addend;
+  size_t cnt = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    cnt += run_queues[i].cnt;
+  return cnt + addend;
 }
 
-int
+static int
 mlfqs_priority_formula (struct thread *t)
 {
   /* `recent_cpu' is fixed point real number.
      `nice' is just an integer. */
   int priority = PRI_MAX
                  - f2i_round_nearest (div_fi (t->recent_cpu, 4))
-                 - (t->nice * 2);
+                 - (t->nice * 2) + t->io_boost;
   /* Out of range. */
   if (PRI_MAX < priority ||
       PRI_MIN > priority)
@@ -574,33 +1452,28 @@ mlfqs_priority_formula (struct thread *t)
     return priority;
 }
 
-int   /* fixed-point */
-mlfqs_recent_cpu_formula (struct thread *t)
+static int   /* fixed-point */
+mlfqs_load_avg_formula (void)
 {
-  /* `load_avg' is fixed point real number.
-     `recent_cpu' is fixed point real number.
-     `nice' is just an integer. */
-  int load_avg2 = mul_fi (load_avg, 2);
-  return add_fi (mul_ff (div_ff (load_avg2, add_fi (load_avg2, 1)),
-                         t->recent_cpu),
-                 t->nice);
+  return load_avg_formula (load_avg, mlfqs_ready_threads ());
 }
 
-int   /* fixed-point */
-mlfqs_load_avg_formula (void)
+/* Returns the load average AVG, decayed by one update with
+   READY threads ready or running.  AVG and the result are fixed
+   point real numbers. */
+static int
+load_avg_formula (int avg, int ready)
 {
-  /* `load_avg' is fixed point real number. */
-  return div_fi (add_fi (mul_fi (load_avg, 59), mlfqs_ready_threads ()),
-                 60);
+  return div_fi (add_fi (mul_fi (avg, 59), ready), 60);
 }
 
 /* Increments `recent_cpu' by one at every tick
    fot not-­idle running thread only. */
-void
+static void
 mlfqs_increment_recent_cpu (void)
 {
   struct thread *cur = thread_current ();
-  if (cur != idle_thread)
+  if (!is_idle (cur))
     {
       /* `recent_cpu' is fixed point real number. */
       cur->recent_cpu = add_ff (cur->recent_cpu, i2f (1));
@@ -608,21 +1481,89 @@ mlfqs_increment_recent_cpu (void)
 }
 
 /* Recalculates priority. Used with thread_foreach(). */
-void
+static void
 mlfqs_recalc_priority (struct thread *t, void *aux UNUSED)
 {
-  t->priority = mlfqs_priority_formula (t);
+  thread_change_priority (t, mlfqs_priority_formula (t));
 }
 
-/* Recalculates recent_cpu. Used with thread_foreach(). */
-void
-mlfqs_recalc_recent_cpu (struct thread *t, void *aux UNUSED)
+/* Applies to T's recent_cpu the decays it has missed while
+   blocked, and recalculates its priority.  Used with
+   thread_foreach(). */
+static void
+mlfqs_catch_up (struct thread *t, void *aux UNUSED)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->decay_cnt != decay_cnt)
+    {
+      mlfqs_apply_decay (t);
+      thread_change_priority (t, mlfqs_priority_formula (t));
+    }
+}
+
+/* Decays recent_cpu, once per second, using the current
+   load_avg.  The running thread and the ready threads are
+   decayed now and requeued at their new priorities; blocked
+   threads are left to mlfqs_catch_up(). */
+static void
+mlfqs_decay_recent_cpu (void)
+{
+  struct list ready;
+  int load_avg2;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* `load_avg' is fixed point real number. */
+  load_avg2 = mul_fi (load_avg, 2);
+  decay_history[decay_cnt++ % DECAY_HISTORY_CNT]
+    = div_ff (load_avg2, add_fi (load_avg2, 1));
+  if (decay_cnt % DECAY_HISTORY_CNT == 0)
+    {
+      thread_foreach (mlfqs_catch_up, NULL);
+      return;
+    }
+
+  mlfqs_catch_up (thread_current (), NULL);
+
+  /* Take every ready thread out of the run queues before any
+     of them moves, so that none is visited twice. */
+  list_init (&ready);
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct thread *t;
+      while ((t = ready_pop (&run_queues[i])) != NULL)
+        list_push_back (&ready, &t->elem);
+    }
+  while (!list_empty (&ready))
+    {
+      struct thread *t = list_entry (list_pop_front (&ready),
+                                     struct thread, elem);
+      mlfqs_apply_decay (t);
+      t->priority = mlfqs_priority_formula (t);
+      ready_push (t);
+    }
+}
+
+/* Applies to T's recent_cpu each decay since it was last
+   decayed. */
+static void
+mlfqs_apply_decay (struct thread *t)
 {
-  t->recent_cpu = mlfqs_recent_cpu_formula (t);
+  ASSERT (decay_cnt - t->decay_cnt <= DECAY_HISTORY_CNT);
+
+  /* `recent_cpu' is fixed point real number.
+     `nice' is just an integer. */
+  while (t->decay_cnt != decay_cnt)
+    {
+      int factor = decay_history[t->decay_cnt++ % DECAY_HISTORY_CNT];
+      t->recent_cpu = add_fi (mul_ff (factor, t->recent_cpu), t->nice);
+    }
 }
 
 /* Updates load_avg. */
-void
+static void
 mlfqs_update_load_avg (void)
 {
   load_avg = mlfqs_load_avg_formula ();
@@ -632,7 +1573,8 @@ mlfqs_update_load_avg (void)
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
+   point it initializes its CPU's idle_thread, "up"s the semaphore
+   passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
@@ -641,15 +1583,26 @@ static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  thread_current ()->cpu->idle_thread = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
     {
-      /* Let someone else run. */
+      /* Let someone else run.  If an interrupt other than the
+         timer's made a thread ready, the timer may have stopped
+         interrupting every tick, so restart it first. */
       intr_disable ();
+      if (ready_queue (cpu_current ())->cnt != 0)
+        timer_resume ();
       thread_block ();
 
+      /* Zero free pages for palloc while there is nothing else to
+         do.  A thread made ready meanwhile preempts us. */
+      intr_enable ();
+      while (palloc_zero_idle ())
+        continue;
+      intr_disable ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -716,9 +1669,17 @@ init_thread (struct thread *t, const char *name, int priority)
   t->priority = priority;
   t->magic = THREAD_MAGIC;
 
+  /* Per-CPU state. */
+  t->cpu = cpu_current ();
+
   /* Priority donation */
-  list_init (&t->donor_list);
+  t->base_priority = priority;
+  t->io_boost = 0;
+  list_init (&t->held_locks);
+  list_init (&t->signalled);
   t->wait_on = NULL;
+  t->wait_sema = NULL;
+  t->wait_cond = NULL;
 
   /* Advanced scheduler */
   t->nice
@@ -729,26 +1690,70 @@ init_thread (struct thread *t, const char *name, int priority)
     = (t != initial_thread)
       ? thread_current ()->recent_cpu   /* From parent thread. */
       : 0;
+  t->decay_cnt = decay_cnt;
+
+  /* Fair scheduler */
+  t->vruntime
+    = (t != initial_thread)
+      ? thread_current ()->vruntime     /* From parent thread. */
+      : 0;
+  t->exec_start = 0;
+
+  /* Earliest deadline first */
+  t->edf_runtime = 0;
+  timer_callout_init (&t->edf_timer, edf_release, t);
 
   /* Process hierarchy */
-  list_init (&t->child_list);
+  t->children = NULL;
   t->process = NULL;
+  t->group = NULL;
 
   /* File descriptors. */
-  list_init (&t->fd_list);
-  t->next_fd_no = 2;
+  idtable_init (&t->fds, 2);
+  t->ring = NULL;
+  t->aio = NULL;
 
 #ifdef VM
   /* Supplemental page table. */
   t->spt = NULL;
+  list_init (&t->region_list);
+  t->heap_start = t->brk = NULL;
 
   /* Mmap mappings. */
-  list_init (&t->mmap_list);
-  t->next_mapid = 0;
+  idtable_init (&t->mmaps, 0);
+
+  /* Swap readahead. */
+  t->swap_last_upage = NULL;
+  t->swap_last_slot = BITMAP_ERROR;
+  t->swap_ra_window = SWAP_RA_INIT;
+
+  /* Resident set. */
+  t->rss = 0;
+  t->rss_limit = frame_rss_limit;
+  t->oom_killed = false;
+
+  /* Page fault frequency. */
+  t->pff_last = 0;
+  t->pff_rate = 0;
+  t->pff_suspended = t->pff_waiting = false;
 #endif
 
+  /* Scheduling group */
+  t->sched_group
+    = (t != initial_thread)
+      ? thread_current ()->sched_group  /* From parent thread. */
+      : &sched_groups[0];
+
+  /* I/O group */
+  t->io_group
+    = (t != initial_thread)
+      ? thread_current ()->io_group     /* From parent thread. */
+      : NULL;
+
   old_level = intr_disable ();
-  list_push_back (&all_list, &t->allelem);
+  rcu_list_push_back (&all_list, &t->allelem);
+  t->sched_group->thread_cnt++;
+  block_io_group_join (t->io_group);
   intr_set_level (old_level);
 }
 
@@ -769,22 +1774,619 @@ alloc_frame (struct thread *t, size_t size)
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   the CPU's idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  /* Among the ready threads, the highest priority thread
+     should be scheduled to run first, and among those of the
+     same priority, the one that has been ready the longest. */
+  struct cpu *cpu = cpu_current ();
+  struct thread *t = ready_pop (ready_queue (cpu));
+
+  /* Rather than idle, take work from another CPU. */
+  if (t == NULL)
+    t = ready_steal (cpu);
+  return t != NULL ? t : cpu->idle_thread;
+}
+
+/* Returns the run queue of CPU. */
+static struct run_queue *
+ready_queue (struct cpu *cpu)
+{
+  return &run_queues[cpu->id];
+}
+
+/* Adds T to the back of its CPU's run queue for its priority. */
+static void
+ready_push (struct thread *t)
+{
+  ready_insert (t, false);
+}
+
+/* Adds T to its CPU's run queue, ahead of the threads it ranks
+   equal to if FRONT is true, otherwise behind them. */
+static void
+ready_insert (struct thread *t, bool front)
+{
+  struct run_queue *rq = ready_queue (t->cpu);
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  old_level = spinlock_acquire (&rq->lock);
+  t->edf_queued = edf_eligible (t);
+  if (t->edf_queued)
+    rbtree_insert (&rq->edf_tree, &t->rq_elem);
+  else
+    sched_class->enqueue (rq, t, front);
+  rq->cnt++;
+  spinlock_release (&rq->lock, old_level);
+}
+
+/* Removes T from its CPU's run queue. */
+static void
+ready_remove (struct thread *t)
+{
+  struct run_queue *rq = ready_queue (t->cpu);
+  enum intr_level old_level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  old_level = spinlock_acquire (&rq->lock);
+  if (t->edf_queued)
+    rbtree_remove (&rq->edf_tree, &t->rq_elem);
   else
+    sched_class->dequeue (rq, t);
+  rq->cnt--;
+  spinlock_release (&rq->lock, old_level);
+}
+
+/* Returns the ready thread in RQ that should run next, without
+   removing it from RQ, or a null pointer if RQ is empty. */
+static struct thread *
+ready_max (struct run_queue *rq)
+{
+  enum intr_level old_level = spinlock_acquire (&rq->lock);
+  struct thread *t = NULL;
+
+  if (!rbtree_empty (&rq->edf_tree))
+    t = rbtree_entry (rbtree_min (&rq->edf_tree), struct thread, rq_elem);
+  else if (rq->cnt != 0)
+    t = sched_class->peek (rq);
+  spinlock_release (&rq->lock, old_level);
+  return t;
+}
+
+/* Removes and returns the ready thread in RQ that should run
+   next, or returns a null pointer if RQ is empty. */
+static struct thread *
+ready_pop (struct run_queue *rq)
+{
+  enum intr_level old_level = spinlock_acquire (&rq->lock);
+  struct thread *t = NULL;
+
+  if (!rbtree_empty (&rq->edf_tree))
     {
-      /* Among the ready threads, the highest priority thread
-         should be scheduled to run first.*/
-      struct thread *t
-        = list_entry (list_max (&ready_list, thread_priority_less, NULL),
-                      struct thread, elem);
-      list_remove(&t->elem);
-      return t;
+      t = rbtree_entry (rbtree_pop_min (&rq->edf_tree),
+                        struct thread, rq_elem);
+      rq->cnt--;
     }
+  else if (rq->cnt != 0)
+    {
+      t = sched_class->pick_next (rq);
+      rq->cnt--;
+    }
+  spinlock_release (&rq->lock, old_level);
+  return t;
+}
+
+/* Returns the run queue of a CPU other than SELF with threads
+   to spare, the one with the highest load average, or with the
+   most ready threads among equals.  Returns a null pointer if
+   no other queue has any ready thread. */
+static struct run_queue *
+ready_busiest (struct cpu *self)
+{
+  struct run_queue *busiest = NULL;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct run_queue *rq = &run_queues[i];
+      if (i == self->id || !cpus[i].started || rq->cnt == 0)
+        continue;
+      if (busiest == NULL || rq->load > busiest->load
+          || (rq->load == busiest->load && rq->cnt > busiest->cnt))
+        busiest = rq;
+    }
+  return busiest;
+}
+
+/* Moves a ready thread from the busiest other CPU's run queue
+   to SELF, and returns it without putting it in SELF's run
+   queue.  The scheduling class chooses the thread; EDF threads
+   stay where they are.  Returns a null pointer if there is
+   nothing to steal. */
+static struct thread *
+ready_steal (struct cpu *self)
+{
+  struct run_queue *rq = ready_busiest (self);
+  enum intr_level old_level;
+  struct thread *stolen;
+
+  if (rq == NULL)
+    return NULL;
+
+  old_level = spinlock_acquire (&rq->lock);
+  stolen = (rq->cnt > rbtree_size (&rq->edf_tree)
+            ? sched_class->steal (rq)
+            : NULL);
+  if (stolen != NULL)
+    {
+      rq->cnt--;
+      stolen->cpu = self;
+    }
+  spinlock_release (&rq->lock, old_level);
+  return stolen;
+}
+
+/* Updates the current CPU's run queue load average, then steals
+   a thread from the busiest other queue if it is loaded
+   BALANCE_MARGIN or more above this one.  Called from the timer
+   interrupt every BALANCE_TICKS ticks. */
+static void
+ready_balance (void)
+{
+  struct cpu *cpu = cpu_current ();
+  struct run_queue *rq = ready_queue (cpu);
+  struct run_queue *busiest;
+  struct thread *t;
+
+  ASSERT (intr_context ());
+
+  rq->load = load_avg_formula (rq->load,
+                               rq->cnt + !is_idle (running_thread ()));
+
+  busiest = ready_busiest (cpu);
+  if (busiest != NULL
+      && sub_ff (busiest->load, rq->load) >= i2f (BALANCE_MARGIN))
+    {
+      t = ready_steal (cpu);
+      if (t != NULL)
+        {
+          ready_push (t);
+          if (preempts (t, running_thread ()))
+            intr_yield_on_return ();
+        }
+    }
+}
+
+/* Returns true if ready thread T should preempt running thread
+   CUR: if T has an EDF job to run with an earlier deadline than
+   CUR's, or else if neither has one and T's scheduling class
+   says so. */
+static bool
+preempts (const struct thread *t, const struct thread *cur)
+{
+  if (edf_eligible (cur))
+    return edf_eligible (t) && t->edf_deadline < cur->edf_deadline;
+  return edf_eligible (t) || sched_class->preempts (t, cur);
+}
+
+/* Returns true if T has an EDF job with budget left, and so is
+   scheduled by deadline. */
+static bool
+edf_eligible (const struct thread *t)
+{
+  return t->edf_runtime != 0 && !t->edf_done && t->edf_budget > 0;
+}
+
+/* Orders threads in an EDF tree by deadline. */
+static bool
+edf_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+          void *aux UNUSED)
+{
+  const struct thread *a = rbtree_entry (a_, struct thread, rq_elem);
+  const struct thread *b = rbtree_entry (b_, struct thread, rq_elem);
+
+  return a->edf_deadline < b->edf_deadline;
+}
+
+/* Adds T to the multi-level queue RQ, at the front of the list
+   for its priority if FRONT is true, otherwise at the back. */
+static void
+mlq_enqueue (struct run_queue *rq, struct thread *t, bool front)
+{
+  int pri = t->priority - PRI_MIN;
+
+  if (front)
+    list_push_front (&rq->lists[pri], &t->elem);
+  else
+    list_push_back (&rq->lists[pri], &t->elem);
+  rq->mask[pri / 32] |= 1u << (pri % 32);
+}
+
+/* Removes T from the multi-level queue RQ. */
+static void
+mlq_dequeue (struct run_queue *rq, struct thread *t)
+{
+  int pri = t->priority - PRI_MIN;
+
+  list_remove (&t->elem);
+  if (list_empty (&rq->lists[pri]))
+    rq->mask[pri / 32] &= ~(1u << (pri % 32));
+}
+
+/* Returns the highest priority nonempty list in multi-level
+   queue RQ, or a null pointer if RQ is empty. */
+static struct list *
+mlq_max_list (struct run_queue *rq)
+{
+  int i;
+
+  ASSERT (spinlock_held (&rq->lock));
+
+  for (i = DIV_ROUND_UP (PRI_CNT, 32) - 1; i >= 0; i--)
+    if (rq->mask[i] != 0)
+      return &rq->lists[i * 32 + 31 - __builtin_clz (rq->mask[i])];
+  return NULL;
+}
+
+/* Returns the first thread of the highest priority in
+   multi-level queue RQ, which must not be empty. */
+static struct thread *
+mlq_peek (struct run_queue *rq)
+{
+  return list_entry (list_front (mlq_max_list (rq)), struct thread, elem);
+}
+
+/* Removes and returns the first thread of the highest priority
+   in multi-level queue RQ, which must not be empty. */
+static struct thread *
+mlq_pick_next (struct run_queue *rq)
+{
+  struct thread *t = mlq_peek (rq);
+
+  mlq_dequeue (rq, t);
+  return t;
+}
+
+/* Removes and returns the highest priority thread in multi-level
+   queue RQ that holds no lock, and so cannot be receiving a
+   priority donation: a thread other threads wait on is best left
+   where it is already queued, since they queued behind it there.
+   Returns a null pointer if every thread holds a lock. */
+static struct thread *
+mlq_steal (struct run_queue *rq)
+{
+  int pri;
+
+  for (pri = PRI_CNT - 1; pri >= 0; pri--)
+    {
+      struct list *list = &rq->lists[pri];
+      struct list_elem *e;
+
+      for (e = list_begin (list); e != list_end (list); e = list_next (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          if (list_empty (&t->held_locks))
+            {
+              mlq_dequeue (rq, t);
+              return t;
+            }
+        }
+    }
+  return NULL;
+}
+
+/* 2**32 divided by the weight of each nice value from -20
+   through 19, rounded, for the fair class, so that scaling by a
+   weight's inverse is a multiplication and a shift.  Nice 0 has
+   weight 1024, and each weight is about 1.25 times the next, so
+   that each step in nice changes a thread's share of the CPU
+   relative to another's by about 10%. */
+static const uint32_t fair_inv_weights[40] =
+  {
+        48388,     59856,     76040,     92818,    118348,
+       147320,    184698,    229616,    287308,    360437,
+       449829,    563644,    704093,    875809,   1099582,
+      1376151,   1717300,   2157191,   2708050,   3363326,
+      4194304,   5237765,   6557202,   8165337,  10153587,
+     12820798,  15790321,  19976592,  24970740,  31350126,
+     39045157,  49367440,  61356676,  76695844,  95443717,
+    119304647, 148102320, 186737708, 238609294, 286331153,
+  };
+
+/* Returns the virtual runtime of NS nanoseconds run by T: NS
+   scaled by the weight of nice 0 over T's weight.  Nice values
+   above 19 count as 19. */
+static int64_t
+fair_scale (const struct thread *t, int64_t ns)
+{
+  int nice = t->nice < -20 ? -20 : t->nice > 19 ? 19 : t->nice;
+
+  /* 2**32 / weight * ns / 2**22 = ns * 1024 / weight. */
+  return (ns * fair_inv_weights[nice + 20]) >> 22;
+}
+
+/* Returns T's virtual runtime, including, if T is running, the
+   time it has run since it was last charged. */
+static int64_t
+fair_vruntime (const struct thread *t)
+{
+  if (t->status != THREAD_RUNNING || is_idle ((struct thread *) t))
+    return t->vruntime;
+  return t->vruntime + fair_scale (t, clock_ns () - t->exec_start);
+}
+
+/* Charges running thread T for the time it has run since it was
+   last charged. */
+static void
+fair_charge (struct thread *t)
+{
+  int64_t now = clock_ns ();
+
+  t->vruntime += fair_scale (t, now - t->exec_start);
+  t->exec_start = now;
+}
+
+/* Adds T to the fair run queue RQ, placing a woken thread near
+   the front, as described above.  If FRONT is true, T also goes
+   ahead of every thread in RQ. */
+static void
+fair_enqueue (struct run_queue *rq, struct thread *t, bool front)
+{
+  if (t->status == THREAD_RUNNING)
+    fair_charge (t);
+  else if (t->vruntime < rq->min_vruntime - FAIR_SLEEPER_NS)
+    t->vruntime = rq->min_vruntime - FAIR_SLEEPER_NS;
+
+  if (front && !rbtree_empty (&rq->fair_tree))
+    {
+      int64_t first = fair_peek (rq)->vruntime;
+      if (t->vruntime >= first)
+        t->vruntime = first - 1;
+    }
+  rbtree_insert (&rq->fair_tree, &t->rq_elem);
+}
+
+/* Removes T from the fair run queue RQ. */
+static void
+fair_dequeue (struct run_queue *rq, struct thread *t)
+{
+  rbtree_remove (&rq->fair_tree, &t->rq_elem);
+}
+
+/* Returns the thread in fair run queue RQ, which must not be
+   empty, with the least virtual runtime. */
+static struct thread *
+fair_peek (struct run_queue *rq)
+{
+  return rbtree_entry (rbtree_min (&rq->fair_tree),
+                       struct thread, rq_elem);
+}
+
+/* Removes and returns the thread in fair run queue RQ, which
+   must not be empty, with the least virtual runtime, and
+   advances RQ's `min_vruntime' to it. */
+static struct thread *
+fair_pick_next (struct run_queue *rq)
+{
+  struct thread *t = rbtree_entry (rbtree_pop_min (&rq->fair_tree),
+                                   struct thread, rq_elem);
+
+  if (t->vruntime > rq->min_vruntime)
+    rq->min_vruntime = t->vruntime;
+  return t;
+}
+
+/* Removes and returns the thread in fair run queue RQ with the
+   most virtual runtime, the one that would wait longest there,
+   or a null pointer if RQ is empty.  Its virtual runtime is
+   brought into line with other queues when it is next woken. */
+static struct thread *
+fair_steal (struct run_queue *rq)
+{
+  struct rbtree_elem *e = rbtree_max (&rq->fair_tree);
+
+  if (e == NULL)
+    return NULL;
+  rbtree_remove (&rq->fair_tree, e);
+  return rbtree_entry (e, struct thread, rq_elem);
+}
+
+/* Returns true if ready thread T has run FAIR_GRAN_NS of virtual
+   runtime less than running thread CUR. */
+static bool
+fair_preempts (const struct thread *t, const struct thread *cur)
+{
+  return fair_vruntime (t) + FAIR_GRAN_NS < fair_vruntime (cur);
+}
+
+/* Charges the running thread for the tick, and preempts it if
+   it has run long enough ahead of the next thread. */
+static void
+fair_tick (bool idle)
+{
+  struct thread *cur = running_thread ();
+  struct run_queue *rq = ready_queue (cur->cpu);
+  struct thread *next;
+
+  if (idle || is_idle (cur))
+    return;
+
+  fair_charge (cur);
+  next = ready_max (rq);
+  if (next != NULL && preempts (next, cur))
+    intr_yield_on_return ();
+}
+
+/* Charges PREV, unless it is already queued and so was charged
+   by fair_enqueue(), and starts charging NEXT, as the CPU
+   switches from PREV to NEXT. */
+static void
+fair_dispatch (struct thread *prev, struct thread *next)
+{
+  int64_t now = clock_ns ();
+
+  if (prev->status != THREAD_READY && !is_idle (prev))
+    prev->vruntime += fair_scale (prev, now - prev->exec_start);
+  next->exec_start = now;
+}
+
+/* Orders threads in a fair run queue by virtual runtime. */
+static bool
+fair_less (const struct rbtree_elem *a_, const struct rbtree_elem *b_,
+           void *aux UNUSED)
+{
+  const struct thread *a = rbtree_entry (a_, struct thread, rq_elem);
+  const struct thread *b = rbtree_entry (b_, struct thread, rq_elem);
+
+  return a->vruntime < b->vruntime;
+}
+
+/* Returns the list of threads in T's scheduling group that are
+   ready in run queue RQ. */
+static struct list *
+stride_queue (struct run_queue *rq, const struct thread *t)
+{
+  return &t->sched_group->queues[rq - run_queues];
+}
+
+/* Adds T to run queue RQ in its scheduling group's list, after
+   the threads of higher priority and, if FRONT is false, of
+   equal priority.  A group that had no thread ready catches up
+   with the pass of the others, so that it cannot bank time
+   while it sleeps. */
+static void
+stride_enqueue (struct run_queue *rq, struct thread *t, bool front)
+{
+  struct sched_group *g = t->sched_group;
+  struct list *q = stride_queue (rq, t);
+  struct list_elem *e;
+
+  if (list_empty (q) && g->pass < rq->stride_pass)
+    g->pass = rq->stride_pass;
+
+  for (e = list_begin (q); e != list_end (q); e = list_next (e))
+    {
+      struct thread *u = list_entry (e, struct thread, elem);
+      if (front ? u->priority <= t->priority : u->priority < t->priority)
+        break;
+    }
+  list_insert (e, &t->elem);
+}
+
+/* Removes T from run queue RQ. */
+static void
+stride_dequeue (struct run_queue *rq UNUSED, struct thread *t)
+{
+  list_remove (&t->elem);
+}
+
+/* Returns the scheduling group with threads ready in RQ, which
+   must not be empty, that has the lowest pass. */
+static struct sched_group *
+stride_next_group (struct run_queue *rq)
+{
+  struct sched_group *next = NULL;
+  int i;
+
+  for (i = 0; i < SCHED_GROUP_MAX; i++)
+    {
+      struct sched_group *g = &sched_groups[i];
+      if (!list_empty (&g->queues[rq - run_queues])
+          && (next == NULL || g->pass < next->pass))
+        next = g;
+    }
+  ASSERT (next != NULL);
+  return next;
+}
+
+/* Returns the highest priority thread in run queue RQ, which
+   must not be empty, of the group with the lowest pass. */
+static struct thread *
+stride_peek (struct run_queue *rq)
+{
+  struct sched_group *g = stride_next_group (rq);
+
+  return list_entry (list_front (&g->queues[rq - run_queues]),
+                     struct thread, elem);
+}
+
+/* Removes and returns the thread stride_peek() returns, and
+   advances RQ's pass to its group's. */
+static struct thread *
+stride_pick_next (struct run_queue *rq)
+{
+  struct sched_group *g = stride_next_group (rq);
+  struct list *q = &g->queues[rq - run_queues];
+
+  if (g->pass > rq->stride_pass)
+    rq->stride_pass = g->pass;
+  return list_entry (list_pop_front (q), struct thread, elem);
+}
+
+/* Removes and returns a thread from run queue RQ that holds no
+   lock, for the reason given above mlq_steal(), or returns a
+   null pointer if there is none. */
+static struct thread *
+stride_steal (struct run_queue *rq)
+{
+  int i;
+
+  for (i = 0; i < SCHED_GROUP_MAX; i++)
+    {
+      struct list *q = &sched_groups[i].queues[rq - run_queues];
+      struct list_elem *e;
+
+      for (e = list_begin (q); e != list_end (q); e = list_next (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          if (list_empty (&t->held_locks))
+            {
+              list_remove (e);
+              return t;
+            }
+        }
+    }
+  return NULL;
+}
+
+/* Returns true if ready thread T should preempt running thread
+   CUR: within a group, if T has the higher priority, and between
+   groups, if T's group has the lower pass. */
+static bool
+stride_preempts (const struct thread *t, const struct thread *cur)
+{
+  if (t->sched_group == cur->sched_group)
+    return priority_preempts (t, cur);
+  return t->sched_group->pass < cur->sched_group->pass;
+}
+
+/* Advances the pass of the running thread's group for the tick,
+   and preempts the thread if another group is now behind. */
+static void
+stride_tick (bool idle)
+{
+  struct thread *cur = running_thread ();
+  struct thread *next;
+
+  if (idle || is_idle (cur))
+    return;
+
+  cur->sched_group->pass += cur->sched_group->stride;
+  next = ready_max (ready_queue (cur->cpu));
+  if (next != NULL && preempts (next, cur))
+    intr_yield_on_return ();
+}
+
+/* Returns true if T is the idle thread of the CPU it runs on. */
+static bool
+is_idle (struct thread *t)
+{
+  return t == t->cpu->idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -814,7 +2416,7 @@ thread_schedule_tail (struct thread *prev)
   cur->status = THREAD_RUNNING;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  cur->cpu->thread_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -829,10 +2431,81 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (rcu_one_cpu ())
+        free_thread_page (prev);
+      else
+        call_rcu (&prev->rcu_head, free_thread_rcu);
     }
 }
 
+/* call_rcu() callback that frees the page of a dead thread, once
+   no thread_foreach() on another CPU can still be visiting it. */
+static void
+free_thread_rcu (struct rcu_head *head)
+{
+  enum intr_level old_level = intr_disable ();
+
+  free_thread_page (rcu_entry (head, struct thread, rcu_head));
+  intr_set_level (old_level);
+}
+
+/* Returns a page for a new thread, from the page cache if it has
+   one, or else from the page allocator, or a null pointer if
+   memory is short.  The page is not zeroed. */
+static struct thread *
+get_thread_page (void)
+{
+  enum intr_level old_level = spinlock_acquire (&page_cache_lock);
+  struct thread *t = NULL;
+
+  if (page_cache_cnt > 0)
+    {
+      t = page_cache[--page_cache_cnt];
+      if (++page_cache_hits >= PAGE_CACHE_DECAY)
+        {
+          page_cache_hits = 0;
+          if (page_cache_limit > PAGE_CACHE_MIN)
+            page_cache_limit /= 2;
+        }
+    }
+  else
+    {
+      page_cache_hits = 0;
+      if (page_cache_limit < PAGE_CACHE_MAX)
+        page_cache_limit *= 2;
+    }
+  spinlock_release (&page_cache_lock, old_level);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Puts the page of dead thread T in the page cache, or frees it
+   if the cache is full.  Also frees any pages that the cache has
+   kept beyond its limit since the limit last shrank. */
+static void
+free_thread_page (struct thread *t)
+{
+  enum intr_level old_level;
+  void *extra = NULL;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  old_level = spinlock_acquire (&page_cache_lock);
+  if (page_cache_cnt < page_cache_limit)
+    {
+      page_cache[page_cache_cnt++] = t;
+      t = NULL;
+    }
+  else if (page_cache_cnt > page_cache_limit)
+    extra = page_cache[--page_cache_cnt];
+  spinlock_release (&page_cache_lock, old_level);
+
+  if (t != NULL)
+    palloc_free_page (t);
+  if (extra != NULL)
+    palloc_free_page (extra);
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -850,9 +2523,33 @@ schedule (void)
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
+  ASSERT (cur->rcu_nesting == 0);
+
+  /* Whichever thread runs next, this CPU has no RCU reader. */
+  rcu_note_qs ();
+  cur->rcu_resched = false;
 
+  if (sched_class->dispatch != NULL)
+    sched_class->dispatch (cur, next);
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace_switch (cur, next);
+      TRACE (TRACE_SCHED, TRACE_SWITCH, cur->tid, next->tid);
+      /* A thread that blocks gives up the CPU voluntarily; one
+         that is still ready to run was preempted, or yielded. */
+      int64_t now = clock_ns ();
+
+      if (cur->status == THREAD_BLOCKED)
+        cur->rusage.nvcsw++;
+      else if (cur->status == THREAD_READY)
+        cur->rusage.nivcsw++;
+      cur->rusage.run_ns += now - cur->run_start;
+      next->run_start = now;
+      pmc_account (&cur->rusage);
+      fpu_switch (cur);
+
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -869,6 +2566,57 @@ allocate_tid (void)
 
   return tid;
 }
+
+/* Adds T, whose tid has just been allocated, to TID_TABLE. */
+static void
+tid_table_insert (struct thread *t)
+{
+  lock_acquire (&tid_lock);
+  ohash_insert (&tid_table, &t->tid_elem);
+  lock_release (&tid_lock);
+}
+
+/* Returns the thread whose tid is TID, or a null pointer if no
+   such thread exists or it has exited.
+
+   The thread found may exit at any time, but its struct thread
+   is not freed before the caller is done with it: this function
+   returns it inside a read-side critical section, begun with
+   rcu_read_lock(), which the caller must end with
+   rcu_read_unlock(), and in which the caller may not sleep. */
+struct thread *
+thread_find (tid_t tid)
+{
+  struct ohash_elem *e;
+
+  ASSERT (!intr_context ());
+
+  lock_acquire (&tid_lock);
+  tid_key.tid = tid;
+  e = ohash_find (&tid_table, &tid_key.tid_elem);
+  if (e != NULL)
+    rcu_read_lock ();
+  lock_release (&tid_lock);
+  return e != NULL ? ohash_entry (e, struct thread, tid_elem) : NULL;
+}
+
+/* Returns the hash value of the thread with element E in
+   TID_TABLE. */
+static unsigned
+tid_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  return hash_int (ohash_entry (e, struct thread, tid_elem)->tid);
+}
+
+/* Returns true if the thread with element A in TID_TABLE has a
+   lower tid than the one with B. */
+static bool
+tid_less (const struct ohash_elem *a, const struct ohash_elem *b,
+          void *aux UNUSED)
+{
+  return (ohash_entry (a, struct thread, tid_elem)->tid
+          < ohash_entry (b, struct thread, tid_elem)->tid);
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
@@ -2,8 +2,18 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <hash.h>
+#include <heap.h>
+#include <idtable.h>
 #include <list.h>
+#include <rbtree.h>
+#include <rusage.h>
 #include <stdint.h>
+#include <vmstat.h>
+#include "devices/timer.h"
+#include "filesys/off_t.h"
+#include "threads/cpu.h"
+#include "threads/rcu.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,8 +34,19 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Defined in threads/thread.c. */
+struct sched_group;
+
+/* Defined in devices/block.c. */
+struct io_group;
+
 /* Defined in userprog/process.h. */
 struct process;
+struct thread_group;
+
+/* Defined in threads/synch.h and threads/synch.c. */
+struct semaphore;
+struct semaphore_elem;
 
 /* Defined in filesys/file.c. */
 struct file;
@@ -95,36 +116,90 @@ struct thread
     uint8_t *stack;                     /* Saved stack pointer. */
     int priority;                       /* Priority. */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct ohash_elem tid_elem;         /* Element in table by tid. */
+    struct cpu *cpu;                    /* CPU whose run queue it uses. */
 
     /* Owned by thread.c. */
-    int64_t wakeup_ticks;               /* Wake-up ticks since OS booted. */
-
-    /* Owned by thread.c. */
-    int original_priority;              /* Original priority */
-    struct list donor_list;             /* Priority donors */
-    struct list_elem donor_list_elem;
+    int base_priority;                  /* Priority before donations. */
+    int io_boost;                       /* Temporary boost after I/O. */
+    struct list held_locks;             /* Locks held, for donation. */
+    struct list signalled;              /* Signallers, for donation. */
     struct lock *wait_on;               /* A lock that blocked me */
 
     /* Owned by thread.c. */
     int nice;                           /* mlfqs. */
     int recent_cpu;                     /* mlfqs, fixed-point. */
+    unsigned decay_cnt;                 /* mlfqs, # of decays applied. */
+
+    /* Owned by thread.c. */
+    struct rbtree_elem rq_elem;         /* fair or EDF run queue element. */
+    int64_t vruntime;                   /* fair, weighted ns run. */
+    int64_t exec_start;                 /* fair, time last charged. */
+
+    /* Owned by thread.c. */
+    int64_t edf_runtime;                /* EDF, ticks per period, or 0. */
+    int64_t edf_rel_deadline;           /* EDF, deadline after release. */
+    int64_t edf_period;                 /* EDF, ticks between releases. */
+    int64_t edf_deadline;               /* EDF, current job's deadline. */
+    int64_t edf_budget;                 /* EDF, ticks left this job. */
+    bool edf_done;                      /* EDF, job finished early? */
+    bool edf_waiting;                   /* EDF, blocked until release? */
+    bool edf_queued;                    /* EDF, in EDF run queue? */
+    unsigned edf_misses;                /* EDF, deadlines missed. */
+    struct timer_callout edf_timer;     /* EDF, next release. */
+
+    /* Owned by thread.c. */
+    struct sched_group *sched_group;    /* Group sharing CPU tickets. */
+
+    /* Owned by devices/block.c. */
+    struct io_group *io_group;          /* Group sharing I/O limits,
+                                           or null for the default. */
+
+    /* Shared between thread.c and threads/rcu.c. */
+    int rcu_nesting;                    /* Depth of RCU read sections. */
+    bool rcu_resched;                   /* Preemption put off by RCU? */
+    struct rcu_head rcu_head;           /* Frees the page once unseen. */
+
+    /* Owned by threads/fpu.c. */
+    void *fpu;                          /* FXSAVE area, if FPU used. */
+    struct cpu *fpu_cpu;                /* CPU that last loaded it. */
+
+    /* Owned by thread.c. */
+    struct rusage rusage;               /* Resources used. */
+    int64_t run_start;                  /* Time last switched to. */
+    int64_t ready_ns;                   /* Time made ready, if traced. */
+    bool woken;                         /* Made ready by a wakeup? */
+
+    /* Owned by userprog/process.c. */
+    struct rusage child_rusage;         /* Used by waited-for children. */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by synch.c. */
+    struct heap_elem wait_elem;         /* Element in semaphore waiters. */
+    struct semaphore *wait_sema;        /* Semaphore waited on, or null. */
+    struct semaphore_elem *wait_cond;   /* Condition waited on, or null. */
+    unsigned wait_seq;                  /* Arrival order among waiters. */
+
     /* Shared between thread.c and
        userprog/process.c. */
     struct process *process;            /* My process control block. */
-    struct list child_list;             /* List of child process control block. */
+    struct ohash *children;             /* Child process control blocks,
+                                           by tid, or null if none. */
+    struct thread_group *group;         /* Threads sharing my address
+                                           space, or null if none. */
 
     /* Shared between thread.c and
        userprog/syscall.c. */
-    struct list fd_list;                /* List of file descriptors. */
-    int next_fd_no;                     /* Next file descriptor number. */
+    struct idtable fds;                 /* File descriptors, by number. */
+    struct ring *ring;                  /* System call ring, if any. */
+    struct aio *aio;                    /* Asynchronous ring operations. */
 
     /* Shared between thread.c and
        userprog/process.c. */
     struct file *bin;                   /* A user program. */
+    struct file *lib;                   /* Its shared library, if any. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
@@ -134,7 +209,14 @@ struct thread
 #ifdef VM
     /* Shared between userprog/process.c
        and vm/page.c. */
-    struct hash *spt;                   /* Supplemental page table. */
+    struct ohash *spt;                  /* Supplemental page table. */
+
+    /* Owned by vm/page.c. */
+    struct list region_list;            /* Regions, sorted by address. */
+    struct region *stack_region;        /* Stack reservation. */
+    void *stack_low;                    /* Lowest stack page created. */
+    void *heap_start;                   /* Start of heap. */
+    void *brk;                          /* End of heap, the break. */
 
     /* Shared between userprog/syscall.c
        and userprog/exception.c. */
@@ -142,23 +224,95 @@ struct thread
 
     /* Shared between thread.c and
        userprog/syscall.c */
-    struct list mmap_list;              /* List of mmap mappings. */
-    int next_mapid;                     /* Next mmap id. */
+    struct idtable mmaps;               /* Mmap mappings, by id. */
+
+    /* Shared between vm/frame.c and vm/page.c,
+       protected by the frame table lock. */
+    void *swap_last_upage;              /* Last page swapped out. */
+    size_t swap_last_slot;              /* Its swap slot. */
+    size_t swap_ra_window;              /* Swap readahead window. */
+    size_t rss;                         /* Frames holding my pages. */
+    size_t rss_limit;                   /* Maximum RSS, or 0. */
+    bool oom_killed;                    /* Killed for lack of swap? */
+
+    /* Owned by vm/pff.c. */
+    long long pff_last;                 /* Major faults at last sample. */
+    unsigned pff_rate;                  /* Major faults in last period. */
+    bool pff_suspended;                 /* Suspended for load control? */
+    bool pff_waiting;                   /* Blocked while suspended? */
+
+    /* Owned by vm/prepage.c. */
+    off_t *fault_trace;                 /* Executable offsets faulted. */
+    size_t fault_trace_cnt;             /* Number of offsets recorded. */
+
+    /* Owned by vm/vmstat.c. */
+    struct vmstat vmstat;               /* VM statistics. */
+#endif
+
+#ifdef FILESYS
+    /* Owned by filesys/journal.c. */
+    int journal_depth;                  /* Nesting of journal_begin(). */
 #endif
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
 
-/* If false (default), use round-robin scheduler.
-   If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+/* Defined in threads/thread.c. */
+struct run_queue;
+
+/* Scheduling class: the policy that decides which ready thread
+   runs next and how thread priorities change.  One class, chosen
+   at boot by thread_set_sched_class(), schedules every thread.
+
+   The run queue operations are called with interrupts off and
+   the run queue locked, and keep whatever per-class state the
+   class keeps in struct run_queue.  The hooks below them may be
+   null if the class has nothing to do. */
+struct sched_class
+  {
+    const char *name;                   /* Name, as for "-sched". */
+    bool donation;                      /* Priorities set and donated? */
+    int64_t period;                     /* Ticks between periodic work
+                                           that `tick' does even when
+                                           idle, or 0. */
+
+    /* Run queue operations. */
+    void (*enqueue) (struct run_queue *, struct thread *, bool front);
+    void (*dequeue) (struct run_queue *, struct thread *);
+    struct thread *(*peek) (struct run_queue *);
+    struct thread *(*pick_next) (struct run_queue *);
+    struct thread *(*steal) (struct run_queue *);
+
+    /* Returns true if ready thread T should preempt running
+       thread CUR. */
+    bool (*preempts) (const struct thread *t, const struct thread *cur);
+
+    /* Hooks. */
+    void (*tick) (bool idle);           /* Each timer tick. */
+    void (*wake) (struct thread *);     /* Updates a blocked thread. */
+    void (*nice_changed) (struct thread *);
+    void (*dispatch) (struct thread *prev, struct thread *next);
+  };
+
+extern const struct sched_class *sched_class;
+
+/* True if the multi-level feedback queue scheduler is in use,
+   false (default) for the priority scheduler.  Controlled by
+   kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* True to trace scheduler latency.  Controlled by kernel
+   command-line option "-slt". */
+extern bool thread_trace_sched;
+
 void thread_init (void);
+bool thread_set_sched_class (const char *name);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_tick (void);
+bool thread_idling (void);
 void thread_print_stats (void);
 
 typedef void thread_func (void *aux);
@@ -173,19 +327,32 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+bool thread_yield_to (struct thread *);
+bool thread_need_resched (void);
+void cond_resched (void);
 
-void thread_sleep (int64_t wakeup_ticks);
-void thread_wakeup (int64_t ticks);
+bool thread_set_edf (int64_t runtime, int64_t deadline, int64_t period);
+void thread_edf_wait (void);
+
+#define SCHED_GROUP_TICKETS 100         /* Default group's tickets. */
+#define SCHED_GROUP_TICKETS_MAX 10000   /* Most tickets for a group. */
+int thread_new_sched_group (int tickets);
+
+void thread_get_rusage (struct thread *, struct rusage *);
+void thread_add_rusage (struct rusage *, const struct rusage *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
+struct thread *thread_find (tid_t);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_change_priority (struct thread *, int);
 
-void thread_donate_priority (struct thread *);
-void thread_recall_donation (struct thread *);
+int thread_effective_priority (struct thread *);
+void thread_boost (struct thread *, int boost);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
@@ -196,15 +363,4 @@ bool thread_priority_less (const struct list_elem *,
                            const struct list_elem *,
                            void *);
 
-/* Getters. */
-int mlfqs_priority_formula (struct thread *);
-int mlfqs_recent_cpu_formula (struct thread *);
-int mlfqs_load_avg_formula (void);
-
-/* Setters. */
-void mlfqs_increment_recent_cpu (void);
-void mlfqs_recalc_priority (struct thread *, void *);
-void mlfqs_recalc_recent_cpu (struct thread *, void *);
-void mlfqs_update_load_avg (void);
-
 #endif /* threads/thread.h */
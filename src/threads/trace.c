@@ -0,0 +1,157 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* Static tracepoints, enabled by category with the
+   "-trace=CATEGORY[,CATEGORY]..." kernel command-line option.
+
+   Each TRACE() site records a fixed-size event, stamped with the
+   time stamp counter, into the ring of the CPU it runs on.  A
+   record's slot is claimed with one atomic increment of the
+   ring's head, so that recording takes no lock and an interrupt
+   that records an event of its own in the middle of another
+   takes the next slot.  Once a ring fills, new events overwrite
+   the oldest, so that the rings always hold the most recent
+   TRACE_RING_PAGES pages of events.
+
+   At shutdown, trace_done() saves the header and rings to the
+   scratch device as file "trace", where "pintos --trace"
+   retrieves it, or, without a scratch device, prints the events
+   to the console. */
+uint32_t trace_mask;
+
+#define TRACE_RING_PAGES 16
+#define TRACE_RING_SIZE (TRACE_RING_PAGES * PGSIZE \
+                         / sizeof (struct trace_record))
+
+static struct trace_header *header;    /* Header page, then rings. */
+static struct trace_record *rings;     /* Ring for CPU I at I * SIZE. */
+
+/* Category names, for the command line. */
+static const char *category_names[TRACE_CATEGORY_CNT] =
+  {"sched", "lock", "vm", "block", "syscall"};
+
+/* Event names, for printing. */
+static const char *event_names[TRACE_EVENT_CNT] =
+  {"switch", "wakeup", "lock-contend", "lock-acquire", "page-load",
+   "evict", "swap-out", "swap-in", "block-read", "block-write",
+   "syscall-enter", "syscall-exit"};
+
+/* Enables tracing of each category in CATEGORIES, a
+   comma-separated list of category names or "all".  Returns
+   true if successful, false if a name is unknown. */
+bool
+trace_enable (char *categories)
+{
+  char *name, *save_ptr;
+
+  for (name = strtok_r (categories, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      int i;
+
+      if (!strcmp (name, "all"))
+        {
+          trace_mask = (1u << TRACE_CATEGORY_CNT) - 1;
+          continue;
+        }
+      for (i = 0; i < TRACE_CATEGORY_CNT; i++)
+        if (!strcmp (name, category_names[i]))
+          break;
+      if (i >= TRACE_CATEGORY_CNT)
+        return false;
+      trace_mask |= 1u << i;
+    }
+  return true;
+}
+
+/* Allocates the rings, if any category is enabled. */
+void
+trace_init (void)
+{
+  if (trace_mask == 0)
+    return;
+
+  header = palloc_get_multiple (PAL_ZERO, 1 + cpu_cnt * TRACE_RING_PAGES);
+  if (header == NULL)
+    {
+      printf ("trace: out of memory, tracing off\n");
+      trace_mask = 0;
+      return;
+    }
+  rings = (struct trace_record *) ((uint8_t *) header + PGSIZE);
+  memcpy (header->magic, "TRCE", 4);
+  header->record_size = sizeof (struct trace_record);
+  header->ring_cnt = cpu_cnt;
+  header->ring_size = TRACE_RING_SIZE;
+}
+
+/* Records EVENT with arguments ARG0 and ARG1.  Use TRACE()
+   instead of calling this directly. */
+void
+trace_record (enum trace_event event, uint32_t arg0, uint32_t arg1)
+{
+  int cpu = cpu_current ()->id;
+  uint32_t slot = __sync_fetch_and_add (&header->head[cpu], 1);
+  struct trace_record *r
+    = &rings[cpu * TRACE_RING_SIZE + slot % TRACE_RING_SIZE];
+
+  r->tsc = clock_cycles ();
+  r->event = event;
+  r->arg[0] = arg0;
+  r->arg[1] = arg1;
+}
+
+/* Stops tracing and saves the events recorded. */
+void
+trace_done (void)
+{
+  size_t page_cnt = 1 + cpu_cnt * TRACE_RING_PAGES;
+  uint32_t cnt = 0;
+  int cpu;
+
+  if (header == NULL)
+    return;
+  trace_mask = 0;
+
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    cnt += header->head[cpu];
+  printf ("Trace: %"PRIu32" events, ", cnt);
+
+#ifdef FILESYS
+  if (intr_get_level () == INTR_ON
+      && fsutil_save ("trace", header, page_cnt * PGSIZE))
+    printf ("saved to scratch device\n");
+  else
+#endif
+    {
+      /* Print each ring's events, oldest first. */
+      printf ("not saved:\n");
+      for (cpu = 0; cpu < cpu_cnt; cpu++)
+        {
+          uint32_t head = header->head[cpu];
+          uint32_t i = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+          for (; i != head; i++)
+            {
+              struct trace_record *r
+                = &rings[cpu * TRACE_RING_SIZE + i % TRACE_RING_SIZE];
+              printf ("trace: %d %"PRIu64" %s %#"PRIx32" %#"PRIx32"\n",
+                      cpu, r->tsc, event_names[r->event],
+                      r->arg[0], r->arg[1]);
+            }
+        }
+    }
+
+  palloc_free_multiple (header, page_cnt);
+  header = NULL;
+}
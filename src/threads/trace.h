@@ -0,0 +1,82 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/cpu.h"
+
+/* Static tracepoints.  See trace.c. */
+
+/* Categories of events, each enabled separately. */
+enum trace_category
+  {
+    TRACE_SCHED,                /* Thread switches and wakeups. */
+    TRACE_LOCK,                 /* Lock contention. */
+    TRACE_VM,                   /* Page faults, evictions, swap. */
+    TRACE_BLOCK,                /* Block device reads and writes. */
+    TRACE_SYSCALL,              /* System call entry and exit. */
+    TRACE_CATEGORY_CNT
+  };
+
+/* Events, with the arguments recorded for each. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Previous tid, next tid. */
+    TRACE_WAKEUP,               /* Tid woken, its priority. */
+    TRACE_LOCK_CONTEND,         /* Lock, holder's tid. */
+    TRACE_LOCK_ACQUIRE,         /* Lock, microseconds waited. */
+    TRACE_PAGE_LOAD,            /* User page, true if a write. */
+    TRACE_EVICT,                /* User page, owner's tid. */
+    TRACE_SWAP_OUT,             /* First slot, slot count. */
+    TRACE_SWAP_IN,              /* First slot, slot count. */
+    TRACE_BLOCK_READ,           /* First sector, sector count. */
+    TRACE_BLOCK_WRITE,          /* First sector, sector count. */
+    TRACE_SYSCALL_ENTER,        /* System call number, caller's tid. */
+    TRACE_SYSCALL_EXIT,         /* System call number, return value. */
+    TRACE_EVENT_CNT
+  };
+
+/* An event, as saved to the scratch device. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time stamp counter. */
+    uint16_t event;             /* A TRACE_* event. */
+    uint16_t unused;
+    uint32_t arg[2];            /* Arguments. */
+  };
+
+/* Header of the trace saved to the scratch device, followed by
+   RING_CNT rings, one for each CPU, of RING_SIZE records each.
+   HEAD[I] events were recorded in ring I; once it has filled,
+   the oldest is at HEAD[I] % RING_SIZE. */
+struct trace_header
+  {
+    char magic[4];              /* "TRCE". */
+    uint32_t record_size;       /* sizeof (struct trace_record). */
+    uint32_t ring_cnt;          /* Number of rings. */
+    uint32_t ring_size;         /* Records in each ring. */
+    uint32_t head[CPU_MAX];     /* Events recorded in each ring. */
+  };
+
+/* Categories enabled, one bit each. */
+extern uint32_t trace_mask;
+
+/* Records EVENT of CATEGORY with arguments ARG0 and ARG1, if
+   CATEGORY is enabled.  While it is not, this costs one test
+   and one branch, predicted not taken. */
+#define TRACE(CATEGORY, EVENT, ARG0, ARG1)                              \
+        do                                                              \
+          {                                                             \
+            if (__builtin_expect ((trace_mask & (1u << (CATEGORY))) != 0, \
+                                  0))                                   \
+              trace_record ((EVENT), (uint32_t) (ARG0),                 \
+                            (uint32_t) (ARG1));                         \
+          }                                                             \
+        while (0)
+
+bool trace_enable (char *categories);
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t arg0, uint32_t arg1);
+void trace_done (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,124 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Workqueues.
+
+   An interrupt handler should do no more than it must with
+   interrupts off: acknowledge the device and take whatever data
+   cannot wait.  The rest of its work, or work that a handler
+   triggers but that needs to sleep or acquire locks, it queues
+   with work_queue() as a struct work, which the workqueue's
+   thread then runs with interrupts on, in the order queued.
+
+   Each workqueue has its own kernel thread.  SYSTEM_WQ runs at
+   PRI_MAX, so that its work is not starved by user processes;
+   its items should be short.  Work that may block for a long
+   time, such as writing back the buffer cache, belongs in a
+   queue of its own at a lower priority.
+
+   A work item is in at most one queue at a time.  Queuing an
+   item already queued, but not yet started, does nothing, so a
+   handler that fires repeatedly before its work runs queues it
+   only once.  Once an item has started running it may be queued
+   again, including by itself. */
+
+struct workqueue system_wq;
+
+static void worker (void *wq_);
+
+/* Starts the system workqueue.  Must be called after
+   thread_start(). */
+void
+workqueue_init (void)
+{
+  workqueue_create (&system_wq, "kworker", PRI_MAX);
+}
+
+/* Initializes WQ as an empty workqueue and starts its thread,
+   named NAME, at the given PRIORITY. */
+void
+workqueue_create (struct workqueue *wq, const char *name, int priority)
+{
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+
+  wq->name = name;
+  list_init (&wq->works);
+  sema_init (&wq->pending, 0);
+  wq->run_cnt = 0;
+  wq->started = true;
+  if (thread_create (name, priority, worker, wq) == TID_ERROR)
+    PANIC ("%s: cannot create workqueue thread", name);
+}
+
+/* Initializes W as a work item that calls FUNC, given auxiliary
+   data AUX. */
+void
+work_init (struct work *w, work_func *func, void *aux)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->aux = aux;
+  w->queued = false;
+}
+
+/* Queues W to be run by WQ's thread.  Returns true if W was
+   queued, false if W was already queued or WQ has not yet been
+   created.  May be called from an interrupt handler. */
+bool
+work_queue (struct workqueue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  if (wq->started && !w->queued)
+    {
+      w->queued = true;
+      list_push_back (&wq->works, &w->elem);
+      sema_up (&wq->pending);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Thread function of workqueue WQ_, which runs its work items
+   one at a time, with interrupts on. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+
+      sema_down (&wq->pending);
+      old_level = intr_disable ();
+      w = list_entry (list_pop_front (&wq->works), struct work, elem);
+      w->queued = false;
+      wq->run_cnt++;
+      intr_set_level (old_level);
+
+      w->func (w->aux);
+    }
+}
+
+/* Prints statistics for the system workqueue. */
+void
+workqueue_print_stats (void)
+{
+  if (system_wq.started)
+    printf ("Workqueue: %lld deferred work items run\n",
+            system_wq.run_cnt);
+}
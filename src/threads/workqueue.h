@@ -0,0 +1,42 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+
+/* Deferred work.  See workqueue.c. */
+
+/* Function run as a work item, given auxiliary data AUX. */
+typedef void work_func (void *aux);
+
+/* A work item: a call to FUNC (AUX) to be made by a workqueue's
+   thread. */
+struct work
+  {
+    struct list_elem elem;              /* Element in queue. */
+    work_func *func;                    /* Function to call. */
+    void *aux;                          /* Passed to FUNC. */
+    bool queued;                        /* In a queue, not yet run? */
+  };
+
+/* A queue of work items and the thread that runs them. */
+struct workqueue
+  {
+    const char *name;                   /* Name of thread. */
+    struct list works;                  /* Queued work items. */
+    struct semaphore pending;           /* Number of queued items. */
+    bool started;                       /* Ready to queue work? */
+    long long run_cnt;                  /* Number of items run. */
+  };
+
+/* Queue for the kernel's deferred work, run at PRI_MAX. */
+extern struct workqueue system_wq;
+
+void workqueue_init (void);
+void workqueue_create (struct workqueue *, const char *name, int priority);
+void work_init (struct work *, work_func *, void *aux);
+bool work_queue (struct workqueue *, struct work *);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
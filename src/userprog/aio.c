@@ -0,0 +1,219 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Asynchronous file I/O.
+
+   A thread submits a read or write of a file with aio_submit()
+   and goes on running while AIO_WQ's thread makes the transfer,
+   then collects the result with aio_next(), waiting for it if
+   need be, and frees the request with aio_release().  Requests
+   run one at a time, in the order submitted, but the submitter
+   may have any number outstanding and overlap its own work with
+   theirs.
+
+   The worker runs outside the submitter's address space, so each
+   request carries a kernel buffer: the submitter fills it before
+   a write and empties it after a read.  Each request also has a
+   file of its own, opened with file_reopen(), so that closing or
+   seeking the submitter's file descriptor meanwhile does not
+   disturb it.
+
+   A request belongs to its struct aio from creation to release,
+   so that aio_destroy() frees it even if the submitter dies
+   while copying to or from its buffer. */
+
+/* The requests of one thread. */
+struct aio
+  {
+    struct lock lock;                   /* Protects all members. */
+    struct condition finished;          /* A request moved to DONE. */
+    struct list reqs;                   /* All requests. */
+    struct list done;                   /* Finished, not yet released. */
+    unsigned running;                   /* Submitted, not yet finished. */
+  };
+
+/* Runs the transfers.  It may block on the disk for a long time,
+   so it has a queue of its own rather than SYSTEM_WQ. */
+static struct workqueue aio_wq;
+
+static void aio_run (void *req_);
+
+/* Starts the asynchronous I/O worker.  Must be called after
+   thread_start(). */
+void
+aio_init (void)
+{
+  workqueue_create (&aio_wq, "aio", PRI_DEFAULT);
+}
+
+/* Returns a new, empty set of requests, or a null pointer if
+   memory is short. */
+struct aio *
+aio_create (void)
+{
+  struct aio *aio = malloc (sizeof *aio);
+
+  if (aio == NULL)
+    return NULL;
+  lock_init (&aio->lock);
+  cond_init (&aio->finished);
+  list_init (&aio->reqs);
+  list_init (&aio->done);
+  aio->running = 0;
+  return aio;
+}
+
+/* Waits for AIO's running requests to finish, then frees AIO
+   and every request in it.  AIO may be null. */
+void
+aio_destroy (struct aio *aio)
+{
+  if (aio == NULL)
+    return;
+
+  lock_acquire (&aio->lock);
+  while (aio->running > 0)
+    cond_wait (&aio->finished, &aio->lock);
+  lock_release (&aio->lock);
+
+  while (!list_empty (&aio->reqs))
+    aio_release (list_entry (list_front (&aio->reqs),
+                             struct aio_req, elem));
+  free (aio);
+}
+
+/* Returns a new request in AIO to transfer SIZE bytes, reading
+   or, if WRITING, writing FILE at offset OFS, with a buffer of
+   that size for the caller to fill or empty.  SIZE must be
+   between 1 and AIO_MAX_SIZE.  Returns a null pointer if memory
+   is short. */
+struct aio_req *
+aio_req_create (struct aio *aio, struct file *file, off_t ofs,
+                unsigned size, bool writing)
+{
+  struct aio_req *req;
+
+  ASSERT (aio != NULL);
+  ASSERT (file != NULL);
+  ASSERT (size > 0 && size <= AIO_MAX_SIZE);
+
+  req = malloc (sizeof *req);
+  if (req == NULL)
+    return NULL;
+  req->buf = malloc (size);
+  req->file = file_reopen (file);
+  if (req->buf == NULL || req->file == NULL)
+    {
+      free (req->buf);
+      file_close (req->file);
+      free (req);
+      return NULL;
+    }
+  work_init (&req->work, aio_run, req);
+  req->aio = aio;
+  req->state = AIO_NEW;
+  req->ofs = ofs;
+  req->writing = writing;
+  req->size = size;
+  req->ubuf = NULL;
+  req->user_data = 0;
+  req->res = -1;
+
+  lock_acquire (&aio->lock);
+  list_push_back (&aio->reqs, &req->elem);
+  lock_release (&aio->lock);
+  return req;
+}
+
+/* Queues REQ, which must be new, to run in the background.  Its
+   result is collected with aio_next(). */
+void
+aio_submit (struct aio_req *req)
+{
+  struct aio *aio = req->aio;
+  bool queued;
+
+  lock_acquire (&aio->lock);
+  ASSERT (req->state == AIO_NEW);
+  req->state = AIO_RUNNING;
+  aio->running++;
+  lock_release (&aio->lock);
+
+  queued = work_queue (&aio_wq, &req->work);
+  ASSERT (queued);
+}
+
+/* Makes REQ's transfer and moves it to its owner's list of
+   finished requests.  Runs in AIO_WQ's thread. */
+static void
+aio_run (void *req_)
+{
+  struct aio_req *req = req_;
+  struct aio *aio = req->aio;
+
+  req->res = (req->writing
+              ? file_write_at (req->file, req->buf, req->size, req->ofs)
+              : file_read_at (req->file, req->buf, req->size, req->ofs));
+
+  lock_acquire (&aio->lock);
+  req->state = AIO_DONE;
+  list_push_back (&aio->done, &req->done_elem);
+  aio->running--;
+  cond_broadcast (&aio->finished, &aio->lock);
+  lock_release (&aio->lock);
+}
+
+/* Returns the first of AIO's finished requests, in the order
+   they finished, with its RES set.  If none has finished yet,
+   waits for one if WAIT is true and some are running, and
+   otherwise returns a null pointer.  The request stays in the
+   list of finished requests until passed to aio_release(). */
+struct aio_req *
+aio_next (struct aio *aio, bool wait)
+{
+  struct aio_req *req = NULL;
+
+  lock_acquire (&aio->lock);
+  while (wait && list_empty (&aio->done) && aio->running > 0)
+    cond_wait (&aio->finished, &aio->lock);
+  if (!list_empty (&aio->done))
+    req = list_entry (list_front (&aio->done), struct aio_req, done_elem);
+  lock_release (&aio->lock);
+  return req;
+}
+
+/* Removes REQ, which must not be running, from its owner and
+   frees it. */
+void
+aio_release (struct aio_req *req)
+{
+  struct aio *aio = req->aio;
+
+  lock_acquire (&aio->lock);
+  ASSERT (req->state != AIO_RUNNING);
+  list_remove (&req->elem);
+  if (req->state == AIO_DONE)
+    list_remove (&req->done_elem);
+  lock_release (&aio->lock);
+
+  file_close (req->file);
+  free (req->buf);
+  free (req);
+}
+
+/* Returns the number of AIO's requests submitted but not yet
+   released. */
+unsigned
+aio_outstanding (struct aio *aio)
+{
+  unsigned cnt;
+
+  lock_acquire (&aio->lock);
+  cnt = aio->running + list_size (&aio->done);
+  lock_release (&aio->lock);
+  return cnt;
+}
@@ -0,0 +1,53 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "filesys/off_t.h"
+#include "threads/workqueue.h"
+
+/* Asynchronous file I/O.  See aio.c. */
+
+/* Largest transfer that one request makes, in bytes. */
+#define AIO_MAX_SIZE 65536
+
+/* States of a request. */
+enum aio_state
+  {
+    AIO_NEW,                            /* Not yet submitted. */
+    AIO_RUNNING,                        /* Submitted, not yet finished. */
+    AIO_DONE                            /* Finished, RES set. */
+  };
+
+/* A read or write of part of a file. */
+struct aio_req
+  {
+    struct list_elem elem;              /* In owner's list of requests. */
+    struct list_elem done_elem;         /* In owner's list, once done. */
+    struct work work;                   /* Runs the transfer. */
+    struct aio *aio;                    /* Owner. */
+    enum aio_state state;               /* Protected by owner's lock. */
+    struct file *file;                  /* File, private to the request. */
+    off_t ofs;                          /* Offset in FILE. */
+    bool writing;                       /* Write, not read? */
+    unsigned size;                      /* Bytes to transfer. */
+    void *buf;                          /* SIZE bytes of kernel memory. */
+    void *ubuf;                         /* For the submitter's use. */
+    unsigned user_data;                 /* For the submitter's use. */
+    int res;                            /* Bytes transferred, once done. */
+  };
+
+/* The requests of one thread. */
+struct aio;
+
+void aio_init (void);
+struct aio *aio_create (void);
+void aio_destroy (struct aio *);
+struct aio_req *aio_req_create (struct aio *, struct file *, off_t ofs,
+                                unsigned size, bool writing);
+void aio_submit (struct aio_req *);
+struct aio_req *aio_next (struct aio *, bool wait);
+void aio_release (struct aio_req *);
+unsigned aio_outstanding (struct aio *);
+
+#endif /* userprog/aio.h */
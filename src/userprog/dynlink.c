@@ -0,0 +1,498 @@
+#include "userprog/dynlink.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "userprog/elf.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+
+/* Dynamic linking.
+
+   A program linked against the shared C library, libc.so, names
+   the library in a PT_INTERP program header, where on Unix it
+   would name its dynamic linker.  load() maps the library's
+   segments at SHLIB_BASE, as lazily loaded regions of the
+   library file like the executable's own, and then calls
+   dynlink_link() to link the two.
+
+   The library is position independent: its text refers to its
+   own data relative to where it is loaded, and to everything
+   else through its global offset table (GOT), in its data.  So
+   its text is never written, and every process running it
+   shares the same frames, through the share table, which stay
+   in memory for a while after the last of them exits; see
+   frame_share() and frame_retain().  Each process needs a copy
+   of its own only of the library's data, GOT included, and of
+   the executable's GOT, through which the executable calls into
+   the library by way of its procedure linkage table (PLT).
+
+   Rather than running a dynamic linker in user mode, the kernel
+   applies the relocations itself, first the library's, then the
+   executable's, all of them at once rather than binding PLT
+   entries lazily on first call, since there are few.  Symbols
+   are looked up in the executable, then in the library, so that
+   if the executable has a copy of a variable of the library,
+   made by a copy relocation, the library uses that copy too.
+
+   Only the relocation types that the GNU tools emit for i386
+   code without thread-local storage are supported, and only in
+   writable segments: an object with text relocations, which
+   would leave its text private to each process, is rejected. */
+
+/* Largest symbol, string, or hash table read, in bytes. */
+#define TABLE_MAX (64 * 1024)
+
+/* Number of dynamic section entries or relocations read at
+   once. */
+#define BATCH 32
+
+typedef int32_t Elf32_Sword;
+
+/* Dynamic section entry.  See [ELF1] 2-8 to 2-13. */
+struct Elf32_Dyn
+  {
+    Elf32_Sword d_tag;
+    Elf32_Word d_val;
+  };
+
+/* Values for d_tag.  See [ELF1] 2-9 to 2-13. */
+#define DT_NULL     0           /* End of dynamic section. */
+#define DT_PLTRELSZ 2           /* Size of PLT relocations. */
+#define DT_HASH     4           /* Symbol hash table. */
+#define DT_STRTAB   5           /* String table. */
+#define DT_SYMTAB   6           /* Symbol table. */
+#define DT_RELA     7           /* Relocations with addends. */
+#define DT_STRSZ    10          /* Size of string table. */
+#define DT_SYMENT   11          /* Size of a symbol. */
+#define DT_REL      17          /* Relocations. */
+#define DT_RELSZ    18          /* Size of relocations. */
+#define DT_RELENT   19          /* Size of a relocation. */
+#define DT_PLTREL   20          /* Type of PLT relocations. */
+#define DT_TEXTREL  22          /* Relocations of text. */
+#define DT_JMPREL   23          /* PLT relocations. */
+
+/* Symbol table entry.  See [ELF1] 1-17 to 1-21. */
+struct Elf32_Sym
+  {
+    Elf32_Word    st_name;
+    Elf32_Addr    st_value;
+    Elf32_Word    st_size;
+    unsigned char st_info;
+    unsigned char st_other;
+    Elf32_Half    st_shndx;
+  };
+
+/* Symbol bindings, the upper bits of st_info.  See [ELF1] 1-18. */
+#define ELF32_ST_BIND(INFO) ((INFO) >> 4)
+#define STB_LOCAL  0            /* Not visible outside its object. */
+#define STB_WEAK   2            /* May be left undefined. */
+
+/* Section index of an undefined symbol.  See [ELF1] 1-7. */
+#define SHN_UNDEF 0
+
+/* Relocation entry.  See [ELF1] 1-22 to 1-23. */
+struct Elf32_Rel
+  {
+    Elf32_Addr r_offset;
+    Elf32_Word r_info;
+  };
+
+#define ELF32_R_SYM(INFO) ((INFO) >> 8)
+#define ELF32_R_TYPE(INFO) ((INFO) & 0xff)
+
+/* Relocation types, with the values they store, from the
+   symbol's address S, the addend A already at the place P being
+   relocated, and the object's load address B.  See [ELF1] 1-24
+   and 2-17. */
+#define R_386_NONE     0        /* Nothing. */
+#define R_386_32       1        /* S + A. */
+#define R_386_PC32     2        /* S + A - P. */
+#define R_386_COPY     5        /* A copy of the variable at S. */
+#define R_386_GLOB_DAT 6        /* S. */
+#define R_386_JMP_SLOT 7        /* S. */
+#define R_386_RELATIVE 8        /* B + A. */
+
+/* An object being linked, the executable or the library. */
+struct object
+  {
+    struct file *file;                  /* File. */
+    const struct exec_image *image;     /* Layout. */
+    uint32_t base;                      /* Load address, 0 if exe. */
+    Elf32_Word *hash;                   /* Hash table, or null. */
+    struct Elf32_Sym *syms;             /* Symbol table, or null. */
+    Elf32_Word sym_cnt;                 /* Number of SYMS. */
+    char *strs;                         /* String table, or null. */
+    Elf32_Word strs_size;               /* Its size, a null after. */
+    Elf32_Addr rel, jmprel;             /* Relocations, PLT's. */
+    Elf32_Word rel_size, jmprel_size;   /* Their sizes. */
+  };
+
+static bool open_object (struct object *, struct file *,
+                         const struct exec_image *);
+static void close_object (struct object *);
+static bool relocate (struct object *objs, struct object *,
+                      Elf32_Addr rel, Elf32_Word size);
+
+/* Links EXE, an executable whose layout is EXE_IMAGE, with LIB,
+   its shared library, whose layout is LIB_IMAGE, after both are
+   mapped into the current process, by applying the relocations
+   of both.  Returns true if successful, false otherwise. */
+bool
+dynlink_link (struct file *exe, const struct exec_image *exe_image,
+              struct file *lib, const struct exec_image *lib_image)
+{
+  struct object objs[2];
+  bool success;
+
+  memset (objs, 0, sizeof objs);
+  success = (open_object (&objs[0], exe, exe_image)
+             && open_object (&objs[1], lib, lib_image)
+             && relocate (objs, &objs[1], objs[1].rel, objs[1].rel_size)
+             && relocate (objs, &objs[1], objs[1].jmprel,
+                          objs[1].jmprel_size)
+             && relocate (objs, &objs[0], objs[0].rel, objs[0].rel_size)
+             && relocate (objs, &objs[0], objs[0].jmprel,
+                          objs[0].jmprel_size));
+  if (!success)
+    printf ("load: %s: error linking\n", exe_image->interp);
+  close_object (&objs[0]);
+  close_object (&objs[1]);
+  return success;
+}
+
+/* Returns true if the SIZE bytes at user virtual address ADDR
+   lie within one segment of O, within the part of it that is
+   read from O's file if FILE_PART is true, and in a writable
+   segment if WRITABLE is true.  If so, and OFS is not a null
+   pointer, also stores ADDR's offset in O's file in *OFS. */
+static bool
+in_segment (const struct object *o, uint32_t addr, uint32_t size,
+            bool file_part, bool writable, off_t *ofs)
+{
+  int i;
+
+  for (i = 0; i < o->image->seg_cnt; i++)
+    {
+      const struct exec_seg *seg = &o->image->segs[i];
+      uint32_t start = (uint32_t) seg->mem_page;
+      uint32_t len = seg->read_bytes + (file_part ? 0 : seg->zero_bytes);
+
+      if (addr >= start && size <= len && addr - start <= len - size
+          && (seg->writable || !writable))
+        {
+          if (ofs != NULL)
+            *ofs = seg->file_page + (addr - start);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Reads the SIZE bytes at address ADDR of O, as it is linked,
+   from O's file into BUF.  Returns true if successful. */
+static bool
+read_object (const struct object *o, Elf32_Addr addr, void *buf,
+             uint32_t size)
+{
+  off_t ofs;
+
+  return (addr <= UINT32_MAX - o->base
+          && in_segment (o, o->base + addr, size, true, false, &ofs)
+          && file_read_at (o->file, buf, size, ofs) == (off_t) size);
+}
+
+/* Returns a new block of memory holding the SIZE bytes at
+   address ADDR of O, as read_object(), followed by a null byte,
+   or a null pointer if SIZE exceeds TABLE_MAX, if memory is
+   short or if the bytes cannot be read. */
+static void *
+read_table (const struct object *o, Elf32_Addr addr, uint32_t size)
+{
+  char *table;
+
+  if (size > TABLE_MAX)
+    return NULL;
+  table = malloc (size + 1);
+  if (table != NULL)
+    {
+      if (read_object (o, addr, table, size))
+        table[size] = '\0';
+      else
+        {
+          free (table);
+          table = NULL;
+        }
+    }
+  return table;
+}
+
+/* Initializes O as FILE, whose layout is IMAGE, and reads its
+   dynamic section and its hash, symbol and string tables.
+   Returns true if successful, false if FILE's dynamic linking
+   information is invalid or unsupported or if memory is short.
+   O must be closed with close_object() either way. */
+static bool
+open_object (struct object *o, struct file *file,
+             const struct exec_image *image)
+{
+  Elf32_Addr hash = 0, symtab = 0, strtab = 0;
+  Elf32_Word syment = sizeof (struct Elf32_Sym);
+  Elf32_Word relent = sizeof (struct Elf32_Rel);
+  Elf32_Word pltrel = DT_REL;
+  Elf32_Word nhash[2];
+  uint32_t ofs;
+
+  o->file = file;
+  o->image = image;
+  o->base = (uint32_t) image->base;
+
+  for (ofs = 0; ofs < image->dyn_size; )
+    {
+      struct Elf32_Dyn dyn[BATCH];
+      uint32_t cnt = (image->dyn_size - ofs) / sizeof *dyn;
+      uint32_t i;
+
+      if (cnt == 0)
+        break;
+      if (cnt > BATCH)
+        cnt = BATCH;
+      if (file_read_at (file, dyn, cnt * sizeof *dyn, image->dyn_ofs + ofs)
+          != (off_t) (cnt * sizeof *dyn))
+        return false;
+      ofs += cnt * sizeof *dyn;
+
+      for (i = 0; i < cnt; i++)
+        switch (dyn[i].d_tag)
+          {
+          case DT_NULL:
+            ofs = image->dyn_size;
+            i = cnt;
+            break;
+          case DT_HASH: hash = dyn[i].d_val; break;
+          case DT_STRTAB: strtab = dyn[i].d_val; break;
+          case DT_SYMTAB: symtab = dyn[i].d_val; break;
+          case DT_STRSZ: o->strs_size = dyn[i].d_val; break;
+          case DT_SYMENT: syment = dyn[i].d_val; break;
+          case DT_REL: o->rel = dyn[i].d_val; break;
+          case DT_RELSZ: o->rel_size = dyn[i].d_val; break;
+          case DT_RELENT: relent = dyn[i].d_val; break;
+          case DT_PLTREL: pltrel = dyn[i].d_val; break;
+          case DT_JMPREL: o->jmprel = dyn[i].d_val; break;
+          case DT_PLTRELSZ: o->jmprel_size = dyn[i].d_val; break;
+          case DT_RELA:
+          case DT_TEXTREL:
+            return false;
+          }
+    }
+  if (syment != sizeof (struct Elf32_Sym)
+      || relent != sizeof (struct Elf32_Rel) || pltrel != DT_REL)
+    return false;
+
+  /* The hash table's chain array has an entry for each symbol,
+     which is how the size of the symbol table is known. */
+  if (symtab != 0)
+    {
+      if (hash == 0 || !read_object (o, hash, nhash, sizeof nhash)
+          || nhash[0] == 0
+          || nhash[0] > TABLE_MAX / sizeof (Elf32_Word)
+          || nhash[1] > TABLE_MAX / sizeof (struct Elf32_Sym))
+        return false;
+      o->hash = read_table (o, hash, ((2 + nhash[0] + nhash[1])
+                                      * sizeof (Elf32_Word)));
+      o->sym_cnt = nhash[1];
+      o->syms = read_table (o, symtab,
+                            o->sym_cnt * sizeof (struct Elf32_Sym));
+      o->strs = read_table (o, strtab, o->strs_size);
+      if (o->hash == NULL || o->syms == NULL || o->strs == NULL)
+        return false;
+    }
+  return true;
+}
+
+/* Frees the tables that open_object() read for O. */
+static void
+close_object (struct object *o)
+{
+  free (o->hash);
+  free (o->syms);
+  free (o->strs);
+}
+
+/* Returns the ELF hash of NAME.  See [ELF1] 2-19. */
+static unsigned long
+elf_hash (const char *name)
+{
+  unsigned long h = 0;
+
+  while (*name != '\0')
+    {
+      unsigned long g;
+
+      h = (h << 4) + (unsigned char) *name++;
+      g = h & 0xf0000000;
+      if (g != 0)
+        h ^= g >> 24;
+      h &= ~g;
+    }
+  return h;
+}
+
+/* Returns the name of symbol SYM of O, or a null pointer if it
+   is invalid. */
+static const char *
+symbol_name (const struct object *o, const struct Elf32_Sym *sym)
+{
+  return sym->st_name < o->strs_size ? o->strs + sym->st_name : NULL;
+}
+
+/* Looks up the global symbol NAME, whose ELF hash is H, among the
+   symbols that O defines.  Returns the symbol if it is found,
+   otherwise a null pointer. */
+static const struct Elf32_Sym *
+find_symbol (const struct object *o, const char *name, unsigned long h)
+{
+  Elf32_Word nbucket, nchain, idx, steps;
+
+  if (o->hash == NULL)
+    return NULL;
+  nbucket = o->hash[0];
+  nchain = o->hash[1];
+  for (idx = o->hash[2 + h % nbucket], steps = 0;
+       idx != 0 && idx < nchain && steps < nchain;
+       idx = o->hash[2 + nbucket + idx], steps++)
+    {
+      const struct Elf32_Sym *sym = &o->syms[idx];
+      const char *sym_name = symbol_name (o, sym);
+
+      if (sym->st_shndx != SHN_UNDEF
+          && ELF32_ST_BIND (sym->st_info) != STB_LOCAL
+          && sym_name != NULL && !strcmp (sym_name, name))
+        return sym;
+    }
+  return NULL;
+}
+
+/* Resolves symbol IDX of O, for a relocation of O, looking up a
+   global symbol in OBJS, the executable and then the library,
+   but not in O itself if COPY is true.  Stores the symbol's
+   address and size in *ADDR and *SIZE and the object defining
+   it, if any, in *DEF.  Returns true if successful, false if the
+   symbol is invalid or is undefined, and not weak. */
+static bool
+resolve (struct object *objs, const struct object *o, Elf32_Word idx,
+         bool copy, uint32_t *addr, uint32_t *size,
+         const struct object **def)
+{
+  const struct Elf32_Sym *sym;
+  const char *name;
+  unsigned long h;
+  int i;
+
+  *addr = *size = 0;
+  *def = NULL;
+  if (idx == 0)
+    return true;
+  if (idx >= o->sym_cnt)
+    return false;
+
+  sym = &o->syms[idx];
+  if (ELF32_ST_BIND (sym->st_info) == STB_LOCAL)
+    {
+      *addr = o->base + sym->st_value;
+      *size = sym->st_size;
+      *def = o;
+      return true;
+    }
+
+  name = symbol_name (o, sym);
+  if (name == NULL)
+    return false;
+  h = elf_hash (name);
+  for (i = 0; i < 2; i++)
+    if (!copy || &objs[i] != o)
+      {
+        const struct Elf32_Sym *s = find_symbol (&objs[i], name, h);
+        if (s != NULL)
+          {
+            *addr = objs[i].base + s->st_value;
+            *size = s->st_size;
+            *def = &objs[i];
+            return true;
+          }
+      }
+  if (ELF32_ST_BIND (sym->st_info) == STB_WEAK)
+    return true;
+  printf ("load: undefined symbol `%s'\n", name);
+  return false;
+}
+
+/* Applies the SIZE bytes of relocations at address REL of O,
+   looking up symbols in OBJS.  Returns true if successful. */
+static bool
+relocate (struct object *objs, struct object *o, Elf32_Addr rel,
+          Elf32_Word size)
+{
+  Elf32_Word ofs;
+
+  if (size % sizeof (struct Elf32_Rel) != 0)
+    return false;
+  for (ofs = 0; ofs < size; )
+    {
+      struct Elf32_Rel rels[BATCH];
+      Elf32_Word cnt = (size - ofs) / sizeof *rels;
+      Elf32_Word i;
+
+      if (cnt > BATCH)
+        cnt = BATCH;
+      if (rel > UINT32_MAX - ofs
+          || !read_object (o, rel + ofs, rels, cnt * sizeof *rels))
+        return false;
+      ofs += cnt * sizeof *rels;
+
+      for (i = 0; i < cnt; i++)
+        {
+          int type = ELF32_R_TYPE (rels[i].r_info);
+          Elf32_Word idx = ELF32_R_SYM (rels[i].r_info);
+          uint32_t p = o->base + rels[i].r_offset;
+          uint32_t s, s_size;
+          const struct object *def;
+          uint32_t *place = (uint32_t *) p;
+
+          if (type == R_386_NONE)
+            continue;
+          if (!resolve (objs, o, idx, type == R_386_COPY, &s, &s_size, &def))
+            return false;
+          if (type == R_386_COPY)
+            {
+              if (def == NULL
+                  || !in_segment (def, s, s_size, false, false, NULL)
+                  || !in_segment (o, p, s_size, false, true, NULL))
+                return false;
+              memcpy (place, (const void *) s, s_size);
+              continue;
+            }
+          if (!in_segment (o, p, sizeof *place, false, true, NULL))
+            return false;
+          switch (type)
+            {
+            case R_386_32:
+              *place += s;
+              break;
+            case R_386_PC32:
+              *place += s - p;
+              break;
+            case R_386_GLOB_DAT:
+            case R_386_JMP_SLOT:
+              *place = s;
+              break;
+            case R_386_RELATIVE:
+              *place += o->base;
+              break;
+            default:
+              printf ("load: unsupported relocation type %d\n", type);
+              return false;
+            }
+        }
+    }
+  return true;
+}
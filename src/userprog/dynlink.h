@@ -0,0 +1,12 @@
+#ifndef USERPROG_DYNLINK_H
+#define USERPROG_DYNLINK_H
+
+#include <stdbool.h>
+
+struct file;
+struct exec_image;
+
+bool dynlink_link (struct file *exe, const struct exec_image *,
+                   struct file *lib, const struct exec_image *);
+
+#endif /* userprog/dynlink.h */
@@ -0,0 +1,105 @@
+#ifndef USERPROG_ELF_H
+#define USERPROG_ELF_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+/* We load ELF binaries.  The following definitions are taken
+   from the ELF specification, [ELF1], more-or-less verbatim.  */
+
+/* ELF types.  See [ELF1] 1-2. */
+typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
+typedef uint16_t Elf32_Half;
+
+/* For use with ELF types in printf(). */
+#define PE32Wx PRIx32   /* Print Elf32_Word in hexadecimal. */
+#define PE32Ax PRIx32   /* Print Elf32_Addr in hexadecimal. */
+#define PE32Ox PRIx32   /* Print Elf32_Off in hexadecimal. */
+#define PE32Hx PRIx16   /* Print Elf32_Half in hexadecimal. */
+
+/* Executable header.  See [ELF1] 1-4 to 1-8.
+   This appears at the very beginning of an ELF binary. */
+struct Elf32_Ehdr
+  {
+    unsigned char e_ident[16];
+    Elf32_Half    e_type;
+    Elf32_Half    e_machine;
+    Elf32_Word    e_version;
+    Elf32_Addr    e_entry;
+    Elf32_Off     e_phoff;
+    Elf32_Off     e_shoff;
+    Elf32_Word    e_flags;
+    Elf32_Half    e_ehsize;
+    Elf32_Half    e_phentsize;
+    Elf32_Half    e_phnum;
+    Elf32_Half    e_shentsize;
+    Elf32_Half    e_shnum;
+    Elf32_Half    e_shstrndx;
+  };
+
+/* Values for e_type.  See [ELF1] 1-3. */
+#define ET_EXEC 2               /* Executable file. */
+#define ET_DYN  3               /* Shared object file. */
+
+/* Program header.  See [ELF1] 2-2 to 2-4.
+   There are e_phnum of these, starting at file offset e_phoff
+   (see [ELF1] 1-6). */
+struct Elf32_Phdr
+  {
+    Elf32_Word p_type;
+    Elf32_Off  p_offset;
+    Elf32_Addr p_vaddr;
+    Elf32_Addr p_paddr;
+    Elf32_Word p_filesz;
+    Elf32_Word p_memsz;
+    Elf32_Word p_flags;
+    Elf32_Word p_align;
+  };
+
+/* Values for p_type.  See [ELF1] 2-3. */
+#define PT_NULL    0            /* Ignore. */
+#define PT_LOAD    1            /* Loadable segment. */
+#define PT_DYNAMIC 2            /* Dynamic linking info. */
+#define PT_INTERP  3            /* Name of dynamic loader. */
+#define PT_NOTE    4            /* Auxiliary info. */
+#define PT_SHLIB   5            /* Reserved. */
+#define PT_PHDR    6            /* Program header table. */
+#define PT_STACK   0x6474e551   /* Stack segment. */
+
+/* Flags for p_flags.  See [ELF3] 2-3 and 2-4. */
+#define PF_X 1          /* Executable. */
+#define PF_W 2          /* Writable. */
+#define PF_R 4          /* Readable. */
+
+/* A loadable segment, as load_segment() takes it. */
+struct exec_seg
+  {
+    off_t file_page;                    /* Offset in file. */
+    uint8_t *mem_page;                  /* User virtual address. */
+    uint32_t read_bytes;                /* Bytes read from file. */
+    uint32_t zero_bytes;                /* Bytes zeroed after those. */
+    bool writable;                      /* Writable by the process? */
+  };
+
+/* Maximum number of loadable segments in an executable. */
+#define EXEC_SEG_MAX 16
+
+/* Maximum length of the name of a shared library, including the
+   null terminator. */
+#define EXEC_INTERP_MAX 32
+
+/* The validated layout of an executable or shared library. */
+struct exec_image
+  {
+    void (*entry) (void);               /* Entry point. */
+    uint8_t *base;                      /* Load address, if a library. */
+    int seg_cnt;                        /* Number of SEGS in use. */
+    struct exec_seg segs[EXEC_SEG_MAX]; /* Loadable segments. */
+    off_t dyn_ofs;                      /* Offset of PT_DYNAMIC in file. */
+    uint32_t dyn_size;                  /* Its size, 0 if there is none. */
+    char interp[EXEC_INTERP_MAX];       /* Library to link, or "". */
+  };
+
+#endif /* userprog/elf.h */
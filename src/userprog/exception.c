@@ -1,18 +1,25 @@
 #include "userprog/exception.h"
+#include <atomic.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/syscall.h"
 #include "userprog/gdt.h"
+#include "userprog/process.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "vm/page.h"
+#include "vm/pff.h"
+#include "devices/timer.h"
+#include "vm/vmstat.h"
 
 /* Number of page faults processed. */
-static long long page_fault_cnt;
+static atomic64_t page_fault_cnt;
 
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
+static void device_not_available (struct intr_frame *);
 static bool stack_access (void *, void *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -49,7 +56,7 @@ exception_init (void)
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
   intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
+  intr_register_int (7, 0, INTR_ON, device_not_available,
                      "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
@@ -68,7 +75,8 @@ exception_init (void)
 void
 exception_print_stats (void) 
 {
-  printf ("Exception: %lld page faults\n", page_fault_cnt);
+  printf ("Exception: %lld page faults\n",
+          atomic64_read (&page_fault_cnt));
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -112,6 +120,16 @@ kill (struct intr_frame *f)
     }
 }
 
+/* #NM handler, for the first FPU or SSE instruction of a user
+   process since it was switched in.  Gives it the FPU or, if that
+   cannot be done, kills it. */
+static void
+device_not_available (struct intr_frame *f)
+{
+  if (f->cs != SEL_UCSEG || !fpu_restore ())
+    kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -147,7 +165,7 @@ page_fault (struct intr_frame *f)
   intr_enable ();
 
   /* Count page faults. */
-  page_fault_cnt++;
+  atomic64_inc (&page_fault_cnt);
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
@@ -156,8 +174,8 @@ page_fault (struct intr_frame *f)
 
 #ifdef VM
   struct thread *cur = thread_current ();
-  struct page *p;
   void *esp;
+  bool locked;
 
   /* We need to obtain the current value of the user program's
      stack pointer.
@@ -171,19 +189,27 @@ page_fault (struct intr_frame *f)
      from user to kernel mode. */
   esp = user ? f->esp : cur->saved_esp;
 
+  /* A process killed for lack of swap space may have lost the
+     contents of any of its pages.  See frame_alloc().  The other
+     threads of an exiting process exit with it. */
+  if (process_current ()->oom_killed || process_must_exit ())
+    sys_exit (-1);
+
+  /* Load control may hold the process back while memory is
+     overcommitted.  See pff.c. */
+  if (user)
+    pff_throttle ();
+
+  /* The other threads of the process may be changing its address
+     space, unless this is a fault in a system call that already
+     locked it. */
+  locked = process_lock ();
+
   /* Stack growth.
      Control flow reaches the below code segment which supports
      lazy loading. */
   if (stack_access (fault_addr, esp))
-    {
-      p = page_make_entry (fault_page);
-      if (p != NULL)
-        {
-          /* Add supplemental information. */
-          p->type = PG_ZERO;
-          p->writable = true;
-        }
-    }
+    page_grow_stack (fault_page);
 
   /* Because executable code and data segments are not immediately
      loaded in memory during process setup, a not-present page fault
@@ -195,13 +221,25 @@ page_fault (struct intr_frame *f)
      process has already created SPTEs.
      See load_segment() defined in userprog/process.c.
      
-     Similarly, stack growth is considered as lazy loading. */
-  if (not_present)
+     Similarly, stack growth is considered as lazy loading.
+
+     A write to a page still mapped to the shared zero page, or to
+     a frame shared copy-on-write since fork(), is a rights
+     violation, resolved by giving the page a frame of its own.
+     See page_load(). */
+  if (not_present
+      || (write && is_user_vaddr (fault_addr)
+          && page_is_copy_on_write (fault_page)))
     {
-      if (!page_load (fault_page))
+      uint64_t start = clock_cycles ();
+      bool success = page_load (fault_page, write);
+      process_unlock (locked);
+      if (!success)
         sys_exit (-1);
+      vmstat_record_latency (clock_cycles () - start);
       return;
     }
+  process_unlock (locked);
 #endif
 
   /* A page fault in the kernel merely sets EAX to 0xffffffff and
@@ -230,9 +268,6 @@ page_fault (struct intr_frame *f)
   kill (f);
 }
 
-/* Absolute limit on stack growth size, 8 MB. */
-#define STACK_MAX_SIZE (8 * 1024 * 1024)
-
 /* Checks whether the stack growth is needed or not.
 
    Additional stack pages must be allocated only if they "appear" to be
@@ -241,11 +276,12 @@ page_fault (struct intr_frame *f)
    Notice that the 80x86 PUSH instruction checks access permissions before
    it adjusts the stack pointer, so it may cause a page fault 4 bytes
    below the stack pointer.  Similarly, the PUSHA instruction pushes 32 bytes
-   at once, so it can fault 32 bytes below the stack pointer. */
+   at once, so it can fault 32 bytes below the stack pointer.
+
+   The stack may only grow within the process's stack region,
+   which page_in_stack() checks in constant time. */
 static bool
 stack_access (void *vaddr, void *esp)
 {
-  return vaddr > (PHYS_BASE - STACK_MAX_SIZE)
-         && vaddr <= (PHYS_BASE - 1)
-         && vaddr >= (esp - 32);
+  return page_in_stack (vaddr) && vaddr >= (esp - 32);
 }
\ No newline at end of file
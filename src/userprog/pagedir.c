@@ -2,12 +2,30 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+
+/* Free page tables and page directories, known to be all
+   zeros, most recently freed last.  pagedir_destroy() clears
+   just the entries that were in use before putting a page here,
+   so that pagedir_create() and lookup_page() need not clear a
+   whole page, and exec and exit do not zero and free the same
+   pages over and over.  PT_CACHE_LOCK, unheld as a static,
+   protects the cache. */
+#define PT_CACHE_PAGES 16
+static void *pt_cache[PT_CACHE_PAGES];
+static size_t pt_cache_cnt;
+static struct spinlock pt_cache_lock;
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void *get_zero_page (void);
+static void put_zero_page (void *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,9 +34,12 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
+  uint32_t *pd = get_zero_page ();
+  size_t kernel_pde = pd_no (PHYS_BASE);
+
   if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+    memcpy (pd + kernel_pde, init_page_dir + kernel_pde,
+            PGSIZE - kernel_pde * sizeof *pd);
   return pd;
 }
 
@@ -38,13 +59,70 @@ pagedir_destroy (uint32_t *pd)
       {
         uint32_t *pt = pde_get_pt (*pde);
         uint32_t *pte;
+
+        if (*pde & PTE_PS)
+          {
+            palloc_free_multiple (pte_get_page (*pde), LPPAGES);
+            *pde = 0;
+            continue;
+          }
         
+        /* Clear the PTEs in use, even those not present, which
+           keep their other bits, so PT can be reused as is. */
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-          if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
+          if (*pte != 0)
+            {
+              if (*pte & PTE_P)
+                palloc_free_page (pte_get_page (*pte));
+              *pte = 0;
+            }
+        put_zero_page (pt);
+        *pde = 0;
+
+        /* A big address space takes a while to free. */
+        cond_resched ();
       }
-  palloc_free_page (pd);
+  memset (pde, 0, PGSIZE - (pde - pd) * sizeof *pde);
+  put_zero_page (pd);
+}
+
+/* Maps every user page mapped in SRC at the same address in
+   DST, with the same permissions, to a new page from the user
+   pool holding a copy of its contents.  DST must have no user
+   mappings yet.  Returns false if memory allocation fails, in
+   which case DST holds the copies made so far. */
+bool
+pagedir_copy (uint32_t *dst, uint32_t *src)
+{
+  uint32_t *pde;
+
+  ASSERT (src != init_page_dir);
+  for (pde = src; pde < src + pd_no (PHYS_BASE); pde++)
+    if (*pde & PTE_P)
+      {
+        uint32_t *pt = pde_get_pt (*pde);
+        uint32_t *pte;
+
+        ASSERT ((*pde & PTE_PS) == 0);
+        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+          if (*pte & PTE_P)
+            {
+              void *upage = (void *) (((pde - src) << PDSHIFT)
+                                      | ((pte - pt) << PTSHIFT));
+              void *kpage = palloc_get_page (PAL_USER);
+
+              if (kpage == NULL)
+                return false;
+              fpu_copy_page (kpage, pte_get_page (*pte));
+              if (!pagedir_set_page (dst, upage, kpage,
+                                     (*pte & PTE_W) != 0))
+                {
+                  palloc_free_page (kpage);
+                  return false;
+                }
+            }
+      }
+  return true;
 }
 
 /* Returns the address of the page table entry for virtual
@@ -52,7 +130,10 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.
+   If VADDR lies in a large page, the PDE mapping the large page
+   is returned instead, so the whole large page is examined and
+   modified as a unit. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -70,7 +151,7 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = get_zero_page ();
           if (pt == NULL) 
             return NULL; 
       
@@ -80,6 +161,9 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
         return NULL;
     }
 
+  if (*pde & PTE_PS)
+    return pde;
+
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
@@ -118,6 +202,27 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Changes the frame that user virtual page UPAGE, which must be
+   mapped in PD, maps to KPAGE, keeping the PTE's permissions and
+   its accessed and dirty bits.  The contents of the old frame
+   should be copied to KPAGE first, with interrupts off, so that
+   the process cannot write the old frame meanwhile.  Used to
+   migrate user frames; see frame_compact(). */
+void
+pagedir_move_page (uint32_t *pd, const void *upage, void *kpage)
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (pd, upage, false);
+  ASSERT (pte != NULL && (*pte & PTE_P) != 0 && (*pte & PTE_PS) == 0);
+  *pte = vtop (kpage) | (*pte & PTE_FLAGS);
+  invalidate_page (pd, upage);
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -131,11 +236,68 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
+    {
+      if (*pte & PTE_PS)
+        return pte_get_page (*pte) + ((uintptr_t) uaddr & (LPSIZE - 1));
+      return pte_get_page (*pte) + pg_ofs (uaddr);
+    }
   else
     return NULL;
 }
 
+/* Adds a mapping in page directory PD from the LPSIZE bytes of
+   user virtual memory starting at UPAGE to the LPPAGES physical
+   frames starting at kernel virtual address KPAGE, as a single
+   large page.  Both addresses must be LPSIZE-aligned; KPAGE
+   should be obtained from the user pool with
+   palloc_get_aligned().  No page in the range may be mapped
+   already, and PD must not have a page table for it.
+   If WRITABLE is true, the large page is read/write; otherwise it
+   is read-only. */
+void
+pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                        bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+
+  ASSERT ((uintptr_t) upage % LPSIZE == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+  ASSERT (*pde == 0);
+
+  *pde = pde_create_large_user (kpage, writable);
+}
+
+/* Splits the large page containing user virtual address UADDR in
+   PD, if any, into LPPAGES ordinary pages mapping the same
+   frames with the same permissions, accessed and dirty bits, so
+   that they may be unmapped or evicted one by one.  Returns
+   false if memory for the page table cannot be allocated. */
+bool
+pagedir_split_large_page (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pde = pd + pd_no (uaddr);
+  uint32_t *pt;
+  uint32_t flags;
+  uint8_t *kpage;
+  size_t i;
+
+  if ((*pde & PTE_PS) == 0)
+    return true;
+
+  pt = palloc_get_page (0);
+  if (pt == NULL)
+    return false;
+
+  kpage = pte_get_page (*pde);
+  flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+  for (i = 0; i < LPPAGES; i++)
+    pt[i] = vtop (kpage + i * PGSIZE) | flags;
+  *pde = pde_create (pt);
+  invalidate_pagedir (pd);
+  return true;
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -152,7 +314,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,11 +342,27 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        *pte &= ~(uint32_t) PTE_W;
+      invalidate_page (pd, vpage);
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD has been
    accessed recently, that is, between the time the PTE was
    installed and the last time it was cleared.  Returns false if
@@ -209,11 +387,68 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Returns the address of the PTE for user virtual page UPAGE in
+   PD, without creating a page table.  Returns a null pointer if
+   PD has no page table for UPAGE or if UPAGE lies in a large
+   page.  The address stays valid until PD is destroyed, so
+   callers may keep it and use the pagedir_pte_*() functions to
+   skip walking PD again.  A large page, which a split could
+   later turn into a page table, is never returned. */
+uint32_t *
+pagedir_lookup_pte (uint32_t *pd, const void *upage)
+{
+  uint32_t *pde;
+
+  ASSERT (pd != NULL);
+  ASSERT (is_user_vaddr (upage));
+
+  pde = pd + pd_no (upage);
+  if (*pde == 0 || (*pde & PTE_PS) != 0)
+    return NULL;
+  return &pde_get_pt (*pde)[pt_no (upage)];
+}
+
+/* Returns true if PTE, the PTE for UPAGE in PD returned by
+   pagedir_lookup_pte(), has been accessed since its accessed bit
+   was last cleared, and clears the bit.  The TLB entry is only
+   flushed if the bit was set. */
+bool
+pagedir_pte_test_and_clear_accessed (uint32_t *pd, uint32_t *pte,
+                                     const void *upage)
+{
+  if ((*pte & PTE_A) == 0)
+    return false;
+  *pte &= ~(uint32_t) PTE_A;
+  invalidate_page (pd, upage);
+  return true;
+}
+
+/* Returns true if PTE, returned by pagedir_lookup_pte(), is
+   dirty. */
+bool
+pagedir_pte_is_dirty (const uint32_t *pte)
+{
+  return (*pte & PTE_D) != 0;
+}
+
+/* Marks PTE, the PTE for UPAGE in PD returned by
+   pagedir_lookup_pte(), "not present", like
+   pagedir_clear_page(). */
+void
+pagedir_pte_clear (uint32_t *pd, uint32_t *pte, const void *upage)
+{
+  if ((*pte & PTE_P) != 0)
+    {
+      *pte &= ~PTE_P;
+      invalidate_page (pd, upage);
+    }
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -261,3 +496,44 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entry for virtual page VPAGE if PD is the
+   active page directory.  Unlike invalidate_pagedir(), the rest
+   of the TLB is left intact.  For a large page, any address
+   within it invalidates the whole large page.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage)
+{
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
+
+/* Returns a page of zeros for a page table or page directory,
+   from the cache if it has one, or a null pointer if memory
+   allocation fails. */
+static void *
+get_zero_page (void)
+{
+  enum intr_level old_level = spinlock_acquire (&pt_cache_lock);
+  void *page = pt_cache_cnt > 0 ? pt_cache[--pt_cache_cnt] : NULL;
+  spinlock_release (&pt_cache_lock, old_level);
+
+  return page != NULL ? page : palloc_get_page (PAL_ZERO);
+}
+
+/* Frees PAGE, a page table or page directory that has been
+   cleared to all zeros, into the cache if there is room. */
+static void
+put_zero_page (void *page)
+{
+  enum intr_level old_level = spinlock_acquire (&pt_cache_lock);
+  bool cached = pt_cache_cnt < PT_CACHE_PAGES;
+
+  if (cached)
+    pt_cache[pt_cache_cnt++] = page;
+  spinlock_release (&pt_cache_lock, old_level);
+
+  if (!cached)
+    palloc_free_page (page);
+}
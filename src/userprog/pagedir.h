@@ -6,13 +6,24 @@
 
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
+bool pagedir_copy (uint32_t *dst, uint32_t *src);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+void pagedir_move_page (uint32_t *pd, const void *upage, void *kpage);
+void pagedir_set_large_page (uint32_t *pd, void *upage, void *kpage,
+                             bool rw);
+bool pagedir_split_large_page (uint32_t *pd, const void *uaddr);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
+uint32_t *pagedir_lookup_pte (uint32_t *pd, const void *upage);
+bool pagedir_pte_test_and_clear_accessed (uint32_t *pd, uint32_t *pte,
+                                          const void *upage);
+bool pagedir_pte_is_dirty (const uint32_t *pte);
+void pagedir_pte_clear (uint32_t *pd, uint32_t *pte, const void *upage);
 void pagedir_activate (uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
@@ -0,0 +1,231 @@
+#include "userprog/pipe.h"
+#include <debug.h>
+#include <stdint.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Size of a pipe's buffer, in bytes, a power of 2. */
+#define PIPE_SIZE (PIPE_PAGES * PGSIZE)
+
+/* A pipe.
+
+   HEAD and TAIL count the bytes read from and written to the
+   pipe since it was created, so that TAIL - HEAD bytes are
+   buffered, starting at offset HEAD % PIPE_SIZE of BUF.  Both
+   wrap around together, since PIPE_SIZE divides 2**32.
+
+   The pipe is freed once both of its ends are closed, each end
+   counting one reference per file descriptor open on it. */
+struct pipe
+  {
+    struct lock lock;                   /* Protects all members. */
+    struct condition readable;          /* Data arrived or no writers. */
+    struct condition writable;          /* Room freed or no readers. */
+    uint8_t *buf;                       /* PIPE_SIZE bytes. */
+    size_t head;                        /* Bytes read so far. */
+    size_t tail;                        /* Bytes written so far. */
+    int readers;                        /* References to read end. */
+    int writers;                        /* References to write end. */
+    struct poll_queue pollers;          /* Woken with either condition. */
+  };
+
+/* Creates a pipe with one reference to each of its ends.
+   Returns the pipe, or a null pointer if memory is short. */
+struct pipe *
+pipe_create (void)
+{
+  struct pipe *p = malloc (sizeof *p);
+
+  if (p == NULL)
+    return NULL;
+  p->buf = palloc_get_multiple (0, PIPE_PAGES);
+  if (p->buf == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+
+  lock_init (&p->lock);
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  p->head = p->tail = 0;
+  p->readers = p->writers = 1;
+  poll_queue_init (&p->pollers);
+  return p;
+}
+
+/* Adds a reference to the write end of P if WRITER is true,
+   otherwise to its read end. */
+void
+pipe_dup (struct pipe *p, bool writer)
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writers++;
+  else
+    p->readers++;
+  lock_release (&p->lock);
+}
+
+/* Drops a reference to the write end of P if WRITER is true,
+   otherwise to its read end.  Closing the last reference to one
+   end wakes up any thread waiting at the other, and closing the
+   last reference to both frees P. */
+void
+pipe_close (struct pipe *p, bool writer)
+{
+  bool destroy;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      ASSERT (p->writers > 0);
+      if (--p->writers == 0)
+        {
+          cond_broadcast (&p->readable, &p->lock);
+          poll_wake (&p->pollers);
+        }
+    }
+  else
+    {
+      ASSERT (p->readers > 0);
+      if (--p->readers == 0)
+        {
+          cond_broadcast (&p->writable, &p->lock);
+          poll_wake (&p->pollers);
+        }
+    }
+  destroy = p->readers == 0 && p->writers == 0;
+  lock_release (&p->lock);
+
+  if (destroy)
+    {
+      palloc_free_multiple (p->buf, PIPE_PAGES);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes buffered in P into BUF, without
+   waiting, and returns the number of bytes read. */
+size_t
+pipe_read (struct pipe *p, void *buf_, size_t size)
+{
+  uint8_t *buf = buf_;
+  size_t cnt, ofs, first;
+
+  lock_acquire (&p->lock);
+  cnt = p->tail - p->head;
+  if (cnt > size)
+    cnt = size;
+
+  /* Copy up to the end of BUF, then from its start. */
+  ofs = p->head % PIPE_SIZE;
+  first = cnt < PIPE_SIZE - ofs ? cnt : PIPE_SIZE - ofs;
+  memcpy (buf, p->buf + ofs, first);
+  memcpy (buf + first, p->buf, cnt - first);
+
+  p->head += cnt;
+  if (cnt > 0)
+    {
+      cond_broadcast (&p->writable, &p->lock);
+      poll_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return cnt;
+}
+
+/* Writes up to SIZE bytes from BUF into the room in P, without
+   waiting, and returns the number of bytes written.  Writes
+   nothing if P's read end is closed. */
+size_t
+pipe_write (struct pipe *p, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+  size_t cnt, ofs, first;
+
+  lock_acquire (&p->lock);
+  cnt = p->readers > 0 ? PIPE_SIZE - (p->tail - p->head) : 0;
+  if (cnt > size)
+    cnt = size;
+
+  ofs = p->tail % PIPE_SIZE;
+  first = cnt < PIPE_SIZE - ofs ? cnt : PIPE_SIZE - ofs;
+  memcpy (p->buf + ofs, buf, first);
+  memcpy (p->buf, buf + first, cnt - first);
+
+  p->tail += cnt;
+  if (cnt > 0)
+    {
+      cond_broadcast (&p->readable, &p->lock);
+      poll_wake (&p->pollers);
+    }
+  lock_release (&p->lock);
+  return cnt;
+}
+
+/* If WRITER is true, waits until P has room or its read end is
+   closed, and returns true if it has room for pipe_write().
+   Otherwise waits until P holds data or its write end is
+   closed, and returns true if there is data for pipe_read(). */
+bool
+pipe_wait (struct pipe *p, bool writer)
+{
+  bool ready;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      while (p->readers > 0 && p->tail - p->head == PIPE_SIZE)
+        cond_wait (&p->writable, &p->lock);
+      ready = p->readers > 0;
+    }
+  else
+    {
+      while (p->writers > 0 && p->tail == p->head)
+        cond_wait (&p->readable, &p->lock);
+      ready = p->tail != p->head;
+    }
+  lock_release (&p->lock);
+  return ready;
+}
+
+/* Returns true if pipe_write(), if WRITER is true, or otherwise
+   pipe_read(), would not have to wait on P: because it has room
+   or data, or because its other end is closed. */
+bool
+pipe_ready (struct pipe *p, bool writer)
+{
+  bool ready;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    ready = p->readers == 0 || p->tail - p->head < PIPE_SIZE;
+  else
+    ready = p->writers == 0 || p->tail != p->head;
+  lock_release (&p->lock);
+  return ready;
+}
+
+/* Returns true if the other end of P is closed, as seen from
+   its write end if WRITER is true, otherwise from its read end. */
+bool
+pipe_hung_up (struct pipe *p, bool writer)
+{
+  bool hung_up;
+
+  lock_acquire (&p->lock);
+  hung_up = writer ? p->readers == 0 : p->writers == 0;
+  lock_release (&p->lock);
+  return hung_up;
+}
+
+/* Adds W to P's poll queue, so that POLLER is woken the next time
+   P gets data or room, or one of its ends is closed. */
+void
+pipe_poll_add (struct pipe *p, struct poll_waiter *w, struct poller *poller)
+{
+  poll_queue_add (&p->pollers, w, poller);
+}
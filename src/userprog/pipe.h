@@ -0,0 +1,27 @@
+#ifndef USERPROG_PIPE_H
+#define USERPROG_PIPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/poll.h"
+
+/* A pipe: a kernel buffer of PIPE_PAGES pages through which
+   bytes written at one end are read, in order, at the other. */
+struct pipe;
+
+/* Number of pages in a pipe's buffer. */
+#define PIPE_PAGES 4
+
+struct pipe *pipe_create (void);
+void pipe_dup (struct pipe *, bool writer);
+void pipe_close (struct pipe *, bool writer);
+
+size_t pipe_read (struct pipe *, void *, size_t);
+size_t pipe_write (struct pipe *, const void *, size_t);
+bool pipe_wait (struct pipe *, bool writer);
+
+bool pipe_ready (struct pipe *, bool writer);
+bool pipe_hung_up (struct pipe *, bool writer);
+void pipe_poll_add (struct pipe *, struct poll_waiter *, struct poller *);
+
+#endif /* userprog/pipe.h */
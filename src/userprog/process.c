@@ -5,6 +5,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/aio.h"
+#include "userprog/dynlink.h"
+#include "userprog/elf.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -12,7 +15,9 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/palloc.h"
@@ -20,28 +25,49 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "vm/futex.h"
 #include "vm/page.h"
+#include "vm/prepage.h"
 
 static thread_func start_process NO_RETURN;
+static thread_func spawn_process NO_RETURN;
+static thread_func fork_process NO_RETURN;
+static bool copy_process (struct thread *parent);
+#ifdef VM
+static thread_func start_thread NO_RETURN;
+static bool create_group (struct thread *leader);
+static bool init_thread_stack (void **esp, void *func, void *aux);
+#endif
+static void leave_group (void);
+static void end_group (void);
+static void close_process_files (void);
+static void free_address_space (void);
 static bool load (const char *exec_path, void (**eip) (void), void **esp);
 static void init_process (struct process *process, tid_t tid);
-static bool init_stack (void **esp, char *cmdline);
-static void push_stack (void **esp, void *src, size_t size);
-
-/* It is not safe to call into the file system code
-   provided in the `filesys' directory from multiple threads
-   at once.
-   The file system code is treated as a critical section. */
-extern struct lock fs_lock;
+static bool reserve_child (void);
+static void add_child (struct process *);
+static void release_child (struct ohash_elem *, void *aux);
+static struct exec_args *parse_args (const char *cmdline);
+static bool load_process (const struct exec_args *, struct intr_frame *);
+static bool init_stack (void **esp, const struct exec_args *);
+static void push_stack (void **esp, const void *src, size_t size);
+
+/* A command line, split into arguments once by parse_args(). */
+struct exec_args
+  {
+    int argc;                           /* Number of arguments. */
+    size_t len;                         /* Bytes used in STRINGS. */
+    char strings[];                     /* Each argument, null-terminated,
+                                           program name first. */
+  };
 
 /* Shared between `process_execute' and `process_start'. */
 struct process_exec_params
   {
     /* Used later in `start_process' when scheduled.
        It is `malloc'ed in `process_execute' but must be `free'ed
-       in `start_process' after command line parsing and stack
-       setup completes. */
-    char *fn_copy;
+       in `start_process' after stack setup completes. */
+    struct exec_args *args;
     /* The parent process cannot return from the `process_execute'
        until it knows whether the child process successfully
        loaded its executable. */
@@ -59,46 +85,136 @@ process_execute (const char *cmdline)
 {
   struct process_exec_params params;
   tid_t tid;
-  char *exec_path, *save_ptr;
 
-  /* Make a copy of CMDLINE.
+  /* Split CMDLINE into a copy of its own.
      Otherwise there's a race between the caller and load(). */
-  params.fn_copy = palloc_get_page (0);
-  if (params.fn_copy == NULL)
+  if (!reserve_child ())
     return TID_ERROR;
-  strlcpy (params.fn_copy, cmdline, PGSIZE);
-
-  /* Get the executable path name. */
-  exec_path = palloc_get_page (0);
-  if (exec_path == NULL)
+  params.args = parse_args (cmdline);
+  if (params.args == NULL)
     return TID_ERROR;
-  strlcpy (exec_path, cmdline, PGSIZE);
-  exec_path = strtok_r (exec_path, " ", &save_ptr);
 
-  /* Create a new thread to execute EXEC_PATH */
-  tid = thread_create (exec_path, PRI_DEFAULT, start_process, &params);
-  palloc_free_page (exec_path);
+  /* Create a new thread to execute the program, named after it. */
+  sema_init (&params.load_wait, 0);
+  tid = thread_create (params.args->strings, PRI_DEFAULT, start_process,
+                       &params);
 
   if (tid == TID_ERROR)
-    palloc_free_page (params.fn_copy);
+    free (params.args);
   else
     {
       /* Waits until the child process `tid' successfully loads
          its executable.
          See `start_process' implemented below. */
-      sema_init (&params.load_wait, 0);
       sema_down (&params.load_wait);
 
       if (!params.load_success)
         return TID_ERROR;
 
       /* Add child process. */
-      struct thread *cur = thread_current ();
-      list_push_back (&cur->child_list, &params.process->child_list_elem);
+      add_child (params.process);
+    }
+  return tid;
+}
+
+/* Shared between `process_spawn' and `spawn_process'. */
+struct process_spawn_params
+  {
+    struct exec_args *args;             /* Freed by `spawn_process'. */
+    struct process *process;            /* Child's process block. */
+  };
+
+/* Starts running the executable named first in CMDLINE, passing
+   it the rest as arguments, like process_execute(), but returns
+   as soon as the new thread exists, without waiting for it to
+   load the executable.  The child is added to the current
+   thread's children before this function returns.  If the load
+   fails, the child exits with status -1, which process_wait()
+   returns.  Returns the new process's thread id, or TID_ERROR if
+   the thread cannot be created. */
+tid_t
+process_spawn (const char *cmdline)
+{
+  struct process_spawn_params *params;
+  struct process *process;
+  tid_t tid;
+
+  if (!reserve_child ())
+    return TID_ERROR;
+  params = malloc (sizeof *params);
+  process = malloc (sizeof *process);
+  if (params == NULL || process == NULL
+      || (params->args = parse_args (cmdline)) == NULL)
+    {
+      free (params);
+      free (process);
+      return TID_ERROR;
     }
+
+  init_process (process, TID_ERROR);
+  process->exit_status = -1;
+  params->process = process;
+
+  tid = thread_create (params->args->strings, PRI_DEFAULT, spawn_process,
+                       params);
+  if (tid == TID_ERROR)
+    {
+      free (params->args);
+      free (params);
+      free (process);
+      return TID_ERROR;
+    }
+
+  /* The child does not use its process block's TID and cannot
+     free the block, which its parent still references, so it
+     may already be running, or even have exited. */
+  process->tid = tid;
+  add_child (process);
   return tid;
 }
 
+/* Loads the executable named first in ARGS into the current
+   thread and sets up its user stack, and the user context in
+   IF_ to start it.  Returns true if successful. */
+static bool
+load_process (const struct exec_args *args, struct intr_frame *if_)
+{
+  /* Initialize interrupt frame and load executable. */
+  memset (if_, 0, sizeof *if_);
+  if_->gs = if_->fs = if_->es = if_->ds = if_->ss = SEL_UDSEG;
+  if_->cs = SEL_UCSEG;
+  if_->eflags = FLAG_IF | FLAG_MBS;
+  if (!load (args->strings, &if_->eip, &if_->esp))
+    return false;
+
+  /* Initialize stack with passed arguments. */
+  return init_stack (&if_->esp, args);
+}
+
+/* A thread function that loads a user process for
+   process_spawn() and starts it running.  The process block is
+   registered first, so that a failed load is reported to the
+   parent as an exit. */
+static void
+spawn_process (void *params_)
+{
+  struct process_spawn_params *params = params_;
+  struct thread *cur = thread_current ();
+  struct intr_frame if_;
+  bool success;
+
+  cur->process = params->process;
+  success = load_process (params->args, &if_);
+  free (params->args);
+  free (params);
+  if (!success)
+    thread_exit ();
+
+  /* Start the user process, as start_process() does. */
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
 /* A thread function that loads a user process and starts it
    running. */
 static void
@@ -109,21 +225,10 @@ start_process (void *params_)
   struct intr_frame if_;
   bool success;
 
-  /* Initialize interrupt frame and load executable. */
-  memset (&if_, 0, sizeof if_);
-  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
-  if_.cs = SEL_UCSEG;
-  if_.eflags = FLAG_IF | FLAG_MBS;
-  lock_acquire (&fs_lock);
-  success = load (thread_name (), &if_.eip, &if_.esp);
-  lock_release (&fs_lock);
-
-  /* Initialize stack with passed arguments. */
-  if (success)
-    success = init_stack (&if_.esp, params->fn_copy);
+  success = load_process (params->args, &if_);
 
   /* Unused. */
-  palloc_free_page (params->fn_copy);
+  free (params->args);
 
   /* Allocates a process block of this current thread. */
   if (success)
@@ -161,6 +266,288 @@ start_process (void *params_)
   NOT_REACHED ();
 }
 
+/* Shared between `process_fork' and `fork_process'. */
+struct process_fork_params
+  {
+    struct thread *parent;              /* Process to duplicate. */
+    const struct intr_frame *if_;       /* Its user context. */
+    /* The parent process cannot return from `process_fork', and
+       so cannot run user code, until the child process has
+       copied its address space. */
+    struct semaphore fork_wait;
+    bool fork_success;                  /* Is the copy successful? */
+    struct process *process;            /* For parent to retrieve a pointer to child process block. */
+  };
+
+/* Starts a new process that is a copy of the current one, which
+   entered the kernel with user context IF_, and that resumes as
+   if returning from the same system call, with a return value
+   of 0.  Returns the new process's thread id, or TID_ERROR if
+   the process cannot be created. */
+tid_t
+process_fork (const struct intr_frame *if_)
+{
+  struct thread *cur = thread_current ();
+  struct process_fork_params params;
+  tid_t tid;
+
+  if (!reserve_child ())
+    return TID_ERROR;
+  params.parent = cur;
+  params.if_ = if_;
+  sema_init (&params.fork_wait, 0);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, fork_process, &params);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  sema_down (&params.fork_wait);
+  if (!params.fork_success)
+    return TID_ERROR;
+
+  /* Add child process. */
+  add_child (params.process);
+  return tid;
+}
+
+/* A thread function that makes a copy of the parent process and
+   starts it running. */
+static void
+fork_process (void *params_)
+{
+  struct process_fork_params *params = params_;
+  struct intr_frame if_ = *params->if_;
+  struct process *process;
+  bool success;
+
+  success = copy_process (params->parent);
+
+  /* Allocates a process block of this current thread. */
+  if (success)
+    if (!(process = malloc (sizeof (struct process))))
+      success = false;
+
+  if (success)
+    {
+      struct thread *cur = thread_current ();
+      init_process (process, cur->tid);
+      params->process = cur->process = process;
+    }
+
+  /* PARAMS is gone once the parent resumes. */
+  params->fork_success = success;
+  sema_up (&params->fork_wait);
+
+  if (!success)
+    thread_exit ();
+
+  /* fork() returns 0 in the child. */
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Makes the current process, which has no address space yet, a
+   copy of PARENT, which must be blocked in process_fork().
+   Returns true if successful.  On failure, whatever has been
+   copied is freed by process_exit(). */
+static bool
+copy_process (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = parent->group;
+  bool success;
+
+  /* Keep the executable open and unmodifiable, as load() does. */
+  cur->bin = file_reopen (process_leader (parent)->bin);
+  if (cur->bin == NULL)
+    return false;
+  file_deny_write (cur->bin);
+  if (process_leader (parent)->lib != NULL)
+    {
+      cur->lib = file_reopen (process_leader (parent)->lib);
+      if (cur->lib == NULL)
+        return false;
+      file_deny_write (cur->lib);
+    }
+
+#ifdef VM
+  cur->spt = page_create_spt ();
+#endif
+  cur->pagedir = pagedir_create ();
+  if (cur->pagedir == NULL)
+    return false;
+  process_activate ();
+
+  /* PARENT is blocked, but the other threads of its process are
+     not. */
+  if (g != NULL)
+    lock_acquire (&g->lock);
+#ifdef VM
+  success = page_copy_spt (parent);
+  cur->saved_esp = parent->saved_esp;
+#else
+  success = pagedir_copy (cur->pagedir, parent->pagedir);
+#endif
+  success = success && fpu_copy (parent) && sys_fork_copy (parent);
+  if (g != NULL)
+    lock_release (&g->lock);
+  return success;
+}
+
+#ifdef VM
+/* Shared between `process_thread_create' and `start_thread'. */
+struct process_thread_params
+  {
+    struct thread *leader;              /* Owner of the address space. */
+    void (*eip) (void);                 /* Where to start in user code. */
+    void *func;                         /* First argument for EIP. */
+    void *aux;                          /* Second argument for EIP. */
+    /* The creating thread cannot return from
+       `process_thread_create' until the new thread has its user
+       stack, or has failed to get one. */
+    struct semaphore start_wait;
+    bool start_success;                 /* Is the new thread ready? */
+    struct process *process;            /* For creator to retrieve a pointer to the new process block. */
+  };
+
+/* Starts a new thread of the current process, a peer in its
+   thread group, that shares the process's address space and runs
+   user code at EIP, on a user stack of its own, as if EIP were
+   called with arguments FUNC and AUX.  The calling thread can
+   wait() for the new thread as for a child process; the new
+   thread's exit() ends only itself, while the leader's ends the
+   whole process once the peers have exited too.  See
+   end_group().
+
+   Returns the new thread's id, or TID_ERROR if it cannot be
+   created. */
+tid_t
+process_thread_create (void (*eip) (void), void *func, void *aux)
+{
+  struct thread *cur = thread_current ();
+  struct process_thread_params params;
+  tid_t tid;
+
+  if (!reserve_child ())
+    return TID_ERROR;
+  params.leader = process_current ();
+  if (params.leader->group == NULL && !create_group (params.leader))
+    return TID_ERROR;
+  params.eip = eip;
+  params.func = func;
+  params.aux = aux;
+  sema_init (&params.start_wait, 0);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_thread, &params);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+
+  sema_down (&params.start_wait);
+  if (!params.start_success)
+    return TID_ERROR;
+
+  /* Add child process. */
+  add_child (params.process);
+  return tid;
+}
+
+/* Makes LEADER, the running thread, which must have no thread
+   group yet, the leader of a new one.  Returns false if memory
+   is short. */
+static bool
+create_group (struct thread *leader)
+{
+  struct thread_group *g = malloc (sizeof *g);
+
+  ASSERT (leader == thread_current ());
+
+  if (g == NULL)
+    return false;
+  g->leader = leader;
+  lock_init (&g->lock);
+  cond_init (&g->peers_done);
+  g->peer_cnt = 0;
+  g->exiting = false;
+  leader->group = g;
+  return true;
+}
+
+/* A thread function that joins the thread group of a process
+   and starts running its user code. */
+static void
+start_thread (void *params_)
+{
+  struct process_thread_params *params = params_;
+  struct thread *cur = thread_current ();
+  struct thread *leader = params->leader;
+  struct thread_group *g = leader->group;
+  struct process *process = NULL;
+  struct intr_frame if_;
+  bool success;
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = params->eip;
+
+  /* Join the group, unless its leader is already exiting. */
+  lock_acquire (&g->lock);
+  success = !g->exiting;
+  if (success)
+    {
+      g->peer_cnt++;
+      cur->group = g;
+      cur->pagedir = leader->pagedir;
+      cur->spt = leader->spt;
+      process_activate ();
+      success = init_thread_stack (&if_.esp, params->func, params->aux);
+    }
+  lock_release (&g->lock);
+
+  if (success)
+    success = (process = malloc (sizeof (struct process))) != NULL;
+  if (success)
+    {
+      init_process (process, cur->tid);
+      params->process = cur->process = process;
+    }
+
+  /* PARAMS is gone once the creator resumes. */
+  params->start_success = success;
+  sema_up (&params->start_wait);
+
+  if (!success)
+    thread_exit ();
+
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Reserves a user stack for the running thread, creates its top
+   page, and pushes FUNC and AUX onto it below a null return
+   address, pointing *ESP at the latter.  Returns true if
+   successful. */
+static bool
+init_thread_stack (void **esp, void *func, void *aux)
+{
+  void *top = page_reserve_thread_stack ();
+  void *frame[3];
+
+  if (top == NULL || !page_grow_stack (top - PGSIZE)
+      || !page_load (top - PGSIZE, true))
+    return false;
+
+  frame[0] = NULL;
+  frame[1] = func;
+  frame[2] = aux;
+  *esp = top;
+  push_stack (esp, frame, sizeof frame);
+  return true;
+}
+#endif /* VM */
+
 /* Does basic initialization of PROCESS. */
 static void
 init_process (struct process *process, tid_t tid)
@@ -182,40 +569,80 @@ init_process (struct process *process, tid_t tid)
   process->wait_done = false;
 }
 
-/* Tokenizes CMDLINE and puts the arguments of the process's
-   initial function on the stack. */
-static bool
-init_stack (void **esp, char *cmdline)
+/* Splits CMDLINE into arguments separated by spaces and returns
+   them in a single block allocated with malloc(), or returns a
+   null pointer if CMDLINE holds no argument or memory cannot be
+   allocated. */
+static struct exec_args *
+parse_args (const char *cmdline)
 {
-  char *argv[LOADER_ARGS_LEN];
-  int argc = 0;
-  
-  void *null = NULL;
-  char *token, *save_ptr;
+  struct exec_args *args;
+  char *dst;
+
+  args = malloc (sizeof *args + strlen (cmdline) + 1);
+  if (args == NULL)
+    return NULL;
 
-  /* Argument strings. */
-  for (token = strtok_r (cmdline, " ", &save_ptr); token != NULL;
-       token = strtok_r (NULL, " ", &save_ptr))
+  args->argc = 0;
+  dst = args->strings;
+  for (;;)
     {
-      if (argc > LOADER_ARGS_LEN)
-        return false;
+      while (*cmdline == ' ')
+        cmdline++;
+      if (*cmdline == '\0')
+        break;
+      while (*cmdline != ' ' && *cmdline != '\0')
+        *dst++ = *cmdline++;
+      *dst++ = '\0';
+      args->argc++;
+    }
+  args->len = dst - args->strings;
 
-      push_stack (esp, token, strlen (token) + 1);
-      argv[argc++] = *esp;
+  if (args->argc == 0)
+    {
+      free (args);
+      return NULL;
     }
+  return args;
+}
 
-  /* Word-align. */
-  push_stack (esp, &null, (size_t) *esp % 4);
-  /* Null pointer sentinel. */
-  push_stack (esp, &null, sizeof (char *));
-  
-  /* Address of each argument. */
+/* Puts the arguments of the process's initial function on the
+   stack: the argument strings, copied as one block, then the
+   argv array pointing into that block, argv, argc, and a fake
+   return address.  Returns false if they do not fit in the
+   stack's first page. */
+static bool
+init_stack (void **esp, const struct exec_args *args)
+{
+  size_t ptrs_size = (args->argc + 1) * sizeof (char *);
+  void *null = NULL;
+  const char *str;
+  char *ustrings;
+  char **uargv;
   int i;
-  for (i = argc - 1; i >= 0; i--)
-    push_stack (esp, &argv[i], sizeof (char *));
 
-  push_stack (esp, &*esp, sizeof (char **));   /* argv */
-  push_stack (esp, &argc, sizeof (int));       /* argc */
+  if (args->len + 3 + ptrs_size + sizeof (char **) + sizeof (int)
+      + sizeof (void (*) (void)) > PGSIZE)
+    return false;
+
+  /* Argument strings, then word-align. */
+  push_stack (esp, args->strings, args->len);
+  ustrings = *esp;
+  *esp -= (uintptr_t) *esp % 4;
+
+  /* Address of each argument, then a null pointer sentinel,
+     written in place. */
+  *esp -= ptrs_size;
+  uargv = *esp;
+  for (i = 0, str = args->strings; i < args->argc; i++)
+    {
+      uargv[i] = ustrings + (str - args->strings);
+      str += strlen (str) + 1;
+    }
+  uargv[args->argc] = NULL;
+
+  push_stack (esp, &uargv, sizeof (char **));          /* argv */
+  push_stack (esp, &args->argc, sizeof (int));         /* argc */
   push_stack (esp, &null, sizeof (void (*) (void)));   /* return address. */
 
   return true;
@@ -223,29 +650,139 @@ init_stack (void **esp, char *cmdline)
 
 /* Helper routine. */
 static void
-push_stack (void **esp, void *src, size_t size)
+push_stack (void **esp, const void *src, size_t size)
 {
   memcpy (*esp - size, src, size);
   *esp -= size;
 }
 
+/* Locks the running thread's address space against changes by
+   the other threads of its process and returns true, or returns
+   false if the process has no other threads or the running
+   thread already holds the lock.  The result is to be passed to
+   process_unlock(). */
+bool
+process_lock (void)
+{
+  struct thread_group *g = thread_current ()->group;
+
+  if (g == NULL || lock_held_by_current_thread (&g->lock))
+    return false;
+  lock_acquire (&g->lock);
+  return true;
+}
+
+/* Releases the lock that process_lock() took, if LOCKED. */
+void
+process_unlock (bool locked)
+{
+  if (locked)
+    lock_release (&thread_current ()->group->lock);
+}
+
+/* Releases the running thread's lock on its address space, if it
+   holds it, however it was taken, so that it can wait for another
+   thread of its process to change the address space, and returns
+   true if it did.  The result is to be passed to
+   process_retake_lock(), after which whatever the caller knew of
+   the address space may be out of date. */
+bool
+process_drop_lock (void)
+{
+  struct thread_group *g = thread_current ()->group;
+
+  if (g == NULL || !lock_held_by_current_thread (&g->lock))
+    return false;
+  lock_release (&g->lock);
+  return true;
+}
+
+/* Takes back the lock that process_drop_lock() released, if
+   DROPPED. */
+void
+process_retake_lock (bool dropped)
+{
+  if (dropped)
+    lock_acquire (&thread_current ()->group->lock);
+}
+
+/* Returns true if the running thread is a peer whose leader is
+   exiting, so that it must exit as well.  Checked on entry to
+   the kernel from user code. */
+bool
+process_must_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+
+  return g != NULL && g->leader != cur && g->exiting;
+}
+
 /* Helper routine.
    Finds a child process with the given CHILD_TID.
    If not found, returns NULL. */
 struct process *
 process_child (tid_t child_tid)
 {
-  struct list *child_list = &thread_current ()->child_list;
-  struct list_elem *e;
-  for (e = list_begin (child_list); e != list_end (child_list);
-       e = list_next (e))
+  struct ohash *children = thread_current ()->children;
+  struct process key;
+  struct ohash_elem *e;
+
+  if (children == NULL)
+    return NULL;
+  key.tid = child_tid;
+  e = ohash_find (children, &key.child_elem);
+  return e != NULL ? ohash_entry (e, struct process, child_elem) : NULL;
+}
+
+/* Returns the hash value of the child process with element E in
+   its parent's children. */
+static unsigned
+child_hash (const struct ohash_elem *e, void *aux UNUSED)
+{
+  return hash_int (ohash_entry (e, struct process, child_elem)->tid);
+}
+
+/* Returns true if the child with element A in its parent's
+   children has a lower tid than the one with B. */
+static bool
+child_less (const struct ohash_elem *a, const struct ohash_elem *b,
+            void *aux UNUSED)
+{
+  return (ohash_entry (a, struct process, child_elem)->tid
+          < ohash_entry (b, struct process, child_elem)->tid);
+}
+
+/* Makes sure that the running thread has a table of children,
+   so that add_child() cannot fail after the child exists.
+   Returns false if memory is short. */
+static bool
+reserve_child (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->children != NULL)
+    return true;
+  cur->children = malloc (sizeof *cur->children);
+  if (cur->children == NULL)
+    return false;
+  if (!ohash_init (cur->children, child_hash, child_less, NULL))
     {
-      struct process *child
-        = list_entry (e, struct process, child_list_elem);
-      if (child->tid == child_tid)
-        return child;
+      free (cur->children);
+      cur->children = NULL;
+      return false;
     }
-  return NULL;
+  return true;
+}
+
+/* Adds P, whose tid is set, to the running thread's children,
+   for which reserve_child() must have been called. */
+static void
+add_child (struct process *p)
+{
+  ASSERT (thread_current ()->children != NULL);
+
+  ohash_insert (thread_current ()->children, &p->child_elem);
 }
 
 /* Waits for thread TID to die and returns its exit status.  If
@@ -272,6 +809,7 @@ process_wait (tid_t child_tid)
 
   sema_down (&child->exit_wait);
   child->wait_done = true;
+  thread_add_rusage (&thread_current ()->child_rusage, &child->rusage);
   return child->exit_status;
 }
 
@@ -316,12 +854,144 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
-  uint32_t *pd;
+  struct thread_group *g = cur->group;
+  bool peer = g != NULL && g->leader != cur;
+
+  /* A thread that dies while changing the address space, as on
+     a bad access in a system call, must not keep the others
+     out. */
+  if (g != NULL && lock_held_by_current_thread (&g->lock))
+    lock_release (&g->lock);
+
+  /* Asynchronous ring operations may still be writing files. */
+  aio_destroy (cur->aio);
+  cur->aio = NULL;
+
+  if (peer)
+    leave_group ();
+  else
+    {
+      if (g != NULL)
+        end_group ();
+      close_process_files ();
+    }
+
+  /* The parent may see the exit status as soon as the process's
+     files are closed and its mappings written back.  Freeing its
+     memory is invisible to the parent, so a process whose parent
+     is waiting wakes the parent first and finishes at the lowest
+     priority, out of the way of the parent and its next child.
+     The exiting thread does that work itself, rather than a
+     separate reaper thread, because its pages and frames name it
+     as their owner until they are freed. */
+  if (cur->process != NULL)
+    {
+      bool waited = !heap_empty (&cur->process->exit_wait.waiters);
+
+      thread_get_rusage (cur, &cur->process->rusage);
+      thread_add_rusage (&cur->process->rusage, &cur->child_rusage);
+      sema_up (&cur->process->exit_wait);
+      if (waited && !peer)
+        thread_set_priority (PRI_MIN);
+    }
+  if (!peer)
+    free_address_space ();
+
+  /* If a running thread has a process that it has executed.
+     Releases this process from the current thread. */
+  if (cur->process != NULL)
+    {
+      /* The current thread, that is, a thread that has executed
+         this process no longer owns this process. */
+      release_from_owner (cur->process);
+    }
   
+  /* Make all child processes release from the current thread.
+     The current process informs its child processes that it is
+     terminating first. */
+  if (cur->children != NULL)
+    {
+      ohash_destroy (cur->children, release_child);
+      free (cur->children);
+      cur->children = NULL;
+    }
+}
+
+/* ohash_destroy() helper for process_exit() that releases the
+   child process with element E in the parent's children. */
+static void
+release_child (struct ohash_elem *e, void *aux UNUSED)
+{
+  release_from_parent (ohash_entry (e, struct process, child_elem));
+}
+
+/* Takes the running thread, a peer, out of its thread group,
+   giving up its user stack and its use of the group's page
+   directory, which the leader frees once the last peer is
+   gone. */
+static void
+leave_group (void)
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+
+  lock_acquire (&g->lock);
+#ifdef VM
+  page_release_stack ();
+  cur->spt = NULL;
+#endif
+  cur->pagedir = NULL;
+  pagedir_activate (NULL);
+  g->peer_cnt--;
+  cond_signal (&g->peers_done, &g->lock);
+  lock_release (&g->lock);
+}
+
+/* Waits, as the leader of a thread group, until all its peers
+   have exited, then frees the group.  A peer notices that it
+   must exit on its next system call, page fault, or, if it is
+   running user code, interrupt, so only one that stays blocked
+   in a system call other than a futex wait or a wait for a user
+   fault handler holds the leader up. */
+static void
+end_group (void)
+{
+  struct thread *cur = thread_current ();
+  struct thread_group *g = cur->group;
+
+  lock_acquire (&g->lock);
+  g->exiting = true;
+  lock_release (&g->lock);
+#ifdef VM
+  futex_exit (cur);
+  page_uffd_exit ();
+#endif
+
+  lock_acquire (&g->lock);
+  while (g->peer_cnt > 0)
+    cond_wait (&g->peers_done, &g->lock);
+  lock_release (&g->lock);
+
+  cur->group = NULL;
+  free (g);
+}
+
+/* Closes the executable and open files of the running thread,
+   which no other thread shares, and unmaps its memory mappings,
+   writing them back. */
+static void
+close_process_files (void)
+{
+  struct thread *cur = thread_current ();
+
   /* Close the user program. */
-  lock_acquire (&fs_lock);
+#ifdef VM
+  prepage_finish (thread_name ());
+#endif
   file_close (cur->bin);
-  lock_release (&fs_lock);
+  cur->bin = NULL;
+  file_close (cur->lib);
+  cur->lib = NULL;
 
   /* Close all open files. */
   sys_fd_exit ();
@@ -329,10 +999,22 @@ process_exit (void)
 #ifdef VM
   /* Unmap all mmap mappings. */
   sys_mmap_exit ();
+#endif
+}
+
+/* Frees the address space of the running thread, which no other
+   thread shares, if it has one. */
+static void
+free_address_space (void)
+{
+  struct thread *cur = thread_current ();
+  uint32_t *pd;
 
+#ifdef VM
   /* Destroy the current process's supplemental page table. */
   if (cur->spt != NULL)
     page_destroy_spt (cur->spt);
+  page_destroy_regions ();
 #endif
 
   /* Destroy the current process's page directory and switch back
@@ -351,30 +1033,6 @@ process_exit (void)
       pagedir_activate (NULL);
       pagedir_destroy (pd);
     }
-
-  /* If a running thread has a process that it has executed.
-     Releases this process from the current thread. */
-  if (cur->process != NULL)
-    {
-      sema_up (&cur->process->exit_wait);
-
-      /* The current thread, that is, a thread that has executed
-         this process no longer owns this process. */
-      release_from_owner (cur->process);
-    }
-  
-  /* Make all child processes release from the current thread. */
-  struct list *child_list = &cur->child_list;
-  while (!list_empty (child_list))
-    {
-      struct process *child
-        = list_entry (list_pop_front (child_list), struct process,
-                      child_list_elem);
-      
-      /* The current process informs its child processes that
-         it is terminating first. */
-      release_from_parent (child);
-    }
 }
 
 /* Sets up the CPU for running user code in the current
@@ -393,68 +1051,42 @@ process_activate (void)
   tss_update ();
 }
 
-/* We load ELF binaries.  The following definitions are taken
-   from the ELF specification, [ELF1], more-or-less verbatim.  */
-
-/* ELF types.  See [ELF1] 1-2. */
-typedef uint32_t Elf32_Word, Elf32_Addr, Elf32_Off;
-typedef uint16_t Elf32_Half;
-
-/* For use with ELF types in printf(). */
-#define PE32Wx PRIx32   /* Print Elf32_Word in hexadecimal. */
-#define PE32Ax PRIx32   /* Print Elf32_Addr in hexadecimal. */
-#define PE32Ox PRIx32   /* Print Elf32_Off in hexadecimal. */
-#define PE32Hx PRIx16   /* Print Elf32_Half in hexadecimal. */
-
-/* Executable header.  See [ELF1] 1-4 to 1-8.
-   This appears at the very beginning of an ELF binary. */
-struct Elf32_Ehdr
+/* Cache of executable layouts.
+
+   Validating an executable's headers takes a read of its ELF
+   header and of each program header.  The same few executables
+   tend to be run over and over, so the results are kept here,
+   keyed by inode, and load() goes straight to load_segment() on
+   a hit.  Each entry keeps its inode open, so that the inode
+   stays in memory from one run to the next and cannot be reused
+   for another file, and records the inode's version: a write to
+   the executable changes the version and so invalidates the
+   entry.  An entry whose file has been removed is dropped at the
+   next lookup, which lets the file's sectors be freed. */
+#define EXEC_CACHE_SIZE 8
+
+struct exec_cache_entry
   {
-    unsigned char e_ident[16];
-    Elf32_Half    e_type;
-    Elf32_Half    e_machine;
-    Elf32_Word    e_version;
-    Elf32_Addr    e_entry;
-    Elf32_Off     e_phoff;
-    Elf32_Off     e_shoff;
-    Elf32_Word    e_flags;
-    Elf32_Half    e_ehsize;
-    Elf32_Half    e_phentsize;
-    Elf32_Half    e_phnum;
-    Elf32_Half    e_shentsize;
-    Elf32_Half    e_shnum;
-    Elf32_Half    e_shstrndx;
+    struct inode *inode;                /* Executable, or null if unused. */
+    unsigned version;                   /* Version of INODE when read. */
+    unsigned long used;                 /* Time of last use. */
+    struct exec_image image;            /* Layout. */
   };
 
-/* Program header.  See [ELF1] 2-2 to 2-4.
-   There are e_phnum of these, starting at file offset e_phoff
-   (see [ELF1] 1-6). */
-struct Elf32_Phdr
-  {
-    Elf32_Word p_type;
-    Elf32_Off  p_offset;
-    Elf32_Addr p_vaddr;
-    Elf32_Addr p_paddr;
-    Elf32_Word p_filesz;
-    Elf32_Word p_memsz;
-    Elf32_Word p_flags;
-    Elf32_Word p_align;
-  };
+static struct exec_cache_entry exec_cache[EXEC_CACHE_SIZE];
+static unsigned long exec_cache_clock;  /* Ticks once per use. */
+static struct lock exec_cache_lock;     /* Protects the above. */
+
+/* Where a shared library is loaded.  See dynlink.c. */
+#define SHLIB_BASE ((uint8_t *) 0x40000000)
 
-/* Values for p_type.  See [ELF1] 2-3. */
-#define PT_NULL    0            /* Ignore. */
-#define PT_LOAD    1            /* Loadable segment. */
-#define PT_DYNAMIC 2            /* Dynamic linking info. */
-#define PT_INTERP  3            /* Name of dynamic loader. */
-#define PT_NOTE    4            /* Auxiliary info. */
-#define PT_SHLIB   5            /* Reserved. */
-#define PT_PHDR    6            /* Program header table. */
-#define PT_STACK   0x6474e551   /* Stack segment. */
-
-/* Flags for p_flags.  See [ELF3] 2-3 and 2-4. */
-#define PF_X 1          /* Executable. */
-#define PF_W 2          /* Writable. */
-#define PF_R 4          /* Readable. */
+static bool exec_cache_lookup (struct inode *, struct exec_image *);
+static void exec_cache_insert (struct inode *, const struct exec_image *);
+static bool find_image (struct file *, uint8_t *base, struct exec_image *);
+static bool read_image (struct file *, uint8_t *base, struct exec_image *);
+static bool map_image (struct file *, const struct exec_image *,
+                       uint8_t **heap);
+static bool load_library (struct file *, const struct exec_image *);
 
 static bool setup_stack (void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
@@ -462,6 +1094,13 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
+/* Initializes the cache of executable layouts. */
+void
+process_init (void)
+{
+  lock_init (&exec_cache_lock);
+}
+
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
@@ -470,11 +1109,10 @@ bool
 load (const char *exec_path, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct exec_image image;
   struct file *file = NULL;
-  off_t file_ofs;
+  uint8_t *heap = NULL;
   bool success = false;
-  int i;
 
 #ifdef VM
   /* Create supplemental page table. */
@@ -498,31 +1136,164 @@ load (const char *exec_path, void (**eip) (void), void **esp)
     }
   file_deny_write (file);
 
+  /* Find the executable's layout, reading and validating its
+     headers unless an earlier run already did.  Writes are denied
+     from here on, so the layout cannot go stale while we load. */
+  if (!find_image (file, NULL, &image))
+    {
+      printf ("load: %s: error loading executable\n", exec_path);
+      goto done; 
+    }
+
+  /* Map the segments.  The heap starts past the last one. */
+  if (!map_image (file, &image, &heap))
+    goto done;
+#ifdef VM
+  page_init_heap (heap);
+#endif
+
+  /* Map and link the shared library, if the executable uses
+     one. */
+  if (image.interp[0] != '\0' && !load_library (file, &image))
+    goto done;
+
+  /* Set up stack. */
+  if (!setup_stack (esp))
+    goto done;
+
+#ifdef VM
+  /* Prefetch the pages this executable faulted in last time. */
+  prepage_start (exec_path, file);
+#endif
+
+  /* Start address. */
+  *eip = image.entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not. */
+  return success;
+}
+
+/* load() helpers. */
+
+static bool install_page (void *upage, void *kpage, bool writable);
+
+/* Loads the shared library that IMAGE, the layout of executable
+   FILE, names at SHLIB_BASE, keeping it open and unmodifiable
+   as the executable is, and links the two.  Returns true if
+   successful, false otherwise. */
+static bool
+load_library (struct file *file, const struct exec_image *image)
+{
+  struct thread *t = thread_current ();
+  struct exec_image lib_image;
+
+  t->lib = filesys_open (image->interp);
+  if (t->lib == NULL)
+    {
+      printf ("load: %s: open failed\n", image->interp);
+      return false;
+    }
+  file_deny_write (t->lib);
+
+  if (!find_image (t->lib, SHLIB_BASE, &lib_image))
+    {
+      printf ("load: %s: error loading shared library\n", image->interp);
+      return false;
+    }
+  return (map_image (t->lib, &lib_image, NULL)
+          && dynlink_link (file, image, t->lib, &lib_image));
+}
+
+/* Stores the layout of FILE, loaded at BASE, in IMAGE, from the
+   cache if an earlier load already read it, otherwise by reading
+   and validating FILE's headers and adding the result to the
+   cache.  Returns true if successful, false if FILE is not a
+   valid executable, if BASE is a null pointer, or shared
+   library otherwise. */
+static bool
+find_image (struct file *file, uint8_t *base, struct exec_image *image)
+{
+  struct inode *inode = file_get_inode (file);
+
+  if (exec_cache_lookup (inode, image) && image->base == base)
+    return true;
+  if (!read_image (file, base, image))
+    return false;
+  exec_cache_insert (inode, image);
+  return true;
+}
+
+/* Maps the segments of IMAGE, the layout of FILE.  If HEAP is
+   not a null pointer, raises *HEAP to the end of the last
+   segment.  Returns true if successful, false otherwise. */
+static bool
+map_image (struct file *file, const struct exec_image *image,
+           uint8_t **heap)
+{
+  int i;
+
+  for (i = 0; i < image->seg_cnt; i++)
+    {
+      const struct exec_seg *seg = &image->segs[i];
+      uint8_t *seg_end = seg->mem_page + seg->read_bytes + seg->zero_bytes;
+
+      if (!load_segment (file, seg->file_page, seg->mem_page,
+                         seg->read_bytes, seg->zero_bytes, seg->writable))
+        return false;
+      if (heap != NULL && seg_end > *heap)
+        *heap = seg_end;
+    }
+  return true;
+}
+
+/* Reads and validates the ELF header and program headers of
+   FILE, and stores the entry point and loadable segments in
+   IMAGE.  FILE must be an executable if BASE is a null pointer,
+   otherwise a shared library, whose addresses are offset by
+   BASE.  Returns true if successful, false if FILE is not a
+   valid executable or library. */
+static bool
+read_image (struct file *file, uint8_t *base, struct exec_image *image)
+{
+  struct Elf32_Ehdr ehdr;
+  off_t file_ofs;
+  int i;
+
   /* Read and verify executable header. */
+  file_seek (file, 0);
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
       || memcmp (ehdr.e_ident, "\177ELF\1\1\1", 7)
-      || ehdr.e_type != 2
+      || ehdr.e_type != (base == NULL ? ET_EXEC : ET_DYN)
       || ehdr.e_machine != 3
       || ehdr.e_version != 1
       || ehdr.e_phentsize != sizeof (struct Elf32_Phdr)
       || ehdr.e_phnum > 1024) 
-    {
-      printf ("load: %s: error loading executable\n", exec_path);
-      goto done; 
-    }
+    return false;
+
+  image->entry = (void (*) (void)) (base + ehdr.e_entry);
+  image->base = base;
+  image->seg_cnt = 0;
+  image->dyn_ofs = 0;
+  image->dyn_size = 0;
+  image->interp[0] = '\0';
 
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++) 
     {
       struct Elf32_Phdr phdr;
+      struct exec_seg *seg;
+      uint32_t page_offset;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        return false;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        return false;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -533,60 +1304,145 @@ load (const char *exec_path, void (**eip) (void), void **esp)
         default:
           /* Ignore this segment. */
           break;
+        case PT_SHLIB:
+          return false;
         case PT_DYNAMIC:
+          if (phdr.p_offset > (Elf32_Off) file_length (file)
+              || phdr.p_filesz > (Elf32_Off) file_length (file)
+                                 - phdr.p_offset)
+            return false;
+          image->dyn_ofs = phdr.p_offset;
+          image->dyn_size = phdr.p_filesz;
+          break;
         case PT_INTERP:
-        case PT_SHLIB:
-          goto done;
+          /* Only an executable names a library, with a short
+             absolute file name. */
+          if (base != NULL || phdr.p_filesz < 2
+              || phdr.p_filesz > EXEC_INTERP_MAX
+              || (file_read_at (file, image->interp, phdr.p_filesz,
+                                phdr.p_offset)
+                  != (off_t) phdr.p_filesz)
+              || image->interp[phdr.p_filesz - 1] != '\0'
+              || strlen (image->interp) != phdr.p_filesz - 1)
+            return false;
+          break;
         case PT_LOAD:
-          if (validate_segment (&phdr, file)) 
+          /* A library's addresses are relative to BASE. */
+          if (phdr.p_vaddr >= (uintptr_t) PHYS_BASE - (uintptr_t) base)
+            return false;
+          phdr.p_vaddr += (uintptr_t) base;
+          if (!validate_segment (&phdr, file)
+              || image->seg_cnt >= EXEC_SEG_MAX)
+            return false;
+
+          seg = &image->segs[image->seg_cnt++];
+          seg->writable = (phdr.p_flags & PF_W) != 0;
+          seg->file_page = phdr.p_offset & ~PGMASK;
+          seg->mem_page = (uint8_t *) (phdr.p_vaddr & ~PGMASK);
+          page_offset = phdr.p_vaddr & PGMASK;
+          if (phdr.p_filesz > 0)
+            {
+              /* Normal segment.
+                 Read initial part from disk and zero the rest. */
+              seg->read_bytes = page_offset + phdr.p_filesz;
+              seg->zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
+                                 - seg->read_bytes);
+            }
+          else 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
-              uint32_t page_offset = phdr.p_vaddr & PGMASK;
-              uint32_t read_bytes, zero_bytes;
-              if (phdr.p_filesz > 0)
-                {
-                  /* Normal segment.
-                     Read initial part from disk and zero the rest. */
-                  read_bytes = page_offset + phdr.p_filesz;
-                  zero_bytes = (ROUND_UP (page_offset + phdr.p_memsz, PGSIZE)
-                                - read_bytes);
-                }
-              else 
-                {
-                  /* Entirely zero.
-                     Don't read anything from disk. */
-                  read_bytes = 0;
-                  zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
-                }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
+              /* Entirely zero.
+                 Don't read anything from disk. */
+              seg->read_bytes = 0;
+              seg->zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
             }
-          else
-            goto done;
           break;
         }
     }
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
+  /* Dynamic linking information is used only to link an
+     executable with its library, so an executable must name one
+     if it has any, and a library must have some. */
+  if (base == NULL
+      ? image->dyn_size > 0 && image->interp[0] == '\0'
+      : image->dyn_size == 0)
+    return false;
+  return true;
+}
 
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+/* Looks up the layout of the executable in INODE in the cache
+   and, if it is there and current, copies it to IMAGE and returns
+   true.  Otherwise returns false.  Also drops any entries for
+   removed files. */
+static bool
+exec_cache_lookup (struct inode *inode, struct exec_image *image)
+{
+  struct inode *stale[EXEC_CACHE_SIZE];
+  int stale_cnt = 0;
+  bool found = false;
+  int i;
 
-  success = true;
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+      struct exec_cache_entry *e = &exec_cache[i];
+      if (e->inode == NULL)
+        continue;
+      if (e->inode == inode && e->version == inode_get_version (inode))
+        {
+          *image = e->image;
+          e->used = ++exec_cache_clock;
+          found = true;
+        }
+      else if (e->inode == inode || inode_is_removed (e->inode))
+        {
+          stale[stale_cnt++] = e->inode;
+          e->inode = NULL;
+        }
+    }
+  lock_release (&exec_cache_lock);
 
- done:
-  /* We arrive here whether the load is successful or not. */
-  return success;
+  /* Closing may free a removed file's sectors, so it is done
+     without the cache lock. */
+  for (i = 0; i < stale_cnt; i++)
+    inode_close (stale[i]);
+  return found;
 }
-
-/* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
+/* Adds IMAGE, the layout of the executable in INODE, to the
+   cache, replacing the least recently used entry if the cache is
+   full. */
+static void
+exec_cache_insert (struct inode *inode, const struct exec_image *image)
+{
+  struct exec_cache_entry *victim = NULL;
+  struct inode *old;
+  int i;
+
+  lock_acquire (&exec_cache_lock);
+  for (i = 0; i < EXEC_CACHE_SIZE; i++)
+    {
+      struct exec_cache_entry *e = &exec_cache[i];
+      if (e->inode == inode)
+        {
+          /* Another process read the same layout meanwhile. */
+          lock_release (&exec_cache_lock);
+          return;
+        }
+      if (victim == NULL || e->inode == NULL
+          || (victim->inode != NULL && e->used < victim->used))
+        victim = e;
+    }
+
+  old = victim->inode;
+  victim->inode = inode_reopen (inode);
+  victim->version = inode_get_version (inode);
+  victim->used = ++exec_cache_clock;
+  victim->image = *image;
+  lock_release (&exec_cache_lock);
+
+  if (old != NULL)
+    inode_close (old);
+}
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -655,6 +1511,12 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifdef VM
+  /* The whole segment is a single region, whose pages are loaded
+     lazily. */
+  return page_map_region (upage, (read_bytes + zero_bytes) / PGSIZE,
+                          file, ofs, read_bytes, writable, false);
+#else
   file_seek (file, ofs);
   while (read_bytes > 0 || zero_bytes > 0) 
     {
@@ -663,25 +1525,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
          and zero the final PAGE_ZERO_BYTES bytes. */
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
-#ifdef VM
-      /* Create a supplemental page table entry for UPAGE. */
-      struct page *p = page_make_entry (upage);
-      if (!p)
-        return false;
-      
-      /* Set the page type. */
-      if (page_read_bytes > 0)
-        p->type = PG_FILE;
-      else
-        p->type = PG_ZERO;
-      
-      /* Add supplemental information. */
-      p->file = file;
-      p->file_ofs = ofs;
-      p->read_bytes = page_read_bytes;
-      p->zero_bytes = page_zero_bytes;
-      p->writable = writable;
-#else
+
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
@@ -701,17 +1545,14 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
           palloc_free_page (kpage);
           return false; 
         }
-#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
       zero_bytes -= page_zero_bytes;
       upage += PGSIZE;
-#ifdef VM
-      ofs += page_read_bytes;
-#endif
     }
   return true;
+#endif
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
@@ -720,20 +1561,15 @@ static bool
 setup_stack (void **esp) 
 {
 #ifdef VM
-  struct page *p;
   void *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
   bool success = false;
 
-  /* Create a supplemental page table entry for UPAGE. */
-  p = page_make_entry (upage);  
-  if (p != NULL)
+  /* Reserve the stack region, then create its top page and load
+     it immediately. */
+  if (page_reserve_stack (STACK_MAX_SIZE / PGSIZE)
+      && page_grow_stack (upage))
     {
-      /* Add supplemental information. */
-      p->type = PG_ZERO;
-      p->writable = true;
-
-      /* Load UPAGE immediately. */
-      success = page_load (upage);
+      success = page_load (upage, true);
       if (success)
         *esp = PHYS_BASE;
     }
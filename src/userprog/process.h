@@ -1,6 +1,7 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <hash.h>
 #include <list.h>
 #include "threads/thread.h"
 #include "threads/synch.h"
@@ -8,12 +9,12 @@
 /* A process control block to maintain process hierarchy
    and exec/wait infrastructure.
    Each thread has a reference to this process control block and
-   has a list of child processes. */
+   a table of its child processes, by tid. */
 struct process
   {
     /* Basic information. */
     tid_t tid;                          /* Process identifier. */
-    struct list_elem child_list_elem;   /* List element of child list in `struct thread'. */
+    struct ohash_elem child_elem;       /* Element in parent's `children'. */
 
     /* Shared data between `exec' and `wait'. */
     int exit_status;                    /* Process's exit status. */
@@ -29,13 +30,64 @@ struct process
 
     /* Prevent waiting more than once for the same tid. */
     bool wait_done;                     /* If true, wait call to this process must be ignored. */
+
+    /* Resources used by the process and its waited-for children,
+       set when it exits. */
+    struct rusage rusage;
+  };
+
+/* The threads of a process that thread_create() has given more
+   than one, all sharing the address space of its first thread,
+   the leader.  The leader keeps the page directory, SPT,
+   regions, file descriptors and mmap mappings in its struct
+   thread, and exits last, so that the SPTEs and frames that name
+   it as their owner stay valid.  The other threads, its peers,
+   copy its page directory and SPT pointers and have user stacks
+   of their own.
+
+   A process gets a group on its first thread_create(), so that
+   a process with a single thread takes no locks for it. */
+struct thread_group
+  {
+    struct thread *leader;              /* Owner of the address space. */
+    struct lock lock;                   /* Serializes changes to it. */
+    struct condition peers_done;        /* Signaled as peers exit. */
+    int peer_cnt;                       /* Threads other than LEADER. */
+    bool exiting;                       /* Is LEADER exiting? */
   };
 
+/* Returns the thread that owns the address space of thread T:
+   T itself, unless T is a peer in a thread group. */
+static inline struct thread *
+process_leader (struct thread *t)
+{
+  return t->group != NULL ? t->group->leader : t;
+}
+
+/* Returns the thread that owns the running thread's address
+   space. */
+static inline struct thread *
+process_current (void)
+{
+  return process_leader (thread_current ());
+}
+
+void process_init (void);
+struct intr_frame;
+
 tid_t process_execute (const char *cmdline);
+tid_t process_spawn (const char *cmdline);
+tid_t process_fork (const struct intr_frame *);
+tid_t process_thread_create (void (*eip) (void), void *func, void *aux);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
 
 struct process *process_child (tid_t);
+bool process_lock (void);
+void process_unlock (bool locked);
+bool process_drop_lock (void);
+void process_retake_lock (bool dropped);
+bool process_must_exit (void);
 
 #endif /* userprog/process.h */
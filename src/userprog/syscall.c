@@ -1,32 +1,50 @@
 #include "userprog/syscall.h"
 #include "lib/user/syscall.h"
 #include <stdio.h>
+#include <round.h>
+#include <string.h>
 #include <syscall-nr.h>
 #include "lib/stdio.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/poll.h"
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
+#include "userprog/pipe.h"
+#include "userprog/systrace.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #ifdef VM
 #include "vm/page.h"
 #include "vm/frame.h"
+#include "vm/vmstat.h"
+#include "vm/shm.h"
+#include "vm/futex.h"
+#include "vm/uffd.h"
+#include "filesys/cache.h"
 #endif
 
 static void syscall_handler (struct intr_frame *);
 
 /* Number of system calls. */
-#ifdef VM
-#define SYSCALL_CNT 15
-#else
-#define SYSCALL_CNT 13
-#endif
+#define SYSCALL_CNT (SYS_IO_GROUP + 1)
+
+/* Maximum number of buffers in a readv() or writev() call. */
+#define IOV_MAX 1024
+
+/* Maximum number of file descriptors in a poll() call. */
+#define POLL_MAX 64
 
 /* Wrapper functions for each system call.
    Each of them safely reads sycall arguments and invokes system
@@ -51,8 +69,48 @@ static void sys_close_wrapper    (struct intr_frame *);
 /* Project 3 and optionally project 4. */
 static void sys_mmap_wrapper     (struct intr_frame *);
 static void sys_munmap_wrapper   (struct intr_frame *);
+
+/* Extensions. */
+static void sys_vmstat_wrapper   (struct intr_frame *);
+static void sys_shm_map_wrapper  (struct intr_frame *);
+static void sys_shm_unlink_wrapper (struct intr_frame *);
+static void sys_msync_wrapper    (struct intr_frame *);
+static void sys_mmap_range_wrapper (struct intr_frame *);
+static void sys_madvise_wrapper  (struct intr_frame *);
+static void sys_thread_create_wrapper (struct intr_frame *);
+static void sys_futex_wrapper    (struct intr_frame *);
+static void sys_sbrk_wrapper     (struct intr_frame *);
+static void sys_mempressure_wrapper (struct intr_frame *);
+static void sys_uffd_register_wrapper (struct intr_frame *);
+static void sys_uffd_copy_wrapper (struct intr_frame *);
 #endif
 
+/* Extensions. */
+static void sys_readv_wrapper    (struct intr_frame *);
+static void sys_writev_wrapper   (struct intr_frame *);
+static void sys_ring_setup_wrapper (struct intr_frame *);
+static void sys_ring_enter_wrapper (struct intr_frame *);
+static void sys_fork_wrapper     (struct intr_frame *);
+static void sys_clock_ns_wrapper (struct intr_frame *);
+static void sys_lockstat_wrapper (struct intr_frame *);
+static void sys_memstat_wrapper  (struct intr_frame *);
+static void sys_iostat_wrapper   (struct intr_frame *);
+static void sys_read_input_wrapper (struct intr_frame *);
+static void sys_pipe_wrapper     (struct intr_frame *);
+static void sys_spawn_wrapper    (struct intr_frame *);
+static void sys_spawn_many_wrapper (struct intr_frame *);
+static void sys_sched_group_wrapper (struct intr_frame *);
+static void sys_io_group_wrapper (struct intr_frame *);
+static void sys_getrusage_wrapper (struct intr_frame *);
+static void sys_syscallstat_wrapper (struct intr_frame *);
+static void sys_fallocate_wrapper (struct intr_frame *);
+static void sys_copy_file_range_wrapper (struct intr_frame *);
+static void sys_fsync_wrapper    (struct intr_frame *);
+static void sys_sync_wrapper     (struct intr_frame *);
+static void sys_getdents_wrapper (struct intr_frame *);
+static void sys_poll_wrapper (struct intr_frame *);
+static void sys_ring_wait_wrapper (struct intr_frame *);
+
 /* Prototypes. */
 void     sys_halt (void);
 void     sys_exit (int);
@@ -63,6 +121,7 @@ bool     sys_remove (const char *);
 int      sys_open (const char *);
 int      sys_filesize (int);
 int      sys_read (int, void *, unsigned);
+int      sys_read_input (void *, unsigned, int);
 int      sys_write (int, const void *, unsigned);
 void     sys_seek (int, unsigned);
 unsigned sys_tell (int);
@@ -70,7 +129,42 @@ void     sys_close (int);
 #ifdef VM
 mapid_t  sys_mmap (int, void *);
 void     sys_munmap (mapid_t);
+bool     sys_vmstat (struct vmstat *, bool);
+mapid_t  sys_shm_map (const char *, void *, unsigned);
+bool     sys_shm_unlink (const char *);
+bool     sys_msync (mapid_t, int);
+mapid_t  sys_mmap_range (int, void *, const struct mmap_args *);
+bool     sys_madvise (void *, size_t, int);
+pid_t    sys_thread_create (void (*) (void), void *, void *);
+int      sys_futex (int *, int, int);
+void    *sys_sbrk (intptr_t);
+int      sys_mempressure (int, int);
+int      sys_uffd_register (void *, size_t);
+int      sys_uffd_copy (void *, const void *, size_t);
 #endif
+int      sys_readv (int, const struct iovec *, int);
+int      sys_writev (int, const struct iovec *, int);
+bool     sys_ring_setup (struct ring *);
+int      sys_ring_enter (void);
+int      sys_ring_wait (void);
+pid_t    sys_fork (struct intr_frame *);
+bool     sys_clock_ns (int64_t *);
+void     sys_lockstat (void);
+void     sys_memstat (void);
+void     sys_iostat (void);
+bool     sys_pipe (int *);
+pid_t    sys_spawn (const char *);
+int      sys_spawn_many (const char **, int, pid_t *);
+int      sys_sched_group (int);
+int      sys_io_group (int, int);
+bool     sys_getrusage (int, struct rusage *);
+void     sys_syscallstat (void);
+bool     sys_fallocate (int, const struct fallocate_args *);
+int      sys_copy_file_range (int, int, unsigned);
+bool     sys_fsync (int);
+void     sys_sync (void);
+int      sys_getdents (const struct getdents_args *);
+int      sys_poll (struct pollfd *, int, int);
 
 /* In Pintos, system call number and arguments are all 32-bit
    values.  See lib/user/syscall.c */
@@ -80,6 +174,64 @@ typedef void sys_wrapper_func (struct intr_frame *);
 /* System call wrapper functions for each system call. */
 static sys_wrapper_func *sys_wrap_funcs[SYSCALL_CNT];
 
+/* System calls that change the address space, which run with it
+   locked against the other threads of the process.  See
+   process_lock(). */
+static bool sys_locked[SYSCALL_CNT];
+
+/* Statistics for each system call, in TSC cycles.  A call
+   counts as blocked if the calling thread blocked at least once
+   before it returned.  Latencies go in buckets of powers of 2
+   cycles from 2**10 up, as for page faults in vm/vmstat.c. */
+#define SYSCALL_LATENCY_BUCKETS 16
+struct syscall_stats
+  {
+    long long calls;                    /* Calls made. */
+    long long blocked;                  /* Calls that blocked. */
+    long long cycles;                   /* Time in the call. */
+    long long lock_cycles;              /* Waiting for process_lock(). */
+    long long bytes;                    /* Read or written, if I/O. */
+    unsigned latency[2][SYSCALL_LATENCY_BUCKETS]; /* By blocked. */
+  };
+static struct syscall_stats syscall_stats[SYSCALL_CNT];
+
+/* System call names, for printing statistics. */
+static const char *syscall_names[SYSCALL_CNT] =
+  {
+    [SYS_HALT] = "halt", [SYS_EXIT] = "exit", [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait", [SYS_CREATE] = "create", [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open", [SYS_FILESIZE] = "filesize", [SYS_READ] = "read",
+    [SYS_WRITE] = "write", [SYS_SEEK] = "seek", [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close", [SYS_MMAP] = "mmap", [SYS_MUNMAP] = "munmap",
+    [SYS_CHDIR] = "chdir", [SYS_MKDIR] = "mkdir", [SYS_READDIR] = "readdir",
+    [SYS_ISDIR] = "isdir", [SYS_INUMBER] = "inumber",
+    [SYS_VMSTAT] = "vmstat", [SYS_READV] = "readv", [SYS_WRITEV] = "writev",
+    [SYS_RING_SETUP] = "ring_setup", [SYS_RING_ENTER] = "ring_enter",
+    [SYS_FORK] = "fork", [SYS_CLOCK_NS] = "clock_ns",
+    [SYS_LOCKSTAT] = "lockstat", [SYS_MEMSTAT] = "memstat",
+    [SYS_IOSTAT] = "iostat", [SYS_READ_INPUT] = "read_input",
+    [SYS_PIPE] = "pipe", [SYS_SHM_MAP] = "shm_map",
+    [SYS_SHM_UNLINK] = "shm_unlink", [SYS_MSYNC] = "msync",
+    [SYS_MMAP_RANGE] = "mmap_range", [SYS_MADVISE] = "madvise",
+    [SYS_THREAD_CREATE] = "thread_create", [SYS_FUTEX] = "futex",
+    [SYS_SBRK] = "sbrk", [SYS_SPAWN] = "spawn",
+    [SYS_SPAWN_MANY] = "spawn_many", [SYS_SCHED_GROUP] = "sched_group",
+    [SYS_GETRUSAGE] = "getrusage", [SYS_SYSCALLSTAT] = "syscallstat",
+    [SYS_FALLOCATE] = "fallocate",
+    [SYS_COPY_FILE_RANGE] = "copy_file_range",
+    [SYS_FSYNC] = "fsync", [SYS_SYNC] = "sync",
+    [SYS_GETDENTS] = "getdents", [SYS_POLL] = "poll",
+    [SYS_RING_WAIT] = "ring_wait", [SYS_MEMPRESSURE] = "mempressure",
+    [SYS_UFFD_REGISTER] = "uffd_register", [SYS_UFFD_COPY] = "uffd_copy",
+    [SYS_IO_GROUP] = "io_group",
+  };
+
+static void count_syscall (int no, const struct intr_frame *,
+                           uint64_t start, uint64_t lock_cycles,
+                           bool blocked);
+static void record_syscall (int no, const struct intr_frame *,
+                            int64_t start_ns, bool returns);
+
 /* User memory read/write helpers.
    Every user memory access required by system call must be done
    using these helper functions. */
@@ -114,31 +266,38 @@ static void bad_user_access (void);
 #define SYSCALL_GET_NUMBER(ESP, DST) \
         SYSCALL_GET_ARG(ESP, -1, DST);
 
+/* Helper routine.  It reads the first CNT syscall arguments
+   from the stack into array DST with a single copy. */
+#define SYSCALL_GET_ARGV(ESP, DST, CNT) \
+        copy_from_user (DST, SYSCALL_ARG_ADDR (ESP, 0), \
+                        (CNT) * sizeof (sys_param_type));
+
 /* Safely retrieves "one" syscall argument. */
 #define SYSCALL_GET_ARGS1(ESP, DST0) \
         SYSCALL_GET_ARG(ESP, 0, DST0);
 /* Safely retrieves "two" syscall argument. */
 #define SYSCALL_GET_ARGS2(ESP, DST0, DST1) \
-        SYSCALL_GET_ARGS1(ESP, DST0); \
-        SYSCALL_GET_ARG(ESP, 1, DST1);
+        { \
+          sys_param_type argv_[2]; \
+          SYSCALL_GET_ARGV (ESP, argv_, 2); \
+          *(DST0) = argv_[0]; \
+          *(DST1) = argv_[1]; \
+        }
 /* Safely retrieves "three" syscall argument. */
 #define SYSCALL_GET_ARGS3(ESP, DST0, DST1, DST2) \
-        SYSCALL_GET_ARGS2(ESP, DST0, DST1); \
-        SYSCALL_GET_ARG(ESP, 2, DST2);
-
-/* It is not safe to call into the file system code
-   provided in the `filesys' directory from multiple threads
-   at once.
-   The file system code is treated as a critical section. */
-struct lock fs_lock;
+        { \
+          sys_param_type argv_[3]; \
+          SYSCALL_GET_ARGV (ESP, argv_, 3); \
+          *(DST0) = argv_[0]; \
+          *(DST1) = argv_[1]; \
+          *(DST2) = argv_[2]; \
+        }
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 
-  lock_init (&fs_lock);
-
   /* Projects 2 and later. */
   sys_wrap_funcs[SYS_HALT]     = sys_halt_wrapper;
   sys_wrap_funcs[SYS_EXIT]     = sys_exit_wrapper;
@@ -158,7 +317,52 @@ syscall_init (void)
   /* Project 3 and optionally project 4. */
   sys_wrap_funcs[SYS_MMAP]     = sys_mmap_wrapper;
   sys_wrap_funcs[SYS_MUNMAP]   = sys_munmap_wrapper;
+
+  /* Extensions. */
+  sys_wrap_funcs[SYS_VMSTAT]   = sys_vmstat_wrapper;
+  sys_wrap_funcs[SYS_SHM_MAP]  = sys_shm_map_wrapper;
+  sys_wrap_funcs[SYS_SHM_UNLINK] = sys_shm_unlink_wrapper;
+  sys_wrap_funcs[SYS_MSYNC]    = sys_msync_wrapper;
+  sys_wrap_funcs[SYS_MMAP_RANGE] = sys_mmap_range_wrapper;
+  sys_wrap_funcs[SYS_MADVISE]  = sys_madvise_wrapper;
+  sys_wrap_funcs[SYS_THREAD_CREATE] = sys_thread_create_wrapper;
+  sys_wrap_funcs[SYS_FUTEX]    = sys_futex_wrapper;
+  sys_wrap_funcs[SYS_SBRK]     = sys_sbrk_wrapper;
+  sys_wrap_funcs[SYS_MEMPRESSURE] = sys_mempressure_wrapper;
+  sys_wrap_funcs[SYS_UFFD_REGISTER] = sys_uffd_register_wrapper;
+  sys_wrap_funcs[SYS_UFFD_COPY] = sys_uffd_copy_wrapper;
+
+  sys_locked[SYS_MMAP] = sys_locked[SYS_MUNMAP] = true;
+  sys_locked[SYS_SHM_MAP] = sys_locked[SYS_MSYNC] = true;
+  sys_locked[SYS_MMAP_RANGE] = sys_locked[SYS_MADVISE] = true;
+  sys_locked[SYS_SBRK] = sys_locked[SYS_UFFD_REGISTER] = true;
 #endif
+
+  /* Extensions. */
+  sys_wrap_funcs[SYS_READV]    = sys_readv_wrapper;
+  sys_wrap_funcs[SYS_WRITEV]   = sys_writev_wrapper;
+  sys_wrap_funcs[SYS_RING_SETUP] = sys_ring_setup_wrapper;
+  sys_wrap_funcs[SYS_RING_ENTER] = sys_ring_enter_wrapper;
+  sys_wrap_funcs[SYS_FORK]     = sys_fork_wrapper;
+  sys_wrap_funcs[SYS_CLOCK_NS] = sys_clock_ns_wrapper;
+  sys_wrap_funcs[SYS_LOCKSTAT] = sys_lockstat_wrapper;
+  sys_wrap_funcs[SYS_MEMSTAT]  = sys_memstat_wrapper;
+  sys_wrap_funcs[SYS_IOSTAT]   = sys_iostat_wrapper;
+  sys_wrap_funcs[SYS_READ_INPUT] = sys_read_input_wrapper;
+  sys_wrap_funcs[SYS_PIPE]     = sys_pipe_wrapper;
+  sys_wrap_funcs[SYS_SPAWN]    = sys_spawn_wrapper;
+  sys_wrap_funcs[SYS_SPAWN_MANY] = sys_spawn_many_wrapper;
+  sys_wrap_funcs[SYS_SCHED_GROUP] = sys_sched_group_wrapper;
+  sys_wrap_funcs[SYS_IO_GROUP] = sys_io_group_wrapper;
+  sys_wrap_funcs[SYS_GETRUSAGE] = sys_getrusage_wrapper;
+  sys_wrap_funcs[SYS_SYSCALLSTAT] = sys_syscallstat_wrapper;
+  sys_wrap_funcs[SYS_FALLOCATE] = sys_fallocate_wrapper;
+  sys_wrap_funcs[SYS_COPY_FILE_RANGE] = sys_copy_file_range_wrapper;
+  sys_wrap_funcs[SYS_FSYNC] = sys_fsync_wrapper;
+  sys_wrap_funcs[SYS_SYNC] = sys_sync_wrapper;
+  sys_wrap_funcs[SYS_GETDENTS] = sys_getdents_wrapper;
+  sys_wrap_funcs[SYS_POLL] = sys_poll_wrapper;
+  sys_wrap_funcs[SYS_RING_WAIT] = sys_ring_wait_wrapper;
 }
 
 static void
@@ -178,15 +382,98 @@ syscall_handler (struct intr_frame *f)
      ESP out of the struct intr_frame passed to page_fault()
      would yield an undefined value. */
   thread_current ()->saved_esp = f->esp;
+
+  /* Killed for lack of swap space.  See frame_alloc().  The
+     other threads of an exiting process exit with it. */
+  if (process_current ()->oom_killed || process_must_exit ())
+    sys_exit (-1);
 #endif
 
   /* Invokes system call wrapper function. */
-  if (no < 0 || no >= SYSCALL_CNT)
+  if (no < 0 || no >= SYSCALL_CNT || sys_wrap_funcs[no] == NULL)
     PANIC ("Unknown system call");
   else
     {
       sys_wrapper_func *wrap_func = sys_wrap_funcs[no];
+      long long nvcsw = thread_current ()->rusage.nvcsw;
+      uint64_t start = clock_cycles ();
+      int64_t start_ns = systrace_enabled ? clock_ns () : 0;
+      uint64_t lock_cycles;
+      bool locked;
+
+      /* These do not return. */
+      if (systrace_enabled && (no == SYS_EXIT || no == SYS_HALT))
+        record_syscall (no, f, start_ns, false);
+
+      syscall_stats[no].calls++;
+      locked = sys_locked[no] && process_lock ();
+      lock_cycles = clock_cycles () - start;
+      TRACE (TRACE_SYSCALL, TRACE_SYSCALL_ENTER, no, thread_tid ());
       wrap_func (f);
+      TRACE (TRACE_SYSCALL, TRACE_SYSCALL_EXIT, no, f->eax);
+      process_unlock (locked);
+      count_syscall (no, f, start, lock_cycles,
+                     thread_current ()->rusage.nvcsw != nvcsw);
+      if (systrace_enabled)
+        record_syscall (no, f, start_ns, true);
+    }
+}
+
+/* Counts system call NO, which returned to F after running from
+   START, waiting LOCK_CYCLES for process_lock(), and which
+   BLOCKED or not. */
+static void
+count_syscall (int no, const struct intr_frame *f, uint64_t start,
+               uint64_t lock_cycles, bool blocked)
+{
+  struct syscall_stats *s = &syscall_stats[no];
+  uint64_t cycles = clock_cycles () - start;
+  size_t bucket = 0;
+
+  s->cycles += cycles;
+  s->lock_cycles += lock_cycles;
+  if (blocked)
+    s->blocked++;
+  if ((no == SYS_READ || no == SYS_WRITE || no == SYS_READV
+       || no == SYS_WRITEV) && (int) f->eax > 0)
+    s->bytes += (int) f->eax;
+
+  for (cycles >>= 11; cycles > 0 && bucket < SYSCALL_LATENCY_BUCKETS - 1;
+       cycles >>= 1)
+    bucket++;
+  s->latency[blocked][bucket]++;
+}
+
+/* Prints statistics for each system call that has been made. */
+void
+syscall_print_stats (void)
+{
+  int no;
+
+  for (no = 0; no < SYSCALL_CNT; no++)
+    {
+      const struct syscall_stats *s = &syscall_stats[no];
+      int blocked;
+      size_t i;
+
+      if (s->calls == 0)
+        continue;
+      printf ("Syscall %s: %lld calls, %lld blocked, %lld cycles, "
+              "%lld cycles locked", syscall_names[no], s->calls,
+              s->blocked, s->cycles, s->lock_cycles);
+      if (s->bytes > 0)
+        printf (", %lld bytes", s->bytes);
+      printf ("\n");
+      for (blocked = 0; blocked < 2; blocked++)
+        if (blocked ? s->blocked > 0 : s->blocked < s->calls)
+          {
+            printf ("  %s latency (log2 cycles):",
+                    blocked ? "blocked" : "unblocked");
+            for (i = 0; i < SYSCALL_LATENCY_BUCKETS; i++)
+              if (s->latency[blocked][i] > 0)
+                printf (" %zu:%u", i + 10, s->latency[blocked][i]);
+            printf ("\n");
+          }
     }
 }
 
@@ -214,6 +501,64 @@ put_user (uint8_t *udst, uint8_t byte)
   return error_code != SYS_BAD_ADDR;
 }
 
+/* Returns the number of bytes from UADDR to the end of its page,
+   but no more than SIZE. */
+static size_t
+page_chunk (const void *uaddr, size_t size)
+{
+  size_t chunk = PGSIZE - pg_ofs (uaddr);
+  return chunk < size ? chunk : size;
+}
+
+#ifdef VM
+/* Pins the page containing UADDR as page_pin() does, with the
+   address space locked against the other threads of the process
+   meanwhile. */
+static void *
+pin_user (const void *uaddr, bool write)
+{
+  bool locked = process_lock ();
+  void *kaddr = page_pin (uaddr, write);
+
+  process_unlock (locked);
+  return kaddr;
+}
+
+/* Unpins the page that pin_user() pinned and returned KADDR in.
+   The address space is not locked meanwhile: a peer unmapping
+   the page holds that lock while it waits for the frame. */
+static void
+unpin_user (const void *kaddr)
+{
+  page_unpin (kaddr);
+}
+#endif
+
+/* Copies SIZE bytes from SRC to DST, a 32-bit word at a time once
+   SRC is word-aligned.  Both must lie within validated memory. */
+static void
+copy_words (uint8_t *dst, const uint8_t *src, size_t size)
+{
+  for (; size > 0 && ((uintptr_t) src & 3) != 0; size--)
+    *dst++ = *src++;
+  for (; size >= 4; size -= 4, dst += 4, src += 4)
+    *(uint32_t *) dst = *(const uint32_t *) src;
+  for (; size > 0; size--)
+    *dst++ = *src++;
+}
+
+/* True if any byte of 32-bit word W is zero. */
+#define HAS_ZERO_BYTE(W) ((((W) - 0x01010101) & ~(W) & 0x80808080) != 0)
+
+/* The helpers below validate user memory a page at a time: if the
+   first byte of a page is below PHYS_BASE, so is the whole page,
+   and once get_user() or put_user() has accessed that byte without
+   a fault, the process is known to have the page mapped with the
+   right permissions.  The rest of the page is then copied with
+   plain loads and stores.  Should the page be evicted in the
+   meantime, the resulting not-present fault is resolved by
+   page_fault() like any other. */
+
 /* Reads SIZE bytes from user virtual address USRC to UDST.
    If USRC points to kernel memory or causes page fault,
    returns -1, otherwise returns the number of bytes read. */
@@ -228,17 +573,18 @@ copy_from_user (void *kdst_, const void *usrc_, size_t size)
   ASSERT (kdst != NULL || size == 0);
   ASSERT (usrc != NULL || size == 0);
 
-  for (; size > 0; size--, res++)
+  while (size > 0)
     {
-      /* Assumes that the user address has already been verified
-         to be below PHYS_BASE. */
-      if (!is_user_vaddr (usrc + res))
-        bad_user_access ();
-      /* A memory access causes page fault. */
-      if ((byte = get_user (usrc + res)) == SYS_BAD_ADDR)
+      size_t chunk = page_chunk (usrc + res, size);
+
+      if (!is_user_vaddr (usrc + res)
+          || (byte = get_user (usrc + res)) == SYS_BAD_ADDR)
         bad_user_access ();
-      
       kdst[res] = (uint8_t) byte;
+      copy_words (kdst + res + 1, usrc + res + 1, chunk - 1);
+
+      res += chunk;
+      size -= chunk;
     }
   return res;
 }
@@ -256,19 +602,79 @@ copy_to_user (void *udst_, const void *ksrc_, size_t size)
   ASSERT (udst != NULL || size == 0);
   ASSERT (ksrc != NULL || size == 0);
 
-  for (; size > 0; size--, res++)
+  while (size > 0)
     {
-      /* Assumes that the user address has already been verified
-         to be below PHYS_BASE. */
-      if (!is_user_vaddr (udst + res))
-        bad_user_access ();
-      /* A memory access causes page fault. */
-      if (!put_user (udst + res, ksrc[res]))
+      size_t chunk = page_chunk (udst + res, size);
+
+      if (!is_user_vaddr (udst + res)
+          || !put_user (udst + res, ksrc[res]))
         bad_user_access ();
+      copy_words (udst + res + 1, ksrc + res + 1, chunk - 1);
+
+      res += chunk;
+      size -= chunk;
     }
   return res;
 }
 
+/* Copies up to SIZE bytes from user address USRC to KDST, as
+   copy_from_user() does, but stops at the first byte that cannot
+   be read rather than killing the process, and returns the number
+   of bytes copied.  If STRING is true, also stops after a null
+   byte. */
+static size_t
+peek_user (void *kdst_, const void *usrc_, size_t size, bool string)
+{
+  uint8_t *kdst = kdst_;
+  const uint8_t *usrc = usrc_;
+  size_t i;
+  int byte;
+
+  for (i = 0; i < size; i++)
+    {
+      if (!is_user_vaddr (usrc + i)
+          || (byte = get_user (usrc + i)) == SYS_BAD_ADDR)
+        break;
+      kdst[i] = byte;
+      if (string && byte == '\0')
+        return i + 1;
+    }
+  return i;
+}
+
+/* Records system call NO, made from F at START_NS, in the system
+   call log, if it is not full.  If RETURNS is false, NO is being
+   made and will not return, otherwise it has just returned.
+   Arguments that cannot be read are recorded as 0, so that a
+   bad pointer kills the process where it would without
+   recording.  See systrace.c. */
+static void
+record_syscall (int no, const struct intr_frame *f, int64_t start_ns,
+                bool returns)
+{
+  struct systrace_record *r = systrace_claim ();
+
+  if (r == NULL)
+    return;
+  r->ns = start_ns;
+  r->pid = process_current ()->tid;
+  r->tid = thread_tid ();
+  r->no = no;
+  memset (r->args, 0, sizeof r->args);
+  peek_user (r->args, SYSCALL_ARG_ADDR (f->esp, 0), sizeof r->args, false);
+  if (returns)
+    r->ret = f->eax;
+  else
+    r->ret = no == SYS_EXIT ? (int32_t) r->args[0] : 0;
+
+  memset (r->path, 0, sizeof r->path);
+  if (no == SYS_EXEC || no == SYS_CREATE || no == SYS_REMOVE
+      || no == SYS_OPEN || no == SYS_CHDIR || no == SYS_MKDIR
+      || no == SYS_SPAWN)
+    peek_user (r->path, (const void *) r->args[0], sizeof r->path - 1,
+               true);
+}
+
 /* Copies a string from USRC to UDST.  If USRC is longer than
    SIZE - 1 characters, only SIZE - 1 characters are copied.
    A null terminator is always written to DST, unless SIZE is 0.
@@ -280,8 +686,7 @@ static long
 strncpy_from_user (char *kdst, const char *usrc_, size_t size)
 {
   const uint8_t *usrc = (uint8_t *) usrc_;
-	long res = 0;
-  int byte;
+  size_t res = 0;
 
   ASSERT (kdst != NULL);
   ASSERT (usrc != NULL);
@@ -289,23 +694,33 @@ strncpy_from_user (char *kdst, const char *usrc_, size_t size)
   if (!size)
     return 0;
 
-  for (; size > 0; size--, res++)
+  while (res < size)
     {
-      /* Assumes that the user address has already been verified
-         to be below PHYS_BASE. */
-      if (!is_user_vaddr (usrc + res))
-        bad_user_access ();
-      /* A memory access causes page fault. */
-      if ((byte = get_user (usrc + res)) == SYS_BAD_ADDR)
+      size_t end = res + page_chunk (usrc + res, size - res);
+
+      if (!is_user_vaddr (usrc + res)
+          || get_user (usrc + res) == SYS_BAD_ADDR)
         bad_user_access ();
-      
-		  kdst[res] = (char) byte;
-		  if (!byte)
-		  	return res;
+
+      /* Bytes up to a word boundary, then whole words up to the
+         first one holding a null byte, then the rest. */
+      for (; res < end && ((uintptr_t) (usrc + res) & 3) != 0; res++)
+        if ((kdst[res] = usrc[res]) == '\0')
+          return res;
+      for (; end - res >= 4; res += 4)
+        {
+          uint32_t word = *(const uint32_t *) (usrc + res);
+          if (HAS_ZERO_BYTE (word))
+            break;
+          *(uint32_t *) (kdst + res) = word;
+        }
+      for (; res < end; res++)
+        if ((kdst[res] = usrc[res]) == '\0')
+          return res;
     }
 
-  kdst[--res] = '\0';
-  return res;
+  kdst[size - 1] = '\0';
+  return size - 1;
 }
 
 /* Core system call services.  Each of them provides kernel
@@ -333,7 +748,8 @@ void
 sys_exit (int status)
 {
   struct thread *cur = thread_current ();
-  printf ("%s: exit(%d)\n", cur->name, status);
+  if (process_current () == cur)
+    printf ("%s: exit(%d)\n", cur->name, status);
   cur->process->exit_status = status;
   thread_exit ();
 }
@@ -357,6 +773,162 @@ sys_exec (const char *cmdline)
   return process_execute (kstr);
 }
 
+/* Runs the executable whose name is given in CMDLINE, like
+   `exec', but returns as soon as the child process exists,
+   without waiting for it to load its executable.  If the load
+   fails, the child exits with status -1, so `wait' on it
+   returns -1.  Returns pid -1 only if the child process cannot
+   be created at all. */
+pid_t
+sys_spawn (const char *cmdline)
+{
+  char kstr[256];
+
+  if (cmdline == NULL)
+    bad_user_access ();
+
+  strncpy_from_user (kstr, cmdline, 256);
+  return process_spawn (kstr);
+}
+
+/* Starts CNT processes, as `spawn' does, from the command lines
+   in array CMDLINES, storing the pid of each in the same
+   position of array PIDS.  Stops at the first process that
+   cannot be created.  Returns the number of processes started,
+   which are the first ones in CMDLINES. */
+int
+sys_spawn_many (const char **cmdlines, int cnt, pid_t *pids)
+{
+  char kstr[256];
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const char *cmdline;
+      pid_t pid;
+
+      copy_from_user (&cmdline, cmdlines + i, sizeof cmdline);
+      if (cmdline == NULL)
+        bad_user_access ();
+      strncpy_from_user (kstr, cmdline, 256);
+
+      pid = process_spawn (kstr);
+      if (pid == TID_ERROR)
+        break;
+      copy_to_user (pids + i, &pid, sizeof pid);
+    }
+  return i;
+}
+
+/* Moves the calling thread into a new scheduling group with
+   TICKETS tickets, which the processes it runs afterward
+   inherit.  Under the stride scheduler, the groups share the
+   CPU in proportion to their tickets.  Returns the group's
+   number, or -1 if TICKETS is out of range or there are too
+   many groups. */
+int
+sys_sched_group (int tickets)
+{
+  return thread_new_sched_group (tickets);
+}
+
+/* Moves the calling thread into a new I/O group, which the
+   processes it runs afterward inherit, whose block requests
+   together are limited to IOPS per second and KBPS kilobytes
+   per second, with 0 for no limit.  Returns the group's number,
+   or -1 if a limit is negative or there are too many groups. */
+int
+sys_io_group (int iops, int kbps)
+{
+  return block_io_group_new (iops, kbps);
+}
+
+/* Copies to USAGE the resources used by the calling thread if
+   WHO is RUSAGE_SELF, or by the children it has waited for, and
+   theirs, if WHO is RUSAGE_CHILDREN.  Returns false if WHO is
+   neither. */
+bool
+sys_getrusage (int who, struct rusage *usage)
+{
+  struct thread *cur = thread_current ();
+  struct rusage r;
+
+  if (who == RUSAGE_SELF)
+    thread_get_rusage (cur, &r);
+  else if (who == RUSAGE_CHILDREN)
+    r = cur->child_rusage;
+  else
+    return false;
+
+  copy_to_user (usage, &r, sizeof r);
+  return true;
+}
+
+/* Creates a new process, the child, which is a copy of the
+   current process, the parent, and which resumes running from
+   this system call as well.  Returns the child's pid to the
+   parent and 0 to the child, or -1 to the parent if the child
+   cannot be created.  F is the parent's user context.
+
+   The parent's memory is shared with the child copy-on-write,
+   except for its mmap mappings, which are not inherited.  The
+   child gets its own copy of each file descriptor, at the same
+   position, which it closes independently. */
+pid_t
+sys_fork (struct intr_frame *f)
+{
+  return process_fork (f);
+}
+
+/* Stores the time since the OS booted, in nanoseconds, in *NS.
+   See clock_ns() in devices/timer.c.  Returns false if NS is a
+   null pointer. */
+bool
+sys_clock_ns (int64_t *ns)
+{
+  int64_t now = clock_ns ();
+
+  if (ns == NULL)
+    return false;
+  copy_to_user (ns, &now, sizeof now);
+  return true;
+}
+
+/* Prints lock statistics to the console, including the lock
+   profile if the kernel was built with LOCK_PROFILE. */
+void
+sys_lockstat (void)
+{
+  lock_print_stats ();
+}
+
+/* Prints memory allocator statistics to the console, including
+   memory use by caller if the kernel was built with MEM_TRACE. */
+void
+sys_memstat (void)
+{
+  palloc_print_stats ();
+  malloc_print_stats ();
+}
+
+/* Prints system call statistics to the console: for each
+   system call, how often it was made and blocked, its latency
+   and, for reads and writes, the bytes transferred. */
+void
+sys_syscallstat (void)
+{
+  syscall_print_stats ();
+}
+
+/* Prints block device statistics to the console: request
+   counts, sizes, latencies and queue depths, and how much I/O was
+   for swap, file data and file system metadata. */
+void
+sys_iostat (void)
+{
+  block_print_stats ();
+}
+
 /* Waits for a child process PID and retrieves the child's
    exit status.
    If PID is still alive, waits until it terminates.  Then,
@@ -385,9 +957,7 @@ sys_create (const char *file, unsigned initial_size)
 
   strncpy_from_user (kstr, file, 256);
 
-  lock_acquire (&fs_lock);
   res = filesys_create (kstr, initial_size);
-  lock_release (&fs_lock);
 
   return res;
 }
@@ -408,38 +978,69 @@ sys_remove (const char *file)
 
   strncpy_from_user (kstr, file, 256);
 
-  lock_acquire (&fs_lock);
   res = filesys_remove (kstr);
-  lock_release (&fs_lock);
 
   return res;
 }
 
-/* A file descriptor. */
+/* A file descriptor, open on either a file or one end of a
+   pipe.  It is freed once it is closed and the last system call
+   using it, in any thread of the process, is done with it. */
 struct file_desc
   {
-    struct list_elem fd_list_elem;   /* List element. */
-    struct file *file;               /* File. */
+    struct file *file;               /* File, or null for a pipe. */
+    struct pipe *pipe;               /* Pipe, if FILE is null. */
+    bool writer;                     /* Write end of PIPE? */
     int no;                          /* File descriptor number. */
+    int ref_cnt;                     /* The fd table's reference, if
+                                        still open, plus lookup_fd()'s.
+                                        Protected by the process
+                                        lock. */
   };
 
-/* Finds a file descriptor with the given FD_NO.
-   If not found, returns NULL. */
+/* Closes FD's file or pipe end. */
+static void
+release_fd (struct file_desc *fd)
+{
+  if (fd->pipe != NULL)
+    pipe_close (fd->pipe, fd->writer);
+  else
+    file_close (fd->file);
+}
+
+/* Finds a file descriptor with the given FD_NO and returns it
+   with a reference held, which the caller must drop with
+   put_fd(), so that another thread of the process closing it
+   meanwhile does not free it.  If not found, returns NULL. */
 static struct file_desc *
 lookup_fd (int fd_no)
 {
-  struct thread *cur = thread_current ();
-  struct list *fd_list = &cur->fd_list;
-  struct list_elem *e;
-  for (e = list_begin (fd_list); e != list_end (fd_list);
-       e = list_next (e))
+  bool locked = process_lock ();
+  struct file_desc *fd = idtable_lookup (&process_current ()->fds, fd_no);
+
+  if (fd != NULL)
+    fd->ref_cnt++;
+  process_unlock (locked);
+  return fd;
+}
+
+/* Drops a reference to FD, if it is not a null pointer, and
+   closes and frees FD if that was the last one. */
+static void
+put_fd (struct file_desc *fd)
+{
+  bool locked, last;
+
+  if (fd == NULL)
+    return;
+  locked = process_lock ();
+  last = --fd->ref_cnt == 0;
+  process_unlock (locked);
+  if (last)
     {
-      struct file_desc *fd
-        = list_entry (e, struct file_desc, fd_list_elem);
-      if (fd->no == fd_no)
-        return fd;
+      release_fd (fd);
+      free (fd);
     }
-  return NULL;
 }
 
 /* Opens the file given the path FILE.  It returns a file descriptor
@@ -449,7 +1050,7 @@ lookup_fd (int fd_no)
 
    Each process has an independent set of file descriptors which is not
    limited on the number, and these file descriptors are not inherited
-   by child processes.
+   by child processes.  The lowest number not in use is returned.
 
    It is possible for a single process or different processes to open
    the same file more than once, and each `open' system call returns a
@@ -459,10 +1060,10 @@ lookup_fd (int fd_no)
 int
 sys_open (const char *file)
 {
-  struct thread *cur = thread_current ();
   struct file *f;
   struct file_desc *fd;
   char kstr[256];
+  bool locked;
 
   if (file == NULL)
     return -1;
@@ -472,18 +1073,24 @@ sys_open (const char *file)
   if ((fd = malloc (sizeof (struct file_desc))) == NULL)
     return -1;
 
-  lock_acquire (&fs_lock);
   if ((f = filesys_open (kstr)) == NULL)
     {
-      lock_release (&fs_lock);
       free (fd);
       return -1;
     }
-  lock_release (&fs_lock);
 
   fd->file = f;
-  fd->no = cur->next_fd_no++;
-  list_push_back (&cur->fd_list, &fd->fd_list_elem);
+  fd->pipe = NULL;
+  fd->ref_cnt = 1;
+  locked = process_lock ();
+  fd->no = idtable_insert (&process_current ()->fds, fd);
+  process_unlock (locked);
+  if (fd->no < 0)
+    {
+      file_close (f);
+      free (fd);
+      return -1;
+    }
 
   return fd->no;
 }
@@ -495,15 +1102,209 @@ sys_filesize (int fd_no)
   struct file_desc *fd;
   int res;
 
-  if ((fd = lookup_fd (fd_no)) == NULL)
-    return -1;
+  if ((fd = lookup_fd (fd_no)) == NULL || fd->pipe != NULL)
+    {
+      put_fd (fd);
+      return -1;
+    }
   
-  lock_acquire (&fs_lock);
   res = file_length (fd->file);
-  lock_release (&fs_lock);
+  put_fd (fd);
+
+  return res;
+}
+
+#ifdef VM
+/* Transfers CHUNK bytes between user address UADDR and FILE at
+   its current position, as transfer_user() does, through the
+   frame of a shared file mapping that holds that page of FILE.
+   The bytes must lie within one page of UADDR and one page of
+   FILE.  *BOUNCE is a kernel page to copy through, allocated on
+   first use.  Returns the number of bytes transferred, or -1 if
+   no such frame is resident and the caller should use FILE.
+
+   User memory is never touched with the frame locked: a fault on
+   it could need that very frame, or another frame whose holder
+   is waiting for this one. */
+static int
+transfer_frame (struct file *file, void *uaddr, unsigned chunk,
+                bool to_file, void **bounce)
+{
+  struct inode *inode = file_get_inode (file);
+  off_t pos = file_tell (file);
+  off_t ofs = pos % PGSIZE;
+  struct frame *f;
+  int bytes;
+
+  if (*bounce == NULL && (*bounce = palloc_get_page (0)) == NULL)
+    return -1;
+  f = frame_lock_file (inode, pos - ofs);
+  if (f == NULL)
+    return -1;
+
+  if (!to_file)
+    {
+      off_t left = file_length (file) - pos;
+
+      if (left < (off_t) chunk)
+        chunk = left > 0 ? left : 0;
+      if (ofs + (off_t) chunk > (off_t) f->page->read_bytes)
+        {
+          /* The file grew past what the mapping holds. */
+          frame_lock_release (f);
+          return -1;
+        }
+      memcpy (*bounce, f->kpage + ofs, chunk);
+      frame_lock_release (f);
+      copy_to_user (uaddr, *bounce, chunk);
+      file_seek (file, pos + chunk);
+      return chunk;
+    }
+
+  frame_lock_release (f);
+  copy_from_user (*bounce, uaddr, chunk);
+  f = frame_lock_file (inode, pos - ofs);
+  bytes = file_write (file, *bounce, chunk);
+  if (f != NULL)
+    {
+      if (bytes > 0)
+        memcpy (f->kpage + ofs, *bounce, bytes);
+      frame_lock_release (f);
+    }
+  return bytes;
+}
+
+/* Brings the frame of a shared file mapping that holds the page
+   of FILE at POS, if one is resident, up to date with the BYTES
+   just written there, which all lie within that page. */
+static void
+transfer_frame_update (struct file *file, off_t pos, int bytes)
+{
+  off_t ofs = pos % PGSIZE;
+  struct frame *f = frame_lock_file (file_get_inode (file), pos - ofs);
+
+  if (f != NULL)
+    {
+      file_read_at (file, f->kpage + ofs, bytes, pos);
+      frame_lock_release (f);
+    }
+}
+
+/* Reads SIZE bytes from FILE into user buffer UBUF, or, if
+   TO_FILE, writes SIZE bytes from UBUF to FILE.  Returns the
+   number of bytes transferred.
+
+   Rather than bouncing the data through a kernel buffer, each
+   page of UBUF is pinned in turn and the file system copies
+   straight between its buffer cache and the user frame.  An
+   invalid page in UBUF terminates the process.
+
+   A page of FILE that some process has mapped shared, though, is
+   held in its frame, which may be newer than the file until it
+   is written back.  Such a page is read from that frame, and
+   written through to both the file and the frame, so that read()
+   and write() agree with every mapping.  See transfer_frame(). */
+static int
+transfer_user (struct file *file, void *ubuf, unsigned size, bool to_file)
+{
+  void *bounce = NULL;
+  int res = 0;
+
+  while (size > 0)
+    {
+      void *uaddr = ubuf + res;
+      off_t pos = file_tell (file);
+      unsigned chunk = PGSIZE - pg_ofs (uaddr);
+      void *kaddr;
+      int bytes;
+
+      if (chunk > size)
+        chunk = size;
+      if (chunk > (unsigned) (PGSIZE - pos % PGSIZE))
+        chunk = PGSIZE - pos % PGSIZE;
+
+      bytes = transfer_frame (file, uaddr, chunk, to_file, &bounce);
+      if (bytes < 0)
+        {
+          /* Reading from the file writes to the user page. */
+          kaddr = pin_user (uaddr, !to_file);
+          if (kaddr == NULL)
+            bad_user_access ();
+          bytes = (to_file
+                   ? file_write (file, kaddr, chunk)
+                   : file_read (file, kaddr, chunk));
+          unpin_user (kaddr);
+          if (to_file && bytes > 0)
+            transfer_frame_update (file, pos, bytes);
+        }
 
+      res += bytes;
+      size -= bytes;
+      if ((unsigned) bytes < chunk)
+        break;
+    }
+  if (bounce != NULL)
+    palloc_free_page (bounce);
   return res;
 }
+#endif
+
+/* Reads up to SIZE bytes from the read end of PIPE into user
+   buffer UBUF, or, if WRITER, writes SIZE bytes from UBUF to the
+   write end.  A read first waits for data, if there is none, and
+   returns whatever it finds, or 0 once the write end is closed
+   and the data drained; a write waits for room until all of UBUF
+   is written.  Returns the number of bytes transferred, or -1 if
+   no byte could be written because the read end is closed.
+
+   With VM, each page of UBUF is pinned in turn and copied
+   straight between its frame and the pipe's buffer, as
+   transfer_user() does for files.  The frame is never left
+   locked while waiting on the pipe, since the other end may be
+   this same process, or another that needs the frame. */
+static int
+transfer_pipe (struct pipe *pipe, void *ubuf, unsigned size, bool writer)
+{
+  int res = 0;
+
+  while (size > 0)
+    {
+      void *uaddr = ubuf + res;
+      size_t chunk = page_chunk (uaddr, size);
+      size_t bytes;
+#ifdef VM
+      void *kaddr = pin_user (uaddr, !writer);
+
+      if (kaddr == NULL)
+        bad_user_access ();
+      bytes = (writer
+               ? pipe_write (pipe, kaddr, chunk)
+               : pipe_read (pipe, kaddr, chunk));
+      unpin_user (kaddr);
+#else
+      uint8_t kbuf[256];
+
+      if (chunk > sizeof kbuf)
+        chunk = sizeof kbuf;
+      if (writer)
+        {
+          copy_from_user (kbuf, uaddr, chunk);
+          bytes = pipe_write (pipe, kbuf, chunk);
+        }
+      else
+        {
+          bytes = pipe_read (pipe, kbuf, chunk);
+          copy_to_user (uaddr, kbuf, bytes);
+        }
+#endif
+
+      res += bytes;
+      size -= bytes;
+      if (bytes == 0 && ((!writer && res > 0) || !pipe_wait (pipe, writer)))
+        break;
+    }
+  return writer && res == 0 && size > 0 ? -1 : res;
+}
 
 /* Reads the data from opened file.  It returns the number of bytes
    actually read if FD_NO exists, or -­1 otherwise.  The UBUF is a
@@ -513,7 +1314,7 @@ sys_filesize (int fd_no)
 int
 sys_read (int fd_no, void *ubuf, unsigned size)
 {
-  struct file_desc *fd;
+  struct file_desc *fd = NULL;
   int res = 0;
 
   if (ubuf == NULL)
@@ -522,8 +1323,18 @@ sys_read (int fd_no, void *ubuf, unsigned size)
       && (fd = lookup_fd (fd_no)) == NULL)
     return -1;
   
-  if (fd_no != STDIN_FILENO)
+  if (fd_no != STDIN_FILENO && fd->pipe != NULL)
+    {
+      if (fd->writer)
+        res = -1;
+      else
+        res = transfer_pipe (fd->pipe, ubuf, size, false);
+    }
+  else if (fd_no != STDIN_FILENO)
     {
+#ifdef VM
+      res = transfer_user (fd->file, ubuf, size, false);
+#else
       char kbuf[256];
       int read_amount, bytes_read;
       
@@ -533,9 +1344,7 @@ sys_read (int fd_no, void *ubuf, unsigned size)
           /* Read is possible up to 256 bytes at once. */
           read_amount = (size > 256) ? 256 : size;
 
-          lock_acquire (&fs_lock);
           bytes_read = file_read (fd->file, kbuf, read_amount);
-          lock_release (&fs_lock); 
 
           /* Data read is saved in KBUF. */
           copy_to_user (ubuf + res, kbuf, bytes_read);
@@ -548,23 +1357,50 @@ sys_read (int fd_no, void *ubuf, unsigned size)
           res += bytes_read;
           size -= bytes_read;
         }
+#endif
     }
   else
     {
-      for (; size > 0; size--, res++)
+      /* Waits for each chunk of input, but takes everything
+         already buffered at once. */
+      while (size > 0)
         {
-          /* Assumes that the user address has already been verified
-             to be below PHYS_BASE. */
-          if (!is_user_vaddr (ubuf + res))
-            bad_user_access ();
-          /* A memory access causes page fault. */
-          if (!put_user (ubuf + res, input_getc ()))
-            bad_user_access ();
+          int cnt = sys_read_input ((uint8_t *) ubuf + res, size, -1);
+
+          res += cnt;
+          size -= cnt;
         }
     }
+  put_fd (fd);
   return res;
 }
 
+/* Reads up to SIZE bytes of console input into UBUF and returns
+   the number of bytes read.  If no input is buffered, first
+   waits up to TIMEOUT milliseconds for some, or as long as it
+   takes if TIMEOUT is negative, and returns 0 if none arrives: a
+   TIMEOUT of 0 only takes what is buffered, without waiting.
+   Unlike sys_read(), does not wait for all SIZE bytes. */
+int
+sys_read_input (void *ubuf, unsigned size, int timeout)
+{
+  uint8_t kbuf[256];
+  int64_t ticks;
+  size_t cnt;
+
+  if (ubuf == NULL)
+    return -1;
+
+  if (timeout < 0)
+    ticks = -1;
+  else
+    ticks = DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ, 1000);
+
+  cnt = input_read (kbuf, size < sizeof kbuf ? size : sizeof kbuf, ticks);
+  copy_to_user (ubuf, kbuf, cnt);
+  return cnt;
+}
+
 /* Writes the data from UBUF to the open file FD_NO.  It returns
    the the number of bytes actually recoreded into the file if
    succeeds, or -­1 otherwise.  The SIZE is the number of bytes to be
@@ -573,7 +1409,7 @@ sys_read (int fd_no, void *ubuf, unsigned size)
 int
 sys_write (int fd_no, const void *ubuf, unsigned size)
 {
-  struct file_desc *fd;
+  struct file_desc *fd = NULL;
   int res = 0;
 
   if (ubuf == NULL)
@@ -582,9 +1418,19 @@ sys_write (int fd_no, const void *ubuf, unsigned size)
       && (fd = lookup_fd (fd_no)) == NULL)
     return -1;
   
-  if (fd_no != STDOUT_FILENO)
+  if (fd_no != STDOUT_FILENO && fd->pipe != NULL)
     {
-      char kbuf[256];
+      if (!fd->writer)
+        res = -1;
+      else
+        res = transfer_pipe (fd->pipe, (void *) ubuf, size, true);
+    }
+  else if (fd_no != STDOUT_FILENO)
+    {
+#ifdef VM
+      res = transfer_user (fd->file, (void *) ubuf, size, true);
+#else
+      char kbuf[256];
       int write_amount, bytes_written;
       
       /* Breaks up the BUFFER and writes up to 256-bytes at once. */
@@ -596,9 +1442,7 @@ sys_write (int fd_no, const void *ubuf, unsigned size)
           /* Temporarily copies write data into kernel space. */
           copy_from_user (kbuf, ubuf + res, write_amount);
 
-          lock_acquire (&fs_lock);
           bytes_written = file_write (fd->file, kbuf, write_amount);
-          lock_release (&fs_lock);
 
           /* If 0 bytes written, terminates the loop. */
           if (bytes_written == 0)
@@ -608,27 +1452,99 @@ sys_write (int fd_no, const void *ubuf, unsigned size)
           res += bytes_written;
           size -= bytes_written;
         }
+#endif
     }
   else
     {
-      putbuf (ubuf, size);
-      return size;
+      char kbuf[256];
+
+      /* Copies the data into kernel space first, so that
+         page faults on UBUF are taken here and not while the
+         console copies it into the serial queue with interrupts
+         off. */
+      while (size > 0)
+        {
+          unsigned chunk = size < sizeof kbuf ? size : sizeof kbuf;
+
+          copy_from_user (kbuf, ubuf + res, chunk);
+          putbuf (kbuf, chunk);
+          res += chunk;
+          size -= chunk;
+        }
+    }
+  put_fd (fd);
+  return res;
+}
+
+/* Reads from open file FD_NO into each of the IOVCNT buffers
+   described by user array UIOV in turn, as sys_read() would, or,
+   if TO_FILE, writes each of them to FD_NO as sys_write() would.
+   Stops at the first buffer that is not transferred in full.
+   Returns the total number of bytes transferred, or -1 if FD_NO
+   or IOVCNT is invalid. */
+static int
+transfer_iovecs (int fd_no, const struct iovec *uiov, int iovcnt,
+                 bool to_file)
+{
+  struct iovec *kiov;
+  int res = 0;
+  int i;
+
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  kiov = malloc (iovcnt * sizeof *kiov + 1);
+  if (kiov == NULL)
+    return -1;
+  copy_from_user (kiov, uiov, iovcnt * sizeof *kiov);
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      int bytes;
+
+      if (kiov[i].iov_len == 0)
+        continue;
+      bytes = (to_file
+               ? sys_write (fd_no, kiov[i].iov_base, kiov[i].iov_len)
+               : sys_read (fd_no, kiov[i].iov_base, kiov[i].iov_len));
+      if (bytes < 0)
+        {
+          if (res == 0)
+            res = -1;
+          break;
+        }
+      res += bytes;
+      if ((size_t) bytes < kiov[i].iov_len)
+        break;
     }
+  free (kiov);
   return res;
 }
 
+/* Reads from open file FD_NO into the IOVCNT buffers described by
+   UIOV.  See transfer_iovecs(). */
+int
+sys_readv (int fd_no, const struct iovec *uiov, int iovcnt)
+{
+  return transfer_iovecs (fd_no, uiov, iovcnt, false);
+}
+
+/* Writes the IOVCNT buffers described by UIOV to open file FD_NO.
+   See transfer_iovecs(). */
+int
+sys_writev (int fd_no, const struct iovec *uiov, int iovcnt)
+{
+  return transfer_iovecs (fd_no, uiov, iovcnt, true);
+}
+
 /* Changes the next byte to be read or written in open
    file FD_NO to POSITION. */
 void
 sys_seek (int fd_no, unsigned position)
 {
   struct file_desc *fd;
-  if ((fd = lookup_fd (fd_no)) == NULL)
-    return;
-  
-  lock_acquire (&fs_lock);
-  file_seek (fd->file, position);
-  lock_release (&fs_lock);
+  if ((fd = lookup_fd (fd_no)) != NULL && fd->pipe == NULL)
+    file_seek (fd->file, position);
+  put_fd (fd);
 }
 
 /* Returns the position, in byte offset, of the file if
@@ -639,39 +1555,569 @@ sys_tell (int fd_no)
   struct file_desc *fd;
   unsigned res;
   
-  if ((fd = lookup_fd (fd_no)) == NULL)
-    return -1;
+  if ((fd = lookup_fd (fd_no)) == NULL || fd->pipe != NULL)
+    {
+      put_fd (fd);
+      return -1;
+    }
   
-  lock_acquire (&fs_lock);
   res = file_tell (fd->file);
-  lock_release (&fs_lock);
+  put_fd (fd);
   
   return res;
 }
 
+/* Allocates disk space for the bytes of open file FD_NO given
+   by ARGS, in as few runs of contiguous sectors as possible, and
+   grows the file to cover them, as described for fallocate() in
+   lib/user/syscall.h.  With FALLOC_UNWRITTEN, the space is not
+   zeroed on disk, but still reads as zeros.  Returns true if
+   successful, false if FD_NO is not an open file, if the range
+   is too big, or if file_allocate() fails. */
+bool
+sys_fallocate (int fd_no, const struct fallocate_args *args)
+{
+  struct fallocate_args kargs;
+  struct file_desc *fd;
+  bool success = false;
+
+  if (args == NULL)
+    return false;
+  copy_from_user (&kargs, args, sizeof kargs);
+  if ((fd = lookup_fd (fd_no)) != NULL && fd->pipe == NULL
+      && kargs.offset <= (unsigned) INT32_MAX
+      && kargs.length <= (unsigned) INT32_MAX - kargs.offset)
+    success = file_allocate (fd->file, kargs.offset, kargs.length,
+                             (kargs.flags & FALLOC_UNWRITTEN) != 0);
+  put_fd (fd);
+  return success;
+}
+
+/* Reads CHUNK bytes, which must lie within one page of FILE,
+   from FILE at its current position into kernel buffer KBUF.
+   With VM, they come from the frame of a shared file mapping
+   that holds that page, if one is resident, as for
+   transfer_frame().  Returns the number of bytes read. */
+static int
+read_kernel (struct file *file, void *kbuf, unsigned chunk)
+{
+#ifdef VM
+  off_t pos = file_tell (file);
+  off_t ofs = pos % PGSIZE;
+  struct frame *f = frame_lock_file (file_get_inode (file), pos - ofs);
+
+  if (f != NULL)
+    {
+      off_t left = file_length (file) - pos;
+
+      if (left < (off_t) chunk)
+        chunk = left > 0 ? left : 0;
+      if (ofs + (off_t) chunk <= (off_t) f->page->read_bytes)
+        {
+          memcpy (kbuf, f->kpage + ofs, chunk);
+          frame_lock_release (f);
+          file_seek (file, pos + chunk);
+          return chunk;
+        }
+      frame_lock_release (f);
+    }
+#endif
+  return file_read (file, kbuf, chunk);
+}
+
+/* Copies up to SIZE bytes from open file IN_FD, starting at its
+   position, to open file OUT_FD at its position, advancing both.
+   The data moves a page at a time between the buffer cache of
+   one file and that of the other through a kernel page, never
+   crossing into user memory, and agrees with shared mappings of
+   either file as read() and write() do.  Returns the number of
+   bytes copied, fewer than SIZE at the end of IN_FD or if OUT_FD
+   cannot grow, or -1 if either is not an open file or no kernel
+   page is free. */
+int
+sys_copy_file_range (int in_fd, int out_fd, unsigned size)
+{
+  struct file_desc *in, *out = NULL;
+  void *kbuf = NULL;
+  int res = 0;
+
+  if ((in = lookup_fd (in_fd)) == NULL || in->pipe != NULL
+      || (out = lookup_fd (out_fd)) == NULL || out->pipe != NULL
+      || (kbuf = palloc_get_page (0)) == NULL)
+    {
+      put_fd (in);
+      put_fd (out);
+      return -1;
+    }
+
+  while (size > 0)
+    {
+      off_t in_pos = file_tell (in->file);
+      off_t out_pos = file_tell (out->file);
+      unsigned chunk = PGSIZE - in_pos % PGSIZE;
+      int bytes, written;
+
+      if (chunk > (unsigned) (PGSIZE - out_pos % PGSIZE))
+        chunk = PGSIZE - out_pos % PGSIZE;
+      if (chunk > size)
+        chunk = size;
+
+      bytes = read_kernel (in->file, kbuf, chunk);
+      if (bytes <= 0)
+        break;
+      written = file_write (out->file, kbuf, bytes);
+      if (written < bytes)
+        file_seek (in->file, in_pos + (written > 0 ? written : 0));
+      if (written <= 0)
+        break;
+#ifdef VM
+      transfer_frame_update (out->file, out_pos, written);
+#endif
+
+      res += written;
+      size -= written;
+      if ((unsigned) written < chunk)
+        break;
+    }
+  palloc_free_page (kbuf);
+  put_fd (in);
+  put_fd (out);
+  return res;
+}
+
+/* Writes the data and inode of open file FD_NO to disk and waits
+   until they are there.  Returns false if FD_NO is not an open
+   file. */
+bool
+sys_fsync (int fd_no)
+{
+  struct file_desc *fd;
+
+  bool success = false;
+
+  if ((fd = lookup_fd (fd_no)) != NULL && fd->pipe == NULL)
+    {
+      file_sync (fd->file);
+      success = true;
+    }
+  put_fd (fd);
+  return success;
+}
+
+/* Writes all file system data to disk and waits until it is
+   there. */
+void
+sys_sync (void)
+{
+  filesys_sync ();
+}
+
+/* Number of directory entries sys_getdents() reads at once. */
+#define GETDENTS_BATCH 16
+
+/* Copies to user array ARGS->ENTS up to ARGS->CNT entries of the
+   root directory, starting at *ARGS->COOKIE, and advances the
+   cookie, as described for getdents() in lib/user/syscall.h.
+   Returns the number of entries copied, or -1 if ARGS is null,
+   the cookie is out of range, or the root directory cannot be
+   opened. */
+int
+sys_getdents (const struct getdents_args *args)
+{
+  struct getdents_args kargs;
+  struct dir_info info[GETDENTS_BATCH];
+  struct dir *dir;
+  unsigned cookie;
+  int res = 0;
+
+  if (args == NULL)
+    return -1;
+  copy_from_user (&kargs, args, sizeof kargs);
+  copy_from_user (&cookie, kargs.cookie, sizeof cookie);
+  if (cookie > (unsigned) INT32_MAX || (dir = dir_open_root ()) == NULL)
+    return -1;
+
+  while (res < kargs.cnt)
+    {
+      off_t pos = cookie;
+      size_t max = kargs.cnt - res < GETDENTS_BATCH
+                   ? (size_t) (kargs.cnt - res) : GETDENTS_BATCH;
+      size_t cnt = dir_read_entries (dir, &pos, info, max,
+                                     (kargs.flags & GETDENTS_PLUS) != 0);
+      size_t i;
+
+      cookie = pos;
+      for (i = 0; i < cnt; i++)
+        {
+          struct dirent d;
+
+          memset (&d, 0, sizeof d);
+          strlcpy (d.name, info[i].name, sizeof d.name);
+          if (kargs.flags & GETDENTS_PLUS)
+            {
+              d.inumber = info[i].inode_sector;
+              d.size = info[i].length;
+            }
+          copy_to_user (kargs.ents + res++, &d, sizeof d);
+        }
+      if (cnt < max)
+        break;
+    }
+  dir_close (dir);
+
+  copy_to_user (kargs.cookie, &cookie, sizeof cookie);
+  return res;
+}
+
+/* Returns those of EVENTS that have occurred on file descriptor
+   FD_NO, plus POLLHUP or POLLNVAL if they apply.  If FD_NO is the
+   console's input or a pipe, first adds W for POLLER to its poll
+   queue, so that POLLER is woken when that may change. */
+static short
+poll_fd (int fd_no, short events, struct poll_waiter *w,
+         struct poller *poller)
+{
+  struct file_desc *fd;
+  short revents = 0;
+
+  if (fd_no < 0)
+    return 0;
+  if (fd_no == STDIN_FILENO)
+    {
+      input_poll_add (w, poller);
+      return input_ready () ? events & POLLIN : 0;
+    }
+  if (fd_no == STDOUT_FILENO)
+    return events & POLLOUT;
+  if ((fd = lookup_fd (fd_no)) == NULL)
+    return POLLNVAL;
+  if (fd->pipe == NULL)
+    revents = events & (POLLIN | POLLOUT);
+  else
+    {
+      pipe_poll_add (fd->pipe, w, poller);
+      if (pipe_ready (fd->pipe, fd->writer))
+        revents |= events & (fd->writer ? POLLOUT : POLLIN);
+      if (pipe_hung_up (fd->pipe, fd->writer))
+        revents |= POLLHUP;
+    }
+  put_fd (fd);
+  return revents;
+}
+
+/* Waits until at least one of the CNT file descriptors in user
+   array UFDS has one of the events it asks for, or up to TIMEOUT
+   milliseconds, or as long as it takes if TIMEOUT is negative: a
+   TIMEOUT of 0 only checks.  Sets each one's REVENTS and returns
+   the number of them with any, 0 on a timeout, or -1 if CNT is
+   out of range or memory is short.
+
+   Sleeps on the poll queues of the pipes and the console input
+   among UFDS, rather than checking them over and over.  See
+   threads/poll.c. */
+int
+sys_poll (struct pollfd *ufds, int cnt, int timeout)
+{
+  struct pollfd *kfds;
+  struct poll_waiter *waiters;
+  struct poller poller;
+  int64_t ticks;
+  int ready, i;
+
+  if (cnt < 0 || cnt > POLL_MAX)
+    return -1;
+  kfds = malloc (cnt * (sizeof *kfds + sizeof *waiters) + 1);
+  if (kfds == NULL)
+    return -1;
+  waiters = (struct poll_waiter *) (kfds + cnt);
+  copy_from_user (kfds, ufds, cnt * sizeof *kfds);
+
+  if (timeout < 0)
+    ticks = -1;
+  else
+    ticks = DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ, 1000);
+  poller_init (&poller, ticks);
+  for (i = 0; i < cnt; i++)
+    waiters[i].queue = NULL;
+  for (;;)
+    {
+      ready = 0;
+      for (i = 0; i < cnt; i++)
+        {
+          poll_queue_remove (&waiters[i]);
+          kfds[i].revents = poll_fd (kfds[i].fd, kfds[i].events,
+                                     &waiters[i], &poller);
+          if (kfds[i].revents != 0)
+            ready++;
+        }
+      if (ready > 0 || !poller_wait (&poller))
+        break;
+    }
+  for (i = 0; i < cnt; i++)
+    poll_queue_remove (&waiters[i]);
+  poller_done (&poller);
+
+  copy_to_user (ufds, kfds, cnt * sizeof *kfds);
+  free (kfds);
+  return ready;
+}
+
 /* Closes the opened file with the given file descriptor FD_NO. */
 void
 sys_close (int fd_no)
 {
   struct file_desc *fd;
+  bool locked;
   
-  if ((fd = lookup_fd (fd_no)) == NULL)
-    return;
-  
-  lock_acquire(&fs_lock);
-  file_close (fd->file);
-  lock_release (&fs_lock);
+  locked = process_lock ();
+  fd = idtable_remove (&process_current ()->fds, fd_no);
+  process_unlock (locked);
+  put_fd (fd);
+}
 
-  list_remove (&fd->fd_list_elem);
-  free (fd);
+/* Creates a pipe and stores a file descriptor for its read end
+   in UFDS[0] and one for its write end in UFDS[1].  Bytes
+   written to UFDS[1] are read from UFDS[0] in the same order.
+   Like other file descriptors, both are inherited by fork().
+   Returns false, creating nothing, if memory is short. */
+bool
+sys_pipe (int *ufds)
+{
+  struct thread *cur = process_current ();
+  struct file_desc *fds[2];
+  struct pipe *pipe;
+  int nos[2];
+  bool locked;
+  int i;
+
+  if (ufds == NULL)
+    return false;
+  if ((pipe = pipe_create ()) == NULL)
+    return false;
+
+  locked = process_lock ();
+  for (i = 0; i < 2; i++)
+    {
+      fds[i] = malloc (sizeof (struct file_desc));
+      if (fds[i] == NULL)
+        break;
+      fds[i]->file = NULL;
+      fds[i]->pipe = pipe;
+      fds[i]->writer = i == 1;
+      fds[i]->ref_cnt = 1;
+      fds[i]->no = nos[i] = idtable_insert (&cur->fds, fds[i]);
+      if (fds[i]->no < 0)
+        {
+          free (fds[i]);
+          break;
+        }
+    }
+  if (i < 2)
+    {
+      /* Undo, closing each end once. */
+      if (i > 0)
+        {
+          idtable_remove (&cur->fds, nos[0]);
+          free (fds[0]);
+        }
+      process_unlock (locked);
+      pipe_close (pipe, false);
+      pipe_close (pipe, true);
+      return false;
+    }
+  process_unlock (locked);
+
+  copy_to_user (ufds, nos, sizeof nos);
+  return true;
+}
+
+/* Reads the header of user ring URING into RING.  Returns false
+   if its size is not a power of 2 between 1 and RING_MAX. */
+static bool
+get_ring (struct ring *ring, const struct ring *uring)
+{
+  copy_from_user (ring, uring, sizeof *ring);
+  return (ring->entries > 0 && ring->entries <= RING_MAX
+          && (ring->entries & (ring->entries - 1)) == 0);
+}
+
+/* Registers URING as the current process's system call ring, to
+   be processed by later calls to ring_enter(), replacing any ring
+   registered before.  Returns false, registering nothing, if
+   URING's size is invalid. */
+bool
+sys_ring_setup (struct ring *uring)
+{
+  struct ring ring;
+
+  if (uring == NULL || !get_ring (&ring, uring))
+    return false;
+  thread_current ()->ring = uring;
+  return true;
+}
+
+/* Performs the operation that SQE submits and returns its
+   result for the completion. */
+static int
+ring_op (const struct ring_sqe *sqe)
+{
+  switch (sqe->op)
+    {
+    case RING_READ:
+      return sys_read (sqe->fd, sqe->buf, sqe->size);
+    case RING_WRITE:
+      return sys_write (sqe->fd, sqe->buf, sqe->size);
+    case RING_SEEK:
+      sys_seek (sqe->fd, sqe->size);
+      return 0;
+    case RING_CLOSE:
+      sys_close (sqe->fd);
+      return 0;
+    default:
+      return -1;
+    }
+}
+
+/* Starts asynchronous operation SQE, RING_READ_ASYNC or
+   RING_WRITE_ASYNC, in the background and returns true.  If it
+   cannot be started, returns false and stores the result for an
+   immediate completion in *RES instead. */
+static bool
+ring_start_async (const struct ring_sqe *sqe, int *res)
+{
+  struct thread *cur = thread_current ();
+  bool writing = sqe->op == RING_WRITE_ASYNC;
+  unsigned size = sqe->size < AIO_MAX_SIZE ? sqe->size : AIO_MAX_SIZE;
+  struct file_desc *fd;
+  struct aio_req *req = NULL;
+
+  *res = -1;
+  if (sqe->buf == NULL || sqe->offset > (unsigned) INT32_MAX)
+    return false;
+  if ((fd = lookup_fd (sqe->fd)) != NULL && fd->pipe == NULL)
+    {
+      if (size == 0)
+        *res = 0;
+      else if (cur->aio != NULL || (cur->aio = aio_create ()) != NULL)
+        req = aio_req_create (cur->aio, fd->file, sqe->offset, size,
+                              writing);
+    }
+  put_fd (fd);
+  if (req == NULL)
+    return false;
+
+  req->ubuf = sqe->buf;
+  req->user_data = sqe->user_data;
+  if (writing)
+    copy_from_user (req->buf, sqe->buf, size);
+  aio_submit (req);
+  return true;
+}
+
+/* Posts a completion to RING, whose index mask is MASK, for each
+   of the current thread's finished asynchronous operations,
+   first waiting until one finishes if WAIT is true and any are
+   running.  Returns the number of completions posted. */
+static int
+ring_reap (struct ring *ring, unsigned mask, bool wait)
+{
+  struct aio *aio = thread_current ()->aio;
+  struct aio_req *req;
+  int cnt = 0;
+
+  if (aio == NULL)
+    return 0;
+  while ((req = aio_next (aio, wait && cnt == 0)) != NULL)
+    {
+      struct ring_cqe cqe;
+
+      if (!req->writing && req->res > 0)
+        copy_to_user (req->ubuf, req->buf, req->res);
+      cqe.user_data = req->user_data;
+      cqe.res = req->res;
+      aio_release (req);
+      copy_to_user (&ring->cqes[ring->cq_tail++ & mask], &cqe, sizeof cqe);
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Processes, in order, the submissions queued in the current
+   thread's ring, until the submission queue is empty or the
+   completion queue is full.  Posts a completion for each,
+   except that RING_READ_ASYNC and RING_WRITE_ASYNC start in the
+   background and only hold a completion slot; then posts the
+   completions of any that have finished.  Returns the number of
+   submissions processed, or -1 if no ring has been set up.
+
+   The whole batch costs one entry into the kernel, and for
+   each submission, one copy of the entry in each direction. */
+int
+sys_ring_enter (void)
+{
+  struct thread *cur = thread_current ();
+  struct ring *uring = cur->ring;
+  struct ring ring;
+  unsigned mask, outstanding;
+  int cnt = 0;
+
+  if (uring == NULL || !get_ring (&ring, uring))
+    return -1;
+  mask = ring.entries - 1;
+  outstanding = cur->aio != NULL ? aio_outstanding (cur->aio) : 0;
+
+  while (ring.sq_head != ring.sq_tail
+         && ring.cq_tail - ring.cq_head + outstanding < ring.entries)
+    {
+      struct ring_sqe sqe;
+      struct ring_cqe cqe;
+
+      copy_from_user (&sqe, &ring.sqes[ring.sq_head++ & mask], sizeof sqe);
+      cnt++;
+      if (sqe.op == RING_READ_ASYNC || sqe.op == RING_WRITE_ASYNC)
+        {
+          if (ring_start_async (&sqe, &cqe.res))
+            {
+              outstanding++;
+              continue;
+            }
+        }
+      else
+        cqe.res = ring_op (&sqe);
+      cqe.user_data = sqe.user_data;
+      copy_to_user (&ring.cqes[ring.cq_tail++ & mask], &cqe, sizeof cqe);
+    }
+  ring_reap (&ring, mask, false);
+
+  copy_to_user (&uring->sq_head, &ring.sq_head, sizeof ring.sq_head);
+  copy_to_user (&uring->cq_tail, &ring.cq_tail, sizeof ring.cq_tail);
+  return cnt;
+}
+
+/* Waits until at least one of the current thread's asynchronous
+   ring operations has finished, unless none is running, and
+   posts the completions of all that have.  Returns the number of
+   completions posted, or -1 if no ring has been set up. */
+int
+sys_ring_wait (void)
+{
+  struct ring *uring = thread_current ()->ring;
+  struct ring ring;
+  int cnt;
+
+  if (uring == NULL || !get_ring (&ring, uring))
+    return -1;
+  cnt = ring_reap (&ring, ring.entries - 1, true);
+  copy_to_user (&uring->cq_tail, &ring.cq_tail, sizeof ring.cq_tail);
+  return cnt;
 }
 
 #ifdef VM
 /* A mmap mapping. */
 struct mmap
   {
-    struct list_elem mmap_list_elem;   /* List element. */
-    struct file *file;                 /* File. */
+    struct file *file;                 /* File, or null for SHM. */
+    struct shm *shm;                   /* Shared memory segment. */
     mapid_t mapid;                     /* Mmap id. */
     
     /* A user virtual address from which mapping starts. */
@@ -680,25 +2126,15 @@ struct mmap
     size_t pages;
   };
 
-/* Finds a file descriptor with the given FD_NO.
+/* Finds a mmap mapping with the given MAPID.
    If not found, returns NULL. */
 static struct mmap *
 lookup_mmap (mapid_t mapid)
 {
-  struct thread *cur = thread_current ();
-  struct list *mmap_list = &cur->mmap_list;
-  struct list_elem *e;
-  for (e = list_begin (mmap_list); e != list_end (mmap_list);
-       e = list_next (e))
-    {
-      struct mmap *m
-        = list_entry (e, struct mmap, mmap_list_elem);
-      if (m->mapid == mapid)
-        return m;
-    }
-  return NULL;
+  return idtable_lookup (&process_current ()->mmaps, mapid);
 }
 
+static mapid_t do_mmap (int, void *, off_t, size_t, int);
 static void do_munmap (struct mmap *, bool);
 
 /* Maps the file open as FD_NO into the process's virtual
@@ -728,89 +2164,437 @@ static void do_munmap (struct mmap *, bool);
 mapid_t
 sys_mmap (int fd_no, void *addr)
 {
-  struct thread *cur = thread_current ();
+  return do_mmap (fd_no, addr, 0, SIZE_MAX, MAP_SHARED);
+}
+
+/* Maps LENGTH bytes of the file open as FD_NO, starting at
+   offset OFFSET, or as many as the file has past OFFSET if
+   fewer, into the process's virtual address space at ADDR, as
+   mmap() maps a whole file.  ARGS holds OFFSET, LENGTH and the
+   FLAGS of the mapping:
+
+     - MAP_SHARED writes the process's changes back to the file,
+       as mmap() does.
+
+     - MAP_PRIVATE keeps them to the process instead: a modified
+       page goes to swap when it is evicted, as a data page of an
+       executable does, and the file is left unchanged.
+
+     - MAP_POPULATE reads every page in before returning, a run
+       of them at a time, so that the process takes no page
+       faults on them later.
+
+   Returns a mapping id, or -1 if mmap() would fail, if OFFSET
+   is not page-aligned or not within the file, if LENGTH is 0,
+   or if FLAGS has neither or both of MAP_SHARED and
+   MAP_PRIVATE. */
+mapid_t
+sys_mmap_range (int fd_no, void *addr, const struct mmap_args *args)
+{
+  struct mmap_args kargs;
+
+  if (args == NULL)
+    return -1;
+  copy_from_user (&kargs, args, sizeof kargs);
+  if (kargs.length == 0 || kargs.offset % PGSIZE != 0
+      || kargs.offset > (unsigned) INT32_MAX)
+    return -1;
+  return do_mmap (fd_no, addr, kargs.offset, kargs.length, kargs.flags);
+}
+
+/* Performs a core functionality of mmap() and mmap_range():
+   maps LENGTH bytes of the file open as FD_NO, or the rest of it
+   past page-aligned offset OFS, at ADDR, with mmap_range() FLAGS.
+   Returns the new mapping id, or -1 on failure. */
+static mapid_t
+do_mmap (int fd_no, void *addr, off_t ofs, size_t length, int flags)
+{
+  struct thread *cur = process_current ();
+  bool shared = (flags & MAP_SHARED) != 0;
   struct file_desc *fd;
   struct file *f;
   struct mmap *m;
   size_t size;
-  off_t ofs = 0;
 
+  if (shared == ((flags & MAP_PRIVATE) != 0))
+    return -1;
   if (fd_no == STDIN_FILENO || fd_no == STDOUT_FILENO)
     return -1;
   if (addr == NULL || pg_ofs (addr) != 0)
     return -1;
-  if ((fd = lookup_fd (fd_no)) == NULL)
+  if ((fd = lookup_fd (fd_no)) == NULL || fd->pipe != NULL)
+    {
+      put_fd (fd);
+      return -1;
+    }
+  f = file_reopen (fd->file);
+  put_fd (fd);
+  if (f == NULL)
     return -1;
   if ((m = malloc (sizeof (struct mmap))) == NULL)
-    return -1;
-  
-  lock_acquire (&fs_lock);
-  if ((f = file_reopen (fd->file)) == NULL)
     {
-      lock_release (&fs_lock);
-      free (m);
+      file_close (f);
       return -1;
     }
-  lock_release (&fs_lock);
 
+  m->mapid = idtable_insert (&cur->mmaps, m);
+  if (m->mapid < 0)
+    {
+      file_close (f);
+      free (m);
+      return -1;
+    }
   m->file = f;
-  m->mapid = cur->next_mapid++;
+  m->shm = NULL;
   m->addr = addr;
   m->pages = 0;
-  list_push_back (&cur->mmap_list, &m->mmap_list_elem);
 
-  lock_acquire (&fs_lock);
-  size = file_length (m->file);
-  lock_release (&fs_lock);
+  /* Bytes past the end of the file are not mapped, since
+     changes to them could not be written back. */
+  if (ofs >= file_length (m->file))
+    goto munmap;
+  size = file_length (m->file) - ofs;
+  if (size > length)
+    size = length;
+
+  /* If the range of pages mapped overlaps any existing set
+     of user virtual pages, mmap() fails. */
+  if (!page_map_region (addr, DIV_ROUND_UP (size, PGSIZE), f, ofs, size,
+                        true, shared))
+    goto munmap;
+  m->pages = DIV_ROUND_UP (size, PGSIZE);
+
+  if (flags & MAP_POPULATE)
+    page_populate (addr, m->pages, true);
+  return m->mapid;
 
-  if (size == 0)
-    return -1;
+ munmap:
+  do_munmap (m, false);
+  return -1;
+}
 
-  while (size > 0)
+/* Unmaps the mapping designated by MAPID, which must be a
+   mapping id returned by a previous call to mmap() by the
+   same process that has not yet been unmapped. */
+void
+sys_munmap (mapid_t mapid)
+{
+  struct mmap *m;
+  if ((m = lookup_mmap (mapid)) == NULL)
+    return;
+  do_munmap (m, true);
+}
+
+/* Writes the pages of mapping MAPID that have been modified
+   since they were loaded or last written back to the mapped
+   file, as munmap() would, but keeps the mapping.  With MS_SYNC
+   in FLAGS, also waits until the file system has written them
+   to disk; with MS_ASYNC, leaves that to the buffer cache.  A
+   mapping of a shared memory segment has no file, so there is
+   nothing to write for it.  Returns false if MAPID is not a
+   mapping of the current process or FLAGS has neither or both
+   of MS_SYNC and MS_ASYNC. */
+bool
+sys_msync (mapid_t mapid, int flags)
+{
+  struct mmap *m;
+
+  if ((m = lookup_mmap (mapid)) == NULL)
+    return false;
+  if (((flags & MS_SYNC) != 0) == ((flags & MS_ASYNC) != 0))
+    return false;
+
+  if (m->file != NULL)
+    page_msync (m->addr, m->pages);
+  if (flags & MS_SYNC)
+    cache_flush ();
+  return true;
+}
+
+/* Tells the kernel how the process will access the LENGTH
+   bytes, rounded up to whole pages, starting at page-aligned
+   ADDR, according to ADVICE:
+
+     - MADV_NORMAL, MADV_RANDOM and MADV_SEQUENTIAL are kept for
+       the pages.  A fault on a random page maps no more pages
+       around it, nor reads ahead swap slots; a fault on a
+       sequential page maps more, and suggests the pages the scan
+       has gone past for eviction.
+
+     - MADV_WILLNEED reads in the pages of file mappings that are
+       not resident, using free frames only.
+
+     - MADV_DONTNEED frees the memory and swap space of the
+       pages right away.  Their next access loads them again from
+       the mapped file, or as zeros, so changes to them are lost
+       except in shared file mappings, which are written back
+       first.
+
+   Returns false if ADDR is not page-aligned or the range is
+   empty or not in user memory, or ADVICE is not one of the
+   above. */
+bool
+sys_madvise (void *addr, size_t length, int advice)
+{
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+  if (pg_ofs (addr) != 0 || length == 0 || !is_user_vaddr (addr)
+      || page_cnt > (size_t) (PHYS_BASE - addr) / PGSIZE)
+    return false;
+
+  switch (advice)
     {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from the file F
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = (size > PGSIZE) ? PGSIZE : size;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-      struct page *p;
-
-      /* If the range of pages mapped overlaps any existing set
-         of user virtual pages, mmap() fails. */
-      if ((p = page_make_entry (addr)) == NULL)
-        goto munmap;
-      m->pages++;
-
-      p->type = PG_FILE;
-      p->writable = true;
-
-      p->file = f;
-      p->read_bytes = page_read_bytes;
-      p->zero_bytes = page_zero_bytes;
-      p->file_ofs = ofs;
-
-      size -= page_read_bytes;
-      addr += PGSIZE;
-      ofs  += page_read_bytes;
-    }  
+    case MADV_NORMAL:
+      return page_advise (addr, page_cnt, ADV_NORMAL);
+    case MADV_RANDOM:
+      return page_advise (addr, page_cnt, ADV_RANDOM);
+    case MADV_SEQUENTIAL:
+      return page_advise (addr, page_cnt, ADV_SEQUENTIAL);
+    case MADV_WILLNEED:
+      page_populate (addr, page_cnt, false);
+      return true;
+    case MADV_DONTNEED:
+      page_dontneed (addr, page_cnt);
+      return true;
+    default:
+      return false;
+    }
+}
+
+/* Maps the first SIZE bytes of the shared memory segment called
+   NAME into the process's virtual address space at ADDR, as
+   mmap() maps a file, creating a zero-filled segment of SIZE
+   bytes, rounded up to whole pages, if there is no segment of
+   that name yet.  Every process mapping a segment sees the
+   others' changes to it.
+
+   Returns a mapping id, to be given to munmap() like one
+   returned by mmap(), or -1 if ADDR is 0 or not page-aligned,
+   if the pages overlap existing mapped pages, if the segment
+   called NAME has fewer than SIZE bytes, or if SIZE is 0.  The
+   segment lasts until shm_unlink() removes NAME and the last
+   mapping is removed. */
+mapid_t
+sys_shm_map (const char *name, void *addr, unsigned size)
+{
+  struct thread *cur = process_current ();
+  char kname[SHM_NAME_MAX + 2];
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  struct shm *shm;
+  struct mmap *m;
+
+  if (name == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return -1;
+  strncpy_from_user (kname, name, sizeof kname);
 
+  if ((m = malloc (sizeof (struct mmap))) == NULL)
+    return -1;
+  if ((shm = shm_open (kname, page_cnt)) == NULL)
+    {
+      free (m);
+      return -1;
+    }
+  if (!page_map_shm (addr, page_cnt, shm))
+    {
+      shm_close (shm);
+      free (m);
+      return -1;
+    }
+  if ((m->mapid = idtable_insert (&cur->mmaps, m)) < 0)
+    {
+      page_unmap_region (addr);
+      shm_close (shm);
+      free (m);
+      return -1;
+    }
+  m->file = NULL;
+  m->shm = shm;
+  m->addr = addr;
+  m->pages = page_cnt;
   return m->mapid;
+}
+
+/* Removes NAME from the shared memory segments, so that a later
+   shm_map() of NAME creates a new segment, while existing
+   mappings keep the old one.  Returns false if there is no such
+   segment. */
+bool
+sys_shm_unlink (const char *name)
+{
+  char kname[SHM_NAME_MAX + 2];
+
+  if (name == NULL)
+    return false;
+  strncpy_from_user (kname, name, sizeof kname);
+  return shm_unlink (kname);
+}
+
+/* Starts a new thread in the current process, sharing its memory
+   and file descriptors, that runs user code at START as if
+   START (FUNC, AUX) were called, on a stack of its own.  Returns
+   the new thread's id, which the calling thread may wait() for,
+   or -1 if the thread cannot be created.
+
+   The new thread's exit() ends only that thread.  The exit() of
+   the process's first thread, or of a process killed by the
+   kernel, ends the others at their next system call or page
+   fault, and the process exits once they all have.  A file
+   descriptor closed while another thread is using it stays open
+   until that thread's system call returns; memory unmapped while
+   another thread is using it stays mapped until the kernel is
+   done with it. */
+pid_t
+sys_thread_create (void (*start) (void), void *func, void *aux)
+{
+  return process_thread_create (start, func, aux);
+}
+
+/* Performs futex operation OP on the futex at UADDR with
+   argument VAL, as described in lib/user/syscall.h, and returns
+   its result, or -1 if OP is unknown. */
+int
+sys_futex (int *uaddr, int op, int val)
+{
+  switch (op)
+    {
+    case FUTEX_WAIT:
+      return futex_wait (uaddr, val);
+    case FUTEX_WAKE:
+      return futex_wake (uaddr, val);
+    case FUTEX_REQUEUE:
+      return futex_requeue (uaddr, (const int *) val);
+    default:
+      return -1;
+    }
+}
+
+/* Moves the end of the process's heap by INCREMENT bytes, up or
+   down, and returns the old end, or (void *) -1 if the heap
+   cannot grow that far or would shrink below its start.  The
+   heap starts, empty, at the first page past the executable's
+   segments, and new heap memory is zero-filled. */
+void *
+sys_sbrk (intptr_t increment)
+{
+  void *old_brk = page_sbrk (increment);
+
+  return old_brk != NULL ? old_brk : (void *) -1;
+}
+
+/* Waits until the system's memory pressure is at least LEVEL, one
+   of the MEMPRESSURE_* levels, or up to TIMEOUT milliseconds, or
+   as long as it takes if TIMEOUT is negative: a TIMEOUT of 0 only
+   checks.  Returns the pressure level last found, which is below
+   LEVEL only on a timeout, or -1 if LEVEL is out of range.  See
+   vm/frame.c for how the level is measured. */
+int
+sys_mempressure (int level, int timeout)
+{
+  int64_t ticks;
+
+  if (level < MEMPRESSURE_NONE || level > MEMPRESSURE_CRITICAL)
+    return -1;
+  if (timeout < 0)
+    ticks = -1;
+  else
+    ticks = DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ, 1000);
+  return frame_pressure_wait (level, ticks);
+}
+
+/* Maps LENGTH bytes at page-aligned ADDR, rounded up to whole
+   pages, as a writable region whose pages are missing until a
+   handler fills them in with uffd_copy(), and returns a file
+   descriptor from which the handler reads a struct uffd_msg for
+   each fault on a missing page.  Returns -1 if the pages overlap
+   memory already in use or memory is short.  See vm/uffd.c. */
+int
+sys_uffd_register (void *addr, size_t length)
+{
+  size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  struct file_desc *fd;
+  struct uffd *u;
+  struct pipe *pipe;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || page_cnt == 0)
+    return -1;
+  if ((fd = malloc (sizeof (struct file_desc))) == NULL)
+    return -1;
+  if ((u = uffd_create ()) == NULL)
+    {
+      free (fd);
+      return -1;
+    }
+  pipe = uffd_pipe (u);
+  if (!page_map_uffd (addr, page_cnt, u))
+    {
+      uffd_close (u);
+      goto fail;
+    }
+
+  fd->file = NULL;
+  fd->pipe = pipe;
+  fd->writer = false;
+  fd->ref_cnt = 1;
+  fd->no = idtable_insert (&process_current ()->fds, fd);
+  if (fd->no < 0)
+    {
+      page_unmap_region (addr);
+      goto fail;
+    }
+  return fd->no;
+
+ fail:
+  pipe_close (pipe, false);
+  free (fd);
+  return -1;
+}
+
+/* Fills in the missing pages of the LENGTH bytes at DST, which
+   must be page-aligned and in a region registered with
+   uffd_register(), with copies of the pages at SRC, or with zeros
+   if SRC is null, and wakes the threads that faulted on them.
+   Returns the number of pages filled in, which falls short at the
+   first page that is not missing, or -1 if DST or LENGTH is not
+   page-aligned or memory is short. */
+int
+sys_uffd_copy (void *dst, const void *src, size_t length)
+{
+  void *kpage = NULL;
+  size_t i;
+
+  if (pg_ofs (dst) != 0 || length % PGSIZE != 0)
+    return -1;
+  if (src != NULL && (kpage = palloc_get_page (0)) == NULL)
+    return -1;
 
- munmap:
-  do_munmap (m, false);
-  return -1;
+  /* Copy each page in before locking the address space, since
+     SRC may fault. */
+  for (i = 0; i < length / PGSIZE; i++)
+    {
+      void *upage = dst + i * PGSIZE;
+
+      if (!is_user_vaddr (upage))
+        break;
+      if (src != NULL)
+        copy_from_user (kpage, src + i * PGSIZE, PGSIZE);
+      if (!page_uffd_resolve (upage, kpage))
+        break;
+    }
+  palloc_free_page (kpage);
+  return i;
 }
 
-/* Unmaps the mapping designated by MAPID, which must be a
-   mapping id returned by a previous call to mmap() by the
-   same process that has not yet been unmapped. */
-void
-sys_munmap (mapid_t mapid)
+/* Copies the virtual memory statistics of the whole system if
+   SYSTEM is true, otherwise of the current process, to STATS.
+   Returns false if STATS is a null pointer. */
+bool
+sys_vmstat (struct vmstat *stats, bool system)
 {
-  struct mmap *m;
-  if ((m = lookup_mmap (mapid)) == NULL)
-    return;
-  do_munmap (m, true);
+  if (stats == NULL)
+    return false;
+  copy_to_user (stats, system ? &vmstat_total : &thread_current ()->vmstat,
+                sizeof *stats);
+  return true;
 }
 
 /* Performs a core functionality of munmap().  It first closes
@@ -823,67 +2607,104 @@ sys_munmap (mapid_t mapid)
 static void
 do_munmap (struct mmap* m, bool write)
 {
-  struct thread *cur = thread_current ();
+  struct thread *cur = process_current ();
   struct page *p;
   void *upage;
 
   ASSERT (m != NULL);
 
-  /* For each mmap'ed page, */
+  if (m->pages > 0)
+    page_unmap_region (m->addr);
+
+  /* Write back the dirty pages, a run of them at a time.  Those
+     evicted since their last write went back to the file
+     already. */
+  if (write && m->file != NULL)
+    page_msync (m->addr, m->pages);
+
+  /* For each mmap'ed page which has been used, */
   for (upage = m->addr; upage < m->addr + PGSIZE * m->pages;
        upage += PGSIZE)
     {
       p = page_lookup (upage);
+      if (p == NULL)
+        continue;
 
-      ASSERT (p != NULL);
       ASSERT (p->file == m->file);
-
-      /* Here, UPAGE could have been evicted; the current process
-         does not have any virtual mapping for UPAGE.  The function
-         pagedir_is_dirty() returns false, if a page is dirty or
-         "there is no mapping" between UPAGE and a physical frame. */
-      p->dirty |= pagedir_is_dirty (cur->pagedir, p->upage);
-
-      if (write && p->dirty) 
-        {
-          /* Write back the page's contents. */
-          lock_acquire (&fs_lock);
-          file_write_at (p->file, p->upage, p->read_bytes, p->file_ofs);
-          lock_release (&fs_lock);
-        }
       page_remove_entry (p);
+      cond_resched ();
     }
   
-  lock_acquire (&fs_lock);
+  if (m->shm != NULL)
+    shm_close (m->shm);
   file_close (m->file);
-  lock_release (&fs_lock);
   
-  list_remove (&m->mmap_list_elem);
+  idtable_remove (&cur->mmaps, m->mapid);
   free (m);
 }
 #endif
 
+/* Closes file descriptor FD, on behalf of sys_fd_exit(). */
+static void
+close_fd (void *fd_, int fd_no UNUSED)
+{
+  struct file_desc *fd = fd_;
+
+  release_fd (fd);
+  free (fd);
+}
+
+/* Duplicates file descriptor FD, on behalf of sys_fork_copy(). */
+static void *
+copy_fd (void *fd_, int fd_no UNUSED)
+{
+  struct file_desc *fd = fd_;
+  struct file_desc *copy;
+
+  if ((copy = malloc (sizeof (struct file_desc))) == NULL)
+    return NULL;
+  *copy = *fd;
+  copy->ref_cnt = 1;
+  if (fd->pipe != NULL)
+    pipe_dup (fd->pipe, fd->writer);
+  else if ((copy->file = file_reopen (fd->file)) == NULL)
+    {
+      free (copy);
+      return NULL;
+    }
+  else
+    file_seek (copy->file, file_tell (fd->file));
+  return copy;
+}
+
+/* Gives the current process, just created by fork(), copies of
+   the file descriptors and the system call ring of PARENT.
+   Returns false if memory runs out; the descriptors copied so
+   far are closed by sys_fd_exit(). */
+bool
+sys_fork_copy (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+
+  cur->ring = parent->ring;
+  return idtable_copy (&cur->fds, &process_leader (parent)->fds, copy_fd);
+}
+
 /* Closes all opened files of the current process. */
 void
 sys_fd_exit (void)
 {
-  struct thread *cur = thread_current ();
-  struct list *fd_list = &cur->fd_list;
-  while (!list_empty (fd_list))
-    {
-      struct file_desc *fd
-        = list_entry (list_pop_front (fd_list), struct file_desc,
-                      fd_list_elem);
-      
-      lock_acquire (&fs_lock);
-      file_close (fd->file);
-      lock_release (&fs_lock);
-      
-      free (fd);
-    }
+  idtable_destroy (&thread_current ()->fds, close_fd);
 }
 
 #ifdef VM
+/* Unmaps mapping M, on behalf of sys_mmap_exit(). */
+static void
+unmap (void *m, int mapid UNUSED)
+{
+  do_munmap (m, true);
+}
+
 /* Unmaps all mmap mappings.
    All mappings are implicitly unmapped when a process exits,
    whether via exit or by any other means.  When a mapping is
@@ -894,15 +2715,7 @@ sys_fd_exit (void)
 void
 sys_mmap_exit (void)
 {
-  struct thread *cur = thread_current ();
-  struct list *mmap_list = &cur->mmap_list;
-  while (!list_empty (mmap_list))
-    {
-      struct mmap *m
-        = list_entry (list_front (mmap_list), struct mmap,
-                      mmap_list_elem);
-      do_munmap (m, true);
-    }
+  idtable_destroy (&thread_current ()->mmaps, unmap);
 }
 #endif
 
@@ -1028,8 +2841,287 @@ sys_munmap_wrapper (struct intr_frame *f)
   SYSCALL_GET_ARGS1 (f->esp, &ARG0);
   sys_munmap ((mapid_t) ARG0);
 }
+
+static void
+sys_vmstat_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_vmstat ((struct vmstat *) ARG0, (bool) ARG1);
+}
+#endif
+
+static void
+sys_readv_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_readv ((int) ARG0, (const struct iovec *) ARG1, (int) ARG2);
+}
+
+static void
+sys_writev_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_writev ((int) ARG0, (const struct iovec *) ARG1, (int) ARG2);
+}
+
+static void
+sys_ring_setup_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_ring_setup ((struct ring *) ARG0);
+}
+
+static void
+sys_ring_enter_wrapper (struct intr_frame *f)
+{
+  f->eax = sys_ring_enter ();
+}
+
+static void
+sys_fork_wrapper (struct intr_frame *f)
+{
+  f->eax = sys_fork (f);
+}
+
+static void
+sys_clock_ns_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_clock_ns ((int64_t *) ARG0);
+}
+
+static void
+sys_lockstat_wrapper (struct intr_frame *f UNUSED)
+{
+  sys_lockstat ();
+}
+
+static void
+sys_memstat_wrapper (struct intr_frame *f UNUSED)
+{
+  sys_memstat ();
+}
+
+static void
+sys_iostat_wrapper (struct intr_frame *f UNUSED)
+{
+  sys_iostat ();
+}
+
+static void
+sys_read_input_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_read_input ((void *) ARG0, (unsigned) ARG1, (int) ARG2);
+}
+
+#ifdef VM
+static void
+sys_shm_map_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_shm_map ((const char *) ARG0, (void *) ARG1,
+                        (unsigned) ARG2);
+}
+
+static void
+sys_shm_unlink_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_shm_unlink ((const char *) ARG0);
+}
+
+static void
+sys_msync_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_msync ((mapid_t) ARG0, (int) ARG1);
+}
+
+static void
+sys_mmap_range_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_mmap_range ((int) ARG0, (void *) ARG1,
+                           (const struct mmap_args *) ARG2);
+}
+
+static void
+sys_madvise_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_madvise ((void *) ARG0, (size_t) ARG1, (int) ARG2);
+}
+
+static void
+sys_thread_create_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_thread_create ((void (*) (void)) ARG0, (void *) ARG1,
+                              (void *) ARG2);
+}
+
+static void
+sys_futex_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_futex ((int *) ARG0, (int) ARG1, (int) ARG2);
+}
+
+static void
+sys_sbrk_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = (uint32_t) sys_sbrk ((intptr_t) ARG0);
+}
+
+static void
+sys_mempressure_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_mempressure ((int) ARG0, (int) ARG1);
+}
+
+static void
+sys_uffd_register_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_uffd_register ((void *) ARG0, (size_t) ARG1);
+}
+
+static void
+sys_uffd_copy_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_uffd_copy ((void *) ARG0, (const void *) ARG1,
+                          (size_t) ARG2);
+}
 #endif
 
+static void
+sys_pipe_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_pipe ((int *) ARG0);
+}
+
+static void
+sys_spawn_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_spawn ((const char *) ARG0);
+}
+
+static void
+sys_spawn_many_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_spawn_many ((const char **) ARG0, (int) ARG1,
+                           (pid_t *) ARG2);
+}
+
+static void
+sys_sched_group_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_sched_group ((int) ARG0);
+}
+
+static void
+sys_io_group_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_io_group ((int) ARG0, (int) ARG1);
+}
+
+static void
+sys_getrusage_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_getrusage ((int) ARG0, (struct rusage *) ARG1);
+}
+
+static void
+sys_syscallstat_wrapper (struct intr_frame *f UNUSED)
+{
+  sys_syscallstat ();
+}
+
+static void
+sys_fallocate_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1;
+  SYSCALL_GET_ARGS2 (f->esp, &ARG0, &ARG1);
+  f->eax = sys_fallocate ((int) ARG0, (const struct fallocate_args *) ARG1);
+}
+
+static void
+sys_copy_file_range_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_copy_file_range ((int) ARG0, (int) ARG1, (unsigned) ARG2);
+}
+
+static void
+sys_fsync_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_fsync ((int) ARG0);
+}
+
+static void
+sys_sync_wrapper (struct intr_frame *f UNUSED)
+{
+  sys_sync ();
+}
+
+static void
+sys_getdents_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0;
+  SYSCALL_GET_ARGS1 (f->esp, &ARG0);
+  f->eax = sys_getdents ((const struct getdents_args *) ARG0);
+}
+
+static void
+sys_poll_wrapper (struct intr_frame *f)
+{
+  sys_param_type ARG0, ARG1, ARG2;
+  SYSCALL_GET_ARGS3 (f->esp, &ARG0, &ARG1, &ARG2);
+  f->eax = sys_poll ((struct pollfd *) ARG0, (int) ARG1, (int) ARG2);
+}
+
+static void
+sys_ring_wait_wrapper (struct intr_frame *f)
+{
+  f->eax = sys_ring_wait ();
+}
+
 /* Handles invalid user-provided pointer access. */
 static void
 bad_user_access (void)
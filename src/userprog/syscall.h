@@ -1,15 +1,21 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+
 /* [3.1.5] Accessing User Memory
    The provided code for `get_user' and `put_user' assumes that
    the page fault in the kernel returns -1. */
 #define SYS_BAD_ADDR -1
 
 void syscall_init (void);
+void syscall_print_stats (void);
 void sys_exit (int);
 
+struct thread;
+
 void sys_fd_exit (void);
 void sys_mmap_exit (void);
+bool sys_fork_copy (struct thread *parent);
 
 #endif /* userprog/syscall.h */
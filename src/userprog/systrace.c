@@ -0,0 +1,95 @@
+#include "userprog/systrace.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/fsutil.h"
+#endif
+
+/* System call recording, enabled with the "-systrace[=PAGES]"
+   kernel command-line option.
+
+   syscall_handler() records each system call made by a user
+   program, with the time it was made, its caller, its first
+   arguments, any file name or command line it was given, and its
+   return value, into a log of PAGES pages.  A record's slot is
+   claimed with one atomic increment, so that the processes on
+   every CPU record without a lock.  Once the log is full,
+   further calls are only counted, so that a replay starts at the
+   beginning of the workload.
+
+   At shutdown, systrace_done() saves the log to the scratch
+   device as file "systrace", where "pintos --systrace"
+   retrieves it.  examples/replay issues the calls again from a
+   user program, as a repeatable benchmark. */
+int systrace_pages;
+bool systrace_enabled;
+
+static struct systrace_header *header;  /* Start of the log. */
+static struct systrace_record *records; /* RECORD_MAX records. */
+static uint32_t record_max;
+static uint32_t claim_cnt;              /* Slots claimed so far. */
+
+/* Allocates the log, if recording is on. */
+void
+systrace_init (void)
+{
+  if (systrace_pages <= 0)
+    return;
+
+  header = palloc_get_multiple (PAL_ZERO, systrace_pages);
+  if (header == NULL)
+    {
+      printf ("systrace: out of memory, recording off\n");
+      systrace_pages = 0;
+      return;
+    }
+  records = (struct systrace_record *) (header + 1);
+  record_max = ((systrace_pages * PGSIZE - sizeof *header)
+                / sizeof *records);
+  systrace_enabled = true;
+}
+
+/* Returns a free record in the log for the system call being
+   made, or a null pointer if the log is full. */
+struct systrace_record *
+systrace_claim (void)
+{
+  uint32_t slot = __sync_fetch_and_add (&claim_cnt, 1);
+
+  return slot < record_max ? &records[slot] : NULL;
+}
+
+/* Stops recording and saves the log. */
+void
+systrace_done (void)
+{
+  uint32_t cnt;
+
+  if (header == NULL)
+    return;
+  systrace_enabled = false;
+
+  cnt = claim_cnt < record_max ? claim_cnt : record_max;
+  memcpy (header->magic, "SYSC", 4);
+  header->record_size = sizeof *records;
+  header->record_cnt = cnt;
+  header->lost_cnt = claim_cnt - cnt;
+
+  printf ("Systrace: %"PRIu32" calls recorded, %"PRIu32" lost, ",
+          cnt, header->lost_cnt);
+#ifdef FILESYS
+  if (intr_get_level () == INTR_ON
+      && fsutil_save ("systrace", header,
+                      sizeof *header + cnt * sizeof *records))
+    printf ("saved to scratch device\n");
+  else
+#endif
+    printf ("not saved\n");
+
+  palloc_free_multiple (header, systrace_pages);
+  header = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef USERPROG_SYSTRACE_H
+#define USERPROG_SYSTRACE_H
+
+#include <stdbool.h>
+#include <systrace.h>
+
+/* System call recording.  See systrace.c. */
+
+/* Default size of the log, in pages. */
+#define SYSTRACE_PAGES 64
+
+/* Size of the log in pages, or 0 if recording is off. */
+extern int systrace_pages;
+
+/* True while system calls are being recorded. */
+extern bool systrace_enabled;
+
+void systrace_init (void);
+struct systrace_record *systrace_claim (void);
+void systrace_done (void);
+
+#endif /* userprog/systrace.h */
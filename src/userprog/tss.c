@@ -1,6 +1,7 @@
 #include "userprog/tss.h"
 #include <debug.h>
 #include <stddef.h>
+#include <sysenter.h>
 #include "userprog/gdt.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
@@ -75,6 +76,16 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Model-specific registers that configure "sysenter". */
+#define MSR_SYSENTER_CS  0x174  /* Kernel code selector. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer. */
+#define MSR_SYSENTER_EIP 0x176  /* Entry point. */
+
+/* Fast system call entry point, in userprog/sysenter.S. */
+void sysenter_entry (void);
+
+static void write_msr (uint32_t msr, uint32_t value);
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -86,6 +97,20 @@ tss_init (void)
   tss->ss0 = SEL_KDSEG;
   tss->bitmap = 0xdfff;
   tss_update ();
+
+  /* Let user programs enter system calls with "sysenter".  Rather
+     than reloading IA32_SYSENTER_ESP on every thread switch, we
+     point it at the TSS's esp0, which sysenter_entry loads as
+     its stack pointer, so that tss_update() serves both.  The
+     CPU derives the kernel stack selector and the user selectors
+     from SEL_KCSEG, which the order of segments in gdt.c
+     matches. */
+  if (sysenter_supported ())
+    {
+      write_msr (MSR_SYSENTER_CS, SEL_KCSEG);
+      write_msr (MSR_SYSENTER_ESP, (uint32_t) &tss->esp0);
+      write_msr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+    }
 }
 
 /* Returns the kernel TSS. */
@@ -104,3 +129,10 @@ tss_update (void)
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
 }
+
+/* Sets model-specific register MSR to VALUE. */
+static void
+write_msr (uint32_t msr, uint32_t value)
+{
+  asm volatile ("wrmsr" : : "c" (msr), "a" (value), "d" (0));
+}
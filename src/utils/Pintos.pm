@@ -8,15 +8,16 @@ our $LOADER_SIZE = 314;
 my (%role2type) = (KERNEL => 0x20,
 		   FILESYS => 0x21,
 		   SCRATCH => 0x22,
-		   SWAP => 0x23);
+		   SWAP => 0x23,
+		   HIBERNATE => 0x25);
 my (%type2role) = reverse %role2type;
 
 # Order of roles within a given disk.
-our (@role_order) = qw (KERNEL FILESYS SCRATCH SWAP);
+our (@role_order) = qw (KERNEL FILESYS SCRATCH SWAP HIBERNATE);
 
 # Partitions.
 #
-# Valid keys are KERNEL, FILESYS, SCRATCH, SWAP.  Only those
+# Valid keys are KERNEL, FILESYS, SCRATCH, SWAP, HIBERNATE.  Only those
 # partitions which are in use are included.
 #
 # Each value is a reference to a hash.  If the partition's contents
@@ -122,14 +123,14 @@ sub set_align {
 # assemble_disk(%args)
 #
 # Creates a virtual disk $args{DISK} containing the partitions
-# described by @args{KERNEL, FILESYS, SCRATCH, SWAP}.
+# described by @args{KERNEL, FILESYS, SCRATCH, SWAP, HIBERNATE}.
 #
 # Required arguments:
 #   DISK => output disk file name
 #   HANDLE => output file handle (will be closed)
 #
 # Normally at least one of the following is included:
-#   KERNEL, FILESYS, SCRATCH, SWAP => {input:
+#   KERNEL, FILESYS, SCRATCH, SWAP, HIBERNATE => {input:
 #				       FILE => file to read,
 #                                      OFFSET => byte offset in file,
 #                                      BYTES => byte count from file,
@@ -258,6 +259,7 @@ sub make_partition_table {
 	$table .= pack ("V", $p->{SECTORS});          # Length in sectors
 	die if length ($table) % 16;
     }
+    die "too many partitions for one disk\n" if length ($table) > 64;
     return pack ("a64", $table);
 }
 
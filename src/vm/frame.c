@@ -1,193 +1,2716 @@
 #include "vm/frame.h"
 #include "vm/page.h"
+#include "vm/pff.h"
+#include "vm/shm.h"
 #include "vm/swap.h"
+#include "vm/vmstat.h"
 #include <list.h>
 #include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include <round.h>
+#include "threads/fpu.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
-#include "threads/malloc.h"
+#include "threads/poll.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "devices/timer.h"
+#include "filesys/file.h"
+#include "filesys/inode.h"
+
+/* Watermarks of the page cleaner, in frames.
+   When fewer than FRAME_FREE_LOW frames are left in the user
+   pool and fewer than FRAME_CLEAN_LOW frames are clean, the page
+   cleaner writes dirty frames ahead of the clock hand until
+   FRAME_CLEAN_HIGH frames are clean.  A FRAME_CLEAN_HIGH of 0
+   disables the page cleaner.
+   Controlled by kernel command-line options "-fl", "-cl" and
+   "-ch". */
+size_t frame_free_low = 8;
+size_t frame_clean_low = 8;
+size_t frame_clean_high = 32;
+
+/* How often the mmap flusher writes the dirty pages of file
+   mappings back to their files, in seconds, so that they do not
+   wait for munmap() or eviction.  0 disables the flusher.
+   Controlled by kernel command-line option "-mf". */
+unsigned frame_flush_secs = 5;
+
+/* Distance between the two hands of the two-handed clock, in
+   frames.  Controlled by kernel command-line option "-hs". */
+size_t frame_hand_spread = 16;
+
+/* Maximum number of frames holding the pages of each process,
+   its resident set size (RSS), or 0 for no limit.  A process at
+   its limit evicts one of its own frames for each page it loads,
+   rather than take frames from other processes.
+   Controlled by kernel command-line option "-rl". */
+size_t frame_rss_limit = 0;
+
+/* Number of frames the same-page merger scans each MERGE_PERIOD,
+   or 0 to disable it.  The merger finds anonymous pages whose
+   contents are identical and have not changed since its last pass
+   over the frame table, and makes them share one frame
+   copy-on-write, as fork() does.  Controlled by kernel
+   command-line option "-ksm". */
+size_t frame_merge_pages = 0;
+
+/* Order of the free block that the compaction daemon keeps in
+   the memory pool, by migrating user frames, so that requests
+   for up to 2**FRAME_COMPACT_ORDER contiguous pages find one
+   without waiting for compaction.  0 disables the daemon, though
+   a failed request for contiguous pages still compacts memory
+   itself.  Controlled by kernel command-line option "-kc". */
+int frame_compact_order = 0;
+
+/* Maximum number of frames retained after the last process
+   mapping them lets go, so that running the same program again
+   finds its code in memory instead of reading it from disk, or
+   0 to retain none.  Controlled by kernel command-line option
+   "-pc".  See frame_retain(). */
+size_t frame_retain_max = 128;
+
+/* How often the page cleaner wakes up, in timer ticks. */
+#define CLEANER_PERIOD (TIMER_FREQ / 10)
+
+/* How often the compaction daemon wakes up, in timer ticks. */
+#define COMPACT_PERIOD TIMER_FREQ
+
+/* How often the same-page merger wakes up, in timer ticks. */
+#define MERGE_PERIOD (TIMER_FREQ / 5)
+
+/* Memory pressure is measured over the last second, in
+   PRESSURE_SLOTS slots of PRESSURE_SLOT_TICKS timer ticks, and is
+   critical once the frames evicted in that second reach
+   1/PRESSURE_CRITICAL_DIV of the frame table.  See
+   frame_pressure_level(). */
+#define PRESSURE_SLOTS 10
+#define PRESSURE_SLOT_TICKS (TIMER_FREQ / PRESSURE_SLOTS)
+#define PRESSURE_CRITICAL_DIV 8
+
+/* Maximum number of pages the mmap flusher writes at once. */
+#define FLUSH_BATCH 8
+
+/* Number of frames remembered for drop-behind.  See
+   frame_drop_behind(). */
+#define DROP_BEHIND_MAX 64
 
 /* Mutual exclusion. */
 static struct lock table_lock;
 
-/* List of allocated frames, frame table (FT). */
-static struct list frame_list;
+/* Signaled, while holding TABLE_LOCK, whenever the swap-out I/O
+   of some evicted SPTE completes.  See frame_wait_eviction(). */
+static struct condition transit_done;
+
+/* Share table: the frames holding read-only executable pages,
+   keyed by inode and file offset.  Each entry holds a reference
+   to its inode, so that the inode outlives the files that the
+   frame's pages were loaded from, and no other inode can take its
+   address while the entry exists.  Protected by TABLE_LOCK. */
+static struct hash share_table;
+
+/* Drop-behind candidates: frames of pages that a sequential
+   scan has gone past, most recently added at DROP_HEAD - 1, or
+   null pointers for frames that left the frame table meanwhile.
+   Protected by TABLE_LOCK.  See frame_drop_behind(). */
+static struct frame *drop_ring[DROP_BEHIND_MAX];
+static unsigned drop_head, drop_tail;
+static long long drop_cnt;              /* # of victims taken from it. */
+
+/* Retained frames: keyed by inode and file offset in
+   RETAIN_TABLE, and in RETAIN_LIST least recently retained first,
+   RETAIN_CNT of them.  Protected by TABLE_LOCK. */
+static struct hash retain_table;
+static struct list retain_list;
+static size_t retain_cnt;
+static long long retain_total_cnt;      /* # of frames retained. */
+static long long retain_reuse_cnt;      /* # of them mapped again. */
+
+/* Memory pressure: EVICT_SLOTS[I] counts the frames evicted
+   during slot EVICT_EPOCHS[I], numbered from boot, and PRESSURE is
+   the level last computed.  Threads waiting for the level to rise
+   are in PRESSURE_QUEUE.  Protected by TABLE_LOCK. */
+static unsigned evict_slots[PRESSURE_SLOTS];
+static int64_t evict_epochs[PRESSURE_SLOTS];
+static enum frame_pressure pressure;
+static struct poll_queue pressure_queue;
+static long long pressure_rise_cnt[PRESSURE_CRITICAL + 1];
+
+/* Frame table (FT): one FTE for each page of the memory pool,
+   indexed by palloc_page_no(), of which FRAME_CNT are in the
+   table.  The clock hands sweep the array in order, passing over
+   the FTEs of pages that are not user frames. */
+static struct frame *frames;
+static size_t frame_total;
+static size_t frame_cnt;
+
+/* Index of the last examined FTE in the frame table.  This is
+   the hand that selects victims, whatever the replacement
+   policy. */
+static size_t hand;
+
+/* A page replacement policy.
+   All policies share FRAMES and HAND; a policy may keep further
+   hands and per-frame state of its own. */
+struct frame_policy
+  {
+    const char *name;                   /* Name for "-rp" option. */
+
+    /* Called when F enters the frame table, with F->PAGE set to
+       the page it is about to hold. */
+    void (*insert) (struct frame *f);
+
+    /* Called when F is about to leave the frame table. */
+    void (*remove) (struct frame *f);
+
+    /* Selects a victim frame, locks it and returns it, adding the
+       number of frames examined to *SCAN_CNT.  The victim is
+       still in the frame table. */
+    struct frame *(*victim) (size_t *scan_cnt);
+  };
+
+static void clock_insert (struct frame *);
+static void clock_remove (struct frame *);
+static struct frame *clock_victim (size_t *);
+static struct frame *clock2_victim (size_t *);
+static void clockpro_insert (struct frame *);
+static void clockpro_remove (struct frame *);
+static struct frame *clockpro_victim (size_t *);
+
+/* Available replacement policies. */
+static const struct frame_policy policies[] =
+  {
+    {"clock", clock_insert, clock_remove, clock_victim},
+    {"2clock", clock_insert, clock_remove, clock2_victim},
+    {"clockpro", clockpro_insert, clockpro_remove, clockpro_victim},
+  };
+
+/* Current replacement policy. */
+static const struct frame_policy *policy = &policies[0];
+
+/* Victim selection statistics. */
+static long long victim_cnt;            /* # of victims selected. */
+static long long victim_scan_cnt;       /* # of frames examined. */
+static size_t victim_scan_max;          /* Longest single scan. */
+
+/* Same-page merging: the frames found stable so far in the
+   current pass, keyed by checksum, and statistics.  Only the
+   merger thread uses MERGE_TABLE. */
+static struct hash merge_table;
+static size_t merge_hand;               /* Last frame scanned. */
+static long long merge_scan_cnt;        /* # of frames examined. */
+static long long merge_cnt;             /* # of frames freed. */
+
+/* Compaction statistics. */
+static long long compact_cnt;           /* # of blocks freed. */
+static long long compact_fail_cnt;      /* # of attempts that failed. */
+static long long migrate_cnt;           /* # of frames migrated. */
+
+static thread_func frame_cleaner NO_RETURN;
+static thread_func frame_flusher NO_RETURN;
+static thread_func frame_merger NO_RETURN;
+static thread_func frame_compactor NO_RETURN;
+static hash_hash_func merge_hash;
+static hash_less_func merge_less;
+static hash_hash_func share_hash;
+static hash_less_func share_less;
+static void frame_drop_sharer (struct frame *, struct page *);
+static bool frame_retain (struct frame *, struct page *);
+static struct frame *frame_reuse (struct page *, struct inode **);
+static void *frame_reclaim (struct inode **);
+static void frame_note_eviction (void);
+static void frame_update_pressure (void);
+static struct shm_page *shm_page (const struct page *);
+static void frame_save_shm (struct frame *);
+static void frame_clean_shm (struct frame *);
+
+/* Selects the page replacement policy called NAME.  Returns
+   true if successful, false if there is no such policy.
+   Must be called before frame_init(). */
+bool
+frame_set_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof policies / sizeof *policies; i++)
+    if (!strcmp (name, policies[i].name))
+      {
+        policy = &policies[i];
+        return true;
+      }
+  return false;
+}
+
+/* Initializes the frame allocatior.
+   All allocated frames are stored in FRAMES and managed
+   globally. */
+void
+frame_init (void)
+{
+  size_t i;
+
+  lock_init (&table_lock);
+  cond_init (&transit_done);
+  hash_init (&share_table, share_hash, share_less, NULL);
+  hash_init (&retain_table, share_hash, share_less, NULL);
+  list_init (&retain_list);
+  poll_queue_init (&pressure_queue);
+
+  frame_total = palloc_page_cnt ();
+  frames = palloc_get_multiple (PAL_ASSERT,
+                                DIV_ROUND_UP (frame_total * sizeof *frames,
+                                              PGSIZE));
+  for (i = 0; i < frame_total; i++)
+    {
+      lock_init (&frames[i].lock);
+      frames[i].in_table = false;
+      frames[i].retained = false;
+    }
+  frame_cnt = 0;
+  hand = frame_total - 1;
+
+  if (frame_clean_high > 0)
+    thread_create ("pgcleaner", PRI_DEFAULT, frame_cleaner, NULL);
+  if (frame_flush_secs > 0)
+    thread_create ("mmapflush", PRI_DEFAULT, frame_flusher, NULL);
+  if (frame_merge_pages > 0)
+    {
+      hash_init (&merge_table, merge_hash, merge_less, NULL);
+      merge_hand = frame_total - 1;
+      thread_create ("ksmd", PRI_MIN, frame_merger, NULL);
+    }
+  if (frame_compact_order > 0)
+    thread_create ("kcompactd", PRI_MIN, frame_compactor, NULL);
+  pff_init ();
+}
+
+static struct frame *frame_make (struct page *, void *kpage);
+static struct frame *frame_advance (size_t *);
+static void frame_link (struct frame *);
+static struct inode *frame_unlink (struct frame *);
+static struct frame *frame_get_victim (struct thread *, struct inode **);
+static struct frame *frame_local_victim (struct thread *, size_t *);
+static struct thread *frame_oom_victim (void);
+static void frame_oom_kill (struct thread *);
+static struct frame *frame_take_dropped (void);
+static void frame_forget_dropped (struct frame *);
+static bool frame_wait_shared (struct frame *, struct inode *, off_t);
+static bool frame_was_accessed (struct frame *);
+static bool frame_prefer_clean (struct frame *, size_t scan_cnt);
+static bool frame_do_eviction (struct page *src, struct page *dst,
+                               struct list *copies);
+static void frame_write_victim (struct page *src, void *kpage,
+                                size_t hint, struct list *copies);
+static void frame_write_page (struct page *, void *kpage, size_t hint);
+
+/* Obtains a single free physical frame and returns a FTE
+   corresponding to the kernel virtual address identifying the
+   frame obtained from the user pool.
+   If too few pages are available, some frame is evicted.
+
+   Eviction is split into two phases.  Choosing and unmapping the
+   victim happens with TABLE_LOCK held, but writing the victim's
+   contents to swap does not: the victim FTE stays locked by the
+   current thread and its previous SPTE is marked in transit
+   until the write completes, so other page faults may proceed
+   meanwhile.  So are the dirty copy-on-write sharers of the
+   victim, which are written to slots of their own.
+
+   A process at its RSS limit evicts one of its own frames, if it
+   can, even while the user pool has free pages.  Once swap space
+   is exhausted, the process with the largest resident set is
+   killed, and its frames are evicted first, without being
+   written to swap.  See frame_oom_victim().  In PFF mode, the
+   victim is otherwise taken from a process that faults rarely,
+   if there is one.  See pff.c.
+   
+   P's FRAME member is also set to the returned FTE. */
+struct frame *
+frame_alloc (struct page *p)
+{
+  struct frame *f = NULL;
+  struct page *src;
+  struct thread *owner = p->owner;
+  struct list copies;
+  struct inode *stale = NULL;
+  size_t hint = BITMAP_ERROR;
+  void *kpage;
+
+  list_init (&copies);
+  lock_acquire (&table_lock);
+
+  if (owner->rss_limit > 0 && owner->rss >= owner->rss_limit)
+    f = frame_get_victim (owner, &stale);
+  if (f == NULL)
+    {
+      /* A retained frame is given up before any page that is
+         still mapped. */
+      kpage = palloc_get_page (PAL_USER);
+      if (kpage == NULL)
+        kpage = frame_reclaim (&stale);
+      if (kpage != NULL)
+        {
+          f = frame_make (p, kpage);
+          frame_update_pressure ();
+          lock_release (&table_lock);
+          if (stale != NULL)
+            inode_close (stale);
+          return f;
+        }
+
+      owner = frame_oom_victim ();
+      if (owner == NULL)
+        owner = pff_donor (p->owner);
+      if (owner != NULL)
+        f = frame_get_victim (owner, &stale);
+      if (f == NULL)
+        f = frame_get_victim (NULL, &stale);
+      frame_note_eviction ();
+      frame_update_pressure ();
+    }
+  src = f->page;
+  if (!frame_do_eviction (src, p, &copies))
+    {
+      /* Nothing to write back. */
+      lock_release (&table_lock);
+      inode_close (stale);
+      return f;
+    }
+
+  /* Group the swap slots of each process by user virtual
+     address, so that a process which streams through its pages
+     finds them in consecutive slots at swap-in time.  See
+     page_load(). */
+  owner = src->owner;
+  if (owner->swap_last_slot != BITMAP_ERROR
+      && owner->swap_last_upage + PGSIZE == src->upage)
+    hint = owner->swap_last_slot + 1;
+  lock_release (&table_lock);
+  inode_close (stale);
+
+  /* F is still locked, so nobody else can touch its contents
+     until page_load() fills it for P. */
+  frame_write_victim (src, f->kpage, hint, &copies);
+  return f;
+}
+
+/* Obtains a single free physical frame for P, as frame_alloc(),
+   but never evicts any frame: returns a null pointer if the user
+   pool is exhausted.  It is meant for speculative loads. */
+struct frame *
+frame_try_alloc (struct page *p)
+{
+  struct frame *f = NULL;
+  void *kpage;
+
+  lock_acquire (&table_lock);
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage != NULL)
+    f = frame_make (p, kpage);
+  lock_release (&table_lock);
+
+  return f;
+}
+
+/* Locks the FTE of physical frame KPAGE, links it with P and
+   adds it to the frame table. */
+static struct frame *
+frame_make (struct page *p, void *kpage)
+{
+  struct frame *f = &frames[palloc_page_no (kpage)];
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+  ASSERT (!f->in_table);
+
+  /* F is locked until it is released inside page_load().  A
+     thread that was waiting for F's previous page may hold its
+     lock for a moment, and takes TABLE_LOCK after it. */
+  if (!frame_lock_try_acquire (f))
+    {
+      lock_release (&table_lock);
+      frame_lock_acquire (f);
+      lock_acquire (&table_lock);
+    }
+
+  /* One-to-one correspondence. */
+  f->kpage = kpage;
+
+  /* Doubly linked. */
+  f->page = p;
+  f->page->frame = f;
+
+  list_init (&f->sharers);
+  f->inode = NULL;
+  f->dropped = false;
+  
+  frame_link (f);
+  return f;
+}
+
+/* Returns true if P's contents may be shared between all the
+   processes mapping the same page of the same file, that is, P
+   is a read-only page loaded from file or a page of a shared
+   file mapping.  The frames of the latter are the page cache of
+   their file: every mapping of the page maps the same frame, and
+   read() and write() go through it.  See frame_lock_file(). */
+static bool
+frame_shareable (const struct page *p)
+{
+  return p->type == PG_FILE && (p->writeback || !p->writable);
+}
+
+/* Looks up the share table for a frame already holding the
+   contents of P, which is not resident.  If one is found and can
+   be locked, P becomes one of its sharers and the frame is
+   returned, locked.  Otherwise returns a null pointer, and P
+   must be loaded into a frame of its own.
+
+   If no frame holds the contents of P but a retained frame
+   does, that frame is taken back into the frame table for P.
+
+   A page of a shared file mapping must never be loaded into a
+   second frame, whose changes the other mappings would not see,
+   so for such a P this waits for a frame that is locked, as
+   frame_lock_resident() does, rather than give up. */
+struct frame *
+frame_share (struct page *p)
+{
+  struct frame key, *f;
+  struct hash_elem *e;
+  struct inode *stale = NULL;
+
+  ASSERT (p->frame == NULL);
+
+  if (!frame_shareable (p))
+    return NULL;
+
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->file_ofs;
+
+  lock_acquire (&table_lock);
+  while ((e = hash_find (&share_table, &key.hash_elem)) != NULL)
+    {
+      f = hash_entry (e, struct frame, hash_elem);
+      if (f->page->read_bytes != p->read_bytes
+          || f->page->writeback != p->writeback)
+        break;
+      if (frame_lock_try_acquire (f))
+        goto attach;
+      if (!p->writeback || lock_held_by_current_thread (&f->lock))
+        break;
+      if (frame_wait_shared (f, key.inode, key.ofs))
+        goto attach;
+    }
+  f = e == NULL ? frame_reuse (p, &stale) : NULL;
+  lock_release (&table_lock);
+  if (stale != NULL)
+    inode_close (stale);
+  return f;
+
+ attach:
+  ASSERT (f->page->writeback == p->writeback);
+  list_push_back (&f->sharers, &p->share_elem);
+  p->frame = f;
+  lock_release (&table_lock);
+  return f;
+}
+
+/* Registers F, which must be locked by the current thread, in
+   the share table, if its page is shareable and no other frame
+   holds it.  Returns false, leaving F unregistered, if F's page
+   is a page of a shared file mapping that another frame holds
+   already, in which case F must not be used for it: the page must
+   be shared with frame_share() instead, which the other frame
+   allows.
+
+   This is done before F is filled, so that a process loading
+   the same page of a shared file mapping meanwhile waits for F.
+   F must then be freed if it cannot be filled. */
+bool
+frame_publish (struct frame *f)
+{
+  struct page *p = f->page;
+  struct hash_elem *e;
+  bool success = true;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (!frame_shareable (p))
+    return true;
+
+  lock_acquire (&table_lock);
+  f->inode = file_get_inode (p->file);
+  f->ofs = p->file_ofs;
+  e = hash_insert (&share_table, &f->hash_elem);
+  if (e == NULL)
+    inode_reopen (f->inode);
+  else
+    {
+      struct frame *other = hash_entry (e, struct frame, hash_elem);
+
+      f->inode = NULL;
+      success = !(p->writeback && other->page->writeback
+                  && other->page->read_bytes == p->read_bytes
+                  && !lock_held_by_current_thread (&other->lock));
+    }
+  lock_release (&table_lock);
+  return success;
+}
+
+/* Returns the frame that holds the page at page-aligned offset
+   OFS of INODE for a shared file mapping, locked, or a null
+   pointer if no frame does.  The caller must not hold any other
+   frame's lock, since this may wait for the frame. */
+struct frame *
+frame_lock_file (struct inode *inode, off_t ofs)
+{
+  struct frame key, *f;
+  struct hash_elem *e;
+
+  ASSERT (ofs % PGSIZE == 0);
+
+  key.inode = inode;
+  key.ofs = ofs;
+
+  lock_acquire (&table_lock);
+  while ((e = hash_find (&share_table, &key.hash_elem)) != NULL)
+    {
+      f = hash_entry (e, struct frame, hash_elem);
+      if (!f->page->writeback)
+        break;
+      if (frame_lock_try_acquire (f) || frame_wait_shared (f, inode, ofs))
+        {
+          lock_release (&table_lock);
+          return f;
+        }
+    }
+  lock_release (&table_lock);
+  return NULL;
+}
+
+/* Waits for F, a frame of a shared file mapping in the share
+   table that another thread has locked, and locks it.  TABLE_LOCK
+   must be held; it is released meanwhile.  Returns true if F
+   still holds the page at offset OFS of INODE, false otherwise,
+   in which case F is left unlocked and must not be used. */
+static bool
+frame_wait_shared (struct frame *f, struct inode *inode, off_t ofs)
+{
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  lock_release (&table_lock);
+  frame_lock_acquire (f);
+  lock_acquire (&table_lock);
+
+  /* Evicted or freed meanwhile, and maybe holding another page
+     for now. */
+  if (f->inode == inode && f->ofs == ofs && f->page->writeback)
+    return true;
+  frame_lock_release (f);
+  return false;
+}
+
+/* Marks F, which must be locked by the current thread, clean in
+   every page mapping it, before its contents are written to the
+   file of its shared file mapping, so that a write by any of them
+   meanwhile makes F dirty again. */
+void
+frame_mark_clean (struct frame *f)
+{
+  struct page *p = f->page;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  pagedir_set_dirty (p->owner->pagedir, p->upage, false);
+  p->dirty = false;
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    {
+      struct page *q = list_entry (e, struct page, share_elem);
+      pagedir_set_dirty (q->owner->pagedir, q->upage, false);
+      q->dirty = false;
+    }
+}
+
+/* Detaches P, which belongs to the current process, from F,
+   which must be locked by the current thread.  If nobody else
+   shares F, F is freed as by frame_free(), after saving its
+   contents to swap if P is a page of a shared memory segment,
+   whose lock the current thread must then hold, or retained if
+   it can be, as frame_retain() describes.  Otherwise P's mapping
+   is removed, so that pagedir_destroy() does not free the
+   physical frame, and F is unlocked. */
+void
+frame_detach (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (p->frame == f);
+  ASSERT (p->owner == process_current ());
+
+  if (list_empty (&f->sharers))
+    {
+      if (p->type == PG_SHM)
+        frame_save_shm (f);
+      if (!frame_retain (f, p))
+        frame_free (f);
+      return;
+    }
+
+  lock_acquire (&table_lock);
+  frame_drop_sharer (f, p);
+  lock_release (&table_lock);
+
+  frame_lock_release (f);
+}
+
+/* Removes P from the pages sharing F, which must have others,
+   and unmaps it. */
+static void
+frame_drop_sharer (struct frame *f, struct page *p)
+{
+  bool dirty = page_pte_is_dirty (p);
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+  ASSERT (!list_empty (&f->sharers));
+
+  /* P's writes to a shared memory segment must not be lost
+     along with its mapping. */
+  if (p->type == PG_SHM && dirty)
+    shm_page (p)->dirty = true;
+  page_pte_clear (p);
+  if (f->page == p)
+    {
+      f->page = list_entry (list_pop_front (&f->sharers),
+                            struct page, share_elem);
+      p->owner->rss--;
+      f->page->owner->rss++;
+    }
+  else
+    list_remove (&p->share_elem);
+  p->frame = NULL;
+
+  /* Nor its writes to a shared file mapping, which the pages
+     left write back. */
+  if (p->writeback && (dirty || p->dirty))
+    f->page->dirty = true;
+}
+
+/* Makes Q, a page of the current process, one more of the pages
+   sharing F, which must be locked by the current thread.  Used
+   by fork(), to share the parent's frames with the child. */
+void
+frame_add_sharer (struct frame *f, struct page *q)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (q->frame == NULL);
+
+  lock_acquire (&table_lock);
+  list_push_back (&f->sharers, &q->share_elem);
+  q->frame = f;
+  lock_release (&table_lock);
+}
+
+/* Gives P, a copy-on-write page of the current process mapping
+   F, which must be locked by the current thread, a frame of its
+   own, and returns that frame, locked.  If nobody else shares F
+   any more, that is F itself.  Otherwise P is unmapped, the
+   contents of F are copied to a new frame, and F is unlocked. */
+struct frame *
+frame_unshare (struct frame *f, struct page *p)
+{
+  struct frame *copy;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (p->frame == f);
+  ASSERT (p->owner == process_current ());
+
+  lock_acquire (&table_lock);
+  if (list_empty (&f->sharers))
+    {
+      lock_release (&table_lock);
+      return f;
+    }
+  frame_drop_sharer (f, p);
+  lock_release (&table_lock);
+
+  /* F stays locked, so it cannot be the victim here. */
+  copy = frame_alloc (p);
+  fpu_copy_page (copy->kpage, f->kpage);
+  frame_lock_release (f);
+  return copy;
+}
+
+/* Detaches P from F, as frame_detach(), and if that frees F,
+   also unmaps P and returns the physical frame to the user pool,
+   rather than leaving it to pagedir_destroy().  Used to give up
+   a page's memory while the process goes on running. */
+void
+frame_discard (struct frame *f, struct page *p)
+{
+  void *kpage = f->kpage;
+  bool last;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (p->type != PG_SHM);
+
+  lock_acquire (&table_lock);
+  last = list_empty (&f->sharers);
+  lock_release (&table_lock);
+
+  if (last)
+    {
+      frame_free (f);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      palloc_free_page (kpage);
+    }
+  else
+    frame_detach (f, p);
+}
+
+/* Suggests P, a page of the current process that a sequential
+   scan has gone past, as the next victim, ahead of whatever the
+   replacement policy would choose.  P's accessed bits are
+   cleared, so that P is still passed over if it is accessed
+   again before it is taken.  Shared frames are not suggested. */
+void
+frame_drop_behind (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&table_lock);
+  f = p->frame;
+  if (f != NULL && !f->dropped && f->page == p
+      && list_empty (&f->sharers) && frame_lock_try_acquire (f))
+    {
+      frame_was_accessed (f);
+      frame_lock_release (f);
+
+      if (drop_head - drop_tail == DROP_BEHIND_MAX)
+        {
+          struct frame *old = drop_ring[drop_tail++ % DROP_BEHIND_MAX];
+          if (old != NULL)
+            old->dropped = false;
+        }
+      drop_ring[drop_head++ % DROP_BEHIND_MAX] = f;
+      f->dropped = true;
+    }
+  lock_release (&table_lock);
+}
+
+/* Returns the page of its shared memory segment that P maps. */
+static struct shm_page *
+shm_page (const struct page *p)
+{
+  ASSERT (p->type == PG_SHM);
+  return &p->shm->pages[p->file_ofs / PGSIZE];
+}
+
+/* Makes P, a non-resident page of a shared memory segment mapped
+   by the current process, one of the pages sharing the frame
+   that holds the segment's page, and returns that frame, locked.
+   If no frame does, a frame is allocated for P and loaded from
+   the segment's swap slot, or zeroed, and *MAJOR is set to true
+   if I/O was needed.
+
+   The current thread must hold the segment's lock, so that no
+   two processes load the same page of it at once, and cannot
+   hold the lock of any frame. */
+struct frame *
+frame_share_shm (struct page *p, bool *major)
+{
+  struct shm_page *sp = shm_page (p);
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&p->shm->lock));
+  ASSERT (p->frame == NULL);
+
+  *major = false;
+  for (;;)
+    {
+      lock_acquire (&table_lock);
+      while (sp->in_transit)
+        cond_wait (&transit_done, &table_lock);
+      f = sp->frame;
+      lock_release (&table_lock);
+      if (f == NULL)
+        break;
+
+      /* F may have been evicted while we waited for it, as in
+         frame_lock_resident(). */
+      frame_lock_acquire (f);
+      if (sp->frame == f)
+        {
+          frame_add_sharer (f, p);
+          return f;
+        }
+      frame_lock_release (f);
+    }
+
+  /* Nobody else can load the page meanwhile, and eviction passes
+     over F while it is locked. */
+  f = frame_alloc (p);
+  if (sp->slot != BITMAP_ERROR)
+    {
+      swap_read (f->kpage, sp->slot);
+      *major = true;
+    }
+  else
+    fpu_zero_page (f->kpage);
+  sp->dirty = false;
+
+  lock_acquire (&table_lock);
+  sp->frame = f;
+  lock_release (&table_lock);
+  return f;
+}
+
+/* Writes the contents of F, which holds a page of a shared
+   memory segment but is no longer mapped by any process but its
+   PAGE, to the segment's swap slot if they changed, and takes F
+   away from the segment.  F must be locked by the current thread,
+   which must hold the segment's lock. */
+static void
+frame_save_shm (struct frame *f)
+{
+  struct page *p = f->page;
+  struct shm_page *sp = shm_page (p);
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (lock_held_by_current_thread (&p->shm->lock));
+
+  if (sp->dirty || pagedir_is_dirty (p->owner->pagedir, p->upage))
+    {
+      if (sp->slot != BITMAP_ERROR)
+        swap_free (sp->slot);
+      sp->slot = swap_out (f->kpage);
+      sp->dirty = false;
+    }
+
+  lock_acquire (&table_lock);
+  sp->frame = NULL;
+  lock_release (&table_lock);
+}
+
+/* Clears the accessed bits of all the pages mapping F and
+   returns true if any of them was set. */
+static bool
+frame_was_accessed (struct frame *f)
+{
+  bool accessed = page_was_accessed (f->page);
+  struct list_elem *e;
+
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    if (page_was_accessed (list_entry (e, struct page, share_elem)))
+      accessed = true;
+  return accessed;
+}
+
+/* Drops retained frame F from the retained table and list,
+   leaving its physical frame allocated.  Returns F's inode,
+   which the caller must close after releasing TABLE_LOCK. */
+static struct inode *
+frame_unretain (struct frame *f)
+{
+  struct inode *inode = f->inode;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+  ASSERT (f->retained);
+
+  hash_delete (&retain_table, &f->hash_elem);
+  list_remove (&f->retain_elem);
+  retain_cnt--;
+  f->retained = false;
+  f->inode = NULL;
+  return inode;
+}
+
+/* Retains F, which must be locked by the current thread, as its
+   last page P lets go of it, if P is a read-only page of a file
+   and F is in the share table, so that F holds P's contents in
+   full.  F then leaves the frame table, unlocked, but keeps its
+   physical frame, which P is unmapped from, and its place in the
+   share table passes on to the retained table.  Returns false,
+   doing nothing, if F cannot be retained.
+
+   A retained frame is mapped again by frame_share() if its page
+   is needed while the file has not been written, and reclaimed
+   by frame_alloc() before any frame in the frame table is
+   evicted.  No more than FRAME_RETAIN_MAX frames are retained,
+   and those of removed files are freed as others are retained,
+   so that they do not keep the files' sectors in use. */
+static bool
+frame_retain (struct frame *f, struct page *p)
+{
+  struct frame *stale[2];
+  struct inode *stale_inode[2];
+  struct hash_elem *e;
+  struct list_elem *le;
+  struct inode *inode;
+  size_t stale_cnt = 0, i;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  ASSERT (f->page == p && list_empty (&f->sharers));
+
+  if (frame_retain_max == 0 || p->type != PG_FILE || p->writable
+      || p->writeback || p->owner->pagedir == NULL)
+    return false;
+
+  lock_acquire (&table_lock);
+  inode = f->inode;
+  if (inode == NULL)
+    {
+      lock_release (&table_lock);
+      return false;
+    }
+  /* The share table's reference to the inode passes on to the
+     retained table. */
+  f->inode = frame_unlink (f);
+  p->frame = NULL;
+  f->version = inode_get_version (inode);
+  f->read_bytes = p->read_bytes;
+
+  /* An older copy of the same page is out of date. */
+  e = hash_find (&retain_table, &f->hash_elem);
+  if (e != NULL)
+    {
+      stale[stale_cnt] = hash_entry (e, struct frame, hash_elem);
+      stale_inode[stale_cnt] = frame_unretain (stale[stale_cnt]);
+      stale_cnt++;
+    }
+  hash_insert (&retain_table, &f->hash_elem);
+  list_push_back (&retain_list, &f->retain_elem);
+  f->retained = true;
+  retain_cnt++;
+  retain_total_cnt++;
+
+  /* Make room, dropping a removed file's frame first, if there is
+     one. */
+  for (le = list_begin (&retain_list); le != list_end (&retain_list);
+       le = list_next (le))
+    if (inode_is_removed (list_entry (le, struct frame,
+                                      retain_elem)->inode))
+      break;
+  if (le == list_end (&retain_list) && retain_cnt > frame_retain_max)
+    le = list_begin (&retain_list);
+  if (le != list_end (&retain_list))
+    {
+      stale[stale_cnt] = list_entry (le, struct frame, retain_elem);
+      stale_inode[stale_cnt] = frame_unretain (stale[stale_cnt]);
+      stale_cnt++;
+    }
+  lock_release (&table_lock);
+
+  pagedir_clear_page (p->owner->pagedir, p->upage);
+  if (stale_cnt > 0 && stale[stale_cnt - 1] == f)
+    {
+      /* F itself had to go. */
+      frame_lock_release (f);
+      palloc_free_page (f->kpage);
+      inode_close (stale_inode[--stale_cnt]);
+    }
+  else
+    frame_lock_release (f);
+  for (i = 0; i < stale_cnt; i++)
+    {
+      palloc_free_page (stale[i]->kpage);
+      inode_close (stale_inode[i]);
+    }
+  return true;
+}
+
+/* Takes retained frame holding the contents of P, which is not
+   resident, back into the frame table for P, and returns it,
+   locked, or returns a null pointer if no retained frame is
+   current for P.  An out-of-date frame is dropped, and its
+   physical frame freed.  The retained table's reference to the
+   inode passes on to the frame's share table entry, or, if it
+   gets none, is stored in *STALE, which the caller must close
+   after releasing TABLE_LOCK, which must be held. */
+static struct frame *
+frame_reuse (struct page *p, struct inode **stale)
+{
+  struct frame key, *f;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  if (p->writeback || p->writable)
+    return NULL;
+  key.inode = file_get_inode (p->file);
+  key.ofs = p->file_ofs;
+  e = hash_find (&retain_table, &key.hash_elem);
+  if (e == NULL)
+    return NULL;
+  f = hash_entry (e, struct frame, hash_elem);
+  *stale = frame_unretain (f);
+  if (f->version != inode_get_version (key.inode)
+      || f->read_bytes != p->read_bytes)
+    {
+      palloc_free_page (f->kpage);
+      return NULL;
+    }
+
+  f = frame_make (p, f->kpage);
+  f->inode = key.inode;
+  f->ofs = key.ofs;
+  if (hash_insert (&share_table, &f->hash_elem) == NULL)
+    *stale = NULL;
+  else
+    f->inode = NULL;
+  retain_reuse_cnt++;
+  return f;
+}
+
+/* Takes the least recently retained frame, if there is one, out
+   of the retained table, and returns its physical frame, for
+   reuse.  Its inode is stored in *STALE, which the caller must
+   close after releasing TABLE_LOCK, which must be held.  Returns
+   a null pointer if no frame is retained. */
+static void *
+frame_reclaim (struct inode **stale)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  if (list_empty (&retain_list))
+    return NULL;
+  f = list_entry (list_front (&retain_list), struct frame, retain_elem);
+  *stale = frame_unretain (f);
+  return f->kpage;
+}
+
+/* Hash function for the share table. */
+static unsigned
+share_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct frame *f = hash_entry (e, struct frame, hash_elem);
+  return hash_bytes (&f->inode, sizeof f->inode) ^ hash_int (f->ofs);
+}
+
+/* Comparison function for the share table. */
+static bool
+share_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct frame *a = hash_entry (a_, struct frame, hash_elem);
+  const struct frame *b = hash_entry (b_, struct frame, hash_elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
+
+/* Writes out KPAGE, the former contents of SRC, if SRC is in
+   transit, as frame_write_page() does, and then
+   the same contents once for each of the pages in COPIES, the
+   dirty copy-on-write sharers of the victim, linked by their
+   SHARE_ELEM members.  Called without TABLE_LOCK held. */
+static void
+frame_write_victim (struct page *src, void *kpage, size_t hint,
+                    struct list *copies)
+{
+  ASSERT (!lock_held_by_current_thread (&table_lock));
+
+  if (src->in_transit)
+    frame_write_page (src, kpage, hint);
+  while (!list_empty (copies))
+    frame_write_page (list_entry (list_pop_front (copies),
+                                  struct page, share_elem),
+                      kpage, BITMAP_ERROR);
+}
+
+/* Writes out KPAGE, the former contents of P which is in
+   transit, back to P's file if P is mmap'ed, otherwise to a swap
+   slot, preferably to slot HINT.  Then wakes up everyone waiting
+   for P's eviction. */
+static void
+frame_write_page (struct page *p, void *kpage, size_t hint)
+{
+  size_t slot;
+
+  ASSERT (p->in_transit);
+
+  if (p->type == PG_SHM)
+    {
+      /* The page of a shared memory segment goes to the slot of
+         the segment, for whichever process loads it next. */
+      struct shm_page *sp = shm_page (p);
+
+      if (sp->slot != BITMAP_ERROR)
+        swap_free (sp->slot);
+      slot = swap_out_near (kpage, hint);
+
+      lock_acquire (&table_lock);
+      sp->slot = slot;
+      sp->dirty = false;
+      sp->in_transit = p->in_transit = false;
+      cond_broadcast (&transit_done, &table_lock);
+      lock_release (&table_lock);
+      return;
+    }
+
+  if (p->writeback)
+    {
+      /* An mmap'ed page stays PG_FILE: its file is its backing
+         store, so swap is not used for it, and munmap() has
+         nothing left to write back unless it is dirtied again.
+         The other mappings of a shared frame are clean; they
+         only wait for the write from the page that was dirty. */
+      if (p->dirty)
+        {
+          file_write_at (p->file, kpage, p->read_bytes, p->file_ofs);
+          VMSTAT_ADD (file_writes, 1);
+        }
+
+      lock_acquire (&table_lock);
+      p->dirty = false;
+      p->in_transit = false;
+      cond_broadcast (&transit_done, &table_lock);
+      lock_release (&table_lock);
+      return;
+    }
+
+  /* A copy left in swap slot by the page cleaner is stale,
+     because P has been dirtied since. */
+  if (p->slot != BITMAP_ERROR)
+    swap_free (p->slot);
+  slot = (p->owner->oom_killed
+          ? BITMAP_ERROR : swap_try_out (kpage, hint));
+
+  lock_acquire (&table_lock);
+  if (slot != BITMAP_ERROR)
+    {
+      p->owner->swap_last_upage = p->upage;
+      p->owner->swap_last_slot = slot;
+      p->type = PG_SWAP;
+    }
+  else
+    {
+      /* Out of swap space: P's contents are lost, so its owner
+         must not run on without them. */
+      frame_oom_kill (p->owner);
+      p->type = PG_ZERO;
+    }
+  p->slot = slot;
+  p->in_transit = false;
+  cond_broadcast (&transit_done, &table_lock);
+  lock_release (&table_lock);
+}
+
+/* Waits until the swap-out I/O of P, if being processed, 
+   completes.  After this function returns, P's TYPE and SLOT
+   members describe valid contents. */
+void
+frame_wait_eviction (struct page *p)
+{
+  ASSERT (p != NULL);
+
+  lock_acquire (&table_lock);
+  while (p->in_transit)
+    cond_wait (&transit_done, &table_lock);
+  lock_release (&table_lock);
+}
+
+/* Frees the swap slots kept by resident pages, that is, the
+   swap cache, and returns the number of slots freed.  Each such
+   page becomes dirty, because its only copy is now in memory.
+   Frames locked by any thread are left alone.  Called without
+   TABLE_LOCK held, when swap space runs out. */
+size_t
+frame_reclaim_swap (void)
+{
+  size_t cnt = 0, i;
+
+  lock_acquire (&table_lock);
+  for (i = 0; i < frame_total; i++)
+    {
+      struct frame *f = &frames[i];
+      struct page *p = f->page;
+
+      if (!f->in_table || p->slot == BITMAP_ERROR
+          || !frame_lock_try_acquire (f))
+        continue;
+      if (p->slot != BITMAP_ERROR)
+        {
+          swap_free (p->slot);
+          p->slot = BITMAP_ERROR;
+          p->dirty = true;
+          cnt++;
+        }
+      frame_lock_release (f);
+    }
+  lock_release (&table_lock);
+
+  return cnt;
+}
+
+/* Returns the process whose frames should be evicted first
+   because swap space is exhausted, or a null pointer if swap
+   space is left, counting the slots that frame_reclaim_swap()
+   can free.  That is a process already killed for lack of swap
+   that still holds frames, or else the process with the largest
+   resident set, which is killed: it will exit at its next page
+   fault or system call, and the pages it loses meanwhile are
+   just discarded.  See frame_write_page(). */
+static struct thread *
+frame_oom_victim (void)
+{
+  struct thread *victim = NULL;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  if (swap_free_cnt () > 0)
+    return NULL;
+  for (i = 0; i < frame_total; i++)
+    {
+      struct frame *f = &frames[i];
+      struct thread *t;
+
+      if (!f->in_table)
+        continue;
+      if (f->page->slot != BITMAP_ERROR)
+        return NULL;
+      t = f->page->owner;
+      if (victim == NULL || (t->oom_killed && !victim->oom_killed)
+          || (t->oom_killed == victim->oom_killed && t->rss > victim->rss))
+        victim = t;
+    }
+  if (victim != NULL)
+    frame_oom_kill (victim);
+  return victim;
+}
+
+/* Marks process T killed for lack of swap space, if it is not
+   already. */
+static void
+frame_oom_kill (struct thread *t)
+{
+  if (!t->oom_killed)
+    {
+      t->oom_killed = true;
+      printf ("%s: out of swap space, killed.\n", t->name);
+    }
+}
+
+/* Circularly advances the hand *H, an index into FRAMES, to the
+   next FTE in the frame table and returns that FTE.  The frame
+   table must not be empty. */
+static struct frame *
+frame_advance (size_t *h)
+{
+  ASSERT (frame_cnt > 0);
+
+  do
+    if (++*h >= frame_total)
+      *h = 0;
+  while (!frames[*h].in_table);
+  return &frames[*h];
+}
+
+/* Adds F, whose PAGE is set to the page it is about to hold, to
+   the frame table. */
+static void
+frame_link (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  f->in_table = true;
+  frame_cnt++;
+  f->page->owner->rss++;
+  policy->insert (f);
+}
+
+/* Removes F from the frame table.  Returns the inode of F's
+   share table entry, if it had one, whose reference the caller
+   must close after releasing TABLE_LOCK, or a null pointer. */
+static struct inode *
+frame_unlink (struct frame *f)
+{
+  struct inode *inode = f->inode;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  policy->remove (f);
+  f->in_table = false;
+  frame_cnt--;
+  f->page->owner->rss--;
+  if (f->dropped)
+    frame_forget_dropped (f);
+  if (inode != NULL)
+    {
+      hash_delete (&share_table, &f->hash_elem);
+      f->inode = NULL;
+    }
+  return inode;
+}
+
+/* Selects a victim physical frame using the current replacement
+   policy, removes it from the frame table and returns the
+   corresponding FTE, locked.  If T is not a null pointer, the
+   victim is rather one of T's own frames, and a null pointer is
+   returned if T has none that can be evicted.  The inode that
+   frame_unlink() returns for the victim, if any, is stored in
+   *STALE, which the caller must close after releasing
+   TABLE_LOCK. */
+static struct frame *
+frame_get_victim (struct thread *t, struct inode **stale)
+{
+  struct frame *f;
+  size_t scan_cnt = 0;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+  ASSERT (frame_cnt > 0);
+
+  if (t != NULL)
+    {
+      f = frame_local_victim (t, &scan_cnt);
+      if (f == NULL)
+        return NULL;
+    }
+  else if ((f = frame_take_dropped ()) != NULL)
+    scan_cnt = 1;
+  else
+    f = policy->victim (&scan_cnt);
+  ASSERT (f->page != NULL);
+  *stale = frame_unlink (f);
+
+  victim_cnt++;
+  victim_scan_cnt += scan_cnt;
+  VMSTAT_ADD (evictions, 1);
+  VMSTAT_ADD (scan_steps, scan_cnt);
+  if (scan_cnt > victim_scan_max)
+    victim_scan_max = scan_cnt;
+  return f;
+}
+
+/* Selects a victim among the frames of T, locks it and returns
+   it, adding the number of frames examined to *SCAN_CNT, or
+   returns a null pointer if there is none.  Like the clock, the
+   scan passes over frames accessed since it last went by during
+   its first revolution, but not its second.  Shared frames are
+   never taken, since evicting them affects other processes. */
+static struct frame *
+frame_local_victim (struct thread *t, size_t *scan_cnt)
+{
+  static size_t local_hand;
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct frame *f = frame_advance (&local_hand);
+
+      ++*scan_cnt;
+      if (f->page->owner != t || f->page->type == PG_SHM
+          || !list_empty (&f->sharers) || !frame_lock_try_acquire (f))
+        continue;
+      if (i >= frame_cnt || !frame_was_accessed (f))
+        return f;
+      frame_lock_release (f);
+    }
+  return NULL;
+}
+
+/* Takes the most recently added drop-behind candidate that has
+   not been accessed since it was added and is not shared, locks
+   it and returns it.  Candidates passed over are forgotten.
+   Returns a null pointer if there is none. */
+static struct frame *
+frame_take_dropped (void)
+{
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  while (drop_head != drop_tail)
+    {
+      struct frame *f = drop_ring[--drop_head % DROP_BEHIND_MAX];
+
+      if (f == NULL)
+        continue;
+      f->dropped = false;
+      if (!list_empty (&f->sharers) || !frame_lock_try_acquire (f))
+        continue;
+      if (!frame_was_accessed (f))
+        {
+          f->page->test_epoch = 0;
+          drop_cnt++;
+          return f;
+        }
+      frame_lock_release (f);
+    }
+  return NULL;
+}
+
+/* Forgets F, which is leaving the frame table, as a drop-behind
+   candidate. */
+static void
+frame_forget_dropped (struct frame *f)
+{
+  unsigned i;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  for (i = drop_tail; i != drop_head; i++)
+    if (drop_ring[i % DROP_BEHIND_MAX] == f)
+      drop_ring[i % DROP_BEHIND_MAX] = NULL;
+  f->dropped = false;
+}
+
+/* Returns true if victim candidate F should be passed over
+   because it is dirty, while it is the SCAN_CNT'th frame
+   examined by the current victim scan.  Evicting a clean frame
+   is just an unmap, so during the first revolution only clean
+   frames, i.e. unmodified code and file data or pages whose swap
+   copy is still valid, are taken. */
+static bool
+frame_prefer_clean (struct frame *f, size_t scan_cnt)
+{
+  return scan_cnt <= frame_cnt && frame_is_dirty (f);
+}
+
+/* Memory pressure.
+
+   The level rises to PRESSURE_LOW once fewer than FRAME_FREE_LOW
+   frames are free, counting retained frames, to PRESSURE_MEDIUM
+   once frames are being evicted to make room for others, and to
+   PRESSURE_CRITICAL once a large part of memory is evicted every
+   second, that is, the system is close to thrashing.  Evictions
+   of a process at its RSS limit do not count: they are the
+   process's own business.  A process that learns of the pressure
+   can shed its caches with madvise(MADV_DONTNEED), so that they
+   are not written to swap. */
+
+/* Counts an eviction from the frame table as a whole towards
+   the memory pressure.  TABLE_LOCK must be held. */
+static void
+frame_note_eviction (void)
+{
+  int64_t epoch = timer_ticks () / PRESSURE_SLOT_TICKS;
+  size_t i = epoch % PRESSURE_SLOTS;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  if (evict_epochs[i] != epoch)
+    {
+      evict_epochs[i] = epoch;
+      evict_slots[i] = 0;
+    }
+  evict_slots[i]++;
+}
+
+/* Returns the current memory pressure level.  TABLE_LOCK must be
+   held. */
+static enum frame_pressure
+frame_pressure_level (void)
+{
+  int64_t epoch = timer_ticks () / PRESSURE_SLOT_TICKS;
+  size_t evict_cnt = 0;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  for (i = 0; i < PRESSURE_SLOTS; i++)
+    if (evict_epochs[i] > epoch - PRESSURE_SLOTS)
+      evict_cnt += evict_slots[i];
+  if (evict_cnt > 0 && evict_cnt >= frame_cnt / PRESSURE_CRITICAL_DIV)
+    return PRESSURE_CRITICAL;
+  else if (evict_cnt > 0)
+    return PRESSURE_MEDIUM;
+  else if (palloc_free_cnt (PAL_USER) + retain_cnt < frame_free_low)
+    return PRESSURE_LOW;
+  else
+    return PRESSURE_NONE;
+}
+
+/* Computes the memory pressure level again, and wakes up the
+   threads waiting in frame_pressure_wait() if it has risen since
+   it was last computed.  TABLE_LOCK must be held. */
+static void
+frame_update_pressure (void)
+{
+  enum frame_pressure level = frame_pressure_level ();
+
+  if (level > pressure)
+    {
+      pressure_rise_cnt[level]++;
+      poll_wake (&pressure_queue);
+    }
+  pressure = level;
+}
+
+/* Waits until the memory pressure level is at least LEVEL, or for
+   up to TIMEOUT timer ticks, or as long as it takes if TIMEOUT is
+   negative: a TIMEOUT of 0 only checks.  Returns the level last
+   found, which is below LEVEL only on a timeout. */
+enum frame_pressure
+frame_pressure_wait (enum frame_pressure level, int64_t timeout)
+{
+  struct poller poller;
+  struct poll_waiter w;
+  enum frame_pressure cur;
+
+  poller_init (&poller, timeout);
+  w.queue = NULL;
+  for (;;)
+    {
+      /* Join the queue before looking, so that a rise in the
+         meantime is not missed. */
+      lock_acquire (&table_lock);
+      poll_queue_remove (&w);
+      poll_queue_add (&pressure_queue, &w, &poller);
+      cur = pressure = frame_pressure_level ();
+      lock_release (&table_lock);
+
+      if (cur >= level || !poller_wait (&poller))
+        break;
+    }
+  poll_queue_remove (&w);
+  poller_done (&poller);
+  return cur;
+}
+
+/* Prints page replacement statistics. */
+void
+frame_print_stats (void)
+{
+  printf ("Frames: %s replacement, %lld victims, %lld frames scanned, "
+          "longest scan %zu, %lld dropped behind\n",
+          policy->name, victim_cnt, victim_scan_cnt, victim_scan_max,
+          drop_cnt);
+  if (frame_merge_pages > 0)
+    printf ("Frames: same-page merging, %lld frames scanned, "
+            "%lld pages merged\n", merge_scan_cnt, merge_cnt);
+  printf ("Frames: %lld blocks compacted, %lld compactions failed, "
+          "%lld frames migrated\n",
+          compact_cnt, compact_fail_cnt, migrate_cnt);
+  printf ("Frames: %lld frames retained, %lld mapped again, %zu now\n",
+          retain_total_cnt, retain_reuse_cnt, retain_cnt);
+  printf ("Frames: memory pressure rose to low %lld times, "
+          "to medium %lld, to critical %lld\n",
+          pressure_rise_cnt[PRESSURE_LOW], pressure_rise_cnt[PRESSURE_MEDIUM],
+          pressure_rise_cnt[PRESSURE_CRITICAL]);
+}
+
+/* One-handed clock.
+
+   HAND sweeps around the frame table, clearing accessed bits,
+   and evicts the first frame found not accessed since the last
+   sweep.  Frames locked by someone else are skipped. */
+
+static void
+clock_insert (struct frame *f UNUSED)
+{
+}
+
+static void
+clock_remove (struct frame *f UNUSED)
+{
+}
+
+static struct frame *
+clock_victim (size_t *scan_cnt)
+{
+  for (;;)
+    {
+      struct frame *f = frame_advance (&hand);
+
+      ++*scan_cnt;
+      if (!frame_lock_try_acquire (f))
+        continue;
+      if (!frame_was_accessed (f)
+          && !frame_prefer_clean (f, *scan_cnt))
+        return f;
+      frame_lock_release (f);
+    }
+}
+
+/* Two-handed clock.
+
+   The front hand runs FRAME_HAND_SPREAD frames ahead of HAND,
+   the back hand, clearing accessed bits; the back hand evicts
+   the first frame that has not been accessed since the front
+   hand passed it.  A narrow spread evicts pages that are not
+   reused soon, without waiting a whole revolution. */
+
+/* Front hand, or SIZE_MAX until it is first set. */
+static size_t front_hand = SIZE_MAX;
+
+static struct frame *
+clock2_victim (size_t *scan_cnt)
+{
+  if (front_hand == SIZE_MAX)
+    {
+      size_t i;
+
+      front_hand = hand;
+      for (i = 0; i < frame_hand_spread; i++)
+        frame_advance (&front_hand);
+    }
+
+  for (;;)
+    {
+      struct frame *f = frame_advance (&front_hand);
+      if (frame_lock_try_acquire (f))
+        {
+          frame_was_accessed (f);
+          frame_lock_release (f);
+        }
+
+      f = frame_advance (&hand);
+      ++*scan_cnt;
+      if (!frame_lock_try_acquire (f))
+        continue;
+      if (!frame_was_accessed (f)
+          && !frame_prefer_clean (f, *scan_cnt))
+        return f;
+      frame_lock_release (f);
+    }
+}
+
+/* CLOCK-Pro.
+
+   Resident frames are either hot or cold.  A cold frame starts
+   a test period when it is loaded or accessed; a cold frame
+   accessed again during its test period becomes hot.  HAND, the
+   cold hand, evicts only unaccessed cold frames.  The hot hand
+   turns unaccessed hot frames cold, and ends the test periods
+   of the cold frames it passes.
+
+   A page evicted during its test period remains in test as a
+   non-resident page: if it faults back in before the hot hand
+   has made a full revolution, it comes back hot, and the target
+   number of cold frames grows, since cold frames were too few to
+   keep it.  A test period that ends without reuse shrinks the
+   target instead. */
+
+/* Hot hand. */
+static size_t hot_hand;
+
+/* Number of resident frames, of those that are hot, and target
+   number of cold frames. */
+static size_t resident_cnt;
+static size_t hot_cnt;
+static size_t cold_target = 16;
+
+/* Incremented whenever the hot hand completes a revolution.
+   Starts at 1, since a TEST_EPOCH of 0 in struct page means "not
+   in test". */
+static unsigned clockpro_epoch = 1;
+
+/* Returns the maximum number of hot frames. */
+static size_t
+clockpro_hot_limit (void)
+{
+  if (cold_target >= resident_cnt)
+    cold_target = resident_cnt > 1 ? resident_cnt - 1 : 1;
+  return resident_cnt - cold_target;
+}
+
+/* Moves the hot hand until the number of hot frames is within
+   the limit, at most one revolution. */
+static void
+clockpro_run_hot_hand (void)
+{
+  size_t i;
+
+  for (i = 0; i < resident_cnt && hot_cnt > clockpro_hot_limit (); i++)
+    {
+      size_t last = hot_hand;
+      struct frame *f = frame_advance (&hot_hand);
+
+      if (hot_hand <= last)
+        clockpro_epoch++;
+
+      if (f->hot)
+        {
+          if (!frame_lock_try_acquire (f))
+            continue;
+          if (!frame_was_accessed (f))
+            {
+              f->hot = false;
+              f->test = false;
+              hot_cnt--;
+            }
+          frame_lock_release (f);
+        }
+      else if (f->test)
+        {
+          f->test = false;
+          if (cold_target > 1)
+            cold_target--;
+        }
+    }
+}
+
+static void
+clockpro_insert (struct frame *f)
+{
+  struct page *p = f->page;
+
+  resident_cnt++;
+  if (p->test_epoch != 0 && clockpro_epoch <= p->test_epoch + 1)
+    {
+      /* Faulted back in during its test period. */
+      f->hot = true;
+      f->test = false;
+      hot_cnt++;
+      cold_target++;
+    }
+  else
+    {
+      f->hot = false;
+      f->test = true;
+    }
+  p->test_epoch = 0;
+
+  clockpro_run_hot_hand ();
+}
+
+static void
+clockpro_remove (struct frame *f)
+{
+  resident_cnt--;
+  if (f->hot)
+    hot_cnt--;
+}
+
+static struct frame *
+clockpro_victim (size_t *scan_cnt)
+{
+  for (;;)
+    {
+      struct frame *f = frame_advance (&hand);
+
+      ++*scan_cnt;
+
+      /* Every frame is hot: make room for cold ones. */
+      if (*scan_cnt % resident_cnt == 0 && hot_cnt > 0)
+        {
+          cold_target++;
+          clockpro_run_hot_hand ();
+        }
+
+      if (f->hot || !frame_lock_try_acquire (f))
+        continue;
+      if (!frame_was_accessed (f))
+        {
+          if (frame_prefer_clean (f, *scan_cnt))
+            {
+              frame_lock_release (f);
+              continue;
+            }
+
+          /* Remember the test period beyond eviction. */
+          f->page->test_epoch = f->test ? clockpro_epoch : 0;
+          return f;
+        }
+
+      if (f->test)
+        {
+          f->hot = true;
+          f->test = false;
+          hot_cnt++;
+          frame_lock_release (f);
+          clockpro_run_hot_hand ();
+        }
+      else
+        {
+          f->test = true;
+          frame_lock_release (f);
+        }
+    }
+}
+
+
+/* Performs the critical section of frame eviction.
+   Deprives SRC of its FTE and pyhsical frame, and gives them
+   to DST.
+   The SPTE SRC must have FTE and physical frame allocated to
+   it, and the FTE and SRC must point to each other.
+   DST must not have FTE and physical frame allocated to it.
+
+   The sharers of the frame whose contents cannot be reloaded,
+   that is, its dirty copy-on-write sharers, are marked in
+   transit and added to COPIES.
+
+   Returns true if the previous contents of the frame must be
+   written out by the caller, in which case SRC, or some
+   page in COPIES, is left marked in transit. */
+static bool
+frame_do_eviction (struct page *src, struct page *dst,
+                   struct list *copies)
+{
+  ASSERT (src != NULL);
+  ASSERT (src->frame != NULL);
+  ASSERT (src->frame->page == src);
+
+  ASSERT (dst != NULL);
+  ASSERT (dst->frame == NULL);
+  ASSERT (dst->owner == process_current ());
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  TRACE (TRACE_VM, TRACE_EVICT, src->upage, src->owner->tid);
+  struct frame *f = src->frame;
+
+  /* Check if the contents of the page to which the victim FTE
+     was allocated has been changed.  Then, remove the
+     corresponding virtual mapping.
+     
+     If the contents has been changed at least once, it should
+     be backed up to swap slot whenever future eviction occurs. */
+  page_pte_clear (src);
+  src->dirty |= page_pte_is_dirty (src);
+
+  /* A speculatively loaded page evicted before any access. */
+  if (src->prefetched)
+    page_prefetch_feedback (src, false);
+
+  /* The previous contents will be saved to the swap slot, or to
+     the file of an mmap'ed page, and supplemental information for
+     later page fault handling will be re-initialized, once the
+     write completes.  Until then, SRC is in transit. */
+  src->in_transit = src->dirty;
+  src->cow = false;
+  
+  /* A page of a shared memory segment is written, once, to the
+     segment's swap slot if any process mapping it has changed
+     it.  Until then, the segment's page is in transit as well. */
+  if (src->type == PG_SHM)
+    {
+      struct shm_page *sp = shm_page (src);
+      bool dirty = sp->dirty || src->dirty;
+
+      while (!list_empty (&f->sharers))
+        {
+          struct page *q = list_entry (list_pop_front (&f->sharers),
+                                       struct page, share_elem);
+          page_pte_clear (q);
+          dirty |= page_pte_is_dirty (q);
+          q->frame = NULL;
+        }
+      sp->frame = NULL;
+      sp->dirty = dirty;
+      sp->in_transit = src->in_transit = dirty;
+      src->dirty = false;
+    }
+
+  /* A page of a shared file mapping is written back, once, from
+     SRC, if any process mapping it has changed it.  Until then,
+     the other mappings are in transit as well, so that none of
+     them reads the page back from the file too early. */
+  if (src->writeback)
+    {
+      struct list_elem *e;
+      bool dirty = src->dirty;
+
+      for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+           e = list_next (e))
+        {
+          struct page *q = list_entry (e, struct page, share_elem);
+          page_pte_clear (q);
+          dirty |= q->dirty || page_pte_is_dirty (q);
+        }
+      while (!list_empty (&f->sharers))
+        {
+          struct page *q = list_entry (list_pop_front (&f->sharers),
+                                       struct page, share_elem);
+          q->frame = NULL;
+          q->dirty = false;
+          q->in_transit = dirty;
+          if (dirty)
+            list_push_back (copies, &q->share_elem);
+        }
+      src->dirty = src->in_transit = dirty;
+    }
+
+  /* A shared frame is taken away from every sharer.  The pages
+     of a shared executable are read-only, so nothing needs to be
+     written back for them, but each dirty copy-on-write sharer
+     needs a copy in swap of its own. */
+  while (!list_empty (&f->sharers))
+    {
+      struct page *q = list_entry (list_pop_front (&f->sharers),
+                                   struct page, share_elem);
+      page_pte_clear (q);
+      q->frame = NULL;
+      q->cow = false;
+      if (q->dirty)
+        {
+          q->in_transit = true;
+          list_push_back (copies, &q->share_elem);
+        }
+    }
+
+  /* Transfer the victim frame (doubly linked). */
+  f->page = dst;
+  f->page->frame = f;
+
+  /* Remove the frame from SRC. */
+  src->frame = NULL;
+
+  frame_link (f);
+  return src->in_transit || !list_empty (copies);
+}
+
+/* Removes a frame table entry F from the table.
+   Importantly, this function does not free the actual
+   physical frame corresponding to F, because this frame will
+   be deallocated by pagedir_destroy() when a process exits. */
+void
+frame_free (struct frame *f)
+{
+  struct inode *inode;
+
+  ASSERT (f != NULL);
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  lock_acquire (&table_lock);
+  inode = frame_unlink (f);
+  f->page->frame = NULL;
+  frame_lock_release (f);
+  lock_release (&table_lock);
+  inode_close (inode);
+}
+
+/* Returns true if the contents of F must be written back
+   before F can be evicted without I/O. */
+bool
+frame_is_dirty (struct frame *f)
+{
+  struct page *p = f->page;
+  struct list_elem *e;
 
-/* An iterator pointing to the last examined FTE in the
-   frame table. */
-static struct list_elem *hand;
+  if (p->dirty || page_pte_is_dirty (p))
+    return true;
+  if (p->type == PG_SHM && shm_page (p)->dirty)
+    return true;
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    {
+      struct page *q = list_entry (e, struct page, share_elem);
+      if (q->dirty || page_pte_is_dirty (q))
+        return true;
+    }
+  return false;
+}
 
-/* Initializes the frame allocatior.
-   All allocated frames are stored in the FRAME_LIST and
-   managed globally. */
-void
-frame_init (void)
+/* Writes back the contents of F, which must be locked by the
+   current thread, so that F becomes clean.  The contents of an
+   mmap'ed page go back to its file; any other page goes to a
+   swap slot, once for each dirty copy-on-write sharer as well.
+   Called without TABLE_LOCK held. */
+static void
+frame_clean (struct frame *f)
 {
-  lock_init (&table_lock);
-  list_init (&frame_list);
-  hand = NULL;
+  struct page *p = f->page;
+  size_t old_slot = p->slot;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (p->type == PG_SHM)
+    {
+      frame_clean_shm (f);
+      return;
+    }
+
+  /* The sharers are mapped read-only, so they stay clean. */
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    {
+      struct page *q = list_entry (e, struct page, share_elem);
+      size_t slot;
+
+      if (q->dirty
+          && (slot = swap_try_out (f->kpage, BITMAP_ERROR)) != BITMAP_ERROR)
+        {
+          if (q->slot != BITMAP_ERROR)
+            swap_free (q->slot);
+          q->slot = slot;
+          q->type = PG_SWAP;
+          q->dirty = false;
+        }
+    }
+
+  /* Clear the dirty bit before writing, so that a write access
+     by the owner during the write-back makes F dirty again. */
+  pagedir_set_dirty (p->owner->pagedir, p->upage, false);
+
+  if (p->writeback)
+    {
+      frame_mark_clean (f);
+      file_write_at (p->file, f->kpage, p->read_bytes, p->file_ofs);
+      VMSTAT_ADD (file_writes, 1);
+      p->slot = BITMAP_ERROR;
+      p->type = PG_FILE;
+    }
+  else
+    {
+      size_t slot = swap_try_out (f->kpage, BITMAP_ERROR);
+
+      if (slot == BITMAP_ERROR)
+        {
+          /* Out of swap space: F stays dirty until it is
+             evicted. */
+          p->dirty = true;
+          return;
+        }
+      p->slot = slot;
+      p->type = PG_SWAP;
+    }
+  p->dirty = false;
+
+  /* Any previous copy in swap slot is stale. */
+  if (old_slot != BITMAP_ERROR)
+    swap_free (old_slot);
 }
 
-static struct frame *frame_advance_hand (void);
-static struct frame *frame_get_victim (void);
-static void frame_do_eviction (struct page *src, struct page *dst);
+/* Writes back the contents of F, which must be locked by the
+   current thread and hold a page of a shared memory segment, to
+   the segment's swap slot, as frame_clean() does. */
+static void
+frame_clean_shm (struct frame *f)
+{
+  struct shm_page *sp = shm_page (f->page);
+  size_t old_slot = sp->slot;
+  struct list_elem *e;
+
+  /* Every sharer may write F, so each one's dirty bit is cleared
+     before writing, as for F's PAGE. */
+  pagedir_set_dirty (f->page->owner->pagedir, f->page->upage, false);
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    {
+      struct page *q = list_entry (e, struct page, share_elem);
+      pagedir_set_dirty (q->owner->pagedir, q->upage, false);
+    }
+  sp->dirty = false;
 
-/* Obtains a single free physical frame and returns a FTE
-   corresponding to the kernel virtual address identifying the
-   frame obtained from the user pool.
-   If too few pages are available, some frame is evicted.
-   
-   P's FRAME member is also set to the returned FTE. */
-struct frame *
-frame_alloc (struct page *p)
+  sp->slot = swap_out (f->kpage);
+  if (old_slot != BITMAP_ERROR)
+    swap_free (old_slot);
+}
+
+/* Scans the frame table once, starting at the clock hand, and
+   cleans dirty frames until FRAME_CLEAN_HIGH frames are clean.
+   The scan is skipped unless both the user pool and the clean
+   frames are running low. */
+static void
+frame_clean_pass (void)
 {
-  struct frame *f;
-  void *kpage;
+  size_t clean_cnt = 0, scan_cnt, h, i;
+
+  if (palloc_free_cnt (PAL_USER) + retain_cnt >= frame_free_low)
+    return;
 
   lock_acquire (&table_lock);
+  scan_cnt = frame_cnt;
+  for (i = 0; i < frame_total; i++)
+    if (frames[i].in_table && !frame_is_dirty (&frames[i]))
+      clean_cnt++;
+  if (clean_cnt >= frame_clean_low || scan_cnt == 0)
+    {
+      lock_release (&table_lock);
+      return;
+    }
 
-  kpage = palloc_get_page (PAL_USER);
-  if (kpage != NULL)
+  h = hand;
+  for (i = 0; i < scan_cnt && clean_cnt < frame_clean_high; i++)
     {
-      f = malloc (sizeof (struct frame));
-      if (f == NULL)
-        PANIC ("cannot allocate a frame table entry.");
+      struct frame *f = frame_advance (&h);
 
-      /* F is locked until it is released inside
-         page_load(). */
-      lock_init (&f->lock);
-      frame_lock_acquire (f);
+      if (!frame_is_dirty (f) || !frame_lock_try_acquire (f))
+        continue;
 
-      /* One-to-one correspondence. */
-      f->kpage = kpage;
+      /* While F is locked, it can be neither evicted nor freed. */
+      lock_release (&table_lock);
+      frame_clean (f);
+      lock_acquire (&table_lock);
 
-      /* Doubly linked. */
-      f->page = p;
-      f->page->frame = f;
-      
-      list_push_back (&frame_list, &f->list_elem);
+      frame_lock_release (f);
+      clean_cnt++;
     }
-  else
+  lock_release (&table_lock);
+}
+
+/* Page cleaner thread.  Periodically wakes up and writes dirty
+   frames back, so that later evictions become a cheap unmap
+   instead of a synchronous write on the faulting thread. */
+static void
+frame_cleaner (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (CLEANER_PERIOD);
+      frame_clean_pass ();
+    }
+}
+
+/* Returns true if frame A should be written before frame B,
+   that is, if A's page comes first in file order. */
+static bool
+flush_less (const struct frame *a, const struct frame *b)
+{
+  struct inode *ai = file_get_inode (a->page->file);
+  struct inode *bi = file_get_inode (b->page->file);
+
+  if (ai != bi)
+    return ai < bi;
+  return a->page->file_ofs < b->page->file_ofs;
+}
+
+/* Writes the CNT frames in BATCH, which hold dirty mmap'ed pages
+   and are locked by the current thread, back to their files,
+   through BUF, a buffer of FLUSH_BATCH pages.  Pages that lie
+   consecutively in the same file are copied together into BUF
+   and written with a single write, so that the file system sees
+   one large request for each run.  The frames stay locked.
+   Called without TABLE_LOCK held. */
+static void
+frame_flush_batch (struct frame **batch, size_t cnt, uint8_t *buf)
+{
+  size_t i, j;
+
+  ASSERT (cnt <= FLUSH_BATCH);
+
+  /* Sort by insertion, since BATCH is small. */
+  for (i = 1; i < cnt; i++)
+    for (j = i; j > 0 && flush_less (batch[j], batch[j - 1]); j--)
+      {
+        struct frame *t = batch[j];
+        batch[j] = batch[j - 1];
+        batch[j - 1] = t;
+      }
+
+  for (i = 0; i < cnt; i = j)
     {
-      f = frame_get_victim ();
-      frame_do_eviction (f->page, p);
+      struct page *first = batch[i]->page;
+      off_t size = 0;
+
+      for (j = i; j < cnt; j++)
+        {
+          struct page *p = batch[j]->page;
+
+          if (j > i
+              && (file_get_inode (p->file) != file_get_inode (first->file)
+                  || p->file_ofs != first->file_ofs + size
+                  || size % PGSIZE != 0))
+            break;
+
+          /* Clear the dirty bits before copying, so that a write
+             by a process mapping the page meanwhile makes it dirty
+             again. */
+          frame_mark_clean (batch[j]);
+          memcpy (buf + (j - i) * PGSIZE, batch[j]->kpage, p->read_bytes);
+          size += p->read_bytes;
+        }
+      file_write_at (first->file, buf, size, first->file_ofs);
+      VMSTAT_ADD (file_writes, j - i);
     }
+}
+
+/* Writes every dirty mmap'ed page in the frame table back to its
+   file, a batch of up to FLUSH_BATCH pages at a time.  Frames
+   locked by other threads are left for the next pass. */
+static void
+frame_flush_pass (uint8_t *buf)
+{
+  struct frame *batch[FLUSH_BATCH];
+  size_t cnt = 0, i, j;
+
+  lock_acquire (&table_lock);
+  for (j = 0; j < frame_total; j++)
+    {
+      struct frame *f = &frames[j];
+
+      if (!f->in_table || !f->page->writeback || !frame_is_dirty (f)
+          || !frame_lock_try_acquire (f))
+        continue;
+      batch[cnt++] = f;
+      if (cnt < FLUSH_BATCH)
+        continue;
 
+      /* While the frames of BATCH are locked, they can be
+         neither evicted nor freed. */
+      lock_release (&table_lock);
+      frame_flush_batch (batch, cnt, buf);
+      lock_acquire (&table_lock);
+
+      for (i = 0; i < cnt; i++)
+        frame_lock_release (batch[i]);
+      cnt = 0;
+    }
   lock_release (&table_lock);
-  return f;
+
+  frame_flush_batch (batch, cnt, buf);
+  for (i = 0; i < cnt; i++)
+    frame_lock_release (batch[i]);
 }
 
-/* Circularly advances the iterator HAND. */
-static struct frame *
-frame_advance_hand (void)
+/* Mmap flusher thread.  Every FRAME_FLUSH_SECS seconds, writes
+   the pages of file mappings that have been modified back to
+   their files, so that a long-running process loses little on a
+   crash and does not pay for all its writes at munmap() or
+   exit. */
+static void
+frame_flusher (void *aux UNUSED)
 {
-  if (hand == NULL)
-    hand = list_begin (&frame_list);
-  else
+  uint8_t *buf = palloc_get_multiple (PAL_ASSERT, FLUSH_BATCH);
+
+  for (;;)
     {
-      hand = list_next (hand);
-      if (hand == list_end (&frame_list))
-        hand = list_begin (&frame_list);
+      timer_sleep (frame_flush_secs * TIMER_FREQ);
+      frame_flush_pass (buf);
     }
-  return list_entry (hand, struct frame, list_elem);
 }
 
-/* Selects a victim physical frame and returns the
-   corresponding FTE. */
-static struct frame *
-frame_get_victim (void)
+/* Returns true if F, which must be locked by the current thread,
+   holds an anonymous page that same-page merging may map to
+   another frame, or, if KEEP, that others may be merged into.
+   Such a page is writable and private to one process, but not
+   yet shared.  If KEEP, it may also be shared copy-on-write
+   already, since all its sharers are then read-only. */
+static bool
+frame_mergeable (struct frame *f, bool keep)
 {
-  ASSERT (lock_held_by_current_thread (&table_lock));
-  ASSERT (!list_empty (&frame_list));
+  struct page *p = f->page;
 
-  struct frame *f;
-  while ((f = frame_advance_hand ()))
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  if (!f->in_table || f->inode != NULL || !p->writable || p->writeback
+      || p->type == PG_SHM || p->in_transit || p->zero_mapped
+      || p->owner->pagedir == NULL)
+    return false;
+  if (p->cow)
+    return keep;
+  return (list_empty (&f->sharers)
+          && pagedir_get_page (p->owner->pagedir, p->upage) == f->kpage);
+}
+
+/* Write-protects P, a mergeable page that is not copy-on-write
+   yet, so that its contents stay put until it is merged or
+   released by frame_merge_release().  P becomes copy-on-write
+   first: a write fault meanwhile waits for P's frame and then
+   finds P copy-on-write, as it should. */
+static void
+frame_merge_protect (struct page *p)
+{
+  p->cow = true;
+  pagedir_set_writable (p->owner->pagedir, p->upage, false);
+}
+
+/* Undoes frame_merge_protect() on P, in the reverse order. */
+static void
+frame_merge_release (struct page *p)
+{
+  pagedir_set_writable (p->owner->pagedir, p->upage, true);
+  p->cow = false;
+}
+
+/* Merges DUP's page into KEEP, if their contents are identical:
+   the page is remapped read-only to KEEP, shared copy-on-write
+   with KEEP's pages, and DUP is freed.  Both frames must be
+   locked by the current thread and mergeable, DUP as by
+   frame_mergeable (DUP, false).  DUP is unlocked either way.
+   Returns true if the pages were merged. */
+static bool
+frame_merge (struct frame *keep, struct frame *dup)
+{
+  struct page *p = keep->page;
+  struct page *q = dup->page;
+  bool protect_p = !p->cow;
+  void *kpage = dup->kpage;
+
+  if (protect_p)
+    frame_merge_protect (p);
+  frame_merge_protect (q);
+  if (memcmp (keep->kpage, dup->kpage, PGSIZE))
+    {
+      frame_merge_release (q);
+      if (protect_p)
+        frame_merge_release (p);
+      frame_lock_release (dup);
+      return false;
+    }
+
+  /* Q's modifications are in neither frame's backing store. */
+  q->dirty |= page_pte_is_dirty (q);
+  page_pte_clear (q);
+  pagedir_set_page (q->owner->pagedir, q->upage, keep->kpage, false);
+
+  lock_acquire (&table_lock);
+  frame_unlink (dup);
+  list_push_back (&keep->sharers, &q->share_elem);
+  q->frame = keep;
+  merge_cnt++;
+  lock_release (&table_lock);
+
+  frame_lock_release (dup);
+  palloc_free_page (kpage);
+  return true;
+}
+
+/* Scans the next FRAME_MERGE_PAGES frames of the frame table for
+   same-page merging.  A frame is a merge candidate once the
+   checksum of its contents is unchanged since the last pass,
+   which keeps pages that are being written from being merged,
+   only to be copied again at once.  Each candidate is merged
+   into an earlier candidate of the same pass with the same
+   checksum and the same contents, if there is one, or else
+   becomes a candidate for the later ones.  Frames locked by
+   other threads are skipped. */
+static void
+frame_merge_pass (void)
+{
+  size_t i;
+
+  for (i = 0; i < frame_merge_pages; i++)
     {
-      ASSERT (f->page != NULL);
+      struct frame *f, *keep;
+      struct hash_elem *e;
+      size_t prev = merge_hand;
+      unsigned sum;
+      bool stable;
 
+      lock_acquire (&table_lock);
+      if (frame_cnt == 0)
+        {
+          lock_release (&table_lock);
+          return;
+        }
+      f = frame_advance (&merge_hand);
+      if (merge_hand <= prev)
+        hash_clear (&merge_table, NULL);        /* A new pass. */
+      merge_scan_cnt++;
       if (!frame_lock_try_acquire (f))
-        continue;
-      if (page_was_accessed (f->page))
+        {
+          lock_release (&table_lock);
+          continue;
+        }
+      lock_release (&table_lock);
+
+      /* While F is locked, it can be neither evicted nor freed. */
+      if (!frame_mergeable (f, false))
+        {
+          frame_lock_release (f);
+          continue;
+        }
+      sum = hash_bytes (f->kpage, PGSIZE);
+      stable = sum == f->merge_sum;
+      f->merge_sum = sum;
+      if (!stable)
         {
           frame_lock_release (f);
           continue;
         }
 
-      list_remove (&f->list_elem);
-      return f;
+      /* Frames in MERGE_TABLE may have been freed or may hold
+         other pages since, so KEEP is checked again. */
+      e = hash_find (&merge_table, &f->merge_elem);
+      if (e == NULL)
+        {
+          hash_insert (&merge_table, &f->merge_elem);
+          frame_lock_release (f);
+          continue;
+        }
+      keep = hash_entry (e, struct frame, merge_elem);
+      if (!frame_lock_try_acquire (keep))
+        {
+          frame_lock_release (f);
+          continue;
+        }
+      if (frame_mergeable (keep, true))
+        frame_merge (keep, f);
+      else
+        frame_lock_release (f);
+      frame_lock_release (keep);
     }
-  NOT_REACHED ();
 }
 
-/* Performs frame eviction.
-   Deprives SRC of its FTE and pyhsical frame, and gives them
-   to DST.
-   The SPTE SRC must have FTE and physical frame allocated to
-   it, and the FTE and SRC must point to each other.
-   DST must not have FTE and physical frame allocated to it. */
+/* Same-page merger thread.  Every MERGE_PERIOD, scans the next
+   FRAME_MERGE_PAGES frames for pages to merge, at the lowest
+   priority, so that it only uses otherwise idle time. */
 static void
-frame_do_eviction (struct page *src, struct page *dst)
+frame_merger (void *aux UNUSED)
 {
-  ASSERT (src != NULL);
-  ASSERT (src->frame != NULL);
-  ASSERT (src->frame->page == src);
+  for (;;)
+    {
+      timer_sleep (MERGE_PERIOD);
+      frame_merge_pass ();
+    }
+}
 
-  ASSERT (dst != NULL);
-  ASSERT (dst->frame == NULL);
-  ASSERT (dst->owner == thread_current ());
+/* Returns the checksum of frame E's contents at its last scan. */
+static unsigned
+merge_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_entry (e, struct frame, merge_elem)->merge_sum;
+}
 
-  ASSERT (lock_held_by_current_thread (&table_lock));
+/* Returns true if frame A's checksum is less than frame B's. */
+static bool
+merge_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct frame, merge_elem)->merge_sum
+          < hash_entry (b, struct frame, merge_elem)->merge_sum);
+}
 
-  struct frame *f = src->frame;
+/* Returns true if F, which holds a user page, may be migrated to
+   another physical frame by frame_compact().  The frames of
+   shared memory segments, whose pages point to them as well, and
+   the frames in the share table, which would have to be rehashed,
+   are not.  Must be called with TABLE_LOCK held or with F locked
+   by the current thread. */
+static bool
+frame_movable (const struct frame *f)
+{
+  struct page *p = f->page;
 
-  /* Remove a victim FTE from the table.
-     It will be pushed back to the table at the end of
-     this procedure. */
-  list_remove (&f->list_elem);
+  return (f->in_table && f->inode == NULL && p->type != PG_SHM
+          && !p->in_transit && p->owner->pagedir != NULL
+          && pagedir_get_page (p->owner->pagedir, p->upage) == f->kpage);
+}
 
-  /* Check if the contents of the page to which the victim FTE
-     was allocated has been changed.  Then, remove the
-     corresponding virtual mapping.
-     
-     If the contents has been changed at least once, it should
-     be backed up to swap slot whenever future eviction occurs. */
-  pagedir_clear_page (src->owner->pagedir, src->upage);
-  src->dirty |= pagedir_is_dirty (src->owner->pagedir, src->upage);
+/* Maps P, if it maps physical frame OLD, to NEW instead. */
+static void
+frame_move_mapping (struct page *p, void *old, void *new)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  if (pd != NULL && pagedir_get_page (pd, p->upage) == old)
+    pagedir_move_page (pd, p->upage, new);
+}
+
+/* Migrates the contents of F, which must be movable and locked
+   by the current thread, to KPAGE, a free user page, and remaps
+   each page sharing F to it.  F leaves the frame table, unlocked,
+   and its physical frame is freed; the FTE of KPAGE takes its
+   place.  Called without TABLE_LOCK held. */
+static void
+frame_migrate (struct frame *f, void *kpage)
+{
+  struct frame *g = &frames[palloc_page_no (kpage)];
+  struct page *p = f->page;
+  void *old = f->kpage;
+  enum intr_level old_level;
+  struct list_elem *e;
 
-  if (src->dirty)
+  frame_lock_acquire (g);
+  ASSERT (!g->in_table);
+
+  /* With interrupts off, no process runs, so none can write the
+     old frame between the copy and the remapping. */
+  old_level = intr_disable ();
+  fpu_copy_page (kpage, old);
+  frame_move_mapping (p, old, kpage);
+  for (e = list_begin (&f->sharers); e != list_end (&f->sharers);
+       e = list_next (e))
+    frame_move_mapping (list_entry (e, struct page, share_elem),
+                        old, kpage);
+  intr_set_level (old_level);
+
+  lock_acquire (&table_lock);
+  frame_unlink (f);
+  g->kpage = kpage;
+  g->page = p;
+  p->frame = g;
+  list_init (&g->sharers);
+  while (!list_empty (&f->sharers))
     {
-      /* Save the previous contents to the swap slot and
-         re-initializes supplemental information for later
-         page fault handling. */
-      src->slot = swap_out (f->kpage);
-      src->type = PG_SWAP;
+      struct page *q = list_entry (list_pop_front (&f->sharers),
+                                   struct page, share_elem);
+      q->frame = g;
+      list_push_back (&g->sharers, &q->share_elem);
     }
-  
-  /* Transfer the victim frame (doubly linked). */
-  f->page = dst;
-  f->page->frame = f;
+  g->inode = NULL;
+  g->dropped = false;
+  g->merge_sum = f->merge_sum;
+  frame_link (g);
+  migrate_cnt++;
+  lock_release (&table_lock);
 
-  /* Remove the frame from SRC. */
-  src->frame = NULL;
+  frame_lock_release (g);
+  frame_lock_release (f);
+  palloc_free_page (old);
+}
+
+/* Returns the number of the first page of the block of 2**ORDER
+   pages of the memory pool, aligned to its size in physical
+   memory, that takes the fewest migrations to free, or SIZE_MAX
+   if every block holds kernel pages or immovable frames, or if
+   there are too few free pages outside the block to migrate its
+   frames to.  Must be called with TABLE_LOCK held. */
+static size_t
+frame_compact_block (int order)
+{
+  size_t block = (size_t) 1 << order;
+  size_t base_pfn = vtop (palloc_page_addr (0)) >> PGBITS;
+  size_t best = SIZE_MAX, best_moves = SIZE_MAX, best_free = 0;
+  size_t start;
+
+  ASSERT (lock_held_by_current_thread (&table_lock));
+
+  for (start = ROUND_UP (base_pfn, block) - base_pfn;
+       start + block <= frame_total; start += block)
+    {
+      size_t moves = 0, free = 0, i;
+
+      for (i = start; i < start + block; i++)
+        if (palloc_page_free (palloc_page_addr (i)))
+          free++;
+        else if (frame_movable (&frames[i]))
+          moves++;
+        else
+          break;
+      if (i == start + block && moves < best_moves)
+        {
+          best = start;
+          best_moves = moves;
+          best_free = free;
+        }
+    }
 
-  list_push_back (&frame_list, &f->list_elem);
+  if (best != SIZE_MAX
+      && palloc_free_cnt (PAL_USER) < best_free + best_moves)
+    return SIZE_MAX;
+  return best;
 }
 
-/* Removes a frame table entry F from the table and frees it.
-   Importantly, this function does not free the actual
-   physical frame corresponding to F, because this frame will
-   be deallocated by pagedir_destroy() when a process exits. */
-void
-frame_free (struct frame *f)
+/* Tries to free a block of 2**ORDER contiguous pages of the
+   memory pool, aligned to its size in physical memory, by
+   migrating the user frames in the block that needs the fewest
+   migrations to other free pages.  Returns true if every frame
+   in the block was migrated, after which palloc_get_multiple()
+   and palloc_get_aligned() find the block free, unless someone
+   else takes part of it first.
+
+   Called when those fail, and by the compaction daemon.  Does
+   nothing, returning false, in an interrupt handler, with
+   interrupts off or with TABLE_LOCK held, or before
+   frame_init(). */
+bool
+frame_compact (int order)
 {
-  ASSERT (f != NULL);
-  ASSERT (lock_held_by_current_thread (&f->lock));
+  size_t block = (size_t) 1 << order;
+  size_t start, i;
+  void *held = NULL;
+  bool success = true;
+
+  if (frames == NULL || block > frame_total || intr_context ()
+      || intr_get_level () == INTR_OFF
+      || lock_held_by_current_thread (&table_lock))
+    return false;
 
+  palloc_flush_cache ();
   lock_acquire (&table_lock);
-  list_remove (&f->list_elem);
-  free (f);
+  start = frame_compact_block (order);
   lock_release (&table_lock);
+
+  for (i = start; start != SIZE_MAX && i < start + block; i++)
+    {
+      struct frame *f = &frames[i];
+      void *kpage;
+
+      lock_acquire (&table_lock);
+      if (!f->in_table)
+        {
+          lock_release (&table_lock);
+          continue;
+        }
+      if (!frame_lock_try_acquire (f))
+        {
+          lock_release (&table_lock);
+          success = false;
+          break;
+        }
+      lock_release (&table_lock);
+      if (!frame_movable (f))
+        {
+          frame_lock_release (f);
+          success = false;
+          break;
+        }
+
+      /* The pages of the block, freed by earlier migrations or
+         by anyone else, are held until the end rather than used
+         for the copy, linked through their first words. */
+      while ((kpage = palloc_get_page (PAL_USER)) != NULL
+             && palloc_page_no (kpage) - start < block)
+        {
+          *(void **) kpage = held;
+          held = kpage;
+        }
+      if (kpage == NULL)
+        {
+          frame_lock_release (f);
+          success = false;
+          break;
+        }
+      frame_migrate (f, kpage);
+    }
+
+  while (held != NULL)
+    {
+      void *next = *(void **) held;
+      palloc_free_page (held);
+      held = next;
+    }
+
+  success = success && start != SIZE_MAX;
+  if (success)
+    compact_cnt++;
+  else
+    compact_fail_cnt++;
+  return success;
+}
+
+/* Compaction daemon.  Every COMPACT_PERIOD, if the memory pool
+   has no free block of 2**FRAME_COMPACT_ORDER pages, compacts
+   memory to make one, ahead of the requests that need it. */
+static void
+frame_compactor (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (COMPACT_PERIOD);
+      if (palloc_free_order () < frame_compact_order)
+        frame_compact (frame_compact_order);
+    }
+}
+
+/* Locks and returns the frame holding P, which must belong to
+   the current process, or to a process that cannot run
+   meanwhile, such as the parent of a fork(), or returns a null
+   pointer if P is not in memory.  Eviction passes over locked
+   frames, so P stays in memory until the frame is unlocked. */
+struct frame *
+frame_lock_resident (struct page *p)
+{
+  for (;;)
+    {
+      struct frame *f;
+
+      lock_acquire (&table_lock);
+      f = p->frame;
+      lock_release (&table_lock);
+      if (f == NULL)
+        return NULL;
+
+      /* F may have been evicted while we waited for it. */
+      frame_lock_acquire (f);
+      if (p->frame == f)
+        return f;
+      frame_lock_release (f);
+    }
 }
 
 /* Acquires FTE F's LOCK, waiting until it becomes available
@@ -200,6 +2723,13 @@ frame_lock_acquire (struct frame *f)
   lock_acquire (&f->lock);
 }
 
+/* Returns the FTE of KPAGE, a page of the user pool. */
+struct frame *
+frame_of_kpage (const void *kpage)
+{
+  return &frames[palloc_page_no (kpage)];
+}
+
 /* Releases FTE F's LOCK, which must be owned by the current
    thread. */
 void 
@@ -219,10 +2749,10 @@ bool
 frame_lock_try_acquire (struct frame *f)
 {
   ASSERT (f != NULL);
-  if (f->page->owner == thread_current ())
-    {
-      if (lock_held_by_current_thread (&f->lock))
-        return false;
-    }
-  return lock_try_acquire (&f->lock);
+  if (lock_held_by_current_thread (&f->lock))
+    return false;
+  if (lock_try_acquire (&f->lock))
+    return true;
+  VMSTAT_ADD (lock_contention, 1);
+  return false;
 }
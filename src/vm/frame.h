@@ -1,14 +1,20 @@
 #ifndef VM_FRAME_H
 #define VM_FRAME_H
 
+#include <hash.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "threads/synch.h"
+#include "filesys/off_t.h"
 
 /* A frame table entry (FTE) which holds a kernel virtual address
    identifying a physical frame palloc'ed from user pool.
-   There is a one-to-one correspondence between FTEs and allocated
-   user pool frames.
+   There is one FTE for every page of the memory pool, in a flat
+   array indexed by palloc_page_no(), allocated once by
+   frame_init(): the FTE of a page is in the frame table, that is,
+   IN_TABLE is true, while the page is allocated as a user frame.
 
    All FTEs are managed globally, because all physical frames are
    distributed to multiple processes.
@@ -33,19 +39,111 @@ struct frame
        See page.h. */
     struct page *page;
 
+    /* A frame holding a read-only page of an executable may be
+       shared by every process running it, and a frame of a
+       process that forks is shared copy-on-write by the parent
+       and the child.  A frame holding a page of a shared memory
+       segment is shared, writable, by every process mapping that
+       page; see shm.h.  PAGE is then one of the sharing SPTEs, and
+       SHARERS lists the others by their SHARE_ELEM members.  INODE and OFS identify the page in the
+       share table if the frame is registered there, otherwise
+       INODE is a null pointer.  See frame_share(). */
+    struct list sharers;
+    struct inode *inode;
+    off_t ofs;
+    struct hash_elem hash_elem;
+
+    /* A clean frame of a read-only file page left by the last
+       process mapping it may be "retained": kept out of the frame
+       table, mapped by no page, in case the page is needed again.
+       INODE, reopened, and OFS then key it in the retained table,
+       and VERSION and READ_BYTES tell whether it is still current.
+       See frame_retain(). */
+    bool retained;
+    unsigned version;
+    size_t read_bytes;
+    struct list_elem retain_elem;       /* Element in retained list. */
+
     /* Protects a critical section that might be generated during
        frame eviction. */
     struct lock lock;
 
-    struct list_elem list_elem;
+    /* Used by the CLOCK-Pro replacement policy.  See frame.c. */
+    bool hot;                           /* Hot, or cold? */
+    bool test;                          /* Cold and in test period? */
+
+    /* True if F is a drop-behind candidate.  See frame.c. */
+    bool dropped;
+
+    /* True while F is in the frame table. */
+    bool in_table;
+
+    /* Used by same-page merging.  See frame_merge_pass(). */
+    unsigned merge_sum;                 /* Checksum at last scan. */
+    struct hash_elem merge_elem;        /* Element in merge table. */
+  };
+
+/* Levels of memory pressure, from none to close to thrashing.
+   The same as MEMPRESSURE_* in lib/user/syscall.h.  See
+   frame.c. */
+enum frame_pressure
+  {
+    PRESSURE_NONE,              /* Enough free frames. */
+    PRESSURE_LOW,               /* Free frames running low. */
+    PRESSURE_MEDIUM,            /* Frames being evicted. */
+    PRESSURE_CRITICAL           /* Close to thrashing. */
   };
 
+/* Page cleaner watermarks.  See frame.c. */
+extern size_t frame_free_low;
+extern size_t frame_clean_low;
+extern size_t frame_clean_high;
+
+/* Period of the mmap flusher, in seconds.  See frame.c. */
+extern unsigned frame_flush_secs;
+
+/* Two-handed clock hand spread.  See frame.c. */
+extern size_t frame_hand_spread;
+
+/* Resident set size limit of each process.  See frame.c. */
+extern size_t frame_rss_limit;
+
+/* Frames scanned for same-page merging per period.  See frame.c. */
+extern size_t frame_merge_pages;
+
+/* Block order the compaction daemon keeps free.  See frame.c. */
+extern int frame_compact_order;
+
+/* Maximum number of retained frames.  See frame.c. */
+extern size_t frame_retain_max;
+
+bool frame_set_policy (const char *);
 void frame_init (void);
 struct frame *frame_alloc (struct page *);
+struct frame *frame_try_alloc (struct page *);
 void frame_free (struct frame *);
+struct frame *frame_share (struct page *);
+bool frame_publish (struct frame *);
+struct frame *frame_lock_file (struct inode *, off_t);
+void frame_mark_clean (struct frame *);
+bool frame_is_dirty (struct frame *);
+void frame_detach (struct frame *, struct page *);
+void frame_discard (struct frame *, struct page *);
+void frame_drop_behind (struct page *);
+void frame_add_sharer (struct frame *, struct page *);
+struct frame *frame_unshare (struct frame *, struct page *);
+struct frame *frame_share_shm (struct page *, bool *major);
+void frame_wait_eviction (struct page *);
+size_t frame_reclaim_swap (void);
+bool frame_compact (int order);
+enum frame_pressure frame_pressure_wait (enum frame_pressure,
+                                         int64_t timeout);
+void frame_print_stats (void);
 
 void frame_lock_acquire (struct frame *);
 void frame_lock_release (struct frame *);
 bool frame_lock_try_acquire (struct frame *);
+struct frame *frame_lock_resident (struct page *);
+struct frame *frame_of_kpage (const void *kpage);
 
 #endif /* vm/frame.h */
\ No newline at end of file
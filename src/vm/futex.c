@@ -0,0 +1,257 @@
+#include "vm/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* Futexes ("fast user-space mutexes").
+
+   A futex is a 32-bit word of user memory that the threads of a
+   process use to build locks and condition variables in user
+   space.  Only contended operations enter the kernel: a thread
+   that must block calls futex_wait() with the value it saw in
+   the word, and sleeps only if the word still has that value, so
+   that a wakeup sent after the word changed is not lost.
+
+   A futex is named by its address space, that is, the leader of
+   the process's thread group, and the user address of its word.
+   Futexes with waiters are kept in FUTEX_TABLE, each with a
+   condition variable on which its waiters sleep, highest
+   priority first, and are freed when their last waiter is woken.
+   Futexes are private to a process: the same word mapped by two
+   processes names two futexes.
+
+   FUTEX_LOCK protects the table and serializes futex_wait()'s
+   check of the word against the wakeups, so it is taken before
+   the address space lock of process_lock(). */
+
+/* A futex with threads waiting on it. */
+struct futex
+  {
+    struct hash_elem elem;              /* Element in futex_table. */
+    struct thread *space;               /* Owning process's leader. */
+    const int *uaddr;                   /* User address of the word. */
+    struct condition waiters;           /* Threads waiting. */
+    int waiter_cnt;                     /* Number of waiters. */
+  };
+
+static struct hash futex_table;
+static struct lock futex_lock;
+
+static hash_hash_func futex_hash;
+static hash_less_func futex_less;
+static struct futex *futex_find (struct thread *space, const int *uaddr,
+                                 bool create);
+static int futex_wake_cnt (struct futex *, int cnt);
+
+/* Initializes the futex table. */
+void
+futex_init (void)
+{
+  lock_init (&futex_lock);
+  if (!hash_init (&futex_table, futex_hash, futex_less, NULL))
+    PANIC ("Failed to initialize futex table");
+}
+
+/* Blocks the running thread on the futex at UADDR, if the word
+   there still holds VAL, until futex_wake() or futex_requeue()
+   wakes it.  Returns 0 after being woken, or -1 without waiting
+   if the word holds some other value, UADDR is not an aligned
+   word that the process may read, or the process is exiting.
+
+   As with a condition variable, the caller must check the word
+   again after waking up. */
+int
+futex_wait (const int *uaddr, int val)
+{
+  struct thread *space = process_current ();
+  const int *kaddr;
+  struct futex *f;
+  bool locked;
+  int word;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+
+  /* Read the word through its frame, pinned so that the read
+     cannot fault while FUTEX_LOCK is held. */
+  locked = process_lock ();
+  kaddr = page_pin (uaddr, false);
+  process_unlock (locked);
+  if (kaddr == NULL)
+    return -1;
+
+  lock_acquire (&futex_lock);
+  word = *kaddr;
+  page_unpin (kaddr);
+
+  if (word != val || process_must_exit ()
+      || (f = futex_find (space, uaddr, true)) == NULL)
+    {
+      lock_release (&futex_lock);
+      return -1;
+    }
+
+  /* The thread that wakes us accounts for our leaving F, and
+     frees it if we were its last waiter. */
+  f->waiter_cnt++;
+  cond_wait (&f->waiters, &futex_lock);
+  lock_release (&futex_lock);
+  return 0;
+}
+
+/* Wakes up to CNT threads waiting on the futex at UADDR, highest
+   priority first.  Returns the number woken. */
+int
+futex_wake (const int *uaddr, int cnt)
+{
+  struct futex *f;
+  int woken = 0;
+
+  lock_acquire (&futex_lock);
+  f = futex_find (process_current (), uaddr, false);
+  if (f != NULL)
+    woken = futex_wake_cnt (f, cnt);
+  lock_release (&futex_lock);
+  return woken;
+}
+
+/* Wakes the highest priority thread waiting on the futex at
+   UADDR and moves the others, without waking them, to wait on
+   the futex at UADDR2 instead.  Returns the number of threads
+   woken or moved.
+
+   This lets a condition variable's broadcast hand its waiters to
+   the mutex they will take next, to be woken one at a time as
+   the mutex is released, rather than all at once only to block
+   again on the mutex.  If the futex at UADDR2 cannot be set up,
+   all the waiters are woken. */
+int
+futex_requeue (const int *uaddr, const int *uaddr2)
+{
+  struct thread *space = process_current ();
+  struct futex *f, *f2;
+  int cnt = 0;
+
+  lock_acquire (&futex_lock);
+  f = futex_find (space, uaddr, false);
+  if (f != NULL)
+    {
+      cnt = f->waiter_cnt;
+      cond_signal (&f->waiters, &futex_lock);
+      f->waiter_cnt--;
+      if (f->waiter_cnt > 0 && uaddr2 != uaddr
+          && (f2 = futex_find (space, uaddr2, true)) != NULL)
+        {
+          cond_requeue (&f->waiters, &f2->waiters, &futex_lock);
+          f2->waiter_cnt += f->waiter_cnt;
+          f->waiter_cnt = 0;
+        }
+      futex_wake_cnt (f, f->waiter_cnt);
+    }
+  lock_release (&futex_lock);
+  return cnt;
+}
+
+/* Wakes every thread waiting on a futex of the process whose
+   leader is SPACE, which is exiting, so that they notice on
+   their way back to user space and exit too. */
+void
+futex_exit (struct thread *space)
+{
+  lock_acquire (&futex_lock);
+  for (;;)
+    {
+      struct futex *f = NULL;
+      struct hash_iterator i;
+
+      hash_first (&i, &futex_table);
+      while (hash_next (&i))
+        {
+          struct futex *g = hash_entry (hash_cur (&i), struct futex, elem);
+          if (g->space == space)
+            {
+              f = g;
+              break;
+            }
+        }
+      if (f == NULL)
+        break;
+      futex_wake_cnt (f, f->waiter_cnt);
+    }
+  lock_release (&futex_lock);
+}
+
+/* Returns the futex of SPACE at UADDR.  If it has no waiters,
+   returns a new futex if CREATE is true, or a null pointer if
+   CREATE is false or memory is short. */
+static struct futex *
+futex_find (struct thread *space, const int *uaddr, bool create)
+{
+  struct futex key, *f;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&futex_lock));
+
+  key.space = space;
+  key.uaddr = uaddr;
+  e = hash_find (&futex_table, &key.elem);
+  if (e != NULL)
+    return hash_entry (e, struct futex, elem);
+  if (!create || (f = malloc (sizeof *f)) == NULL)
+    return NULL;
+
+  f->space = space;
+  f->uaddr = uaddr;
+  cond_init (&f->waiters);
+  f->waiter_cnt = 0;
+  hash_insert (&futex_table, &f->elem);
+  return f;
+}
+
+/* Wakes up to CNT of the threads waiting on F and returns the
+   number woken.  Frees F if none are left. */
+static int
+futex_wake_cnt (struct futex *f, int cnt)
+{
+  int woken;
+
+  ASSERT (lock_held_by_current_thread (&futex_lock));
+
+  for (woken = 0; woken < cnt && f->waiter_cnt > 0; woken++)
+    {
+      cond_signal (&f->waiters, &futex_lock);
+      f->waiter_cnt--;
+    }
+  if (f->waiter_cnt == 0)
+    {
+      hash_delete (&futex_table, &f->elem);
+      free (f);
+    }
+  return woken;
+}
+
+/* Hash function for the futex table. */
+static unsigned
+futex_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex *f = hash_entry (e, struct futex, elem);
+  return hash_bytes (&f->space, sizeof f->space) ^ hash_int ((int) f->uaddr);
+}
+
+/* Comparison function for the futex table. */
+static bool
+futex_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex *a = hash_entry (a_, struct futex, elem);
+  const struct futex *b = hash_entry (b_, struct futex, elem);
+
+  if (a->space != b->space)
+    return a->space < b->space;
+  return a->uaddr < b->uaddr;
+}
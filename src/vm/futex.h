@@ -0,0 +1,13 @@
+#ifndef VM_FUTEX_H
+#define VM_FUTEX_H
+
+/* Defined in threads/thread.h. */
+struct thread;
+
+void futex_init (void);
+int futex_wait (const int *uaddr, int val);
+int futex_wake (const int *uaddr, int cnt);
+int futex_requeue (const int *uaddr, const int *uaddr2);
+void futex_exit (struct thread *space);
+
+#endif /* vm/futex.h */
@@ -0,0 +1,157 @@
+#include "vm/lz.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* A small LZ77 compressor for swapped-out pages.
+
+   The compressed stream is a sequence of items, each starting
+   with a token byte T:
+
+        - T < 0x80: T + 1 literal bytes follow.
+
+        - T >= 0x80: a match of (T & 0x7f) + MIN_MATCH bytes,
+          copied from OFFSET bytes back in the output, where
+          OFFSET is given by the two following bytes, least
+          significant first.
+
+   Matches are found through a hash table of the last position
+   of each 3-byte sequence, so compression is a single greedy
+   pass.  The hash table is static: callers must serialize calls
+   to lz_compress(). */
+
+#define MIN_MATCH 3                     /* Shortest match. */
+#define MAX_MATCH (0x7f + MIN_MATCH)    /* Longest match. */
+#define MAX_LITERALS 0x80               /* Longest literal run. */
+#define MAX_OFFSET 0xffff               /* Farthest match. */
+
+#define HASH_BITS 12
+#define HASH_SIZE (1 << HASH_BITS)
+
+/* Position + 1 of the last occurrence of each hashed 3-byte
+   sequence, or 0. */
+static uint16_t hash_table[HASH_SIZE];
+
+/* Hashes the 3 bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Appends the literal run of CNT bytes at SRC to *DST, which has
+   room up to END.  Returns false if it does not fit. */
+static bool
+emit_literals (uint8_t **dst, uint8_t *end, const uint8_t *src, size_t cnt)
+{
+  while (cnt > 0)
+    {
+      size_t run = cnt < MAX_LITERALS ? cnt : MAX_LITERALS;
+      if ((size_t) (end - *dst) < run + 1)
+        return false;
+      *(*dst)++ = run - 1;
+      memcpy (*dst, src, run);
+      *dst += run;
+      src += run;
+      cnt -= run;
+    }
+  return true;
+}
+
+/* Compresses the SRC_LEN bytes at SRC into DST, which has room
+   for DST_MAX bytes.  Returns the compressed size, or 0 if the
+   result would not fit in DST_MAX bytes.  SRC_LEN must be less
+   than 65536. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_, size_t dst_max)
+{
+  const uint8_t *src = src_;
+  const uint8_t *lit = src;
+  uint8_t *dst = dst_, *end = dst + dst_max;
+  size_t pos = 0;
+
+  ASSERT (src_len < 0x10000);
+
+  memset (hash_table, 0, sizeof hash_table);
+  while (pos + MIN_MATCH <= src_len)
+    {
+      unsigned h = hash3 (src + pos);
+      size_t cand = hash_table[h];
+      size_t len = 0;
+
+      hash_table[h] = pos + 1;
+      if (cand != 0 && pos - (cand - 1) <= MAX_OFFSET)
+        {
+          const uint8_t *m = src + cand - 1;
+          size_t max = src_len - pos < MAX_MATCH ? src_len - pos : MAX_MATCH;
+          while (len < max && m[len] == src[pos + len])
+            len++;
+        }
+
+      if (len < MIN_MATCH)
+        {
+          pos++;
+          continue;
+        }
+
+      /* Flush pending literals, then emit the match. */
+      if (!emit_literals (&dst, end, lit, src + pos - lit)
+          || end - dst < 3)
+        return 0;
+      *dst++ = 0x80 | (len - MIN_MATCH);
+      *dst++ = (pos - (cand - 1)) & 0xff;
+      *dst++ = (pos - (cand - 1)) >> 8;
+      pos += len;
+      lit = src + pos;
+    }
+
+  if (!emit_literals (&dst, end, lit, src + src_len - lit))
+    return 0;
+  return dst - (uint8_t *) dst_;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC, produced by
+   lz_compress(), into exactly DST_LEN bytes at DST.  Returns
+   false if SRC is corrupt. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_, size_t dst_len)
+{
+  const uint8_t *src = src_, *src_end = src + src_len;
+  uint8_t *dst = dst_, *dst_end = dst + dst_len;
+
+  while (src < src_end)
+    {
+      uint8_t t = *src++;
+      if (t < 0x80)
+        {
+          size_t run = t + 1;
+          if ((size_t) (src_end - src) < run
+              || (size_t) (dst_end - dst) < run)
+            return false;
+          memcpy (dst, src, run);
+          src += run;
+          dst += run;
+        }
+      else
+        {
+          size_t len = (t & 0x7f) + MIN_MATCH;
+          size_t ofs;
+
+          if (src_end - src < 2)
+            return false;
+          ofs = src[0] | (src[1] << 8);
+          src += 2;
+          if (ofs == 0 || ofs > (size_t) (dst - (uint8_t *) dst_)
+              || (size_t) (dst_end - dst) < len)
+            return false;
+
+          /* Byte by byte, since the match may overlap its own
+             output. */
+          for (; len > 0; len--, dst++)
+            *dst = *(dst - ofs);
+        }
+    }
+  return dst == dst_end;
+}
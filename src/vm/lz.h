@@ -0,0 +1,12 @@
+#ifndef VM_LZ_H
+#define VM_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+size_t lz_compress (const void *src, size_t src_len,
+                    void *dst, size_t dst_max);
+bool lz_decompress (const void *src, size_t src_len,
+                    void *dst, size_t dst_len);
+
+#endif /* vm/lz.h */
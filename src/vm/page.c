@@ -1,30 +1,113 @@
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "vm/swap.h"
+#include "vm/vmstat.h"
+#include "vm/prepage.h"
+#include "vm/shm.h"
+#include "vm/uffd.h"
 #include <debug.h>
+#include <stdio.h>
 #include <string.h>
 #include <hash.h>
+#include "threads/fpu.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
+#include "threads/palloc.h"
 #include "userprog/pagedir.h"
+#include "userprog/process.h"
 #include "filesys/file.h"
+#include "filesys/inode.h"
 
-static unsigned page_hash_func (const struct hash_elem *, void *);
-static bool page_hash_less (const struct hash_elem *, const struct hash_elem *, void *);
-static void page_hash_free (struct hash_elem *, void *);
+static unsigned page_hash_func (const struct ohash_elem *, void *);
+static bool page_hash_less (const struct ohash_elem *, const struct ohash_elem *, void *);
+static void page_hash_free (struct ohash_elem *, void *);
 
 static void wait_and_destruct_frame (struct page *);
+static void page_swap_readahead (struct page *, size_t slot);
+static void page_fault_around (struct page *, size_t cnt);
+static void page_drop_behind (struct page *, size_t cnt);
+static void page_discard (struct page *);
+static void page_init_from_region (struct page *, struct region *);
+static bool region_split (void *upage);
+static void page_swap_in (struct page *, void *kpage);
+static void page_swap_done (struct page *);
+static struct page *page_find (void *);
+static struct page *page_new_entry (void *);
+static struct region *region_find (void *);
+static bool reserve_stack (void *bottom, size_t page_cnt);
+static struct page *page_new_zero (void *);
+static bool page_unshare (struct page *, struct frame *);
+static bool page_load_shm (struct page *);
+static void page_sync_run (struct page **, size_t cnt);
+static void page_populate_run (struct frame **, size_t cnt);
+static bool page_copy (struct page *, struct thread *parent, void *buf);
+static struct file *inherited_file (struct file *, struct thread *leader);
+static bool install_page (void *upage, void *kpage, bool writable);
+static uint32_t *page_pte (struct page *);
+static void region_free (struct region *);
+
+/* Maximum number of pages page_fault_around() maps beyond the
+   faulting page.  0 disables fault-around. */
+size_t page_fault_around_pages = 8;
+
+/* How many times wider fault-around is for pages given
+   ADV_SEQUENTIAL advice. */
+#define SEQ_AROUND_FACTOR 4
+
+/* Maximum number of pages page_msync() writes, or
+   page_populate() reads, at once. */
+#define MSYNC_RUN_MAX 16
+
+/* Number of pages the stack grows by when a fault extends it
+   downward page by page.  Set by kernel command-line option
+   "-sb".  See page_grow_stack(). */
+size_t page_stack_batch = 8;
+
+/* A page of zeros, mapped read-only for reads from PG_ZERO pages
+   that have not been written yet.  See page_load(). */
+static void *zero_kpage;
+static size_t zero_map_cnt;             /* # of zero page mappings. */
+
+/* Cache of SPTEs. */
+static struct slab_cache page_cache;
+
+/* Fault-around statistics. */
+static size_t fault_around_cnt;         /* # of pages read ahead. */
+static size_t fault_around_hit_cnt;     /* # of them accessed later. */
+
+/* Stack growth statistics. */
+static size_t stack_grow_cnt;           /* # of stack growth faults. */
+static size_t stack_batch_cnt;          /* # of pages mapped in advance. */
+
+/* User fault handling statistics.  See uffd.c. */
+static size_t uffd_fault_cnt;           /* # of faults reported. */
+static size_t uffd_fill_cnt;            /* # of pages filled in. */
+static size_t uffd_zero_cnt;            /* # of pages zeroed, no handler. */
+
+/* Initializes the paging module. */
+void
+page_init (void)
+{
+  zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  slab_cache_init (&page_cache, "page", sizeof (struct page), NULL);
+}
 
 /* Creates and initializes a supplemental page table (SPT).
-   This table stores SPTEs using their UPAGE as a key. */
-struct hash *
+   This table stores SPTEs using their UPAGE as a key, in an
+   open-addressing hash table, since it is searched on every page
+   fault.  The table grows incrementally, so that a fault in a
+   large address space never waits for the whole table to be
+   rehashed. */
+struct ohash *
 page_create_spt (void)
 {
-  struct hash *spt = malloc (sizeof (struct hash));
-  if (!spt)
+  struct ohash *spt = malloc (sizeof (struct ohash));
+  if (!spt || !ohash_init (spt, page_hash_func, page_hash_less, NULL))
     PANIC ("cannot create a supplemental page table.");
-  hash_init (spt, page_hash_func, page_hash_less, NULL);
+  ohash_set_incremental (spt, true);
   return spt;
 }
 
@@ -36,41 +119,44 @@ page_create_spt (void)
    is not freed, because this frame should be deallocated by
    pagedir_destroy() when a process exits. */
 void
-page_destroy_spt (struct hash *spt)
+page_destroy_spt (struct ohash *spt)
 {
   ASSERT (spt != NULL);
-  hash_destroy (spt, page_hash_free);
+  ohash_destroy (spt, page_hash_free);
   free (spt);
 }
 
 static unsigned
-page_hash_func (const struct hash_elem *e, void *aux UNUSED)
+page_hash_func (const struct ohash_elem *e, void *aux UNUSED)
 {
-  struct page *p = hash_entry (e, struct page, hash_elem);
+  struct page *p = ohash_entry (e, struct page, hash_elem);
   return hash_int ((int) p->upage);
 }
 
 static bool
-page_hash_less (const struct hash_elem *a_,
-                const struct hash_elem *b_,
+page_hash_less (const struct ohash_elem *a_,
+                const struct ohash_elem *b_,
                 void *aux UNUSED)
 {
-  struct page *a = hash_entry (a_, struct page, hash_elem);
-  struct page *b = hash_entry (b_, struct page, hash_elem);
+  struct page *a = ohash_entry (a_, struct page, hash_elem);
+  struct page *b = ohash_entry (b_, struct page, hash_elem);
   return a->upage < b->upage;
 }
 
 static void
-page_hash_free (struct hash_elem *e, void *aux UNUSED)
+page_hash_free (struct ohash_elem *e, void *aux UNUSED)
 {
-  struct page *p = hash_entry (e, struct page, hash_elem);
+  struct page *p = ohash_entry (e, struct page, hash_elem);
 
   wait_and_destruct_frame (p);
 
   if (p->slot != BITMAP_ERROR)
     swap_free (p->slot);
 
-  free (p);
+  slab_free (&page_cache, p);
+
+  /* Called for every entry of a table that may be large. */
+  cond_resched ();
 }
 
 /* Waits until P's frame eviction completes, if being processed,
@@ -97,6 +183,18 @@ wait_and_destruct_frame (struct page *p)
 {
   struct frame *f = p->frame;
 
+  /* No other process may take up a segment's page while its last
+     mapping is being removed.  See frame_detach(). */
+  if (p->type == PG_SHM)
+    lock_acquire (&p->shm->lock);
+
+  /* The zero page must not be freed by pagedir_destroy(). */
+  if (p->zero_mapped)
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      p->zero_mapped = false;
+    }
+
   /* P owns F. */
   if (f != NULL)
     {
@@ -116,32 +214,521 @@ wait_and_destruct_frame (struct page *p)
       else
         {
           /* F was not a victim; P owns F with being locked.
-             It is safe to free F because it cannot be a victim
+             It is safe to free F, or to leave it to the other
+             processes sharing it, because it cannot be a victim
              anymore. */
+          frame_detach (f, p);
+        }
+    }
+  if (p->type == PG_SHM)
+    lock_release (&p->shm->lock);
+
+  /* F may have been evicted from P, but its contents may still
+     be on the way to swap slot. */
+  frame_wait_eviction (p);
+}
+
+/* Maps PAGE_CNT user virtual pages starting at UPAGE as a region
+   of the current process.  The first LENGTH bytes are loaded from
+   FILE starting at offset OFS, and the rest is filled with zeros.
+   The pages are writable by the process if WRITABLE is true, and
+   their changes go back to FILE if WRITEBACK is true.
+
+   No SPTE is created here; see page_lookup().  Returns false if
+   the pages do not fit in user virtual memory or overlap any
+   existing region or page. */
+bool
+page_map_region (void *upage, size_t page_cnt, struct file *file,
+                 off_t ofs, off_t length, bool writable, bool writeback)
+{
+  struct thread *cur = process_current ();
+  void *end = upage + page_cnt * PGSIZE;
+  struct list_elem *e;
+  struct region *r;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (page_cnt == 0 || !is_user_vaddr (upage)
+      || end < upage || end > PHYS_BASE)
+    return false;
+
+  /* Find the insertion point, checking for overlapping
+     regions. */
+  for (e = list_begin (&cur->region_list);
+       e != list_end (&cur->region_list); e = list_next (e))
+    {
+      r = list_entry (e, struct region, list_elem);
+      if (r->start >= end)
+        break;
+      if (r->end > upage)
+        return false;
+    }
+
+  /* Check for pages outside any region, such as stack pages,
+     whichever is cheaper. */
+  if (page_cnt <= ohash_size (cur->spt))
+    {
+      void *p;
+      for (p = upage; p < end; p += PGSIZE)
+        if (page_find (p) != NULL)
+          return false;
+    }
+  else
+    {
+      struct ohash_iterator i;
+      ohash_first (&i, cur->spt);
+      while (ohash_next (&i))
+        {
+          struct page *p = ohash_entry (ohash_cur (&i), struct page,
+                                        hash_elem);
+          if (p->upage >= upage && p->upage < end)
+            return false;
+        }
+    }
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return false;
+  r->start = upage;
+  r->end = end;
+  r->file = file;
+  r->file_ofs = ofs;
+  r->length = length;
+  r->writable = writable;
+  r->writeback = writeback;
+  r->shm = NULL;
+  r->uffd = NULL;
+  r->advice = ADV_NORMAL;
+  r->split = false;
+  r->stack = false;
+  list_insert (e, &r->list_elem);
+  return true;
+}
+
+/* Maps the first PAGE_CNT pages of shared memory segment SHM at
+   UPAGE, writable, as a region of the current process, as
+   page_map_region() does for a file. */
+bool
+page_map_shm (void *upage, size_t page_cnt, struct shm *shm)
+{
+  ASSERT (page_cnt <= shm->page_cnt);
+
+  if (!page_map_region (upage, page_cnt, NULL, 0, 0, true, false))
+    return false;
+  region_find (upage)->shm = shm;
+  return true;
+}
+
+/* Maps PAGE_CNT pages at UPAGE, writable, as a region of the
+   current process whose pages are missing until the handler
+   reading from U fills them in, as page_map_region() does for an
+   anonymous mapping.  The region takes over the caller's
+   reference to U.  See uffd.c. */
+bool
+page_map_uffd (void *upage, size_t page_cnt, struct uffd *u)
+{
+  if (!page_map_region (upage, page_cnt, NULL, 0, 0, true, false))
+    return false;
+  region_find (upage)->uffd = u;
+  return true;
+}
+
+/* Fills in UPAGE, a missing page of a region of the current
+   process registered with uffd_register(), with a copy of the
+   page at KPAGE, or with zeros if KPAGE is null, and wakes the
+   threads waiting for it.  Returns false if UPAGE is not such a
+   page. */
+bool
+page_uffd_resolve (void *upage, const void *kpage)
+{
+  bool locked = process_lock ();
+  struct region *r = region_find (upage);
+  struct page *p = NULL;
+  struct frame *f;
+  bool success = false;
+
+  if (r != NULL && r->uffd != NULL)
+    p = page_lookup (upage);
+  if (p != NULL && p->type == PG_UFFD)
+    {
+      if (kpage == NULL)
+        {
+          /* The next fault loads the page as zeros. */
+          p->type = PG_ZERO;
+          success = true;
+        }
+      else
+        {
+          f = frame_alloc (p);
+          memcpy (f->kpage, kpage, PGSIZE);
+          if (install_page (upage, f->kpage, p->writable))
+            {
+              /* The contents are in no backing store yet. */
+              p->type = PG_ZERO;
+              p->dirty = true;
+              frame_lock_release (f);
+              success = true;
+            }
+          else
+            frame_free (f);
+        }
+    }
+  if (success)
+    {
+      uffd_fill_cnt++;
+      uffd_wake (r->uffd);
+    }
+  process_unlock (locked);
+  return success;
+}
+
+/* Wakes the threads of the current process, which is exiting,
+   that wait for a user fault handler, so that they exit too. */
+void
+page_uffd_exit (void)
+{
+  struct list *regions = &process_current ()->region_list;
+  struct list_elem *e;
+
+  for (e = list_begin (regions); e != list_end (regions);
+       e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, list_elem);
+      if (r->uffd != NULL)
+        uffd_wake (r->uffd);
+    }
+}
+
+/* Frees region R, which must be out of its list. */
+static void
+region_free (struct region *r)
+{
+  if (r->uffd != NULL)
+    uffd_close (r->uffd);
+  free (r);
+}
+
+/* Removes the region starting at UPAGE from the current process,
+   if any, along with the pieces page_advise() split off it.
+   SPTEs already created for its pages are not affected, and
+   must be removed by the caller. */
+void
+page_unmap_region (void *upage)
+{
+  struct region *r = region_find (upage);
+
+  if (r != NULL && r->start == upage)
+    do
+      {
+        struct list_elem *next = list_remove (&r->list_elem);
+        region_free (r);
+        r = (next != list_end (&process_current ()->region_list)
+             ? list_entry (next, struct region, list_elem) : NULL);
+      }
+    while (r != NULL && r->split);
+}
+
+/* Removes all regions of the current process, which must have a
+   single thread. */
+void
+page_destroy_regions (void)
+{
+  struct thread *cur = thread_current ();
+  struct list *regions = &cur->region_list;
+
+  ASSERT (cur->group == NULL);
+
+  while (!list_empty (regions))
+    region_free (list_entry (list_pop_front (regions), struct region,
+                             list_elem));
+  cur->stack_region = NULL;
+}
+
+/* Reserves the top PAGE_CNT pages of user virtual memory as the
+   current thread's stack region.  Unlike other regions, pages
+   in a stack region are not created on first use by
+   page_lookup(), but only by page_grow_stack(), so that stray
+   accesses far below the stack pointer still fault.  Returns
+   true if successful. */
+bool
+page_reserve_stack (size_t page_cnt)
+{
+  return reserve_stack ((uint8_t *) PHYS_BASE - page_cnt * PGSIZE,
+                        page_cnt);
+}
+
+/* Reserves a stack region of THREAD_STACK_SIZE bytes for the
+   current thread, a further thread of its process, in the first
+   free one of THREAD_STACK_MAX slots below the process's first
+   stack region.  Returns the top of the new stack, or a null
+   pointer if no slot is free. */
+void *
+page_reserve_thread_stack (void)
+{
+  uint8_t *top = (uint8_t *) PHYS_BASE - STACK_MAX_SIZE;
+  int i;
+
+  for (i = 0; i < THREAD_STACK_MAX; i++, top -= THREAD_STACK_SIZE)
+    if (reserve_stack (top - THREAD_STACK_SIZE, THREAD_STACK_SIZE / PGSIZE))
+      return top;
+  return NULL;
+}
+
+/* Reserves the PAGE_CNT pages from BOTTOM as the current
+   thread's stack region, which it must not have yet.  Returns
+   false if they overlap a region or page of the process. */
+static bool
+reserve_stack (void *bottom, size_t page_cnt)
+{
+  struct thread *cur = thread_current ();
+  struct region *r;
+
+  ASSERT (cur->stack_region == NULL);
+
+  if (!page_map_region (bottom, page_cnt, NULL, 0, 0, true, false))
+    return false;
+  r = region_find (bottom);
+  r->stack = true;
+  cur->stack_region = r;
+  cur->stack_low = r->end;
+  return true;
+}
+
+/* Removes the current thread's stack region, if it has one,
+   along with the pages created in it, on behalf of a thread
+   exiting from a process that keeps running. */
+void
+page_release_stack (void)
+{
+  struct thread *cur = thread_current ();
+  struct region *r = cur->stack_region;
+  void *upage;
+
+  if (r == NULL)
+    return;
+
+  for (upage = cur->stack_low; upage < r->end; upage += PGSIZE)
+    {
+      struct page *p = page_find (upage);
+      if (p != NULL)
+        page_remove_entry (p);
+    }
+  page_unmap_region (r->start);
+  cur->stack_region = NULL;
+}
+
+/* Starts the current process's heap, empty, at HEAP, the first
+   page past its executable's segments. */
+void
+page_init_heap (void *heap)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (pg_ofs (heap) == 0);
+
+  cur->heap_start = cur->brk = heap;
+}
+
+/* Moves the current process's break, the end of its heap, by
+   INCREMENT bytes, as sbrk() does, and returns the old break, or
+   a null pointer if the break would move below the start of the
+   heap or the heap would overlap another region.
+
+   The heap is made of zero-filled regions, whose pages are only
+   created, by page_lookup(), when first used.  Growing the heap
+   extends its last region, or maps a new one.  Shrinking it
+   removes the pages past the new break, along with their frames
+   and swap slots. */
+void *
+page_sbrk (intptr_t increment)
+{
+  struct thread *cur = process_current ();
+  uint8_t *old_brk = cur->brk;
+  uint8_t *new_brk = old_brk + increment;
+  uint8_t *old_end = pg_round_up (old_brk);
+  uint8_t *new_end;
+
+  if (increment > 0
+      ? new_brk < old_brk || !is_user_vaddr (new_brk - 1)
+      : new_brk > old_brk || new_brk < (uint8_t *) cur->heap_start)
+    return NULL;
+  new_end = pg_round_up (new_brk);
+
+  if (new_end > old_end)
+    {
+      struct region *r, *prev;
+
+      if (!page_map_region (old_end, (new_end - old_end) / PGSIZE,
+                            NULL, 0, 0, true, false))
+        return NULL;
+
+      /* Merge the new region into the heap region below it. */
+      r = region_find (old_end);
+      prev = (old_end > (uint8_t *) cur->heap_start
+              ? region_find (old_end - PGSIZE) : NULL);
+      if (prev != NULL && prev->end == old_end && prev->file == NULL
+          && prev->shm == NULL && !prev->stack
+          && prev->advice == r->advice)
+        {
+          prev->end = r->end;
+          list_remove (&r->list_elem);
+          free (r);
+        }
+    }
+  else if (new_end < old_end)
+    {
+      struct region *r;
+      uint8_t *upage;
+
+      /* Split the heap region that NEW_END falls in, then remove
+         the pages and regions from NEW_END up. */
+      if (!region_split (new_end))
+        return NULL;
+      for (upage = new_end; upage < old_end; upage += PGSIZE)
+        {
+          struct page *p = page_find (upage);
+          if (p != NULL)
+            page_remove_entry (p);
+        }
+      r = region_find (new_end);
+      while (r != NULL && (uint8_t *) r->start < old_end)
+        {
+          struct list_elem *next = list_remove (&r->list_elem);
+          free (r);
+          r = (next != list_end (&cur->region_list)
+               ? list_entry (next, struct region, list_elem) : NULL);
+        }
+    }
+
+  cur->brk = new_brk;
+  return old_brk;
+}
+
+/* Returns true if UADDR lies in the current thread's stack
+   region. */
+bool
+page_in_stack (const void *uaddr)
+{
+  struct region *r = thread_current ()->stack_region;
+
+  return r != NULL && uaddr >= r->start && uaddr < r->end;
+}
+
+/* Creates a zero-filled SPTE for stack page UPAGE, which must lie
+   in the current thread's stack region, unless it already has
+   one.
+
+   If UPAGE is just below the lowest stack page created so far,
+   the stack is growing page by page, so up to PAGE_STACK_BATCH
+   - 1 pages below UPAGE are created as well and mapped to free
+   frames right away, saving a fault on each of them.  Returns
+   true if UPAGE has an SPTE. */
+bool
+page_grow_stack (void *upage)
+{
+  struct thread *cur = thread_current ();
+  void *bottom = cur->stack_region->start;
+  bool sequential = upage == cur->stack_low - PGSIZE;
+  size_t k;
+
+  ASSERT (page_in_stack (upage));
+  ASSERT (pg_ofs (upage) == 0);
+
+  if (page_find (upage) != NULL)
+    return true;
+
+  page_new_zero (upage);
+  stack_grow_cnt++;
+  if (upage < cur->stack_low)
+    cur->stack_low = upage;
+  if (!sequential)
+    return true;
+
+  for (k = 1; k < page_stack_batch; k++)
+    {
+      void *below = upage - k * PGSIZE;
+      struct page *p;
+      struct frame *f;
+
+      if (below < bottom || page_find (below) != NULL)
+        break;
+      p = page_new_zero (below);
+      cur->stack_low = below;
+
+      f = frame_try_alloc (p);
+      if (f == NULL)
+        break;
+      fpu_zero_page (f->kpage);
+      if (!install_page (below, f->kpage, true))
+        {
           frame_free (f);
+          break;
         }
+      stack_batch_cnt++;
+      frame_lock_release (f);
+    }
+  return true;
+}
+
+/* Creates a writable, zero-filled SPTE for UPAGE, which must not
+   have one yet. */
+static struct page *
+page_new_zero (void *upage)
+{
+  struct page *p = page_new_entry (upage);
+
+  p->type = PG_ZERO;
+  p->writable = true;
+  return p;
+}
+
+/* Returns the region of the current process containing UPAGE, or
+   a null pointer if there is none. */
+static struct region *
+region_find (void *upage)
+{
+  struct list *regions = &process_current ()->region_list;
+  struct list_elem *e;
+
+  for (e = list_begin (regions); e != list_end (regions);
+       e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, list_elem);
+      if (upage < r->start)
+        break;
+      if (upage < r->end)
+        return r;
     }
+  return NULL;
 }
 
 /* Creates a SPTE to load a user virtual page at UPAGE,
    stores it in the current process's SPT, and returns a pointer
    to the created SPTE.
-   A request to create an already existing SPTE is denied.
+   A request to create an already existing SPTE, or one within a
+   region, is denied.
    After created, the SPTE's TYPE and some necessary information
    must be initialized. */
 struct page *
 page_make_entry (void *upage)
 {
-  struct thread *cur = thread_current ();
-  struct page *p;
-
   ASSERT (is_user_vaddr (upage));
   ASSERT (pg_ofs (upage) == 0);
 
-  if (page_lookup (upage))
+  if (page_find (upage) || region_find (upage))
     return NULL;
-  
-  p = malloc (sizeof (struct page));
+  return page_new_entry (upage);
+}
+
+/* Creates a SPTE for UPAGE as page_make_entry(), without
+   checking for an existing one. */
+static struct page *
+page_new_entry (void *upage)
+{
+  struct thread *cur = process_current ();
+  struct page *p;
+
+  p = slab_alloc (&page_cache);
   if (!p)
     PANIC ("cannot create supplemental page table entry.");
   
@@ -153,11 +740,20 @@ page_make_entry (void *upage)
 
   p->type = PG_UNKNOWN;
   p->file = NULL;
+  p->writeback = false;
   p->slot = BITMAP_ERROR;
+  p->shm = NULL;
 
   p->dirty = false;
+  p->in_transit = false;
+  p->zero_mapped = false;
+  p->cow = false;
+  p->prefetched = false;
+  p->test_epoch = 0;
+  p->advice = ADV_NORMAL;
+  p->pte = NULL;
 
-  hash_insert (cur->spt, &p->hash_elem);
+  ohash_insert (cur->spt, &p->hash_elem);
   return p;
 }
 
@@ -170,7 +766,7 @@ page_make_entry (void *upage)
 void
 page_remove_entry (struct page *p)
 {
-  ASSERT (p->owner == thread_current ());
+  ASSERT (p->owner == process_current ());
   ASSERT (p != NULL);
 
   wait_and_destruct_frame (p);
@@ -178,52 +774,175 @@ page_remove_entry (struct page *p)
   if (p->slot != BITMAP_ERROR)
     swap_free (p->slot);
 
-  hash_delete (p->owner->spt, &p->hash_elem);
-  free (p);
+  ohash_delete (p->owner->spt, &p->hash_elem);
+  slab_free (&page_cache, p);
 }
 
-static bool install_page (void *upage, void *kpage, bool writable);
+/* Counts a fault on P, as a major fault if MAJOR is true. */
+static void
+page_count_fault (const struct page *p, bool major)
+{
+  if (major)
+    VMSTAT_ADD (major_faults, 1);
+  else
+    VMSTAT_ADD (minor_faults, 1);
+
+  if (p->type == PG_FILE)
+    VMSTAT_ADD (file_faults, 1);
+  else if (p->type == PG_SWAP)
+    VMSTAT_ADD (swap_faults, 1);
+  else if (p->type == PG_ZERO)
+    VMSTAT_ADD (zero_faults, 1);
+}
 
-/* Loads a user virtual page at UPAGE.
+/* Loads a user virtual page at UPAGE, accessed for writing if
+   WRITE is true, for reading otherwise.
 
    If the current process's SPT does not contain any SPTE
    corresponding to the virtual page UPAGE, page_load()
    returns false.
+
+   Reading a PG_ZERO page maps the shared zero page read-only
+   instead of allocating a frame: the first write faults again
+   and only then gives the page a frame of its own.  Likewise, a
+   write to a copy-on-write page gives it a copy of its frame.
    
    Otherwise, it allocates a frame for the SPTE and loads the
    contents of the page from file or swap slot, or fills with
    zeros.  Finally, a user virtual mapping is added to the
-   current process. */
+   current process.
+
+   When the page comes from swap, the following pages which were
+   swapped out to the consecutive slots are read in as well, as
+   long as free frames remain.  See page_swap_readahead().
+   Likewise, the following pages of the same file run are mapped
+   as well when the page comes from file.  See
+   page_fault_around(). */
 bool
-page_load (void *upage)
+page_load (void *upage, bool write)
 {
   ASSERT (is_user_vaddr (upage));
   ASSERT (pg_ofs (upage) == 0);
 
+  TRACE (TRACE_VM, TRACE_PAGE_LOAD, upage, write);
   struct page *p = page_lookup (upage);
   if (!p)
     return false;
 
-  struct frame *f = frame_alloc (p);
+  /* UPAGE might have just been evicted by another process. */
+  frame_wait_eviction (p);
+
+  if (p->type == PG_SHM)
+    return page_load_shm (p);
+
+  /* A missing page of a region registered with uffd_register() is
+     filled in by the process's handler, whose fault this then
+     retries, or as zeros if there is none.  The address space is
+     unlocked meanwhile, so P is looked up again after the wait. */
+  if (p->type == PG_UFFD)
+    {
+      struct region *r = region_find (upage);
+
+      uffd_fault_cnt++;
+      if (r != NULL && r->uffd != NULL && uffd_wait (r->uffd, upage, write))
+        return true;
+      p = page_lookup (upage);
+      if (p == NULL)
+        return false;
+      if (p->type == PG_UFFD)
+        {
+          p->type = PG_ZERO;
+          uffd_zero_cnt++;
+        }
+    }
+
+  if (p->cow && write)
+    {
+      struct frame *f = frame_lock_resident (p);
+      if (f != NULL)
+        return page_unshare (p, f);
+
+      /* Evicted meanwhile: the page is loaded below into a frame
+         of its own. */
+    }
+
+  if (p->zero_mapped)
+    {
+      if (!write)
+        return true;
+      pagedir_clear_page (p->owner->pagedir, upage);
+      p->zero_mapped = false;
+    }
+  else if (p->type == PG_ZERO && !write)
+    {
+      if (!install_page (upage, zero_kpage, false))
+        return false;
+      p->zero_mapped = true;
+      zero_map_cnt++;
+      page_count_fault (p, false);
+      return true;
+    }
+
+  /* Another process running the same executable may have the
+     same read-only page in memory already, and every mapping of
+     a page of a shared file mapping uses the same frame. */
+  struct frame *f;
+ share:
+  f = frame_share (p);
+  if (f != NULL)
+    {
+      if (!install_page (upage, f->kpage, p->writable))
+        {
+          frame_detach (f, p);
+          return false;
+        }
+      frame_lock_release (f);
+      page_count_fault (p, false);
+      return true;
+    }
+
+  f = frame_alloc (p);
+  size_t ra_slot = BITMAP_ERROR;
+  bool around = false;
+  size_t around_cnt = page_fault_around_pages;
   switch (p->type)
     {
     case PG_FILE:
       {
-        size_t read_bytes
-          = file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs);
-        if (read_bytes != p->read_bytes)
-          goto fail;
-        memset (f->kpage + p->read_bytes, 0, p->zero_bytes);
+        size_t read_bytes;
+
+        /* Another process may have loaded the page of a shared
+           file mapping meanwhile. */
+        if (!frame_publish (f))
+          {
+            frame_free (f);
+            goto share;
+          }
+        /* A page that lies in a hole of the file reads as zeros,
+           with no need to go through the buffer cache. */
+        if (inode_is_hole (file_get_inode (p->file), p->file_ofs,
+                           p->read_bytes))
+          fpu_zero_page (f->kpage);
+        else
+          {
+            read_bytes = file_read_at (p->file, f->kpage, p->read_bytes,
+                                       p->file_ofs);
+            if (read_bytes != p->read_bytes)
+              goto fail;
+            memset (f->kpage + p->read_bytes, 0, p->zero_bytes);
+          }
+        around = p->advice != ADV_RANDOM;
         break;
       }
     
     case PG_SWAP:
-      swap_in (f->kpage, p->slot);
-      p->slot = BITMAP_ERROR;
+      if (p->advice != ADV_RANDOM)
+        ra_slot = p->slot;
+      page_swap_in (p, f->kpage);
       break;
     
     case PG_ZERO:
-      memset (f->kpage, 0, PGSIZE);
+      fpu_zero_page (f->kpage);
       break;
 
     case PG_UNKNOWN:
@@ -237,6 +956,17 @@ page_load (void *upage)
     goto fail;
 
   frame_lock_release (f);
+  page_count_fault (p, p->type != PG_ZERO);
+  prepage_record (p);
+
+  if (p->advice == ADV_SEQUENTIAL)
+    around_cnt *= SEQ_AROUND_FACTOR;
+  if (ra_slot != BITMAP_ERROR)
+    page_swap_readahead (p, ra_slot);
+  else if (around)
+    page_fault_around (p, around_cnt);
+  if (p->advice == ADV_SEQUENTIAL)
+    page_drop_behind (p, around_cnt + 1);
   return true;
 
  fail:
@@ -244,43 +974,866 @@ page_load (void *upage)
   return false;
 }
 
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
+/* Loads P, a page of a shared memory segment, by mapping it to
+   the frame that holds the segment's page, which is brought into
+   memory first if no process has it resident. */
 static bool
-install_page (void *upage, void *kpage, bool writable)
+page_load_shm (struct page *p)
 {
-  struct thread *t = thread_current ();
+  struct frame *f;
+  bool major, success;
 
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+  lock_acquire (&p->shm->lock);
+  f = frame_share_shm (p, &major);
+  success = install_page (p->upage, f->kpage, p->writable);
+  if (success)
+    frame_lock_release (f);
+  else
+    frame_detach (f, p);
+  lock_release (&p->shm->lock);
+
+  if (success)
+    page_count_fault (p, major);
+  return success;
 }
 
-/* Finds a SPTE corresponding to the given UPAGE.
-   If not found, returns NULL. */
-struct page *
-page_lookup (void *upage)
+/* Resolves a write fault on P, a copy-on-write page of the
+   current process whose frame F is locked by the current thread,
+   by mapping P writable to a frame of its own.  F is copied
+   unless P is the last page sharing it. */
+static bool
+page_unshare (struct page *p, struct frame *f)
 {
-  struct thread *cur = thread_current ();
-  struct page key;
-  struct hash_elem *e;
-
-  ASSERT (cur->spt != NULL);
-  ASSERT (is_user_vaddr (upage));
-  ASSERT (pg_ofs (upage) == 0);
+  uint32_t *pd = p->owner->pagedir;
+
+  f = frame_unshare (f, p);
+  p->cow = false;
+  if (pagedir_get_page (pd, p->upage) == f->kpage)
+    pagedir_set_writable (pd, p->upage, true);
+  else if (!install_page (p->upage, f->kpage, true))
+    {
+      frame_free (f);
+      return false;
+    }
+  frame_lock_release (f);
+
+  VMSTAT_ADD (cow_faults, 1);
+  page_count_fault (p, false);
+  return true;
+}
+
+/* Reads the contents of P from its swap slot into KPAGE. */
+static void
+page_swap_in (struct page *p, void *kpage)
+{
+  swap_read (kpage, p->slot);
+  page_swap_done (p);
+}
+
+/* Updates P once its contents have been read from its swap slot.
+
+   The slot is kept as a swap cache: P becomes clean, so that
+   evicting it again before it is written costs no I/O.  See
+   frame_do_eviction().  An mmap'ed page never comes from swap,
+   since it is written back to its file instead. */
+static void
+page_swap_done (struct page *p)
+{
+  ASSERT (!p->writeback);
+  p->dirty = false;
+}
+
+/* Reads in the pages following P, which has just been loaded
+   from swap slot SLOT, as long as they do reside in the slots
+   following SLOT.  At most the current process's readahead
+   window of pages are read, using only free frames.  All the
+   reads are queued at once, and then waited for.
+
+   The window grows when a prefetched page turns out to be used
+   and shrinks when one is evicted unused.  See
+   page_prefetch_feedback(). */
+static void
+page_swap_readahead (struct page *p, size_t slot)
+{
+  struct thread *cur = process_current ();
+  size_t window = cur->swap_ra_window;
+  struct frame *frames[SWAP_RA_MAX];
+  struct block_request reqs[SWAP_RA_MAX];
+  size_t cnt, k;
+
+  if (window > SWAP_RA_MAX)
+    window = SWAP_RA_MAX;
+
+  for (cnt = 0; cnt < window; cnt++)
+    {
+      void *upage = p->upage + (cnt + 1) * PGSIZE;
+      struct page *q;
+      struct frame *f;
+
+      if (!is_user_vaddr (upage) || upage < p->upage)
+        break;
+      q = page_find (upage);
+      if (q == NULL || q->frame != NULL)
+        break;
+      frame_wait_eviction (q);
+      if (q->type != PG_SWAP || q->slot != slot + cnt + 1)
+        break;
+
+      /* Q stays locked until its read completes. */
+      f = frame_try_alloc (q);
+      if (f == NULL)
+        break;
+
+      frames[cnt] = f;
+      swap_read_async (f->kpage, q->slot, &reqs[cnt]);
+    }
+
+  for (k = 0; k < cnt; k++)
+    {
+      struct frame *f = frames[k];
+      struct page *q = f->page;
+
+      block_wait (&reqs[k]);
+      swap_verify (f->kpage, q->slot);
+      page_swap_done (q);
+      if (!install_page (q->upage, f->kpage, q->writable))
+        {
+          frame_free (f);
+          continue;
+        }
+      q->prefetched = true;
+      frame_lock_release (f);
+    }
+}
+
+/* Maps the pages following P, which has just been loaded from
+   file, as long as they are not resident yet and continue P's
+   run of the same file.  At most CNT pages are read, using only
+   free frames. */
+static void
+page_fault_around (struct page *p, size_t cnt)
+{
+  size_t k;
+
+  for (k = 1; k <= cnt; k++)
+    {
+      void *upage = p->upage + k * PGSIZE;
+      struct page *q;
+      struct frame *f;
+
+      if (!is_user_vaddr (upage) || upage < p->upage)
+        break;
+      q = page_lookup (upage);
+      if (q == NULL || q->frame != NULL)
+        break;
+      frame_wait_eviction (q);
+      if (q->type != PG_FILE || q->file != p->file
+          || q->file_ofs != p->file_ofs + (off_t) (k * PGSIZE))
+        break;
+
+      f = frame_try_alloc (q);
+      if (f == NULL)
+        break;
+
+      if (!frame_publish (f)
+          || file_read_at (q->file, f->kpage, q->read_bytes, q->file_ofs)
+             != (off_t) q->read_bytes
+          || !install_page (q->upage, f->kpage, q->writable))
+        {
+          frame_free (f);
+          break;
+        }
+      memset (f->kpage + q->read_bytes, 0, q->zero_bytes);
+      q->prefetched = true;
+      fault_around_cnt++;
+      frame_lock_release (f);
+    }
+}
+
+/* Suggests the CNT pages that come CNT pages before P, which has
+   ADV_SEQUENTIAL advice and has just been loaded along with the
+   CNT - 1 pages after it, as the next victims of eviction, since
+   a sequential scan is unlikely to come back to them.  Each fault
+   thus gives up about as many pages as it brings in. */
+static void
+page_drop_behind (struct page *p, size_t cnt)
+{
+  size_t k;
+
+  for (k = cnt; k < 2 * cnt; k++)
+    {
+      void *upage = p->upage - k * PGSIZE;
+      struct page *q;
+
+      if (upage > p->upage)
+        break;
+      q = page_find (upage);
+      if (q != NULL && q->advice == ADV_SEQUENTIAL)
+        frame_drop_behind (q);
+    }
+}
+
+/* Maps the page of the current process loaded from offset OFS
+   of FILE, if some region maps it and it is not resident yet,
+   using only a free frame.  Returns true if the page was
+   mapped. */
+bool
+page_prefetch_file (struct file *file, off_t ofs)
+{
+  struct list *regions = &process_current ()->region_list;
+  struct region *r = NULL;
+  struct list_elem *e;
+  struct page *p;
+  struct frame *f;
+
+  for (e = list_begin (regions); e != list_end (regions);
+       e = list_next (e))
+    {
+      r = list_entry (e, struct region, list_elem);
+      if (r->file == file && ofs >= r->file_ofs
+          && ofs < r->file_ofs + r->length)
+        break;
+    }
+  if (e == list_end (regions) || ofs % PGSIZE != 0)
+    return false;
+
+  p = page_lookup (r->start + (ofs - r->file_ofs));
+  if (p == NULL || p->frame != NULL || p->type != PG_FILE)
+    return false;
+
+  f = frame_try_alloc (p);
+  if (f == NULL)
+    return false;
+  if (!frame_publish (f)
+      || file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+         != (off_t) p->read_bytes
+      || !install_page (p->upage, f->kpage, p->writable))
+    {
+      frame_free (f);
+      return false;
+    }
+  memset (f->kpage + p->read_bytes, 0, p->zero_bytes);
+  frame_lock_release (f);
+  return true;
+}
+
+/* Adds a mapping from user virtual address UPAGE to kernel
+   virtual address KPAGE to the page table.
+   If WRITABLE is true, the user process may modify the page;
+   otherwise, it is read-only.
+   UPAGE must not already be mapped.
+   KPAGE should probably be a page obtained from the user pool
+   with palloc_get_page().
+   Returns true on success, false if UPAGE is already mapped or
+   if memory allocation fails. */
+static bool
+install_page (void *upage, void *kpage, bool writable)
+{
+  struct thread *t = thread_current ();
+
+  /* Verify that there's not already a page at that virtual
+     address, then map our page there. */
+  return (pagedir_get_page (t->pagedir, upage) == NULL
+          && pagedir_set_page (t->pagedir, upage, kpage, writable));
+}
+
+/* Writes the modified pages among the PAGE_CNT pages of a file
+   mapping of the current process starting at UPAGE back to the
+   mapped file, and leaves them clean.  Each run of consecutive
+   modified pages, up to MSYNC_RUN_MAX of them, is written with a
+   single write, straight from the user pages, whose frames stay
+   locked meanwhile.  A page that is not resident has been
+   written back by its eviction already; this waits for that
+   write to complete.  Pages of a private mapping are never
+   written.  A frame shared with other mappings of the same file
+   is written if any of them has modified it. */
+void
+page_msync (void *upage, size_t page_cnt)
+{
+  struct page *run[MSYNC_RUN_MAX];
+  void *end = upage + page_cnt * PGSIZE;
+  size_t run_cnt = 0;
+
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_find (upage);
+      struct frame *f = NULL;
+
+      if (p != NULL && !p->writeback)
+        p = NULL;
+      if (p != NULL && (f = frame_lock_resident (p)) == NULL)
+        frame_wait_eviction (p);
+      else if (f != NULL && !frame_is_dirty (f))
+        {
+          frame_lock_release (f);
+          f = NULL;
+        }
+
+      if (f == NULL || run_cnt == MSYNC_RUN_MAX)
+        {
+          page_sync_run (run, run_cnt);
+          run_cnt = 0;
+        }
+      if (f != NULL)
+        run[run_cnt++] = p;
+    }
+  page_sync_run (run, run_cnt);
+}
+
+/* Writes the CNT pages in RUN, consecutive pages of the same
+   file mapping of the current process whose frames page_msync()
+   locked, back to the file, and unlocks the frames. */
+static void
+page_sync_run (struct page **run, size_t cnt)
+{
+  struct page *first;
+  off_t size = 0;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  /* Clear the dirty bits before writing, so that a write by the
+     process meanwhile makes the pages dirty again. */
+  for (i = 0; i < cnt; i++)
+    {
+      frame_mark_clean (run[i]->frame);
+      size += run[i]->read_bytes;
+    }
+
+  first = run[0];
+  file_write_at (first->file, first->upage, size, first->file_ofs);
+  VMSTAT_ADD (file_writes, cnt);
+
+  for (i = 0; i < cnt; i++)
+    frame_lock_release (run[i]->frame);
+}
+
+/* Loads those of the PAGE_CNT pages of a file mapping of the
+   current process starting at UPAGE that are not resident yet,
+   so that the process takes no faults on them later.  Each run
+   of consecutive such pages, up to MSYNC_RUN_MAX of them, is
+   read with a single read, straight into the user pages, whose
+   frames stay locked until the read completes.  If EVICT is
+   true, frames are allocated as page_load() does, evicting
+   others if needed; otherwise only free frames are used, and
+   loading stops when they run out. */
+void
+page_populate (void *upage, size_t page_cnt, bool evict)
+{
+  struct frame *run[MSYNC_RUN_MAX];
+  void *end = upage + page_cnt * PGSIZE;
+  size_t run_cnt = 0;
+
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+      struct frame *f = NULL;
+
+      if (p != NULL)
+        frame_wait_eviction (p);
+      if (p != NULL && p->frame == NULL && p->type == PG_FILE)
+        {
+          f = evict ? frame_alloc (p) : frame_try_alloc (p);
+          if (f == NULL)
+            break;
+
+          /* Writable for now, so that the read may fill it.  A page
+             of a shared file mapping that another process has
+             loaded meanwhile is left to a fault, to share. */
+          if (!frame_publish (f) || !install_page (upage, f->kpage, true))
+            {
+              frame_free (f);
+              f = NULL;
+            }
+        }
+
+      if (f == NULL || run_cnt == MSYNC_RUN_MAX)
+        {
+          page_populate_run (run, run_cnt);
+          run_cnt = 0;
+        }
+      if (f != NULL)
+        run[run_cnt++] = f;
+    }
+  page_populate_run (run, run_cnt);
+}
+
+/* Reads the contents of the CNT frames in RUN, allocated and
+   mapped by page_populate() for consecutive pages of the same
+   file mapping, from the file, and unlocks them.  If the read
+   fails, the pages are unmapped again, to be loaded by page
+   faults. */
+static void
+page_populate_run (struct frame **run, size_t cnt)
+{
+  struct page *first;
+  off_t size = 0;
+  bool success;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+
+  for (i = 0; i < cnt; i++)
+    size += run[i]->page->read_bytes;
+  first = run[0]->page;
+  success = file_read_at (first->file, first->upage, size,
+                          first->file_ofs) == size;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = run[i];
+      struct page *p = f->page;
+      uint32_t *pd = p->owner->pagedir;
+
+      if (!success)
+        {
+          pagedir_clear_page (pd, p->upage);
+          frame_free (f);
+          continue;
+        }
+      memset (f->kpage + p->read_bytes, 0, p->zero_bytes);
+      pagedir_set_dirty (pd, p->upage, false);
+      if (!p->writable)
+        pagedir_set_writable (pd, p->upage, false);
+      frame_lock_release (f);
+    }
+}
+
+/* Records ADVICE for the PAGE_CNT pages of the current process
+   starting at UPAGE, in their SPTEs and in the regions they lie
+   in, so that SPTEs created later get it too.  A region that
+   lies only partly in the range is split first, except for a
+   stack region, which only the existing SPTEs take the advice
+   for.  Returns false if memory for a split runs out. */
+bool
+page_advise (void *upage, size_t page_cnt, enum page_advice advice)
+{
+  struct thread *cur = process_current ();
+  void *end = upage + page_cnt * PGSIZE;
+  struct list_elem *e;
+
+  if (!region_split (upage) || !region_split (end))
+    return false;
+  for (e = list_begin (&cur->region_list);
+       e != list_end (&cur->region_list); e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, list_elem);
+      if (r->start >= end)
+        break;
+      if (r->start >= upage && !r->stack)
+        r->advice = advice;
+    }
+
+  /* Visit the SPTEs in the range, whichever way is cheaper. */
+  if (page_cnt <= ohash_size (cur->spt))
+    for (; upage < end; upage += PGSIZE)
+      {
+        struct page *p = page_find (upage);
+        if (p != NULL)
+          p->advice = advice;
+      }
+  else
+    {
+      struct ohash_iterator i;
+      ohash_first (&i, cur->spt);
+      while (ohash_next (&i))
+        {
+          struct page *p = ohash_entry (ohash_cur (&i), struct page,
+                                        hash_elem);
+          if (p->upage >= upage && p->upage < end)
+            p->advice = advice;
+        }
+    }
+  return true;
+}
+
+/* Splits the region of the current process that contains UPAGE
+   in two at UPAGE, unless UPAGE is its first page, no region
+   contains UPAGE or the region is a stack region.  Returns false
+   if memory runs out. */
+static bool
+region_split (void *upage)
+{
+  struct region *r = region_find (upage);
+  struct region *tail;
+  off_t ofs;
+
+  if (r == NULL || r->start == upage || r->stack)
+    return true;
+
+  tail = malloc (sizeof *tail);
+  if (tail == NULL)
+    return false;
+  *tail = *r;
+  if (tail->uffd != NULL)
+    uffd_dup (tail->uffd);
+  ofs = upage - r->start;
+  tail->start = upage;
+  tail->file_ofs += ofs;
+  tail->length = r->length > ofs ? r->length - ofs : 0;
+  tail->split = true;
+  r->end = upage;
+  if (r->length > ofs)
+    r->length = ofs;
+  list_insert (list_next (&r->list_elem), &tail->list_elem);
+  return true;
+}
+
+/* Gives up the memory and swap space of those of the PAGE_CNT
+   pages of the current process starting at UPAGE that have
+   SPTEs, which then load their pages afresh, from file or as
+   zeros, on their next access.  Changes to pages of shared file
+   mappings are written back first, and pages of shared memory
+   segments are left alone; changes to other pages are lost. */
+void
+page_dontneed (void *upage, size_t page_cnt)
+{
+  void *end = upage + page_cnt * PGSIZE;
+
+  page_msync (upage, page_cnt);
+  for (; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_find (upage);
+      if (p != NULL && p->type != PG_SHM)
+        page_discard (p);
+    }
+}
+
+/* Frees the frame and swap slot of P, a page of the current
+   process, keeping its SPTE, which is reset to load the page as
+   when it was created. */
+static void
+page_discard (struct page *p)
+{
+  struct thread *cur = thread_current ();
+  struct region *r = region_find (p->upage);
+  struct frame *f;
+
+  if (p->zero_mapped)
+    {
+      pagedir_clear_page (cur->pagedir, p->upage);
+      p->zero_mapped = false;
+    }
+  f = frame_lock_resident (p);
+  if (f != NULL)
+    frame_discard (f, p);
+  else
+    frame_wait_eviction (p);
+
+  if (p->slot != BITMAP_ERROR)
+    {
+      swap_free (p->slot);
+      p->slot = BITMAP_ERROR;
+    }
+  p->dirty = false;
+  p->cow = false;
+  p->prefetched = false;
+  p->test_epoch = 0;
+
+  if (r != NULL && !r->stack)
+    page_init_from_region (p, r);
+  else
+    p->type = PG_ZERO;
+}
+
+/* Finds a SPTE corresponding to the given UPAGE.
+   If UPAGE lies in a region but its SPTE does not exist yet, the
+   SPTE is created from the region.  If not found, returns
+   NULL. */
+struct page *
+page_lookup (void *upage)
+{
+  struct page *p = page_find (upage);
+  struct region *r;
+
+  if (p != NULL || (r = region_find (upage)) == NULL || r->stack)
+    return p;
+
+  p = page_new_entry (upage);
+  page_init_from_region (p, r);
+  return p;
+}
+
+/* Sets up P, a page in region R, to be loaded as R says. */
+static void
+page_init_from_region (struct page *p, struct region *r)
+{
+  off_t ofs = p->upage - r->start;
+
+  p->file = r->file;
+  p->file_ofs = r->file_ofs + ofs;
+  p->shm = r->shm;
+  if (r->shm != NULL)
+    {
+      p->read_bytes = 0;
+      p->type = PG_SHM;
+    }
+  else if (r->uffd != NULL)
+    {
+      p->read_bytes = 0;
+      p->type = PG_UFFD;
+    }
+  else if (r->length > ofs)
+    {
+      p->read_bytes = r->length - ofs < PGSIZE ? r->length - ofs : PGSIZE;
+      p->type = PG_FILE;
+    }
+  else
+    {
+      p->read_bytes = 0;
+      p->type = PG_ZERO;
+    }
+  p->zero_bytes = PGSIZE - p->read_bytes;
+  p->writable = r->writable;
+  p->writeback = r->writeback;
+  p->advice = r->advice;
+}
+
+/* Finds an existing SPTE corresponding to the given UPAGE.
+   If not found, returns NULL. */
+static struct page *
+page_find (void *upage)
+{
+  struct thread *cur = thread_current ();
+  struct page key;
+  struct ohash_elem *e;
+
+  ASSERT (cur->spt != NULL);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pg_ofs (upage) == 0);
 
   key.upage = upage;
-  e = hash_find (cur->spt, &key.hash_elem);
+  e = ohash_find (cur->spt, &key.hash_elem);
+
+  return e != NULL ? ohash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Returns true if UPAGE, a user virtual page of the current
+   process, is mapped read-only only until it is first written,
+   either to the shared zero page or to a frame shared
+   copy-on-write, so that a write fault on it is to be resolved
+   by page_load(). */
+bool
+page_is_copy_on_write (void *upage)
+{
+  struct page *p = page_find (upage);
+  return p != NULL && (p->zero_mapped || p->cow);
+}
+
+/* Makes the address space of the current process, which must be
+   empty, a copy of that of PARENT, which must be blocked
+   waiting for the copy to complete, for fork().
+
+   Resident pages are not copied: the frames of PARENT are shared
+   with the current process, read-only, and a writable page gets
+   a frame of its own on its first write in either process.  See
+   page_unshare().  Only swapped-out pages are copied to new swap
+   slots.  Memory mappings, including those of shared memory
+   segments, are not inherited, nor are the stack regions of
+   the other threads of PARENT's process: the copy has one
+   thread, whose stack is PARENT's.
+
+   The executable pages of PARENT are reloaded from the current
+   thread's BIN, which must already be open.  Returns true if
+   successful. */
+bool
+page_copy_spt (struct thread *parent)
+{
+  struct thread *cur = thread_current ();
+  struct thread *leader = process_leader (parent);
+  struct ohash_iterator i;
+  struct list_elem *e;
+  void *buf;
+  bool success = true;
+
+  ASSERT (ohash_empty (cur->spt));
+  ASSERT (list_empty (&cur->region_list));
+
+  for (e = list_begin (&leader->region_list);
+       e != list_end (&leader->region_list); e = list_next (e))
+    {
+      struct region *r = list_entry (e, struct region, list_elem);
+      struct region *copy;
 
-  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+      /* Mappings made by mmap() and shm_map() are not
+         inherited. */
+      if (r->shm != NULL
+          || (r->file != NULL && inherited_file (r->file, leader) == NULL)
+          || (r->stack && r != parent->stack_region))
+        continue;
+      copy = malloc (sizeof *copy);
+      if (copy == NULL)
+        return false;
+      *copy = *r;
+      copy->uffd = NULL;
+      if (copy->file != NULL)
+        copy->file = inherited_file (r->file, leader);
+      list_push_back (&cur->region_list, &copy->list_elem);
+      if (r == parent->stack_region)
+        cur->stack_region = copy;
+    }
+  cur->stack_low = parent->stack_low;
+  cur->heap_start = leader->heap_start;
+  cur->brk = leader->brk;
+
+  /* A bounce buffer for copying swap slots. */
+  buf = palloc_get_page (0);
+  if (buf == NULL)
+    return false;
+
+  ohash_first (&i, parent->spt);
+  while (success && ohash_next (&i))
+    {
+      struct page *p = ohash_entry (ohash_cur (&i), struct page,
+                                    hash_elem);
+      if (p->type != PG_SHM
+          && (p->file == NULL || inherited_file (p->file, leader) != NULL))
+        success = page_copy (p, parent, buf);
+    }
+  palloc_free_page (buf);
+  return success;
+}
+
+/* Returns the current process's copy of FILE, which LEADER
+   mapped, if it is LEADER's executable or shared library, or a
+   null pointer if FILE was mapped by mmap(), whose mappings
+   fork() does not inherit. */
+static struct file *
+inherited_file (struct file *file, struct thread *leader)
+{
+  struct thread *cur = thread_current ();
+
+  if (file == leader->bin)
+    return cur->bin;
+  else if (file != NULL && file == leader->lib)
+    return cur->lib;
+  else
+    return NULL;
+}
+
+/* Creates a copy of PARENT's page P in the current process, for
+   page_copy_spt().  BUF is a page of kernel memory to copy swap
+   slots through.  Returns true if successful. */
+static bool
+page_copy (struct page *p, struct thread *parent, void *buf)
+{
+  struct page *q = page_new_entry (p->upage);
+  struct frame *f;
+
+  q->type = p->type;
+  q->file = inherited_file (p->file, process_leader (parent));
+  q->file_ofs = p->file_ofs;
+  q->read_bytes = p->read_bytes;
+  q->zero_bytes = p->zero_bytes;
+  q->writable = p->writable;
+  q->advice = p->advice;
+
+  if (p->zero_mapped)
+    {
+      q->zero_mapped = true;
+      zero_map_cnt++;
+      return install_page (q->upage, zero_kpage, false);
+    }
+
+  f = frame_lock_resident (p);
+  if (f == NULL)
+    {
+      /* PARENT cannot load P meanwhile, so once any eviction
+         completes, P's contents stay where they are. */
+      frame_wait_eviction (p);
+      if (p->type == PG_SWAP)
+        {
+          /* Out of swap space, the fork fails. */
+          swap_read (buf, p->slot);
+          q->slot = swap_try_out (buf, BITMAP_ERROR);
+          if (q->slot == BITMAP_ERROR)
+            {
+              q->type = PG_ZERO;
+              return false;
+            }
+        }
+      return true;
+    }
+
+  if (p->writable)
+    {
+      /* From now on neither process writes the frame in place,
+         until the other no longer shares it.  Its contents are
+         not in Q's backing store if they were modified, or if
+         they are clean only with respect to P's swap slot. */
+      p->dirty |= pagedir_is_dirty (parent->pagedir, p->upage);
+      pagedir_set_writable (parent->pagedir, p->upage, false);
+      p->cow = q->cow = true;
+      q->dirty = p->dirty || p->type == PG_SWAP;
+    }
+
+  frame_add_sharer (f, q);
+  if (!install_page (q->upage, f->kpage, false))
+    {
+      frame_detach (f, q);
+      return false;
+    }
+  frame_lock_release (f);
+  return true;
+}
+
+/* Brings the page of the current process that contains UADDR
+   into memory and locks its frame, so that it is not evicted
+   until page_unpin(), and returns the kernel virtual address that
+   corresponds to UADDR.  The kernel may then copy to or from the
+   user page through that address, without faulting.  The page is
+   marked accessed and, if WRITE, dirty, as a user access would.
+
+   Returns a null pointer if UADDR is not in a page the process
+   may access, or, if WRITE, may write.  As in the page fault
+   handler, an address just below the stack grows it. */
+void *
+page_pin (const void *uaddr, bool write)
+{
+  struct thread *cur = thread_current ();
+  void *upage = pg_round_down (uaddr);
+  struct page *p;
+  struct frame *f;
+
+  if (!is_user_vaddr (uaddr))
+    return NULL;
+
+  p = page_lookup (upage);
+  if (p == NULL && page_in_stack (uaddr)
+      && uaddr >= cur->saved_esp - 32 && page_grow_stack (upage))
+    p = page_lookup (upage);
+  if (p == NULL || (write && !p->writable))
+    return NULL;
+
+  /* Loading as if for writing gives a zero page a frame of its
+     own, rather than the shared zero page, which has none to lock.
+     The mapping still follows P's permissions.  A copy-on-write
+     page about to be written needs a frame of its own, too. */
+  while ((f = frame_lock_resident (p)) == NULL || (write && p->cow))
+    {
+      if (f != NULL)
+        frame_lock_release (f);
+      if (!page_load (upage, true))
+        return NULL;
+    }
+
+  pagedir_set_accessed (cur->pagedir, upage, true);
+  if (write)
+    pagedir_set_dirty (cur->pagedir, upage, true);
+  return f->kpage + pg_ofs (uaddr);
+}
+
+/* Unlocks the frame that page_pin() locked and returned kernel
+   address KADDR within.  Needs no lock on the address space: the
+   frame, rather than the page, is looked up, so that a thread
+   unmapping the page meanwhile, which waits for the frame with
+   the address space locked, cannot deadlock with this one. */
+void
+page_unpin (const void *kaddr)
+{
+  frame_lock_release (frame_of_kpage (pg_round_down (kaddr)));
 }
 
 /* Returns true, only if the PTE for user virtual page UPAGE
@@ -296,8 +1849,95 @@ page_was_accessed (struct page *p)
 
   uint32_t *pd = p->owner->pagedir;
   void *upage = p->upage;
-  bool accessed = pagedir_is_accessed (pd, upage);
-  pagedir_set_accessed (pd, upage, false);
+  uint32_t *pte = page_pte (p);
+  bool accessed;
+
+  if (pte != NULL)
+    accessed = pagedir_pte_test_and_clear_accessed (pd, pte, upage);
+  else
+    {
+      accessed = pagedir_is_accessed (pd, upage);
+      pagedir_set_accessed (pd, upage, false);
+    }
+
+  if (accessed && p->prefetched)
+    page_prefetch_feedback (p, true);
 
   return accessed;
-}
\ No newline at end of file
+}
+
+/* Returns true if the PTE for P's page in its owner's page
+   directory is dirty, as pagedir_is_dirty(). */
+bool
+page_pte_is_dirty (struct page *p)
+{
+  uint32_t *pte = page_pte (p);
+
+  return (pte != NULL ? pagedir_pte_is_dirty (pte)
+          : pagedir_is_dirty (p->owner->pagedir, p->upage));
+}
+
+/* Unmaps P's page from its owner's page directory, as
+   pagedir_clear_page(). */
+void
+page_pte_clear (struct page *p)
+{
+  uint32_t *pte = page_pte (p);
+
+  if (pte != NULL)
+    pagedir_pte_clear (p->owner->pagedir, pte, p->upage);
+  else
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+}
+
+/* Returns the address of the PTE for P's page in its owner's
+   page directory, looking it up the first time only, so that
+   the eviction scans skip walking the page directory.  Returns
+   a null pointer if there is no page table for the page yet. */
+static uint32_t *
+page_pte (struct page *p)
+{
+  if (p->pte == NULL)
+    p->pte = pagedir_lookup_pte (p->owner->pagedir, p->upage);
+  return p->pte;
+}
+
+/* Records that P was read in ahead of time and then either
+   accessed (HIT is true) or evicted unused (HIT is false).
+   For swap readahead, adjusts the readahead window of P's owner.
+   Must be called with the frame table lock held. */
+void
+page_prefetch_feedback (struct page *p, bool hit)
+{
+  struct thread *t = p->owner;
+
+  ASSERT (p->prefetched);
+
+  p->prefetched = false;
+  if (p->type == PG_FILE)
+    {
+      if (hit)
+        fault_around_hit_cnt++;
+    }
+  else if (hit)
+    {
+      if (t->swap_ra_window < SWAP_RA_MAX)
+        t->swap_ra_window++;
+    }
+  else if (t->swap_ra_window > 1)
+    t->swap_ra_window /= 2;
+}
+
+/* Prints paging statistics. */
+void
+page_print_stats (void)
+{
+  printf ("Fault-around: %zu pages mapped, %zu accessed\n",
+          fault_around_cnt, fault_around_hit_cnt);
+  printf ("Zero page: %zu mappings\n", zero_map_cnt);
+  printf ("Stack: %zu growth faults, %zu pages mapped in advance\n",
+          stack_grow_cnt, stack_batch_cnt);
+  printf ("User faults: %zu reported, %zu pages filled in, "
+          "%zu zeroed without a handler\n",
+          uffd_fault_cnt, uffd_fill_cnt, uffd_zero_cnt);
+}
@@ -3,17 +3,47 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <hash.h>
+#include <list.h>
 #include "threads/thread.h"
 #include "filesys/off_t.h"
 
+/* Bounds of each process's swap readahead window, in pages.
+   See page_load(). */
+#define SWAP_RA_INIT 4                  /* Initial window. */
+#define SWAP_RA_MAX 16                  /* Maximum window. */
+
+/* Size of each process's stack reservation, 8 MB. */
+#define STACK_MAX_SIZE (8 * 1024 * 1024)
+
+/* Size of the stack reservation of each further thread of a
+   process, 1 MB, and how many of them fit below the first. */
+#define THREAD_STACK_SIZE (1024 * 1024)
+#define THREAD_STACK_MAX 64
+
+extern size_t page_fault_around_pages;
+extern size_t page_stack_batch;
+
+/* How a process expects to access a range of its pages, as told
+   by madvise(). */
+enum page_advice
+  {
+    ADV_NORMAL,                         /* No expectation. */
+    ADV_RANDOM,                         /* No fault-around. */
+    ADV_SEQUENTIAL                      /* Wide fault-around,
+                                           drop-behind. */
+  };
+
 /* How to load user virtual pages? */
 enum page_type
   {
     PG_FILE = 1,                        /* Load from file. */
     PG_SWAP = 2,                        /* Load from swap slot. */
     PG_ZERO = 3,                        /* Zero page contents. */
-    PG_UNKNOWN = 4                      /* Unknown (for debugging purposes). */
+    PG_UNKNOWN = 4,                     /* Unknown (for debugging purposes). */
+    PG_SHM = 5,                         /* Page of a shared memory segment. */
+    PG_UFFD = 6                         /* Filled in by user fault handler. */
   };
 
 /* A supplemental page table entry (SPTE) which provides
@@ -57,8 +87,9 @@ struct page
     bool writable;
 
     /* If DIRTY is false, the contents of UPAGE has not been
-       modified; otherwise the contents has been changed at least
-       once.
+       modified since it was last loaded from its backing store,
+       that is, its file or swap slot; otherwise the contents has
+       been changed at least once.
        
        Notice that the contents reside in the corresponding physical
        frame, and this frame could be evicted.  When a physical frame
@@ -70,27 +101,130 @@ struct page
     /* How to load this page? */
     enum page_type type;
 
-    /* Used if TYPE is PG_FILE. */
+    /* Used if TYPE is PG_FILE, FILE_OFS also if TYPE is
+       PG_SHM. */
     struct file *file;                  /* File. */
     off_t file_ofs;                     /* Offset. */
     size_t read_bytes;                  /* File read amount. */
     size_t zero_bytes;                  /* PGSIZE - READ_BYTES. */
+    bool writeback;                     /* Write changes back to FILE? */
 
     /* Used if TYPE is PG_SWAP. */
     size_t slot;                        /* Index of swap slot. */
 
-    struct hash_elem hash_elem;         /* Hash element. */
+    /* Used if TYPE is PG_SHM: the segment whose page at offset
+       FILE_OFS this page maps.  The page never changes type:
+       wherever the segment's page resides, see shm.h. */
+    struct shm *shm;
+
+    /* If IN_TRANSIT is true, the frame of this page has already
+       been given to another SPTE, but its previous contents are
+       still being written to swap by the evicting thread.  TYPE
+       and SLOT are not valid until the write completes.
+       See frame_wait_eviction(). */
+    bool in_transit;
+
+    /* If ZERO_MAPPED is true, this PG_ZERO page has only been
+       read so far, and UPAGE is mapped read-only to the shared
+       zero page rather than to a frame of its own. */
+    bool zero_mapped;
+
+    /* If COW is true, this writable page is mapped read-only to a
+       frame shared with another process since fork(), and the
+       first write gives it a copy of its own.  Protected by the
+       frame's lock, like FRAME. */
+    bool cow;
+
+    /* PREFETCHED is true if this page was read in by swap
+       readahead and has not been accessed since. */
+    bool prefetched;
+
+    /* Nonzero if this page was evicted during its CLOCK-Pro test
+       period: the hot hand revolution it was evicted in.  See
+       frame.c. */
+    unsigned test_epoch;
+
+    /* Access pattern hint, from the page's region when the SPTE
+       was created or from a later madvise().  See page_load(). */
+    enum page_advice advice;
+
+    /* Element in the SHARERS list of FRAME, if this page maps a
+       frame shared with other processes but is not the frame's
+       PAGE.  See frame.h. */
+    struct list_elem share_elem;
+
+    /* Address of UPAGE's PTE in the owner's page directory, once
+       looked up, or a null pointer.  Page tables are only freed
+       along with the page directory, so it stays valid as long as
+       the SPTE does.  See page_pte(). */
+    uint32_t *pte;
+
+    struct ohash_elem hash_elem;        /* Element in owner's SPT. */
+  };
+
+void page_init (void);
+
+/* A region of a process's address space whose pages are loaded
+   from the same file run or filled with zeros.  The SPTE of each
+   page in a region is only created on first use, by
+   page_lookup(), so that mapping a region costs the same however
+   large it is. */
+struct region
+  {
+    void *start;                        /* First user page. */
+    void *end;                          /* Just past the last page. */
+    struct file *file;                  /* File. */
+    off_t file_ofs;                     /* Offset of START in FILE. */
+    off_t length;                       /* Bytes of FILE, then zeros. */
+    bool writable;                      /* Writable pages? */
+    bool writeback;                     /* Write changes to FILE? */
+    struct shm *shm;                    /* Segment, if not FILE. */
+    struct uffd *uffd;                  /* User fault handler, or null. */
+    enum page_advice advice;            /* Hint for new SPTEs. */
+    bool split;                         /* Split off the previous one? */
+    bool stack;                         /* A thread's stack region? */
+    struct list_elem list_elem;         /* Element in region list. */
   };
 
-struct hash *page_create_spt (void);
-void page_destroy_spt (struct hash *);
+struct ohash *page_create_spt (void);
+void page_destroy_spt (struct ohash *);
+
+bool page_map_region (void *upage, size_t page_cnt, struct file *,
+                      off_t ofs, off_t length,
+                      bool writable, bool writeback);
+bool page_map_shm (void *upage, size_t page_cnt, struct shm *);
+bool page_map_uffd (void *upage, size_t page_cnt, struct uffd *);
+bool page_uffd_resolve (void *upage, const void *kpage);
+void page_uffd_exit (void);
+void page_unmap_region (void *upage);
+void page_msync (void *upage, size_t page_cnt);
+void page_populate (void *upage, size_t page_cnt, bool evict);
+bool page_advise (void *upage, size_t page_cnt, enum page_advice);
+void page_dontneed (void *upage, size_t page_cnt);
+void page_destroy_regions (void);
+bool page_reserve_stack (size_t page_cnt);
+void *page_reserve_thread_stack (void);
+void page_release_stack (void);
+bool page_in_stack (const void *);
+bool page_grow_stack (void *upage);
+void page_init_heap (void *heap);
+void *page_sbrk (intptr_t increment);
 
 struct page *page_make_entry (void *);
 void page_remove_entry (struct page *);
 
-bool page_load (void *);
+bool page_load (void *, bool write);
 struct page *page_lookup (void *);
+bool page_is_copy_on_write (void *);
+bool page_copy_spt (struct thread *parent);
+bool page_prefetch_file (struct file *, off_t);
+void *page_pin (const void *, bool write);
+void page_unpin (const void *kaddr);
 
 bool page_was_accessed (struct page *);
+bool page_pte_is_dirty (struct page *);
+void page_pte_clear (struct page *);
+void page_prefetch_feedback (struct page *, bool hit);
+void page_print_stats (void);
 
 #endif /* vm/page.h */
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "vm/pff.h"
+#include <debug.h>
+#include <stddef.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "vm/frame.h"
+
+/* Page-fault-frequency (PFF) replacement and load control.
+
+   Every PFF_PERIOD, the "pff" thread samples the number of major
+   faults each process took since the last sample, its fault
+   rate.  A process faulting more than PFF_HIGH times per period
+   needs more frames; one faulting fewer than PFF_LOW times can
+   spare some.  When the user pool runs out, frame_alloc() takes
+   the victim from the faulting process itself if it is below
+   PFF_LOW, otherwise from the process with the lowest rate below
+   PFF_LOW, and only then by the global replacement policy, which
+   cannot tell a thrashing process from an idle one.
+
+   If some process is above PFF_HIGH while none is below PFF_LOW
+   and the user pool is low, demand exceeds memory.  The
+   lowest-priority process above PFF_HIGH is then suspended at its
+   next page fault from user mode: not running, it stops faulting
+   and its frames go to the others.  One suspended process is
+   resumed per period once no process is above PFF_HIGH any more
+   or the user pool has room again.
+
+   Enabled by kernel command-line option "-pff". */
+bool pff_enabled;
+
+/* Fault rate thresholds, in major faults per period.
+   Controlled by kernel command-line options "-ph" and "-pl". */
+unsigned pff_high = 16;
+unsigned pff_low = 2;
+
+/* Sampling period, in timer ticks. */
+#define PFF_PERIOD (TIMER_FREQ / 4)
+
+/* What a sampling pass found out about the processes. */
+struct pff_census
+  {
+    struct thread *thrashing;   /* Lowest priority above PFF_HIGH. */
+    struct thread *suspended;   /* Highest priority suspended. */
+    size_t thrashing_cnt;       /* Running processes above PFF_HIGH. */
+    size_t donor_cnt;           /* Processes below PFF_LOW with frames. */
+    size_t running_cnt;         /* Processes not suspended. */
+  };
+
+/* A search for the process to take a frame from. */
+struct pff_search
+  {
+    struct thread *taker;       /* Process that needs a frame. */
+    struct thread *donor;       /* Best donor so far, or null. */
+  };
+
+static thread_func pff_thread NO_RETURN;
+static thread_action_func pff_sample;
+static thread_action_func pff_find_donor;
+static void pff_resume (struct thread *);
+
+/* Starts the sampling thread, if PFF is enabled. */
+void
+pff_init (void)
+{
+  if (pff_enabled)
+    thread_create ("pff", PRI_MAX, pff_thread, NULL);
+}
+
+/* Returns the process that TAKER, the current process, should
+   take its next frame from, or a null pointer to leave the
+   choice to the replacement policy.  Called by frame_alloc() when
+   the user pool is exhausted. */
+struct thread *
+pff_donor (struct thread *taker)
+{
+  struct pff_search s;
+
+  if (!pff_enabled)
+    return NULL;
+  if (taker->pff_rate < pff_low && taker->rss > 0)
+    return taker;
+
+  s.taker = taker;
+  s.donor = NULL;
+  thread_foreach (pff_find_donor, &s);
+  return s.donor;
+}
+
+/* Considers T as a donor for the search AUX. */
+static void
+pff_find_donor (struct thread *t, void *aux)
+{
+  struct pff_search *s = aux;
+
+  if (t == s->taker || t->pagedir == NULL || t->rss == 0
+      || t->pff_rate >= pff_low)
+    return;
+  if (s->donor == NULL || t->pff_rate < s->donor->pff_rate
+      || (t->pff_rate == s->donor->pff_rate && t->rss > s->donor->rss))
+    s->donor = t;
+}
+
+/* Called on each page fault from user mode.  Blocks the current
+   process while it is suspended for load control. */
+void
+pff_throttle (void)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (!pff_enabled)
+    return;
+
+  old_level = intr_disable ();
+  while (cur->pff_suspended)
+    {
+      cur->pff_waiting = true;
+      thread_block ();
+    }
+  intr_set_level (old_level);
+}
+
+/* Samples the fault rates of all processes every PFF_PERIOD, and
+   suspends or resumes a process when needed. */
+static void
+pff_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct pff_census c = {NULL, NULL, 0, 0, 0};
+      enum intr_level old_level;
+      bool low;
+
+      timer_sleep (PFF_PERIOD);
+
+      low = palloc_free_cnt (PAL_USER) < frame_free_low;
+      old_level = intr_disable ();
+      thread_foreach (pff_sample, &c);
+      if (c.suspended != NULL && (c.thrashing_cnt == 0 || !low))
+        pff_resume (c.suspended);
+      else if (c.thrashing != NULL && c.donor_cnt == 0 && low
+               && c.running_cnt > 1)
+        c.thrashing->pff_suspended = true;
+      intr_set_level (old_level);
+    }
+}
+
+/* Samples the fault rate of T into the census AUX. */
+static void
+pff_sample (struct thread *t, void *aux)
+{
+  struct pff_census *c = aux;
+
+  if (t->pagedir == NULL)
+    return;
+
+  t->pff_rate = (unsigned) (t->vmstat.major_faults - t->pff_last);
+  t->pff_last = t->vmstat.major_faults;
+
+  if (t->pff_rate < pff_low && t->rss > 0)
+    c->donor_cnt++;
+  if (t->pff_suspended)
+    {
+      if (c->suspended == NULL || t->priority > c->suspended->priority)
+        c->suspended = t;
+      return;
+    }
+
+  c->running_cnt++;
+  if (t->pff_rate > pff_high)
+    {
+      c->thrashing_cnt++;
+      if (c->thrashing == NULL || t->priority < c->thrashing->priority)
+        c->thrashing = t;
+    }
+}
+
+/* Resumes T, which is suspended. */
+static void
+pff_resume (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  t->pff_suspended = false;
+  if (t->pff_waiting)
+    {
+      t->pff_waiting = false;
+      thread_unblock (t);
+    }
+}
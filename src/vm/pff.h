@@ -0,0 +1,15 @@
+#ifndef VM_PFF_H
+#define VM_PFF_H
+
+#include <stdbool.h>
+#include "threads/thread.h"
+
+extern bool pff_enabled;
+extern unsigned pff_high;
+extern unsigned pff_low;
+
+void pff_init (void);
+struct thread *pff_donor (struct thread *taker);
+void pff_throttle (void);
+
+#endif /* vm/pff.h */
@@ -0,0 +1,123 @@
+#include "vm/prepage.h"
+#include <debug.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+
+/* Prepaging from recorded fault traces.
+
+   The first time an executable runs, the file offsets of the
+   first PREPAGE_MAX pages of the executable it faults in are
+   recorded, and written at exit to a trace file named after the
+   executable with a ".pf" suffix.  On later runs, load() reads
+   the trace and maps those pages before the process starts, so
+   it does not fault on them one by one.  Remove the trace file
+   to record a new one.
+
+   Enabled by kernel command-line option "-pp". */
+bool prepage_enabled;
+
+static bool trace_name (char name[NAME_MAX + 1], const char *exec_name);
+static int compare_ofs (const void *, const void *);
+
+/* Called by load(), with the file system lock held, once the
+   executable BIN named EXEC_NAME is mapped.  Prefetches the pages
+   in EXEC_NAME's trace, or starts recording one if there is
+   none. */
+void
+prepage_start (const char *exec_name, struct file *bin)
+{
+  struct thread *cur = thread_current ();
+  char name[NAME_MAX + 1];
+  struct file *trace;
+  off_t ofs[PREPAGE_MAX];
+  size_t cnt, i;
+
+  if (!prepage_enabled || !trace_name (name, exec_name))
+    return;
+
+  trace = filesys_open (name);
+  if (trace == NULL)
+    {
+      cur->fault_trace = malloc (PREPAGE_MAX * sizeof *cur->fault_trace);
+      cur->fault_trace_cnt = 0;
+      return;
+    }
+
+  cnt = file_read (trace, ofs, sizeof ofs) / sizeof *ofs;
+  file_close (trace);
+
+  /* Read the pages in file order. */
+  qsort (ofs, cnt, sizeof *ofs, compare_ofs);
+  for (i = 0; i < cnt; i++)
+    page_prefetch_file (bin, ofs[i]);
+}
+
+/* Records a fault on P, if the current process is recording a
+   trace and P is a page of its executable. */
+void
+prepage_record (const struct page *p)
+{
+  struct thread *cur = process_current ();
+  size_t i;
+
+  if (cur->fault_trace == NULL || p->type != PG_FILE || p->file != cur->bin
+      || cur->fault_trace_cnt >= PREPAGE_MAX)
+    return;
+
+  /* A page faults again if it was evicted. */
+  for (i = 0; i < cur->fault_trace_cnt; i++)
+    if (cur->fault_trace[i] == p->file_ofs)
+      return;
+  cur->fault_trace[cur->fault_trace_cnt++] = p->file_ofs;
+}
+
+/* Called by process_exit(), with the file system lock held.
+   Writes the trace recorded for executable EXEC_NAME, if any. */
+void
+prepage_finish (const char *exec_name)
+{
+  struct thread *cur = thread_current ();
+  char name[NAME_MAX + 1];
+  off_t size = cur->fault_trace_cnt * sizeof *cur->fault_trace;
+  struct file *trace;
+
+  if (cur->fault_trace == NULL)
+    return;
+
+  if (size > 0 && trace_name (name, exec_name)
+      && filesys_create (name, size))
+    {
+      trace = filesys_open (name);
+      if (trace != NULL)
+        {
+          file_write (trace, cur->fault_trace, size);
+          file_close (trace);
+        }
+    }
+  free (cur->fault_trace);
+  cur->fault_trace = NULL;
+}
+
+/* Stores the name of EXEC_NAME's trace file into NAME.  Returns
+   false if the name would be too long. */
+static bool
+trace_name (char name[NAME_MAX + 1], const char *exec_name)
+{
+  return (size_t) snprintf (name, NAME_MAX + 1, "%s.pf", exec_name)
+         <= NAME_MAX;
+}
+
+/* Compares file offsets A and B. */
+static int
+compare_ofs (const void *a_, const void *b_)
+{
+  const off_t *a = a_, *b = b_;
+  return *a < *b ? -1 : *a > *b;
+}
@@ -0,0 +1,16 @@
+#ifndef VM_PREPAGE_H
+#define VM_PREPAGE_H
+
+#include <stdbool.h>
+#include "vm/page.h"
+
+/* Maximum number of faults recorded per executable. */
+#define PREPAGE_MAX 64
+
+extern bool prepage_enabled;
+
+void prepage_start (const char *exec_name, struct file *bin);
+void prepage_record (const struct page *);
+void prepage_finish (const char *exec_name);
+
+#endif /* vm/prepage.h */
@@ -0,0 +1,143 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "vm/swap.h"
+
+/* Segments that are still linked, by name. */
+static struct list shm_list;
+
+/* Protects SHM_LIST and the LINKED and REF_CNT members of every
+   segment. */
+static struct lock shm_list_lock;
+
+static void shm_destroy (struct shm *);
+
+/* Initializes the shared memory segment table. */
+void
+shm_init (void)
+{
+  list_init (&shm_list);
+  lock_init (&shm_list_lock);
+}
+
+/* Returns the linked segment called NAME, or a null pointer if
+   there is none. */
+static struct shm *
+shm_find (const char *name)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&shm_list_lock));
+
+  for (e = list_begin (&shm_list); e != list_end (&shm_list);
+       e = list_next (e))
+    {
+      struct shm *s = list_entry (e, struct shm, list_elem);
+      if (!strcmp (s->name, name))
+        return s;
+    }
+  return NULL;
+}
+
+/* Returns the segment called NAME, with a reference added for a
+   new mapping of its first PAGE_CNT pages.  Creates a zero-filled
+   segment of PAGE_CNT pages if there is no such segment.
+   Returns a null pointer if NAME is too long or empty, if the
+   existing segment has fewer than PAGE_CNT pages, or if memory
+   is short. */
+struct shm *
+shm_open (const char *name, size_t page_cnt)
+{
+  struct shm *s;
+  size_t i;
+
+  if (*name == '\0' || strlen (name) > SHM_NAME_MAX || page_cnt == 0)
+    return NULL;
+
+  lock_acquire (&shm_list_lock);
+  s = shm_find (name);
+  if (s != NULL)
+    {
+      if (s->page_cnt >= page_cnt)
+        atomic_inc (&s->ref_cnt);
+      else
+        s = NULL;
+      lock_release (&shm_list_lock);
+      return s;
+    }
+
+  s = malloc (sizeof *s + page_cnt * sizeof *s->pages);
+  if (s != NULL)
+    {
+      strlcpy (s->name, name, sizeof s->name);
+      s->linked = true;
+      atomic_set (&s->ref_cnt, 2);
+      lock_init (&s->lock);
+      s->page_cnt = page_cnt;
+      for (i = 0; i < page_cnt; i++)
+        {
+          s->pages[i].frame = NULL;
+          s->pages[i].slot = BITMAP_ERROR;
+          s->pages[i].dirty = false;
+          s->pages[i].in_transit = false;
+        }
+      list_push_back (&shm_list, &s->list_elem);
+    }
+  lock_release (&shm_list_lock);
+  return s;
+}
+
+/* Drops the reference to S of a mapping that has been removed,
+   freeing S if it was the last one.  This takes no lock: while S
+   is linked its name holds a reference, so the count only drops
+   to 0 once S can no longer be found, and shm_open() cannot add
+   a reference meanwhile. */
+void
+shm_close (struct shm *s)
+{
+  ASSERT (atomic_read (&s->ref_cnt) > 0);
+  if (atomic_dec_and_test (&s->ref_cnt))
+    shm_destroy (s);
+}
+
+/* Removes the name of the segment called NAME, so that the next
+   shm_open() of NAME creates a new segment.  The segment itself
+   lasts until it is no longer mapped.  Returns false if there is
+   no such segment. */
+bool
+shm_unlink (const char *name)
+{
+  struct shm *s;
+
+  lock_acquire (&shm_list_lock);
+  s = shm_find (name);
+  if (s != NULL)
+    {
+      list_remove (&s->list_elem);
+      s->linked = false;
+    }
+  lock_release (&shm_list_lock);
+
+  if (s == NULL)
+    return false;
+  shm_close (s);
+  return true;
+}
+
+/* Frees S, which nobody maps any more, and its swap slots. */
+static void
+shm_destroy (struct shm *s)
+{
+  size_t i;
+
+  ASSERT (!s->linked);
+
+  for (i = 0; i < s->page_cnt; i++)
+    {
+      ASSERT (s->pages[i].frame == NULL);
+      if (s->pages[i].slot != BITMAP_ERROR)
+        swap_free (s->pages[i].slot);
+    }
+  free (s);
+}
@@ -0,0 +1,54 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <atomic.h>
+#include <bitmap.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Maximum length of a shared memory segment's name. */
+#define SHM_NAME_MAX 14
+
+/* A page of a shared memory segment.
+
+   While the page is resident, FRAME holds it and each process
+   mapping the page is one of the pages sharing FRAME, mapped
+   writable; see frame.h.  Otherwise its contents are in SLOT, or
+   are all zeros if SLOT is BITMAP_ERROR.  SLOT may also be kept
+   while the page is resident, as a copy that is valid unless
+   DIRTY is true.
+
+   FRAME and IN_TRANSIT are protected by the frame table's lock,
+   SLOT and DIRTY by the lock of FRAME while the page is
+   resident.  See frame_share_shm(). */
+struct shm_page
+  {
+    struct frame *frame;                /* Frame, or null. */
+    size_t slot;                        /* Swap slot, or BITMAP_ERROR. */
+    bool dirty;                         /* FRAME newer than SLOT? */
+    bool in_transit;                    /* Being written to SLOT? */
+  };
+
+/* A shared memory segment: anonymous, zero-filled memory that
+   several processes map at once, each seeing the others'
+   changes.  A segment is found by its NAME until it is unlinked,
+   and freed once it is unlinked and no longer mapped. */
+struct shm
+  {
+    char name[SHM_NAME_MAX + 1];        /* Name. */
+    bool linked;                        /* Still found by name? */
+    atomic_t ref_cnt;                   /* Mappings, plus 1 if LINKED. */
+    struct lock lock;                   /* Serializes page loads. */
+    struct list_elem list_elem;         /* Element in segment list. */
+    size_t page_cnt;                    /* Number of pages. */
+    struct shm_page pages[];            /* Pages. */
+  };
+
+void shm_init (void);
+struct shm *shm_open (const char *name, size_t page_cnt);
+void shm_close (struct shm *);
+bool shm_unlink (const char *name);
+
+#endif /* vm/shm.h */
@@ -1,40 +1,434 @@
 #include "vm/swap.h"
 #include <debug.h>
 #include <bitmap.h>
+#include <crc32c.h>
+#include <list.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include "devices/block.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
+#include "vm/frame.h"
+#include "vm/lz.h"
+#include "vm/vmstat.h"
 
 /* Number of sectors per page. */
 #define PAGE_SECTOR_CNT (PGSIZE / BLOCK_SECTOR_SIZE)
 
+/* Maximum number of swap devices, one per IDE disk. */
+#define SWAP_DEV_MAX 4
+
+/* Maximum number of runs of contiguous sectors in the swap file.
+   See swap_file_grow(). */
+#define SWAP_RUN_MAX 64
+
+/* Number of slots set aside for each run of slots allocated
+   afresh.  See swap_scan(). */
+#define SWAP_CLUSTER 16
+
+/* If true, every block device of type BLOCK_SWAP is used for
+   swap; otherwise only the one assigned the BLOCK_SWAP role.
+   Cleared by kernel command-line option "-swap". */
+bool swap_all_devices = true;
+
+/* A swap device, or a run of the swap file's sectors.  Swap
+   slots are numbered consecutively across all swap devices; the
+   slots of a device form the range [BASE, BASE + SLOTS), stored
+   in the sectors of BDEV from START on. */
+struct swap_dev
+  {
+    struct block *bdev;                 /* Block device. */
+    block_sector_t start;               /* Sector of slot BASE. */
+    size_t base;                        /* First slot. */
+    size_t slots;                       /* Number of slots. */
+    size_t cursor;                      /* Where the next scan starts. */
+  };
+
 /* Mutual exclusion. */
 static struct lock swap_lock;
 
-/* Block device for swapping. */
-static struct block *swap_bdev;
+/* Swap devices, then the swap file's runs. */
+static struct swap_dev swap_devs[SWAP_DEV_MAX + SWAP_RUN_MAX];
+static size_t swap_dev_cnt;
+
+/* Device where the next run of slots is placed, round-robin, so
+   that writes to disks on different channels overlap. */
+static size_t next_dev;
 
 /* Bitmap of free slots. */
 static struct bitmap *used_map;
 
-/* Number of swap slots. */
+/* Number of swap slots, and of those that are free.  USED_MAP
+   and the other tables indexed by slot have room for SLOT_CAP,
+   counting the slots the swap file may grow to, which are
+   marked used until they exist. */
 static size_t swap_slots;
+static size_t free_slots;
+static size_t slot_cap;
+
+/* Swap file.
+
+   Besides, or instead of, swap devices, swap may be a file in
+   the file system, named by kernel command-line option
+   "-swapfile".  The file is preallocated in unwritten extents,
+   so that its data sectors are allocated, contiguous where the
+   free map allows, and never read through the file, which
+   stays open with writes denied.  Each run of its sectors then
+   becomes a swap device of its own in SWAP_DEVS, on the file
+   system device, so that swap I/O goes straight to the sectors
+   with one lookup, bypassing the file and the buffer cache.
+
+   The file starts at SWAP_GROW_SLOTS slots, or its size if it
+   already exists, and grows by SWAP_GROW_SLOTS slots at a time,
+   in the background once fewer than SWAP_GROW_LOW slots are
+   free, and at once if a swap-out finds none, up to
+   SWAP_FILE_MAX_MB.  A page that would straddle two runs is not
+   used. */
+#define SWAP_GROW_SLOTS 256
+#define SWAP_GROW_LOW (4 * SWAP_CLUSTER)
+
+/* Set by kernel command-line options "-swapfile" and
+   "-swapfile-max". */
+const char *swap_file_name;
+size_t swap_file_max_mb = 16;
+
+static struct file *swap_file;
+static size_t file_base;                /* First slot of the file. */
+static size_t file_run_first;           /* Its first run in SWAP_DEVS. */
+static size_t file_slots;               /* File size in slots. */
+static size_t file_max_slots;           /* Largest FILE_SLOTS. */
+static struct lock grow_lock;           /* Serializes growth. */
+static struct work grow_work;           /* Background growth. */
+static long long grow_cnt;              /* Times grown. */
+static size_t unused_slots;             /* Slots straddling runs. */
+
+/* If true, the CRC32C of each page is kept when it is swapped
+   out, in SLOT_CKSUMS, and checked when it is read back, so that
+   a page that the disk or the pool corrupted panics the kernel
+   rather than being handed to a process.  Set by kernel
+   command-line option "-swapck". */
+bool swap_checksums;
+static uint32_t *slot_cksums;
+static long long verified_cnt;          /* Pages checked. */
+
+/* Compressed swap cache ("zswap").
+
+   A page written to a single swap slot is first offered to an
+   in-memory pool of compressed pages.  Pages whose words all
+   have the same value are stored as just that value; others are
+   compressed and kept if they shrink to ZSWAP_MAX_LEN bytes or
+   less and the pool has room, otherwise they go to disk as
+   usual.  The slot stays allocated either way, so a slot number
+   names the page wherever it lives.
+
+   When the pool grows past three quarters of its limit, the
+   "zswap" thread writes the least recently stored pages back to
+   their slots on disk and drops them from the pool.
+
+   A slot whose bit in USED_MAP is clear never has an entry.
+   Lock ordering: ZLOCK before SWAP_LOCK. */
+
+/* Pool size limit, in percent of the kernel pool as of
+   swap_init().  Set by kernel command-line option "-zp"; 0
+   disables the pool. */
+size_t zswap_pool_percent = 10;
+
+/* Compressed pages larger than this go to disk.  Keeping it at
+   half a page means a stored page takes at most half a page of
+   kernel memory from malloc(). */
+#define ZSWAP_MAX_LEN (PGSIZE / 2)
+
+/* A page stored in the pool. */
+struct zentry
+  {
+    size_t slot;                        /* Swap slot. */
+    uint32_t fill;                      /* Word value if LEN == 0. */
+    size_t len;                         /* Compressed size, 0 if same-filled. */
+    uint8_t *data;                      /* Compressed data, if LEN > 0. */
+    struct list_elem lru_elem;          /* In zlru, if LEN > 0. */
+    bool writeback;                     /* Being written to disk? */
+    bool free_pending;                  /* Freed during write back? */
+  };
+
+static struct lock zlock;               /* Protects the pool. */
+static struct condition zpressure;      /* Signaled above high mark. */
+static struct zentry **ztable;          /* Entry per slot, or null. */
+static struct list zlru;                /* Compressed entries, oldest first. */
+static size_t zbytes;                   /* Bytes of compressed data. */
+static size_t zlimit;                   /* Maximum ZBYTES. */
+static uint8_t zbuf[PGSIZE];            /* Compression buffer. */
+
+/* Statistics. */
+static long long zstored_cnt;           /* Pages compressed into the pool. */
+static long long zsame_cnt;             /* Same-filled pages stored. */
+static long long zreject_cnt;           /* Pages sent to disk instead. */
+static long long zwriteback_cnt;        /* Pages written back to disk. */
+static long long zload_cnt;             /* Pages read from the pool. */
+
+static void swap_add_device (struct block *);
+static void swap_file_open (void);
+static bool swap_file_grow (size_t cnt);
+static void swap_file_grow_work (void *aux);
+static struct swap_dev *slot_to_dev (size_t slot, block_sector_t *);
+static size_t swap_alloc (size_t cnt);
+static size_t swap_scan (size_t cnt);
+static size_t swap_scan_span (size_t cnt, size_t span);
+static size_t swap_scan_dev (struct swap_dev *, size_t cnt);
+static void swap_store (const void *kpage, size_t slot);
+static bool zswap_store (const void *kpage, size_t slot);
+static bool zswap_load (void *kpage, size_t slot);
+static bool zswap_present (size_t slot, size_t cnt);
+static bool zswap_drop (size_t slot);
+static void zswap_writeback (void *aux);
 
 /* Initializes the swap slot allocator.  At most SWAP_SLOTS
-   slots are available. */
+   slots are available, striped over the swap devices, plus those
+   of the swap file, if any. */
 void
 swap_init (void)
 {
-  if (!(swap_bdev = block_get_role (BLOCK_SWAP)))
+  struct block *role_bdev, *b;
+
+  role_bdev = block_get_role (BLOCK_SWAP);
+  if (role_bdev == NULL && swap_file_name == NULL)
     PANIC ("no block device has been assigned BLOCK_SWAP.");
 
-  swap_slots = block_size (swap_bdev) / PAGE_SECTOR_CNT;
-  used_map = bitmap_create (swap_slots);
+  if (role_bdev != NULL)
+    swap_add_device (role_bdev);
+  if (swap_all_devices)
+    for (b = block_first (); b != NULL; b = block_next (b))
+      if (b != role_bdev && block_type (b) == BLOCK_SWAP)
+        swap_add_device (b);
+
+  file_base = swap_slots;
+  file_run_first = swap_dev_cnt;
+  if (swap_file_name != NULL)
+    file_max_slots = swap_file_max_mb * (1024 * 1024 / PGSIZE);
+  slot_cap = swap_slots + file_max_slots;
+
+  used_map = bitmap_create (slot_cap);
+  free_slots = swap_slots;
 
   if (!used_map)
     PANIC ("bitmap allocation failed.");
+  bitmap_set_multiple (used_map, swap_slots, slot_cap - swap_slots, true);
+
+  if (swap_checksums)
+    {
+      slot_cksums = calloc (slot_cap, sizeof *slot_cksums);
+      if (slot_cksums == NULL)
+        PANIC ("swap checksum allocation failed.");
+    }
   
   lock_init (&swap_lock);
+  lock_init (&grow_lock);
+  work_init (&grow_work, swap_file_grow_work, NULL);
+
+  lock_init (&zlock);
+  cond_init (&zpressure);
+  list_init (&zlru);
+  zlimit = palloc_free_cnt (0) / 100 * zswap_pool_percent * PGSIZE;
+  if (zlimit > 0)
+    {
+      ztable = calloc (slot_cap, sizeof *ztable);
+      if (ztable == NULL
+          || thread_create ("zswap", PRI_DEFAULT,
+                            zswap_writeback, NULL) == TID_ERROR)
+        {
+          free (ztable);
+          ztable = NULL;
+          zlimit = 0;
+        }
+    }
+
+  if (swap_file_name != NULL)
+    swap_file_open ();
+}
+
+/* Appends block device B to the swap devices. */
+static void
+swap_add_device (struct block *b)
+{
+  struct swap_dev *d;
+
+  if (swap_dev_cnt >= SWAP_DEV_MAX)
+    return;
+
+  d = &swap_devs[swap_dev_cnt++];
+  d->bdev = b;
+  d->start = 0;
+  d->base = swap_slots;
+  d->slots = block_size (b) / PAGE_SECTOR_CNT;
+  d->cursor = d->base;
+  swap_slots += d->slots;
+}
+
+/* Opens the swap file, creating it if needed, and makes its
+   first slots available.  Panics if there is no other swap
+   space and it cannot be set up. */
+static void
+swap_file_open (void)
+{
+  size_t cnt = SWAP_GROW_SLOTS;
+
+  swap_file = filesys_open (swap_file_name);
+  if (swap_file == NULL && filesys_create (swap_file_name, 0))
+    swap_file = filesys_open (swap_file_name);
+  if (swap_file == NULL)
+    {
+      if (swap_slots == 0)
+        PANIC ("cannot open swap file %s.", swap_file_name);
+      printf ("swap: cannot open %s, not using it\n", swap_file_name);
+      return;
+    }
+  file_deny_write (swap_file);
+
+  if ((size_t) file_length (swap_file) / PGSIZE > cnt)
+    cnt = file_length (swap_file) / PGSIZE;
+  if (cnt > file_max_slots)
+    cnt = file_max_slots;
+  if (!swap_file_grow (cnt) && swap_slots == 0)
+    PANIC ("cannot allocate swap file %s.", swap_file_name);
+}
+
+/* Appends SLOT, the next slot of the swap file, at SECTOR of the
+   file system device, to the last run of the file in SWAP_DEVS if
+   it follows it on disk, otherwise to a new run.  Returns false
+   if there are too many runs.  SWAP_LOCK must be held. */
+static bool
+swap_add_run (size_t slot, block_sector_t sector)
+{
+  struct swap_dev *d;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  d = &swap_devs[swap_dev_cnt > 0 ? swap_dev_cnt - 1 : 0];
+  if (swap_dev_cnt > file_run_first && d->base + d->slots == slot
+      && d->start + d->slots * PAGE_SECTOR_CNT == sector)
+    {
+      d->slots++;
+      return true;
+    }
+  if (swap_dev_cnt >= sizeof swap_devs / sizeof *swap_devs)
+    return false;
+
+  d = &swap_devs[swap_dev_cnt];
+  d->bdev = fs_device;
+  d->start = sector;
+  d->base = slot;
+  d->slots = 1;
+  d->cursor = slot;
+
+  /* slot_to_dev() reads SWAP_DEVS without the lock. */
+  barrier ();
+  swap_dev_cnt++;
+  return true;
+}
+
+/* Extends the swap file by up to CNT slots, stopping at its
+   maximum size, and adds the new slots to the free ones.
+   Returns true if any were added.  Only one thread grows the
+   file at a time; others return false at once.  If the disk
+   fills up, the file stops growing. */
+static bool
+swap_file_grow (size_t cnt)
+{
+  struct inode *inode;
+  size_t first, added = 0, i;
+  bool ok;
+
+  if (swap_file == NULL || !lock_try_acquire (&grow_lock))
+    return false;
+
+  first = file_slots;
+  if (cnt > file_max_slots - first)
+    cnt = file_max_slots - first;
+  if (cnt == 0)
+    {
+      lock_release (&grow_lock);
+      return false;
+    }
+
+  inode = file_get_inode (swap_file);
+  file_allow_write (swap_file);
+  ok = inode_preallocate (inode, (off_t) first * PGSIZE,
+                          (off_t) cnt * PGSIZE, true);
+  file_deny_write (swap_file);
+  if (!ok)
+    {
+      printf ("swap: %s is full at %zu slots\n", swap_file_name, first);
+      file_max_slots = first;
+      lock_release (&grow_lock);
+      return false;
+    }
+
+  for (i = first; i < first + cnt; i++)
+    {
+      size_t slot = file_base + i;
+      block_sector_t sector;
+      size_t run;
+
+      sector = inode_sector_run (inode, (off_t) i * PGSIZE, &run);
+
+      /* The sectors may have belonged to a file deleted since,
+         whose dirty buffers the cache would otherwise write back
+         over the swapped-out pages, which bypass it. */
+      if (sector != (block_sector_t) -1 && run >= PAGE_SECTOR_CNT)
+        cache_flush_range (sector, PAGE_SECTOR_CNT);
+
+      lock_acquire (&swap_lock);
+      if (sector != (block_sector_t) -1 && run >= PAGE_SECTOR_CNT
+          && swap_add_run (slot, sector))
+        {
+          bitmap_reset (used_map, slot);
+          free_slots++;
+          added++;
+        }
+      else
+        unused_slots++;
+      swap_slots = slot + 1;
+      lock_release (&swap_lock);
+    }
+  file_slots = first + cnt;
+  grow_cnt++;
+  lock_release (&grow_lock);
+  return added > 0;
+}
+
+/* Grows the swap file in the background. */
+static void
+swap_file_grow_work (void *aux UNUSED)
+{
+  swap_file_grow (SWAP_GROW_SLOTS);
+}
+
+/* Returns the swap device holding SLOT, and stores the sector of
+   the device where SLOT starts into *SECTOR. */
+static struct swap_dev *
+slot_to_dev (size_t slot, block_sector_t *sector)
+{
+  size_t i;
+
+  for (i = 0; i < swap_dev_cnt; i++)
+    {
+      struct swap_dev *d = &swap_devs[i];
+      if (slot >= d->base && slot < d->base + d->slots)
+        {
+          *sector = d->start + (slot - d->base) * PAGE_SECTOR_CNT;
+          return d;
+        }
+    }
+  PANIC ("invalid swap slot %zu.", slot);
 }
 
 /* Writes PGSIZE bytes to a free slot from KPAGE.  Returns the
@@ -43,49 +437,325 @@ swap_init (void)
 size_t
 swap_out (void* kpage)
 {
-  size_t slot;
-  block_sector_t sector;
-  int i;
+  return swap_out_multiple (kpage, 1);
+}
+
+/* Writes PGSIZE bytes from KPAGE to slot HINT if it is free,
+   otherwise to any free slot, and returns the index of the slot
+   used.  HINT may be BITMAP_ERROR.
+   If too few slots are available, kernel panics. */
+size_t
+swap_out_near (void *kpage, size_t hint)
+{
+  size_t slot = swap_try_out (kpage, hint);
+
+  if (slot == BITMAP_ERROR)
+    PANIC ("cannot find any free swap slot.");
+  return slot;
+}
+
+/* Writes PGSIZE bytes from KPAGE to a free slot, as
+   swap_out_near(), but returns BITMAP_ERROR instead of panicking
+   if swap space is exhausted. */
+size_t
+swap_try_out (void *kpage, size_t hint)
+{
+  size_t slot = BITMAP_ERROR;
 
   ASSERT (kpage != NULL);
 
   lock_acquire (&swap_lock);
-  slot = bitmap_scan_and_flip (used_map, 0, 1, false);
+  if (hint < swap_slots && !bitmap_test (used_map, hint))
+    {
+      bitmap_mark (used_map, hint);
+      free_slots--;
+      slot = hint;
+    }
+  lock_release (&swap_lock);
+
+  if (slot == BITMAP_ERROR)
+    slot = swap_alloc (1);
+  if (slot == BITMAP_ERROR)
+    return BITMAP_ERROR;
+
+  swap_store (kpage, slot);
+  return slot;
+}
+
+/* Returns the number of free swap slots. */
+size_t
+swap_free_cnt (void)
+{
+  size_t cnt;
+
+  lock_acquire (&swap_lock);
+  cnt = free_slots;
   lock_release (&swap_lock);
+  return cnt;
+}
+
+/* Stores the page at KPAGE into SLOT, which must be allocated,
+   in the pool if it fits there, otherwise on disk. */
+static void
+swap_store (const void *kpage, size_t slot)
+{
+  struct swap_dev *d;
+  block_sector_t sector;
+
+  TRACE (TRACE_VM, TRACE_SWAP_OUT, slot, 1);
+  VMSTAT_ADD (swap_outs, 1);
+  if (slot_cksums != NULL)
+    slot_cksums[slot] = crc32c (0, kpage, PGSIZE);
+  if (zswap_store (kpage, slot))
+    return;
+
+  d = slot_to_dev (slot, &sector);
+  block_write_multiple (d->bdev, sector, kpage, PAGE_SECTOR_CNT);
+}
+
+/* Finds CNT consecutive free slots on a single swap device,
+   trying the devices round-robin, marks them used and returns
+   the first one.  Returns BITMAP_ERROR if there are none.
+   Must be called with SWAP_LOCK held.
 
-  if (slot != BITMAP_ERROR)
+   Each device is scanned next-fit, from where its last scan left
+   off, so that the cost of a scan does not grow as the device
+   fills from the front.  Runs are placed at the start of a
+   cluster of at least SWAP_CLUSTER free slots where possible, and
+   the device's cursor moves past the whole cluster: the slots
+   after the run stay free for a while, so that swap_out_near()
+   can give the pages a process evicts next the slots that follow
+   its last ones, and swap-in can read them back together. */
+static size_t
+swap_scan (size_t cnt)
+{
+  size_t slot = BITMAP_ERROR;
+
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  if (cnt < SWAP_CLUSTER)
+    slot = swap_scan_span (cnt, SWAP_CLUSTER);
+  if (slot == BITMAP_ERROR)
+    slot = swap_scan_span (cnt, cnt);
+  return slot;
+}
+
+/* Finds SPAN consecutive free slots on a single swap device, as
+   swap_scan(), marks the first CNT of them used and returns the
+   first one, or BITMAP_ERROR if there are none. */
+static size_t
+swap_scan_span (size_t cnt, size_t span)
+{
+  size_t i;
+
+  for (i = 0; i < swap_dev_cnt; i++)
     {
-      sector = slot * PAGE_SECTOR_CNT;
-      for (i = 0; i < PAGE_SECTOR_CNT; i++)
+      struct swap_dev *d = &swap_devs[(next_dev + i) % swap_dev_cnt];
+      size_t slot = swap_scan_dev (d, span);
+
+      if (slot != BITMAP_ERROR)
         {
-          block_write (swap_bdev, sector + i,
-                       kpage + BLOCK_SECTOR_SIZE * i);
+          bitmap_set_multiple (used_map, slot, cnt, true);
+          free_slots -= cnt;
+          d->cursor = slot + span;
+          if (d->cursor >= d->base + d->slots)
+            d->cursor = d->base;
+          next_dev = (next_dev + i + 1) % swap_dev_cnt;
+          return slot;
         }
-      return slot;
     }
-  else
+  return BITMAP_ERROR;
+}
+
+/* Returns the first of CNT consecutive free slots on device D,
+   searching from D's cursor to its end and then from its start,
+   or BITMAP_ERROR if there are none. */
+static size_t
+swap_scan_dev (struct swap_dev *d, size_t cnt)
+{
+  size_t end = d->base + d->slots;
+  size_t slot;
+
+  if (cnt > d->slots)
+    return BITMAP_ERROR;
+
+  slot = bitmap_scan (used_map, d->cursor, cnt, false);
+  if (slot != BITMAP_ERROR && slot + cnt <= end)
+    return slot;
+  if (d->cursor == d->base)
+    return BITMAP_ERROR;
+
+  slot = bitmap_scan (used_map, d->base, cnt, false);
+  if (slot != BITMAP_ERROR && slot + cnt <= end)
+    return slot;
+  return BITMAP_ERROR;
+}
+
+/* Allocates CNT consecutive free slots of one device and returns
+   the first, or BITMAP_ERROR if there are none.
+
+   Slots still held as swap cache by resident pages are reclaimed
+   only when the free slots run out. */
+static size_t
+swap_alloc (size_t cnt)
+{
+  size_t slot;
+  bool low;
+
+  lock_acquire (&swap_lock);
+  slot = swap_scan (cnt);
+  low = free_slots < SWAP_GROW_LOW;
+  lock_release (&swap_lock);
+
+  if (low && swap_file != NULL)
+    work_queue (&system_wq, &grow_work);
+  if (slot == BITMAP_ERROR && swap_file_grow (SWAP_GROW_SLOTS))
+    {
+      lock_acquire (&swap_lock);
+      slot = swap_scan (cnt);
+      lock_release (&swap_lock);
+    }
+  if (slot == BITMAP_ERROR && frame_reclaim_swap () > 0)
+    {
+      lock_acquire (&swap_lock);
+      slot = swap_scan (cnt);
+      lock_release (&swap_lock);
+    }
+  return slot;
+}
+
+/* Writes CNT * PGSIZE bytes from PAGES, which must be contiguous
+   in kernel virtual memory, to CNT consecutive free slots of one
+   device with a single block request.  Returns the index of the
+   first slot.
+   If too few consecutive slots are available, kernel panics. */
+size_t
+swap_out_multiple (const void *pages, size_t cnt)
+{
+  size_t slot, i;
+  struct swap_dev *d;
+  block_sector_t sector;
+
+  ASSERT (pages != NULL);
+  ASSERT (cnt > 0);
+
+  slot = swap_alloc (cnt);
+  if (slot == BITMAP_ERROR)
     PANIC ("cannot find any free swap slot.");
+
+  if (cnt == 1)
+    {
+      swap_store (pages, slot);
+      return slot;
+    }
+
+  TRACE (TRACE_VM, TRACE_SWAP_OUT, slot, cnt);
+  VMSTAT_ADD (swap_outs, cnt);
+  if (slot_cksums != NULL)
+    for (i = 0; i < cnt; i++)
+      slot_cksums[slot + i] = crc32c (0, (const uint8_t *) pages
+                                      + i * PGSIZE, PGSIZE);
+  d = slot_to_dev (slot, &sector);
+  block_write_multiple (d->bdev, sector, pages, cnt * PAGE_SECTOR_CNT);
+  return slot;
 }
 
 /* Reads PGSIZE bytes from SLOT into KPAGE and frees SLOT. */
 void
 swap_in (void *kpage, size_t slot)
 {
+  swap_in_multiple (kpage, slot, 1);
+}
+
+/* Reads PGSIZE bytes from SLOT into KPAGE, leaving SLOT
+   allocated, so that the copy may be reused if the page is
+   evicted again without being modified. */
+void
+swap_read (void *kpage, size_t slot)
+{
+  struct swap_dev *d;
   block_sector_t sector;
-  int i;
 
   ASSERT (kpage != NULL);
   ASSERT (slot != BITMAP_ERROR);
 
-  sector = slot * PAGE_SECTOR_CNT;
-  for (i = 0; i < PAGE_SECTOR_CNT; i++)
+  VMSTAT_ADD (swap_ins, 1);
+  if (!zswap_load (kpage, slot))
     {
-      block_read (swap_bdev, sector + i,
-                  kpage + BLOCK_SECTOR_SIZE * i);
+      d = slot_to_dev (slot, &sector);
+      block_read_multiple (d->bdev, sector, kpage, PAGE_SECTOR_CNT);
     }
+  swap_verify (kpage, slot);
+}
 
-  ASSERT (bitmap_all (used_map, slot, 1));
-  bitmap_set_multiple (used_map, slot, 1, false);
+/* Starts reading PGSIZE bytes from SLOT into KPAGE, as
+   swap_read(), but returns without waiting.  The read is
+   described by R; block_wait(R) waits for it to complete, after
+   which the caller should pass the page to swap_verify(). */
+void
+swap_read_async (void *kpage, size_t slot, struct block_request *r)
+{
+  struct swap_dev *d;
+  block_sector_t sector;
+
+  ASSERT (kpage != NULL);
+  ASSERT (slot != BITMAP_ERROR);
+
+  VMSTAT_ADD (swap_ins, 1);
+  if (zswap_load (kpage, slot))
+    {
+      /* Already done: make block_wait(R) return at once. */
+      sema_init (&r->done, 1);
+      return;
+    }
+
+  d = slot_to_dev (slot, &sector);
+  block_submit (d->bdev, r, sector, kpage, PAGE_SECTOR_CNT, false);
+}
+
+/* Reads CNT consecutive slots starting at SLOT into PAGES, which
+   must have room for CNT * PGSIZE bytes, with a single block
+   request if the slots are on one device.  Then frees the
+   slots. */
+void
+swap_in_multiple (void *pages, size_t slot, size_t cnt)
+{
+  struct swap_dev *d;
+  block_sector_t sector;
+  size_t i;
+
+  ASSERT (pages != NULL);
+  ASSERT (slot != BITMAP_ERROR);
+  ASSERT (cnt > 0);
+
+  TRACE (TRACE_VM, TRACE_SWAP_IN, slot, cnt);
+  d = slot_to_dev (slot, &sector);
+  if (slot + cnt <= d->base + d->slots && !zswap_present (slot, cnt))
+    {
+      VMSTAT_ADD (swap_ins, cnt);
+      block_read_multiple (d->bdev, sector, pages, cnt * PAGE_SECTOR_CNT);
+      for (i = 0; i < cnt; i++)
+        swap_verify ((uint8_t *) pages + i * PGSIZE, slot + i);
+    }
+  else
+    for (i = 0; i < cnt; i++)
+      swap_read ((uint8_t *) pages + i * PGSIZE, slot + i);
+
+  for (i = 0; i < cnt; i++)
+    swap_free (slot + i);
+}
+
+/* Panics if swap checksums are on and the page at KPAGE, just
+   read from SLOT, is not what was written there. */
+void
+swap_verify (const void *kpage, size_t slot)
+{
+  if (slot_cksums == NULL)
+    return;
+
+  if (crc32c (0, kpage, PGSIZE) != slot_cksums[slot])
+    PANIC ("swap slot %zu failed its checksum.", slot);
+  verified_cnt++;
 }
 
 /* Just frees SLOT. */
@@ -93,7 +763,243 @@ void
 swap_free (size_t slot)
 {
   ASSERT (slot != BITMAP_ERROR);
+
+  if (zswap_drop (slot))
+    return;
+
+  lock_acquire (&swap_lock);
   ASSERT (bitmap_all (used_map, slot, 1));
-  
   bitmap_set_multiple (used_map, slot, 1, false);
-}
\ No newline at end of file
+  free_slots++;
+  lock_release (&swap_lock);
+}
+
+/* Returns true if every 32-bit word of the page at KPAGE equals
+   the first, storing that word into *FILL. */
+static bool
+page_same_filled (const void *kpage, uint32_t *fill)
+{
+  const uint32_t *w = kpage;
+  size_t i;
+
+  for (i = 1; i < PGSIZE / sizeof *w; i++)
+    if (w[i] != w[0])
+      return false;
+  *fill = w[0];
+  return true;
+}
+
+/* Tries to store the page at KPAGE as SLOT in the pool.  Returns
+   true if successful, false if the page must go to disk. */
+static bool
+zswap_store (const void *kpage, size_t slot)
+{
+  struct zentry *e;
+  uint32_t fill = 0;
+  size_t len = 0;
+
+  if (ztable == NULL)
+    return false;
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    return false;
+
+  lock_acquire (&zlock);
+  ASSERT (ztable[slot] == NULL);
+  if (!page_same_filled (kpage, &fill))
+    {
+      len = lz_compress (kpage, PGSIZE, zbuf, ZSWAP_MAX_LEN);
+      if (len == 0 || zbytes + len > zlimit
+          || (e->data = malloc (len)) == NULL)
+        {
+          zreject_cnt++;
+          lock_release (&zlock);
+          free (e);
+          return false;
+        }
+      memcpy (e->data, zbuf, len);
+      list_push_back (&zlru, &e->lru_elem);
+      zbytes += len;
+      zstored_cnt++;
+      if (zbytes > zlimit / 4 * 3)
+        cond_signal (&zpressure, &zlock);
+    }
+  else
+    zsame_cnt++;
+  e->slot = slot;
+  e->fill = fill;
+  e->len = len;
+  e->writeback = false;
+  e->free_pending = false;
+  ztable[slot] = e;
+  lock_release (&zlock);
+  return true;
+}
+
+/* Frees entry E, which must already be out of ZTABLE. */
+static void
+zentry_free (struct zentry *e)
+{
+  ASSERT (lock_held_by_current_thread (&zlock));
+
+  if (e->len > 0)
+    {
+      if (!e->writeback)
+        list_remove (&e->lru_elem);
+      zbytes -= e->len;
+      free (e->data);
+    }
+  free (e);
+}
+
+/* If SLOT is in the pool, reads it into KPAGE and returns true.
+   Otherwise returns false. */
+static bool
+zswap_load (void *kpage, size_t slot)
+{
+  struct zentry *e;
+  bool ok;
+
+  if (ztable == NULL)
+    return false;
+
+  lock_acquire (&zlock);
+  e = ztable[slot];
+  if (e == NULL)
+    {
+      lock_release (&zlock);
+      return false;
+    }
+  if (e->len == 0)
+    {
+      uint32_t *w = kpage;
+      size_t i;
+
+      for (i = 0; i < PGSIZE / sizeof *w; i++)
+        w[i] = e->fill;
+      ok = true;
+    }
+  else
+    ok = lz_decompress (e->data, e->len, kpage, PGSIZE);
+  zload_cnt++;
+  lock_release (&zlock);
+
+  if (!ok)
+    PANIC ("corrupt compressed swap slot %zu.", slot);
+  return true;
+}
+
+/* Returns true if any of the CNT slots starting at SLOT is in the
+   pool. */
+static bool
+zswap_present (size_t slot, size_t cnt)
+{
+  bool present = false;
+  size_t i;
+
+  if (ztable == NULL)
+    return false;
+
+  lock_acquire (&zlock);
+  for (i = 0; i < cnt && !present; i++)
+    present = ztable[slot + i] != NULL;
+  lock_release (&zlock);
+  return present;
+}
+
+/* Drops SLOT from the pool, if it is there.  Returns true if the
+   slot is being written back, in which case the write back frees
+   it once it completes; otherwise the caller frees the slot. */
+static bool
+zswap_drop (size_t slot)
+{
+  struct zentry *e;
+  bool deferred = false;
+
+  if (ztable == NULL)
+    return false;
+
+  lock_acquire (&zlock);
+  e = ztable[slot];
+  if (e != NULL)
+    {
+      if (e->writeback)
+        {
+          e->free_pending = true;
+          deferred = true;
+        }
+      else
+        {
+          ztable[slot] = NULL;
+          zentry_free (e);
+        }
+    }
+  lock_release (&zlock);
+  return deferred;
+}
+
+/* Writes back pages from the pool to disk, oldest first, whenever
+   the pool is more than three quarters full, until it is at most
+   half full.  Entries stay readable from the pool while being
+   written. */
+static void
+zswap_writeback (void *aux UNUSED)
+{
+  void *kpage = palloc_get_page (PAL_ASSERT);
+
+  lock_acquire (&zlock);
+  for (;;)
+    {
+      struct zentry *e;
+      struct swap_dev *d;
+      block_sector_t sector;
+      size_t slot;
+      bool freed;
+
+      while (zbytes <= zlimit / 4 * 3)
+        cond_wait (&zpressure, &zlock);
+
+      while (zbytes > zlimit / 2 && !list_empty (&zlru))
+        {
+          e = list_entry (list_pop_front (&zlru), struct zentry, lru_elem);
+          e->writeback = true;
+          slot = e->slot;
+          if (!lz_decompress (e->data, e->len, kpage, PGSIZE))
+            PANIC ("corrupt compressed swap slot %zu.", slot);
+          lock_release (&zlock);
+
+          d = slot_to_dev (slot, &sector);
+          block_write_multiple (d->bdev, sector, kpage, PAGE_SECTOR_CNT);
+
+          lock_acquire (&zlock);
+          freed = e->free_pending;
+          ztable[slot] = NULL;
+          zentry_free (e);
+          zwriteback_cnt++;
+          if (freed)
+            {
+              lock_acquire (&swap_lock);
+              bitmap_reset (used_map, slot);
+              free_slots++;
+              lock_release (&swap_lock);
+            }
+        }
+    }
+}
+
+/* Prints compressed swap statistics. */
+void
+swap_print_stats (void)
+{
+  printf ("Swap: %lld pages compressed, %lld same-filled, "
+          "%lld rejected, %lld written back, %lld loaded\n",
+          zstored_cnt, zsame_cnt, zreject_cnt, zwriteback_cnt, zload_cnt);
+  if (slot_cksums != NULL)
+    printf ("Swap: %lld pages verified\n", verified_cnt);
+  if (swap_file != NULL)
+    printf ("Swap: file %s of %zu slots in %zu runs, grown %lld times, "
+            "%zu slots unused\n", swap_file_name, file_slots,
+            swap_dev_cnt - file_run_first, grow_cnt,
+            unused_slots);
+}
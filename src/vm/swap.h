@@ -1,12 +1,36 @@
 #ifndef VM_SWAP_H
 #define VM_SWAP_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <bitmap.h>
+#include "devices/block.h"
+
+/* Stripe swap over every swap device?  See swap.c. */
+extern bool swap_all_devices;
+
+/* Compressed swap pool size, in percent of kernel memory. */
+extern size_t zswap_pool_percent;
+
+/* Swap file name, or null, and its maximum size in MB. */
+extern const char *swap_file_name;
+extern size_t swap_file_max_mb;
+
+/* Verify swapped in pages against checksums? */
+extern bool swap_checksums;
 
 void swap_init (void);
 size_t swap_out (void *);
+size_t swap_out_near (void *, size_t hint);
+size_t swap_try_out (void *, size_t hint);
+size_t swap_free_cnt (void);
+size_t swap_out_multiple (const void *, size_t cnt);
 void swap_in (void *, size_t);
+void swap_read (void *, size_t);
+void swap_read_async (void *, size_t, struct block_request *);
+void swap_verify (const void *, size_t);
+void swap_in_multiple (void *, size_t, size_t cnt);
 void swap_free (size_t);
+void swap_print_stats (void);
 
 #endif /* vm/swap.h */
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "vm/uffd.h"
+#include <debug.h>
+#include <stdint.h>
+#include "lib/user/syscall.h"
+#include "threads/malloc.h"
+#include "threads/poll.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pipe.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+/* User fault handling.
+
+   uffd_register() makes a range of a process's address space a
+   region whose pages start out missing, of type PG_UFFD, rather
+   than zero-filled, and returns a file descriptor for the read
+   end of a pipe whose write end belongs to the region's struct
+   uffd.  A thread that faults on a missing page writes a struct
+   uffd_msg for it into the pipe and sleeps, with its process's
+   address space unlocked, until a handler thread, usually
+   another thread of the same process that reads or poll()s the
+   descriptor, fills the page in with uffd_copy() or the handler
+   goes away.  Only the threads that touch that page wait; the
+   rest of the process runs on.
+
+   A page filled in is an ordinary anonymous page from then on,
+   written to swap when evicted, so the handler hears of each
+   page only once, unless madvise(MADV_DONTNEED) makes it missing
+   again.  Once the descriptor is closed, or if fork() copied the
+   region into a process that has no handler, missing pages are
+   filled with zeros as they fault. */
+struct uffd
+  {
+    struct lock lock;                   /* Protects REF_CNT, RESOLVED,
+                                           SEQ. */
+    struct lock send_lock;              /* Keeps messages whole. */
+    struct poll_queue resolved;         /* Woken as pages are filled. */
+    struct pipe *pipe;                  /* Pipe for messages. */
+    int ref_cnt;                        /* References, from regions
+                                           and waiting threads. */
+    unsigned seq;                       /* Bumped by uffd_wake(). */
+  };
+
+/* Creates a struct uffd with one reference, and a pipe whose
+   write end it holds and whose read end is left for the caller
+   to open a file descriptor on, or to close.  Returns a null
+   pointer if memory is short. */
+struct uffd *
+uffd_create (void)
+{
+  struct uffd *u = malloc (sizeof *u);
+
+  if (u == NULL)
+    return NULL;
+  u->pipe = pipe_create ();
+  if (u->pipe == NULL)
+    {
+      free (u);
+      return NULL;
+    }
+  lock_init (&u->lock);
+  lock_init (&u->send_lock);
+  poll_queue_init (&u->resolved);
+  u->ref_cnt = 1;
+  u->seq = 0;
+  return u;
+}
+
+/* Returns U's pipe. */
+struct pipe *
+uffd_pipe (struct uffd *u)
+{
+  return u->pipe;
+}
+
+/* Adds a reference to U, for a region split off another or for
+   a thread waiting in uffd_wait(). */
+void
+uffd_dup (struct uffd *u)
+{
+  lock_acquire (&u->lock);
+  u->ref_cnt++;
+  lock_release (&u->lock);
+}
+
+/* Drops a reference to U, freeing it and closing the write end
+   of its pipe along with the last one. */
+void
+uffd_close (struct uffd *u)
+{
+  bool destroy;
+
+  lock_acquire (&u->lock);
+  destroy = --u->ref_cnt == 0;
+  lock_release (&u->lock);
+  if (destroy)
+    {
+      pipe_close (u->pipe, true);
+      free (u);
+    }
+}
+
+/* Reports a fault on UPAGE, a missing page of a region of U,
+   accessed for writing if WRITE is true, to U's handler, and
+   waits until the page is filled in.  Returns true if it was, if
+   it was unmapped, or if the process must exit, in which case
+   the access should just be retried.  Returns false, at once or
+   once it goes away, if there is no handler to fill the page in.
+
+   The process's address space is unlocked during the wait, so
+   that the handler can fill the page in, so U is held by a
+   reference of its own, in case the region goes away, and the
+   page is looked up again, with the address space locked, each
+   time uffd_wake() is called. */
+bool
+uffd_wait (struct uffd *u, void *upage, bool write)
+{
+  struct uffd_msg msg;
+  struct poller poller;
+  struct poll_waiter w, hup;
+  bool resolved = false;
+  size_t sent = 0;
+  unsigned seq;
+  bool relock;
+
+  uffd_dup (u);
+  lock_acquire (&u->lock);
+  seq = u->seq;
+  lock_release (&u->lock);
+  relock = process_drop_lock ();
+
+  msg.addr = upage;
+  msg.write = write;
+  msg.tid = thread_tid ();
+  msg.reserved = 0;
+
+  lock_acquire (&u->send_lock);
+  while (sent < sizeof msg)
+    {
+      size_t n = pipe_write (u->pipe, (uint8_t *) &msg + sent,
+                             sizeof msg - sent);
+
+      sent += n;
+      if (n == 0 && !pipe_wait (u->pipe, true))
+        break;
+    }
+  lock_release (&u->send_lock);
+
+  poller_init (&poller, -1);
+  w.queue = hup.queue = NULL;
+  while (sent == sizeof msg)
+    {
+      bool woken;
+
+      /* Join the queues before looking, so that a wakeup in the
+         meantime is not missed. */
+      lock_acquire (&u->lock);
+      poll_queue_remove (&w);
+      poll_queue_add (&u->resolved, &w, &poller);
+      woken = u->seq != seq;
+      seq = u->seq;
+      lock_release (&u->lock);
+      poll_queue_remove (&hup);
+      pipe_poll_add (u->pipe, &hup, &poller);
+
+      if (woken)
+        {
+          struct page *p;
+
+          process_retake_lock (relock);
+          p = page_lookup (upage);
+          resolved = (p == NULL || p->type != PG_UFFD
+                      || process_must_exit ());
+          relock = process_drop_lock ();
+          if (resolved)
+            break;
+        }
+      else if (pipe_hung_up (u->pipe, true))
+        break;
+      else
+        poller_wait (&poller);
+    }
+  poll_queue_remove (&w);
+  poll_queue_remove (&hup);
+  poller_done (&poller);
+
+  process_retake_lock (relock);
+  uffd_close (u);
+  return resolved;
+}
+
+/* Wakes up the threads waiting in uffd_wait() on U, to check
+   whether their pages have been filled in, or whether they must
+   exit. */
+void
+uffd_wake (struct uffd *u)
+{
+  lock_acquire (&u->lock);
+  u->seq++;
+  poll_wake (&u->resolved);
+  lock_release (&u->lock);
+}
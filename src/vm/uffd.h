@@ -0,0 +1,17 @@
+#ifndef VM_UFFD_H
+#define VM_UFFD_H
+
+#include <stdbool.h>
+
+/* User fault handling.  See uffd.c. */
+struct uffd;
+struct pipe;
+
+struct uffd *uffd_create (void);
+struct pipe *uffd_pipe (struct uffd *);
+void uffd_dup (struct uffd *);
+void uffd_close (struct uffd *);
+bool uffd_wait (struct uffd *, void *upage, bool write);
+void uffd_wake (struct uffd *);
+
+#endif /* vm/uffd.h */
@@ -0,0 +1,48 @@
+#include "vm/vmstat.h"
+#include <stdio.h>
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* System-wide statistics. */
+struct vmstat vmstat_total;
+
+/* Records a page fault serviced in CYCLES TSC cycles. */
+void
+vmstat_record_latency (uint64_t cycles)
+{
+  size_t bucket = 0;
+
+  for (cycles >>= 11; cycles > 0 && bucket < VMSTAT_LATENCY_BUCKETS - 1;
+       cycles >>= 1)
+    bucket++;
+  VMSTAT_ADD (latency[bucket], 1);
+}
+
+/* Prints virtual memory statistics. */
+void
+vm_print_stats (void)
+{
+  const struct vmstat *s = &vmstat_total;
+  size_t i;
+
+  frame_print_stats ();
+  page_print_stats ();
+  swap_print_stats ();
+
+  printf ("VM: %lld minor faults, %lld major faults "
+          "(%lld file, %lld swap, %lld zero, %lld copy-on-write)\n",
+          s->minor_faults, s->major_faults,
+          s->file_faults, s->swap_faults, s->zero_faults,
+          s->cow_faults);
+  printf ("VM: %lld evictions, %lld frames scanned, "
+          "%lld frame lock conflicts\n",
+          s->evictions, s->scan_steps, s->lock_contention);
+  printf ("VM: %lld swap ins, %lld swap outs, %lld file write-backs\n",
+          s->swap_ins, s->swap_outs, s->file_writes);
+  printf ("VM: fault latency (log2 cycles):");
+  for (i = 0; i < VMSTAT_LATENCY_BUCKETS; i++)
+    if (s->latency[i] > 0)
+      printf (" %zu:%lld", i + 10, s->latency[i]);
+  printf ("\n");
+}
@@ -0,0 +1,25 @@
+#ifndef VM_VMSTAT_H
+#define VM_VMSTAT_H
+
+#include <stdint.h>
+#include <vmstat.h>
+#include "threads/thread.h"
+
+/* System-wide statistics.  Per-process statistics are in
+   struct thread. */
+extern struct vmstat vmstat_total;
+
+/* Adds N to counter FIELD of both the system-wide and the
+   current process's statistics. */
+#define VMSTAT_ADD(FIELD, N)                            \
+        do                                              \
+          {                                             \
+            vmstat_total.FIELD += (N);                  \
+            thread_current ()->vmstat.FIELD += (N);     \
+          }                                             \
+        while (0)
+
+void vmstat_record_latency (uint64_t cycles);
+void vm_print_stats (void);
+
+#endif /* vm/vmstat.h */